@@ -86,6 +86,17 @@ typedef EGLBoolean (EGLAPIENTRYP PFNEGLSWAPBUFFERSREGIONNOK) (EGLDisplay dpy, EG
 #define EGL_DRM_BUFFER_FORMAT_RGB565_MESA       0x3292
 #endif /* EGL_MESA_drm_image_formats */
 
+#ifndef EGL_MESA_pbuffer_swap_chain
+#define EGL_MESA_pbuffer_swap_chain 1
+#define EGL_SWAP_CHAIN_LENGTH_MESA              0x3293
+#ifdef EGL_EGLEXT_PROTOTYPES
+EGLAPI EGLBoolean EGLAPIENTRY eglAcquireSwapChainImageMESA(EGLDisplay dpy, EGLSurface surface, EGLImageKHR *image, EGLint *fence_fd);
+EGLAPI EGLBoolean EGLAPIENTRY eglReleaseSwapChainImageMESA(EGLDisplay dpy, EGLSurface surface, EGLImageKHR image);
+#endif
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLACQUIRESWAPCHAINIMAGEMESAPROC) (EGLDisplay dpy, EGLSurface surface, EGLImageKHR *image, EGLint *fence_fd);
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLRELEASESWAPCHAINIMAGEMESAPROC) (EGLDisplay dpy, EGLSurface surface, EGLImageKHR image);
+#endif /* EGL_MESA_pbuffer_swap_chain */
+
 #ifdef __cplusplus
 }
 #endif
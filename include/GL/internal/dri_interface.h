@@ -83,6 +83,7 @@ typedef struct __DRI2throttleExtensionRec	__DRI2throttleExtension;
 typedef struct __DRI2fenceExtensionRec          __DRI2fenceExtension;
 typedef struct __DRI2interopExtensionRec	__DRI2interopExtension;
 typedef struct __DRI2blobExtensionRec           __DRI2blobExtension;
+typedef struct __DRI2bufferDamageExtensionRec   __DRI2bufferDamageExtension;
 
 typedef struct __DRIimageLoaderExtensionRec     __DRIimageLoaderExtension;
 typedef struct __DRIimageDriverExtensionRec     __DRIimageDriverExtension;
@@ -361,6 +362,29 @@ struct __DRI2blobExtensionRec {
                             __DRIblobCacheSet set, __DRIblobCacheGet get);
 };
 
+/**
+ * Extension for EGL_KHR_partial_update
+ */
+
+#define __DRI2_BUFFER_DAMAGE "DRI2_BufferDamage"
+#define __DRI2_BUFFER_DAMAGE_VERSION 1
+
+struct __DRI2bufferDamageExtensionRec {
+   __DRIextension base;
+
+   /**
+    * Set the region of the back buffer the current frame will change,
+    * rects are x, y, width, height quadruples with the origin at the
+    * bottom left. The driver may leave everything outside of them as it
+    * was. nrects 0 resets the region to the whole buffer, the loader does
+    * it after each swap.
+    *
+    * May be NULL if the driver doesn't use the damage region.
+    */
+   void (*set_damage_region) (__DRIdrawable *drawable,
+                              unsigned int nrects, int *rects);
+};
+
 /**
  * Extension for fences / synchronization objects.
  */
@@ -41,6 +41,10 @@
  *    built-in function signatures, where they're available, what types they
  *    take, and so on.
  *
+ *    The lists are first run to only register the names of the functions.
+ *    The signatures of a function are built on its first lookup, by running
+ *    the lists again for that function alone.
+ *
  * 4. Implementations of built-in function signatures
  *
  *    A series of functions which create ir_function_signatures and emit IR
@@ -663,6 +667,11 @@ public:
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   /**
+    * Look up a function, building its signatures if it hasn't been yet.
+    */
+   ir_function *get_function(const char *name);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
@@ -675,10 +684,22 @@ public:
 private:
    void *mem_ctx;
 
+   /**
+    * The function whose signatures are being built, NULL when the lists
+    * only register the names.
+    */
+   const char *building;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
 
+   /**
+    * Whether the lists must build the signatures of a function, registers
+    * it otherwise.
+    */
+   bool want_function(const char *name);
+
    /**
     * IR builder helpers:
     *
@@ -709,7 +730,7 @@ private:
     */
    ir_call *call(ir_function *f, ir_variable *ret, exec_list params);
 
-   /** Create a new function and add the given signatures. */
+   /** Add the given signatures to a registered function. */
    void add_function(const char *name, ...);
 
    typedef ir_function_signature *(builtin_builder::*image_prototype_ctr)(const glsl_type *image_type,
@@ -1023,6 +1044,7 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   building = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1043,7 +1065,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1064,10 +1086,45 @@ builtin_builder::initialize()
 
    mem_ctx = ralloc_context(NULL);
    create_shader();
+
+   /* Only register the names, see get_function(). */
    create_intrinsics();
    create_builtins();
 }
 
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+
+   /* Every function has at least one signature once built.  Building one
+    * can build the intrinsics it calls, hence the save of the previous
+    * building function.
+    */
+   if (f != NULL && f->signatures.is_empty()) {
+      const char *prev = building;
+
+      building = f->name;
+      create_intrinsics();
+      create_builtins();
+      building = prev;
+   }
+
+   return f;
+}
+
+bool
+builtin_builder::want_function(const char *name)
+{
+   if (building == NULL) {
+      if (shader->symbols->get_function(name) == NULL)
+         shader->symbols->add_function(new(mem_ctx) ir_function(name));
+      return false;
+   }
+
+   return strcmp(name, building) == 0;
+}
+
 void
 builtin_builder::release()
 {
@@ -1091,6 +1148,14 @@ builtin_builder::create_shader()
 
 /** @} */
 
+/**
+ * The arguments of add_function() create the signatures, so they must only
+ * be evaluated when the function is being built.
+ */
+#define add_function(NAME, ...)           \
+   if (want_function(NAME))               \
+      add_function(NAME, __VA_ARGS__)
+
 /**
  * Create ir_function and ir_function_signature objects for each
  * intrinsic.
@@ -3349,12 +3414,14 @@ builtin_builder::create_builtins()
 #undef FIU2_MIXED
 }
 
+#undef add_function
+
 void
 builtin_builder::add_function(const char *name, ...)
 {
    va_list ap;
 
-   ir_function *f = new(mem_ctx) ir_function(name);
+   ir_function *f = shader->symbols->get_function(name);
 
    va_start(ap, name);
    while (true) {
@@ -3371,8 +3438,6 @@ builtin_builder::add_function(const char *name, ...)
       f->add_signature(sig);
    }
    va_end(ap);
-
-   shader->symbols->add_function(f);
 }
 
 void
@@ -3419,7 +3484,10 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
-   ir_function *f = new(mem_ctx) ir_function(name);
+   if (!want_function(name))
+      return;
+
+   ir_function *f = shader->symbols->get_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
       if ((types[i]->sampled_type != GLSL_TYPE_FLOAT ||
@@ -3429,8 +3497,6 @@ builtin_builder::add_image_function(const char *name,
          f->add_signature(_image(prototype, types[i], intrinsic_name,
                                  num_arguments, flags, intrinsic_id));
    }
-
-   shader->symbols->add_function(f);
 }
 
 void
@@ -5839,7 +5905,7 @@ builtin_builder::_atomic_counter_op(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 1, counter);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5869,8 +5935,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
       parameters.push_tail(new(mem_ctx) ir_dereference_variable(counter));
       parameters.push_tail(new(mem_ctx) ir_dereference_variable(neg_data));
 
-      ir_function *const func =
-         shader->symbols->get_function("__intrinsic_atomic_add");
+      ir_function *const func = get_function("__intrinsic_atomic_add");
       ir_instruction *const c = call(func, retval, parameters);
 
       assert(c != NULL);
@@ -5878,7 +5943,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
 
       body.emit(c);
    } else {
-      body.emit(call(shader->symbols->get_function(intrinsic), retval,
+      body.emit(call(get_function(intrinsic), retval,
                      sig->parameters));
    }
 
@@ -5896,7 +5961,7 @@ builtin_builder::_atomic_counter_op2(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 3, counter, compare, data);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5912,7 +5977,7 @@ builtin_builder::_atomic_op2(const char *intrinsic,
    MAKE_SIG(type, avail, 2, atomic, data);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5929,7 +5994,7 @@ builtin_builder::_atomic_op3(const char *intrinsic,
    MAKE_SIG(type, avail, 3, atomic, data1, data2);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6118,7 +6183,7 @@ builtin_builder::_image(image_prototype_ctr prototype,
 
    if (flags & IMAGE_FUNCTION_EMIT_STUB) {
       ir_factory body(&sig->body, mem_ctx);
-      ir_function *f = shader->symbols->get_function(intrinsic_name);
+      ir_function *f = get_function(intrinsic_name);
 
       if (flags & IMAGE_FUNCTION_RETURNS_VOID) {
          body.emit(call(f, NULL, sig->parameters));
@@ -6151,7 +6216,7 @@ builtin_builder::_memory_barrier(const char *intrinsic_name,
                                  builtin_available_predicate avail)
 {
    MAKE_SIG(glsl_type::void_type, avail, 0);
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   NULL, sig->parameters));
    return sig;
 }
@@ -6173,7 +6238,7 @@ builtin_builder::_ballot()
    MAKE_SIG(glsl_type::uint64_t_type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(glsl_type::uint64_t_type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_ballot"),
+   body.emit(call(get_function("__intrinsic_ballot"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6196,7 +6261,7 @@ builtin_builder::_read_first_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_first_invocation"),
+   body.emit(call(get_function("__intrinsic_read_first_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6221,7 +6286,7 @@ builtin_builder::_read_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 2, value, invocation);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_invocation"),
+   body.emit(call(get_function("__intrinsic_read_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6243,7 +6308,7 @@ builtin_builder::_shader_clock(builtin_available_predicate avail,
 
    ir_variable *retval = body.make_temp(glsl_type::uvec2_type, "clock_retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_shader_clock"),
+   body.emit(call(get_function("__intrinsic_shader_clock"),
                   retval, sig->parameters));
 
    if (type == glsl_type::uint64_t_type) {
@@ -6274,7 +6339,7 @@ builtin_builder::_vote(const char *intrinsic_name,
 
    ir_variable *retval = body.make_temp(glsl_type::bool_type, "retval");
 
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6326,7 +6391,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
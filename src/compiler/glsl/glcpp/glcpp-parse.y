@@ -107,6 +107,9 @@ _parser_active_list_pop(glcpp_parser_t *parser);
 static int
 _parser_active_list_contains(glcpp_parser_t *parser, const char *identifier);
 
+static macro_t *
+_glcpp_parser_lookup_macro(glcpp_parser_t *parser, const char *identifier);
+
 typedef enum {
    EXPANSION_MODE_IGNORE_DEFINED,
    EXPANSION_MODE_EVALUATE_DEFINED
@@ -355,15 +358,11 @@ control_line_success:
 		_glcpp_parser_skip_stack_push_if (parser, & @1, 0);
 	}
 |	HASH_TOKEN IFDEF IDENTIFIER junk NEWLINE {
-		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
-		macro_t *macro = entry ? entry->data : NULL;
+		macro_t *macro = _glcpp_parser_lookup_macro (parser, $3);
 		_glcpp_parser_skip_stack_push_if (parser, & @1, macro != NULL);
 	}
 |	HASH_TOKEN IFNDEF IDENTIFIER junk NEWLINE {
-		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
-		macro_t *macro = entry ? entry->data : NULL;
+		macro_t *macro = _glcpp_parser_lookup_macro (parser, $3);
 		_glcpp_parser_skip_stack_push_if (parser, & @3, macro == NULL);
 	}
 |	HASH_TOKEN ELIF pp_tokens NEWLINE {
@@ -1359,6 +1358,7 @@ glcpp_parser_create(const struct gl_extensions *extension_list,
    parser->defines = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
                                              _mesa_key_string_equal);
    parser->linalloc = linear_alloc_parent(parser, 0);
+   memset(parser->macro_filter, 0, sizeof(parser->macro_filter));
    parser->active = NULL;
    parser->lexing_directive = 0;
    parser->lexing_version_directive = 0;
@@ -1584,8 +1584,8 @@ _glcpp_parser_evaluate_defined(glcpp_parser_t *parser, token_node_t *node,
 
    *last = node;
 
-   return _mesa_hash_table_search(parser->defines,
-                                  argument->token->value.str) ? 1 : 0;
+   return _glcpp_parser_lookup_macro(parser,
+                                     argument->token->value.str) ? 1 : 0;
 
 FAIL:
    glcpp_error (&defined->token->location, parser,
@@ -1724,10 +1724,9 @@ _glcpp_parser_apply_pastes(glcpp_parser_t *parser, token_list_t *list)
  */
 static token_list_t *
 _glcpp_parser_expand_function(glcpp_parser_t *parser, token_node_t *node,
-                              token_node_t **last, expansion_mode_t mode)
+                              macro_t *macro, token_node_t **last,
+                              expansion_mode_t mode)
 {
-   struct hash_entry *entry;
-   macro_t *macro;
    const char *identifier;
    argument_list_t *arguments;
    function_status_t status;
@@ -1736,9 +1735,6 @@ _glcpp_parser_expand_function(glcpp_parser_t *parser, token_node_t *node,
 
    identifier = node->token->value.str;
 
-   entry = _mesa_hash_table_search(parser->defines, identifier);
-   macro = entry ? entry->data : NULL;
-
    assert(macro->is_function);
 
    arguments = _argument_list_create(parser);
@@ -1833,7 +1829,6 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
 {
    token_t *token = node->token;
    const char *identifier;
-   struct hash_entry *entry;
    macro_t *macro;
 
    /* We only expand identifiers */
@@ -1857,8 +1852,7 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
    }
 
    /* Look up this identifier in the hash table. */
-   entry = _mesa_hash_table_search(parser->defines, identifier);
-   macro = entry ? entry->data : NULL;
+   macro = _glcpp_parser_lookup_macro(parser, identifier);
 
    /* Not a macro, so no expansion needed. */
    if (macro == NULL)
@@ -1892,7 +1886,7 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
       return replacement;
    }
 
-   return _glcpp_parser_expand_function(parser, node, last, mode);
+   return _glcpp_parser_expand_function(parser, node, macro, last, mode);
 }
 
 /* Push a new identifier onto the parser's active list.
@@ -1908,8 +1902,9 @@ _parser_active_list_push(glcpp_parser_t *parser, const char *identifier,
 {
    active_list_t *node;
 
+   /* The token strings live as long as the parser, no need for a copy. */
    node = linear_alloc_child(parser->linalloc, sizeof(active_list_t));
-   node->identifier = linear_strdup(parser->linalloc, identifier);
+   node->identifier = identifier;
    node->marker = marker;
    node->next = parser->active;
 
@@ -2054,6 +2049,51 @@ _glcpp_parser_print_expanded_token_list(glcpp_parser_t *parser,
    _token_list_print (parser, list);
 }
 
+/* Most identifiers of a shader aren't macros. The filter has two of its
+ * bits set for each identifier defined, from the length and a few of the
+ * characters of the identifier, so that most of the others are rejected
+ * without hashing the whole string for the defines table. Bits aren't
+ * cleared by #undef, the filter only avoids lookups bound to fail.
+ */
+static void
+_macro_filter_bits(const char *identifier, unsigned *bit0, unsigned *bit1)
+{
+   size_t len = strlen(identifier);
+   uint32_t h = (uint32_t) len ^
+                (uint32_t) (unsigned char) identifier[0] << 8 ^
+                (uint32_t) (unsigned char) identifier[len / 2] << 16 ^
+                (uint32_t) (unsigned char) identifier[len ? len - 1 : 0] << 24;
+
+   h *= 0x9e3779b1;
+   *bit0 = h >> 22;
+   *bit1 = (h >> 12) & 0x3ff;
+}
+
+static void
+_macro_filter_add(glcpp_parser_t *parser, const char *identifier)
+{
+   unsigned bit0, bit1;
+
+   _macro_filter_bits(identifier, &bit0, &bit1);
+   parser->macro_filter[bit0 / 64] |= 1ull << (bit0 % 64);
+   parser->macro_filter[bit1 / 64] |= 1ull << (bit1 % 64);
+}
+
+static macro_t *
+_glcpp_parser_lookup_macro(glcpp_parser_t *parser, const char *identifier)
+{
+   struct hash_entry *entry;
+   unsigned bit0, bit1;
+
+   _macro_filter_bits(identifier, &bit0, &bit1);
+   if (!(parser->macro_filter[bit0 / 64] & (1ull << (bit0 % 64))) ||
+       !(parser->macro_filter[bit1 / 64] & (1ull << (bit1 % 64))))
+      return NULL;
+
+   entry = _mesa_hash_table_search(parser->defines, identifier);
+   return entry ? entry->data : NULL;
+}
+
 static void
 _check_for_reserved_macro_name(glcpp_parser_t *parser, YYLTYPE *loc,
                                const char *identifier)
@@ -2130,6 +2170,7 @@ _define_object_macro(glcpp_parser_t *parser, YYLTYPE *loc,
       glcpp_error (loc, parser, "Redefinition of macro %s\n",  identifier);
    }
 
+   _macro_filter_add(parser, identifier);
    _mesa_hash_table_insert (parser->defines, identifier, macro);
 }
 
@@ -2165,6 +2206,7 @@ _define_function_macro(glcpp_parser_t *parser, YYLTYPE *loc,
       glcpp_error (loc, parser, "Redefinition of macro %s\n", identifier);
    }
 
+   _macro_filter_add(parser, identifier);
    _mesa_hash_table_insert(parser->defines, identifier, macro);
 }
 
@@ -2211,9 +2253,7 @@ glcpp_parser_lex(YYSTYPE *yylval, YYLTYPE *yylloc, glcpp_parser_t *parser)
                ret == ENDIF || ret == HASH_TOKEN) {
          parser->in_control_line = 1;
       } else if (ret == IDENTIFIER) {
-         struct hash_entry *entry = _mesa_hash_table_search(parser->defines,
-                                                            yylval->str);
-         macro_t *macro = entry ? entry->data : NULL;
+         macro_t *macro = _glcpp_parser_lookup_macro(parser, yylval->str);
          if (macro && macro->is_function) {
             parser->newline_as_space = 1;
             parser->paren_count = 0;
@@ -188,6 +188,9 @@ struct glcpp_parser {
 	void *linalloc;
 	yyscan_t scanner;
 	struct hash_table *defines;
+	/* bits of the identifiers ever defined, see
+	 * _glcpp_parser_lookup_macro() */
+	uint64_t macro_filter[16];
 	active_list_t *active;
 	int lexing_directive;
 	int lexing_version_directive;
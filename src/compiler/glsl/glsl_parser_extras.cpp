@@ -1980,6 +1980,7 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
 
    struct gl_shader_compiler_options *options =
       &ctx->Const.ShaderCompilerOptions[shader->Stage];
+   void *mem_ctx = NULL;
 
    /* Do some optimization at compile time to reduce shader IR size
     * and reduce later work if the same shader is linked multiple times
@@ -1989,10 +1990,20 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
       do_common_optimization(shader->ir, false, false, options,
                              ctx->Const.NativeIntegers);
    } else {
-      /* Repeat it until it stops making changes. */
+      /* Repeat it until it stops making changes. The IR replaced by the
+       * passes is trashed every few rounds instead of piling up until the
+       * end of the compile.
+       */
+      unsigned rounds = 0;
       while (do_common_optimization(shader->ir, false, false, options,
-                                    ctx->Const.NativeIntegers))
-         ;
+                                    ctx->Const.NativeIntegers)) {
+         if (++rounds % 4 == 0) {
+            void *live_ctx = ralloc_context(NULL);
+            reparent_ir(shader->ir, live_ctx);
+            ralloc_free(mem_ctx);
+            mem_ctx = live_ctx;
+         }
+      }
    }
 
    validate_ir_tree(shader->ir);
@@ -2019,6 +2030,7 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
 
    /* Retain any live IR, but trash the rest. */
    reparent_ir(shader->ir, shader->ir);
+   ralloc_free(mem_ctx);
 
    /* Destroy the symbol table.  Create a new symbol table that contains only
     * the variables and functions that still exist in the IR.  The symbol
@@ -2120,6 +2132,13 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    if (!state->error)
       set_shader_inout_layout(shader, state);
 
+   /* Nothing refers to the AST once the layout qualifiers are processed,
+    * so its arena goes before the IR gets optimized.
+    */
+   state->translation_unit.make_empty();
+   linear_free_parent(state->linalloc);
+   state->linalloc = NULL;
+
    shader->symbols = new(shader->ir) glsl_symbol_table;
    shader->CompileStatus = state->error ? COMPILE_FAILURE : COMPILE_SUCCESS;
    shader->InfoLog = state->info_log;
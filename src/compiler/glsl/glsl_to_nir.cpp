@@ -403,6 +403,7 @@ nir_visitor::visit(ir_variable *ir)
    }
 
    var->data.interpolation = ir->data.interpolation;
+   var->data.precision = ir->data.precision;
    var->data.origin_upper_left = ir->data.origin_upper_left;
    var->data.pixel_center_integer = ir->data.pixel_center_integer;
    var->data.location_frac = ir->data.location_frac;
@@ -74,6 +74,8 @@
 #include "program/program.h"
 #include "util/mesa-sha1.h"
 #include "util/set.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
 #include "string_to_uint_map.h"
 #include "linker.h"
 #include "link_varyings.h"
@@ -4748,6 +4750,114 @@ linker_optimisation_loop(struct gl_context *ctx, exec_list *ir,
       }
 }
 
+/* The threads running the work of the stages of a program in parallel,
+ * shared by all the contexts.
+ */
+static struct util_queue link_queue;
+static bool link_queue_initialized;
+static once_flag link_queue_once = ONCE_FLAG_INIT;
+
+static void
+link_queue_init(void)
+{
+   util_cpu_detect();
+
+   /* MESA_GLSL_LINK_THREADS=1 runs everything in the linking thread. */
+   const char *env = getenv("MESA_GLSL_LINK_THREADS");
+   unsigned threads = env ? atoi(env) : util_cpu_caps.nr_cpus;
+
+   if (threads > 1) {
+      link_queue_initialized =
+         util_queue_init(&link_queue, "glsl_link", MESA_SHADER_STAGES,
+                         MIN2(threads, MESA_SHADER_STAGES) - 1, 0);
+   }
+}
+
+struct link_stage_job {
+   struct gl_context *ctx;
+   struct gl_linked_shader *shader;
+   link_stage_func func;
+   void *data;
+   struct util_queue_fence fence;
+};
+
+static void
+link_stage_job_execute(void *data, int thread_index)
+{
+   struct link_stage_job *job = (struct link_stage_job *) data;
+
+   job->func(job->ctx, job->shader, job->data);
+}
+
+/**
+ * Call func for each linked shader of the program, on the link queue
+ * threads when there are several.  The first stage runs in the calling
+ * thread, and all have been done when this returns.
+ *
+ * func must only touch its own stage: the IR and the program of its
+ * linked shader.  It can't report link errors, the info log isn't
+ * locked.
+ */
+void
+link_run_stages(struct gl_context *ctx, struct gl_shader_program *prog,
+                link_stage_func func, void *data)
+{
+   struct link_stage_job jobs[MESA_SHADER_STAGES];
+   unsigned num_jobs = 0;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] == NULL)
+         continue;
+
+      jobs[num_jobs].ctx = ctx;
+      jobs[num_jobs].shader = prog->_LinkedShaders[i];
+      jobs[num_jobs].func = func;
+      jobs[num_jobs].data = data;
+      num_jobs++;
+   }
+
+   if (num_jobs > 1)
+      call_once(&link_queue_once, link_queue_init);
+
+   if (num_jobs <= 1 || !link_queue_initialized) {
+      for (unsigned i = 0; i < num_jobs; i++)
+         func(ctx, jobs[i].shader, data);
+      return;
+   }
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&link_queue, &jobs[i], &jobs[i].fence,
+                         link_stage_job_execute, NULL);
+   }
+
+   func(ctx, jobs[0].shader, data);
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
+/* The optimisations of a stage before the varyings and uniforms are
+ * assigned, which don't depend on the other stages.
+ */
+static void
+link_optimise_stage(struct gl_context *ctx, struct gl_linked_shader *sh,
+                    void *data)
+{
+   /* Call opts before lowering const arrays to uniforms so we can const
+    * propagate any elements accessed directly.
+    */
+   linker_optimisation_loop(ctx, sh->ir, sh->Stage);
+
+   /* Call opts after lowering const arrays to copy propagate things. */
+   if (lower_const_arrays_to_uniforms(sh->ir, sh->Stage))
+      linker_optimisation_loop(ctx, sh->ir, sh->Stage);
+
+   propagate_invariance(sh->ir);
+}
+
 void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
 {
@@ -5054,19 +5164,10 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
       if (ctx->Const.LowerTessLevel) {
          lower_tess_level(prog->_LinkedShaders[i]);
       }
-
-      /* Call opts before lowering const arrays to uniforms so we can const
-       * propagate any elements accessed directly.
-       */
-      linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      /* Call opts after lowering const arrays to copy propagate things. */
-      if (lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir, i))
-         linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      propagate_invariance(prog->_LinkedShaders[i]->ir);
    }
 
+   link_run_stages(ctx, prog, link_optimise_stage, NULL);
+
    /* Validation for special cases where we allow sampler array indexing
     * with loop induction variable. This check emits a warning or error
     * depending if backend can handle dynamic indexing.
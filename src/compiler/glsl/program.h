@@ -44,6 +44,15 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 extern void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog);
 
+struct gl_linked_shader;
+
+typedef void (*link_stage_func)(struct gl_context *ctx,
+                                struct gl_linked_shader *shader, void *data);
+
+extern void
+link_run_stages(struct gl_context *ctx, struct gl_shader_program *prog,
+                link_stage_func func, void *data);
+
 extern void
 build_program_resource_list(struct gl_context *ctx,
                             struct gl_shader_program *shProg);
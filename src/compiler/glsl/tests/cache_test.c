@@ -507,6 +507,19 @@ main(void)
 
    test_put_key_and_get_key();
 
+   /* Again with the single file backend, in a fresh cache directory. */
+   err = rmrf_local(CACHE_TEST_TMP);
+   expect_equal(err, 0, "Removing " CACHE_TEST_TMP " for the single file");
+   mkdir(CACHE_TEST_TMP, 0755);
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+   setenv("MESA_GLSL_CACHE_SINGLE_FILE", "true", 1);
+
+   test_put_and_get();
+
+   test_put_key_and_get_key();
+
+   unsetenv("MESA_GLSL_CACHE_SINGLE_FILE");
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
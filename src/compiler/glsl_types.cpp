@@ -26,14 +26,115 @@
 #include "compiler/glsl/glsl_parser_extras.h"
 #include "glsl_types.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
+
+
+/**
+ * A table of the known types of a kind, searched without taking
+ * glsl_type::hash_mutex.
+ *
+ * The slots are only ever filled, with the mutex held, after the type is
+ * complete.  A table more than half full is replaced by a copy twice as
+ * large.  A thread still searching the previous one misses the newest
+ * types, and searches again with the mutex held.  The replaced tables are
+ * kept in the prev list until _mesa_glsl_release_types().
+ */
+struct glsl_type_table {
+   unsigned size;
+   unsigned count;
+   struct glsl_type_table *prev;
+   const glsl_type **slots;
+};
+
+typedef bool (*glsl_type_key_equal)(const void *key, const void *type);
+typedef uint32_t (*glsl_type_key_hash)(const void *type);
+
+static const glsl_type *
+type_table_search(struct glsl_type_table *const *table_ptr, uint32_t hash,
+                  const void *key, glsl_type_key_equal equal)
+{
+   struct glsl_type_table *table = p_atomic_read(table_ptr);
+
+   if (table == NULL)
+      return NULL;
+
+   /* Linear probing, there is always an empty slot. */
+   for (unsigned i = hash; ; i++) {
+      const glsl_type *t = p_atomic_read(&table->slots[i & (table->size - 1)]);
+
+      if (t == NULL || equal(key, t))
+         return t;
+   }
+}
+
+static void
+type_table_add(struct glsl_type_table *table, const glsl_type *t,
+               uint32_t hash)
+{
+   unsigned i = hash;
+
+   while (table->slots[i & (table->size - 1)] != NULL)
+      i++;
+
+   p_atomic_set(&table->slots[i & (table->size - 1)], t);
+   table->count++;
+}
+
+/**
+ * Add a new type, with glsl_type::hash_mutex held.
+ */
+static void
+type_table_insert(struct glsl_type_table **table_ptr, const glsl_type *t,
+                  uint32_t hash, glsl_type_key_hash hash_type)
+{
+   struct glsl_type_table *table = *table_ptr;
+
+   if (table == NULL || (table->count + 1) * 2 > table->size) {
+      unsigned size = table ? table->size * 2 : 64;
+      struct glsl_type_table *grown = (struct glsl_type_table *)
+         calloc(1, sizeof(*grown) + size * sizeof(grown->slots[0]));
+
+      grown->size = size;
+      grown->prev = table;
+      grown->slots = (const glsl_type **) (grown + 1);
+
+      for (unsigned i = 0; table && i < table->size; i++) {
+         if (table->slots[i] != NULL)
+            type_table_add(grown, table->slots[i], hash_type(table->slots[i]));
+      }
+
+      /* Publish the copy once it is complete. */
+      p_atomic_set(table_ptr, grown);
+      table = grown;
+   }
+
+   type_table_add(table, t, hash);
+}
+
+static void
+type_table_destroy(struct glsl_type_table *table)
+{
+   if (table == NULL)
+      return;
+
+   for (unsigned i = 0; i < table->size; i++)
+      delete table->slots[i];
+
+   while (table != NULL) {
+      struct glsl_type_table *prev = table->prev;
+
+      free(table);
+      table = prev;
+   }
+}
 
 
 mtx_t glsl_type::hash_mutex = _MTX_INITIALIZER_NP;
-hash_table *glsl_type::array_types = NULL;
-hash_table *glsl_type::record_types = NULL;
-hash_table *glsl_type::interface_types = NULL;
-hash_table *glsl_type::function_types = NULL;
-hash_table *glsl_type::subroutine_types = NULL;
+glsl_type_table *glsl_type::array_types = NULL;
+glsl_type_table *glsl_type::record_types = NULL;
+glsl_type_table *glsl_type::interface_types = NULL;
+glsl_type_table *glsl_type::function_types = NULL;
+glsl_type_table *glsl_type::subroutine_types = NULL;
 
 glsl_type::glsl_type(GLenum gl_type,
                      glsl_base_type base_type, unsigned vector_elements,
@@ -388,17 +489,6 @@ const glsl_type *glsl_type::get_scalar_type() const
 }
 
 
-static void
-hash_free_type_function(struct hash_entry *entry)
-{
-   glsl_type *type = (glsl_type *) entry->data;
-
-   if (type->is_array())
-      free((void*)entry->key);
-
-   delete type;
-}
-
 void
 _mesa_glsl_release_types(void)
 {
@@ -406,30 +496,20 @@ _mesa_glsl_release_types(void)
     * object, or if process terminates), so no mutex-locking should be
     * necessary.
     */
-   if (glsl_type::array_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::array_types, hash_free_type_function);
-      glsl_type::array_types = NULL;
-   }
+   type_table_destroy(glsl_type::array_types);
+   glsl_type::array_types = NULL;
 
-   if (glsl_type::record_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::record_types, hash_free_type_function);
-      glsl_type::record_types = NULL;
-   }
+   type_table_destroy(glsl_type::record_types);
+   glsl_type::record_types = NULL;
 
-   if (glsl_type::interface_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::interface_types, hash_free_type_function);
-      glsl_type::interface_types = NULL;
-   }
+   type_table_destroy(glsl_type::interface_types);
+   glsl_type::interface_types = NULL;
 
-   if (glsl_type::function_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::function_types, hash_free_type_function);
-      glsl_type::function_types = NULL;
-   }
+   type_table_destroy(glsl_type::function_types);
+   glsl_type::function_types = NULL;
 
-   if (glsl_type::subroutine_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::subroutine_types, hash_free_type_function);
-      glsl_type::subroutine_types = NULL;
-   }
+   type_table_destroy(glsl_type::subroutine_types);
+   glsl_type::subroutine_types = NULL;
 }
 
 
@@ -844,40 +924,62 @@ glsl_type::get_image_instance(enum glsl_sampler_dim dim,
    unreachable("switch statement above should be complete");
 }
 
-const glsl_type *
-glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
+/* The key of the array types: the element type pointer, as the name of the
+ * element type may not be unique across shaders.  For example, two shaders
+ * may have different record types named 'foo'.
+ */
+struct array_key {
+   const glsl_type *base;
+   unsigned length;
+};
+
+static uint32_t
+array_key_hash(const glsl_type *base, unsigned length)
 {
-   /* Generate a name using the base type pointer in the key.  This is
-    * done because the name of the base type may not be unique across
-    * shaders.  For example, two shaders may have different record types
-    * named 'foo'.
-    */
-   char key[128];
-   snprintf(key, sizeof(key), "%p[%u]", (void *) base, array_size);
+   return _mesa_hash_pointer(base) ^ (length * 0x9e3779b1u);
+}
 
-   mtx_lock(&glsl_type::hash_mutex);
+static uint32_t
+array_type_hash(const void *a)
+{
+   const glsl_type *const t = (const glsl_type *) a;
+   return array_key_hash(t->fields.array, t->length);
+}
 
-   if (array_types == NULL) {
-      array_types = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
-                                            _mesa_key_string_equal);
-   }
+static bool
+array_key_equal(const void *a, const void *b)
+{
+   const struct array_key *const key = (const struct array_key *) a;
+   const glsl_type *const t = (const glsl_type *) b;
 
-   const struct hash_entry *entry = _mesa_hash_table_search(array_types, key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(base, array_size);
+   return t->fields.array == key->base && t->length == key->length;
+}
 
-      entry = _mesa_hash_table_insert(array_types,
-                                      strdup(key),
-                                      (void *) t);
-   }
+const glsl_type *
+glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
+{
+   const struct array_key key = { base, array_size };
+   const uint32_t hash = array_key_hash(base, array_size);
+
+   const glsl_type *t = type_table_search(&array_types, hash, &key,
+                                          array_key_equal);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
+
+      t = type_table_search(&array_types, hash, &key, array_key_equal);
+      if (t == NULL) {
+         t = new glsl_type(base, array_size);
+         type_table_insert(&array_types, t, hash, array_type_hash);
+      }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_ARRAY);
-   assert(((glsl_type *) entry->data)->length == array_size);
-   assert(((glsl_type *) entry->data)->fields.array == base);
+      mtx_unlock(&glsl_type::hash_mutex);
+   }
 
-   mtx_unlock(&glsl_type::hash_mutex);
+   assert(t->base_type == GLSL_TYPE_ARRAY);
+   assert(t->length == array_size);
+   assert(t->fields.array == base);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1006,29 +1108,26 @@ glsl_type::get_record_instance(const glsl_struct_field *fields,
                                const char *name)
 {
    const glsl_type key(fields, num_fields, name);
+   const uint32_t hash = record_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
+   const glsl_type *t = type_table_search(&record_types, hash, &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   if (record_types == NULL) {
-      record_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                             record_key_compare);
-   }
-
-   const struct hash_entry *entry = _mesa_hash_table_search(record_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields, name);
+      t = type_table_search(&record_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(fields, num_fields, name);
+         type_table_insert(&record_types, t, hash, record_key_hash);
+      }
 
-      entry = _mesa_hash_table_insert(record_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_STRUCT);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, name) == 0);
+   assert(t->base_type == GLSL_TYPE_STRUCT);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, name) == 0);
 
-   mtx_unlock(&glsl_type::hash_mutex);
-
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1040,58 +1139,52 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
                                   const char *block_name)
 {
    const glsl_type key(fields, num_fields, packing, row_major, block_name);
+   const uint32_t hash = record_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (interface_types == NULL) {
-      interface_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                                record_key_compare);
-   }
+   const glsl_type *t = type_table_search(&interface_types, hash, &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   const struct hash_entry *entry = _mesa_hash_table_search(interface_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields,
-                                         packing, row_major, block_name);
+      t = type_table_search(&interface_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(fields, num_fields,
+                           packing, row_major, block_name);
+         type_table_insert(&interface_types, t, hash, record_key_hash);
+      }
 
-      entry = _mesa_hash_table_insert(interface_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_INTERFACE);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, block_name) == 0);
-
-   mtx_unlock(&glsl_type::hash_mutex);
+   assert(t->base_type == GLSL_TYPE_INTERFACE);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, block_name) == 0);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 const glsl_type *
 glsl_type::get_subroutine_instance(const char *subroutine_name)
 {
    const glsl_type key(subroutine_name);
+   const uint32_t hash = record_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (subroutine_types == NULL) {
-      subroutine_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                                 record_key_compare);
-   }
+   const glsl_type *t = type_table_search(&subroutine_types, hash, &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   const struct hash_entry *entry = _mesa_hash_table_search(subroutine_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(subroutine_name);
+      t = type_table_search(&subroutine_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(subroutine_name);
+         type_table_insert(&subroutine_types, t, hash, record_key_hash);
+      }
 
-      entry = _mesa_hash_table_insert(subroutine_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_SUBROUTINE);
-   assert(strcmp(((glsl_type *) entry->data)->name, subroutine_name) == 0);
-
-   mtx_unlock(&glsl_type::hash_mutex);
+   assert(t->base_type == GLSL_TYPE_SUBROUTINE);
+   assert(strcmp(t->name, subroutine_name) == 0);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1123,28 +1216,24 @@ glsl_type::get_function_instance(const glsl_type *return_type,
                                  unsigned num_params)
 {
    const glsl_type key(return_type, params, num_params);
+   const uint32_t hash = function_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
+   const glsl_type *t = type_table_search(&function_types, hash, &key, function_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   if (function_types == NULL) {
-      function_types = _mesa_hash_table_create(NULL, function_key_hash,
-                                               function_key_compare);
-   }
-
-   struct hash_entry *entry = _mesa_hash_table_search(function_types, &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(return_type, params, num_params);
+      t = type_table_search(&function_types, hash, &key, function_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(return_type, params, num_params);
+         type_table_insert(&function_types, t, hash, function_key_hash);
+      }
 
-      entry = _mesa_hash_table_insert(function_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   const glsl_type *t = (const glsl_type *)entry->data;
-
    assert(t->base_type == GLSL_TYPE_FUNCTION);
    assert(t->length == num_params);
 
-   mtx_unlock(&glsl_type::hash_mutex);
-
    return t;
 }
 
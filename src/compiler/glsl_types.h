@@ -37,6 +37,7 @@
 #endif
 
 struct glsl_type;
+struct glsl_type_table;
 
 #ifdef __cplusplus
 extern "C" {
@@ -890,20 +891,20 @@ private:
    /** Constructor for subroutine types */
    glsl_type(const char *name);
 
-   /** Hash table containing the known array types. */
-   static struct hash_table *array_types;
+   /** Table containing the known array types. */
+   static struct glsl_type_table *array_types;
 
-   /** Hash table containing the known record types. */
-   static struct hash_table *record_types;
+   /** Table containing the known record types. */
+   static struct glsl_type_table *record_types;
 
-   /** Hash table containing the known interface types. */
-   static struct hash_table *interface_types;
+   /** Table containing the known interface types. */
+   static struct glsl_type_table *interface_types;
 
-   /** Hash table containing the known subroutine types. */
-   static struct hash_table *subroutine_types;
+   /** Table containing the known subroutine types. */
+   static struct glsl_type_table *subroutine_types;
 
-   /** Hash table containing the known function types. */
-   static struct hash_table *function_types;
+   /** Table containing the known function types. */
+   static struct glsl_type_table *function_types;
 
    static bool record_key_compare(const void *a, const void *b);
    static unsigned record_key_hash(const void *key);
@@ -32,6 +32,15 @@
 #include <assert.h>
 #include <math.h>
 
+static void
+nir_shader_destroy_pool(void *mem)
+{
+   nir_shader *shader = mem;
+
+   /* the instructions, children of the shader, are freed already */
+   ralloc_pool_destroy(shader->instr_pool);
+}
+
 nir_shader *
 nir_shader_create(void *mem_ctx,
                   gl_shader_stage stage,
@@ -65,6 +74,9 @@ nir_shader_create(void *mem_ctx,
    shader->num_uniforms = 0;
    shader->num_shared = 0;
 
+   shader->instr_pool = ralloc_pool_create();
+   ralloc_set_destructor(shader, nir_shader_destroy_pool);
+
    return shader;
 }
 
@@ -419,10 +431,23 @@ nir_loop_create(nir_shader *shader)
    return loop;
 }
 
+static void *
+instr_alloc(nir_shader *shader, size_t size)
+{
+   return ralloc_pool_size(shader->instr_pool, shader, size);
+}
+
+static void *
+instr_zalloc(nir_shader *shader, size_t size)
+{
+   return rzalloc_pool_size(shader->instr_pool, shader, size);
+}
+
 static void
 instr_init(nir_instr *instr, nir_instr_type type)
 {
    instr->type = type;
+   instr->set_hash = 0;
    instr->block = NULL;
    exec_node_init(&instr->node);
 }
@@ -461,7 +486,7 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
    unsigned num_srcs = nir_op_infos[op].num_inputs;
    /* TODO: don't use rzalloc */
    nir_alu_instr *instr =
-      rzalloc_size(shader,
+      instr_zalloc(shader,
                    sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
 
    instr_init(&instr->instr, nir_instr_type_alu);
@@ -476,7 +501,7 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(shader, nir_jump_instr);
+   nir_jump_instr *instr = instr_alloc(shader, sizeof(nir_jump_instr));
    instr_init(&instr->instr, nir_instr_type_jump);
    instr->type = type;
    return instr;
@@ -486,7 +511,8 @@ nir_load_const_instr *
 nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
-   nir_load_const_instr *instr = rzalloc(shader, nir_load_const_instr);
+   nir_load_const_instr *instr =
+      instr_zalloc(shader, sizeof(nir_load_const_instr));
    instr_init(&instr->instr, nir_instr_type_load_const);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -500,8 +526,8 @@ nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    /* TODO: don't use rzalloc */
    nir_intrinsic_instr *instr =
-      rzalloc_size(shader,
-                  sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
+      instr_zalloc(shader,
+                   sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
 
    instr_init(&instr->instr, nir_instr_type_intrinsic);
    instr->intrinsic = op;
@@ -518,7 +544,7 @@ nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 nir_call_instr *
 nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
-   nir_call_instr *instr = ralloc(shader, nir_call_instr);
+   nir_call_instr *instr = instr_alloc(shader, sizeof(nir_call_instr));
    instr_init(&instr->instr, nir_instr_type_call);
 
    instr->callee = callee;
@@ -532,13 +558,14 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = rzalloc(shader, nir_tex_instr);
+   nir_tex_instr *instr = instr_zalloc(shader, sizeof(nir_tex_instr));
    instr_init(&instr->instr, nir_instr_type_tex);
 
    dest_init(&instr->dest);
 
    instr->num_srcs = num_srcs;
-   instr->src = ralloc_array(instr, nir_tex_src, num_srcs);
+   instr->src = ralloc_pool_size(shader->instr_pool, instr,
+                                 num_srcs * sizeof(nir_tex_src));
    for (unsigned i = 0; i < num_srcs; i++)
       src_init(&instr->src[i].src);
 
@@ -592,7 +619,7 @@ nir_tex_instr_remove_src(nir_tex_instr *tex, unsigned src_idx)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = ralloc(shader, nir_phi_instr);
+   nir_phi_instr *instr = instr_alloc(shader, sizeof(nir_phi_instr));
    instr_init(&instr->instr, nir_instr_type_phi);
 
    dest_init(&instr->dest);
@@ -603,7 +630,8 @@ nir_phi_instr_create(nir_shader *shader)
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = ralloc(shader, nir_parallel_copy_instr);
+   nir_parallel_copy_instr *instr =
+      instr_alloc(shader, sizeof(nir_parallel_copy_instr));
    instr_init(&instr->instr, nir_instr_type_parallel_copy);
 
    exec_list_make_empty(&instr->entries);
@@ -616,7 +644,8 @@ nir_ssa_undef_instr_create(nir_shader *shader,
                            unsigned num_components,
                            unsigned bit_size)
 {
-   nir_ssa_undef_instr *instr = ralloc(shader, nir_ssa_undef_instr);
+   nir_ssa_undef_instr *instr =
+      instr_alloc(shader, sizeof(nir_ssa_undef_instr));
    instr_init(&instr->instr, nir_instr_type_ssa_undef);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
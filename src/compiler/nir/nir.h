@@ -218,6 +218,12 @@ typedef struct nir_variable {
        */
       unsigned interpolation:2;
 
+      /**
+       * Precision qualifier of GLSL ES shaders, always
+       * GLSL_PRECISION_NONE on desktop.
+       */
+      unsigned precision:2;
+
       /**
        * \name ARB_fragment_coord_conventions
        * @{
@@ -440,6 +446,12 @@ typedef enum {
 typedef struct nir_instr {
    struct exec_node node;
    nir_instr_type type;
+
+   /** Hash computed when the instruction is added to an instruction set,
+    * only valid while it is in the set.
+    */
+   uint32_t set_hash;
+
    struct nir_block *block;
 
    /** generic instruction index. */
@@ -1952,6 +1964,21 @@ typedef struct nir_shader_compiler_options {
    bool vs_inputs_dual_locations;
 
    unsigned max_unroll_iterations;
+
+   /**
+    * Instruction budget of an unrolled loop, its instruction count times its
+    * trip count.  0 is max_unroll_iterations * 26, which suits GPUs with
+    * cheap branches; backends without flow control raise it to unroll every
+    * loop with a known trip count.
+    */
+   unsigned max_unroll_instructions;
+
+   /**
+    * ALU instructions in the branches of an if nir_opt_peephole_select()
+    * flattens into selects, when it is more than the limit the pass is
+    * called with.  Backends with no or expensive branching raise it.
+    */
+   unsigned max_select_flatten_cost;
 } nir_shader_compiler_options;
 
 typedef struct nir_shader {
@@ -1996,6 +2023,13 @@ typedef struct nir_shader {
     * access plus one
     */
    unsigned num_inputs, num_uniforms, num_outputs, num_shared;
+
+   /**
+    * The instructions of the shader are allocated from this pool, the ones
+    * freed with a pass context or by nir_sweep are reused for the next ones.
+    * Instructions must not be moved to another shader.
+    */
+   struct ralloc_pool *instr_pool;
 } nir_shader;
 
 static inline nir_function_impl *
@@ -2508,6 +2542,72 @@ static inline bool should_print_nir(void) { return false; }
       nir_print_shader(nir, stdout);                                 \
 )
 
+#define NIR_PASS_LOOP_MAX_PASSES 32
+
+/**
+ * Optimization loop which skips the passes that can't make progress.
+ *
+ * A pass which didn't make progress is skipped until another pass of the
+ * loop changed the shader, as it would see the same shader again.  The
+ * loop ends after an iteration without progress, like the usual
+ * do { } while (progress) loops.  The passes are identified by their
+ * position in the iteration, so every iteration must run the same passes
+ * in the same order, and they must return whether they made progress:
+ *
+ *    nir_pass_loop loop;
+ *
+ *    nir_pass_loop_init(&loop);
+ *    while (nir_pass_loop_iterate(&loop)) {
+ *       NIR_LOOP_PASS(&loop, nir, nir_copy_prop);
+ *       NIR_LOOP_PASS(&loop, nir, nir_opt_dce);
+ *    }
+ *    nir_pass_loop_finish(&loop, "driver fs");
+ *
+ * NIR_PASS_STATS=true prints the runs, skips and time of the passes.
+ */
+typedef struct {
+   /* Number of passes which made progress so far */
+   unsigned changes;
+   bool progress;
+   unsigned num_iterations;
+   unsigned pass;
+   int64_t start;
+
+   struct {
+      const char *name;
+      /* changes when the pass last ran without progress, ~0 if it did */
+      unsigned clean;
+      unsigned runs, skips, progress;
+      int64_t time;
+   } passes[NIR_PASS_LOOP_MAX_PASSES];
+   unsigned num_passes;
+} nir_pass_loop;
+
+void nir_pass_loop_init(nir_pass_loop *loop);
+bool nir_pass_loop_iterate(nir_pass_loop *loop);
+void nir_pass_loop_finish(nir_pass_loop *loop, const char *name);
+bool nir_pass_loop_begin_pass(nir_pass_loop *loop, const char *name);
+void nir_pass_loop_end_pass(nir_pass_loop *loop, bool progress,
+                            bool loop_progress);
+
+#define _LOOP_PASS(loop, loop_progress, nir, pass, ...) do {         \
+   if (nir_pass_loop_begin_pass(loop, #pass)) {                      \
+      bool _pass_progress = false;                                   \
+      NIR_PASS(_pass_progress, nir, pass, ##__VA_ARGS__);            \
+      nir_pass_loop_end_pass(loop, _pass_progress, loop_progress);   \
+   }                                                                 \
+} while (0)
+
+/** Pass whose progress makes the loop run another iteration */
+#define NIR_LOOP_PASS(loop, nir, pass, ...)                          \
+   _LOOP_PASS(loop, true, nir, pass, ##__VA_ARGS__)
+
+/** Pass whose progress doesn't by itself make the loop go on, like a
+ *  NIR_PASS_V in a do { } while (progress) loop.
+ */
+#define NIR_LOOP_PASS_V(loop, nir, pass, ...)                        \
+   _LOOP_PASS(loop, false, nir, pass, ##__VA_ARGS__)
+
 void nir_calc_dominance_impl(nir_function_impl *impl);
 void nir_calc_dominance(nir_shader *shader);
 
@@ -2841,6 +2941,12 @@ bool nir_opt_move_load_ubo(nir_shader *shader);
 
 bool nir_opt_peephole_select(nir_shader *shader, unsigned limit);
 
+/** Whether nir_opt_vectorize() may combine the instruction with others */
+typedef bool (*nir_opt_vectorize_cb)(const nir_instr *instr, void *data);
+
+bool nir_opt_vectorize(nir_shader *shader, nir_opt_vectorize_cb filter,
+                       void *data);
+
 bool nir_opt_remove_phis(nir_shader *shader);
 
 bool nir_opt_shrink_load(nir_shader *shader);
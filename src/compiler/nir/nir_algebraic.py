@@ -495,6 +495,145 @@ class SearchAndReplace(object):
 
       BitSizeValidator(varset).validate(self.search, self.replace)
 
+class TreeAutomaton(object):
+   """Bottom-up tree automaton matching values to search expressions.
+
+   The items are the search expressions and all their sub-expressions,
+   plus two items for the leaves: a variable matches anything and a
+   constant any load_const.  The state of a value is the set of items it may
+   match, from its opcode and the states of its sources: an expression item
+   is in the set if the opcode is the same and each source state contains
+   the item of the corresponding source, in either order for commutative
+   opcodes.  Conditions, bit sizes, swizzles, constant values and repeated
+   variables aren't tracked, so a state is a superset of the items a value
+   actually matches and nir_replace_instr() still does the matching.
+
+   The states are the sets reachable from the leaves.  To keep the tables
+   small, the states of the sources of an opcode are first filtered down to
+   the items which appear as its sources, and the transition tables are
+   indexed by the filtered sets.
+   """
+   def __init__(self, transforms):
+      self.item_ids = {}
+      self.items = []
+      self.any_item = self._add_item(('any',))
+      self.const_item = self._add_item(('const',))
+
+      # items by opcode
+      self.opcode_items = {}
+      self.xform_items = [self._value_item(xform.search)
+                          for xform in transforms]
+
+      self.states = []
+      self.state_ids = {}
+      self._add_state(frozenset([self.any_item]))
+      self._add_state(frozenset([self.any_item, self.const_item]))
+
+      self._build()
+
+   def _add_item(self, item):
+      if item not in self.item_ids:
+         self.item_ids[item] = len(self.items)
+         self.items.append(item)
+      return self.item_ids[item]
+
+   def _value_item(self, val):
+      if isinstance(val, Expression):
+         srcs = tuple(self._value_item(src) for src in val.sources)
+         item = self._add_item((val.opcode, srcs))
+         self.opcode_items.setdefault(val.opcode, set()).add(item)
+         return item
+      elif isinstance(val, Constant):
+         return self.const_item
+      elif isinstance(val, Variable) and val.is_constant:
+         return self.const_item
+      else:
+         return self.any_item
+
+   def _add_state(self, state):
+      if state not in self.state_ids:
+         self.state_ids[state] = len(self.states)
+         self.states.append(state)
+         return True
+      return False
+
+   def _src_items(self, opcode, i):
+      num_inputs = opcodes[opcode].num_inputs
+      commutative = "commutative" in opcodes[opcode].algebraic_properties
+      srcs = set()
+      for item in self.opcode_items[opcode]:
+         if commutative:
+            srcs.update(self.items[item][1])
+         else:
+            srcs.add(self.items[item][1][i])
+      return frozenset(srcs)
+
+   def _matches(self, opcode, item, src_sets):
+      srcs = self.items[item][1]
+      if all(src in src_sets[i] for i, src in enumerate(srcs)):
+         return True
+      if "commutative" in opcodes[opcode].algebraic_properties:
+         assert len(srcs) == 2
+         return srcs[0] in src_sets[1] and srcs[1] in src_sets[0]
+      return False
+
+   def _build(self):
+      self.filters = {}
+      for opcode in self.opcode_items:
+         num_inputs = opcodes[opcode].num_inputs
+         self.filters[opcode] = {
+            'src_items': [self._src_items(opcode, i)
+                          for i in range(num_inputs)],
+            'sets': [[] for i in range(num_inputs)],
+            'set_ids': [{} for i in range(num_inputs)],
+            'map': [[] for i in range(num_inputs)],
+            'table': {},
+         }
+
+      num_done = 0
+      while num_done < len(self.states):
+         # filter the new states for every opcode source
+         dirty = set()
+         for state in self.states[num_done:]:
+            for opcode, f in self.filters.items():
+               for i, src_items in enumerate(f['src_items']):
+                  filtered = state & src_items
+                  if filtered not in f['set_ids'][i]:
+                     f['set_ids'][i][filtered] = len(f['sets'][i])
+                     f['sets'][i].append(filtered)
+                     dirty.add(opcode)
+                  f['map'][i].append(f['set_ids'][i][filtered])
+         num_done = len(self.states)
+
+         # compute the transitions from the new filtered sets
+         for opcode in sorted(dirty):
+            f = self.filters[opcode]
+            for index in itertools.product(*[range(len(s)) for s in f['sets']]):
+               if index in f['table']:
+                  continue
+               src_sets = [f['sets'][i][j] for i, j in enumerate(index)]
+               state = frozenset([self.any_item] +
+                                 [item for item in self.opcode_items[opcode]
+                                  if self._matches(opcode, item, src_sets)])
+               self._add_state(state)
+               f['table'][index] = self.state_ids[state]
+
+      assert len(self.states) < (1 << 16)
+
+   def op_tables(self):
+      """Yields the opcode, [filter arrays] and the flattened table"""
+      for opcode in sorted(self.filters):
+         f = self.filters[opcode]
+         sizes = [len(s) for s in f['sets']]
+         table = [f['table'][index] for index in
+                  itertools.product(*[range(n) for n in sizes])]
+         yield opcode, f['map'], sizes, table
+
+   def state_xforms(self, state):
+      """Indices of the transforms whose search expression is in the state"""
+      return [i for i, item in enumerate(self.xform_items)
+              if item in self.states[state]]
+
 _algebraic_pass_template = mako.template.Template("""
 #include "nir.h"
 #include "nir_search.h"
@@ -511,22 +650,69 @@ struct transform {
 
 #endif
 
-% for (opcode, xform_list) in xform_dict.iteritems():
-% for xform in xform_list:
+% for xform in xforms:
    ${xform.search.render()}
    ${xform.replace.render()}
 % endfor
 
-static const struct transform ${pass_name}_${opcode}_xforms[] = {
-% for xform in xform_list:
+static const struct transform ${pass_name}_xforms[] = {
+% for xform in xforms:
    { &${xform.search.name}, ${xform.replace.c_ptr}, ${xform.condition_index} },
 % endfor
 };
+
+% for (opcode, filters, sizes, table) in automaton.op_tables():
+% for i, f in enumerate(filters):
+% if filters.index(f) == i:
+static const uint16_t ${pass_name}_${opcode}_filter${i}[] = {
+   ${', '.join(str(s) for s in f)}
+};
+% endif
+% endfor
+static const uint16_t ${pass_name}_${opcode}_table[] = {
+   ${', '.join(str(s) for s in table)}
+};
+
+% endfor
+static const nir_search_op_table ${pass_name}_op_tables[nir_num_opcodes] = {
+% for (opcode, filters, sizes, table) in automaton.op_tables():
+   [nir_op_${opcode}] = {
+      {
+   % for f in filters:
+         ${pass_name}_${opcode}_filter${filters.index(f)},
+   % endfor
+      },
+      { ${', '.join(str(s) for s in sizes)} },
+      ${pass_name}_${opcode}_table,
+   },
+% endfor
+};
+
+<% state_xforms = [automaton.state_xforms(s) for s in range(len(automaton.states))] %>
+/* The transforms which may apply to a value, for each automaton state:
+ * ${pass_name}_state_xforms[offset[state]] to [offset[state + 1]].
+ */
+static const uint16_t ${pass_name}_state_xforms[] = {
+% for s, l in enumerate(state_xforms):
+   % if l:
+   ${', '.join(str(i) for i in l)},
+   % endif
+% endfor
+   0
+};
+
+static const uint32_t ${pass_name}_state_xforms_offset[] = {
+<% offset = 0 %>
+% for l in state_xforms:
+   ${offset},
+<% offset += len(l) %>
 % endfor
+   ${offset}
+};
 
 static bool
 ${pass_name}_block(nir_block *block, const bool *condition_flags,
-                   void *mem_ctx)
+                   const uint16_t *states, void *mem_ctx)
 {
    bool progress = false;
 
@@ -538,22 +724,20 @@ ${pass_name}_block(nir_block *block, const bool *condition_flags,
       if (!alu->dest.dest.is_ssa)
          continue;
 
-      switch (alu->op) {
-      % for opcode in xform_dict.keys():
-      case nir_op_${opcode}:
-         for (unsigned i = 0; i < ARRAY_SIZE(${pass_name}_${opcode}_xforms); i++) {
-            const struct transform *xform = &${pass_name}_${opcode}_xforms[i];
-            if (condition_flags[xform->condition_offset] &&
-                nir_replace_instr(alu, xform->search, xform->replace,
-                                  mem_ctx)) {
-               progress = true;
-               break;
-            }
+      /* Values created by the replacements are only visited by the next
+       * run, all the ones visited here have a state.
+       */
+      unsigned state = states[alu->dest.dest.ssa.index];
+      for (unsigned i = ${pass_name}_state_xforms_offset[state];
+           i < ${pass_name}_state_xforms_offset[state + 1]; i++) {
+         const struct transform *xform =
+            &${pass_name}_xforms[${pass_name}_state_xforms[i]];
+         if (condition_flags[xform->condition_offset] &&
+             nir_replace_instr(alu, xform->search, xform->replace,
+                               mem_ctx)) {
+            progress = true;
+            break;
          }
-         break;
-      % endfor
-      default:
-         break;
       }
    }
 
@@ -566,10 +750,16 @@ ${pass_name}_impl(nir_function_impl *impl, const bool *condition_flags)
    void *mem_ctx = ralloc_parent(impl);
    bool progress = false;
 
+   uint16_t *states = nir_algebraic_automaton(impl, ${pass_name}_op_tables);
+   if (!states)
+      return false;
+
    nir_foreach_block_reverse(block, impl) {
-      progress |= ${pass_name}_block(block, condition_flags, mem_ctx);
+      progress |= ${pass_name}_block(block, condition_flags, states, mem_ctx);
    }
 
+   free(states);
+
    if (progress)
       nir_metadata_preserve(impl, nir_metadata_block_index |
                                   nir_metadata_dominance);
@@ -626,7 +816,13 @@ class AlgebraicPass(object):
       if error:
          sys.exit(1)
 
+      # the transforms grouped by opcode, in order within an opcode
+      self.xforms = [xform for xform_list in self.xform_dict.values()
+                     for xform in xform_list]
+      self.automaton = TreeAutomaton(self.xforms)
+
    def render(self):
       return _algebraic_pass_template.render(pass_name=self.pass_name,
-                                             xform_dict=self.xform_dict,
+                                             xforms=self.xforms,
+                                             automaton=self.automaton,
                                              condition_list=condition_list)
@@ -451,7 +451,8 @@ clone_phi(clone_state *state, const nir_phi_instr *phi, nir_block *nblk)
    nir_instr_insert_after_block(nblk, &nphi->instr);
 
    foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
-      nir_phi_src *nsrc = ralloc(nphi, nir_phi_src);
+      nir_phi_src *nsrc =
+         ralloc_pool_size(state->ns->instr_pool, nphi, sizeof(*nsrc));
 
       /* Just copy the old source for now. */
       memcpy(nsrc, src, sizeof(*src));
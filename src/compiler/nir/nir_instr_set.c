@@ -236,12 +236,19 @@ nir_alu_srcs_equal(const nir_alu_instr *alu1, const nir_alu_instr *alu2,
        alu1->src[src1].negate != alu2->src[src2].negate)
       return false;
 
-   for (unsigned i = 0; i < nir_ssa_alu_instr_src_components(alu1, src1); i++) {
+   /* Different SSA values is the common case, check them before the
+    * swizzles.
+    */
+   if (!nir_srcs_equal(alu1->src[src1].src, alu2->src[src2].src))
+      return false;
+
+   const unsigned num_components = nir_ssa_alu_instr_src_components(alu1, src1);
+   for (unsigned i = 0; i < num_components; i++) {
       if (alu1->src[src1].swizzle[i] != alu2->src[src2].swizzle[i])
          return false;
    }
 
-   return nir_srcs_equal(alu1->src[src1].src, alu2->src[src2].src);
+   return true;
 }
 
 /* Returns "true" if two instructions are equal. Note that this will only
@@ -298,13 +305,8 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
 
       if (tex1->num_srcs != tex2->num_srcs)
          return false;
-      for (unsigned i = 0; i < tex1->num_srcs; i++) {
-         if (tex1->src[i].src_type != tex2->src[i].src_type ||
-             !nir_srcs_equal(tex1->src[i].src, tex2->src[i].src)) {
-            return false;
-         }
-      }
 
+      /* Compare the scalar fields before walking the sources */
       if (tex1->coord_components != tex2->coord_components ||
           tex1->sampler_dim != tex2->sampler_dim ||
           tex1->is_array != tex2->is_array ||
@@ -317,6 +319,13 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
          return false;
       }
 
+      for (unsigned i = 0; i < tex1->num_srcs; i++) {
+         if (tex1->src[i].src_type != tex2->src[i].src_type ||
+             !nir_srcs_equal(tex1->src[i].src, tex2->src[i].src)) {
+            return false;
+         }
+      }
+
       /* Don't support un-lowered sampler derefs currently. */
       assert(!tex1->texture && !tex1->sampler &&
              !tex2->texture && !tex2->sampler);
@@ -374,11 +383,6 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
                             intrinsic2->dest.ssa.bit_size)
          return false;
 
-      for (unsigned i = 0; i < info->num_srcs; i++) {
-         if (!nir_srcs_equal(intrinsic1->src[i], intrinsic2->src[i]))
-            return false;
-      }
-
       assert(info->num_variables == 0);
 
       for (unsigned i = 0; i < info->num_indices; i++) {
@@ -386,6 +390,11 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
             return false;
       }
 
+      for (unsigned i = 0; i < info->num_srcs; i++) {
+         if (!nir_srcs_equal(intrinsic1->src[i], intrinsic2->src[i]))
+            return false;
+      }
+
       return true;
    }
    case nir_instr_type_call:
@@ -508,7 +517,11 @@ nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr)
    if (!instr_can_rewrite(instr))
       return false;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
+   /* Hash once for the search and the insertion, and keep the hash for
+    * nir_instr_set_remove().
+    */
+   uint32_t hash = hash_instr(instr);
+   struct set_entry *entry = _mesa_set_search_pre_hashed(instr_set, hash, instr);
    if (entry) {
       nir_ssa_def *def = nir_instr_get_dest_ssa_def(instr);
       nir_instr *match = (nir_instr *) entry->key;
@@ -526,7 +539,8 @@ nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr)
       return true;
    }
 
-   _mesa_set_add(instr_set, instr);
+   instr->set_hash = hash;
+   _mesa_set_add_pre_hashed(instr_set, hash, instr);
    return false;
 }
 
@@ -536,8 +550,14 @@ nir_instr_set_remove(struct set *instr_set, nir_instr *instr)
    if (!instr_can_rewrite(instr))
       return;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
-   if (entry)
+   /* The instruction may have changed since it was added, e.g. a loop phi
+    * whose source got rewritten, look it up with the hash it was added
+    * with.  Only remove the instruction itself, when it wasn't added an
+    * equal one might be found.
+    */
+   struct set_entry *entry =
+      _mesa_set_search_pre_hashed(instr_set, instr->set_hash, instr);
+   if (entry && entry->key == instr)
       _mesa_set_remove(instr_set, entry);
 }
 
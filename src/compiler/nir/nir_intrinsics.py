@@ -434,6 +434,7 @@ system_value("user_clip_plane", 4, indices=[UCP_ID])
 system_value("num_work_groups", 3)
 system_value("helper_invocation", 1)
 system_value("alpha_ref_float", 1)
+system_value("point_coord", 2)
 system_value("layer_id", 1)
 system_value("view_index", 1)
 system_value("subgroup_size", 1)
@@ -469,6 +469,7 @@ static bool
 is_loop_small_enough_to_unroll(nir_shader *shader, nir_loop_info *li)
 {
    unsigned max_iter = shader->options->max_unroll_iterations;
+   unsigned max_instructions = shader->options->max_unroll_instructions;
 
    if (li->trip_count > max_iter)
       return false;
@@ -476,8 +477,11 @@ is_loop_small_enough_to_unroll(nir_shader *shader, nir_loop_info *li)
    if (li->force_unroll)
       return true;
 
+   if (!max_instructions)
+      max_instructions = max_iter * LOOP_UNROLL_LIMIT;
+
    bool loop_not_too_large =
-      li->num_instructions * li->trip_count <= max_iter * LOOP_UNROLL_LIMIT;
+      li->num_instructions * li->trip_count <= max_instructions;
 
    return loop_not_too_large;
 }
@@ -54,7 +54,8 @@
  * If the number of ALU operations in the branches is greater than the limit
  * parameter, then the optimization is skipped.  In limit=0 mode, the SSA defs
  * must only be MOVs which we expect to get copy-propagated away once they're
- * out of the inner blocks.
+ * out of the inner blocks.  The max_select_flatten_cost compiler option
+ * raises the limit for the backends which would rather not branch.
  */
 
 static bool
@@ -255,6 +256,8 @@ nir_opt_peephole_select(nir_shader *shader, unsigned limit)
 {
    bool progress = false;
 
+   limit = MAX2(limit, shader->options->max_select_flatten_cost);
+
    nir_foreach_function(function, shader) {
       if (function->impl)
          progress |= nir_opt_peephole_select_impl(function->impl, limit);
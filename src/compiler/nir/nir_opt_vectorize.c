@@ -0,0 +1,339 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "util/hash_table.h"
+#include "util/set.h"
+
+/*
+ * Combines the independent per-component ALU instructions of a block which
+ * have the same opcode and read the same SSA values, in any swizzle, into
+ * one instruction of up to vec4.  For example
+ *
+ * ssa_3 = fmul ssa_1.x, ssa_2.y
+ * ssa_4 = fmul ssa_1.z, ssa_2.x
+ *
+ * becomes
+ *
+ * ssa_5 = fmul ssa_1.xz, ssa_2.yx
+ *
+ * with the uses of ssa_3 reading ssa_5.x and the ones of ssa_4 ssa_5.y.
+ * Constant sources of any value are combined into a new constant.
+ *
+ * Because the sources are the same, they are defined before the first
+ * instruction, and the combined one takes its place.  The backend filter
+ * keeps the instructions its units can only run one component at a time.
+ */
+
+#define HASH(hash, data) _mesa_fnv32_1a_accumulate((hash), (data))
+
+static bool
+instr_can_rewrite(nir_instr *instr, nir_opt_vectorize_cb filter, void *data)
+{
+   if (instr->type != nir_instr_type_alu)
+      return false;
+
+   nir_alu_instr *alu = nir_instr_as_alu(instr);
+   const nir_op_info *info = &nir_op_infos[alu->op];
+
+   /* only the ops working on each component on its own */
+   if (info->output_size != 0)
+      return false;
+
+   /* if conditions can't be swizzled */
+   if (!alu->dest.dest.is_ssa || alu->dest.saturate ||
+       alu->dest.dest.ssa.num_components >= 4 ||
+       !list_empty(&alu->dest.dest.ssa.if_uses))
+      return false;
+
+   for (unsigned i = 0; i < info->num_inputs; i++) {
+      if (info->input_sizes[i] != 0 || !alu->src[i].src.is_ssa ||
+          alu->src[i].abs || alu->src[i].negate)
+         return false;
+   }
+
+   return !filter || filter(instr, data);
+}
+
+static bool
+src_is_const(const nir_alu_src *src)
+{
+   return src->src.ssa->parent_instr->type == nir_instr_type_load_const;
+}
+
+static uint32_t
+hash_instr(const void *data)
+{
+   const nir_alu_instr *alu = data;
+   uint32_t hash = _mesa_fnv32_1a_offset_bias;
+
+   hash = HASH(hash, alu->op);
+   hash = HASH(hash, alu->exact);
+   hash = HASH(hash, alu->dest.dest.ssa.bit_size);
+
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      /* constants of any value are combined */
+      if (src_is_const(&alu->src[i]))
+         hash = HASH(hash, alu->src[i].src.ssa->bit_size);
+      else
+         hash = HASH(hash, alu->src[i].src.ssa);
+   }
+
+   return hash;
+}
+
+static bool
+instrs_equal(const void *data1, const void *data2)
+{
+   const nir_alu_instr *alu1 = data1;
+   const nir_alu_instr *alu2 = data2;
+
+   if (alu1->op != alu2->op || alu1->exact != alu2->exact ||
+       alu1->dest.dest.ssa.bit_size != alu2->dest.dest.ssa.bit_size)
+      return false;
+
+   for (unsigned i = 0; i < nir_op_infos[alu1->op].num_inputs; i++) {
+      const nir_alu_src *src1 = &alu1->src[i];
+      const nir_alu_src *src2 = &alu2->src[i];
+
+      if (src1->src.ssa == src2->src.ssa)
+         continue;
+
+      if (!src_is_const(src1) || !src_is_const(src2) ||
+          src1->src.ssa->bit_size != src2->src.ssa->bit_size)
+         return false;
+   }
+
+   return true;
+}
+
+static void
+copy_const_component(nir_const_value *dst, unsigned dst_comp,
+                     const nir_const_value *src, unsigned src_comp,
+                     unsigned bit_size)
+{
+   switch (bit_size) {
+   case 8:
+      dst->u8[dst_comp] = src->u8[src_comp];
+      break;
+   case 16:
+      dst->u16[dst_comp] = src->u16[src_comp];
+      break;
+   case 32:
+      dst->u32[dst_comp] = src->u32[src_comp];
+      break;
+   case 64:
+      dst->u64[dst_comp] = src->u64[src_comp];
+      break;
+   default:
+      unreachable("unknown bit size");
+   }
+}
+
+/* Makes the uses of old read new, its components starting at offset. An
+ * ALU user in the set is hashed on its sources, so it is taken out while
+ * they change.
+ */
+static void
+rewrite_uses(nir_builder *b, struct set *instr_set, nir_ssa_def *old,
+             nir_ssa_def *new, unsigned offset)
+{
+   nir_ssa_def *swizzled = NULL;
+
+   nir_foreach_use_safe(src, old) {
+      nir_instr *user = src->parent_instr;
+
+      if (user->type != nir_instr_type_alu) {
+         if (!swizzled) {
+            unsigned swiz[4] = { offset, offset + 1, offset + 2, offset + 3 };
+            swizzled = nir_swizzle(b, new, swiz, old->num_components, false);
+         }
+         nir_instr_rewrite_src(user, src, nir_src_for_ssa(swizzled));
+         continue;
+      }
+
+      nir_alu_instr *alu = nir_instr_as_alu(user);
+      nir_alu_src *alu_src = exec_node_data(nir_alu_src, src, src);
+      unsigned index = alu_src - alu->src;
+
+      struct set_entry *entry = _mesa_set_search(instr_set, alu);
+      bool in_set = entry && entry->key == alu;
+      if (in_set)
+         _mesa_set_remove(instr_set, entry);
+
+      for (unsigned i = 0; i < 4; i++) {
+         if (nir_alu_instr_channel_used(alu, index, i))
+            alu_src->swizzle[i] += offset;
+      }
+      nir_instr_rewrite_src(user, src, nir_src_for_ssa(new));
+
+      if (in_set)
+         _mesa_set_add(instr_set, alu);
+   }
+}
+
+/* Returns the combined instruction, NULL when there would be more than four
+ * components.
+ */
+static nir_alu_instr *
+instr_try_combine(struct set *instr_set, nir_alu_instr *alu1,
+                  nir_alu_instr *alu2)
+{
+   unsigned comps1 = alu1->dest.dest.ssa.num_components;
+   unsigned comps2 = alu2->dest.dest.ssa.num_components;
+   unsigned total = comps1 + comps2;
+   unsigned bit_size = alu1->dest.dest.ssa.bit_size;
+
+   if (total > 4)
+      return NULL;
+
+   nir_builder b;
+   nir_builder_init(&b, nir_cf_node_get_function(&alu1->instr.block->cf_node));
+   b.cursor = nir_after_instr(&alu1->instr);
+
+   nir_alu_instr *alu = nir_alu_instr_create(b.shader, alu1->op);
+   nir_ssa_dest_init(&alu->instr, &alu->dest.dest, total, bit_size, NULL);
+   alu->dest.write_mask = (1 << total) - 1;
+   alu->exact = alu1->exact;
+
+   for (unsigned i = 0; i < nir_op_infos[alu1->op].num_inputs; i++) {
+      nir_alu_src *src1 = &alu1->src[i];
+      nir_alu_src *src2 = &alu2->src[i];
+
+      if (src1->src.ssa == src2->src.ssa) {
+         alu->src[i].src = nir_src_for_ssa(src1->src.ssa);
+         for (unsigned j = 0; j < comps1; j++)
+            alu->src[i].swizzle[j] = src1->swizzle[j];
+         for (unsigned j = 0; j < comps2; j++)
+            alu->src[i].swizzle[comps1 + j] = src2->swizzle[j];
+         continue;
+      }
+
+      /* two constants, in the order of the components they are read in */
+      nir_load_const_instr *load1 =
+         nir_instr_as_load_const(src1->src.ssa->parent_instr);
+      nir_load_const_instr *load2 =
+         nir_instr_as_load_const(src2->src.ssa->parent_instr);
+      unsigned src_bit_size = src1->src.ssa->bit_size;
+      nir_const_value value;
+
+      memset(&value, 0, sizeof(value));
+      for (unsigned j = 0; j < comps1; j++) {
+         copy_const_component(&value, j, &load1->value, src1->swizzle[j],
+                              src_bit_size);
+      }
+      for (unsigned j = 0; j < comps2; j++) {
+         copy_const_component(&value, comps1 + j, &load2->value,
+                              src2->swizzle[j], src_bit_size);
+      }
+
+      nir_ssa_def *def = nir_build_imm(&b, total, src_bit_size, value);
+      alu->src[i].src = nir_src_for_ssa(def);
+      for (unsigned j = 0; j < total; j++)
+         alu->src[i].swizzle[j] = j;
+   }
+
+   nir_builder_instr_insert(&b, &alu->instr);
+
+   /* the swizzles for the non-ALU uses go after it */
+   b.cursor = nir_after_instr(&alu->instr);
+   rewrite_uses(&b, instr_set, &alu1->dest.dest.ssa, &alu->dest.dest.ssa, 0);
+   rewrite_uses(&b, instr_set, &alu2->dest.dest.ssa, &alu->dest.dest.ssa,
+                comps1);
+
+   nir_instr_remove(&alu1->instr);
+   nir_instr_remove(&alu2->instr);
+
+   return alu;
+}
+
+static bool
+vectorize_block(nir_block *block, struct set *instr_set,
+                nir_opt_vectorize_cb filter, void *data)
+{
+   bool progress = false;
+
+   nir_foreach_instr_safe(instr, block) {
+      if (!instr_can_rewrite(instr, filter, data))
+         continue;
+
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+      struct set_entry *entry = _mesa_set_search(instr_set, alu);
+      if (entry) {
+         nir_alu_instr *other = (nir_alu_instr *) entry->key;
+
+         /* the uses rewritten may add to the set, out before that */
+         _mesa_set_remove(instr_set, entry);
+
+         /* a full one can't take more, and without room the later
+          * instruction stays for the next ones to combine with
+          */
+         nir_alu_instr *combined = instr_try_combine(instr_set, other, alu);
+         if (combined) {
+            if (combined->dest.dest.ssa.num_components < 4)
+               _mesa_set_add(instr_set, combined);
+            progress = true;
+            continue;
+         }
+      }
+
+      _mesa_set_add(instr_set, alu);
+   }
+
+   return progress;
+}
+
+static bool
+nir_opt_vectorize_impl(nir_function_impl *impl, nir_opt_vectorize_cb filter,
+                       void *data)
+{
+   bool progress = false;
+
+   nir_foreach_block(block, impl) {
+      struct set *instr_set = _mesa_set_create(NULL, hash_instr, instrs_equal);
+      progress |= vectorize_block(block, instr_set, filter, data);
+      _mesa_set_destroy(instr_set, NULL);
+   }
+
+   if (progress) {
+      nir_metadata_preserve(impl, nir_metadata_block_index |
+                                  nir_metadata_dominance);
+   }
+
+   return progress;
+}
+
+bool
+nir_opt_vectorize(nir_shader *shader, nir_opt_vectorize_cb filter,
+                  void *data)
+{
+   bool progress = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         progress |= nir_opt_vectorize_impl(function->impl, filter, data);
+   }
+
+   return progress;
+}
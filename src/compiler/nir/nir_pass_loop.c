@@ -0,0 +1,126 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "nir.h"
+#include "util/os_time.h"
+
+#define PASS_NOT_CLEAN (~0u)
+
+static bool
+should_print_pass_stats(void)
+{
+   static int print_stats = -1;
+   if (print_stats < 0)
+      print_stats = env_var_as_boolean("NIR_PASS_STATS", false);
+
+   return print_stats;
+}
+
+void
+nir_pass_loop_init(nir_pass_loop *loop)
+{
+   memset(loop, 0, sizeof(*loop));
+}
+
+bool
+nir_pass_loop_iterate(nir_pass_loop *loop)
+{
+   if (loop->num_iterations && !loop->progress)
+      return false;
+
+   /* every iteration must run the same passes */
+   assert(!loop->num_iterations || loop->pass == loop->num_passes);
+
+   loop->progress = false;
+   loop->pass = 0;
+   loop->num_iterations++;
+   return true;
+}
+
+/**
+ * Returns whether the next pass of the iteration has to run, false if it
+ * didn't make progress last time it ran and the shader didn't change
+ * since.
+ */
+bool
+nir_pass_loop_begin_pass(nir_pass_loop *loop, const char *name)
+{
+   unsigned i = loop->pass++;
+
+   assert(i < NIR_PASS_LOOP_MAX_PASSES);
+   if (i == loop->num_passes) {
+      loop->passes[i].name = name;
+      loop->passes[i].clean = PASS_NOT_CLEAN;
+      loop->num_passes++;
+   }
+   assert(strcmp(loop->passes[i].name, name) == 0);
+
+   if (loop->passes[i].clean == loop->changes) {
+      loop->passes[i].skips++;
+      return false;
+   }
+
+   if (should_print_pass_stats())
+      loop->start = os_time_get_nano();
+
+   return true;
+}
+
+void
+nir_pass_loop_end_pass(nir_pass_loop *loop, bool progress,
+                       bool loop_progress)
+{
+   unsigned i = loop->pass - 1;
+
+   if (should_print_pass_stats())
+      loop->passes[i].time += os_time_get_nano() - loop->start;
+
+   loop->passes[i].runs++;
+
+   if (progress) {
+      loop->passes[i].progress++;
+      loop->passes[i].clean = PASS_NOT_CLEAN;
+      loop->changes++;
+      if (loop_progress)
+         loop->progress = true;
+   } else {
+      loop->passes[i].clean = loop->changes;
+   }
+}
+
+void
+nir_pass_loop_finish(nir_pass_loop *loop, const char *name)
+{
+   if (!should_print_pass_stats())
+      return;
+
+   fprintf(stderr, "%s: %u iterations\n", name, loop->num_iterations);
+   for (unsigned i = 0; i < loop->num_passes; i++) {
+      fprintf(stderr, "   %-32s runs %3u skips %3u progress %3u %8.3f ms\n",
+              loop->passes[i].name, loop->passes[i].runs,
+              loop->passes[i].skips, loop->passes[i].progress,
+              loop->passes[i].time / 1000000.0);
+   }
+}
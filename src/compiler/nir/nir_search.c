@@ -602,6 +602,69 @@ construct_value(const nir_search_value *value,
    }
 }
 
+static uint16_t
+automaton_alu_state(const nir_alu_instr *alu, const uint16_t *states,
+                    const nir_search_op_table *tbl)
+{
+   unsigned index = 0;
+
+   if (!tbl->table)
+      return NIR_SEARCH_STATE_ANY;
+
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      unsigned src_state = alu->src[i].src.is_ssa ?
+         states[alu->src[i].src.ssa->index] : NIR_SEARCH_STATE_ANY;
+
+      index = index * tbl->num_filtered[i] + tbl->filter[i][src_state];
+   }
+
+   return tbl->table[index];
+}
+
+/**
+ * Runs the tree automaton of an algebraic pass over a function, returns
+ * the state of every SSA value, indexed by SSA index, in a malloc'd array.
+ *
+ * The values are visited in order, so that the sources of an ALU
+ * instruction have their state before it.  A search expression can only
+ * match a value whose state lists it, nir_replace_instr() then does the
+ * actual matching, including the conditions, bit sizes and swizzles which
+ * the automaton doesn't track.
+ */
+uint16_t *
+nir_algebraic_automaton(nir_function_impl *impl,
+                        const nir_search_op_table *op_tables)
+{
+   nir_index_ssa_defs(impl);
+
+   uint16_t *states = calloc(impl->ssa_alloc, sizeof(*states));
+   if (!states)
+      return NULL;
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         switch (instr->type) {
+         case nir_instr_type_alu: {
+            nir_alu_instr *alu = nir_instr_as_alu(instr);
+            if (alu->dest.dest.is_ssa) {
+               states[alu->dest.dest.ssa.index] =
+                  automaton_alu_state(alu, states, &op_tables[alu->op]);
+            }
+            break;
+         }
+         case nir_instr_type_load_const:
+            states[nir_instr_as_load_const(instr)->def.index] =
+               NIR_SEARCH_STATE_CONST;
+            break;
+         default:
+            break;
+         }
+      }
+   }
+
+   return states;
+}
+
 nir_alu_instr *
 nir_replace_instr(nir_alu_instr *instr, const nir_search_expression *search,
                   const nir_search_value *replace, void *mem_ctx)
@@ -123,6 +123,29 @@ NIR_DEFINE_CAST(nir_search_value_as_expression, nir_search_value,
                 nir_search_expression, value,
                 type, nir_search_value_expression)
 
+/** State of the values which don't match any expression */
+#define NIR_SEARCH_STATE_ANY 0
+/** State of the load_const values */
+#define NIR_SEARCH_STATE_CONST 1
+
+/**
+ * Transitions of the tree automaton generated by nir_algebraic.py for an
+ * opcode.  The state of an ALU value tells which search expressions, or
+ * parts of search expressions, it may be matched with, from the opcode and
+ * the states of the sources.  filter[i] maps the state of source i to its
+ * index in table, which is a num_filtered[0] x num_filtered[1] x ... array.
+ * A NULL table means the opcode appears in no search expression.
+ */
+typedef struct {
+   const uint16_t *filter[4];
+   uint16_t num_filtered[4];
+   const uint16_t *table;
+} nir_search_op_table;
+
+uint16_t *
+nir_algebraic_automaton(nir_function_impl *impl,
+                        const nir_search_op_table *op_tables);
+
 nir_alu_instr *
 nir_replace_instr(nir_alu_instr *instr, const nir_search_expression *search,
                   const nir_search_value *replace, void *mem_ctx);
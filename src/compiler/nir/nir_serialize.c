@@ -40,7 +40,11 @@ typedef struct {
    struct hash_table *remap_table;
 
    /* the next index to assign to a NIR in-memory object */
-   uintptr_t next_idx;
+   uint32_t next_idx;
+
+   /* maps the types already written to their index + 1 */
+   struct hash_table *type_table;
+   uint32_t next_type_idx;
 
    /* Array of write_phi_fixup structs representing phi sources that need to
     * be resolved in the second pass.
@@ -54,14 +58,17 @@ typedef struct {
    struct blob_reader *blob;
 
    /* the next index to assign to a NIR in-memory object */
-   uintptr_t next_idx;
+   uint32_t next_idx;
 
    /* The length of the index -> object table */
-   uintptr_t idx_table_len;
+   uint32_t idx_table_len;
 
    /* map from index to deserialized pointer */
    void **idx_table;
 
+   /* the types read, in the order of their indices */
+   struct util_dynarray types;
+
    /* List of phi sources. */
    struct list_head phi_srcs;
 
@@ -74,7 +81,7 @@ write_add_object(write_ctx *ctx, const void *obj)
    _mesa_hash_table_insert(ctx->remap_table, obj, (void *) index);
 }
 
-static uintptr_t
+static uint32_t
 write_lookup_object(write_ctx *ctx, const void *obj)
 {
    struct hash_entry *entry = _mesa_hash_table_search(ctx->remap_table, obj);
@@ -85,7 +92,7 @@ write_lookup_object(write_ctx *ctx, const void *obj)
 static void
 write_object(write_ctx *ctx, const void *obj)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, obj));
+   blob_write_uint32(ctx->blob, write_lookup_object(ctx, obj));
 }
 
 static void
@@ -96,7 +103,7 @@ read_add_object(read_ctx *ctx, void *obj)
 }
 
 static void *
-read_lookup_object(read_ctx *ctx, uintptr_t idx)
+read_lookup_object(read_ctx *ctx, uint32_t idx)
 {
    assert(idx < ctx->idx_table_len);
    return ctx->idx_table[idx];
@@ -105,7 +112,47 @@ read_lookup_object(read_ctx *ctx, uintptr_t idx)
 static void *
 read_object(read_ctx *ctx)
 {
-   return read_lookup_object(ctx, blob_read_intptr(ctx->blob));
+   return read_lookup_object(ctx, blob_read_uint32(ctx->blob));
+}
+
+/* Types are encoded the first time they are written, as a 0 followed by the
+ * encoding, which is mostly all the members of the structs.  The following
+ * times only their index + 1 is written.
+ */
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   if (type) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(ctx->type_table, type);
+      if (entry) {
+         blob_write_uint32(ctx->blob, (uintptr_t) entry->data);
+         return;
+      }
+
+      uintptr_t index = ++ctx->next_type_idx;
+      _mesa_hash_table_insert(ctx->type_table, type, (void *) index);
+   }
+
+   blob_write_uint32(ctx->blob, 0);
+   encode_type_to_blob(ctx->blob, type);
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t index = blob_read_uint32(ctx->blob);
+   if (index) {
+      assert(index * sizeof(const struct glsl_type *) <= ctx->types.size);
+      return *util_dynarray_element(&ctx->types, const struct glsl_type *,
+                                    index - 1);
+   }
+
+   const struct glsl_type *type = decode_type_from_blob(ctx->blob);
+   if (type)
+      util_dynarray_append(&ctx->types, const struct glsl_type *, type);
+
+   return type;
 }
 
 static void
@@ -135,7 +182,7 @@ static void
 write_variable(write_ctx *ctx, const nir_variable *var)
 {
    write_add_object(ctx, var);
-   encode_type_to_blob(ctx->blob, var->type);
+   write_type(ctx, var->type);
    blob_write_uint32(ctx->blob, !!(var->name));
    if (var->name)
       blob_write_string(ctx->blob, var->name);
@@ -148,7 +195,7 @@ write_variable(write_ctx *ctx, const nir_variable *var)
       write_constant(ctx, var->constant_initializer);
    blob_write_uint32(ctx->blob, !!(var->interface_type));
    if (var->interface_type)
-      encode_type_to_blob(ctx->blob, var->interface_type);
+      write_type(ctx, var->interface_type);
 }
 
 static nir_variable *
@@ -157,7 +204,7 @@ read_variable(read_ctx *ctx)
    nir_variable *var = rzalloc(ctx->nir, nir_variable);
    read_add_object(ctx, var);
 
-   var->type = decode_type_from_blob(ctx->blob);
+   var->type = read_type(ctx);
    bool has_name = blob_read_uint32(ctx->blob);
    if (has_name) {
       const char *name = blob_read_string(ctx->blob);
@@ -177,7 +224,7 @@ read_variable(read_ctx *ctx)
       var->constant_initializer = NULL;
    bool has_interface_type = blob_read_uint32(ctx->blob);
    if (has_interface_type)
-      var->interface_type = decode_type_from_blob(ctx->blob);
+      var->interface_type = read_type(ctx);
    else
       var->interface_type = NULL;
 
@@ -274,14 +321,14 @@ write_src(write_ctx *ctx, const nir_src *src)
     * address space would've been exhausted allocating the remap table!
     */
    if (src->is_ssa) {
-      uintptr_t idx = write_lookup_object(ctx, src->ssa) << 2;
+      uint32_t idx = write_lookup_object(ctx, src->ssa) << 2;
       idx |= 1;
-      blob_write_intptr(ctx->blob, idx);
+      blob_write_uint32(ctx->blob, idx);
    } else {
-      uintptr_t idx = write_lookup_object(ctx, src->reg.reg) << 2;
+      uint32_t idx = write_lookup_object(ctx, src->reg.reg) << 2;
       if (src->reg.indirect)
          idx |= 2;
-      blob_write_intptr(ctx->blob, idx);
+      blob_write_uint32(ctx->blob, idx);
       blob_write_uint32(ctx->blob, src->reg.base_offset);
       if (src->reg.indirect) {
          write_src(ctx, src->reg.indirect);
@@ -292,8 +339,8 @@ write_src(write_ctx *ctx, const nir_src *src)
 static void
 read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
 {
-   uintptr_t val = blob_read_intptr(ctx->blob);
-   uintptr_t idx = val >> 2;
+   uint32_t val = blob_read_uint32(ctx->blob);
+   uint32_t idx = val >> 2;
    src->is_ssa = val & 0x1;
    if (src->is_ssa) {
       src->ssa = read_lookup_object(ctx, idx);
@@ -327,7 +374,7 @@ write_dest(write_ctx *ctx, const nir_dest *dst)
       if (dst->ssa.name)
          blob_write_string(ctx->blob, dst->ssa.name);
    } else {
-      blob_write_intptr(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
+      write_object(ctx, dst->reg.reg);
       blob_write_uint32(ctx->blob, dst->reg.base_offset);
       if (dst->reg.indirect)
          write_src(ctx, dst->reg.indirect);
@@ -387,7 +434,7 @@ write_deref_chain(write_ctx *ctx, const nir_deref_var *deref_var)
          unreachable("Invalid deref type");
       }
 
-      encode_type_to_blob(ctx->blob, d->type);
+      write_type(ctx, d->type);
    }
 }
 
@@ -423,7 +470,7 @@ read_deref_chain(read_ctx *ctx, void *mem_ctx)
          unreachable("Invalid deref type");
       }
 
-      deref->type = decode_type_from_blob(ctx->blob);
+      deref->type = read_type(ctx);
 
       tail->child = deref;
       tail = deref;
@@ -435,10 +482,10 @@ read_deref_chain(read_ctx *ctx, void *mem_ctx)
 static void
 write_alu(write_ctx *ctx, const nir_alu_instr *alu)
 {
-   blob_write_uint32(ctx->blob, alu->op);
-   uint32_t flags = alu->exact;
-   flags |= alu->dest.saturate << 1;
-   flags |= alu->dest.write_mask << 2;
+   uint32_t flags = alu->op;
+   flags |= alu->exact << 16;
+   flags |= alu->dest.saturate << 17;
+   flags |= alu->dest.write_mask << 18;
    blob_write_uint32(ctx->blob, flags);
 
    write_dest(ctx, &alu->dest.dest);
@@ -456,13 +503,13 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
 static nir_alu_instr *
 read_alu(read_ctx *ctx)
 {
-   nir_op op = blob_read_uint32(ctx->blob);
+   uint32_t flags = blob_read_uint32(ctx->blob);
+   nir_op op = flags & 0xffff;
    nir_alu_instr *alu = nir_alu_instr_create(ctx->nir, op);
 
-   uint32_t flags = blob_read_uint32(ctx->blob);
-   alu->exact = flags & 1;
-   alu->dest.saturate = flags & 2;
-   alu->dest.write_mask = flags >> 2;
+   alu->exact = (flags >> 16) & 1;
+   alu->dest.saturate = (flags >> 17) & 1;
+   alu->dest.write_mask = flags >> 18;
 
    read_dest(ctx, &alu->dest.dest, &alu->instr);
 
@@ -481,14 +528,14 @@ read_alu(read_ctx *ctx)
 static void
 write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
 {
-   blob_write_uint32(ctx->blob, intrin->intrinsic);
+   assert(intrin->intrinsic < (1 << 16));
+   blob_write_uint32(ctx->blob,
+                     intrin->intrinsic | intrin->num_components << 16);
 
    unsigned num_variables = nir_intrinsic_infos[intrin->intrinsic].num_variables;
    unsigned num_srcs = nir_intrinsic_infos[intrin->intrinsic].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[intrin->intrinsic].num_indices;
 
-   blob_write_uint32(ctx->blob, intrin->num_components);
-
    if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
       write_dest(ctx, &intrin->dest);
 
@@ -505,7 +552,8 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
 static nir_intrinsic_instr *
 read_intrinsic(read_ctx *ctx)
 {
-   nir_intrinsic_op op = blob_read_uint32(ctx->blob);
+   uint32_t val = blob_read_uint32(ctx->blob);
+   nir_intrinsic_op op = val & 0xffff;
 
    nir_intrinsic_instr *intrin = nir_intrinsic_instr_create(ctx->nir, op);
 
@@ -513,7 +561,7 @@ read_intrinsic(read_ctx *ctx)
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[op].num_indices;
 
-   intrin->num_components = blob_read_uint32(ctx->blob);
+   intrin->num_components = val >> 16;
 
    if (nir_intrinsic_infos[op].has_dest)
       read_dest(ctx, &intrin->dest, &intrin->instr);
@@ -536,7 +584,9 @@ write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
    uint32_t val = lc->def.num_components;
    val |= lc->def.bit_size << 3;
    blob_write_uint32(ctx->blob, val);
-   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   /* the components are at the start of the value, only them are written */
+   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value,
+                    lc->def.num_components * lc->def.bit_size / 8);
    write_add_object(ctx, &lc->def);
 }
 
@@ -548,7 +598,8 @@ read_load_const(read_ctx *ctx)
    nir_load_const_instr *lc =
       nir_load_const_instr_create(ctx->nir, val & 0x7, val >> 3);
 
-   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value,
+                   lc->def.num_components * lc->def.bit_size / 8);
    read_add_object(ctx, &lc->def);
    return lc;
 }
@@ -664,7 +715,7 @@ static void
 write_phi(write_ctx *ctx, const nir_phi_instr *phi)
 {
    /* Phi nodes are special, since they may reference SSA definitions and
-    * basic blocks that don't exist yet. We leave two empty uintptr_t's here,
+    * basic blocks that don't exist yet. We leave two empty uint32_t's here,
     * and then store enough information so that a later fixup pass can fill
     * them in correctly.
     */
@@ -674,9 +725,9 @@ write_phi(write_ctx *ctx, const nir_phi_instr *phi)
 
    nir_foreach_phi_src(src, phi) {
       assert(src->src.is_ssa);
-      size_t blob_offset = blob_reserve_intptr(ctx->blob);
-      MAYBE_UNUSED size_t blob_offset2 = blob_reserve_intptr(ctx->blob);
-      assert(blob_offset + sizeof(uintptr_t) == blob_offset2);
+      size_t blob_offset = blob_reserve_uint32(ctx->blob);
+      MAYBE_UNUSED size_t blob_offset2 = blob_reserve_uint32(ctx->blob);
+      assert(blob_offset + sizeof(uint32_t) == blob_offset2);
       write_phi_fixup fixup = {
          .blob_offset = blob_offset,
          .src = src->src.ssa,
@@ -690,7 +741,7 @@ static void
 write_fixup_phis(write_ctx *ctx)
 {
    util_dynarray_foreach(&ctx->phi_fixups, write_phi_fixup, fixup) {
-      uintptr_t *blob_ptr = (uintptr_t *)(ctx->blob->data + fixup->blob_offset);
+      uint32_t *blob_ptr = (uint32_t *)(ctx->blob->data + fixup->blob_offset);
       blob_ptr[0] = write_lookup_object(ctx, fixup->src);
       blob_ptr[1] = write_lookup_object(ctx, fixup->block);
    }
@@ -718,11 +769,12 @@ read_phi(read_ctx *ctx, nir_block *blk)
    nir_instr_insert_after_block(blk, &phi->instr);
 
    for (unsigned i = 0; i < num_srcs; i++) {
-      nir_phi_src *src = ralloc(phi, nir_phi_src);
+      nir_phi_src *src =
+         ralloc_pool_size(ctx->nir->instr_pool, phi, sizeof(*src));
 
       src->src.is_ssa = true;
-      src->src.ssa = (nir_ssa_def *) blob_read_intptr(ctx->blob);
-      src->pred = (nir_block *) blob_read_intptr(ctx->blob);
+      src->src.ssa = (nir_ssa_def *)(uintptr_t) blob_read_uint32(ctx->blob);
+      src->pred = (nir_block *)(uintptr_t) blob_read_uint32(ctx->blob);
 
       /* Since we're not letting nir_insert_instr handle use/def stuff for us,
        * we have to set the parent_instr manually.  It doesn't really matter
@@ -773,7 +825,7 @@ read_jump(read_ctx *ctx)
 static void
 write_call(write_ctx *ctx, const nir_call_instr *call)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, call->callee));
+   write_object(ctx, call->callee);
 
    for (unsigned i = 0; i < call->num_params; i++)
       write_deref_chain(ctx, call->params[i]);
@@ -1063,10 +1115,10 @@ write_function(write_ctx *ctx, const nir_function *fxn)
    blob_write_uint32(ctx->blob, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
       blob_write_uint32(ctx->blob, fxn->params[i].param_type);
-      encode_type_to_blob(ctx->blob, fxn->params[i].type);
+      write_type(ctx, fxn->params[i].type);
    }
 
-   encode_type_to_blob(ctx->blob, fxn->return_type);
+   write_type(ctx, fxn->return_type);
 
    /* At first glance, it looks like we should write the function_impl here.
     * However, call instructions need to be able to reference at least the
@@ -1088,10 +1140,10 @@ read_function(read_ctx *ctx)
    fxn->num_params = blob_read_uint32(ctx->blob);
    for (unsigned i = 0; i < fxn->num_params; i++) {
       fxn->params[i].param_type = blob_read_uint32(ctx->blob);
-      fxn->params[i].type = decode_type_from_blob(ctx->blob);
+      fxn->params[i].type = read_type(ctx);
    }
 
-   fxn->return_type = decode_type_from_blob(ctx->blob);
+   fxn->return_type = read_type(ctx);
 }
 
 void
@@ -1101,11 +1153,14 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
    ctx.remap_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
                                              _mesa_key_pointer_equal);
    ctx.next_idx = 0;
+   ctx.type_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                            _mesa_key_pointer_equal);
+   ctx.next_type_idx = 0;
    ctx.blob = blob;
    ctx.nir = nir;
    util_dynarray_init(&ctx.phi_fixups, NULL);
 
-   size_t idx_size_offset = blob_reserve_intptr(blob);
+   size_t idx_size_offset = blob_reserve_uint32(blob);
 
    struct shader_info info = nir->info;
    uint32_t strings = 0;
@@ -1144,9 +1199,10 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
       write_function_impl(&ctx, fxn->impl);
    }
 
-   *(uintptr_t *)(blob->data + idx_size_offset) = ctx.next_idx;
+   blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
    _mesa_hash_table_destroy(ctx.remap_table, NULL);
+   _mesa_hash_table_destroy(ctx.type_table, NULL);
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
@@ -1158,9 +1214,10 @@ nir_deserialize(void *mem_ctx,
    read_ctx ctx;
    ctx.blob = blob;
    list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_intptr(blob);
+   ctx.idx_table_len = blob_read_uint32(blob);
    ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
    ctx.next_idx = 0;
+   util_dynarray_init(&ctx.types, NULL);
 
    uint32_t strings = blob_read_uint32(blob);
    char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
@@ -1198,6 +1255,7 @@ nir_deserialize(void *mem_ctx,
       fxn->impl = read_function_impl(&ctx, fxn);
 
    free(ctx.idx_table);
+   util_dynarray_fini(&ctx.types);
 
    return ctx.nir;
 }
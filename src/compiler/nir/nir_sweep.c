@@ -171,6 +171,9 @@ nir_sweep(nir_shader *nir)
       sweep_function(nir, func);
    }
 
-   /* Free everything we didn't steal back. */
+   /* Free everything we didn't steal back.  The dead instructions go to
+    * the pool, whose chunks left without a live instruction are freed.
+    */
    ralloc_free(rubbish);
+   ralloc_pool_trim(nir->instr_pool);
 }
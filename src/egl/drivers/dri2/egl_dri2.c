@@ -460,6 +460,7 @@ static const struct dri2_extension_match optional_core_extensions[] = {
    { __DRI_IMAGE, 1, offsetof(struct dri2_egl_display, image) },
    { __DRI2_FLUSH_CONTROL, 1, offsetof(struct dri2_egl_display, flush_control) },
    { __DRI2_BLOB, 1, offsetof(struct dri2_egl_display, blob) },
+   { __DRI2_BUFFER_DAMAGE, 1, offsetof(struct dri2_egl_display, buffer_damage) },
    { NULL, 0, 0 }
 };
 
@@ -1654,15 +1655,33 @@ dri2_flush_drawable_for_swapbuffers(_EGLDisplay *disp, _EGLSurface *draw)
    }
 }
 
+/* the damage region of EGL_KHR_partial_update only lasts for a frame */
+static void
+dri2_reset_damage_region(_EGLDisplay *dpy, _EGLSurface *surf)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
+
+   if (!surf->SetDamageRegionCalled || !dri2_dpy->buffer_damage ||
+       !dri2_dpy->buffer_damage->set_damage_region)
+      return;
+
+   __DRIdrawable *dri_drawable = dri2_dpy->vtbl->get_dri_drawable(surf);
+   dri2_dpy->buffer_damage->set_damage_region(dri_drawable, 0, NULL);
+}
+
 static EGLBoolean
 dri2_swap_buffers(_EGLDriver *drv, _EGLDisplay *dpy, _EGLSurface *surf)
 {
    struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
    _EGLContext *ctx = _eglGetCurrentContext();
+   EGLBoolean ret;
 
    if (ctx && surf)
       dri2_surf_update_fence_fd(ctx, dpy, surf);
-   return dri2_dpy->vtbl->swap_buffers(drv, dpy, surf);
+   ret = dri2_dpy->vtbl->swap_buffers(drv, dpy, surf);
+   if (ret)
+      dri2_reset_damage_region(dpy, surf);
+   return ret;
 }
 
 static EGLBoolean
@@ -1672,11 +1691,15 @@ dri2_swap_buffers_with_damage(_EGLDriver *drv, _EGLDisplay *dpy,
 {
    struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
    _EGLContext *ctx = _eglGetCurrentContext();
+   EGLBoolean ret;
 
    if (ctx && surf)
       dri2_surf_update_fence_fd(ctx, dpy, surf);
-   return dri2_dpy->vtbl->swap_buffers_with_damage(drv, dpy, surf,
-                                                   rects, n_rects);
+   ret = dri2_dpy->vtbl->swap_buffers_with_damage(drv, dpy, surf,
+                                                  rects, n_rects);
+   if (ret)
+      dri2_reset_damage_region(dpy, surf);
+   return ret;
 }
 
 static EGLBoolean
@@ -1692,6 +1715,14 @@ dri2_set_damage_region(_EGLDriver *drv, _EGLDisplay *dpy, _EGLSurface *surf,
                        EGLint *rects, EGLint n_rects)
 {
    struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
+
+   /* the driver may skip rendering outside of the region, the platform
+    * tells the compositor */
+   if (dri2_dpy->buffer_damage && dri2_dpy->buffer_damage->set_damage_region) {
+      __DRIdrawable *dri_drawable = dri2_dpy->vtbl->get_dri_drawable(surf);
+      dri2_dpy->buffer_damage->set_damage_region(dri_drawable, n_rects, rects);
+   }
+
    return dri2_dpy->vtbl->set_damage_region(drv, dpy, surf, rects, n_rects);
 }
 
@@ -1836,7 +1867,7 @@ dri2_create_image(_EGLDriver *drv, _EGLDisplay *dpy, _EGLContext *ctx,
                                        attr_list);
 }
 
-static _EGLImage *
+_EGLImage *
 dri2_create_image_from_dri(_EGLDisplay *disp, __DRIimage *dri_image)
 {
    struct dri2_egl_image *dri2_img;
@@ -1996,6 +2027,28 @@ dri2_get_sync_values_chromium(_EGLDisplay *dpy, _EGLSurface *surf,
    return dri2_dpy->vtbl->get_sync_values(dpy, surf, ust, msc, sbc);
 }
 
+static EGLBoolean
+dri2_acquire_swap_chain_image_mesa(_EGLDriver *drv, _EGLDisplay *dpy,
+                                   _EGLSurface *surf, _EGLImage **img,
+                                   EGLint *fence_fd)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
+   if (!dri2_dpy->vtbl->acquire_swap_chain_image)
+      return _eglError(EGL_BAD_SURFACE, "eglAcquireSwapChainImageMESA");
+   return dri2_dpy->vtbl->acquire_swap_chain_image(drv, dpy, surf, img,
+                                                   fence_fd);
+}
+
+static EGLBoolean
+dri2_release_swap_chain_image_mesa(_EGLDriver *drv, _EGLDisplay *dpy,
+                                   _EGLSurface *surf, _EGLImage *img)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(dpy);
+   if (!dri2_dpy->vtbl->release_swap_chain_image)
+      return _eglError(EGL_BAD_SURFACE, "eglReleaseSwapChainImageMESA");
+   return dri2_dpy->vtbl->release_swap_chain_image(drv, dpy, surf, img);
+}
+
 /**
  * Set the error code after a call to
  * dri2_egl_image::dri_image::createImageFromTexture.
@@ -3252,6 +3305,8 @@ _eglBuiltInDriver(void)
    dri2_drv->API.QueryWaylandBufferWL = dri2_query_wayland_buffer_wl;
 #endif
    dri2_drv->API.GetSyncValuesCHROMIUM = dri2_get_sync_values_chromium;
+   dri2_drv->API.AcquireSwapChainImageMESA = dri2_acquire_swap_chain_image_mesa;
+   dri2_drv->API.ReleaseSwapChainImageMESA = dri2_release_swap_chain_image_mesa;
    dri2_drv->API.CreateSyncKHR = dri2_create_sync;
    dri2_drv->API.ClientWaitSyncKHR = dri2_client_wait_sync;
    dri2_drv->API.SignalSyncKHR = dri2_signal_sync;
@@ -60,6 +60,14 @@ struct zwp_linux_dmabuf_v1;
 
 #ifdef HAVE_DRM_PLATFORM
 #include <gbm_driint.h>
+
+/* beyond this many swap damage rects, their bounding box is kept */
+#define DRI2_DRM_MAX_DAMAGE_RECTS 8
+#endif
+
+#ifdef HAVE_SURFACELESS_PLATFORM
+/* beyond EGL_MESA_pbuffer_swap_chain lengths of this, EGL_BAD_PARAMETER */
+#define DRI2_SURFACELESS_MAX_SWAP_CHAIN 8
 #endif
 
 #ifdef HAVE_ANDROID_PLATFORM
@@ -153,6 +161,14 @@ struct dri2_egl_display_vtbl {
    __DRIdrawable *(*get_dri_drawable)(_EGLSurface *surf);
 
    void (*close_screen_notify)(_EGLDisplay *dpy);
+
+   /* EGL_MESA_pbuffer_swap_chain, for the platforms exposing it */
+   EGLBoolean (*acquire_swap_chain_image)(_EGLDriver *drv, _EGLDisplay *dpy,
+                                          _EGLSurface *surf,
+                                          _EGLImage **img, EGLint *fence_fd);
+
+   EGLBoolean (*release_swap_chain_image)(_EGLDriver *drv, _EGLDisplay *dpy,
+                                          _EGLSurface *surf, _EGLImage *img);
 };
 
 struct dri2_egl_display
@@ -178,6 +194,7 @@ struct dri2_egl_display
    const __DRI2configQueryExtension *config;
    const __DRI2fenceExtension *fence;
    const __DRI2blobExtension *blob;
+   const __DRI2bufferDamageExtension *buffer_damage;
    const __DRI2rendererQueryExtension *rendererQuery;
    const __DRI2interopExtension *interop;
    int                       fd;
@@ -301,6 +318,10 @@ struct dri2_egl_surface
 #endif
 #ifdef HAVE_DRM_PLATFORM
       struct gbm_bo       *bo;
+      /* damage of the swap which presented the buffer, top-left origin
+       * x, y, width, height, -1 rects for the whole buffer */
+      int32_t             damage[DRI2_DRM_MAX_DAMAGE_RECTS][4];
+      int                 num_damage_rects;
 #endif
       bool                locked;
       int                 age;
@@ -326,6 +347,18 @@ struct dri2_egl_surface
 #if defined(HAVE_SURFACELESS_PLATFORM)
       __DRIimage           *front;
       unsigned int         visual;
+
+      /* EGL_MESA_pbuffer_swap_chain ring, front is the one of cur_image */
+      struct {
+         __DRIimage        *dri_image;
+         /* the image handed out by eglAcquireSwapChainImageMESA */
+         _EGLImage         *acquired;
+         bool               queued;
+         uint64_t           sbc;
+         int                fence_fd;
+      } swap_chain[DRI2_SURFACELESS_MAX_SWAP_CHAIN];
+      int                  cur_image;
+      uint64_t             swap_sbc;
 #endif
    int out_fence_fd;
    EGLBoolean enable_out_fence;
@@ -408,6 +441,9 @@ _EGLImage *
 dri2_create_image_dma_buf(_EGLDisplay *disp, _EGLContext *ctx,
                           EGLClientBuffer buffer, const EGLint *attr_list);
 
+_EGLImage *
+dri2_create_image_from_dri(_EGLDisplay *disp, __DRIimage *dri_image);
+
 #ifdef HAVE_X11_PLATFORM
 EGLBoolean
 dri2_initialize_x11(_EGLDriver *drv, _EGLDisplay *disp);
@@ -25,6 +25,7 @@
  *    Kristian Høgsberg <krh@bitplanet.net>
  */
 
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -36,6 +37,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "util/macros.h"
+
 #include "egl_dri2.h"
 #include "egl_dri2_fallbacks.h"
 #include "loader.h"
@@ -90,6 +93,30 @@ has_free_buffers(struct gbm_surface *_surf)
    return 0;
 }
 
+static int
+get_buffer_damage(struct gbm_surface *_surf, struct gbm_bo *bo,
+                  int32_t *rects, int max_rects)
+{
+   struct gbm_dri_surface *surf = (struct gbm_dri_surface *) _surf;
+   struct dri2_egl_surface *dri2_surf = surf->dri_private;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(dri2_surf->color_buffers); i++) {
+      if (dri2_surf->color_buffers[i].bo == bo) {
+         int num = dri2_surf->color_buffers[i].num_damage_rects;
+
+         /* 0 for the buffers never swapped with damage */
+         if (num <= 0)
+            return -1;
+
+         memcpy(rects, dri2_surf->color_buffers[i].damage,
+                MIN2(num, max_rects) * sizeof(int32_t[4]));
+         return num;
+      }
+   }
+
+   return -1;
+}
+
 static bool
 dri2_drm_config_is_compatible(struct dri2_egl_display *dri2_dpy,
                               const __DRIconfig *config,
@@ -443,6 +470,7 @@ dri2_drm_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *draw)
 
       dri2_surf->current = dri2_surf->back;
       dri2_surf->current->age = 1;
+      dri2_surf->current->num_damage_rects = -1;
       dri2_surf->back = NULL;
    }
 
@@ -466,6 +494,76 @@ dri2_drm_query_buffer_age(_EGLDriver *drv,
    return dri2_surf->back->age;
 }
 
+/**
+ * Keep the damage with the presented buffer for
+ * gbm_surface_get_buffer_damage(), flipped to a top-left origin.  More
+ * rectangles than fit are merged into their bounding box.
+ */
+static void
+set_buffer_damage(struct dri2_egl_surface *dri2_surf, const EGLint *rects,
+                  EGLint n_rects)
+{
+   const int height = dri2_surf->base.Height;
+   int32_t (*damage)[4] = dri2_surf->current->damage;
+
+   if (n_rects <= DRI2_DRM_MAX_DAMAGE_RECTS) {
+      for (EGLint i = 0; i < n_rects; i++) {
+         const EGLint *rect = &rects[i * 4];
+
+         damage[i][0] = rect[0];
+         damage[i][1] = height - rect[1] - rect[3];
+         damage[i][2] = rect[2];
+         damage[i][3] = rect[3];
+      }
+      dri2_surf->current->num_damage_rects = n_rects;
+      return;
+   }
+
+   int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+   for (EGLint i = 0; i < n_rects; i++) {
+      const EGLint *rect = &rects[i * 4];
+
+      x0 = MIN2(x0, rect[0]);
+      y0 = MIN2(y0, rect[1]);
+      x1 = MAX2(x1, rect[0] + rect[2]);
+      y1 = MAX2(y1, rect[1] + rect[3]);
+   }
+   damage[0][0] = x0;
+   damage[0][1] = height - y1;
+   damage[0][2] = x1 - x0;
+   damage[0][3] = y1 - y0;
+   dri2_surf->current->num_damage_rects = 1;
+}
+
+static EGLBoolean
+dri2_drm_swap_buffers_with_damage(_EGLDriver *drv, _EGLDisplay *disp,
+                                  _EGLSurface *draw, const EGLint *rects,
+                                  EGLint n_rects)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(draw);
+
+   if (!dri2_drm_swap_buffers(drv, disp, draw))
+      return EGL_FALSE;
+
+   /* no rects means the whole surface */
+   if (dri2_dpy->flush && dri2_surf->base.Type == EGL_WINDOW_BIT &&
+       dri2_surf->current && n_rects > 0)
+      set_buffer_damage(dri2_surf, rects, n_rects);
+
+   return EGL_TRUE;
+}
+
+/* the region only goes to the driver, see dri2_set_damage_region, and the
+ * whole buffer is presented */
+static EGLBoolean
+dri2_drm_set_damage_region(_EGLDriver *drv, _EGLDisplay *disp,
+                           _EGLSurface *draw, const EGLint *rects,
+                           EGLint n_rects)
+{
+   return EGL_TRUE;
+}
+
 static _EGLImage *
 dri2_drm_create_image_khr_pixmap(_EGLDisplay *disp, _EGLContext *ctx,
                                  EGLClientBuffer buffer, const EGLint *attr_list)
@@ -677,9 +775,9 @@ static const struct dri2_egl_display_vtbl dri2_drm_display_vtbl = {
    .destroy_surface = dri2_drm_destroy_surface,
    .create_image = dri2_drm_create_image_khr,
    .swap_buffers = dri2_drm_swap_buffers,
-   .swap_buffers_with_damage = dri2_fallback_swap_buffers_with_damage,
+   .swap_buffers_with_damage = dri2_drm_swap_buffers_with_damage,
    .swap_buffers_region = dri2_fallback_swap_buffers_region,
-   .set_damage_region = dri2_fallback_set_damage_region,
+   .set_damage_region = dri2_drm_set_damage_region,
    .post_sub_buffer = dri2_fallback_post_sub_buffer,
    .copy_buffers = dri2_fallback_copy_buffers,
    .query_buffer_age = dri2_drm_query_buffer_age,
@@ -755,6 +853,7 @@ dri2_initialize_drm(_EGLDriver *drv, _EGLDisplay *disp)
    dri2_dpy->gbm_dri->base.surface_lock_front_buffer = lock_front_buffer;
    dri2_dpy->gbm_dri->base.surface_release_buffer = release_buffer;
    dri2_dpy->gbm_dri->base.surface_has_free_buffers = has_free_buffers;
+   dri2_dpy->gbm_dri->base.surface_get_buffer_damage = get_buffer_damage;
 
    if (!dri2_setup_extensions(disp)) {
       err = "DRI2: failed to find required DRI extensions";
@@ -771,6 +870,10 @@ dri2_initialize_drm(_EGLDriver *drv, _EGLDisplay *disp)
    disp->Extensions.KHR_image_pixmap = EGL_TRUE;
    if (dri2_dpy->dri2)
       disp->Extensions.EXT_buffer_age = EGL_TRUE;
+   if (dri2_dpy->dri2 && dri2_dpy->buffer_damage &&
+       dri2_dpy->buffer_damage->set_damage_region)
+      disp->Extensions.KHR_partial_update = EGL_TRUE;
+   disp->Extensions.EXT_swap_buffers_with_damage = EGL_TRUE;
 
 #ifdef HAVE_WAYLAND_PLATFORM
    dri2_dpy->device_name = loader_get_device_name_for_fd(dri2_dpy->fd);
@@ -39,23 +39,49 @@
 
 static __DRIimage*
 surfaceless_alloc_image(struct dri2_egl_display *dri2_dpy,
-                     struct dri2_egl_surface *dri2_surf)
+                     struct dri2_egl_surface *dri2_surf, unsigned use)
 {
    return dri2_dpy->image->createImage(
             dri2_dpy->dri_screen,
             dri2_surf->base.Width,
             dri2_surf->base.Height,
             dri2_surf->visual,
-            0,
+            use,
             NULL);
 }
 
+/* The swap chain image rendered to, exportable for its consumer */
+static __DRIimage*
+surfaceless_swap_chain_image(struct dri2_egl_display *dri2_dpy,
+                             struct dri2_egl_surface *dri2_surf)
+{
+   int cur = dri2_surf->cur_image;
+
+   if (!dri2_surf->swap_chain[cur].dri_image)
+      dri2_surf->swap_chain[cur].dri_image =
+         surfaceless_alloc_image(dri2_dpy, dri2_surf, __DRI_IMAGE_USE_SHARE);
+
+   return dri2_surf->swap_chain[cur].dri_image;
+}
+
 static void
 surfaceless_free_images(struct dri2_egl_surface *dri2_surf)
 {
    struct dri2_egl_display *dri2_dpy =
       dri2_egl_display(dri2_surf->base.Resource.Display);
 
+   if (dri2_surf->base.SwapChainLength) {
+      /* the acquired images hold their own reference */
+      for (int i = 0; i < dri2_surf->base.SwapChainLength; i++) {
+         if (dri2_surf->swap_chain[i].dri_image)
+            dri2_dpy->image->destroyImage(dri2_surf->swap_chain[i].dri_image);
+         if (dri2_surf->swap_chain[i].fence_fd >= 0)
+            close(dri2_surf->swap_chain[i].fence_fd);
+      }
+      dri2_surf->front = NULL;
+      return;
+   }
+
    if (dri2_surf->front) {
       dri2_dpy->image->destroyImage(dri2_surf->front);
       dri2_surf->front = NULL;
@@ -94,9 +120,11 @@ surfaceless_image_get_buffers(__DRIdrawable *driDrawable,
 
    if (buffer_mask & __DRI_IMAGE_BUFFER_FRONT) {
 
-      if (!dri2_surf->front)
+      if (!dri2_surf->front && dri2_surf->base.SwapChainLength)
+         dri2_surf->front = surfaceless_swap_chain_image(dri2_dpy, dri2_surf);
+      else if (!dri2_surf->front)
          dri2_surf->front =
-            surfaceless_alloc_image(dri2_dpy, dri2_surf);
+            surfaceless_alloc_image(dri2_dpy, dri2_surf, 0);
 
       buffers->image_mask |= __DRI_IMAGE_BUFFER_FRONT;
       buffers->front = dri2_surf->front;
@@ -127,6 +155,13 @@ dri2_surfaceless_create_surface(_EGLDriver *drv, _EGLDisplay *disp, EGLint type,
    if (!dri2_init_surface(&dri2_surf->base, disp, type, conf, attrib_list, false))
       goto cleanup_surface;
 
+   if (dri2_surf->base.SwapChainLength > DRI2_SURFACELESS_MAX_SWAP_CHAIN) {
+      _eglError(EGL_BAD_PARAMETER, "eglCreatePbufferSurface");
+      goto cleanup_surface;
+   }
+   for (int i = 0; i < DRI2_SURFACELESS_MAX_SWAP_CHAIN; i++)
+      dri2_surf->swap_chain[i].fence_fd = -1;
+
    config = dri2_get_dri_config(dri2_conf, type,
                                 dri2_surf->base.GLColorspace);
 
@@ -178,6 +213,98 @@ dri2_surfaceless_create_pbuffer_surface(_EGLDriver *drv, _EGLDisplay *disp,
                                   attrib_list);
 }
 
+/* The fence fd of the frame rendered by the current context, -1 once it is
+ * complete when there are no native fences.
+ */
+static int
+surfaceless_frame_fence_fd(_EGLDisplay *disp)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   __DRIcontext *dri_ctx =
+      dri2_egl_context(_eglGetCurrentContext())->dri_context;
+   int fence_fd = -1;
+   void *fence;
+
+   if (disp->Extensions.ANDROID_native_fence_sync) {
+      fence = dri2_dpy->fence->create_fence_fd(dri_ctx, -1);
+      if (fence) {
+         fence_fd = dri2_dpy->fence->get_fence_fd(dri2_dpy->dri_screen,
+                                                  fence);
+         dri2_dpy->fence->destroy_fence(dri2_dpy->dri_screen, fence);
+      }
+      if (fence_fd >= 0)
+         return fence_fd;
+   }
+
+   fence = dri2_dpy->fence->create_fence(dri_ctx);
+   if (fence) {
+      dri2_dpy->fence->client_wait_sync(dri_ctx, fence,
+                                        __DRI2_FENCE_FLAG_FLUSH_COMMANDS,
+                                        __DRI2_FENCE_TIMEOUT_INFINITE);
+      dri2_dpy->fence->destroy_fence(dri2_dpy->dri_screen, fence);
+   }
+
+   return -1;
+}
+
+/* Queues the image rendered to for eglAcquireSwapChainImageMESA and moves
+ * the rendering to an image which isn't queued or acquired, or else to the
+ * oldest frame not acquired yet, which is dropped.
+ */
+static EGLBoolean
+surfaceless_swap_chain_queue(_EGLDisplay *disp, _EGLSurface *surf)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
+   int cur = dri2_surf->cur_image;
+   int next = -1;
+
+   /* nothing was rendered since the last swap */
+   if (!dri2_surf->front)
+      return EGL_TRUE;
+
+   dri2_flush_drawable_for_swapbuffers(disp, surf);
+
+   dri2_surf->swap_chain[cur].fence_fd = surfaceless_frame_fence_fd(disp);
+   dri2_surf->swap_chain[cur].queued = true;
+   dri2_surf->swap_chain[cur].sbc = ++dri2_surf->swap_sbc;
+
+   for (int i = 0; i < surf->SwapChainLength; i++) {
+      if (i == cur || dri2_surf->swap_chain[i].acquired)
+         continue;
+
+      if (!dri2_surf->swap_chain[i].queued) {
+         next = i;
+         break;
+      }
+      if (next < 0 ||
+          dri2_surf->swap_chain[i].sbc < dri2_surf->swap_chain[next].sbc)
+         next = i;
+   }
+
+   /* every other image is acquired, the frame can't be queued */
+   if (next < 0) {
+      dri2_surf->swap_chain[cur].queued = false;
+      if (dri2_surf->swap_chain[cur].fence_fd >= 0)
+         close(dri2_surf->swap_chain[cur].fence_fd);
+      dri2_surf->swap_chain[cur].fence_fd = -1;
+      return _eglError(EGL_BAD_ACCESS, "eglSwapBuffers");
+   }
+
+   if (dri2_surf->swap_chain[next].queued) {
+      dri2_surf->swap_chain[next].queued = false;
+      if (dri2_surf->swap_chain[next].fence_fd >= 0)
+         close(dri2_surf->swap_chain[next].fence_fd);
+      dri2_surf->swap_chain[next].fence_fd = -1;
+   }
+
+   dri2_surf->cur_image = next;
+   dri2_surf->front = NULL;
+   dri2_dpy->flush->invalidate(dri2_surf->dri_drawable);
+
+   return EGL_TRUE;
+}
+
 static EGLBoolean
 surfaceless_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *surf)
 {
@@ -185,10 +312,78 @@ surfaceless_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *surf)
 
    /* From the EGL 1.5 spec:
     *    If surface is a [...] pbuffer surface, eglSwapBuffers has no effect.
+    *
+    * Except for the EGL_MESA_pbuffer_swap_chain ones.
     */
+   if (!surf || !surf->SwapChainLength)
+      return EGL_TRUE;
+
+   return surfaceless_swap_chain_queue(disp, surf);
+}
+
+/* Hands out the oldest queued frame, with the fence fd of its rendering */
+static EGLBoolean
+surfaceless_acquire_swap_chain_image(_EGLDriver *drv, _EGLDisplay *disp,
+                                     _EGLSurface *surf, _EGLImage **img,
+                                     EGLint *fence_fd)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
+   __DRIimage *dri_image;
+   int oldest = -1;
+
+   *img = NULL;
+   *fence_fd = -1;
+
+   for (int i = 0; i < surf->SwapChainLength; i++) {
+      if (dri2_surf->swap_chain[i].queued &&
+          (oldest < 0 ||
+           dri2_surf->swap_chain[i].sbc < dri2_surf->swap_chain[oldest].sbc))
+         oldest = i;
+   }
+
+   /* no frame to consume isn't an error */
+   if (oldest < 0)
+      return EGL_TRUE;
+
+   dri_image = dri2_dpy->image->dupImage(dri2_surf->swap_chain[oldest].dri_image,
+                                         NULL);
+   *img = dri2_create_image_from_dri(disp, dri_image);
+   if (!*img) {
+      if (dri_image)
+         dri2_dpy->image->destroyImage(dri_image);
+      return EGL_FALSE;
+   }
+
+   dri2_surf->swap_chain[oldest].acquired = *img;
+   dri2_surf->swap_chain[oldest].queued = false;
+   *fence_fd = dri2_surf->swap_chain[oldest].fence_fd;
+   dri2_surf->swap_chain[oldest].fence_fd = -1;
+
    return EGL_TRUE;
 }
 
+static EGLBoolean
+surfaceless_release_swap_chain_image(_EGLDriver *drv, _EGLDisplay *disp,
+                                     _EGLSurface *surf, _EGLImage *img)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
+
+   for (int i = 0; i < surf->SwapChainLength; i++) {
+      if (dri2_surf->swap_chain[i].acquired != img)
+         continue;
+
+      dri2_surf->swap_chain[i].acquired = NULL;
+      _eglUnlinkImage(img);
+      dri2_dpy->image->destroyImage(dri2_egl_image(img)->dri_image);
+      free(img);
+      return EGL_TRUE;
+   }
+
+   return _eglError(EGL_BAD_PARAMETER, "eglReleaseSwapChainImageMESA");
+}
+
 static EGLBoolean
 surfaceless_add_configs_for_visuals(_EGLDriver *drv, _EGLDisplay *dpy)
 {
@@ -245,6 +440,8 @@ static const struct dri2_egl_display_vtbl dri2_surfaceless_display_vtbl = {
    .create_wayland_buffer_from_image = dri2_fallback_create_wayland_buffer_from_image,
    .get_sync_values = dri2_fallback_get_sync_values,
    .get_dri_drawable = dri2_surface_get_dri_drawable,
+   .acquire_swap_chain_image = surfaceless_acquire_swap_chain_image,
+   .release_swap_chain_image = surfaceless_release_swap_chain_image,
 };
 
 static void
@@ -350,6 +547,11 @@ dri2_initialize_surfaceless(_EGLDriver *drv, _EGLDisplay *disp)
 
    dri2_setup_screen(disp);
 
+   /* the swap chain images are consumed as dma-bufs */
+   if (disp->Extensions.MESA_image_dma_buf_export && dri2_dpy->fence &&
+       dri2_dpy->flush)
+      disp->Extensions.MESA_pbuffer_swap_chain = EGL_TRUE;
+
    if (!surfaceless_add_configs_for_visuals(drv, disp)) {
       err = "DRI2: failed to add configs";
       goto cleanup;
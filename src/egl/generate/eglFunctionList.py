@@ -178,6 +178,10 @@ EGL_FUNCTIONS = (
     _eglFunc("eglExportDMABUFImageQueryMESA",        "display"),
     _eglFunc("eglExportDMABUFImageMESA",             "display"),
 
+    # EGL_MESA_pbuffer_swap_chain
+    _eglFunc("eglAcquireSwapChainImageMESA",         "display"),
+    _eglFunc("eglReleaseSwapChainImageMESA",         "display"),
+
     # EGL_NOK_swap_region
     _eglFunc("eglSwapBuffersRegionNOK",              "display"),
 
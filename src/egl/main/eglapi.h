@@ -195,6 +195,12 @@ struct _egl_api
                                        _EGLImage *img, EGLint *fds,
                                        EGLint *strides, EGLint *offsets);
 
+   EGLBoolean (*AcquireSwapChainImageMESA)(_EGLDriver *drv, _EGLDisplay *disp,
+                                           _EGLSurface *surf,
+                                           _EGLImage **img, EGLint *fence_fd);
+   EGLBoolean (*ReleaseSwapChainImageMESA)(_EGLDriver *drv, _EGLDisplay *disp,
+                                           _EGLSurface *surf, _EGLImage *img);
+
    int (*GLInteropQueryDeviceInfo)(_EGLDisplay *dpy, _EGLContext *ctx,
                                    struct mesa_glinterop_device_info *out);
    int (*GLInteropExportObject)(_EGLDisplay *dpy, _EGLContext *ctx,
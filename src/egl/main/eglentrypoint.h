@@ -2,6 +2,7 @@
  * EGL_KHR_get_all_proc_addresses or EGL 1.5
  */
 /* alphabetical order */
+EGL_ENTRYPOINT(eglAcquireSwapChainImageMESA)
 EGL_ENTRYPOINT(eglBindAPI)
 EGL_ENTRYPOINT(eglBindTexImage)
 EGL_ENTRYPOINT(eglBindWaylandDisplayWL)
@@ -61,6 +62,7 @@ EGL_ENTRYPOINT(eglQueryDmaBufModifiersEXT)
 EGL_ENTRYPOINT(eglQueryString)
 EGL_ENTRYPOINT(eglQuerySurface)
 EGL_ENTRYPOINT(eglQueryWaylandBufferWL)
+EGL_ENTRYPOINT(eglReleaseSwapChainImageMESA)
 EGL_ENTRYPOINT(eglReleaseTexImage)
 EGL_ENTRYPOINT(eglReleaseThread)
 EGL_ENTRYPOINT(eglSetBlobCacheFuncsANDROID)
@@ -100,4 +100,7 @@ _eglInitDriverFallbacks(_EGLDriver *drv)
 
    drv->API.ExportDMABUFImageQueryMESA = NULL;
    drv->API.ExportDMABUFImageMESA = NULL;
+
+   drv->API.AcquireSwapChainImageMESA = NULL;
+   drv->API.ReleaseSwapChainImageMESA = NULL;
 }
@@ -166,6 +166,18 @@ _eglParseSurfaceAttribList(_EGLSurface *surf, const EGLint *attrib_list)
          }
          surf->LargestPbuffer = !!val;
          break;
+      case EGL_SWAP_CHAIN_LENGTH_MESA:
+         if (!dpy->Extensions.MESA_pbuffer_swap_chain ||
+             type != EGL_PBUFFER_BIT) {
+            err = EGL_BAD_ATTRIBUTE;
+            break;
+         }
+         if (val != 0 && val < 2) {
+            err = EGL_BAD_PARAMETER;
+            break;
+         }
+         surf->SwapChainLength = val;
+         break;
       /* for eglBindTexImage */
       case EGL_TEXTURE_FORMAT:
          if (!(type & texture_type)) {
@@ -299,6 +311,7 @@ _eglInitSurface(_EGLSurface *surf, _EGLDisplay *dpy, EGLint type,
    surf->AspectRatio = EGL_UNKNOWN;
 
    surf->PostSubBufferSupportedNV = EGL_FALSE;
+   surf->SwapChainLength = 0;
    surf->SetDamageRegionCalled = EGL_FALSE;
    surf->BufferAgeRead = EGL_FALSE;
 
@@ -387,6 +400,12 @@ _eglQuerySurface(_EGLDriver *drv, _EGLDisplay *dpy, _EGLSurface *surface,
    case EGL_POST_SUB_BUFFER_SUPPORTED_NV:
       *value = surface->PostSubBufferSupportedNV;
       break;
+   case EGL_SWAP_CHAIN_LENGTH_MESA:
+      if (!dpy->Extensions.MESA_pbuffer_swap_chain)
+         return _eglError(EGL_BAD_ATTRIBUTE, "eglQuerySurface");
+
+      *value = surface->SwapChainLength;
+      break;
    case EGL_BUFFER_AGE_EXT:
       if (!dpy->Extensions.EXT_buffer_age)
          return _eglError(EGL_BAD_ATTRIBUTE, "eglQuerySurface");
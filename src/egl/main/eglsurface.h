@@ -98,6 +98,9 @@ struct _egl_surface
    EGLBoolean BoundToTexture;
 
    EGLBoolean PostSubBufferSupportedNV;
+
+   /* EGL_MESA_pbuffer_swap_chain, 0 for a regular pbuffer */
+   EGLint SwapChainLength;
 };
 
 
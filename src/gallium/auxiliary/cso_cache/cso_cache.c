@@ -48,14 +48,18 @@ struct cso_cache {
 static unsigned hash_key(const void *key, unsigned key_size)
 {
    unsigned *ikey = (unsigned *)key;
-   unsigned hash = 0, i;
+   unsigned hash, i;
 
    assert(key_size % 4 == 0);
 
-   /* I'm sure this can be improved on:
+   /* FNV-1a on words: unlike a plain xor, equal or swapped words of the
+    * state don't cancel out (e.g. the render targets of a blend state).
     */
-   for (i = 0; i < key_size/4; i++)
+   hash = 2166136261u;
+   for (i = 0; i < key_size/4; i++) {
       hash ^= ikey[i];
+      hash *= 16777619u;
+   }
 
    return hash;
 }
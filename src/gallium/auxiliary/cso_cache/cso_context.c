@@ -82,6 +82,13 @@ struct cso_context {
    struct sampler_info fragment_samplers_saved;
    struct sampler_info samplers[PIPE_SHADER_TYPES];
 
+   /* The samplers last bound in the driver, to skip binding the same ones
+    * again. Not valid after the cache deleted sampler states, as a new one
+    * may get the address of a deleted one.
+    */
+   void *bound_samplers[PIPE_SHADER_TYPES][PIPE_MAX_SAMPLERS];
+   boolean bound_samplers_valid[PIPE_SHADER_TYPES];
+
    /* Temporary number until cso_single_sampler_done is called.
     * It tracks the highest sampler seen in cso_single_sampler.
     */
@@ -126,6 +133,9 @@ struct cso_context {
    unsigned sample_mask, sample_mask_saved;
    unsigned min_samples, min_samples_saved;
    struct pipe_stencil_ref stencil_ref, stencil_ref_saved;
+
+   /** The CSO found or created by the last set of each type. */
+   void *last_cso[CSO_CACHE_MAX];
 };
 
 struct pipe_context *cso_get_pipe_context(struct cso_context *cso)
@@ -238,6 +248,8 @@ sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
    if (to_remove == 0)
       return;
 
+   ctx->last_cso[type] = NULL;
+
    if (type == CSO_SAMPLER) {
       int i, j;
 
@@ -251,8 +263,19 @@ sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
          for (j = 0; j < PIPE_MAX_SAMPLERS; j++) {
             struct cso_sampler *sampler = ctx->samplers[i].cso_samplers[j];
 
-            if (sampler && cso_hash_take(hash, sampler->hash_key))
+            if (!sampler)
+               continue;
+
+            /* other samplers may have the same key */
+            iter = cso_hash_find(hash, sampler->hash_key);
+            while (!cso_hash_iter_is_null(iter) &&
+                   cso_hash_iter_data(iter) != sampler)
+               iter = cso_hash_iter_next(iter);
+
+            if (!cso_hash_iter_is_null(iter)) {
+               cso_hash_erase(hash, iter);
                samplers_to_restore[to_restore++] = sampler;
+            }
          }
       }
    }
@@ -269,6 +292,10 @@ sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
       if (delete_cso(ctx, cso, type)) {
          iter = cso_hash_erase(hash, iter);
          --to_remove;
+
+         if (type == CSO_SAMPLER)
+            memset(ctx->bound_samplers_valid, 0,
+                   sizeof(ctx->bound_samplers_valid));
       } else
          iter = cso_hash_iter_next(iter);
    }
@@ -454,22 +481,45 @@ void cso_destroy_context( struct cso_context *ctx )
  * the data member of the cso to be the template itself.
  */
 
+/**
+ * Return the CSO of the last set of the given type if it was created from
+ * the same template, so that setting the same state again doesn't hash it
+ * nor search the cache. The state is the first member of all the CSOs.
+ */
+static inline void *
+cso_last_state(struct cso_context *ctx, enum cso_cache_type type,
+               const void *templ, unsigned key_size)
+{
+   void *cso = ctx->last_cso[type];
+
+   if (cso && !memcmp(cso, templ, key_size))
+      return cso;
+   return NULL;
+}
+
 enum pipe_error cso_set_blend(struct cso_context *ctx,
                               const struct pipe_blend_state *templ)
 {
    unsigned key_size, hash_key;
    struct cso_hash_iter iter;
+   struct cso_blend *cso;
    void *handle;
 
    key_size = templ->independent_blend_enable ?
       sizeof(struct pipe_blend_state) :
       (char *)&(templ->rt[1]) - (char *)templ;
+   cso = cso_last_state(ctx, CSO_BLEND, templ, key_size);
+   if (cso) {
+      handle = cso->data;
+      goto bind;
+   }
+
    hash_key = cso_construct_key((void*)templ, key_size);
    iter = cso_find_state_template(ctx->cache, hash_key, CSO_BLEND,
                                   (void*)templ, key_size);
 
    if (cso_hash_iter_is_null(iter)) {
-      struct cso_blend *cso = MALLOC(sizeof(struct cso_blend));
+      cso = MALLOC(sizeof(struct cso_blend));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
 
@@ -484,13 +534,15 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
-
-      handle = cso->data;
    }
    else {
-      handle = ((struct cso_blend *)cso_hash_iter_data(iter))->data;
+      cso = cso_hash_iter_data(iter);
    }
 
+   ctx->last_cso[CSO_BLEND] = cso;
+   handle = cso->data;
+
+bind:
    if (ctx->blend != handle) {
       ctx->blend = handle;
       ctx->pipe->bind_blend_state(ctx->pipe, handle);
@@ -522,16 +574,24 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
                             const struct pipe_depth_stencil_alpha_state *templ)
 {
    unsigned key_size = sizeof(struct pipe_depth_stencil_alpha_state);
-   unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key,
-                                                       CSO_DEPTH_STENCIL_ALPHA,
-                                                       (void*)templ, key_size);
+   unsigned hash_key;
+   struct cso_hash_iter iter;
+   struct cso_depth_stencil_alpha *cso;
    void *handle;
 
+   cso = cso_last_state(ctx, CSO_DEPTH_STENCIL_ALPHA, templ, key_size);
+   if (cso) {
+      handle = cso->data;
+      goto bind;
+   }
+
+   hash_key = cso_construct_key((void*)templ, key_size);
+   iter = cso_find_state_template(ctx->cache, hash_key,
+                                  CSO_DEPTH_STENCIL_ALPHA,
+                                  (void*)templ, key_size);
+
    if (cso_hash_iter_is_null(iter)) {
-      struct cso_depth_stencil_alpha *cso =
-         MALLOC(sizeof(struct cso_depth_stencil_alpha));
+      cso = MALLOC(sizeof(struct cso_depth_stencil_alpha));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
 
@@ -548,14 +608,15 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
-
-      handle = cso->data;
    }
    else {
-      handle = ((struct cso_depth_stencil_alpha *)
-                cso_hash_iter_data(iter))->data;
+      cso = cso_hash_iter_data(iter);
    }
 
+   ctx->last_cso[CSO_DEPTH_STENCIL_ALPHA] = cso;
+   handle = cso->data;
+
+bind:
    if (ctx->depth_stencil != handle) {
       ctx->depth_stencil = handle;
       ctx->pipe->bind_depth_stencil_alpha_state(ctx->pipe, handle);
@@ -587,11 +648,9 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
                                    const struct pipe_rasterizer_state *templ)
 {
    unsigned key_size = sizeof(struct pipe_rasterizer_state);
-   unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key,
-                                                       CSO_RASTERIZER,
-                                                       (void*)templ, key_size);
+   unsigned hash_key;
+   struct cso_hash_iter iter;
+   struct cso_rasterizer *cso;
    void *handle = NULL;
 
    /* We can't have both point_quad_rasterization (sprites) and point_smooth
@@ -599,8 +658,18 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
     */
    assert(!(templ->point_quad_rasterization && templ->point_smooth));
 
+   cso = cso_last_state(ctx, CSO_RASTERIZER, templ, key_size);
+   if (cso) {
+      handle = cso->data;
+      goto bind;
+   }
+
+   hash_key = cso_construct_key((void*)templ, key_size);
+   iter = cso_find_state_template(ctx->cache, hash_key, CSO_RASTERIZER,
+                                  (void*)templ, key_size);
+
    if (cso_hash_iter_is_null(iter)) {
-      struct cso_rasterizer *cso = MALLOC(sizeof(struct cso_rasterizer));
+      cso = MALLOC(sizeof(struct cso_rasterizer));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
 
@@ -615,13 +684,15 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
-
-      handle = cso->data;
    }
    else {
-      handle = ((struct cso_rasterizer *)cso_hash_iter_data(iter))->data;
+      cso = cso_hash_iter_data(iter);
    }
 
+   ctx->last_cso[CSO_RASTERIZER] = cso;
+   handle = cso->data;
+
+bind:
    if (ctx->rasterizer != handle) {
       ctx->rasterizer = handle;
       ctx->pipe->bind_rasterizer_state(ctx->pipe, handle);
@@ -1060,6 +1131,7 @@ cso_set_vertex_elements(struct cso_context *ctx,
    struct u_vbuf *vbuf = ctx->vbuf;
    unsigned key_size, hash_key;
    struct cso_hash_iter iter;
+   struct cso_velements *cso;
    void *handle;
    struct cso_velems_state velems_state;
 
@@ -1077,12 +1149,18 @@ cso_set_vertex_elements(struct cso_context *ctx,
    velems_state.count = count;
    memcpy(velems_state.velems, states,
           sizeof(struct pipe_vertex_element) * count);
+   cso = cso_last_state(ctx, CSO_VELEMENTS, &velems_state, key_size);
+   if (cso) {
+      handle = cso->data;
+      goto bind;
+   }
+
    hash_key = cso_construct_key((void*)&velems_state, key_size);
    iter = cso_find_state_template(ctx->cache, hash_key, CSO_VELEMENTS,
                                   (void*)&velems_state, key_size);
 
    if (cso_hash_iter_is_null(iter)) {
-      struct cso_velements *cso = MALLOC(sizeof(struct cso_velements));
+      cso = MALLOC(sizeof(struct cso_velements));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
 
@@ -1098,13 +1176,15 @@ cso_set_vertex_elements(struct cso_context *ctx,
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
-
-      handle = cso->data;
    }
    else {
-      handle = ((struct cso_velements *)cso_hash_iter_data(iter))->data;
+      cso = cso_hash_iter_data(iter);
    }
 
+   ctx->last_cso[CSO_VELEMENTS] = cso;
+   handle = cso->data;
+
+bind:
    if (ctx->velements != handle) {
       ctx->velements = handle;
       ctx->pipe->bind_vertex_elements_state(ctx->pipe, handle);
@@ -1215,12 +1295,18 @@ cso_single_sampler(struct cso_context *ctx, enum pipe_shader_type shader_stage,
 {
    if (templ) {
       unsigned key_size = sizeof(struct pipe_sampler_state);
-      unsigned hash_key = cso_construct_key((void*)templ, key_size);
+      unsigned hash_key;
       struct cso_sampler *cso;
-      struct cso_hash_iter iter =
-         cso_find_state_template(ctx->cache,
-                                 hash_key, CSO_SAMPLER,
-                                 (void *) templ, key_size);
+      struct cso_hash_iter iter;
+
+      cso = cso_last_state(ctx, CSO_SAMPLER, templ, key_size);
+      if (cso)
+         goto found;
+
+      hash_key = cso_construct_key((void*)templ, key_size);
+      iter = cso_find_state_template(ctx->cache,
+                                     hash_key, CSO_SAMPLER,
+                                     (void *) templ, key_size);
 
       if (cso_hash_iter_is_null(iter)) {
          cso = MALLOC(sizeof(struct cso_sampler));
@@ -1244,6 +1330,9 @@ cso_single_sampler(struct cso_context *ctx, enum pipe_shader_type shader_stage,
          cso = cso_hash_iter_data(iter);
       }
 
+      ctx->last_cso[CSO_SAMPLER] = cso;
+
+found:
       ctx->samplers[shader_stage].cso_samplers[idx] = cso;
       ctx->samplers[shader_stage].samplers[idx] = cso->data;
       ctx->max_sampler_seen = MAX2(ctx->max_sampler_seen, (int)idx);
@@ -1259,14 +1348,23 @@ cso_single_sampler_done(struct cso_context *ctx,
                         enum pipe_shader_type shader_stage)
 {
    struct sampler_info *info = &ctx->samplers[shader_stage];
+   void **bound = ctx->bound_samplers[shader_stage];
+   unsigned count = ctx->max_sampler_seen + 1;
 
    if (ctx->max_sampler_seen == -1)
       return;
 
-   ctx->pipe->bind_sampler_states(ctx->pipe, shader_stage, 0,
-                                  ctx->max_sampler_seen + 1,
-                                  info->samplers);
    ctx->max_sampler_seen = -1;
+
+   /* the slots after count stay bound either way */
+   if (ctx->bound_samplers_valid[shader_stage] &&
+       !memcmp(bound, info->samplers, count * sizeof(void *)))
+      return;
+
+   ctx->pipe->bind_sampler_states(ctx->pipe, shader_stage, 0, count,
+                                  info->samplers);
+   memcpy(bound, info->samplers, count * sizeof(void *));
+   ctx->bound_samplers_valid[shader_stage] = TRUE;
 }
 
 
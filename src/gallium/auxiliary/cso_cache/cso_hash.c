@@ -35,380 +35,293 @@
 
 #include "cso_hash.h"
 
-#ifndef MAX
-#define MAX(a, b) ((a > b) ? (a) : (b))
-#endif
-
-static const int MinNumBits = 4;
-
-static const unsigned char prime_deltas[] = {
-   0,  0,  1,  3,  1,  5,  3,  3,  1,  9,  7,  5,  3,  9, 25,  3,
-   1, 21,  3, 21,  7, 15,  9,  5,  3, 29, 15,  0,  0,  0,  0,  0
-};
-
-static int primeForNumBits(int numBits)
+/* The nodes are an array of 2^num_bits slots, an entry lives in the first
+ * free slot found by linear probing from the home slot of its key. Erased
+ * entries leave a deleted slot behind so that the probe sequences going
+ * through them aren't cut short, until the array gets rehashed.
+ */
+#define CSO_NODE_FREE    0
+#define CSO_NODE_USED    1
+#define CSO_NODE_DELETED 2
+
+static const unsigned MinNumBits = 4;
+
+static inline unsigned
+cso_hash_mask(const struct cso_hash *hash)
 {
-   return (1 << numBits) + prime_deltas[numBits];
+   return (1u << hash->num_bits) - 1;
 }
 
-/*
-    Returns the smallest integer n such that
-    primeForNumBits(n) >= hint.
-*/
-static int countBits(int hint)
+static inline unsigned
+cso_hash_home(const struct cso_hash *hash, unsigned key)
 {
-   int numBits = 0;
-   int bits = hint;
+   /* Fibonacci hashing, keys are often small or only differ in low bits */
+   return (key * 2654435769u) >> (32 - hash->num_bits);
+}
 
-   while (bits > 1) {
-      bits >>= 1;
-      numBits++;
+static boolean cso_hash_rehash(struct cso_hash *hash, unsigned num_bits)
+{
+   struct cso_node *old_nodes = hash->nodes;
+   unsigned old_num_nodes = old_nodes ? 1u << hash->num_bits : 0;
+   struct cso_node *nodes;
+   unsigned i;
+
+   nodes = CALLOC(1u << num_bits, sizeof(struct cso_node));
+   if (!nodes)
+      return FALSE;
+
+   hash->nodes = nodes;
+   hash->num_bits = num_bits;
+   hash->num_deleted = 0;
+
+   for (i = 0; i < old_num_nodes; ++i) {
+      struct cso_node *old = &old_nodes[i];
+      unsigned mask = cso_hash_mask(hash);
+      unsigned j;
+
+      if (old->state != CSO_NODE_USED)
+         continue;
+
+      j = cso_hash_home(hash, old->key);
+      while (nodes[j].state != CSO_NODE_FREE)
+         j = (j + 1) & mask;
+      nodes[j] = *old;
    }
 
-   if (numBits >= (int)sizeof(prime_deltas)) {
-      numBits = sizeof(prime_deltas) - 1;
-   } else if (primeForNumBits(numBits) < hint) {
-      ++numBits;
-   }
-   return numBits;
+   FREE(old_nodes);
+   return TRUE;
 }
 
-struct cso_hash_data {
-   struct cso_node *fakeNext;
-   struct cso_node **buckets;
-   int size;
-   int nodeSize;
-   short userNumBits;
-   short numBits;
-   int numBuckets;
-};
-
-static void *cso_data_allocate_node(struct cso_hash_data *hash)
+/* Keep at most 3/4 of the slots used or deleted, so that the probe
+ * sequences stay short and always end on a free slot.
+ */
+static boolean cso_hash_might_grow(struct cso_hash *hash)
 {
-   return MALLOC(hash->nodeSize);
-}
+   unsigned num_bits = hash->num_bits;
 
-static void cso_free_node(struct cso_node *node)
-{
-   FREE(node);
+   if (hash->nodes &&
+       (hash->size + hash->num_deleted + 1) * 4 <= (3u << num_bits))
+      return TRUE;
+
+   num_bits = MAX2(num_bits, MinNumBits);
+   while ((hash->size + 1) * 2 > (1u << num_bits))
+      ++num_bits;
+
+   return cso_hash_rehash(hash, num_bits);
 }
 
-static struct cso_node *
-cso_hash_create_node(struct cso_hash *hash,
-                      unsigned akey, void *avalue,
-                      struct cso_node **anextNode)
+static void cso_hash_has_shrunk(struct cso_hash *hash)
 {
-   struct cso_node *node = cso_data_allocate_node(hash->data.d);
+   unsigned num_bits = hash->num_bits;
 
-   if (!node)
-      return NULL;
+   if (num_bits <= MinNumBits || hash->size * 8 > (1u << num_bits))
+      return;
 
-   node->key = akey;
-   node->value = avalue;
+   while (num_bits > MinNumBits && hash->size * 4 <= (1u << (num_bits - 1)))
+      --num_bits;
 
-   node->next = (struct cso_node*)(*anextNode);
-   *anextNode = node;
-   ++hash->data.d->size;
-   return node;
+   /* on failure the old array stays valid */
+   cso_hash_rehash(hash, num_bits);
 }
 
-static void cso_data_rehash(struct cso_hash_data *hash, int hint)
+static struct cso_node *cso_hash_probe(struct cso_hash *hash,
+                                       unsigned i, unsigned key)
 {
-   if (hint < 0) {
-      hint = countBits(-hint);
-      if (hint < MinNumBits)
-         hint = MinNumBits;
-      hash->userNumBits = (short)hint;
-      while (primeForNumBits(hint) < (hash->size >> 1))
-         ++hint;
-   } else if (hint < MinNumBits) {
-      hint = MinNumBits;
-   }
+   unsigned mask = cso_hash_mask(hash);
 
-   if (hash->numBits != hint) {
-      struct cso_node *e = (struct cso_node *)(hash);
-      struct cso_node **oldBuckets = hash->buckets;
-      int oldNumBuckets = hash->numBuckets;
-      int  i = 0;
-
-      hash->numBits = (short)hint;
-      hash->numBuckets = primeForNumBits(hint);
-      hash->buckets = MALLOC(sizeof(struct cso_node*) * hash->numBuckets);
-      for (i = 0; i < hash->numBuckets; ++i)
-         hash->buckets[i] = e;
-
-      for (i = 0; i < oldNumBuckets; ++i) {
-         struct cso_node *firstNode = oldBuckets[i];
-         while (firstNode != e) {
-            unsigned h = firstNode->key;
-            struct cso_node *lastNode = firstNode;
-            struct cso_node *afterLastNode;
-            struct cso_node **beforeFirstNode;
-            
-            while (lastNode->next != e && lastNode->next->key == h)
-               lastNode = lastNode->next;
-
-            afterLastNode = lastNode->next;
-            beforeFirstNode = &hash->buckets[h % hash->numBuckets];
-            while (*beforeFirstNode != e)
-               beforeFirstNode = &(*beforeFirstNode)->next;
-            lastNode->next = *beforeFirstNode;
-            *beforeFirstNode = firstNode;
-            firstNode = afterLastNode;
-         }
-      }
-      FREE(oldBuckets);
+   for (;; i = (i + 1) & mask) {
+      struct cso_node *node = &hash->nodes[i];
+
+      if (node->state == CSO_NODE_FREE)
+         return NULL;
+      if (node->state == CSO_NODE_USED && node->key == key)
+         return node;
    }
 }
 
-static void cso_data_might_grow(struct cso_hash_data *hash)
+static struct cso_node *cso_hash_find_node(struct cso_hash *hash,
+                                           unsigned key)
 {
-   if (hash->size >= hash->numBuckets)
-      cso_data_rehash(hash, hash->numBits + 1);
+   if (!hash->nodes)
+      return NULL;
+   return cso_hash_probe(hash, cso_hash_home(hash, key), key);
 }
 
-static void cso_data_has_shrunk(struct cso_hash_data *hash)
+static struct cso_node *cso_hash_next_used(struct cso_hash *hash,
+                                           struct cso_node *node)
 {
-   if (hash->size <= (hash->numBuckets >> 3) &&
-       hash->numBits > hash->userNumBits) {
-      int max = MAX(hash->numBits-2, hash->userNumBits);
-      cso_data_rehash(hash,  max);
-   }
-}
+   struct cso_node *end = hash->nodes + (1u << hash->num_bits);
 
-static struct cso_node *cso_data_first_node(struct cso_hash_data *hash)
-{
-   struct cso_node *e = (struct cso_node *)(hash);
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-   while (n--) {
-      if (*bucket != e)
-         return *bucket;
-      ++bucket;
+   for (; node < end; ++node) {
+      if (node->state == CSO_NODE_USED)
+         return node;
    }
-   return e;
+   return NULL;
 }
 
-static struct cso_node **cso_hash_find_node(struct cso_hash *hash, unsigned akey)
+static void cso_hash_remove_node(struct cso_hash *hash, struct cso_node *node)
 {
-   struct cso_node **node;
+   unsigned mask = cso_hash_mask(hash);
+   unsigned i = node - hash->nodes;
+
+   node->value = NULL;
+   --hash->size;
+
+   /* A slot followed by a free one ends no other probe sequence, nor do
+    * the deleted slots just before it.
+    */
+   if (hash->nodes[(i + 1) & mask].state != CSO_NODE_FREE) {
+      node->state = CSO_NODE_DELETED;
+      ++hash->num_deleted;
+      return;
+   }
 
-   if (hash->data.d->numBuckets) {
-      node = (struct cso_node **)(&hash->data.d->buckets[akey % hash->data.d->numBuckets]);
-      assert(*node == hash->data.e || (*node)->next);
-      while (*node != hash->data.e && (*node)->key != akey)
-         node = &(*node)->next;
-   } else {
-      node = (struct cso_node **)((const struct cso_node * const *)(&hash->data.e));
+   node->state = CSO_NODE_FREE;
+   for (i = (i - 1) & mask; hash->nodes[i].state == CSO_NODE_DELETED;
+        i = (i - 1) & mask) {
+      hash->nodes[i].state = CSO_NODE_FREE;
+      --hash->num_deleted;
    }
-   return node;
 }
 
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash,
                                        unsigned key, void *data)
 {
-   cso_data_might_grow(hash->data.d);
-
-   {
-      struct cso_node **nextNode = cso_hash_find_node(hash, key);
-      struct cso_node *node = cso_hash_create_node(hash, key, data, nextNode);
-      if (!node) {
-         struct cso_hash_iter null_iter = {hash, 0};
-         return null_iter;
-      }
+   struct cso_hash_iter iter = {hash, NULL, FALSE};
+   unsigned mask;
+   unsigned i;
 
-      {
-         struct cso_hash_iter iter = {hash, node};
-         return iter;
-      }
-   }
+   if (!cso_hash_might_grow(hash))
+      return iter;
+
+   mask = cso_hash_mask(hash);
+   i = cso_hash_home(hash, key);
+   while (hash->nodes[i].state == CSO_NODE_USED)
+      i = (i + 1) & mask;
+
+   if (hash->nodes[i].state == CSO_NODE_DELETED)
+      --hash->num_deleted;
+
+   iter.node = &hash->nodes[i];
+   iter.node->key = key;
+   iter.node->state = CSO_NODE_USED;
+   iter.node->value = data;
+   ++hash->size;
+
+   return iter;
 }
 
 struct cso_hash * cso_hash_create(void)
 {
-   struct cso_hash *hash = MALLOC_STRUCT(cso_hash);
+   struct cso_hash *hash = CALLOC_STRUCT(cso_hash);
    if (!hash)
       return NULL;
 
-   hash->data.d = MALLOC_STRUCT(cso_hash_data);
-   if (!hash->data.d) {
-      FREE(hash);
-      return NULL;
-   }
-
-   hash->data.d->fakeNext = 0;
-   hash->data.d->buckets = 0;
-   hash->data.d->size = 0;
-   hash->data.d->nodeSize = sizeof(struct cso_node);
-   hash->data.d->userNumBits = (short)MinNumBits;
-   hash->data.d->numBits = 0;
-   hash->data.d->numBuckets = 0;
-
+   /* the nodes are allocated by the first insertion */
    return hash;
 }
 
 void cso_hash_delete(struct cso_hash *hash)
 {
-   struct cso_node *e_for_x = (struct cso_node *)(hash->data.d);
-   struct cso_node **bucket = (struct cso_node **)(hash->data.d->buckets);
-   int n = hash->data.d->numBuckets;
-   while (n--) {
-      struct cso_node *cur = *bucket++;
-      while (cur != e_for_x) {
-         struct cso_node *next = cur->next;
-         cso_free_node(cur);
-         cur = next;
-      }
-   }
-   FREE(hash->data.d->buckets);
-   FREE(hash->data.d);
+   FREE(hash->nodes);
    FREE(hash);
 }
 
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash,
                                      unsigned key)
 {
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_hash_iter iter = {hash, *nextNode};
+   struct cso_hash_iter iter = {hash, cso_hash_find_node(hash, key), TRUE};
    return iter;
 }
 
 unsigned cso_hash_iter_key(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->key;
 }
 
-static struct cso_node *cso_hash_data_next(struct cso_node *node)
+struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
 {
-   union {
-      struct cso_node *next;
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node **bucket;
-   int n;
-
-   a.next = node->next;
-   if (!a.next) {
-      debug_printf("iterating beyond the last element\n");
-      return 0;
-   }
-   if (a.next->next)
-      return a.next;
-
-   start = (node->key % a.d->numBuckets) + 1;
-   bucket = a.d->buckets + start;
-   n = a.d->numBuckets - start;
-   while (n--) {
-      if (*bucket != a.e)
-         return *bucket;
-      ++bucket;
-   }
-   return a.e;
-}
-
+   struct cso_hash *hash = iter.hash;
 
-static struct cso_node *cso_hash_data_prev(struct cso_node *node)
-{
-   union {
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node *sentinel;
-   struct cso_node **bucket;
-
-   a.e = node;
-   while (a.e->next)
-      a.e = a.e->next;
-
-   if (node == a.e)
-      start = a.d->numBuckets - 1;
-   else
-      start = node->key % a.d->numBuckets;
-
-   sentinel = node;
-   bucket = a.d->buckets + start;
-   while (start >= 0) {
-      if (*bucket != sentinel) {
-         struct cso_node *prev = *bucket;
-         while (prev->next != sentinel)
-            prev = prev->next;
-         return prev;
-      }
+   if (!iter.node)
+      return iter;
 
-      sentinel = a.e;
-      --bucket;
-      --start;
+   if (iter.same_key) {
+      unsigned i = (iter.node - hash->nodes + 1) & cso_hash_mask(hash);
+      iter.node = cso_hash_probe(hash, i, iter.node->key);
+   } else {
+      iter.node = cso_hash_next_used(hash, iter.node + 1);
    }
-   debug_printf("iterating backward beyond first element\n");
-   return a.e;
-}
-
-struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
-{
-   struct cso_hash_iter next = {iter.hash, cso_hash_data_next(iter.node)};
-   return next;
+   return iter;
 }
 
 void * cso_hash_take(struct cso_hash *hash,
                       unsigned akey)
 {
-   struct cso_node **node = cso_hash_find_node(hash, akey);
-   if (*node != hash->data.e) {
-      void *t = (*node)->value;
-      struct cso_node *next = (*node)->next;
-      cso_free_node(*node);
-      *node = next;
-      --hash->data.d->size;
-      cso_data_has_shrunk(hash->data.d);
-      return t;
-   }
-   return 0;
+   struct cso_node *node = cso_hash_find_node(hash, akey);
+   void *t;
+
+   if (!node)
+      return NULL;
+
+   t = node->value;
+   cso_hash_remove_node(hash, node);
+   cso_hash_has_shrunk(hash);
+   return t;
 }
 
 struct cso_hash_iter cso_hash_iter_prev(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter prev = {iter.hash,
-                                 cso_hash_data_prev(iter.node)};
-   return prev;
+   struct cso_hash *hash = iter.hash;
+   struct cso_node *node = iter.node;
+
+   /* walks the whole array backwards, from the end on a null iterator */
+   if (!node)
+      node = hash->nodes ? hash->nodes + (1u << hash->num_bits) : NULL;
+
+   iter.same_key = FALSE;
+   iter.node = NULL;
+   while (node && node != hash->nodes) {
+      --node;
+      if (node->state == CSO_NODE_USED) {
+         iter.node = node;
+         break;
+      }
+   }
+   return iter;
 }
 
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash)
 {
-   struct cso_hash_iter iter = {hash, cso_data_first_node(hash->data.d)};
+   struct cso_hash_iter iter = {hash, NULL, FALSE};
+   if (hash->nodes)
+      iter.node = cso_hash_next_used(hash, hash->nodes);
    return iter;
 }
 
 int cso_hash_size(struct cso_hash *hash)
 {
-   return hash->data.d->size;
+   return hash->size;
 }
 
 struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter)
 {
-   struct cso_hash_iter ret = iter;
-   struct cso_node *node = iter.node;
-   struct cso_node **node_ptr;
+   struct cso_hash_iter ret;
 
-   if (node == hash->data.e)
+   if (!iter.node)
       return iter;
 
-   ret = cso_hash_iter_next(ret);
-   node_ptr = (struct cso_node**)(&hash->data.d->buckets[node->key % hash->data.d->numBuckets]);
-   while (*node_ptr != node)
-      node_ptr = &(*node_ptr)->next;
-   *node_ptr = node->next;
-   cso_free_node(node);
-   --hash->data.d->size;
+   /* removing a node never moves the others, so the walk can go on from
+    * the next one; the array isn't shrunk while an iteration may be going on
+    */
+   ret = cso_hash_iter_next(iter);
+   cso_hash_remove_node(hash, iter.node);
    return ret;
 }
 
 boolean cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **node = cso_hash_find_node(hash, key);
-   return (*node != hash->data.e);
+   return cso_hash_find_node(hash, key) != NULL;
 }
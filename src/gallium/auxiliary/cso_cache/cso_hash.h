@@ -30,13 +30,14 @@
  * Hash table implementation.
  * 
  * This file provides a hash implementation that is capable of dealing
- * with collisions. It stores colliding entries in linked list. All
- * functions operating on the hash return an iterator. The iterator
- * itself points to the collision list. If there wasn't any collision
- * the list will have just one entry, otherwise client code should
- * iterate over the entries to find the exact entry among ones that
- * had the same key (e.g. memcmp could be used on the data to check
- * that)
+ * with collisions. The entries are stored inline in one open-addressed
+ * array, colliding entries follow each other in the probe sequence of
+ * their key. All functions operating on the hash return an iterator.
+ * The iterator returned by cso_hash_find only walks the entries that
+ * have the requested key: if there wasn't any collision it will see just
+ * one entry, otherwise client code should iterate over the entries to
+ * find the exact entry among ones that had the same key (e.g. memcmp
+ * could be used on the data to check that)
  * 
  * @author Zack Rusin <zackr@vmware.com>
  */
@@ -52,21 +53,23 @@ extern "C" {
 
 
 struct cso_node {
-   struct cso_node *next;
    unsigned key;
+   unsigned state;
    void *value;
 };
 
 struct cso_hash {
-   union {
-      struct cso_hash_data *d;
-      struct cso_node      *e;
-   } data;
+   struct cso_node *nodes;
+   unsigned num_bits;
+   unsigned size;
+   unsigned num_deleted;
 };
 
 struct cso_hash_iter {
    struct cso_hash *hash;
    struct cso_node  *node;
+   /* only the entries with the key of node, as returned by cso_hash_find */
+   boolean same_key;
 };
 
 
@@ -79,8 +82,8 @@ int              cso_hash_size(struct cso_hash *hash);
 
 /**
  * Adds a data with the given key to the hash. If entry with the given
- * key is already in the hash, this current entry is instered before it
- * in the collision list.
+ * key is already in the hash, this current entry is added to the
+ * collision list.
  * Function returns iterator pointing to the inserted item in the hash.
  */
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash, unsigned key,
@@ -102,6 +105,8 @@ struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash);
 
 /**
  * Return an iterator pointing to the first entry in the collision list.
+ * Stepping it with cso_hash_iter_next only visits the other entries with
+ * the same key.
  */
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash, unsigned key);
 
@@ -131,15 +136,13 @@ void *cso_hash_find_data_from_template( struct cso_hash *hash,
 static inline int
 cso_hash_iter_is_null(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.node == iter.hash->data.e)
-      return 1;
-   return 0;
+   return !iter.node;
 }
 
 static inline void *
 cso_hash_iter_data(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->value;
 }
@@ -25,9 +25,11 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -40,6 +42,30 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/* Most threads shading the vertices of a run, counting the drawing one. */
+#define LLVM_VS_MAX_THREADS 8
+
+/* Runs are only split in slices of at least this many vertices. */
+#define LLVM_VS_MIN_SLICE 256
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_vs_threads, "DRAW_VS_THREADS", 0)
+
+struct llvm_middle_end;
+
+/** A slice of the vertices of a run, shaded by a worker thread */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct util_queue_fence fence;
+
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   const unsigned *elts;
+
+   boolean clipped;
+};
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -57,6 +83,12 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* threads shading the vertices, 1 when not threaded */
+   unsigned num_vs_threads;
+   boolean vs_queue_initialized;
+   struct util_queue vs_queue;
+   struct llvm_vs_job vs_jobs[LLVM_VS_MAX_THREADS];
 };
 
 
@@ -347,6 +379,118 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Run the fetch and vertex shader of the variant on count vertices into
+ * verts. Returns whether any vertex is clipped.
+ */
+static boolean
+llvm_run_vs(struct llvm_middle_end *fpme, struct vertex_header *verts,
+            unsigned count, unsigned start_or_maxelt, unsigned vid_base,
+            const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts);
+}
+
+static void
+llvm_vs_job_execute(void *data, int thread_index)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *)data;
+
+   job->clipped = llvm_run_vs(job->fpme, job->verts, job->count,
+                              job->start_or_maxelt, job->vid_base,
+                              job->elts);
+}
+
+static boolean
+llvm_init_vs_queue(struct llvm_middle_end *fpme)
+{
+   unsigned i;
+
+   if (fpme->vs_queue_initialized)
+      return TRUE;
+
+   if (!util_queue_init(&fpme->vs_queue, "drawvs", LLVM_VS_MAX_THREADS,
+                        fpme->num_vs_threads - 1, 0)) {
+      /* don't try again */
+      fpme->num_vs_threads = 1;
+      return FALSE;
+   }
+
+   for (i = 0; i < LLVM_VS_MAX_THREADS; i++) {
+      fpme->vs_jobs[i].fpme = fpme;
+      util_queue_fence_init(&fpme->vs_jobs[i].fence);
+   }
+   fpme->vs_queue_initialized = TRUE;
+   return TRUE;
+}
+
+/**
+ * Same as llvm_run_vs, large runs are split in slices shaded in parallel by
+ * the worker threads and the calling one. The vertices stay in order, the
+ * rest of the pipeline runs in this thread once all the slices are done.
+ */
+static boolean
+llvm_run_vs_threaded(struct llvm_middle_end *fpme, struct vertex_header *verts,
+                     unsigned count, unsigned start_or_maxelt,
+                     unsigned vid_base, const unsigned *elts)
+{
+   struct util_queue_job jobs[LLVM_VS_MAX_THREADS];
+   unsigned num_slices = MIN2(fpme->num_vs_threads,
+                              count / LLVM_VS_MIN_SLICE);
+   unsigned slice, first, num_jobs, i;
+   boolean clipped;
+
+   if (num_slices <= 1 || !llvm_init_vs_queue(fpme))
+      return llvm_run_vs(fpme, verts, count, start_or_maxelt, vid_base, elts);
+
+   /* The shader writes whole vectors of vertices, the slices mustn't
+    * share one.
+    */
+   slice = align(DIV_ROUND_UP(count, num_slices),
+                 lp_native_vector_width / 32);
+
+   num_jobs = 0;
+   for (first = slice; first < count; first += slice) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[num_jobs];
+
+      job->verts = (struct vertex_header *)
+         ((char *)verts + first * fpme->vertex_size);
+      job->count = MIN2(slice, count - first);
+      job->start_or_maxelt = elts ? start_or_maxelt : start_or_maxelt + first;
+      job->vid_base = vid_base;
+      job->elts = elts ? elts + first : NULL;
+
+      jobs[num_jobs].job = job;
+      jobs[num_jobs].fence = &job->fence;
+      jobs[num_jobs].execute = llvm_vs_job_execute;
+      jobs[num_jobs].cleanup = NULL;
+      num_jobs++;
+   }
+
+   util_queue_add_jobs(&fpme->vs_queue, jobs, num_jobs, true);
+
+   clipped = llvm_run_vs(fpme, verts, slice, start_or_maxelt, vid_base, elts);
+
+   for (i = 0; i < num_jobs; i++) {
+      util_queue_fence_wait(&fpme->vs_jobs[i].fence);
+      clipped |= fpme->vs_jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -397,17 +541,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts);
+   clipped = llvm_run_vs_threaded(fpme, llvm_vert_info.verts,
+                                  fetch_info->count, start_or_maxelt,
+                                  vid_base, elts);
 
    /* Finished with fetch and vs:
     */
@@ -598,6 +734,14 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   if (fpme->vs_queue_initialized) {
+      unsigned i;
+
+      util_queue_destroy(&fpme->vs_queue);
+      for (i = 0; i < LLVM_VS_MAX_THREADS; i++)
+         util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
+   }
+
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
 
@@ -636,6 +780,16 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->draw = draw;
 
+   /* DRAW_VS_THREADS=1 shades all the vertices in the drawing thread, the
+    * worker threads are only started by the first large run.
+    */
+   fpme->num_vs_threads = debug_get_option_draw_vs_threads();
+   if (!fpme->num_vs_threads) {
+      util_cpu_detect();
+      fpme->num_vs_threads = util_cpu_caps.nr_cpus;
+   }
+   fpme->num_vs_threads = CLAMP(fpme->num_vs_threads, 1, LLVM_VS_MAX_THREADS);
+
    fpme->fetch = draw_pt_fetch_create( draw );
    if (!fpme->fetch)
       goto fail;
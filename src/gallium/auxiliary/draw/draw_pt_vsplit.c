@@ -23,6 +23,9 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <inttypes.h>
+
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
@@ -31,11 +34,25 @@
 #include "draw/draw_pt.h"
 
 #define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+
+/* Two ways per set, enough entries for the fetches of a segment */
+#define MAP_SETS     (SEGMENT_SIZE / 2)
 
 /* The largest possible index within an index buffer */
 #define MAX_ELT_IDX 0xffffffff
 
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vsplit_stats, "DRAW_VSPLIT_STATS", FALSE)
+
+struct vsplit_cache_set {
+   /* the set is empty unless this is the stamp of the cache */
+   unsigned stamp;
+   unsigned num_ways;
+
+   /* map a fetch element to a draw element, the most recently used first */
+   unsigned fetches[2];
+   ushort draws[2];
+};
+
 struct vsplit_frontend {
    struct draw_pt_front_end base;
    struct draw_context *draw;
@@ -53,22 +70,29 @@ struct vsplit_frontend {
    ushort identity_draw_elts[SEGMENT_SIZE];
 
    struct {
-      /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      struct vsplit_cache_set sets[MAP_SETS];
+      unsigned stamp;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
    } cache;
+
+   /* the draw elements of the cached segments, and the fetches among them */
+   struct {
+      uint64_t draws;
+      uint64_t fetches;
+   } stats;
 };
 
 
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   /* empty all the sets at once */
+   if (++vsplit->cache.stamp == 0) {
+      memset(vsplit->cache.sets, 0, sizeof(vsplit->cache.sets));
+      vsplit->cache.stamp = 1;
+   }
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -76,6 +100,9 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   vsplit->stats.draws += vsplit->cache.num_draw_elts;
+   vsplit->stats.fetches += vsplit->cache.num_fetch_elts;
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
@@ -87,23 +114,36 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch)
 {
-   unsigned hash;
+   struct vsplit_cache_set *set = &vsplit->cache.sets[fetch % MAP_SETS];
+   ushort draw;
 
-   hash = fetch % MAP_SIZE;
-
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch) {
-      /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+   if (set->stamp != vsplit->cache.stamp) {
+      set->stamp = vsplit->cache.stamp;
+      set->num_ways = 0;
+   }
 
-      /* add fetch */
-      assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
-      vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+   if (set->num_ways > 0 && set->fetches[0] == fetch) {
+      draw = set->draws[0];
+   }
+   else {
+      if (set->num_ways > 1 && set->fetches[1] == fetch) {
+         draw = set->draws[1];
+      }
+      else {
+         /* add fetch, replacing the least recently used way */
+         assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
+         draw = vsplit->cache.num_fetch_elts;
+         vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+         set->num_ways = MIN2(set->num_ways + 1, 2);
+      }
+
+      set->fetches[1] = set->fetches[0];
+      set->draws[1] = set->draws[0];
+      set->fetches[0] = fetch;
+      set->draws[0] = draw;
    }
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = draw;
 }
 
 /**
@@ -125,12 +165,6 @@ vsplit_add_cache_ubyte(struct vsplit_frontend *vsplit, const ubyte *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -142,12 +176,6 @@ vsplit_add_cache_ushort(struct vsplit_frontend *vsplit, const ushort *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -167,13 +195,6 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
     */
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* Take care for DRAW_MAX_FETCH_IDX (since cache is initialized to -1). */
-   if (elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      /* force update - any value will do except DRAW_MAX_FETCH_IDX */
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -245,6 +266,17 @@ static void vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 
 static void vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   if (debug_get_option_draw_vsplit_stats() && vsplit->stats.draws) {
+      debug_printf("vsplit: %"PRIu64" of %"PRIu64" cached vertices reused "
+                   "(%.1f%%)\n",
+                   vsplit->stats.draws - vsplit->stats.fetches,
+                   vsplit->stats.draws,
+                   100.0 * (vsplit->stats.draws - vsplit->stats.fetches) /
+                   vsplit->stats.draws);
+   }
+
    FREE(frontend);
 }
 
@@ -22,6 +22,7 @@
  */
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
 #include "pipe/p_defines.h"
 #include "pipe/p_state.h"
 #include "pipe/p_context.h"
@@ -30,9 +31,12 @@
 #include "util/u_inlines.h"
 #include "util/u_format.h"
 #include "util/u_upload_mgr.h"
+#include "util/os_time.h"
 #include "noop_public.h"
+#include "noop_stats.h"
 
 DEBUG_GET_ONCE_BOOL_OPTION(noop, "GALLIUM_NOOP", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(noop_stats, "GALLIUM_NOOP_STATS", FALSE)
 
 void noop_init_state_functions(struct pipe_context *ctx);
 
@@ -51,21 +55,25 @@ static struct pipe_query *noop_create_query(struct pipe_context *ctx, unsigned q
 {
    struct noop_query *query = CALLOC_STRUCT(noop_query);
 
+   noop_count(ctx, NOOP_CALL_QUERY);
    return (struct pipe_query *)query;
 }
 
 static void noop_destroy_query(struct pipe_context *ctx, struct pipe_query *query)
 {
+   noop_count(ctx, NOOP_CALL_QUERY);
    FREE(query);
 }
 
 static boolean noop_begin_query(struct pipe_context *ctx, struct pipe_query *query)
 {
+   noop_count(ctx, NOOP_CALL_QUERY);
    return true;
 }
 
 static bool noop_end_query(struct pipe_context *ctx, struct pipe_query *query)
 {
+   noop_count(ctx, NOOP_CALL_QUERY);
    return true;
 }
 
@@ -76,6 +84,7 @@ static boolean noop_get_query_result(struct pipe_context *ctx,
 {
    uint64_t *result = (uint64_t*)vresult;
 
+   noop_count(ctx, NOOP_CALL_QUERY);
    *result = 0;
    return TRUE;
 }
@@ -83,6 +92,7 @@ static boolean noop_get_query_result(struct pipe_context *ctx,
 static void
 noop_set_active_query_state(struct pipe_context *pipe, boolean enable)
 {
+   noop_count(pipe, NOOP_CALL_QUERY);
 }
 
 
@@ -179,6 +189,8 @@ static void *noop_transfer_map(struct pipe_context *pipe,
    struct pipe_transfer *transfer;
    struct noop_resource *nresource = (struct noop_resource *)resource;
 
+   noop_count(pipe, NOOP_CALL_TRANSFER);
+
    transfer = CALLOC_STRUCT(pipe_transfer);
    if (!transfer)
       return NULL;
@@ -211,6 +223,7 @@ static void noop_buffer_subdata(struct pipe_context *pipe,
                                 unsigned usage, unsigned offset,
                                 unsigned size, const void *data)
 {
+   noop_count(pipe, NOOP_CALL_UPLOAD);
 }
 
 static void noop_texture_subdata(struct pipe_context *pipe,
@@ -222,6 +235,7 @@ static void noop_texture_subdata(struct pipe_context *pipe,
                                  unsigned stride,
                                  unsigned layer_stride)
 {
+   noop_count(pipe, NOOP_CALL_UPLOAD);
 }
 
 
@@ -231,6 +245,7 @@ static void noop_texture_subdata(struct pipe_context *pipe,
 static void noop_clear(struct pipe_context *ctx, unsigned buffers,
                        const union pipe_color_union *color, double depth, unsigned stencil)
 {
+   noop_count(ctx, NOOP_CALL_CLEAR);
 }
 
 static void noop_clear_render_target(struct pipe_context *ctx,
@@ -240,6 +255,7 @@ static void noop_clear_render_target(struct pipe_context *ctx,
                                      unsigned width, unsigned height,
                                      bool render_condition_enabled)
 {
+   noop_count(ctx, NOOP_CALL_CLEAR);
 }
 
 static void noop_clear_depth_stencil(struct pipe_context *ctx,
@@ -251,6 +267,7 @@ static void noop_clear_depth_stencil(struct pipe_context *ctx,
                                      unsigned width, unsigned height,
                                      bool render_condition_enabled)
 {
+   noop_count(ctx, NOOP_CALL_CLEAR);
 }
 
 static void noop_resource_copy_region(struct pipe_context *ctx,
@@ -261,12 +278,14 @@ static void noop_resource_copy_region(struct pipe_context *ctx,
                                       unsigned src_level,
                                       const struct pipe_box *src_box)
 {
+   noop_count(ctx, NOOP_CALL_BLIT);
 }
 
 
 static void noop_blit(struct pipe_context *ctx,
                       const struct pipe_blit_info *info)
 {
+   noop_count(ctx, NOOP_CALL_BLIT);
 }
 
 
@@ -274,6 +293,74 @@ static void
 noop_flush_resource(struct pipe_context *ctx,
                     struct pipe_resource *resource)
 {
+   noop_count(ctx, NOOP_CALL_FLUSH);
+}
+
+
+/*
+ * stats
+ */
+static const char *noop_call_names[NOOP_CALL_COUNT] = {
+   [NOOP_CALL_DRAW] = "draw",
+   [NOOP_CALL_COMPUTE] = "compute",
+   [NOOP_CALL_CLEAR] = "clear",
+   [NOOP_CALL_BLIT] = "blit/copy",
+   [NOOP_CALL_FLUSH] = "flush",
+   [NOOP_CALL_TRANSFER] = "transfer map",
+   [NOOP_CALL_UPLOAD] = "subdata",
+   [NOOP_CALL_QUERY] = "query",
+   [NOOP_CALL_CREATE] = "create",
+   [NOOP_CALL_BIND] = "bind",
+   [NOOP_CALL_SET] = "set state",
+   [NOOP_CALL_DELETE] = "delete",
+};
+
+void noop_stats_count(struct noop_stats *stats, enum noop_call call)
+{
+   int64_t now = os_time_get_nano();
+
+   if (!stats->first_call)
+      stats->first_call = now;
+   if (!stats->frame_start)
+      stats->frame_start = now;
+   stats->last_call = now;
+   stats->calls[call]++;
+}
+
+static void noop_stats_end_frame(struct noop_stats *stats)
+{
+   if (!stats->frame_start)
+      return;
+
+   stats->frame_time += stats->last_call - stats->frame_start;
+   stats->frame_start = 0;
+   stats->frames++;
+}
+
+/* printed in release builds too, unlike debug_printf */
+static void noop_stats_print(struct noop_stats *stats)
+{
+   unsigned frames = MAX2(stats->frames, 1);
+   uint64_t total = 0;
+
+   fprintf(stderr, "noop: %u frames, %.3f ms per frame from the first pipe "
+           "call to the end of frame flush, %.3f ms from the first to the "
+           "last call\n", stats->frames,
+           stats->frame_time / (frames * 1000000.0),
+           (stats->last_call - stats->first_call) / 1000000.0);
+
+   for (unsigned i = 0; i < NOOP_CALL_COUNT; i++) {
+      total += stats->calls[i];
+      if (!stats->calls[i])
+         continue;
+
+      fprintf(stderr, "noop:   %-12s %12"PRIu64" %10.1f per frame\n",
+              noop_call_names[i], stats->calls[i],
+              stats->calls[i] / (double)frames);
+   }
+
+   fprintf(stderr, "noop:   %-12s %12"PRIu64" %10.1f per frame\n",
+           "total", total, total / (double)frames);
 }
 
 
@@ -284,12 +371,25 @@ static void noop_flush(struct pipe_context *ctx,
                        struct pipe_fence_handle **fence,
                        unsigned flags)
 {
+   struct noop_stats *stats = ((struct noop_context *)ctx)->stats;
+
+   noop_count(ctx, NOOP_CALL_FLUSH);
+   if (stats && flags & PIPE_FLUSH_END_OF_FRAME)
+      noop_stats_end_frame(stats);
+
    if (fence)
       *fence = NULL;
 }
 
 static void noop_destroy_context(struct pipe_context *ctx)
 {
+   struct noop_stats *stats = ((struct noop_context *)ctx)->stats;
+
+   if (stats) {
+      noop_stats_print(stats);
+      FREE(stats);
+   }
+
    if (ctx->stream_uploader)
       u_upload_destroy(ctx->stream_uploader);
 
@@ -304,23 +404,35 @@ static boolean noop_generate_mipmap(struct pipe_context *ctx,
                                     unsigned first_layer,
                                     unsigned last_layer)
 {
+   noop_count(ctx, NOOP_CALL_BLIT);
    return true;
 }
 
 static struct pipe_context *noop_create_context(struct pipe_screen *screen,
                                                 void *priv, unsigned flags)
 {
-   struct pipe_context *ctx = CALLOC_STRUCT(pipe_context);
+   struct noop_context *nctx = CALLOC_STRUCT(noop_context);
+   struct pipe_context *ctx;
 
-   if (!ctx)
+   if (!nctx)
       return NULL;
 
+   ctx = &nctx->base;
    ctx->screen = screen;
    ctx->priv = priv;
 
+   if (debug_get_option_noop_stats()) {
+      nctx->stats = CALLOC_STRUCT(noop_stats);
+      if (!nctx->stats) {
+         FREE(nctx);
+         return NULL;
+      }
+   }
+
    ctx->stream_uploader = u_upload_create_default(ctx);
    if (!ctx->stream_uploader) {
-      FREE(ctx);
+      FREE(nctx->stats);
+      FREE(nctx);
       return NULL;
    }
    ctx->const_uploader = ctx->stream_uploader;
@@ -463,7 +575,7 @@ struct pipe_screen *noop_screen_create(struct pipe_screen *oscreen)
    struct noop_pipe_screen *noop_screen;
    struct pipe_screen *screen;
 
-   if (!debug_get_option_noop()) {
+   if (!debug_get_option_noop() && !debug_get_option_noop_stats()) {
       return oscreen;
    }
 
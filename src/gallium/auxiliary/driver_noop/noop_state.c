@@ -29,42 +29,50 @@
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
 #include "util/u_transfer.h"
+#include "noop_stats.h"
 
 static void noop_draw_vbo(struct pipe_context *ctx, const struct pipe_draw_info *info)
 {
+   noop_count(ctx, NOOP_CALL_DRAW);
 }
 
 static void noop_launch_grid(struct pipe_context *ctx,
                              const struct pipe_grid_info *info)
 {
+   noop_count(ctx, NOOP_CALL_COMPUTE);
 }
 
 static void noop_set_blend_color(struct pipe_context *ctx,
                                  const struct pipe_blend_color *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void *noop_create_blend_state(struct pipe_context *ctx,
                                      const struct pipe_blend_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
 static void *noop_create_dsa_state(struct pipe_context *ctx,
                                    const struct pipe_depth_stencil_alpha_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
 static void *noop_create_rs_state(struct pipe_context *ctx,
                                   const struct pipe_rasterizer_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
 static void *noop_create_sampler_state(struct pipe_context *ctx,
                                        const struct pipe_sampler_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
@@ -72,6 +80,7 @@ static struct pipe_sampler_view *noop_create_sampler_view(struct pipe_context *c
                                                           struct pipe_resource *texture,
                                                           const struct pipe_sampler_view *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    struct pipe_sampler_view *sampler_view = CALLOC_STRUCT(pipe_sampler_view);
 
    if (!sampler_view)
@@ -90,6 +99,7 @@ static struct pipe_surface *noop_create_surface(struct pipe_context *ctx,
                                                 struct pipe_resource *texture,
                                                 const struct pipe_surface *surf_tmpl)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    struct pipe_surface *surface = CALLOC_STRUCT(pipe_surface);
 
    if (!surface)
@@ -113,6 +123,7 @@ static void noop_set_sampler_views(struct pipe_context *ctx,
                                    unsigned start, unsigned count,
                                    struct pipe_sampler_view **views)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_bind_sampler_states(struct pipe_context *ctx,
@@ -120,20 +131,24 @@ static void noop_bind_sampler_states(struct pipe_context *ctx,
                                      unsigned start, unsigned count,
                                      void **states)
 {
+   noop_count(ctx, NOOP_CALL_BIND);
 }
 
 static void noop_set_clip_state(struct pipe_context *ctx,
                                 const struct pipe_clip_state *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_polygon_stipple(struct pipe_context *ctx,
                                      const struct pipe_poly_stipple *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_sample_mask(struct pipe_context *pipe, unsigned sample_mask)
 {
+   noop_count(pipe, NOOP_CALL_SET);
 }
 
 static void noop_set_scissor_states(struct pipe_context *ctx,
@@ -141,11 +156,13 @@ static void noop_set_scissor_states(struct pipe_context *ctx,
                                     unsigned num_scissors,
                                     const struct pipe_scissor_state *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_stencil_ref(struct pipe_context *ctx,
                                  const struct pipe_stencil_ref *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_viewport_states(struct pipe_context *ctx,
@@ -153,23 +170,27 @@ static void noop_set_viewport_states(struct pipe_context *ctx,
                                      unsigned num_viewports,
                                      const struct pipe_viewport_state *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_framebuffer_state(struct pipe_context *ctx,
                                        const struct pipe_framebuffer_state *state)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void noop_set_constant_buffer(struct pipe_context *ctx,
                                      enum pipe_shader_type shader, uint index,
                                      const struct pipe_constant_buffer *cb)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 
 static void noop_sampler_view_destroy(struct pipe_context *ctx,
                                       struct pipe_sampler_view *state)
 {
+   noop_count(ctx, NOOP_CALL_DELETE);
    pipe_resource_reference(&state->texture, NULL);
    FREE(state);
 }
@@ -178,16 +199,19 @@ static void noop_sampler_view_destroy(struct pipe_context *ctx,
 static void noop_surface_destroy(struct pipe_context *ctx,
                                  struct pipe_surface *surface)
 {
+   noop_count(ctx, NOOP_CALL_DELETE);
    pipe_resource_reference(&surface->texture, NULL);
    FREE(surface);
 }
 
 static void noop_bind_state(struct pipe_context *ctx, void *state)
 {
+   noop_count(ctx, NOOP_CALL_BIND);
 }
 
 static void noop_delete_state(struct pipe_context *ctx, void *state)
 {
+   noop_count(ctx, NOOP_CALL_DELETE);
    FREE(state);
 }
 
@@ -195,24 +219,28 @@ static void noop_set_vertex_buffers(struct pipe_context *ctx,
                                     unsigned start_slot, unsigned count,
                                     const struct pipe_vertex_buffer *buffers)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 static void *noop_create_vertex_elements(struct pipe_context *ctx,
                                          unsigned count,
                                          const struct pipe_vertex_element *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
 static void *noop_create_shader_state(struct pipe_context *ctx,
                                       const struct pipe_shader_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
 static void *noop_create_compute_state(struct pipe_context *ctx,
                                        const struct pipe_compute_state *state)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    return MALLOC(1);
 }
 
@@ -222,6 +250,7 @@ static struct pipe_stream_output_target *noop_create_stream_output_target(
       unsigned buffer_offset,
       unsigned buffer_size)
 {
+   noop_count(ctx, NOOP_CALL_CREATE);
    struct pipe_stream_output_target *t = CALLOC_STRUCT(pipe_stream_output_target);
    if (!t)
       return NULL;
@@ -236,6 +265,7 @@ static struct pipe_stream_output_target *noop_create_stream_output_target(
 static void noop_stream_output_target_destroy(struct pipe_context *ctx,
                                               struct pipe_stream_output_target *t)
 {
+   noop_count(ctx, NOOP_CALL_DELETE);
    pipe_resource_reference(&t->buffer, NULL);
    FREE(t);
 }
@@ -245,6 +275,7 @@ static void noop_set_stream_output_targets(struct pipe_context *ctx,
                                            struct pipe_stream_output_target **targets,
                                            const unsigned *offsets)
 {
+   noop_count(ctx, NOOP_CALL_SET);
 }
 
 void noop_init_state_functions(struct pipe_context *ctx);
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2019 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHOR(S) AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NOOP_STATS_H
+#define NOOP_STATS_H
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_context.h"
+
+/*
+ * GALLIUM_NOOP_STATS counts the calls made to the noop context and the
+ * time between the first call of each frame and its end of frame flush.
+ * The noop driver does no work, so that is the time the state tracker
+ * and the application spend above the pipe interface.
+ */
+
+enum noop_call {
+   NOOP_CALL_DRAW,
+   NOOP_CALL_COMPUTE,
+   NOOP_CALL_CLEAR,
+   NOOP_CALL_BLIT,
+   NOOP_CALL_FLUSH,
+   NOOP_CALL_TRANSFER,
+   NOOP_CALL_UPLOAD,
+   NOOP_CALL_QUERY,
+   NOOP_CALL_CREATE,
+   NOOP_CALL_BIND,
+   NOOP_CALL_SET,
+   NOOP_CALL_DELETE,
+   NOOP_CALL_COUNT,
+};
+
+struct noop_stats {
+   uint64_t calls[NOOP_CALL_COUNT];
+   int64_t first_call;
+   int64_t last_call;
+   /* 0 until the first call of the frame */
+   int64_t frame_start;
+   int64_t frame_time;
+   unsigned frames;
+};
+
+struct noop_context {
+   struct pipe_context base;
+   /* NULL without GALLIUM_NOOP_STATS */
+   struct noop_stats *stats;
+};
+
+void noop_stats_count(struct noop_stats *stats, enum noop_call call);
+
+static inline void
+noop_count(struct pipe_context *ctx, enum noop_call call)
+{
+   struct noop_stats *stats = ((struct noop_context *)ctx)->stats;
+
+   if (unlikely(stats))
+      noop_stats_count(stats, call);
+}
+
+#endif
@@ -30,10 +30,10 @@
  * @file
  * Trace dumping functions.
  *
- * For now we just use standard XML for dumping the trace calls, as this is
- * simple to write, parse, and visually inspect, but the actual representation
- * is abstracted out of this file, so that we can switch to a binary
- * representation if/when it becomes justified.
+ * By default we use standard XML for dumping the trace calls, as this is
+ * simple to write, parse, and visually inspect.  GALLIUM_TRACE_BINARY
+ * switches to the much cheaper binary representation of tr_dump_bin.h,
+ * for tracing at full speed.
  *
  * @author Jose Fonseca <jfonseca@vmware.com>
  */
@@ -53,6 +53,7 @@
 #include "util/u_format.h"
 
 #include "tr_dump.h"
+#include "tr_dump_bin.h"
 #include "tr_screen.h"
 #include "tr_texture.h"
 
@@ -62,6 +63,8 @@ static FILE *stream = NULL;
 static mtx_t call_mutex = _MTX_INITIALIZER_NP;
 static long unsigned call_no = 0;
 static boolean dumping = FALSE;
+static boolean binary = FALSE;
+static boolean state_only = FALSE;
 
 
 static inline void
@@ -167,7 +170,10 @@ void
 trace_dump_trace_flush(void)
 {
    if (stream) {
-      fflush(stream);
+      if (binary)
+         trace_bin_flush();
+      else
+         fflush(stream);
    }
 }
 
@@ -175,7 +181,10 @@ static void
 trace_dump_trace_close(void)
 {
    if (stream) {
-      trace_dump_writes("</trace>\n");
+      if (binary)
+         trace_bin_end();
+      else
+         trace_dump_writes("</trace>\n");
       if (close_stream) {
          fclose(stream);
          close_stream = FALSE;
@@ -209,6 +218,8 @@ trace_dump_trace_begin(void)
       return FALSE;
 
    if (!stream) {
+      binary = debug_get_bool_option("GALLIUM_TRACE_BINARY", FALSE);
+      state_only = debug_get_bool_option("GALLIUM_TRACE_STATE_ONLY", FALSE);
 
       if (strcmp(filename, "stderr") == 0) {
          close_stream = FALSE;
@@ -220,14 +231,19 @@ trace_dump_trace_begin(void)
       }
       else {
          close_stream = TRUE;
-         stream = fopen(filename, "wt");
+         stream = fopen(filename, binary ? "wb" : "wt");
          if (!stream)
             return FALSE;
       }
 
-      trace_dump_writes("<?xml version='1.0' encoding='UTF-8'?>\n");
-      trace_dump_writes("<?xml-stylesheet type='text/xsl' href='trace.xsl'?>\n");
-      trace_dump_writes("<trace version='0.1'>\n");
+      if (binary && !trace_bin_begin(stream))
+         binary = FALSE;
+
+      if (!binary) {
+         trace_dump_writes("<?xml version='1.0' encoding='UTF-8'?>\n");
+         trace_dump_writes("<?xml-stylesheet type='text/xsl' href='trace.xsl'?>\n");
+         trace_dump_writes("<trace version='0.1'>\n");
+      }
 
       /* Many applications don't exit cleanly, others may create and destroy a
        * screen multiple times, so we only write </trace> tag and close at exit
@@ -312,6 +328,16 @@ void trace_dump_call_begin_locked(const char *klass, const char *method)
       return;
 
    ++call_no;
+
+   if (binary) {
+      trace_bin_op(TRACE_BIN_CALL_BEGIN);
+      trace_bin_uint(call_no);
+      trace_bin_name(klass);
+      trace_bin_name(method);
+      call_start_time = os_time_get();
+      return;
+   }
+
    trace_dump_indent(1);
    trace_dump_writes("<call no=\'");
    trace_dump_writef("%lu", call_no);
@@ -334,6 +360,12 @@ void trace_dump_call_end_locked(void)
 
    call_end_time = os_time_get();
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_CALL_END);
+      trace_bin_uint(call_end_time - call_start_time);
+      return;
+   }
+
    trace_dump_call_time(call_end_time - call_start_time);
    trace_dump_indent(1);
    trace_dump_tag_end("call");
@@ -358,6 +390,12 @@ void trace_dump_arg_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ARG_BEGIN);
+      trace_bin_name(name);
+      return;
+   }
+
    trace_dump_indent(2);
    trace_dump_tag_begin1("arg", "name", name);
 }
@@ -367,6 +405,11 @@ void trace_dump_arg_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ARG_END);
+      return;
+   }
+
    trace_dump_tag_end("arg");
    trace_dump_newline();
 }
@@ -376,6 +419,11 @@ void trace_dump_ret_begin(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_RET_BEGIN);
+      return;
+   }
+
    trace_dump_indent(2);
    trace_dump_tag_begin("ret");
 }
@@ -385,6 +433,11 @@ void trace_dump_ret_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_RET_END);
+      return;
+   }
+
    trace_dump_tag_end("ret");
    trace_dump_newline();
 }
@@ -394,6 +447,12 @@ void trace_dump_bool(int value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_BOOL);
+      trace_bin_uint(value ? 1 : 0);
+      return;
+   }
+
    trace_dump_writef("<bool>%c</bool>", value ? '1' : '0');
 }
 
@@ -402,6 +461,12 @@ void trace_dump_int(long long int value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_INT);
+      trace_bin_int(value);
+      return;
+   }
+
    trace_dump_writef("<int>%lli</int>", value);
 }
 
@@ -410,6 +475,12 @@ void trace_dump_uint(long long unsigned value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_UINT);
+      trace_bin_uint(value);
+      return;
+   }
+
    trace_dump_writef("<uint>%llu</uint>", value);
 }
 
@@ -418,6 +489,12 @@ void trace_dump_float(double value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_FLOAT);
+      trace_bin_double(value);
+      return;
+   }
+
    trace_dump_writef("<float>%g</float>", value);
 }
 
@@ -431,6 +508,16 @@ void trace_dump_bytes(const void *data,
    if (!dumping)
       return;
 
+   /* only the state is traced */
+   if (state_only)
+      size = 0;
+
+   if (binary) {
+      trace_bin_op(TRACE_BIN_BYTES);
+      trace_bin_data(data, size);
+      return;
+   }
+
    trace_dump_writes("<bytes>");
    for(i = 0; i < size; ++i) {
       uint8_t byte = *p++;
@@ -474,6 +561,12 @@ void trace_dump_string(const char *str)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_STRING);
+      trace_bin_data(str, strlen(str));
+      return;
+   }
+
    trace_dump_writes("<string>");
    trace_dump_escape(str);
    trace_dump_writes("</string>");
@@ -484,6 +577,12 @@ void trace_dump_enum(const char *value)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ENUM);
+      trace_bin_name(value);
+      return;
+   }
+
    trace_dump_writes("<enum>");
    trace_dump_escape(value);
    trace_dump_writes("</enum>");
@@ -494,6 +593,11 @@ void trace_dump_array_begin(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ARRAY_BEGIN);
+      return;
+   }
+
    trace_dump_writes("<array>");
 }
 
@@ -502,6 +606,11 @@ void trace_dump_array_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ARRAY_END);
+      return;
+   }
+
    trace_dump_writes("</array>");
 }
 
@@ -510,6 +619,11 @@ void trace_dump_elem_begin(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ELEM_BEGIN);
+      return;
+   }
+
    trace_dump_writes("<elem>");
 }
 
@@ -518,6 +632,11 @@ void trace_dump_elem_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_ELEM_END);
+      return;
+   }
+
    trace_dump_writes("</elem>");
 }
 
@@ -526,6 +645,12 @@ void trace_dump_struct_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_STRUCT_BEGIN);
+      trace_bin_name(name);
+      return;
+   }
+
    trace_dump_writef("<struct name='%s'>", name);
 }
 
@@ -534,6 +659,11 @@ void trace_dump_struct_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_STRUCT_END);
+      return;
+   }
+
    trace_dump_writes("</struct>");
 }
 
@@ -542,6 +672,12 @@ void trace_dump_member_begin(const char *name)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_MEMBER_BEGIN);
+      trace_bin_name(name);
+      return;
+   }
+
    trace_dump_writef("<member name='%s'>", name);
 }
 
@@ -550,6 +686,11 @@ void trace_dump_member_end(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_MEMBER_END);
+      return;
+   }
+
    trace_dump_writes("</member>");
 }
 
@@ -558,6 +699,11 @@ void trace_dump_null(void)
    if (!dumping)
       return;
 
+   if (binary) {
+      trace_bin_op(TRACE_BIN_NULL);
+      return;
+   }
+
    trace_dump_writes("<null/>");
 }
 
@@ -566,6 +712,16 @@ void trace_dump_ptr(const void *value)
    if (!dumping)
       return;
 
+   if (binary) {
+      if (value) {
+         trace_bin_op(TRACE_BIN_PTR);
+         trace_bin_uint((uintptr_t)value);
+      } else {
+         trace_bin_op(TRACE_BIN_NULL);
+      }
+      return;
+   }
+
    if(value)
       trace_dump_writef("<ptr>0x%08lx</ptr>", (unsigned long)(uintptr_t)value);
    else
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Binary trace writer.
+ *
+ * The tokens are encoded in chunks, which a thread writes to the stream so
+ * that the traced calls don't wait for the file system.
+ */
+
+#include <string.h>
+
+#include "util/hash_table.h"
+#include "util/u_memory.h"
+#include "util/u_queue.h"
+
+#include "tr_dump_bin.h"
+
+
+#define TRACE_BIN_CHUNK_SIZE (1024 * 1024)
+
+/* chunks waiting to be written before the calls wait for the thread */
+#define TRACE_BIN_MAX_CHUNKS 32
+
+struct trace_bin_chunk
+{
+   struct util_queue_fence fence;
+   size_t size;
+   uint8_t data[TRACE_BIN_CHUNK_SIZE];
+};
+
+static FILE *bin_stream = NULL;
+static struct util_queue bin_queue;
+static struct trace_bin_chunk *bin_chunk = NULL;
+
+/* name -> index + 1 in the table of the decoder */
+static struct hash_table *bin_names = NULL;
+static unsigned bin_num_names = 0;
+
+
+static void
+trace_bin_chunk_write(void *job, int thread_index)
+{
+   struct trace_bin_chunk *chunk = job;
+
+   fwrite(chunk->data, chunk->size, 1, bin_stream);
+   fflush(bin_stream);
+}
+
+static void
+trace_bin_chunk_free(void *job, int thread_index)
+{
+   struct trace_bin_chunk *chunk = job;
+
+   util_queue_fence_destroy(&chunk->fence);
+   FREE(chunk);
+}
+
+/* Hand the current chunk to the thread. */
+static void
+trace_bin_submit(void)
+{
+   struct trace_bin_chunk *chunk = bin_chunk;
+
+   if (!chunk || !chunk->size)
+      return;
+
+   bin_chunk = NULL;
+   util_queue_add_job(&bin_queue, chunk, &chunk->fence,
+                      trace_bin_chunk_write, trace_bin_chunk_free);
+}
+
+static void
+trace_bin_write(const void *data, size_t size)
+{
+   const uint8_t *p = data;
+
+   while (size) {
+      size_t len;
+
+      if (!bin_chunk) {
+         bin_chunk = MALLOC_STRUCT(trace_bin_chunk);
+         if (!bin_chunk)
+            return;
+         util_queue_fence_init(&bin_chunk->fence);
+         bin_chunk->size = 0;
+      }
+
+      len = MIN2(size, TRACE_BIN_CHUNK_SIZE - bin_chunk->size);
+      memcpy(bin_chunk->data + bin_chunk->size, p, len);
+      bin_chunk->size += len;
+      p += len;
+      size -= len;
+
+      if (bin_chunk->size == TRACE_BIN_CHUNK_SIZE)
+         trace_bin_submit();
+   }
+}
+
+boolean
+trace_bin_begin(FILE *stream)
+{
+   bin_names = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
+                                       _mesa_key_string_equal);
+   if (!bin_names)
+      return FALSE;
+
+   if (!util_queue_init(&bin_queue, "trace", TRACE_BIN_MAX_CHUNKS, 1, 0)) {
+      _mesa_hash_table_destroy(bin_names, NULL);
+      bin_names = NULL;
+      return FALSE;
+   }
+
+   bin_stream = stream;
+   bin_num_names = 0;
+
+   trace_bin_write(TRACE_BIN_MAGIC, strlen(TRACE_BIN_MAGIC));
+   trace_bin_uint(TRACE_BIN_VERSION);
+   return TRUE;
+}
+
+/* Start writing what was dumped so far, without waiting for it. */
+void
+trace_bin_flush(void)
+{
+   trace_bin_submit();
+}
+
+static void
+trace_bin_free_name(struct hash_entry *entry)
+{
+   FREE((void *)entry->key);
+}
+
+void
+trace_bin_end(void)
+{
+   trace_bin_submit();
+   /* destroying the queue drops the jobs which didn't start */
+   util_queue_finish(&bin_queue);
+   util_queue_destroy(&bin_queue);
+
+   _mesa_hash_table_destroy(bin_names, trace_bin_free_name);
+   bin_names = NULL;
+   bin_stream = NULL;
+}
+
+void
+trace_bin_op(enum trace_bin_op op)
+{
+   uint8_t byte = op;
+
+   trace_bin_write(&byte, 1);
+}
+
+void
+trace_bin_uint(uint64_t value)
+{
+   uint8_t buf[10];
+   unsigned len = 0;
+
+   do {
+      buf[len] = value & 0x7f;
+      value >>= 7;
+      if (value)
+         buf[len] |= 0x80;
+      len++;
+   } while (value);
+
+   trace_bin_write(buf, len);
+}
+
+void
+trace_bin_int(int64_t value)
+{
+   trace_bin_uint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void
+trace_bin_double(double value)
+{
+   union { double d; uint64_t u; } bits;
+   uint8_t buf[8];
+   unsigned i;
+
+   bits.d = value;
+   for (i = 0; i < 8; i++)
+      buf[i] = bits.u >> (i * 8);
+
+   trace_bin_write(buf, sizeof(buf));
+}
+
+void
+trace_bin_data(const void *data, size_t size)
+{
+   trace_bin_uint(size);
+   trace_bin_write(data, size);
+}
+
+/* Reference a name of the table, sending it if it is new. */
+void
+trace_bin_name(const char *name)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(bin_names, name);
+   char *key;
+
+   if (entry) {
+      trace_bin_uint((uintptr_t)entry->data);
+      return;
+   }
+
+   /* a name which couldn't be added is sent again the next time, under
+    * a new index
+    */
+   key = MALLOC(strlen(name) + 1);
+   if (key) {
+      strcpy(key, name);
+      _mesa_hash_table_insert(bin_names, key,
+                              (void *)(uintptr_t)(bin_num_names + 1));
+   }
+   bin_num_names++;
+
+   trace_bin_uint(0);
+   trace_bin_data(name, strlen(name));
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Binary trace encoding.
+ *
+ * The binary trace is the sequence of the XML trace elements as tokens: an
+ * op byte followed by its operands.  Integers are LEB128 varints (signed
+ * ones zigzag encoded first), floats 8 bytes little endian doubles, strings
+ * and bytes a varint length and the data.  Names (classes, methods, args,
+ * structs, members and enums) are the varint index + 1 of the name in a
+ * table, or 0 followed by the length and data of a new name, which is
+ * added to the table.
+ *
+ * The file starts with TRACE_BIN_MAGIC and the varint TRACE_BIN_VERSION.
+ * src/gallium/tools/trace/tracebin.py decodes it.
+ *
+ * The encoded data is buffered in chunks, written by a thread.
+ */
+
+#ifndef TR_DUMP_BIN_H
+#define TR_DUMP_BIN_H
+
+
+#include <stdio.h>
+
+#include "pipe/p_compiler.h"
+
+
+#define TRACE_BIN_MAGIC "GTRB"
+#define TRACE_BIN_VERSION 1
+
+enum trace_bin_op {
+   TRACE_BIN_CALL_BEGIN = 1,  /* no, class, method */
+   TRACE_BIN_CALL_END,        /* time in microseconds */
+   TRACE_BIN_ARG_BEGIN,       /* name */
+   TRACE_BIN_ARG_END,
+   TRACE_BIN_RET_BEGIN,
+   TRACE_BIN_RET_END,
+   TRACE_BIN_BOOL,            /* 0 or 1 */
+   TRACE_BIN_INT,             /* signed value */
+   TRACE_BIN_UINT,            /* value */
+   TRACE_BIN_FLOAT,           /* double */
+   TRACE_BIN_BYTES,           /* length, data */
+   TRACE_BIN_STRING,          /* length, data */
+   TRACE_BIN_ENUM,            /* name */
+   TRACE_BIN_ARRAY_BEGIN,
+   TRACE_BIN_ARRAY_END,
+   TRACE_BIN_ELEM_BEGIN,
+   TRACE_BIN_ELEM_END,
+   TRACE_BIN_STRUCT_BEGIN,    /* name */
+   TRACE_BIN_STRUCT_END,
+   TRACE_BIN_MEMBER_BEGIN,    /* name */
+   TRACE_BIN_MEMBER_END,
+   TRACE_BIN_NULL,
+   TRACE_BIN_PTR,             /* address */
+};
+
+/*
+ * The writer is not thread safe, the callers hold the trace call mutex.
+ */
+boolean trace_bin_begin(FILE *stream);
+void trace_bin_flush(void);
+void trace_bin_end(void);
+
+void trace_bin_op(enum trace_bin_op op);
+void trace_bin_uint(uint64_t value);
+void trace_bin_int(int64_t value);
+void trace_bin_double(double value);
+void trace_bin_data(const void *data, size_t size);
+void trace_bin_name(const char *name);
+
+
+#endif /* TR_DUMP_BIN_H */
@@ -94,6 +94,7 @@ lp_build_min_simple(struct lp_build_context *bld,
 {
    const struct lp_type type = bld->type;
    const char *intrinsic = NULL;
+   char neon_intrinsic[32];
    unsigned intr_size = 0;
    LLVMValueRef cond;
 
@@ -142,6 +143,23 @@ lp_build_min_simple(struct lp_build_context *bld,
          intrinsic = "llvm.ppc.altivec.vminfp";
          intr_size = 128;
       }
+   } else if (type.floating && LP_HAS_AARCH64_NEON &&
+              (type.width == 32 || type.width == 64)) {
+      struct lp_type intr_type = type;
+      const char *intrinsic_root;
+
+      /* fminnm returns the other operand of a NaN, fmin the NaN */
+      if (nan_behavior == GALLIVM_NAN_RETURN_NAN ||
+          nan_behavior == GALLIVM_NAN_RETURN_NAN_FIRST_NONNAN)
+         intrinsic_root = "llvm.aarch64.neon.fmin";
+      else
+         intrinsic_root = "llvm.aarch64.neon.fminnm";
+
+      intr_size = 128;
+      intr_type.length = intr_size / type.width;
+      lp_format_intrinsic(neon_intrinsic, sizeof neon_intrinsic, intrinsic_root,
+                          lp_build_vec_type(bld->gallivm, intr_type));
+      intrinsic = neon_intrinsic;
    } else if (HAVE_LLVM < 0x0309 &&
               util_cpu_caps.has_avx2 && type.length > 4) {
       intr_size = 256;
@@ -312,6 +330,7 @@ lp_build_max_simple(struct lp_build_context *bld,
 {
    const struct lp_type type = bld->type;
    const char *intrinsic = NULL;
+   char neon_intrinsic[32];
    unsigned intr_size = 0;
    LLVMValueRef cond;
 
@@ -360,6 +379,23 @@ lp_build_max_simple(struct lp_build_context *bld,
          intrinsic = "llvm.ppc.altivec.vmaxfp";
          intr_size = 128;
       }
+   } else if (type.floating && LP_HAS_AARCH64_NEON &&
+              (type.width == 32 || type.width == 64)) {
+      struct lp_type intr_type = type;
+      const char *intrinsic_root;
+
+      /* fmaxnm returns the other operand of a NaN, fmax the NaN */
+      if (nan_behavior == GALLIVM_NAN_RETURN_NAN ||
+          nan_behavior == GALLIVM_NAN_RETURN_NAN_FIRST_NONNAN)
+         intrinsic_root = "llvm.aarch64.neon.fmax";
+      else
+         intrinsic_root = "llvm.aarch64.neon.fmaxnm";
+
+      intr_size = 128;
+      intr_type.length = intr_size / type.width;
+      lp_format_intrinsic(neon_intrinsic, sizeof neon_intrinsic, intrinsic_root,
+                          lp_build_vec_type(bld->gallivm, intr_type));
+      intrinsic = neon_intrinsic;
    } else if (HAVE_LLVM < 0x0309 &&
               util_cpu_caps.has_avx2 && type.length > 4) {
       intr_size = 256;
@@ -550,6 +586,7 @@ lp_build_add(struct lp_build_context *bld,
 
    if (type.norm) {
       const char *intrinsic = NULL;
+      char neon_intrinsic[32];
 
       if (!type.sign && (a == bld->one || b == bld->one))
         return bld->one;
@@ -568,6 +605,16 @@ lp_build_add(struct lp_build_context *bld,
                  intrinsic = type.sign ? "llvm.ppc.altivec.vaddshs" : "llvm.ppc.altivec.vadduhs";
             }
          }
+         if (LP_HAS_AARCH64_NEON &&
+             (type.width == 8 || type.width == 16) &&
+             (type.width * type.length == 64 ||
+              type.width * type.length == 128)) {
+            lp_format_intrinsic(neon_intrinsic, sizeof neon_intrinsic,
+                                type.sign ? "llvm.aarch64.neon.sqadd" :
+                                            "llvm.aarch64.neon.uqadd",
+                                bld->vec_type);
+            intrinsic = neon_intrinsic;
+         }
          if (type.width * type.length == 256) {
             if (util_cpu_caps.has_avx2) {
               if (type.width == 8)
@@ -851,6 +898,7 @@ lp_build_sub(struct lp_build_context *bld,
 
    if (type.norm) {
       const char *intrinsic = NULL;
+      char neon_intrinsic[32];
 
       if (!type.sign && b == bld->one)
         return bld->zero;
@@ -869,6 +917,16 @@ lp_build_sub(struct lp_build_context *bld,
                  intrinsic = type.sign ? "llvm.ppc.altivec.vsubshs" : "llvm.ppc.altivec.vsubuhs";
             }
          }
+         if (LP_HAS_AARCH64_NEON &&
+             (type.width == 8 || type.width == 16) &&
+             (type.width * type.length == 64 ||
+              type.width * type.length == 128)) {
+            lp_format_intrinsic(neon_intrinsic, sizeof neon_intrinsic,
+                                type.sign ? "llvm.aarch64.neon.sqsub" :
+                                            "llvm.aarch64.neon.uqsub",
+                                bld->vec_type);
+            intrinsic = neon_intrinsic;
+         }
          if (type.width * type.length == 256) {
             if (util_cpu_caps.has_avx2) {
               if (type.width == 8)
@@ -1959,6 +2017,10 @@ arch_rounding_available(const struct lp_type type)
    else if ((util_cpu_caps.has_altivec &&
             (type.width == 32 && type.length == 4)))
       return TRUE;
+   else if (LP_HAS_AARCH64_NEON &&
+            (type.length == 1 || type.width*type.length == 64 ||
+             type.width*type.length == 128))
+      return TRUE;
 
    return FALSE;
 }
@@ -2025,6 +2087,34 @@ lp_build_iround_nearest_sse2(struct lp_build_context *bld,
 }
 
 
+/*
+ * fcvtns rounds to nearest even and converts in one instruction, too large
+ * values saturate and NaNs give 0.
+ */
+static inline LLVMValueRef
+lp_build_iround_nearest_neon(struct lp_build_context *bld,
+                             LLVMValueRef a)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   const struct lp_type type = bld->type;
+   char intrinsic_root[32];
+   char intrinsic[48];
+
+   assert(type.floating);
+   assert(lp_check_value(type, a));
+   assert(LP_HAS_AARCH64_NEON);
+   (void)type;
+
+   /* overloaded on both the result and the argument types */
+   lp_format_intrinsic(intrinsic_root, sizeof intrinsic_root,
+                       "llvm.aarch64.neon.fcvtns", bld->int_vec_type);
+   lp_format_intrinsic(intrinsic, sizeof intrinsic, intrinsic_root,
+                       bld->vec_type);
+
+   return lp_build_intrinsic_unary(builder, intrinsic, bld->int_vec_type, a);
+}
+
+
 /*
  */
 static inline LLVMValueRef
@@ -2066,7 +2156,7 @@ lp_build_round_arch(struct lp_build_context *bld,
                     LLVMValueRef a,
                     enum lp_build_round_mode mode)
 {
-   if (util_cpu_caps.has_sse4_1) {
+   if (util_cpu_caps.has_sse4_1 || LP_HAS_AARCH64_NEON) {
       LLVMBuilderRef builder = bld->gallivm->builder;
       const struct lp_type type = bld->type;
       const char *intrinsic_root;
@@ -2078,7 +2168,11 @@ lp_build_round_arch(struct lp_build_context *bld,
 
       switch (mode) {
       case LP_BUILD_ROUND_NEAREST:
-         intrinsic_root = "llvm.nearbyint";
+         /* frintn rounds to even whatever the FPCR rounding mode */
+         if (LP_HAS_AARCH64_NEON)
+            intrinsic_root = "llvm.aarch64.neon.frintn";
+         else
+            intrinsic_root = "llvm.nearbyint";
          break;
       case LP_BUILD_ROUND_FLOOR:
          intrinsic_root = "llvm.floor";
@@ -2438,6 +2532,10 @@ lp_build_iround(struct lp_build_context *bld,
        (util_cpu_caps.has_avx && type.width == 32 && type.length == 8)) {
       return lp_build_iround_nearest_sse2(bld, a);
    }
+   if (LP_HAS_AARCH64_NEON && (type.width == 32 || type.width == 64) &&
+       arch_rounding_available(type)) {
+      return lp_build_iround_nearest_neon(bld, a);
+   }
    if (arch_rounding_available(type)) {
       res = lp_build_round_arch(bld, a, LP_BUILD_ROUND_NEAREST);
    }
@@ -2844,6 +2942,10 @@ lp_build_fast_rsqrt_available(struct lp_type type)
        (util_cpu_caps.has_avx && type.width == 32 && type.length == 8)) {
       return true;
    }
+   if (LP_HAS_AARCH64_NEON && type.width == 32 &&
+       (type.length == 1 || type.length == 2 || type.length == 4)) {
+      return true;
+   }
    return false;
 }
 
@@ -2863,7 +2965,26 @@ lp_build_fast_rsqrt(struct lp_build_context *bld,
 
    assert(lp_check_value(type, a));
 
-   if (lp_build_fast_rsqrt_available(type)) {
+   if (LP_HAS_AARCH64_NEON && lp_build_fast_rsqrt_available(type)) {
+      char intrinsic[32];
+      LLVMValueRef res, step;
+
+      /*
+       * frsqrte only has 8 bits, one frsqrts step ((3 - a*b) / 2) brings
+       * more than the 10 promised.  Squaring the estimate first keeps the
+       * results of 0 and infinity, frsqrts takes 0 * inf as 1.5.
+       */
+      lp_format_intrinsic(intrinsic, sizeof intrinsic,
+                          "llvm.aarch64.neon.frsqrte", bld->vec_type);
+      res = lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
+
+      lp_format_intrinsic(intrinsic, sizeof intrinsic,
+                          "llvm.aarch64.neon.frsqrts", bld->vec_type);
+      step = lp_build_intrinsic_binary(builder, intrinsic, bld->vec_type,
+                                       a, LLVMBuildFMul(builder, res, res, ""));
+      return LLVMBuildFMul(builder, res, step, "");
+   }
+   else if (lp_build_fast_rsqrt_available(type)) {
       const char *intrinsic = NULL;
 
       if (type.length == 4) {
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Cache of the machine code of the compiled modules, see
+ * lp_bld_code_cache.h.
+ */
+
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "os/os_thread.h"
+#include "util/hash_table.h"
+#include "util/list.h"
+#include "util/mesa-sha1.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+
+#include "lp_bld_code_cache.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_init.h"
+#include "lp_bld_type.h"
+
+
+/* bytes of objects kept in memory, the oldest ones are dropped first */
+#define LP_CODE_CACHE_MEMORY_SIZE (16 * 1024 * 1024)
+
+/* These flags need the IR and the code of every compile. */
+#define LP_CODE_CACHE_DEBUG_FLAGS (GALLIVM_DEBUG_IR | \
+                                   GALLIVM_DEBUG_ASM | \
+                                   GALLIVM_DEBUG_NO_OPT | \
+                                   GALLIVM_DEBUG_PERF | \
+                                   GALLIVM_DEBUG_DUMP_BC)
+
+struct lp_cached_object
+{
+   cache_key key;
+   /* the oldest last */
+   struct list_head list;
+   size_t size;
+   uint8_t data[];
+};
+
+DEBUG_GET_ONCE_BOOL_OPTION(code_cache, "GALLIVM_CODE_CACHE", TRUE)
+
+static once_flag code_cache_once = ONCE_FLAG_INIT;
+static mtx_t code_cache_mutex = _MTX_INITIALIZER_NP;
+static struct hash_table *code_cache = NULL;
+static struct list_head code_cache_list;
+static size_t code_cache_size = 0;
+static struct disk_cache *code_disk_cache = NULL;
+
+
+static uint32_t
+lp_code_cache_hash(const void *key)
+{
+   uint32_t hash;
+
+   /* the key is a hash already */
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+lp_code_cache_equal(const void *key1, const void *key2)
+{
+   return !memcmp(key1, key2, sizeof(cache_key));
+}
+
+static void
+lp_code_cache_init(void)
+{
+   uint32_t mesa_timestamp, llvm_timestamp;
+   char timestamp[64];
+
+   code_cache = _mesa_hash_table_create(NULL, lp_code_cache_hash,
+                                        lp_code_cache_equal);
+   list_inithead(&code_cache_list);
+
+   /* no disk cache without the build ids */
+   if (disk_cache_get_function_timestamp(lp_code_cache_init,
+                                         &mesa_timestamp) &&
+       disk_cache_get_function_timestamp(LLVMContextCreate,
+                                         &llvm_timestamp)) {
+      util_snprintf(timestamp, sizeof(timestamp), "%u_%u",
+                    mesa_timestamp, llvm_timestamp);
+      code_disk_cache = disk_cache_create("gallivm", timestamp, 0);
+   }
+}
+
+static boolean
+lp_code_cache_enabled(void)
+{
+   if (!debug_get_option_code_cache() ||
+       (gallivm_debug & LP_CODE_CACHE_DEBUG_FLAGS))
+      return FALSE;
+
+   call_once(&code_cache_once, lp_code_cache_init);
+   return code_cache || code_disk_cache;
+}
+
+/**
+ * Compute the key of the module, to be called before the optimization.
+ *
+ * The functions get names which don't depend on the shader and variant
+ * numbers, which are in the IR and in the symbols of the code.
+ */
+boolean
+lp_code_cache_key(struct gallivm_state *gallivm, cache_key key)
+{
+   struct mesa_sha1 ctx;
+   LLVMValueRef func;
+   unsigned num_funcs = 0;
+   unsigned llvm_version = HAVE_LLVM;
+   char *ir;
+   const char *line;
+
+   if (!lp_code_cache_enabled())
+      return FALSE;
+
+   for (func = LLVMGetFirstFunction(gallivm->module); func;
+        func = LLVMGetNextFunction(func)) {
+      char name[32];
+
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      util_snprintf(name, sizeof(name), "gallivm_func%u", num_funcs++);
+      LLVMSetValueName(func, name);
+   }
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, &llvm_version, sizeof(llvm_version));
+   _mesa_sha1_update(&ctx, &util_cpu_caps, sizeof(util_cpu_caps));
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
+
+   /* the IR without the module name */
+   ir = LLVMPrintModuleToString(gallivm->module);
+   for (line = ir; *line; ) {
+      const char *end = strchr(line, '\n');
+      size_t len = end ? end - line + 1 : strlen(line);
+
+      if (strncmp(line, "; ModuleID", 10) &&
+          strncmp(line, "source_filename", 15))
+         _mesa_sha1_update(&ctx, line, len);
+      line += len;
+   }
+   LLVMDisposeMessage(ir);
+
+   _mesa_sha1_final(&ctx, key);
+   return TRUE;
+}
+
+static void
+lp_code_cache_add_locked(const cache_key key, const void *object, size_t size)
+{
+   struct lp_cached_object *obj;
+
+   if (!code_cache || size > LP_CODE_CACHE_MEMORY_SIZE ||
+       _mesa_hash_table_search(code_cache, key))
+      return;
+
+   while (code_cache_size + size > LP_CODE_CACHE_MEMORY_SIZE) {
+      struct lp_cached_object *old =
+         LIST_ENTRY(struct lp_cached_object, code_cache_list.prev, list);
+
+      _mesa_hash_table_remove(code_cache,
+                              _mesa_hash_table_search(code_cache, old->key));
+      list_del(&old->list);
+      code_cache_size -= old->size;
+      FREE(old);
+   }
+
+   obj = MALLOC(sizeof(*obj) + size);
+   if (!obj)
+      return;
+
+   memcpy(obj->key, key, sizeof(cache_key));
+   obj->size = size;
+   memcpy(obj->data, object, size);
+
+   _mesa_hash_table_insert(code_cache, obj->key, obj);
+   list_add(&obj->list, &code_cache_list);
+   code_cache_size += size;
+}
+
+/**
+ * Get a copy of the object of the key from the memory or from the disk,
+ * which the caller frees with free().
+ */
+void *
+lp_code_cache_get(const cache_key key, size_t *size)
+{
+   struct hash_entry *entry;
+   void *object = NULL;
+
+   mtx_lock(&code_cache_mutex);
+
+   entry = code_cache ? _mesa_hash_table_search(code_cache, key) : NULL;
+   if (entry) {
+      struct lp_cached_object *obj = entry->data;
+
+      list_del(&obj->list);
+      list_add(&obj->list, &code_cache_list);
+
+      object = malloc(obj->size);
+      if (object) {
+         memcpy(object, obj->data, obj->size);
+         *size = obj->size;
+      }
+   }
+
+   mtx_unlock(&code_cache_mutex);
+
+   if (!object && code_disk_cache) {
+      cache_key disk_key;
+
+      disk_cache_compute_key(code_disk_cache, key, sizeof(cache_key),
+                             disk_key);
+      object = disk_cache_get(code_disk_cache, disk_key, size);
+      if (object) {
+         mtx_lock(&code_cache_mutex);
+         lp_code_cache_add_locked(key, object, *size);
+         mtx_unlock(&code_cache_mutex);
+      }
+   }
+
+   return object;
+}
+
+/**
+ * Keep the object generated for the key, called by MCJIT.
+ */
+void
+lp_code_cache_put(const cache_key key, const void *object, size_t size)
+{
+   mtx_lock(&code_cache_mutex);
+   lp_code_cache_add_locked(key, object, size);
+   mtx_unlock(&code_cache_mutex);
+
+   if (code_disk_cache) {
+      cache_key disk_key;
+
+      disk_cache_compute_key(code_disk_cache, key, sizeof(cache_key),
+                             disk_key);
+      disk_cache_put(code_disk_cache, disk_key, object, size, NULL);
+   }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Cache of the machine code of the compiled modules.
+ *
+ * The machine code is kept as the object files MCJIT generates, which
+ * MCJIT loads and relocates again instead of optimizing the IR and
+ * generating code.  The key is a hash of the IR, the host and the LLVM
+ * version, so the same variant created by another context or in another
+ * run gets the code of the first one.  The objects are kept in memory and
+ * in the disk cache.
+ */
+
+#ifndef LP_BLD_CODE_CACHE_H
+#define LP_BLD_CODE_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "util/disk_cache.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct gallivm_state;
+
+boolean
+lp_code_cache_key(struct gallivm_state *gallivm, cache_key key);
+
+void *
+lp_code_cache_get(const cache_key key, size_t *size);
+
+void
+lp_code_cache_put(const cache_key key, const void *object, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* !LP_BLD_CODE_CACHE_H */
@@ -472,7 +472,8 @@ int lp_build_conv_auto(struct gallivm_state *gallivm,
 
       /* Special case 4x4x32 --> 1x16x8 */
       if (src_type.length == 4 &&
-            (util_cpu_caps.has_sse2 || util_cpu_caps.has_altivec))
+            (util_cpu_caps.has_sse2 || util_cpu_caps.has_altivec ||
+             LP_HAS_AARCH64_NEON))
       {
          num_dsts = (num_srcs + 3) / 4;
          dst_type->length = num_srcs * 4 >= 16 ? 16 : num_srcs * 4;
@@ -580,7 +581,8 @@ lp_build_conv(struct gallivm_state *gallivm,
        ((dst_type.length == 16 && 4 * num_dsts == num_srcs) ||
         (num_dsts == 1 && dst_type.length * num_srcs == 16 && num_srcs != 3)) &&
 
-       (util_cpu_caps.has_sse2 || util_cpu_caps.has_altivec))
+       (util_cpu_caps.has_sse2 || util_cpu_caps.has_altivec ||
+        LP_HAS_AARCH64_NEON))
    {
       struct lp_build_context bld;
       struct lp_type int16_type, int32_type;
@@ -655,7 +657,7 @@ lp_build_conv(struct gallivm_state *gallivm,
             tmp[1] = tmp[0];
          }
 
-         /* relying on clamping behavior of sse2 intrinsics here */
+         /* relying on clamping behavior of sse2 (or neon) intrinsics here */
          lo = lp_build_pack2(gallivm, int32_type, int16_type, tmp[0], tmp[1]);
 
          if (num_srcs < 4) {
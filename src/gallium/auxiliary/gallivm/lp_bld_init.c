@@ -34,6 +34,7 @@
 #include "util/simple_list.h"
 #include "util/os_time.h"
 #include "lp_bld.h"
+#include "lp_bld_code_cache.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
@@ -553,13 +554,18 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 
 /**
  * Compile a module.
- * This does IR optimization on all functions in the module.
+ * This does IR optimization on all functions in the module, unless the
+ * code cache has the code of the same IR.
  */
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
    int64_t time_begin = 0;
+   cache_key key;
+   boolean cacheable;
+   void *object = NULL;
+   size_t object_size = 0;
 
    assert(!gallivm->compiled);
 
@@ -568,6 +574,13 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+   cacheable = use_mcjit && HAVE_LLVM >= 0x0306 &&
+               lp_code_cache_key(gallivm, key);
+   if (cacheable)
+      object = lp_code_cache_get(key, &object_size);
+   if (object)
+      goto engine;
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
@@ -614,6 +627,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    filename);
    }
 
+engine:
    if (use_mcjit) {
       /* Setting the module's DataLayout to an empty string will cause the
        * ExecutionEngine to copy to the DataLayout string from its target
@@ -637,6 +651,12 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       if (!init_gallivm_engine(gallivm)) {
          assert(0);
       }
+
+      /* the engine generates code at the first jit */
+      if (cacheable) {
+         lp_set_object_cache(gallivm->engine, gallivm->code, key,
+                             object, object_size);
+      }
    }
    assert(gallivm->engine);
 
@@ -37,6 +37,8 @@
 #define LP_BLD_INTR_H
 
 
+#include "util/u_cpu_detect.h"
+
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_init.h"
 
@@ -46,6 +48,16 @@
  */
 #define LP_MAX_FUNC_ARGS 32
 
+/**
+ * Whether the llvm.aarch64.neon.* intrinsics can be used.  The 32bit ARM
+ * ones have other names, has_neon alone doesn't tell.
+ */
+#if defined(PIPE_ARCH_AARCH64)
+#define LP_HAS_AARCH64_NEON util_cpu_caps.has_neon
+#else
+#define LP_HAS_AARCH64_NEON FALSE
+#endif
+
 enum lp_func_attr {
    LP_FUNC_ATTR_ALWAYSINLINE = (1 << 0),
    LP_FUNC_ATTR_INREG        = (1 << 2),
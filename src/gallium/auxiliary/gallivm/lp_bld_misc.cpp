@@ -64,7 +64,9 @@
 #if HAVE_LLVM < 0x0306
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -96,6 +98,7 @@
 #include "util/u_cpu_detect.h"
 
 #include "lp_bld_misc.h"
+#include "lp_bld_code_cache.h"
 #include "lp_bld_debug.h"
 
 namespace {
@@ -388,6 +391,43 @@ class DelegatingJITMemoryManager : public BaseMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
+/*
+ * Give MCJIT the object from the code cache instead of generating code, or
+ * put the object it generated into the code cache.
+ */
+class ShaderObjectCache : public llvm::ObjectCache {
+   cache_key Key;
+   void *Object;
+   size_t Size;
+
+   public:
+
+      ShaderObjectCache(const unsigned char *key, void *object, size_t size) {
+         memcpy(Key, key, sizeof(Key));
+         Object = object;
+         Size = size;
+      }
+
+      virtual ~ShaderObjectCache() {
+         free(Object);
+      }
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         lp_code_cache_put(Key, Obj.getBufferStart(), Obj.getBufferSize());
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+         if (!Object)
+            return nullptr;
+         return llvm::MemoryBuffer::getMemBufferCopy(
+            llvm::StringRef((const char *)Object, Size));
+      }
+};
+#endif
+
+
 /*
  * Delegate memory management to one shared manager for more efficient use
  * of memory than creating a separate pool for each LLVM engine.
@@ -407,9 +447,16 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       typedef std::vector<void *> Vec;
       Vec FunctionBody, ExceptionTable;
       BaseMemoryManager *TheMM;
+#if HAVE_LLVM >= 0x0306
+      /* used by the engine, which is destroyed before the code */
+      ShaderObjectCache *Cache;
+#endif
 
       GeneratedCode(BaseMemoryManager *MM) {
          TheMM = MM;
+#if HAVE_LLVM >= 0x0306
+         Cache = NULL;
+#endif
       }
 
       ~GeneratedCode() {
@@ -427,6 +474,8 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          for ( i = ExceptionTable.begin(); i != ExceptionTable.end(); ++i )
             TheMM->deallocateExceptionTable(*i);
 #endif /* HAVE_LLVM < 0x0304 */
+#else
+         delete Cache;
 #endif /* HAVE_LLVM < 0x0306 */
       }
    };
@@ -459,6 +508,13 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          delete (GeneratedCode *) code;
       }
 
+#if HAVE_LLVM >= 0x0306
+      static void setObjectCache(struct lp_generated_code *code,
+                                 ShaderObjectCache *cache) {
+         ((GeneratedCode *) code)->Cache = cache;
+      }
+#endif
+
 #if HAVE_LLVM < 0x0304
       virtual void deallocateExceptionTable(void *ET) {
          // remember for later deallocation
@@ -772,6 +828,25 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+/**
+ * Make the engine load the object, which the engine frees, instead of
+ * generating code, or put the code it generates into the cache when there
+ * is no object.  To be called before the engine generates code.
+ */
+extern "C"
+void
+lp_set_object_cache(LLVMExecutionEngineRef EE, struct lp_generated_code *code,
+                    const unsigned char *key, void *object, size_t size)
+{
+#if HAVE_LLVM >= 0x0306
+   ShaderObjectCache *cache = new ShaderObjectCache(key, object, size);
+   llvm::unwrap(EE)->setObjectCache(cache);
+   ShaderMemoryManager::setObjectCache(code, cache);
+#else
+   free(object);
+#endif
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -64,6 +64,10 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+extern void
+lp_set_object_cache(LLVMExecutionEngineRef EE, struct lp_generated_code *code,
+                    const unsigned char *key, void *object, size_t size);
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
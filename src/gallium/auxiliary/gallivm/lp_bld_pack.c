@@ -691,6 +691,32 @@ lp_build_pack2(struct gallivm_state *gallivm,
       }
    }
 
+   if (LP_HAS_AARCH64_NEON && src_type.width * src_type.length == 128 &&
+       (src_type.width == 32 || src_type.width == 16)) {
+      /*
+       * The saturating narrows take signed values like the SSE packs, but
+       * narrow one vector to half of the destination.
+       */
+      struct lp_type half_type = dst_type;
+      LLVMTypeRef half_vec_type;
+      LLVMValueRef halves[2];
+      char intrinsic[32];
+
+      half_type.length /= 2;
+      half_vec_type = lp_build_vec_type(gallivm, half_type);
+      lp_format_intrinsic(intrinsic, sizeof intrinsic,
+                          dst_type.sign ? "llvm.aarch64.neon.sqxtn" :
+                                          "llvm.aarch64.neon.sqxtun",
+                          half_vec_type);
+
+      halves[0] = lp_build_intrinsic_unary(builder, intrinsic,
+                                           half_vec_type, lo);
+      halves[1] = lp_build_intrinsic_unary(builder, intrinsic,
+                                           half_vec_type, hi);
+
+      return lp_build_concat(gallivm, halves, half_type, 2);
+   }
+
    /* generic shuffle */
    lo = LLVMBuildBitCast(builder, lo, dst_vec_type, "");
    hi = LLVMBuildBitCast(builder, hi, dst_vec_type, "");
@@ -799,6 +825,13 @@ lp_build_packs2(struct gallivm_state *gallivm,
       (src_type.width == 32 || src_type.width == 16))
       clamp = FALSE;
 
+   /* Same for the AArch64 NEON saturating narrows of lp_build_pack2. */
+   if (LP_HAS_AARCH64_NEON &&
+       src_type.width * src_type.length == 128 &&
+       src_type.sign &&
+       (src_type.width == 32 || src_type.width == 16))
+      clamp = FALSE;
+
    if(clamp) {
       struct lp_build_context bld;
       unsigned dst_bits = dst_type.sign ? dst_type.width - 1 : dst_type.width;
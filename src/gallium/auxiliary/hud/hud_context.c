@@ -36,6 +36,7 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "hud/hud_context.h"
 #include "hud/hud_private.h"
@@ -50,6 +51,7 @@
 #include "util/u_simple_shaders.h"
 #include "util/u_string.h"
 #include "util/u_upload_mgr.h"
+#include "util/os_time.h"
 #include "tgsi/tgsi_text.h"
 #include "tgsi/tgsi_dump.h"
 
@@ -636,13 +638,51 @@ hud_start_queries(struct hud_context *hud, struct pipe_context *pipe)
    }
 }
 
-/* Stop queries, query results, and record vertices for charts. */
 static void
-hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
+hud_log_value(struct hud_context *hud, double value)
 {
-   struct hud_pane *pane;
-   struct hud_graph *gr, *next;
+   if (fabs(value - lround(value)) > FLT_EPSILON)
+      fprintf(hud->log, "%f", value);
+   else
+      fprintf(hud->log, "%" PRIu64, (uint64_t) lround(value));
+}
+
+/* Write the current values of all graphs to the log, if any changed. */
+static void
+hud_log_values(struct hud_context *hud)
+{
+   double now;
+   unsigned i;
+
+   if (!hud->log_pending)
+      return;
+   hud->log_pending = false;
+
+   now = hud->log_start_time +
+          (os_time_get() - hud->log_start_usecs) / 1000000.0;
+
+   if (hud->log_json)
+      fprintf(hud->log, "{\"time\": %.6f", now);
+   else
+      fprintf(hud->log, "%.6f", now);
+
+   for (i = 0; i < hud->num_log_graphs; i++) {
+      struct hud_graph *gr = hud->log_graphs[i];
+
+      if (hud->log_json)
+         fprintf(hud->log, ", \"%s\": ", gr->name);
+      else
+         fputc(',', hud->log);
+      hud_log_value(hud, gr->current_value);
+   }
 
+   fputs(hud->log_json ? "}\n" : "\n", hud->log);
+}
+
+/* Allocate the vertex buffers of the charts. */
+static bool
+hud_alloc_vertices(struct hud_context *hud, struct pipe_context *pipe)
+{
    /* prepare vertex buffers */
    hud_prepare_vertices(hud, &hud->bg, 16 * 256, 2 * sizeof(float));
    hud_prepare_vertices(hud, &hud->whitelines, 4 * 256, 2 * sizeof(float));
@@ -660,7 +700,7 @@ hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
                   16, &hud->bg.vbuf.buffer_offset, &hud->bg.vbuf.buffer.resource,
                   (void**)&hud->bg.vertices);
    if (!hud->bg.vertices)
-      return;
+      return false;
 
    pipe_resource_reference(&hud->whitelines.vbuf.buffer.resource, hud->bg.vbuf.buffer.resource);
    pipe_resource_reference(&hud->text.vbuf.buffer.resource, hud->bg.vbuf.buffer.resource);
@@ -680,6 +720,18 @@ hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
                                          hud->text.buffer_size;
    hud->color_prims.vertices = hud->text.vertices +
                                hud->text.buffer_size / sizeof(float);
+   return true;
+}
+
+/* Stop queries, query results, and record vertices for charts. */
+static void
+hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
+{
+   struct hud_pane *pane;
+   struct hud_graph *gr, *next;
+
+   if (!hud->headless && !hud_alloc_vertices(hud, pipe))
+      return;
 
    /* prepare all graphs */
    hud_batch_query_update(hud->batch_query, pipe);
@@ -689,6 +741,9 @@ hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
          gr->query_new_value(gr, pipe);
       }
 
+      if (hud->headless)
+         continue;
+
       if (pane->sort_items) {
          LIST_FOR_EACH_ENTRY_SAFE(gr, next, &pane->graph_list, head) {
             /* ignore the last one */
@@ -712,8 +767,12 @@ hud_stop_queries(struct hud_context *hud, struct pipe_context *pipe)
          hud_pane_accumulate_vertices(hud, pane);
    }
 
+   if (hud->log)
+      hud_log_values(hud);
+
    /* unmap the uploader's vertex buffer before drawing */
-   u_upload_unmap(pipe->stream_uploader);
+   if (!hud->headless)
+      u_upload_unmap(pipe->stream_uploader);
 }
 
 /**
@@ -734,7 +793,7 @@ hud_run(struct hud_context *hud, struct cso_context *cso,
    if (hud->record_pipe && (!pipe || pipe == hud->record_pipe))
       hud_stop_queries(hud, hud->record_pipe);
 
-   if (hud->cso && (!cso || cso == hud->cso))
+   if (hud->cso && !hud->headless && (!cso || cso == hud->cso))
       hud_draw_results(hud, tex);
 
    if (hud->record_pipe && (!pipe || pipe == hud->record_pipe))
@@ -959,6 +1018,7 @@ void
 hud_graph_add_value(struct hud_graph *gr, double value)
 {
    gr->current_value = value;
+   gr->pane->hud->log_pending = true;
    value = value > gr->pane->ceiling ? gr->pane->ceiling : value;
 
    if (gr->fd) {
@@ -1061,6 +1121,77 @@ hud_graph_set_dump_file(struct hud_graph *gr)
    }
 }
 
+/**
+ * If the GALLIUM_HUD_LOG env var is set, we'll write the values of all
+ * graphs to that file each time they are updated, one line per update
+ * starting with the time in seconds since the epoch. The file is in CSV
+ * with a header line, or in JSON lines if the name ends with ".json".
+ */
+static void
+hud_open_log(struct hud_context *hud)
+{
+   const char *log_file = getenv("GALLIUM_HUD_LOG");
+   struct hud_pane *pane;
+   struct hud_graph *gr;
+   size_t len;
+
+   if (!log_file || !*log_file)
+      return;
+
+   LIST_FOR_EACH_ENTRY(pane, &hud->pane_list, head) {
+      LIST_FOR_EACH_ENTRY(gr, &pane->graph_list, head) {
+         hud->num_log_graphs++;
+      }
+   }
+
+   /* the columns keep their order when sorted panes reorder the graphs */
+   hud->log_graphs = MALLOC(hud->num_log_graphs * sizeof(*hud->log_graphs));
+   if (!hud->log_graphs)
+      return;
+
+   hud->log = fopen(log_file, "w");
+   if (!hud->log) {
+      fprintf(stderr, "gallium_hud: unable to open %s\n", log_file);
+      FREE(hud->log_graphs);
+      hud->log_graphs = NULL;
+      return;
+   }
+   /* flush output after each line is written */
+   setvbuf(hud->log, NULL, _IOLBF, 0);
+
+   len = strlen(log_file);
+   hud->log_json = len >= 5 && strcmp(log_file + len - 5, ".json") == 0;
+   hud->log_start_time = (double) time(NULL);
+   hud->log_start_usecs = os_time_get();
+
+   hud->num_log_graphs = 0;
+   LIST_FOR_EACH_ENTRY(pane, &hud->pane_list, head) {
+      LIST_FOR_EACH_ENTRY(gr, &pane->graph_list, head) {
+         hud->log_graphs[hud->num_log_graphs++] = gr;
+      }
+   }
+
+   if (!hud->log_json) {
+      unsigned i;
+
+      fputs("time", hud->log);
+      for (i = 0; i < hud->num_log_graphs; i++)
+         fprintf(hud->log, ",%s", hud->log_graphs[i]->name);
+      fputc('\n', hud->log);
+   }
+}
+
+static void
+hud_close_log(struct hud_context *hud)
+{
+   if (hud->log)
+      fclose(hud->log);
+   FREE(hud->log_graphs);
+   hud->log = NULL;
+   hud->log_graphs = NULL;
+   hud->num_log_graphs = 0;
+}
+
 /**
  * Read a string from the environment variable.
  * The separators "+", ",", ":", and ";" terminate the string.
@@ -1506,6 +1637,8 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
          hud_graph_set_dump_file(gr);
       }
    }
+
+   hud_open_log(hud);
 }
 
 static void
@@ -1747,6 +1880,8 @@ hud_unset_record_context(struct hud_context *hud)
    if (!pipe)
       return;
 
+   hud_close_log(hud);
+
    LIST_FOR_EACH_ENTRY_SAFE(pane, pane_tmp, &hud->pane_list, head) {
       LIST_FOR_EACH_ENTRY_SAFE(graph, graph_tmp, &pane->graph_list, head) {
          LIST_DEL(&graph->head);
@@ -1837,6 +1972,7 @@ hud_create(struct cso_context *cso, struct hud_context *share)
    }
 
    hud->refcount = 1;
+   hud->headless = debug_get_bool_option("GALLIUM_HUD_HEADLESS", FALSE);
    hud->has_srgb = screen->is_format_supported(screen,
                                                PIPE_FORMAT_B8G8R8A8_SRGB,
                                                PIPE_TEXTURE_2D, 0,
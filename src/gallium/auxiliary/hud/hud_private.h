@@ -92,6 +92,18 @@ struct hud_context {
    } text, bg, whitelines, color_prims;
 
    bool has_srgb;
+
+   /* GALLIUM_HUD_HEADLESS: only record the queries, never draw */
+   bool headless;
+
+   /* GALLIUM_HUD_LOG: the values of all graphs, one line per update */
+   FILE *log;
+   bool log_json;
+   bool log_pending; /* a graph got a new value since the last line */
+   struct hud_graph **log_graphs; /* in the order of the columns */
+   unsigned num_log_graphs;
+   double log_start_time; /* seconds since the epoch */
+   int64_t log_start_usecs;
 };
 
 struct hud_graph {
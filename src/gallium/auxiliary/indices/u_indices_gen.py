@@ -79,9 +79,18 @@ def prolog():
  */
 
 #include "indices/u_indices_priv.h"
+#include "pipe/p_config.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#define U_INDICES_SSE2 1
+#elif defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+#include <arm_neon.h>
+#define U_INDICES_NEON 1
+#endif
+
 
 static unsigned out_size_idx( unsigned index_size )
 {
@@ -299,9 +308,119 @@ def polygon(intype, outtype, inpv, outpv, pr):
     postamble()
 
 
+def tri_order( v0, v1, v2, inpv, outpv ):
+    if inpv == outpv:
+        return [v0, v1, v2]
+    elif inpv == FIRST:
+        return [v1, v2, v0]
+    else:
+        return [v2, v0, v1]
+
+def quad_order( inpv, outpv ):
+    '''The vertices of a quad emitted by do_quad, as offsets from its first.'''
+    if inpv == LAST:
+        return tri_order(0, 1, 3, inpv, outpv) + tri_order(1, 2, 3, inpv, outpv)
+    else:
+        return tri_order(0, 1, 2, inpv, outpv) + tri_order(0, 2, 3, inpv, outpv)
+
+def c_list( values ):
+    return ', '.join([str(v) for v in values])
+
+def mm_shuffle( p ):
+    return '_MM_SHUFFLE(' + c_list(reversed(p)) + ')'
+
+def simd_quads(intype, outtype, inpv, outpv):
+    '''Vector loops over the whole groups of quads, the scalar loop does
+    the rest.  Both use the same vertex order.'''
+    p = quad_order(inpv, outpv)
+
+    if intype == GENERATE:
+        # the outputs are the first vertex plus constant offsets
+        lanes = 4 if outtype == UINT else 8
+        nquads = lanes / 2
+        offsets = []
+        for q in range(nquads):
+            offsets += [4 * q + v for v in p]
+        bits = '32' if outtype == UINT else '16'
+        print '#if defined(U_INDICES_SSE2)'
+        print '  {'
+        print '    const __m128i base_step = _mm_set1_epi' + bits + '(' + str(4 * nquads) + ');'
+        print '    __m128i base = _mm_set1_epi' + bits + '(i);'
+        for k in range(3):
+            print '    const __m128i off' + str(k) + ' = _mm_setr_epi' + bits + '(' + c_list(offsets[k*lanes:(k+1)*lanes]) + ');'
+        print '    for (; j + ' + str(6 * nquads) + ' <= out_nr; j += ' + str(6 * nquads) + ', i += ' + str(4 * nquads) + ') {'
+        for k in range(3):
+            print '      _mm_storeu_si128((__m128i *)(out+j+' + str(k * lanes) + '), _mm_add_epi' + bits + '(base, off' + str(k) + '));'
+        print '      base = _mm_add_epi' + bits + '(base, base_step);'
+        print '    }'
+        print '  }'
+        print '#elif defined(U_INDICES_NEON)'
+        print '  {'
+        print '    static const uint' + bits + '_t offsets[' + str(len(offsets)) + '] = { ' + c_list(offsets) + ' };'
+        print '    uint' + bits + 'x' + str(lanes) + '_t base = vdupq_n_u' + bits + '(i);'
+        for k in range(3):
+            print '    const uint' + bits + 'x' + str(lanes) + '_t off' + str(k) + ' = vld1q_u' + bits + '(offsets + ' + str(k * lanes) + ');'
+        print '    for (; j + ' + str(6 * nquads) + ' <= out_nr; j += ' + str(6 * nquads) + ', i += ' + str(4 * nquads) + ') {'
+        for k in range(3):
+            print '      vst1q_u' + bits + '((uint' + bits + '_t *)(out+j+' + str(k * lanes) + '), vaddq_u' + bits + '(base, off' + str(k) + '));'
+        print '      base = vaddq_u' + bits + '(base, vdupq_n_u' + bits + '(' + str(4 * nquads) + '));'
+        print '    }'
+        print '  }'
+        print '#endif'
+        return
+
+    if intype == UINT and outtype == UINT:
+        # two quads, 12 indices in three vectors
+        print '#if defined(U_INDICES_SSE2)'
+        print '  for (; j + 12 <= out_nr; j += 12, i += 8) {'
+        print '    const __m128i q0 = _mm_loadu_si128((const __m128i *)(in+i+0));'
+        print '    const __m128i q1 = _mm_loadu_si128((const __m128i *)(in+i+4));'
+        print '    _mm_storeu_si128((__m128i *)(out+j+0), _mm_shuffle_epi32(q0, ' + mm_shuffle(p[0:4]) + '));'
+        print '    _mm_storeu_si128((__m128i *)(out+j+4),'
+        print '                     _mm_unpacklo_epi64(_mm_shuffle_epi32(q0, ' + mm_shuffle(p[4:6] + [0, 0]) + '),'
+        print '                                        _mm_shuffle_epi32(q1, ' + mm_shuffle(p[0:2] + [0, 0]) + ')));'
+        print '    _mm_storeu_si128((__m128i *)(out+j+8), _mm_shuffle_epi32(q1, ' + mm_shuffle(p[2:6]) + '));'
+        print '  }'
+        print '#elif defined(U_INDICES_NEON)'
+        bytes_per = 4
+        nquads = 1
+    elif intype == USHORT and outtype == USHORT:
+        print '#if defined(U_INDICES_NEON)'
+        bytes_per = 2
+        nquads = 2
+    else:
+        return
+
+    # the 16 bytes of the input quads as a table for byte lookups
+    table = []
+    for q in range(nquads):
+        for v in p:
+            for b in range(bytes_per):
+                table.append((4 * q + v) * bytes_per + b)
+    print '  {'
+    print '    static const uint8_t lookup[24] = { ' + c_list(table) + ' };'
+    print '    const uint8x8_t l0 = vld1_u8(lookup + 0);'
+    print '    const uint8x8_t l1 = vld1_u8(lookup + 8);'
+    print '    const uint8x8_t l2 = vld1_u8(lookup + 16);'
+    print '    for (; j + ' + str(6 * nquads) + ' <= out_nr; j += ' + str(6 * nquads) + ', i += ' + str(4 * nquads) + ') {'
+    print '      const uint8x16_t q = vld1q_u8((const uint8_t *)(in+i));'
+    print '      uint8x8x2_t t;'
+    print '      t.val[0] = vget_low_u8(q);'
+    print '      t.val[1] = vget_high_u8(q);'
+    print '      vst1_u8((uint8_t *)(out+j) + 0, vtbl2_u8(t, l0));'
+    print '      vst1_u8((uint8_t *)(out+j) + 8, vtbl2_u8(t, l1));'
+    print '      vst1_u8((uint8_t *)(out+j) + 16, vtbl2_u8(t, l2));'
+    print '    }'
+    print '  }'
+    print '#endif'
+
 def quads(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='quads')
-    print '  for (i = start, j = 0; j < out_nr; j+=6, i+=4) { '
+    print '  i = start;'
+    print '  j = 0;'
+    if pr == PRDISABLE:
+        simd_quads(intype, outtype, inpv, outpv)
+    print '  for (; j < out_nr; j+=6, i+=4) { '
     if pr == PRENABLE:
         print 'restart:'
         print '      if (i + 4 > in_nr) {'
@@ -41,6 +41,7 @@
  */
 
 #include "pipe/p_state.h"
+#include "pipe/p_screen.h"
 #include "util/u_draw.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
@@ -49,11 +50,37 @@
 #include "indices/u_indices.h"
 #include "indices/u_primconvert.h"
 
+/* Converted indices kept around for the draws of static index buffers and
+ * the generated ones, so that the same conversion isn't redone every frame.
+ */
+#define PRIMCONVERT_CACHE_SIZE 8
+
+struct primconvert_cached
+{
+   /* the source indices, NULL for generated ones */
+   struct pipe_resource *src;
+   unsigned serial;
+
+   enum pipe_prim_type mode;
+   unsigned index_size;
+   unsigned start;
+   unsigned count;
+   boolean primitive_restart;
+   unsigned restart_index;
+   unsigned api_pv;
+
+   struct pipe_resource *dst;
+   unsigned dst_offset;
+};
+
 struct primconvert_context
 {
    struct pipe_context *pipe;
    uint32_t primtypes_mask;
    unsigned api_pv;
+
+   struct primconvert_cached cache[PRIMCONVERT_CACHE_SIZE];
+   unsigned next_cached;
 };
 
 
@@ -71,6 +98,10 @@ util_primconvert_create(struct pipe_context *pipe, uint32_t primtypes_mask)
 void
 util_primconvert_destroy(struct primconvert_context *pc)
 {
+   for (unsigned i = 0; i < PRIMCONVERT_CACHE_SIZE; i++) {
+      pipe_resource_reference(&pc->cache[i].src, NULL);
+      pipe_resource_reference(&pc->cache[i].dst, NULL);
+   }
    FREE(pc);
 }
 
@@ -86,17 +117,99 @@ util_primconvert_save_rasterizer_state(struct primconvert_context *pc,
    pc->api_pv = rast->flatshade_first ? PV_FIRST : PV_LAST;
 }
 
+/* The write serial of the index buffer of a cacheable draw, FALSE if the
+ * converted indices can't be reused.
+ */
+static boolean
+primconvert_cacheable(struct primconvert_context *pc,
+                      const struct pipe_draw_info *info, unsigned *serial)
+{
+   struct pipe_screen *screen = pc->pipe->screen;
+
+   if (!info->index_size) {
+      *serial = 0;
+      return TRUE;
+   }
+
+   if (info->has_user_indices || !screen->buffer_get_write_serial)
+      return FALSE;
+
+   *serial = screen->buffer_get_write_serial(screen, info->index.resource);
+   return TRUE;
+}
+
+static boolean
+primconvert_cached_match(const struct primconvert_cached *c,
+                         const struct pipe_draw_info *info,
+                         unsigned serial, unsigned api_pv)
+{
+   return c->dst &&
+          c->src == (info->index_size ? info->index.resource : NULL) &&
+          c->serial == serial &&
+          c->mode == info->mode &&
+          c->index_size == info->index_size &&
+          c->start == info->start &&
+          c->count == info->count &&
+          c->primitive_restart == info->primitive_restart &&
+          (!info->primitive_restart ||
+           c->restart_index == info->restart_index) &&
+          c->api_pv == api_pv;
+}
+
+static struct primconvert_cached *
+primconvert_cache_find(struct primconvert_context *pc,
+                       const struct pipe_draw_info *info, unsigned serial)
+{
+   for (unsigned i = 0; i < PRIMCONVERT_CACHE_SIZE; i++) {
+      if (primconvert_cached_match(&pc->cache[i], info, serial, pc->api_pv))
+         return &pc->cache[i];
+   }
+
+   return NULL;
+}
+
+/* Remember converted indices in place of the oldest entry. The entry holds
+ * a reference to the source buffer so that its address isn't reused by
+ * another one, and to the uploaded indices, which the uploader never writes
+ * again.
+ */
+static void
+primconvert_cache_add(struct primconvert_context *pc,
+                      const struct pipe_draw_info *info, unsigned serial,
+                      struct pipe_resource *dst, unsigned dst_offset)
+{
+   struct primconvert_cached *c = &pc->cache[pc->next_cached];
+
+   pc->next_cached = (pc->next_cached + 1) % PRIMCONVERT_CACHE_SIZE;
+
+   pipe_resource_reference(&c->src,
+                           info->index_size ? info->index.resource : NULL);
+   c->serial = serial;
+   c->mode = info->mode;
+   c->index_size = info->index_size;
+   c->start = info->start;
+   c->count = info->count;
+   c->primitive_restart = info->primitive_restart;
+   c->restart_index = info->restart_index;
+   c->api_pv = pc->api_pv;
+   pipe_resource_reference(&c->dst, dst);
+   c->dst_offset = dst_offset;
+}
+
 void
 util_primconvert_draw_vbo(struct primconvert_context *pc,
                           const struct pipe_draw_info *info)
 {
    struct pipe_draw_info new_info;
    struct pipe_transfer *src_transfer = NULL;
+   struct primconvert_cached *cached = NULL;
    u_translate_func trans_func;
    u_generate_func gen_func;
    const void *src = NULL;
    void *dst;
    unsigned ib_offset;
+   unsigned serial;
+   boolean cacheable;
 
    util_draw_init_info(&new_info);
    new_info.min_index = info->min_index;
@@ -118,12 +231,6 @@ util_primconvert_draw_vbo(struct primconvert_context *pc,
                          &trans_func);
       new_info.mode = mode;
       new_info.index_size = index_size;
-      src = info->has_user_indices ? info->index.user : NULL;
-      if (!src) {
-         src = pipe_buffer_map(pc->pipe, info->index.resource,
-                               PIPE_TRANSFER_READ, &src_transfer);
-      }
-      src = (const uint8_t *)src;
    }
    else {
       enum pipe_prim_type mode = 0;
@@ -138,6 +245,27 @@ util_primconvert_draw_vbo(struct primconvert_context *pc,
       new_info.index_size = index_size;
    }
 
+   cacheable = primconvert_cacheable(pc, info, &serial);
+   if (cacheable)
+      cached = primconvert_cache_find(pc, info, serial);
+
+   if (cached) {
+      pipe_resource_reference(&new_info.index.resource, cached->dst);
+      new_info.start = cached->dst_offset / new_info.index_size;
+      pc->pipe->draw_vbo(pc->pipe, &new_info);
+      pipe_resource_reference(&new_info.index.resource, NULL);
+      return;
+   }
+
+   if (info->index_size) {
+      src = info->has_user_indices ? info->index.user : NULL;
+      if (!src) {
+         src = pipe_buffer_map(pc->pipe, info->index.resource,
+                               PIPE_TRANSFER_READ, &src_transfer);
+      }
+      src = (const uint8_t *)src;
+   }
+
    u_upload_alloc(pc->pipe->stream_uploader, 0, new_info.index_size * new_info.count, 4,
                   &ib_offset, &new_info.index.resource, &dst);
    new_info.start = ib_offset / new_info.index_size;
@@ -154,6 +282,9 @@ util_primconvert_draw_vbo(struct primconvert_context *pc,
 
    u_upload_unmap(pc->pipe->stream_uploader);
 
+   if (cacheable && new_info.index.resource)
+      primconvert_cache_add(pc, info, serial, new_info.index.resource, ib_offset);
+
    /* to the translated draw: */
    pc->pipe->draw_vbo(pc->pipe, &new_info);
 
@@ -22,10 +22,16 @@
  * IN THE SOFTWARE.
  */
 
+#include "c11/threads.h"
+#include "util/hash_table.h"
+#include "util/list.h"
+#include "util/mesa-sha1.h"
 #include "util/ralloc.h"
+#include "compiler/blob.h"
 #include "compiler/nir/nir.h"
 #include "compiler/nir/nir_control_flow.h"
 #include "compiler/nir/nir_builder.h"
+#include "compiler/nir/nir_serialize.h"
 #include "compiler/glsl/list.h"
 #include "compiler/shader_enums.h"
 
@@ -1957,3 +1963,164 @@ tgsi_to_nir(const void *tgsi_tokens,
    ralloc_free(c);
    return s;
 }
+
+/* the number of shaders kept, the least recently used is dropped first */
+#define TTN_CACHE_SIZE 256
+
+struct ttn_cached {
+   unsigned char sha1[20];
+   const nir_shader_compiler_options *options;
+   struct list_head link;
+   struct blob nir;
+};
+
+struct tgsi_to_nir_cache {
+   mtx_t lock;
+   struct hash_table *table;
+   /* most recently used first */
+   struct list_head lru;
+   unsigned num_cached;
+};
+
+static uint32_t
+ttn_cached_hash(const void *key)
+{
+   const struct ttn_cached *c = key;
+   uint32_t hash;
+
+   /* the sha1 is a hash already */
+   memcpy(&hash, c->sha1, sizeof(hash));
+   return hash;
+}
+
+static bool
+ttn_cached_equal(const void *key1, const void *key2)
+{
+   const struct ttn_cached *c1 = key1, *c2 = key2;
+
+   return c1->options == c2->options &&
+          !memcmp(c1->sha1, c2->sha1, sizeof(c1->sha1));
+}
+
+struct tgsi_to_nir_cache *
+tgsi_to_nir_cache_create(void)
+{
+   struct tgsi_to_nir_cache *cache = calloc(1, sizeof(*cache));
+   if (!cache)
+      return NULL;
+
+   cache->table = _mesa_hash_table_create(NULL, ttn_cached_hash,
+                                          ttn_cached_equal);
+   if (!cache->table) {
+      free(cache);
+      return NULL;
+   }
+
+   mtx_init(&cache->lock, mtx_plain);
+   list_inithead(&cache->lru);
+   return cache;
+}
+
+static void
+ttn_cached_free(struct ttn_cached *c)
+{
+   blob_finish(&c->nir);
+   free(c);
+}
+
+void
+tgsi_to_nir_cache_destroy(struct tgsi_to_nir_cache *cache)
+{
+   if (!cache)
+      return;
+
+   list_for_each_entry_safe(struct ttn_cached, c, &cache->lru, link)
+      ttn_cached_free(c);
+
+   _mesa_hash_table_destroy(cache->table, NULL);
+   mtx_destroy(&cache->lock);
+   free(cache);
+}
+
+/* Keep the serialized translation, the caller gets to modify the shader. */
+static void
+ttn_cache_add(struct tgsi_to_nir_cache *cache, const struct ttn_cached *key,
+              const nir_shader *s)
+{
+   struct ttn_cached *c = malloc(sizeof(*c));
+   if (!c)
+      return;
+
+   memcpy(c->sha1, key->sha1, sizeof(c->sha1));
+   c->options = key->options;
+   blob_init(&c->nir);
+   nir_serialize(&c->nir, s);
+   if (c->nir.out_of_memory) {
+      ttn_cached_free(c);
+      return;
+   }
+
+   mtx_lock(&cache->lock);
+
+   /* another thread translated the same shader meanwhile */
+   if (_mesa_hash_table_search(cache->table, c)) {
+      mtx_unlock(&cache->lock);
+      ttn_cached_free(c);
+      return;
+   }
+
+   if (cache->num_cached == TTN_CACHE_SIZE) {
+      struct ttn_cached *old =
+         LIST_ENTRY(struct ttn_cached, cache->lru.prev, link);
+
+      _mesa_hash_table_remove(cache->table,
+                              _mesa_hash_table_search(cache->table, old));
+      list_del(&old->link);
+      ttn_cached_free(old);
+      cache->num_cached--;
+   }
+
+   _mesa_hash_table_insert(cache->table, c, c);
+   list_add(&c->link, &cache->lru);
+   cache->num_cached++;
+
+   mtx_unlock(&cache->lock);
+}
+
+struct nir_shader *
+tgsi_to_nir_cached(struct tgsi_to_nir_cache *cache, const void *tgsi_tokens,
+                   const nir_shader_compiler_options *options)
+{
+   struct ttn_cached key;
+   struct hash_entry *entry;
+   nir_shader *s = NULL;
+
+   if (!cache)
+      return tgsi_to_nir(tgsi_tokens, options);
+
+   _mesa_sha1_compute(tgsi_tokens,
+                      tgsi_num_tokens(tgsi_tokens) * sizeof(struct tgsi_token),
+                      key.sha1);
+   key.options = options;
+
+   mtx_lock(&cache->lock);
+   entry = _mesa_hash_table_search(cache->table, &key);
+   if (entry) {
+      struct ttn_cached *c = entry->data;
+      struct blob_reader reader;
+
+      list_del(&c->link);
+      list_add(&c->link, &cache->lru);
+
+      blob_reader_init(&reader, c->nir.data, c->nir.size);
+      s = nir_deserialize(NULL, options, &reader);
+   }
+   mtx_unlock(&cache->lock);
+
+   if (s)
+      return s;
+
+   s = tgsi_to_nir(tgsi_tokens, options);
+   ttn_cache_add(cache, &key, s);
+   return s;
+}
@@ -26,6 +26,22 @@
 struct nir_shader *
 tgsi_to_nir(const void *tgsi_tokens,
             const struct nir_shader_compiler_options *options);
+
+/* Translations of the TGSI shaders created by a screen, so that the ones
+ * created again (by each context for the internal shaders of the state
+ * tracker and u_blitter, or by meta operations) are deserialized instead
+ * of translated.  The cache is thread safe.
+ */
+struct tgsi_to_nir_cache;
+
+struct tgsi_to_nir_cache *
+tgsi_to_nir_cache_create(void);
+void
+tgsi_to_nir_cache_destroy(struct tgsi_to_nir_cache *cache);
+/* a new shader owned by the caller, like tgsi_to_nir(), cache can be NULL */
+struct nir_shader *
+tgsi_to_nir_cached(struct tgsi_to_nir_cache *cache, const void *tgsi_tokens,
+                   const struct nir_shader_compiler_options *options);
 void
 varying_slot_to_tgsi_semantic(gl_varying_slot slot,
                               unsigned *semantic_name, unsigned *semantic_index);
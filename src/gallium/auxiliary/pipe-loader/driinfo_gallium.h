@@ -5,6 +5,7 @@ DRI_CONF_SECTION_PERFORMANCE
    DRI_CONF_DISABLE_EXT_BUFFER_AGE("false")
    DRI_CONF_DISABLE_OML_SYNC_CONTROL("false")
    DRI_CONF_DISABLE_SGI_VIDEO_SYNC("false")
+   DRI_CONF_MAX_FRAMES_IN_FLIGHT(-1)
 DRI_CONF_SECTION_END
 
 DRI_CONF_SECTION_QUALITY
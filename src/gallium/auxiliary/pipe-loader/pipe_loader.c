@@ -35,6 +35,9 @@
 #include "util/xmlpool.h"
 
 #include <string.h>
+#ifdef HAVE_LIBDRM
+#include <unistd.h>
+#endif
 
 #ifdef _MSC_VER
 #include <stdlib.h>
@@ -137,6 +140,22 @@ pipe_loader_create_screen(struct pipe_loader_device *dev)
    return dev->ops->create_screen(dev, &config);
 }
 
+static bool
+module_path(char *path, size_t size, const char *dir, int len,
+            const char *driver_name)
+{
+   int ret;
+
+   if (len)
+      ret = util_snprintf(path, size, "%.*s/%s%s%s",
+                          len, dir, MODULE_PREFIX, driver_name, UTIL_DL_EXT);
+   else
+      ret = util_snprintf(path, size, "%s%s%s",
+                          MODULE_PREFIX, driver_name, UTIL_DL_EXT);
+
+   return ret > 0 && ret < size;
+}
+
 struct util_dl_library *
 pipe_loader_find_module(const char *driver_name,
                         const char *library_paths)
@@ -144,21 +163,13 @@ pipe_loader_find_module(const char *driver_name,
    struct util_dl_library *lib;
    const char *next;
    char path[PATH_MAX];
-   int len, ret;
+   int len;
 
    for (next = library_paths; *next; library_paths = next + 1) {
       next = util_strchrnul(library_paths, ':');
       len = next - library_paths;
 
-      if (len)
-         ret = util_snprintf(path, sizeof(path), "%.*s/%s%s%s",
-                             len, library_paths,
-                             MODULE_PREFIX, driver_name, UTIL_DL_EXT);
-      else
-         ret = util_snprintf(path, sizeof(path), "%s%s%s",
-                             MODULE_PREFIX, driver_name, UTIL_DL_EXT);
-
-      if (ret > 0 && ret < sizeof(path)) {
+      if (module_path(path, sizeof(path), library_paths, len, driver_name)) {
          lib = util_dl_open(path);
          if (lib) {
             return lib;
@@ -168,3 +179,29 @@ pipe_loader_find_module(const char *driver_name,
 
    return NULL;
 }
+
+#ifdef HAVE_LIBDRM
+bool
+pipe_loader_module_exists(const char *driver_name,
+                          const char *library_paths)
+{
+   const char *next;
+   char path[PATH_MAX];
+   int len;
+
+   for (next = library_paths; *next; library_paths = next + 1) {
+      next = util_strchrnul(library_paths, ':');
+      len = next - library_paths;
+
+      /* the dynamic linker searches its own paths for a bare file name */
+      if (!len)
+         return true;
+
+      if (module_path(path, sizeof(path), library_paths, len, driver_name) &&
+          access(path, R_OK) == 0)
+         return true;
+   }
+
+   return false;
+}
+#endif
@@ -216,13 +216,17 @@ pipe_loader_drm_probe_fd(struct pipe_loader_device **dev, int fd)
    if (!ddev->base.driver_name)
       goto fail;
 
-   struct util_dl_library **plib = NULL;
-#ifndef GALLIUM_STATIC_TARGETS
-   plib = &ddev->lib;
-#endif
-   ddev->dd = get_driver_descriptor(ddev->base.driver_name, plib);
+#ifdef GALLIUM_STATIC_TARGETS
+   ddev->dd = get_driver_descriptor(ddev->base.driver_name, NULL);
    if (!ddev->dd)
       goto fail;
+#else
+   /* The module is loaded when the device is used. Probing all the render
+    * nodes doesn't map and relocate the drivers of the unused ones.
+    */
+   if (!pipe_loader_module_exists(ddev->base.driver_name, PIPE_SEARCH_DIR))
+      goto fail;
+#endif
 
    *dev = &ddev->base;
    return true;
@@ -276,6 +280,16 @@ pipe_loader_drm_probe(struct pipe_loader_device **devs, int ndev)
    return j;
 }
 
+static const struct drm_driver_descriptor *
+pipe_loader_drm_get_descriptor(struct pipe_loader_drm_device *ddev)
+{
+#ifndef GALLIUM_STATIC_TARGETS
+   if (!ddev->dd && !ddev->lib)
+      ddev->dd = get_driver_descriptor(ddev->base.driver_name, &ddev->lib);
+#endif
+   return ddev->dd;
+}
+
 static void
 pipe_loader_drm_release(struct pipe_loader_device **dev)
 {
@@ -296,11 +310,13 @@ pipe_loader_drm_configuration(struct pipe_loader_device *dev,
                               enum drm_conf conf)
 {
    struct pipe_loader_drm_device *ddev = pipe_loader_drm_device(dev);
+   const struct drm_driver_descriptor *dd =
+      pipe_loader_drm_get_descriptor(ddev);
 
-   if (!ddev->dd->configuration)
+   if (!dd || !dd->configuration)
       return NULL;
 
-   return ddev->dd->configuration(conf);
+   return dd->configuration(conf);
 }
 
 static struct pipe_screen *
@@ -308,8 +324,13 @@ pipe_loader_drm_create_screen(struct pipe_loader_device *dev,
                               const struct pipe_screen_config *config)
 {
    struct pipe_loader_drm_device *ddev = pipe_loader_drm_device(dev);
+   const struct drm_driver_descriptor *dd =
+      pipe_loader_drm_get_descriptor(ddev);
+
+   if (!dd)
+      return NULL;
 
-   return ddev->dd->create_screen(ddev->fd, config);
+   return dd->create_screen(ddev->fd, config);
 }
 
 char *
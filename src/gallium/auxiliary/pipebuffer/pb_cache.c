@@ -29,6 +29,30 @@
 #include "pb_cache.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
+#include "util/bitscan.h"
+
+
+/**
+ * Size classes split each power of two in four, so that the buffers of a
+ * class are at most 25% apart in size.
+ */
+static unsigned
+pb_cache_size_class(pb_size size)
+{
+   unsigned bits = util_last_bit64(size);
+
+   if (bits <= 3)
+      return size;
+   return (bits - 2) * 4 + ((size >> (bits - 3)) & 3);
+}
+
+static inline struct list_head *
+pb_cache_size_bucket(struct pb_cache *mgr, unsigned bucket_index,
+                     unsigned size_class)
+{
+   return &mgr->size_buckets[bucket_index * PB_CACHE_NUM_SIZE_CLASSES +
+                             size_class];
+}
 
 
 /**
@@ -43,6 +67,7 @@ destroy_buffer_locked(struct pb_cache_entry *entry)
    assert(!pipe_is_referenced(&buf->reference));
    if (entry->head.next) {
       LIST_DEL(&entry->head);
+      LIST_DEL(&entry->size_head);
       assert(mgr->num_buffers);
       --mgr->num_buffers;
       mgr->cache_size -= buf->size;
@@ -104,7 +129,11 @@ pb_cache_add_buffer(struct pb_cache_entry *entry)
 
    entry->start = os_time_get();
    entry->end = entry->start + mgr->usecs;
+   entry->size_class = pb_cache_size_class(buf->size);
    LIST_ADDTAIL(&entry->head, cache);
+   LIST_ADDTAIL(&entry->size_head,
+                pb_cache_size_bucket(mgr, entry->bucket_index,
+                                     entry->size_class));
    ++mgr->num_buffers;
    mgr->cache_size += buf->size;
    mtx_unlock(&mgr->mutex);
@@ -142,64 +171,54 @@ pb_cache_is_buffer_compat(struct pb_cache_entry *entry,
 /**
  * Find a compatible buffer in the cache, return it, and remove it
  * from the cache.
+ *
+ * Only the size classes that can hold a compatible buffer are searched,
+ * from the smallest one. Within a class the buffers were added in order,
+ * so the search of the class stops at the first busy compatible buffer:
+ * the later ones are likely busy too.
  */
 struct pb_buffer *
 pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
                         unsigned alignment, unsigned usage,
                         unsigned bucket_index)
 {
-   struct pb_cache_entry *entry;
-   struct pb_cache_entry *cur_entry;
-   struct list_head *cur, *next;
+   struct pb_cache_entry *entry = NULL;
+   unsigned first_class, last_class, c;
    int64_t now;
-   int ret = 0;
 
    assert(bucket_index < mgr->num_heaps);
-   struct list_head *cache = &mgr->buckets[bucket_index];
 
-   mtx_lock(&mgr->mutex);
-
-   entry = NULL;
-   cur = cache->next;
-   next = cur->next;
+   if (usage & mgr->bypass_usage)
+      return NULL;
 
-   /* search in the expired buffers, freeing them in the process */
-   now = os_time_get();
-   while (cur != cache) {
-      cur_entry = LIST_ENTRY(struct pb_cache_entry, cur, head);
-
-      if (!entry && (ret = pb_cache_is_buffer_compat(cur_entry, size,
-                                                     alignment, usage)) > 0)
-         entry = cur_entry;
-      else if (os_time_timeout(cur_entry->start, cur_entry->end, now))
-         destroy_buffer_locked(cur_entry);
-      else
-         /* This buffer (and all hereafter) are still hot in cache */
-         break;
+   first_class = pb_cache_size_class(size);
+   last_class = pb_cache_size_class((pb_size)(mgr->size_factor * size));
 
-      /* the buffer is busy (and probably all remaining ones too) */
-      if (ret == -1)
-         break;
+   mtx_lock(&mgr->mutex);
 
-      cur = next;
-      next = cur->next;
-   }
+   now = os_time_get();
+   for (c = first_class; c <= last_class && !entry; c++) {
+      struct list_head *cache = pb_cache_size_bucket(mgr, bucket_index, c);
+      struct list_head *cur, *next;
 
-   /* keep searching in the hot buffers */
-   if (!entry && ret != -1) {
-      while (cur != cache) {
-         cur_entry = LIST_ENTRY(struct pb_cache_entry, cur, head);
-         ret = pb_cache_is_buffer_compat(cur_entry, size, alignment, usage);
+      for (cur = cache->next, next = cur->next; cur != cache;
+           cur = next, next = cur->next) {
+         struct pb_cache_entry *cur_entry =
+            LIST_ENTRY(struct pb_cache_entry, cur, size_head);
+         int ret = pb_cache_is_buffer_compat(cur_entry, size,
+                                             alignment, usage);
 
          if (ret > 0) {
             entry = cur_entry;
             break;
          }
-         if (ret == -1)
+
+         /* free the expired buffers on the way */
+         if (os_time_timeout(cur_entry->start, cur_entry->end, now))
+            destroy_buffer_locked(cur_entry);
+         else if (ret == -1)
+            /* the buffer is busy (and probably all remaining ones too) */
             break;
-         /* no need to check the timeout here */
-         cur = next;
-         next = cur->next;
       }
    }
 
@@ -209,6 +228,7 @@ pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
 
       mgr->cache_size -= buf->size;
       LIST_DEL(&entry->head);
+      LIST_DEL(&entry->size_head);
       --mgr->num_buffers;
       mtx_unlock(&mgr->mutex);
       /* Increase refcount */
@@ -289,8 +309,18 @@ pb_cache_init(struct pb_cache *mgr, uint num_heaps,
    if (!mgr->buckets)
       return;
 
+   mgr->size_buckets = CALLOC(num_heaps * PB_CACHE_NUM_SIZE_CLASSES,
+                              sizeof(struct list_head));
+   if (!mgr->size_buckets) {
+      FREE(mgr->buckets);
+      mgr->buckets = NULL;
+      return;
+   }
+
    for (i = 0; i < num_heaps; i++)
       LIST_INITHEAD(&mgr->buckets[i]);
+   for (i = 0; i < num_heaps * PB_CACHE_NUM_SIZE_CLASSES; i++)
+      LIST_INITHEAD(&mgr->size_buckets[i]);
 
    (void) mtx_init(&mgr->mutex, mtx_plain);
    mgr->cache_size = 0;
@@ -313,5 +343,7 @@ pb_cache_deinit(struct pb_cache *mgr)
    pb_cache_release_all_buffers(mgr);
    mtx_destroy(&mgr->mutex);
    FREE(mgr->buckets);
+   FREE(mgr->size_buckets);
    mgr->buckets = NULL;
+   mgr->size_buckets = NULL;
 }
@@ -39,12 +39,17 @@
 struct pb_cache_entry
 {
    struct list_head head;
+   struct list_head size_head; /**< In the list of its heap and size class */
    struct pb_buffer *buffer; /**< Pointer to the structure this is part of. */
    struct pb_cache *mgr;
    int64_t start, end; /**< Caching time interval */
    unsigned bucket_index;
+   unsigned size_class;
 };
 
+/* Four size classes per power of two up to 2^64. */
+#define PB_CACHE_NUM_SIZE_CLASSES 252
+
 struct pb_cache
 {
    /* The cache is divided into buckets for minimizing cache misses.
@@ -52,6 +57,12 @@ struct pb_cache
     */
    struct list_head *buckets;
 
+   /* The buffers of each bucket are also sorted by size, in
+    * PB_CACHE_NUM_SIZE_CLASSES lists per bucket. Both lists are in the
+    * order the buffers were added.
+    */
+   struct list_head *size_buckets;
+
    mtx_t mutex;
    uint64_t cache_size;
    uint64_t max_cache_size;
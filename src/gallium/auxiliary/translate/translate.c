@@ -42,6 +42,10 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
+#elif defined(PIPE_ARCH_ARM) || defined(PIPE_ARCH_AARCH64)
+   translate = translate_neon_create( key );
+   if (translate)
+      return translate;
 #else
    (void)translate;
 #endif
@@ -0,0 +1,761 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Translate for ARM with NEON, for the keys where all the elements are
+ * copied as they are or converted to 32 bit floats, which covers the
+ * u_vbuf fallbacks and the float vertices of draw.
+ *
+ * Instead of a fetch and an emit call per attribute and vertex, each
+ * element runs over all the vertices with a loop specialised for the
+ * type of its channels. The channels of a vertex are converted together
+ * in a NEON register, with the same operations as the u_format fetch
+ * functions so that the results are the same. Other keys are left to
+ * translate_generic.
+ */
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+#include "util/u_half.h"
+
+#include "translate.h"
+
+
+#if (defined(PIPE_ARCH_ARM) || defined(PIPE_ARCH_AARCH64)) && \
+    defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+
+#include <arm_neon.h>
+
+struct translate_neon_attrib;
+
+/* How the vertices of a run are indexed. */
+struct translate_neon_src {
+   const void *elts;
+   unsigned start;
+   unsigned start_instance;
+   unsigned instance_id;
+};
+
+typedef void (*translate_neon_run_func)(const struct translate_neon_attrib *a,
+                                        const struct translate_neon_src *s,
+                                        unsigned elt_size, unsigned count,
+                                        uint8_t *out, unsigned out_stride);
+
+struct translate_neon_attrib {
+   enum translate_element_type type;
+   translate_neon_run_func run;
+
+   unsigned buffer;
+   unsigned input_offset;
+   unsigned instance_divisor;
+   unsigned output_offset;
+
+   const uint8_t *input_ptr;
+   unsigned input_stride;
+   unsigned max_index;
+
+   /* bytes read from a vertex, or copied if the formats are the same */
+   unsigned size;
+
+   /* output floats and where they come from, PIPE_SWIZZLE_0 and _1 for
+    * the constants; direct if the first ones are the channels in order */
+   unsigned nr_outputs;
+   unsigned char swizzle[4];
+   boolean direct;
+
+   /* the factor of the normalized and fixed point channels */
+   float scale[4];
+
+   /* channels of the 10_10_10_2 formats, shifted to the top bits and back
+    * to the bottom ones */
+   int32_t shl[4];
+   int32_t shr[4];
+};
+
+struct translate_neon {
+   struct translate translate;
+
+   struct translate_neon_attrib attrib[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_attrib;
+};
+
+
+static struct translate_neon *
+translate_neon(struct translate *translate)
+{
+   return (struct translate_neon *)translate;
+}
+
+
+/* The channels of a vertex, the missing ones are 0. */
+union neon_channels {
+   uint8_t u8[32];
+   int8_t s8[32];
+   uint16_t u16[16];
+   int16_t s16[16];
+   uint32_t u32[8];
+   int32_t s32[8];
+   float f32[8];
+   double f64[4];
+};
+
+/* Read the channels of a vertex with a fixed size copy, the reads can't go
+ * past the attribute at the end of the buffer.
+ */
+static ALWAYS_INLINE void
+neon_read(union neon_channels *tmp, const uint8_t *src, unsigned size)
+{
+   memset(tmp, 0, sizeof(*tmp));
+
+   switch (size) {
+   case 1: memcpy(tmp, src, 1); break;
+   case 2: memcpy(tmp, src, 2); break;
+   case 3: memcpy(tmp, src, 3); break;
+   case 4: memcpy(tmp, src, 4); break;
+   case 6: memcpy(tmp, src, 6); break;
+   case 8: memcpy(tmp, src, 8); break;
+   case 12: memcpy(tmp, src, 12); break;
+   case 16: memcpy(tmp, src, 16); break;
+   case 24: memcpy(tmp, src, 24); break;
+   default: memcpy(tmp, src, 32); break;
+   }
+}
+
+static ALWAYS_INLINE void
+neon_write(uint8_t *dst, const float *v, unsigned nr)
+{
+   switch (nr) {
+   case 1: memcpy(dst, v, 4); break;
+   case 2: memcpy(dst, v, 8); break;
+   case 3: memcpy(dst, v, 12); break;
+   default: memcpy(dst, v, 16); break;
+   }
+}
+
+/* Store the channels in memory order as the output floats. */
+static ALWAYS_INLINE void
+neon_store(const struct translate_neon_attrib *a, float32x4_t value,
+           uint8_t *dst)
+{
+   float v[6];
+
+   if (a->direct && a->nr_outputs == 4) {
+      vst1q_f32((float *)dst, value);
+      return;
+   }
+
+   vst1q_f32(v, value);
+
+   if (!a->direct) {
+      float out[4];
+
+      v[PIPE_SWIZZLE_0] = 0.0f;
+      v[PIPE_SWIZZLE_1] = 1.0f;
+      for (unsigned i = 0; i < a->nr_outputs; i++)
+         out[i] = v[a->swizzle[i]];
+      neon_write(dst, out, a->nr_outputs);
+   } else {
+      neon_write(dst, v, a->nr_outputs);
+   }
+}
+
+
+/* The channel loads, the conversions match the u_format fetch functions:
+ * integers times the float factor of the format, and for 32 bit
+ * normalized ones and doubles a conversion from a double.
+ */
+
+static ALWAYS_INLINE float32x4_t
+neon_load_float(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   return vld1q_f32(tmp.f32);
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_half(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+#if defined(PIPE_ARCH_AARCH64)
+   return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(tmp.u16)));
+#else
+   float v[4];
+   for (unsigned i = 0; i < 4; i++)
+      v[i] = util_half_to_float(tmp.u16[i]);
+   return vld1q_f32(v);
+#endif
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_double(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+   float v[4];
+
+   neon_read(&tmp, src, a->size);
+   for (unsigned i = 0; i < 4; i++)
+      v[i] = (float)tmp.f64[i];
+   return vld1q_f32(v);
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_u8(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   uint32x4_t value = vmovl_u16(vget_low_u16(vmovl_u8(vld1_u8(tmp.u8))));
+   return vmulq_f32(vcvtq_f32_u32(value), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_s8(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   int32x4_t value = vmovl_s16(vget_low_s16(vmovl_s8(vld1_s8(tmp.s8))));
+   return vmulq_f32(vcvtq_f32_s32(value), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_u16(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   uint32x4_t value = vmovl_u16(vld1_u16(tmp.u16));
+   return vmulq_f32(vcvtq_f32_u32(value), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_s16(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   int32x4_t value = vmovl_s16(vld1_s16(tmp.s16));
+   return vmulq_f32(vcvtq_f32_s32(value), vld1q_f32(a->scale));
+}
+
+/* scaled and fixed point, the factor of the latter is a power of two so
+ * it doesn't need the double of u_format */
+static ALWAYS_INLINE float32x4_t
+neon_load_u32(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   return vmulq_f32(vcvtq_f32_u32(vld1q_u32(tmp.u32)), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_s32(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+
+   neon_read(&tmp, src, a->size);
+   return vmulq_f32(vcvtq_f32_s32(vld1q_s32(tmp.s32)), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_u32_norm(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+   float v[4];
+
+   neon_read(&tmp, src, a->size);
+   for (unsigned i = 0; i < 4; i++)
+      v[i] = (float)(tmp.u32[i] * (1.0/0xffffffff));
+   return vld1q_f32(v);
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_s32_norm(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   union neon_channels tmp;
+   float v[4];
+
+   neon_read(&tmp, src, a->size);
+   for (unsigned i = 0; i < 4; i++)
+      v[i] = (float)(tmp.s32[i] * (1.0/0x7fffffff));
+   return vld1q_f32(v);
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_u1010102(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   uint32_t tmp;
+
+   memcpy(&tmp, src, 4);
+   uint32x4_t value = vshlq_u32(vshlq_u32(vdupq_n_u32(tmp),
+                                          vld1q_s32(a->shl)),
+                                vld1q_s32(a->shr));
+   return vmulq_f32(vcvtq_f32_u32(value), vld1q_f32(a->scale));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_s1010102(const struct translate_neon_attrib *a, const uint8_t *src)
+{
+   uint32_t tmp;
+
+   memcpy(&tmp, src, 4);
+   int32x4_t value = vshlq_s32(vreinterpretq_s32_u32(
+                                  vshlq_u32(vdupq_n_u32(tmp),
+                                            vld1q_s32(a->shl))),
+                               vld1q_s32(a->shr));
+   return vmulq_f32(vcvtq_f32_s32(value), vld1q_f32(a->scale));
+}
+
+
+/* The vertex of an element, with the index clamping of translate_generic.
+ * elt_size is 0 for a linear run, and a constant in the specialised loops.
+ */
+static ALWAYS_INLINE const uint8_t *
+neon_vertex(const struct translate_neon_attrib *a,
+            const struct translate_neon_src *s, unsigned elt_size, unsigned i)
+{
+   unsigned index;
+
+   if (a->instance_divisor) {
+      index = s->start_instance + s->instance_id / a->instance_divisor;
+   } else {
+      switch (elt_size) {
+      case 1: index = ((const uint8_t *)s->elts)[i]; break;
+      case 2: index = ((const uint16_t *)s->elts)[i]; break;
+      case 4: index = ((const unsigned *)s->elts)[i]; break;
+      default: index = s->start + i; break;
+      }
+      index = MIN2(index, a->max_index);
+   }
+
+   return a->input_ptr + (ptrdiff_t)a->input_stride * index;
+}
+
+#define NEON_LOOP(LOAD, ELT_SIZE)                                       \
+   for (unsigned i = 0; i < count; i++) {                               \
+      neon_store(a, LOAD(a, neon_vertex(a, s, ELT_SIZE, i)),            \
+                 out + i * out_stride);                                 \
+   }
+
+#define NEON_RUN(NAME)                                                  \
+static void                                                             \
+neon_run_##NAME(const struct translate_neon_attrib *a,                  \
+                const struct translate_neon_src *s, unsigned elt_size,  \
+                unsigned count, uint8_t *out, unsigned out_stride)      \
+{                                                                       \
+   out += a->output_offset;                                             \
+   switch (elt_size) {                                                  \
+   case 1: NEON_LOOP(neon_load_##NAME, 1); break;                       \
+   case 2: NEON_LOOP(neon_load_##NAME, 2); break;                       \
+   case 4: NEON_LOOP(neon_load_##NAME, 4); break;                       \
+   default: NEON_LOOP(neon_load_##NAME, 0); break;                      \
+   }                                                                    \
+}
+
+NEON_RUN(float)
+NEON_RUN(half)
+NEON_RUN(double)
+NEON_RUN(u8)
+NEON_RUN(s8)
+NEON_RUN(u16)
+NEON_RUN(s16)
+NEON_RUN(u32)
+NEON_RUN(s32)
+NEON_RUN(u32_norm)
+NEON_RUN(s32_norm)
+NEON_RUN(u1010102)
+NEON_RUN(s1010102)
+
+#define NEON_COPY_LOOP(SIZE, ELT_SIZE)                                  \
+   for (unsigned i = 0; i < count; i++) {                               \
+      memcpy(out + i * out_stride, neon_vertex(a, s, ELT_SIZE, i), SIZE); \
+   }
+
+#define NEON_COPY(SIZE)                                                 \
+static void                                                             \
+neon_run_copy##SIZE(const struct translate_neon_attrib *a,              \
+                    const struct translate_neon_src *s,                 \
+                    unsigned elt_size, unsigned count, uint8_t *out,    \
+                    unsigned out_stride)                                \
+{                                                                       \
+   out += a->output_offset;                                             \
+   switch (elt_size) {                                                  \
+   case 1: NEON_COPY_LOOP(SIZE, 1); break;                              \
+   case 2: NEON_COPY_LOOP(SIZE, 2); break;                              \
+   case 4: NEON_COPY_LOOP(SIZE, 4); break;                              \
+   default: NEON_COPY_LOOP(SIZE, 0); break;                             \
+   }                                                                    \
+}
+
+NEON_COPY(4)
+NEON_COPY(8)
+NEON_COPY(12)
+NEON_COPY(16)
+
+static void
+neon_run_copy(const struct translate_neon_attrib *a,
+              const struct translate_neon_src *s, unsigned elt_size,
+              unsigned count, uint8_t *out, unsigned out_stride)
+{
+   out += a->output_offset;
+   for (unsigned i = 0; i < count; i++)
+      memcpy(out + i * out_stride, neon_vertex(a, s, elt_size, i), a->size);
+}
+
+static void
+neon_run_instance_id(const struct translate_neon_attrib *a,
+                     const struct translate_neon_src *s, unsigned elt_size,
+                     unsigned count, uint8_t *out, unsigned out_stride)
+{
+   union { uint32_t u; float f; } value;
+
+   if (a->size)
+      value.u = s->instance_id;
+   else
+      value.f = (float)s->instance_id;
+
+   out += a->output_offset;
+   for (unsigned i = 0; i < count; i++)
+      memcpy(out + i * out_stride, &value, 4);
+}
+
+
+static void
+neon_run_elements(struct translate_neon *tn,
+                  const struct translate_neon_src *s, unsigned elt_size,
+                  unsigned count, void *output_buffer)
+{
+   for (unsigned i = 0; i < tn->nr_attrib; i++) {
+      tn->attrib[i].run(&tn->attrib[i], s, elt_size, count, output_buffer,
+                        tn->translate.key.output_stride);
+   }
+}
+
+static void PIPE_CDECL
+neon_run_elts(struct translate *translate, const unsigned *elts,
+              unsigned count, unsigned start_instance, unsigned instance_id,
+              void *output_buffer)
+{
+   struct translate_neon_src s = { elts, 0, start_instance, instance_id };
+   neon_run_elements(translate_neon(translate), &s, 4, count, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run_elts16(struct translate *translate, const uint16_t *elts,
+                unsigned count, unsigned start_instance, unsigned instance_id,
+                void *output_buffer)
+{
+   struct translate_neon_src s = { elts, 0, start_instance, instance_id };
+   neon_run_elements(translate_neon(translate), &s, 2, count, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run_elts8(struct translate *translate, const uint8_t *elts,
+               unsigned count, unsigned start_instance, unsigned instance_id,
+               void *output_buffer)
+{
+   struct translate_neon_src s = { elts, 0, start_instance, instance_id };
+   neon_run_elements(translate_neon(translate), &s, 1, count, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run(struct translate *translate, unsigned start, unsigned count,
+         unsigned start_instance, unsigned instance_id, void *output_buffer)
+{
+   struct translate_neon_src s = { NULL, start, start_instance, instance_id };
+   neon_run_elements(translate_neon(translate), &s, 0, count, output_buffer);
+}
+
+
+static void
+neon_set_buffer(struct translate *translate, unsigned buf, const void *ptr,
+                unsigned stride, unsigned max_index)
+{
+   struct translate_neon *tn = translate_neon(translate);
+
+   for (unsigned i = 0; i < tn->nr_attrib; i++) {
+      if (tn->attrib[i].buffer == buf) {
+         tn->attrib[i].input_ptr = ((const uint8_t *)ptr +
+                                    tn->attrib[i].input_offset);
+         tn->attrib[i].input_stride = stride;
+         tn->attrib[i].max_index = max_index;
+      }
+   }
+}
+
+static void
+neon_release(struct translate *translate)
+{
+   FREE(translate);
+}
+
+
+/* Pick the loop of a conversion of formats with the same type and size of
+ * channels to floats, or return FALSE.
+ */
+static boolean
+neon_setup_array(struct translate_neon_attrib *a,
+                 const struct util_format_description *desc)
+{
+   const struct util_format_channel_description *c = &desc->channel[0];
+   float scale = 1.0f;
+
+   for (unsigned i = 1; i < desc->nr_channels; i++) {
+      if (desc->channel[i].type != c->type ||
+          desc->channel[i].size != c->size ||
+          desc->channel[i].normalized != c->normalized ||
+          desc->channel[i].pure_integer != c->pure_integer)
+         return FALSE;
+   }
+
+   if (c->pure_integer)
+      return FALSE;
+
+   a->size = desc->block.bits / 8;
+
+   switch (c->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (c->size == 16)
+         a->run = neon_run_half;
+      else if (c->size == 32)
+         a->run = neon_run_float;
+      else if (c->size == 64)
+         a->run = neon_run_double;
+      else
+         return FALSE;
+      return TRUE;
+
+   case UTIL_FORMAT_TYPE_FIXED:
+      if (c->size != 32)
+         return FALSE;
+      scale = 1.0f / 0x10000;
+      a->run = neon_run_s32;
+      break;
+
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      if (c->normalized)
+         scale = 1.0f / ((1ull << c->size) - 1);
+      if (c->size == 8)
+         a->run = neon_run_u8;
+      else if (c->size == 16)
+         a->run = neon_run_u16;
+      else if (c->size == 32)
+         a->run = c->normalized ? neon_run_u32_norm : neon_run_u32;
+      else
+         return FALSE;
+      break;
+
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (c->normalized)
+         scale = 1.0f / ((1ull << (c->size - 1)) - 1);
+      if (c->size == 8)
+         a->run = neon_run_s8;
+      else if (c->size == 16)
+         a->run = neon_run_s16;
+      else if (c->size == 32)
+         a->run = c->normalized ? neon_run_s32_norm : neon_run_s32;
+      else
+         return FALSE;
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   for (unsigned i = 0; i < 4; i++)
+      a->scale[i] = scale;
+   return TRUE;
+}
+
+/* The 10_10_10_2 formats in both channel orders. */
+static boolean
+neon_setup_1010102(struct translate_neon_attrib *a,
+                   const struct util_format_description *desc)
+{
+   const struct util_format_channel_description *c = &desc->channel[0];
+
+   if (desc->block.bits != 32 || desc->nr_channels != 4 || c->pure_integer ||
+       (c->type != UTIL_FORMAT_TYPE_UNSIGNED &&
+        c->type != UTIL_FORMAT_TYPE_SIGNED))
+      return FALSE;
+
+   for (unsigned i = 0; i < 4; i++) {
+      const struct util_format_channel_description *ch = &desc->channel[i];
+      unsigned size = ch->size;
+
+      if (ch->type != c->type || ch->normalized != c->normalized ||
+          ch->pure_integer || size != (i == 3 ? 2 : 10))
+         return FALSE;
+
+      a->shl[i] = 32 - ch->shift - size;
+      a->shr[i] = -(int32_t)(32 - size);
+
+      if (!c->normalized)
+         a->scale[i] = 1.0f;
+      else if (c->type == UTIL_FORMAT_TYPE_UNSIGNED)
+         a->scale[i] = 1.0f / ((1u << size) - 1);
+      else
+         a->scale[i] = 1.0f / ((1u << (size - 1)) - 1);
+   }
+
+   a->size = 4;
+   a->run = c->type == UTIL_FORMAT_TYPE_UNSIGNED ? neon_run_u1010102 :
+                                                  neon_run_s1010102;
+   return TRUE;
+}
+
+/* The outputs must be 32 bit floats in order. */
+static boolean
+neon_is_float_output(const struct util_format_description *desc)
+{
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN || !desc->is_array)
+      return FALSE;
+
+   for (unsigned i = 0; i < desc->nr_channels; i++) {
+      if (desc->channel[i].type != UTIL_FORMAT_TYPE_FLOAT ||
+          desc->channel[i].size != 32 ||
+          desc->swizzle[i] != PIPE_SWIZZLE_X + i)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+static boolean
+neon_setup_element(struct translate_neon_attrib *a,
+                   const struct translate_element *element)
+{
+   const struct util_format_description *in, *out;
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      a->run = neon_run_instance_id;
+      if (element->output_format == PIPE_FORMAT_R32_USCALED ||
+          element->output_format == PIPE_FORMAT_R32_SSCALED)
+         a->size = 4;
+      else if (element->output_format == PIPE_FORMAT_R32_FLOAT)
+         a->size = 0;
+      else
+         return FALSE;
+      return TRUE;
+   }
+
+   in = util_format_description(element->input_format);
+   out = util_format_description(element->output_format);
+   if (!in || !out)
+      return FALSE;
+
+   if (element->input_format == element->output_format &&
+       in->block.width == 1 && in->block.height == 1 &&
+       !(in->block.bits & 7)) {
+      a->size = in->block.bits / 8;
+      switch (a->size) {
+      case 4: a->run = neon_run_copy4; break;
+      case 8: a->run = neon_run_copy8; break;
+      case 12: a->run = neon_run_copy12; break;
+      case 16: a->run = neon_run_copy16; break;
+      default: a->run = neon_run_copy; break;
+      }
+      return TRUE;
+   }
+
+   if (!neon_is_float_output(out) || in->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       in->block.width != 1 || in->block.height != 1)
+      return FALSE;
+
+   if (in->is_array) {
+      if (!neon_setup_array(a, in))
+         return FALSE;
+   } else if (!neon_setup_1010102(a, in)) {
+      return FALSE;
+   }
+
+   a->nr_outputs = out->nr_channels;
+   a->direct = TRUE;
+   for (unsigned i = 0; i < 4; i++) {
+      a->swizzle[i] = in->swizzle[i];
+      if (i < a->nr_outputs && in->swizzle[i] != PIPE_SWIZZLE_X + i)
+         a->direct = FALSE;
+   }
+   if (a->swizzle[0] == PIPE_SWIZZLE_NONE)
+      return FALSE;
+
+   return TRUE;
+}
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   struct translate_neon *tn = CALLOC_STRUCT(translate_neon);
+   unsigned i;
+
+   if (!tn)
+      return NULL;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   tn->translate.key = *key;
+   tn->translate.release = neon_release;
+   tn->translate.set_buffer = neon_set_buffer;
+   tn->translate.run_elts = neon_run_elts;
+   tn->translate.run_elts16 = neon_run_elts16;
+   tn->translate.run_elts8 = neon_run_elts8;
+   tn->translate.run = neon_run;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      struct translate_neon_attrib *a = &tn->attrib[i];
+
+      a->type = key->element[i].type;
+      a->buffer = key->element[i].input_buffer;
+      a->input_offset = key->element[i].input_offset;
+      a->instance_divisor = key->element[i].instance_divisor;
+      a->output_offset = key->element[i].output_offset;
+
+      if (!neon_setup_element(a, &key->element[i])) {
+         FREE(tn);
+         return NULL;
+      }
+   }
+
+   tn->nr_attrib = key->nr_elements;
+
+   return &tn->translate;
+}
+
+
+#else
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   return NULL;
+}
+
+#endif
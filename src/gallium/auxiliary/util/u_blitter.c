@@ -1373,6 +1373,7 @@ static void util_blitter_clear_custom(struct blitter_context *blitter,
                                       unsigned clear_buffers,
                                       const union pipe_color_union *color,
                                       double depth, unsigned stencil,
+                                      const struct pipe_scissor_state *rect,
                                       void *custom_blend, void *custom_dsa)
 {
    struct blitter_context_priv *ctx = (struct blitter_context_priv*)blitter;
@@ -1380,6 +1381,7 @@ static void util_blitter_clear_custom(struct blitter_context *blitter,
    struct pipe_stencil_ref sr = { { 0 } };
 
    assert(ctx->has_layered || num_layers <= 1);
+   assert(!rect || num_layers <= 1);
 
    util_blitter_common_clear_setup(blitter, width, height, clear_buffers,
                                    custom_blend, custom_dsa);
@@ -1411,9 +1413,14 @@ static void util_blitter_clear_custom(struct blitter_context *blitter,
       else
          get_vs = get_vs_passthrough_pos;
 
+      int x0 = rect ? rect->minx : 0;
+      int y0 = rect ? rect->miny : 0;
+      int x1 = rect ? rect->maxx : width;
+      int y1 = rect ? rect->maxy : height;
+
       blitter_set_common_draw_rect_state(ctx, false);
       blitter->draw_rectangle(blitter, ctx->velem_state, get_vs,
-                              0, 0, width, height,
+                              x0, y0, x1, y1,
                               (float) depth, 1, type, &attrib);
    }
 
@@ -1431,7 +1438,19 @@ void util_blitter_clear(struct blitter_context *blitter,
 {
    util_blitter_clear_custom(blitter, width, height, num_layers,
                              clear_buffers, color, depth, stencil,
-                             NULL, NULL);
+                             NULL, NULL, NULL);
+}
+
+void util_blitter_clear_rect(struct blitter_context *blitter,
+                             unsigned width, unsigned height,
+                             unsigned clear_buffers,
+                             const union pipe_color_union *color,
+                             double depth, unsigned stencil,
+                             const struct pipe_scissor_state *rect)
+{
+   util_blitter_clear_custom(blitter, width, height, 1,
+                             clear_buffers, color, depth, stencil,
+                             rect, NULL, NULL);
 }
 
 void util_blitter_custom_clear_depth(struct blitter_context *blitter,
@@ -1440,7 +1459,7 @@ void util_blitter_custom_clear_depth(struct blitter_context *blitter,
 {
    static const union pipe_color_union color;
    util_blitter_clear_custom(blitter, width, height, 0, 0, &color, depth, 0,
-                             NULL, custom_dsa);
+                             NULL, NULL, custom_dsa);
 }
 
 void util_blitter_default_dst_texture(struct pipe_surface *dst_templ,
@@ -1779,17 +1798,51 @@ static void do_blits(struct blitter_context_priv *ctx,
    }
 }
 
-void util_blitter_blit_generic(struct blitter_context *blitter,
-                               struct pipe_surface *dst,
-                               const struct pipe_box *dstbox,
-                               struct pipe_sampler_view *src,
-                               const struct pipe_box *srcbox,
-                               unsigned src_width0, unsigned src_height0,
-                               unsigned mask, unsigned filter,
-                               const struct pipe_scissor_state *scissor,
-                               bool alpha_blend)
+/* The states bound by the previous blits of a batch, which don't have to
+ * be bound again. Blits outside a batch start with none.
+ */
+struct blitter_bound_state {
+   void *blend;
+   void *dsa;
+   void *fs;
+   void *sampler;
+   void *rs;
+};
+
+static void
+blitter_bind_blit_states(struct blitter_context_priv *ctx,
+                         struct blitter_bound_state *bound,
+                         void *blend, void *dsa, void *fs)
+{
+   struct pipe_context *pipe = ctx->base.pipe;
+
+   if (bound->blend != blend) {
+      pipe->bind_blend_state(pipe, blend);
+      bound->blend = blend;
+   }
+   if (bound->dsa != dsa) {
+      pipe->bind_depth_stencil_alpha_state(pipe, dsa);
+      bound->dsa = dsa;
+   }
+   if (bound->fs != fs) {
+      ctx->bind_fs_state(pipe, fs);
+      bound->fs = fs;
+   }
+}
+
+/* Draw a blit, the states have been saved by the caller. */
+static void
+blitter_draw_blit(struct blitter_context_priv *ctx,
+                  struct pipe_surface *dst,
+                  const struct pipe_box *dstbox,
+                  struct pipe_sampler_view *src,
+                  const struct pipe_box *srcbox,
+                  unsigned src_width0, unsigned src_height0,
+                  unsigned mask, unsigned filter,
+                  const struct pipe_scissor_state *scissor,
+                  bool alpha_blend,
+                  struct blitter_bound_state *bound)
 {
-   struct blitter_context_priv *ctx = (struct blitter_context_priv*)blitter;
    struct pipe_context *pipe = ctx->base.pipe;
    enum pipe_texture_target src_target = src->target;
    unsigned src_samples = src->texture->nr_samples;
@@ -1861,33 +1914,20 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
          box.z + box.depth > 0 && box.z + box.depth <= src_depth;
    }
 
-   /* Check whether the states are properly saved. */
-   util_blitter_set_running_flag(blitter);
-   blitter_check_saved_vertex_states(ctx);
-   blitter_check_saved_fragment_states(ctx);
-   blitter_check_saved_textures(ctx);
-   blitter_check_saved_fb_state(ctx);
-   blitter_disable_render_cond(ctx);
-
    if (blit_depth || blit_stencil) {
-      pipe->bind_blend_state(pipe, ctx->blend[0][0]);
-
       if (blit_depth && blit_stencil) {
-         pipe->bind_depth_stencil_alpha_state(pipe,
-                                              ctx->dsa_write_depth_stencil);
-         ctx->bind_fs_state(pipe,
+         blitter_bind_blit_states(ctx, bound, ctx->blend[0][0],
+               ctx->dsa_write_depth_stencil,
                blitter_get_fs_texfetch_depthstencil(ctx, src_target,
                                                     src_samples, use_txf));
       } else if (blit_depth) {
-         pipe->bind_depth_stencil_alpha_state(pipe,
-                                              ctx->dsa_write_depth_keep_stencil);
-         ctx->bind_fs_state(pipe,
+         blitter_bind_blit_states(ctx, bound, ctx->blend[0][0],
+               ctx->dsa_write_depth_keep_stencil,
                blitter_get_fs_texfetch_depth(ctx, src_target,
                                              src_samples, use_txf));
       } else { /* is_stencil */
-         pipe->bind_depth_stencil_alpha_state(pipe,
-                                              ctx->dsa_keep_depth_write_stencil);
-         ctx->bind_fs_state(pipe,
+         blitter_bind_blit_states(ctx, bound, ctx->blend[0][0],
+               ctx->dsa_keep_depth_write_stencil,
                blitter_get_fs_texfetch_stencil(ctx, src_target,
                                                src_samples, use_txf));
       }
@@ -1895,9 +1935,8 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
    } else {
       unsigned colormask = mask & PIPE_MASK_RGBA;
 
-      pipe->bind_blend_state(pipe, ctx->blend[colormask][alpha_blend]);
-      pipe->bind_depth_stencil_alpha_state(pipe, ctx->dsa_keep_depth_stencil);
-      ctx->bind_fs_state(pipe,
+      blitter_bind_blit_states(ctx, bound, ctx->blend[colormask][alpha_blend],
+            ctx->dsa_keep_depth_stencil,
             blitter_get_fs_texfetch_col(ctx, src->format, dst->format, src_target,
                                         src_samples, dst_samples, filter,
                                         use_txf));
@@ -1934,6 +1973,7 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
 
       pipe->set_sampler_views(pipe, PIPE_SHADER_FRAGMENT, 0, 2, views);
       pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT, 0, 2, samplers);
+      bound->sampler = NULL;
 
       pipe_sampler_view_reference(&views[1], NULL);
    } else if (blit_stencil) {
@@ -1948,24 +1988,60 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
       view = pipe->create_sampler_view(pipe, src->texture, &templ);
 
       pipe->set_sampler_views(pipe, PIPE_SHADER_FRAGMENT, 0, 1, &view);
-      pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT,
-                                0, 1, &sampler_state);
+      if (bound->sampler != sampler_state) {
+         pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT,
+                                   0, 1, &sampler_state);
+         bound->sampler = sampler_state;
+      }
 
       pipe_sampler_view_reference(&view, NULL);
    } else {
       pipe->set_sampler_views(pipe, PIPE_SHADER_FRAGMENT, 0, 1, &src);
-      pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT,
-                                0, 1, &sampler_state);
+      if (bound->sampler != sampler_state) {
+         pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT,
+                                   0, 1, &sampler_state);
+         bound->sampler = sampler_state;
+      }
    }
 
    if (scissor) {
       pipe->set_scissor_states(pipe, 0, 1, scissor);
    }
 
-   blitter_set_common_draw_rect_state(ctx, scissor != NULL);
+   void *rs = scissor ? ctx->rs_state_scissor : ctx->rs_state;
+   if (bound->rs != rs) {
+      blitter_set_common_draw_rect_state(ctx, scissor != NULL);
+      bound->rs = rs;
+   }
 
    do_blits(ctx, dst, dstbox, src, src_width0, src_height0,
             srcbox, blit_depth || blit_stencil, use_txf);
+}
+
+void util_blitter_blit_generic(struct blitter_context *blitter,
+                               struct pipe_surface *dst,
+                               const struct pipe_box *dstbox,
+                               struct pipe_sampler_view *src,
+                               const struct pipe_box *srcbox,
+                               unsigned src_width0, unsigned src_height0,
+                               unsigned mask, unsigned filter,
+                               const struct pipe_scissor_state *scissor,
+                               bool alpha_blend)
+{
+   struct blitter_context_priv *ctx = (struct blitter_context_priv*)blitter;
+   struct pipe_context *pipe = ctx->base.pipe;
+   struct blitter_bound_state bound = {0};
+
+   /* Check whether the states are properly saved. */
+   util_blitter_set_running_flag(blitter);
+   blitter_check_saved_vertex_states(ctx);
+   blitter_check_saved_fragment_states(ctx);
+   blitter_check_saved_textures(ctx);
+   blitter_check_saved_fb_state(ctx);
+   blitter_disable_render_cond(ctx);
+
+   blitter_draw_blit(ctx, dst, dstbox, src, srcbox, src_width0, src_height0,
+                     mask, filter, scissor, alpha_blend, &bound);
 
    util_blitter_restore_vertex_states(blitter);
    util_blitter_restore_fragment_states(blitter);
@@ -1978,27 +2054,39 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
    util_blitter_unset_running_flag(blitter);
 }
 
-void
-util_blitter_blit(struct blitter_context *blitter,
-                  const struct pipe_blit_info *info)
+static void
+blitter_create_blit_views(struct blitter_context *blitter,
+                          const struct pipe_blit_info *info,
+                          struct pipe_surface **dst_view,
+                          struct pipe_sampler_view **src_view)
 {
    struct pipe_resource *dst = info->dst.resource;
    struct pipe_resource *src = info->src.resource;
-   struct blitter_context_priv *ctx = (struct blitter_context_priv*)blitter;
-   struct pipe_context *pipe = ctx->base.pipe;
-   struct pipe_surface *dst_view, dst_templ;
-   struct pipe_sampler_view src_templ, *src_view;
+   struct pipe_context *pipe = blitter->pipe;
+   struct pipe_surface dst_templ;
+   struct pipe_sampler_view src_templ;
 
    /* Initialize the surface. */
    util_blitter_default_dst_texture(&dst_templ, dst, info->dst.level,
                                     info->dst.box.z);
    dst_templ.format = info->dst.format;
-   dst_view = pipe->create_surface(pipe, dst, &dst_templ);
+   *dst_view = pipe->create_surface(pipe, dst, &dst_templ);
 
    /* Initialize the sampler view. */
    util_blitter_default_src_texture(blitter, &src_templ, src, info->src.level);
    src_templ.format = info->src.format;
-   src_view = pipe->create_sampler_view(pipe, src, &src_templ);
+   *src_view = pipe->create_sampler_view(pipe, src, &src_templ);
+}
+
+void
+util_blitter_blit(struct blitter_context *blitter,
+                  const struct pipe_blit_info *info)
+{
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_surface *dst_view;
+   struct pipe_sampler_view *src_view;
+
+   blitter_create_blit_views(blitter, info, &dst_view, &src_view);
 
    /* Copy. */
    util_blitter_blit_generic(blitter, dst_view, &info->dst.box,
@@ -2011,6 +2099,56 @@ util_blitter_blit(struct blitter_context *blitter,
    pipe_sampler_view_reference(&src_view, NULL);
 }
 
+/* Blit a list of blits with one save and restore of the states, only the
+ * states that differ from the previous blit are bound.
+ */
+void
+util_blitter_blit_batch(struct blitter_context *blitter,
+                        const struct pipe_blit_info *infos, unsigned count)
+{
+   struct blitter_context_priv *ctx = (struct blitter_context_priv*)blitter;
+   struct pipe_context *pipe = ctx->base.pipe;
+   struct blitter_bound_state bound = {0};
+   bool scissor = false;
+
+   /* Check whether the states are properly saved. */
+   util_blitter_set_running_flag(blitter);
+   blitter_check_saved_vertex_states(ctx);
+   blitter_check_saved_fragment_states(ctx);
+   blitter_check_saved_textures(ctx);
+   blitter_check_saved_fb_state(ctx);
+   blitter_disable_render_cond(ctx);
+
+   for (unsigned i = 0; i < count; i++) {
+      const struct pipe_blit_info *info = &infos[i];
+      struct pipe_resource *src = info->src.resource;
+      struct pipe_surface *dst_view;
+      struct pipe_sampler_view *src_view;
+
+      blitter_create_blit_views(blitter, info, &dst_view, &src_view);
+
+      blitter_draw_blit(ctx, dst_view, &info->dst.box,
+                        src_view, &info->src.box, src->width0, src->height0,
+                        info->mask, info->filter,
+                        info->scissor_enable ? &info->scissor : NULL,
+                        info->alpha_blend, &bound);
+      scissor |= info->scissor_enable;
+
+      pipe_surface_reference(&dst_view, NULL);
+      pipe_sampler_view_reference(&src_view, NULL);
+   }
+
+   util_blitter_restore_vertex_states(blitter);
+   util_blitter_restore_fragment_states(blitter);
+   util_blitter_restore_textures(blitter);
+   util_blitter_restore_fb_state(blitter);
+   if (scissor) {
+      pipe->set_scissor_states(pipe, 0, 1, &ctx->base.saved_scissor);
+   }
+   util_blitter_restore_render_cond(blitter);
+   util_blitter_unset_running_flag(blitter);
+}
+
 void util_blitter_generate_mipmap(struct blitter_context *blitter,
                                   struct pipe_resource *tex,
                                   enum pipe_format format,
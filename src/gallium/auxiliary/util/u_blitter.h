@@ -200,6 +200,17 @@ void util_blitter_clear(struct blitter_context *blitter,
                         const union pipe_color_union *color,
                         double depth, unsigned stencil);
 
+/**
+ * Like util_blitter_clear, but only the pixels of the rect are cleared, in
+ * the first layer.
+ */
+void util_blitter_clear_rect(struct blitter_context *blitter,
+                             unsigned width, unsigned height,
+                             unsigned clear_buffers,
+                             const union pipe_color_union *color,
+                             double depth, unsigned stencil,
+                             const struct pipe_scissor_state *rect);
+
 /**
  * Check if the blitter (with the help of the driver) can blit between
  * the two resources.
@@ -264,6 +275,14 @@ void util_blitter_blit_generic(struct blitter_context *blitter,
 void util_blitter_blit(struct blitter_context *blitter,
 		       const struct pipe_blit_info *info);
 
+/**
+ * Do several blits like util_blitter_blit, saving and restoring the states
+ * once. The blits are done in order.
+ */
+void util_blitter_blit_batch(struct blitter_context *blitter,
+                             const struct pipe_blit_info *infos,
+                             unsigned count);
+
 void util_blitter_generate_mipmap(struct blitter_context *blitter,
                                   struct pipe_resource *tex,
                                   enum pipe_format format,
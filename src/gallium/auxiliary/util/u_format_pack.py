@@ -610,10 +610,214 @@ def generate_pack_kernel(format, src_channel, src_native_type):
         print_channels(format, pack_into_union)
 
 
+# SIMD row kernels for the 8unorm unpack and pack of the bitmask formats
+# made of small unorm channels, like the RGBA8 swizzles and RGB565.  They
+# do 4 pixels in the 32 bit lanes with the shifts and masks of the scalar
+# kernels, and an exact multiply and shift for the x * 0xff / max, so the
+# results are the same.  They are picked at build time, SSE2 comes with
+# PIPE_ARCH_SSE and NEON with __ARM_NEON, and only the little endian layout
+# is done.
+
+simd_archs = [
+    {
+        'guard': 'defined(PIPE_ARCH_SSE)',
+        'type': '__m128i',
+        'type16': '__m128i',
+        'load': '_mm_loadu_si128((const __m128i *)(%s))',
+        'load16': '_mm_loadu_si128((const __m128i *)(%s))',
+        'store': '_mm_storeu_si128((__m128i *)(%s), %s)',
+        'store16': '_mm_storeu_si128((__m128i *)(%s), %s)',
+        'const': '_mm_set1_epi32(0x%x)',
+        'srl': '_mm_srli_epi32(%s, %u)',
+        'sll': '_mm_slli_epi32(%s, %u)',
+        'and': '_mm_and_si128(%s, %s)',
+        'or': '_mm_or_si128(%s, %s)',
+        # the values are in the low 16 bits of the lanes
+        'mul_ff': '_mm_mullo_epi16(%s, _mm_set1_epi32(0xff))',
+        'mul_div': '_mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(%s, _mm_set1_epi32(0xff)), _mm_set1_epi32(0x%x)), %u)',
+        'widen16_lo': '_mm_unpacklo_epi16(%s, _mm_setzero_si128())',
+        'widen16_hi': '_mm_unpackhi_epi16(%s, _mm_setzero_si128())',
+        # sign extend the low halves so that the pack doesn't saturate
+        'narrow16': '_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(%s, 16), 16), _mm_srai_epi32(_mm_slli_epi32(%s, 16), 16))',
+    },
+    {
+        'guard': 'defined(U_FORMAT_NEON)',
+        'type': 'uint32x4_t',
+        'type16': 'uint16x8_t',
+        'load': 'vld1q_u32((const uint32_t *)(%s))',
+        'load16': 'vld1q_u16((const uint16_t *)(%s))',
+        'store': 'vst1q_u32((uint32_t *)(%s), %s)',
+        'store16': 'vst1q_u16((uint16_t *)(%s), %s)',
+        'const': 'vdupq_n_u32(0x%x)',
+        'srl': 'vshrq_n_u32(%s, %u)',
+        'sll': 'vshlq_n_u32(%s, %u)',
+        'and': 'vandq_u32(%s, %s)',
+        'or': 'vorrq_u32(%s, %s)',
+        'mul_ff': 'vmulq_n_u32(%s, 0xff)',
+        'mul_div': 'vshrq_n_u32(vmulq_n_u32(vmulq_n_u32(%s, 0xff), 0x%x), 16 + %u)',
+        'widen16_lo': 'vmovl_u16(vget_low_u16(%s))',
+        'widen16_hi': 'vmovl_u16(vget_high_u16(%s))',
+        'narrow16': 'vcombine_u16(vmovn_u32(%s), vmovn_u32(%s))',
+    },
+]
+
+
+def has_simd_8unorm(format):
+    '''Whether the 8unorm unpack and pack of the format get SIMD kernels.'''
+
+    if not is_format_supported(format) or not format.is_bitmask():
+        return False
+    if format.block_size() not in (16, 32) or format.block_width != 1 or format.block_height != 1:
+        return False
+    # sRGB goes through the conversion tables
+    if format.colorspace != RGB:
+        return False
+
+    for channel in format.le_channels:
+        if channel.type == VOID:
+            continue
+        if channel.type != UNSIGNED or not channel.norm or channel.pure or channel.size > 8:
+            return False
+
+    return True
+
+
+def unorm_to_8unorm_magic(size):
+    '''Return the multiplier and the shift that give x * 0xff / (2^size - 1)
+    as (x * 0xff * m) >> (16 + s), exact for all the x of the channel.'''
+
+    d = (1 << size) - 1
+    for s in range(16):
+        m = ((1 << (16 + s)) + d - 1) // d
+        if m > 0xffff:
+            break
+        if all((x * 0xff * m) >> (16 + s) == x * 0xff // d for x in range(d + 1)):
+            return m, s
+    assert False
+
+
+def simd_move_bits(arch, value, src_shift, dst_shift, size):
+    '''Expression moving the size bits at src_shift of the lanes to dst_shift,
+    with the other bits cleared.'''
+
+    if src_shift > dst_shift:
+        expr = arch['srl'] % (value, src_shift - dst_shift)
+    elif src_shift < dst_shift:
+        expr = arch['sll'] % (value, dst_shift - src_shift)
+    else:
+        expr = value
+    if not (dst_shift == 0 and src_shift + size == 32) and \
+       not (src_shift == 0 and dst_shift + size == 32):
+        expr = arch['and'] % (expr, arch['const'] % (((1 << size) - 1) << dst_shift))
+    return expr
+
+
+def simd_or(arch, terms):
+    expr = terms[0]
+    for term in terms[1:]:
+        expr = arch['or'] % (expr, term)
+    return expr
+
+
+def simd_unpack_expr(arch, format, value):
+    '''Expression of the 4 rgba8 pixels from the 4 pixels of the lanes.'''
+
+    channels = format.le_channels
+    swizzles = format.le_swizzles
+
+    terms = []
+    ones = 0
+    for i in range(4):
+        swizzle = swizzles[i]
+        if swizzle < 4:
+            channel = channels[swizzle]
+            if channel.size == 8:
+                terms.append(simd_move_bits(arch, value, channel.shift, 8 * i, 8))
+                continue
+            term = simd_move_bits(arch, value, channel.shift, 0, channel.size)
+            if channel.size == 1:
+                term = arch['mul_ff'] % term
+            else:
+                term = arch['mul_div'] % ((term,) + unorm_to_8unorm_magic(channel.size))
+            if i:
+                term = arch['sll'] % (term, 8 * i)
+            terms.append(term)
+        elif swizzle == SWIZZLE_1:
+            ones |= 0xff << (8 * i)
+    if ones:
+        terms.append(arch['const'] % ones)
+    return simd_or(arch, terms)
+
+
+def simd_pack_expr(arch, format, value):
+    '''Expression of the 4 pixels of the lanes from the 4 rgba8 pixels.'''
+
+    channels = format.le_channels
+    inv_swizzle = inv_swizzles(format.le_swizzles)
+
+    terms = []
+    for i in range(4):
+        channel = channels[i]
+        if inv_swizzle[i] is None or channel.type == VOID:
+            continue
+        # keep the top bits of the 8 bit value
+        src_shift = 8 * inv_swizzle[i] + 8 - channel.size
+        terms.append(simd_move_bits(arch, value, src_shift, channel.shift, channel.size))
+    return simd_or(arch, terms)
+
+
+def generate_format_simd_8unorm(format, unpack):
+    '''Generate the SIMD kernel for a row of pixels, which returns the number
+    of pixels it did.'''
+
+    name = format.short_name()
+    bits = format.block_size()
+
+    print 'static inline unsigned'
+    print 'util_format_%s_%s_rgba_8unorm_simd(uint8_t *dst, const uint8_t *src, unsigned width)' % (name, 'unpack' if unpack else 'pack')
+    print '{'
+    print '   unsigned x = 0;'
+    for i, arch in enumerate(simd_archs):
+        print '#%s %s' % ('if' if i == 0 else 'elif', arch['guard'])
+        if bits == 32:
+            print '   for (; x + 4 <= width; x += 4) {'
+            print '      %s value = %s;' % (arch['type'], arch['load'] % 'src + x * 4')
+            if unpack:
+                expr = simd_unpack_expr(arch, format, 'value')
+            else:
+                expr = simd_pack_expr(arch, format, 'value')
+            print '      %s;' % (arch['store'] % ('dst + x * 4', expr))
+            print '   }'
+        elif unpack:
+            print '   for (; x + 8 <= width; x += 8) {'
+            print '      %s value = %s;' % (arch['type16'], arch['load16'] % 'src + x * 2')
+            print '      %s lo = %s;' % (arch['type'], arch['widen16_lo'] % 'value')
+            print '      %s hi = %s;' % (arch['type'], arch['widen16_hi'] % 'value')
+            print '      %s;' % (arch['store'] % ('dst + x * 4', simd_unpack_expr(arch, format, 'lo')))
+            print '      %s;' % (arch['store'] % ('dst + x * 4 + 16', simd_unpack_expr(arch, format, 'hi')))
+            print '   }'
+        else:
+            print '   for (; x + 8 <= width; x += 8) {'
+            print '      %s lo = %s;' % (arch['type'], arch['load'] % 'src + x * 4')
+            print '      %s hi = %s;' % (arch['type'], arch['load'] % 'src + x * 4 + 16')
+            print '      lo = %s;' % simd_pack_expr(arch, format, 'lo')
+            print '      hi = %s;' % simd_pack_expr(arch, format, 'hi')
+            print '      %s;' % (arch['store16'] % ('dst + x * 2', arch['narrow16'] % ('lo', 'hi')))
+            print '   }'
+    print '#endif'
+    print '   return x;'
+    print '}'
+    print
+
+
 def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
     '''Generate the function to unpack pixels from a particular format'''
 
     name = format.short_name()
+    simd = dst_suffix == 'rgba_8unorm' and has_simd_8unorm(format)
+
+    if simd:
+        generate_format_simd_8unorm(format, True)
 
     print 'static inline void'
     print 'util_format_%s_unpack_%s(%s *dst_row, unsigned dst_stride, const uint8_t *src_row, unsigned src_stride, unsigned width, unsigned height)' % (name, dst_suffix, dst_native_type)
@@ -624,7 +828,13 @@ def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
         print '   for(y = 0; y < height; y += %u) {' % (format.block_height,)
         print '      %s *dst = dst_row;' % (dst_native_type)
         print '      const uint8_t *src = src_row;'
-        print '      for(x = 0; x < width; x += %u) {' % (format.block_width,)
+        if simd:
+            print '      x = util_format_%s_unpack_rgba_8unorm_simd(dst, src, width);' % name
+            print '      dst += x * 4;'
+            print '      src += x * %u;' % (format.block_size() / 8,)
+            print '      for(; x < width; x += %u) {' % (format.block_width,)
+        else:
+            print '      for(x = 0; x < width; x += %u) {' % (format.block_width,)
         
         generate_unpack_kernel(format, dst_channel, dst_native_type)
     
@@ -643,6 +853,10 @@ def generate_format_pack(format, src_channel, src_native_type, src_suffix):
     '''Generate the function to pack pixels to a particular format'''
 
     name = format.short_name()
+    simd = src_suffix == 'rgba_8unorm' and has_simd_8unorm(format)
+
+    if simd:
+        generate_format_simd_8unorm(format, False)
 
     print 'static inline void'
     print 'util_format_%s_pack_%s(uint8_t *dst_row, unsigned dst_stride, const %s *src_row, unsigned src_stride, unsigned width, unsigned height)' % (name, src_suffix, src_native_type)
@@ -653,7 +867,13 @@ def generate_format_pack(format, src_channel, src_native_type, src_suffix):
         print '   for(y = 0; y < height; y += %u) {' % (format.block_height,)
         print '      const %s *src = src_row;' % (src_native_type)
         print '      uint8_t *dst = dst_row;'
-        print '      for(x = 0; x < width; x += %u) {' % (format.block_width,)
+        if simd:
+            print '      x = util_format_%s_pack_rgba_8unorm_simd(dst, src, width);' % name
+            print '      src += x * 4;'
+            print '      dst += x * %u;' % (format.block_size() / 8,)
+            print '      for(; x < width; x += %u) {' % (format.block_width,)
+        else:
+            print '      for(x = 0; x < width; x += %u) {' % (format.block_width,)
     
         generate_pack_kernel(format, src_channel, src_native_type)
             
@@ -699,6 +919,13 @@ def generate(formats):
     print '#include "u_format_yuv.h"'
     print '#include "u_format_zs.h"'
     print
+    print '#if defined(PIPE_ARCH_SSE)'
+    print '#include <emmintrin.h>'
+    print '#elif defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)'
+    print '#include <arm_neon.h>'
+    print '#define U_FORMAT_NEON'
+    print '#endif'
+    print
 
     for format in formats:
         if not is_format_hand_written(format):
@@ -30,6 +30,13 @@
 #include "u_math.h"
 #include "u_format_zs.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+#include <arm_neon.h>
+#define U_FORMAT_NEON
+#endif
+
 
 /*
  * z32_unorm conversion functions
@@ -381,7 +388,24 @@ util_format_z24_unorm_s8_uint_unpack_z_32unorm(uint32_t *dst_row, unsigned dst_s
    for(y = 0; y < height; ++y) {
       uint32_t *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
-      for(x = 0; x < width; ++x) {
+      x = 0;
+#if defined(PIPE_ARCH_SSE)
+      for(; x + 4 <= width; x += 4) {
+         __m128i z = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)src), 8);
+         _mm_storeu_si128((__m128i *)dst,
+                          _mm_or_si128(z, _mm_srli_epi32(z, 24)));
+         src += 4;
+         dst += 4;
+      }
+#elif defined(U_FORMAT_NEON)
+      for(; x + 4 <= width; x += 4) {
+         uint32x4_t z = vshlq_n_u32(vld1q_u32(src), 8);
+         vst1q_u32(dst, vorrq_u32(z, vshrq_n_u32(z, 24)));
+         src += 4;
+         dst += 4;
+      }
+#endif
+      for(; x < width; ++x) {
          uint32_t value = util_cpu_to_le32(*src++);
          *dst++ = z24_unorm_to_z32_unorm(value & 0xffffff);
       }
@@ -419,7 +443,26 @@ util_format_z24_unorm_s8_uint_unpack_s_8uint(uint8_t *dst_row, unsigned dst_stri
    for(y = 0; y < height; ++y) {
       uint8_t *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
-      for(x = 0; x < width; ++x) {
+      x = 0;
+#if defined(PIPE_ARCH_SSE)
+      for(; x + 8 <= width; x += 8) {
+         __m128i lo = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)src), 24);
+         __m128i hi = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)src + 1), 24);
+         __m128i s = _mm_packs_epi32(lo, hi);
+         _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(s, s));
+         src += 8;
+         dst += 8;
+      }
+#elif defined(U_FORMAT_NEON)
+      for(; x + 8 <= width; x += 8) {
+         uint16x4_t lo = vshrn_n_u32(vld1q_u32(src), 16);
+         uint16x4_t hi = vshrn_n_u32(vld1q_u32(src + 4), 16);
+         vst1_u8(dst, vshrn_n_u16(vcombine_u16(lo, hi), 8));
+         src += 8;
+         dst += 8;
+      }
+#endif
+      for(; x < width; ++x) {
          uint32_t value = util_cpu_to_le32(*src++);
          *dst++ = value >> 24;
       }
@@ -608,7 +651,24 @@ util_format_z24x8_unorm_unpack_z_32unorm(uint32_t *dst_row, unsigned dst_stride,
    for(y = 0; y < height; ++y) {
       uint32_t *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
-      for(x = 0; x < width; ++x) {
+      x = 0;
+#if defined(PIPE_ARCH_SSE)
+      for(; x + 4 <= width; x += 4) {
+         __m128i z = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)src), 8);
+         _mm_storeu_si128((__m128i *)dst,
+                          _mm_or_si128(z, _mm_srli_epi32(z, 24)));
+         src += 4;
+         dst += 4;
+      }
+#elif defined(U_FORMAT_NEON)
+      for(; x + 4 <= width; x += 4) {
+         uint32x4_t z = vshlq_n_u32(vld1q_u32(src), 8);
+         vst1q_u32(dst, vorrq_u32(z, vshrq_n_u32(z, 24)));
+         src += 4;
+         dst += 4;
+      }
+#endif
+      for(; x < width; ++x) {
          uint32_t value = util_cpu_to_le32(*src++);
          *dst++ = z24_unorm_to_z32_unorm(value & 0xffffff);
       }
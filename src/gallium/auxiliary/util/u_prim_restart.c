@@ -25,10 +25,16 @@
 
 
 
+#include "pipe/p_screen.h"
 #include "u_inlines.h"
+#include "u_math.h"
 #include "u_memory.h"
 #include "u_prim_restart.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
 
 /**
  * Translate an index buffer for primitive restart.
@@ -167,97 +173,274 @@ add_range(struct range_info *info, unsigned start, unsigned count)
 }
 
 
+/**
+ * Return the position of the first restart index of indices[i..count-1],
+ * count if there is none.
+ */
+#define FIND_RESTART(TYPE, SUFFIX, CMPEQ, SHIFT) \
+static unsigned \
+find_restart_##SUFFIX(const TYPE *indices, unsigned i, unsigned count, \
+                      TYPE restart) \
+{ \
+   SIMD_FIND_RESTART(TYPE, CMPEQ, SHIFT) \
+   for (; i < count; i++) { \
+      if (indices[i] == restart) \
+         break; \
+   } \
+   return i; \
+}
+
+#if defined(PIPE_ARCH_SSE)
+/* 16 bytes at a time, the compare mask has sizeof(TYPE) bits per index */
+#define SIMD_FIND_RESTART(TYPE, CMPEQ, SHIFT) \
+   const __m128i r = sizeof(TYPE) == 1 ? _mm_set1_epi8(restart) : \
+                     sizeof(TYPE) == 2 ? _mm_set1_epi16(restart) : \
+                                         _mm_set1_epi32(restart); \
+   for (; i + 16 / sizeof(TYPE) <= count; i += 16 / sizeof(TYPE)) { \
+      __m128i v = _mm_loadu_si128((const __m128i *)(indices + i)); \
+      unsigned mask = _mm_movemask_epi8(CMPEQ(v, r)); \
+      if (mask) \
+         return i + ((ffs(mask) - 1) >> SHIFT); \
+   }
+#else
+#define SIMD_FIND_RESTART(TYPE, CMPEQ, SHIFT)
+#endif
+
+FIND_RESTART(uint8_t, ubyte, _mm_cmpeq_epi8, 0)
+FIND_RESTART(uint16_t, ushort, _mm_cmpeq_epi16, 1)
+FIND_RESTART(uint32_t, uint, _mm_cmpeq_epi32, 2)
+
+
+/**
+ * Fill ranges with the runs of indices between the restart indexes.
+ * \return true for success, false if out of memory
+ */
+static boolean
+scan_ranges(const struct pipe_draw_info *info, const void *src_map,
+            struct range_info *ranges)
+{
+   const unsigned count = info->count;
+   unsigned start = 0;
+
+   /* a restart index no index can be equal to never cuts */
+   if (info->index_size < 4 &&
+       info->restart_index >> (info->index_size * 8))
+      return count ? add_range(ranges, info->start, count) : TRUE;
+
+   while (start < count) {
+      unsigned end;
+
+      switch (info->index_size) {
+      case 1:
+         end = find_restart_ubyte(src_map, start, count,
+                                  info->restart_index);
+         break;
+      case 2:
+         end = find_restart_ushort(src_map, start, count,
+                                   info->restart_index);
+         break;
+      default:
+         end = find_restart_uint(src_map, start, count,
+                                 info->restart_index);
+         break;
+      }
+
+      if (end > start && !add_range(ranges, info->start + start, end - start))
+         return FALSE;
+      start = end + 1;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * The runs of indices of draws from static index buffers are kept, the
+ * scan is only done again when the buffer is written. This needs the
+ * screen to implement buffer_get_write_serial.
+ */
+#define U_PRIM_RESTART_CACHE_SIZE 8
+
+struct util_prim_restart_cache {
+   struct {
+      struct pipe_resource *resource;
+      unsigned serial;
+      unsigned index_size;
+      unsigned start, count;
+      unsigned restart_index;
+      struct range_info ranges;
+   } entries[U_PRIM_RESTART_CACHE_SIZE];
+   unsigned next_entry;
+};
+
+
+struct util_prim_restart_cache *
+util_prim_restart_cache_create(void)
+{
+   return CALLOC_STRUCT(util_prim_restart_cache);
+}
+
+
+void
+util_prim_restart_cache_destroy(struct util_prim_restart_cache *cache)
+{
+   unsigned i;
+
+   if (!cache)
+      return;
+
+   for (i = 0; i < U_PRIM_RESTART_CACHE_SIZE; i++) {
+      pipe_resource_reference(&cache->entries[i].resource, NULL);
+      FREE(cache->entries[i].ranges.ranges);
+   }
+   FREE(cache);
+}
+
+
+static const struct range_info *
+cache_find(struct util_prim_restart_cache *cache,
+           const struct pipe_draw_info *info, unsigned serial)
+{
+   unsigned i;
+
+   for (i = 0; i < U_PRIM_RESTART_CACHE_SIZE; i++) {
+      if (cache->entries[i].resource == info->index.resource &&
+          cache->entries[i].serial == serial &&
+          cache->entries[i].index_size == info->index_size &&
+          cache->entries[i].start == info->start &&
+          cache->entries[i].count == info->count &&
+          cache->entries[i].restart_index == info->restart_index)
+         return &cache->entries[i].ranges;
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Keep the ranges in place of the oldest entry, which takes them over.
+ * The entry holds a reference to the index buffer, so that its address
+ * isn't reused by another buffer.
+ */
+static void
+cache_add(struct util_prim_restart_cache *cache,
+          const struct pipe_draw_info *info, unsigned serial,
+          struct range_info *ranges)
+{
+   unsigned e = cache->next_entry;
+
+   cache->next_entry = (e + 1) % U_PRIM_RESTART_CACHE_SIZE;
+
+   pipe_resource_reference(&cache->entries[e].resource, info->index.resource);
+   cache->entries[e].serial = serial;
+   cache->entries[e].index_size = info->index_size;
+   cache->entries[e].start = info->start;
+   cache->entries[e].count = info->count;
+   cache->entries[e].restart_index = info->restart_index;
+   FREE(cache->entries[e].ranges.ranges);
+   cache->entries[e].ranges = *ranges;
+
+   memset(ranges, 0, sizeof(*ranges));
+}
+
+
 /**
  * Implement primitive restart by breaking an indexed primitive into
  * pieces which do not contain restart indexes.  Each piece is then
  * drawn by calling pipe_context::draw_vbo().
+ * If cache isn't NULL, the pieces of draws from index buffers are
+ * remembered there for later draws of the same unchanged indices.
  * \return PIPE_OK if no error, an error code otherwise.
  */
 enum pipe_error
-util_draw_vbo_without_prim_restart(struct pipe_context *context,
-                                   const struct pipe_draw_info *info)
+util_draw_vbo_without_prim_restart_cached(struct pipe_context *context,
+                                          struct util_prim_restart_cache *cache,
+                                          const struct pipe_draw_info *info)
 {
+   struct pipe_screen *screen = context->screen;
    const void *src_map;
-   struct range_info ranges = {0};
+   struct range_info scanned = {0};
+   const struct range_info *ranges = NULL;
    struct pipe_draw_info new_info;
    struct pipe_transfer *src_transfer = NULL;
-   unsigned i, start, count;
+   unsigned serial = 0;
+   unsigned i;
 
    assert(info->index_size);
    assert(info->primitive_restart);
 
-   /* Get pointer to the index data */
-   if (!info->has_user_indices) {
-      /* map the index buffer (only the range we need to scan) */
-      src_map = pipe_buffer_map_range(context, info->index.resource,
-                                      info->start * info->index_size,
-                                      info->count * info->index_size,
-                                      PIPE_TRANSFER_READ,
-                                      &src_transfer);
-      if (!src_map) {
-         return PIPE_ERROR_OUT_OF_MEMORY;
-      }
-   }
-   else {
-      if (!info->index.user) {
-         debug_printf("User-space index buffer is null!");
-         return PIPE_ERROR_BAD_INPUT;
-      }
-      src_map = (const uint8_t *) info->index.user
-         + info->start * info->index_size;
+   if (info->index_size != 1 && info->index_size != 2 &&
+       info->index_size != 4) {
+      assert(!"Bad index size");
+      return PIPE_ERROR_BAD_INPUT;
    }
 
-#define SCAN_INDEXES(TYPE) \
-   for (i = 0; i <= info->count; i++) { \
-      if (i == info->count || \
-          ((const TYPE *) src_map)[i] == info->restart_index) { \
-         /* cut / restart */ \
-         if (count > 0) { \
-            if (!add_range(&ranges, info->start + start, count)) { \
-               if (src_transfer) \
-                  pipe_buffer_unmap(context, src_transfer); \
-               return PIPE_ERROR_OUT_OF_MEMORY; \
-            } \
-         } \
-         start = i + 1; \
-         count = 0; \
-      } \
-      else { \
-         count++; \
-      } \
-   }
+   if (info->has_user_indices || !screen->buffer_get_write_serial)
+      cache = NULL;
 
-   start = 0;
-   count = 0;
-   switch (info->index_size) {
-   case 1:
-      SCAN_INDEXES(uint8_t);
-      break;
-   case 2:
-      SCAN_INDEXES(uint16_t);
-      break;
-   case 4:
-      SCAN_INDEXES(uint32_t);
-      break;
-   default:
-      assert(!"Bad index size");
-      return PIPE_ERROR_BAD_INPUT;
+   if (cache) {
+      serial = screen->buffer_get_write_serial(screen, info->index.resource);
+      ranges = cache_find(cache, info, serial);
    }
 
-   /* unmap index buffer */
-   if (src_transfer)
-      pipe_buffer_unmap(context, src_transfer);
+   if (!ranges) {
+      /* Get pointer to the index data */
+      if (!info->has_user_indices) {
+         /* map the index buffer (only the range we need to scan) */
+         src_map = pipe_buffer_map_range(context, info->index.resource,
+                                         info->start * info->index_size,
+                                         info->count * info->index_size,
+                                         PIPE_TRANSFER_READ,
+                                         &src_transfer);
+         if (!src_map) {
+            return PIPE_ERROR_OUT_OF_MEMORY;
+         }
+      }
+      else {
+         if (!info->index.user) {
+            debug_printf("User-space index buffer is null!");
+            return PIPE_ERROR_BAD_INPUT;
+         }
+         src_map = (const uint8_t *) info->index.user
+            + info->start * info->index_size;
+      }
+
+      if (!scan_ranges(info, src_map, &scanned)) {
+         if (src_transfer)
+            pipe_buffer_unmap(context, src_transfer);
+         FREE(scanned.ranges);
+         return PIPE_ERROR_OUT_OF_MEMORY;
+      }
+
+      /* unmap index buffer */
+      if (src_transfer)
+         pipe_buffer_unmap(context, src_transfer);
+
+      ranges = &scanned;
+      if (cache) {
+         cache_add(cache, info, serial, &scanned);
+         ranges = cache_find(cache, info, serial);
+      }
+   }
 
    /* draw ranges between the restart indexes */
    new_info = *info;
    new_info.primitive_restart = FALSE;
-   for (i = 0; i < ranges.count; i++) {
-      new_info.start = ranges.ranges[i].start;
-      new_info.count = ranges.ranges[i].count;
+   for (i = 0; i < ranges->count; i++) {
+      new_info.start = ranges->ranges[i].start;
+      new_info.count = ranges->ranges[i].count;
       context->draw_vbo(context, &new_info);
    }
 
-   FREE(ranges.ranges);
+   FREE(scanned.ranges);
 
    return PIPE_OK;
 }
+
+
+enum pipe_error
+util_draw_vbo_without_prim_restart(struct pipe_context *context,
+                                   const struct pipe_draw_info *info)
+{
+   return util_draw_vbo_without_prim_restart_cached(context, NULL, info);
+}
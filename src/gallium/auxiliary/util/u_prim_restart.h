@@ -40,6 +40,7 @@ struct pipe_context;
 struct pipe_draw_info;
 union pipe_index_binding;
 struct pipe_resource;
+struct util_prim_restart_cache;
 
 
 enum pipe_error
@@ -51,6 +52,17 @@ enum pipe_error
 util_draw_vbo_without_prim_restart(struct pipe_context *context,
                                    const struct pipe_draw_info *info);
 
+struct util_prim_restart_cache *
+util_prim_restart_cache_create(void);
+
+void
+util_prim_restart_cache_destroy(struct util_prim_restart_cache *cache);
+
+enum pipe_error
+util_draw_vbo_without_prim_restart_cached(struct pipe_context *context,
+                                          struct util_prim_restart_cache *cache,
+                                          const struct pipe_draw_info *info);
+
 
 #ifdef __cplusplus
 }
@@ -26,17 +26,35 @@
  * 
  **************************************************************************/
 
-/* A simple allocator that suballocates memory from a large buffer. */
+/* A simple allocator that suballocates memory from a large buffer.
+ *
+ * Allocations are bumped out of a buffer ("slab") per size class, so that
+ * small allocations don't leave the big ones with the tail of a slab. With
+ * recycling enabled, full slabs wait in a reclaim list until the fence of
+ * the flush after they got full has signalled, like the entries of pb_slab,
+ * and are then allocated from again.
+ */
 
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
 #include "pipe/p_context.h"
+#include "pipe/p_screen.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/list.h"
 
 #include "u_suballoc.h"
 
 
+/* Allocations up to size >> 6, up to size >> 3 and the rest. */
+#define U_SUBALLOC_NUM_CLASSES 3
+
+struct u_suballoc_slab {
+   struct list_head head;
+   struct pipe_resource *buffer;
+   struct pipe_fence_handle *fence; /* Of a flush after it got full. */
+};
+
 struct u_suballocator {
    struct pipe_context *pipe;
 
@@ -46,8 +64,14 @@ struct u_suballocator {
    unsigned flags;         /* bitmask of PIPE_RESOURCE_FLAG_x */
    boolean zero_buffer_memory; /* If the buffer contents should be zeroed. */
 
-   struct pipe_resource *buffer;   /* The buffer we suballocate from. */
-   unsigned offset; /* Aligned offset pointing at the first unused byte. */
+   struct {
+      struct pipe_resource *buffer;   /* The buffer we suballocate from. */
+      unsigned offset; /* Aligned offset pointing at the first unused byte. */
+   } classes[U_SUBALLOC_NUM_CLASSES];
+
+   unsigned max_slabs;     /* Full slabs kept for recycling, 0 if disabled. */
+   unsigned num_slabs;
+   struct list_head reclaim; /* Full slabs, the oldest first. */
 };
 
 
@@ -74,50 +98,185 @@ u_suballocator_create(struct pipe_context *pipe, unsigned size, unsigned bind,
    allocator->usage = usage;
    allocator->flags = flags;
    allocator->zero_buffer_memory = zero_buffer_memory;
+   list_inithead(&allocator->reclaim);
    return allocator;
 }
 
+static void
+u_suballoc_slab_free(struct u_suballocator *allocator,
+                     struct u_suballoc_slab *slab)
+{
+   struct pipe_screen *screen = allocator->pipe->screen;
+
+   list_del(&slab->head);
+   allocator->num_slabs--;
+   pipe_resource_reference(&slab->buffer, NULL);
+   screen->fence_reference(screen, &slab->fence, NULL);
+   FREE(slab);
+}
+
 void
 u_suballocator_destroy(struct u_suballocator *allocator)
 {
-   pipe_resource_reference(&allocator->buffer, NULL);
+   for (unsigned i = 0; i < U_SUBALLOC_NUM_CLASSES; i++)
+      pipe_resource_reference(&allocator->classes[i].buffer, NULL);
+
+   list_for_each_entry_safe(struct u_suballoc_slab, slab,
+                            &allocator->reclaim, head)
+      u_suballoc_slab_free(allocator, slab);
+
    FREE(allocator);
 }
 
+void
+u_suballocator_enable_recycling(struct u_suballocator *allocator,
+                                unsigned max_slabs)
+{
+   allocator->max_slabs = max_slabs;
+
+   while (allocator->num_slabs > max_slabs) {
+      u_suballoc_slab_free(allocator,
+                           LIST_ENTRY(struct u_suballoc_slab,
+                                      allocator->reclaim.next, head));
+   }
+}
+
+boolean
+u_suballocator_needs_fence(struct u_suballocator *allocator)
+{
+   /* the slabs after the last one were tagged earlier */
+   return !LIST_IS_EMPTY(&allocator->reclaim) &&
+          !LIST_ENTRY(struct u_suballoc_slab,
+                      allocator->reclaim.prev, head)->fence;
+}
+
+void
+u_suballocator_fence(struct u_suballocator *allocator,
+                     struct pipe_fence_handle *fence)
+{
+   struct pipe_screen *screen = allocator->pipe->screen;
+
+   list_for_each_entry_rev(struct u_suballoc_slab, slab,
+                           &allocator->reclaim, head) {
+      if (slab->fence)
+         break;
+      screen->fence_reference(screen, &slab->fence, fence);
+   }
+}
+
+/* Move a full buffer to the reclaim list, dropping the oldest slab if
+ * there are too many.
+ */
+static void
+u_suballoc_retire(struct u_suballocator *allocator,
+                  struct pipe_resource **buffer)
+{
+   struct u_suballoc_slab *slab;
+
+   if (!allocator->max_slabs || !*buffer) {
+      pipe_resource_reference(buffer, NULL);
+      return;
+   }
+
+   if (allocator->num_slabs == allocator->max_slabs) {
+      u_suballoc_slab_free(allocator,
+                           LIST_ENTRY(struct u_suballoc_slab,
+                                      allocator->reclaim.next, head));
+   }
+
+   slab = CALLOC_STRUCT(u_suballoc_slab);
+   if (!slab) {
+      pipe_resource_reference(buffer, NULL);
+      return;
+   }
+
+   /* take over the reference */
+   slab->buffer = *buffer;
+   *buffer = NULL;
+   list_addtail(&slab->head, &allocator->reclaim);
+   allocator->num_slabs++;
+}
+
+/* Return the buffer of the oldest slab the GPU is done with, or NULL. */
+static struct pipe_resource *
+u_suballoc_reclaim(struct u_suballocator *allocator)
+{
+   struct pipe_screen *screen = allocator->pipe->screen;
+
+   list_for_each_entry_safe(struct u_suballoc_slab, slab,
+                            &allocator->reclaim, head) {
+      struct pipe_resource *buffer = NULL;
+
+      /* the slabs after it were tagged later, they aren't idle either */
+      if (!slab->fence || !screen->fence_finish(screen, NULL, slab->fence, 0))
+         return NULL;
+
+      /* the outstanding allocations may still be used by later draws */
+      if (p_atomic_read(&slab->buffer->reference.count) > 1)
+         continue;
+
+      pipe_resource_reference(&buffer, slab->buffer);
+      u_suballoc_slab_free(allocator, slab);
+      return buffer;
+   }
+
+   return NULL;
+}
+
+static unsigned
+u_suballoc_class(struct u_suballocator *allocator, unsigned size)
+{
+   if (size <= allocator->size >> 6)
+      return 0;
+   if (size <= allocator->size >> 3)
+      return 1;
+   return 2;
+}
+
 void
 u_suballocator_alloc(struct u_suballocator *allocator, unsigned size,
                      unsigned alignment, unsigned *out_offset,
                      struct pipe_resource **outbuf)
 {
-   allocator->offset = align(allocator->offset, alignment);
-
    /* Don't allow allocations larger than the buffer size. */
    if (size > allocator->size)
       goto fail;
 
+   unsigned index = u_suballoc_class(allocator, size);
+   struct pipe_resource **buffer = &allocator->classes[index].buffer;
+   unsigned *offset = &allocator->classes[index].offset;
+
+   *offset = align(*offset, alignment);
+
    /* Make sure we have enough space in the buffer. */
-   if (!allocator->buffer ||
-       allocator->offset + size > allocator->size) {
-      /* Allocate a new buffer. */
-      pipe_resource_reference(&allocator->buffer, NULL);
-      allocator->offset = 0;
-
-      struct pipe_resource templ;
-      memset(&templ, 0, sizeof(templ));
-      templ.target = PIPE_BUFFER;
-      templ.format = PIPE_FORMAT_R8_UNORM;
-      templ.bind = allocator->bind;
-      templ.usage = allocator->usage;
-      templ.flags = allocator->flags;
-      templ.width0 = allocator->size;
-      templ.height0 = 1;
-      templ.depth0 = 1;
-      templ.array_size = 1;
-
-      struct pipe_screen *screen = allocator->pipe->screen;
-      allocator->buffer = screen->resource_create(screen, &templ);
-      if (!allocator->buffer)
-         goto fail;
+   if (!*buffer || *offset + size > allocator->size) {
+      /* Reuse a drained buffer, or allocate a new one. Reclaim first, the
+       * retired buffer could push the drained one out.
+       */
+      struct pipe_resource *reclaimed = u_suballoc_reclaim(allocator);
+
+      u_suballoc_retire(allocator, buffer);
+      *buffer = reclaimed;
+      *offset = 0;
+
+      if (!*buffer) {
+         struct pipe_resource templ;
+         memset(&templ, 0, sizeof(templ));
+         templ.target = PIPE_BUFFER;
+         templ.format = PIPE_FORMAT_R8_UNORM;
+         templ.bind = allocator->bind;
+         templ.usage = allocator->usage;
+         templ.flags = allocator->flags;
+         templ.width0 = allocator->size;
+         templ.height0 = 1;
+         templ.depth0 = 1;
+         templ.array_size = 1;
+
+         struct pipe_screen *screen = allocator->pipe->screen;
+         *buffer = screen->resource_create(screen, &templ);
+         if (!*buffer)
+            goto fail;
+      }
 
       /* Clear the memory if needed. */
       if (allocator->zero_buffer_memory) {
@@ -126,11 +285,11 @@ u_suballocator_alloc(struct u_suballocator *allocator, unsigned size,
          if (pipe->clear_buffer) {
             unsigned clear_value = 0;
 
-            pipe->clear_buffer(pipe, allocator->buffer, 0, allocator->size,
+            pipe->clear_buffer(pipe, *buffer, 0, allocator->size,
                                &clear_value, 4);
          } else {
             struct pipe_transfer *transfer = NULL;
-            void *ptr = pipe_buffer_map(pipe, allocator->buffer,
+            void *ptr = pipe_buffer_map(pipe, *buffer,
                                         PIPE_TRANSFER_WRITE, &transfer);
             memset(ptr, 0, allocator->size);
             pipe_buffer_unmap(pipe, transfer);
@@ -138,15 +297,15 @@ u_suballocator_alloc(struct u_suballocator *allocator, unsigned size,
       }
    }
 
-   assert(allocator->offset % alignment == 0);
-   assert(allocator->offset < allocator->buffer->width0);
-   assert(allocator->offset + size <= allocator->buffer->width0);
+   assert(*offset % alignment == 0);
+   assert(*offset < (*buffer)->width0);
+   assert(*offset + size <= (*buffer)->width0);
 
    /* Return the buffer. */
-   *out_offset = allocator->offset;
-   pipe_resource_reference(outbuf, allocator->buffer);
+   *out_offset = *offset;
+   pipe_resource_reference(outbuf, *buffer);
 
-   allocator->offset += size;
+   *offset += size;
    return;
 
 fail:
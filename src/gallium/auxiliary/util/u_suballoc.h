@@ -32,6 +32,7 @@
 #define U_SUBALLOC
 
 struct u_suballocator;
+struct pipe_fence_handle;
 
 struct u_suballocator *
 u_suballocator_create(struct pipe_context *pipe, unsigned size, unsigned bind,
@@ -46,4 +47,32 @@ u_suballocator_alloc(struct u_suballocator *allocator, unsigned size,
                      unsigned alignment, unsigned *out_offset,
                      struct pipe_resource **outbuf);
 
+/**
+ * Keep up to max_slabs full buffers around, and allocate from the oldest
+ * one the GPU is done with instead of creating a new buffer.
+ *
+ * The suballocator doesn't know when the GPU is done with a buffer, the
+ * driver has to pass the fence of its flushes with u_suballocator_fence().
+ * A full buffer is reused once the fence of a flush after it got full has
+ * signalled and no allocation from it is referenced anymore.
+ */
+void
+u_suballocator_enable_recycling(struct u_suballocator *allocator,
+                                unsigned max_slabs);
+
+/**
+ * Whether some full buffers wait for the fence of a flush, so that drivers
+ * only create a fence when it's needed.
+ */
+boolean
+u_suballocator_needs_fence(struct u_suballocator *allocator);
+
+/**
+ * Tag the full buffers not tagged yet with the fence of a flush, which
+ * covers all their uses.
+ */
+void
+u_suballocator_fence(struct u_suballocator *allocator,
+                     struct pipe_fence_handle *fence);
+
 #endif
@@ -30,6 +30,7 @@
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 #include "util/u_upload_mgr.h"
+#include "util/bitset.h"
 
 /* 0 = disabled, 1 = assertions, 2 = printfs */
 #define TC_DEBUG 0
@@ -63,6 +64,12 @@ typedef void (*tc_execute)(struct pipe_context *pipe, union tc_payload *payload)
 
 static const tc_execute execute_func[TC_NUM_CALLS];
 
+static void
+tc_batch_coalesce(struct tc_batch *batch, BITSET_WORD *skip);
+
+static void
+tc_release_call(struct tc_call *call);
+
 static void
 tc_batch_check(MAYBE_UNUSED struct tc_batch *batch)
 {
@@ -85,15 +92,35 @@ tc_batch_execute(void *job, UNUSED int thread_index)
    struct tc_batch *batch = job;
    struct pipe_context *pipe = batch->pipe;
    struct tc_call *last = &batch->call[batch->num_total_call_slots];
+   BITSET_DECLARE(skip, TC_CALLS_PER_BATCH);
 
    tc_batch_check(batch);
 
    assert(!batch->token);
 
-   for (struct tc_call *iter = batch->call; iter != last;
-        iter += iter->num_call_slots) {
-      tc_assert(iter->sentinel == TC_SENTINEL);
-      execute_func[iter->call_id](pipe, &iter->payload);
+   if (!batch->tc->coalesce_calls) {
+      for (struct tc_call *iter = batch->call; iter != last;
+           iter += iter->num_call_slots) {
+         tc_assert(iter->sentinel == TC_SENTINEL);
+         execute_func[iter->call_id](pipe, &iter->payload);
+      }
+   } else {
+      BITSET_ZERO(skip);
+      batch->num_merged_draws = 0;
+      batch->num_dropped_calls = 0;
+      tc_batch_coalesce(batch, skip);
+
+      for (struct tc_call *iter = batch->call; iter != last;
+           iter += iter->num_call_slots) {
+         tc_assert(iter->sentinel == TC_SENTINEL);
+         if (BITSET_TEST(skip, iter - batch->call))
+            tc_release_call(iter);
+         else
+            execute_func[iter->call_id](pipe, &iter->payload);
+      }
+
+      p_atomic_add(&batch->tc->num_merged_draws, batch->num_merged_draws);
+      p_atomic_add(&batch->tc->num_dropped_calls, batch->num_dropped_calls);
    }
 
    tc_batch_check(batch);
@@ -2082,6 +2109,172 @@ tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info)
    }
 }
 
+/********************************************************************
+ * call coalescing
+ */
+
+/* Calls that set state the draws read, and don't read constant buffers.
+ * A constant buffer set before one of them and set again after it was
+ * never used.
+ */
+static bool
+tc_call_is_state(enum tc_call_id id)
+{
+   switch (id) {
+   case TC_CALL_bind_blend_state:
+   case TC_CALL_bind_rasterizer_state:
+   case TC_CALL_bind_depth_stencil_alpha_state:
+   case TC_CALL_bind_compute_state:
+   case TC_CALL_bind_fs_state:
+   case TC_CALL_bind_vs_state:
+   case TC_CALL_bind_gs_state:
+   case TC_CALL_bind_tcs_state:
+   case TC_CALL_bind_tes_state:
+   case TC_CALL_bind_vertex_elements_state:
+   case TC_CALL_bind_sampler_states:
+   case TC_CALL_set_constant_buffer:
+   case TC_CALL_set_scissor_states:
+   case TC_CALL_set_viewport_states:
+   case TC_CALL_set_sampler_views:
+   case TC_CALL_set_vertex_buffers:
+   case TC_CALL_set_blend_color:
+   case TC_CALL_set_stencil_ref:
+   case TC_CALL_set_clip_state:
+   case TC_CALL_set_sample_mask:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* Whether a draw can be appended to another one: both must be single
+ * instance, non-indexed and direct, and the first one must end on a
+ * whole primitive of a list.
+ */
+static bool
+tc_draw_can_merge(const struct pipe_draw_info *a,
+                  const struct pipe_draw_info *b)
+{
+   unsigned verts;
+
+   if (a->index_size || a->indirect || a->count_from_stream_output ||
+       b->index_size || b->indirect || b->count_from_stream_output)
+      return false;
+
+   if (a->mode != b->mode || a->instance_count != 1 ||
+       b->instance_count != 1 || a->start_instance != b->start_instance ||
+       a->drawid != b->drawid || a->start + a->count != b->start)
+      return false;
+
+   switch (a->mode) {
+   case PIPE_PRIM_POINTS:
+      verts = 1;
+      break;
+   case PIPE_PRIM_LINES:
+      verts = 2;
+      break;
+   case PIPE_PRIM_TRIANGLES:
+      verts = 3;
+      break;
+   default:
+      return false;
+   }
+
+   return a->count % verts == 0;
+}
+
+/* Look for the calls of the batch that don't change what gets drawn and
+ * mark them in skip:
+ *  - binds of the CSO the driver has bound already,
+ *  - constant buffer sets overridden before a call uses them,
+ *  - draws appended to the previous draw, which gets their vertices.
+ *
+ * The bound CSOs are tracked across batches, they are only touched by the
+ * thread executing the batches.
+ */
+static void
+tc_batch_coalesce(struct tc_batch *batch, BITSET_WORD *skip)
+{
+   struct threaded_context *tc = batch->tc;
+   struct tc_call *last = &batch->call[batch->num_total_call_slots];
+   struct pipe_draw_info *draw = NULL;
+   /* the pending set of each constant buffer slot, valid if its generation
+    * is the current one */
+   ushort cb_call[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
+   ushort cb_gen[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
+   ushort gen = 1;
+
+   memset(cb_gen, 0, sizeof(cb_gen));
+
+   for (struct tc_call *iter = batch->call; iter != last;
+        iter += iter->num_call_slots) {
+      unsigned index = iter - batch->call;
+      enum tc_call_id id = iter->call_id;
+
+      if (id >= TC_CALL_bind_blend_state &&
+          id <= TC_CALL_bind_vertex_elements_state) {
+         unsigned cso = id - TC_CALL_bind_blend_state;
+         void *state = *(void **)&iter->payload;
+
+         if (tc->bound_cso_valid & (1u << cso) &&
+             tc->bound_cso[cso] == state) {
+            BITSET_SET(skip, index);
+            batch->num_dropped_calls++;
+            continue;
+         }
+         tc->bound_cso[cso] = state;
+         tc->bound_cso_valid |= 1u << cso;
+      } else if (id >= TC_CALL_delete_blend_state &&
+                 id <= TC_CALL_delete_vertex_elements_state) {
+         unsigned cso = id - TC_CALL_delete_blend_state;
+
+         /* a new CSO could get the same address */
+         if (tc->bound_cso[cso] == *(void **)&iter->payload)
+            tc->bound_cso_valid &= ~(1u << cso);
+      } else if (id == TC_CALL_set_constant_buffer) {
+         struct tc_constant_buffer *p =
+            (struct tc_constant_buffer *)&iter->payload;
+
+         if (cb_gen[p->shader][p->index] == gen) {
+            BITSET_SET(skip, cb_call[p->shader][p->index]);
+            batch->num_dropped_calls++;
+         }
+         cb_call[p->shader][p->index] = index;
+         cb_gen[p->shader][p->index] = gen;
+      } else if (id == TC_CALL_draw_vbo) {
+         struct pipe_draw_info *info = (struct pipe_draw_info *)&iter->payload;
+
+         if (draw && tc_draw_can_merge(draw, info)) {
+            draw->count += info->count;
+            draw->min_index = MIN2(draw->min_index, info->min_index);
+            draw->max_index = MAX2(draw->max_index, info->max_index);
+            BITSET_SET(skip, index);
+            batch->num_merged_draws++;
+            continue;
+         }
+         draw = info;
+      }
+
+      if (!tc_call_is_state(id))
+         gen++;
+      /* only calls skipped above keep the draws mergeable */
+      if (id != TC_CALL_draw_vbo)
+         draw = NULL;
+   }
+}
+
+/* Release what a skipped call holds. */
+static void
+tc_release_call(struct tc_call *call)
+{
+   if (call->call_id == TC_CALL_set_constant_buffer) {
+      struct tc_constant_buffer *p =
+         (struct tc_constant_buffer *)&call->payload;
+      pipe_resource_reference(&p->cb.buffer, NULL);
+   }
+   /* merged draws and binds don't hold references */
+}
+
 static void
 tc_call_launch_grid(struct pipe_context *pipe, union tc_payload *payload)
 {
@@ -2517,6 +2710,12 @@ threaded_context_create(struct pipe_context *pipe,
 
    STATIC_ASSERT(sizeof(union tc_payload) <= 8);
    STATIC_ASSERT(sizeof(struct tc_call) <= 16);
+   STATIC_ASSERT(TC_CALL_bind_vertex_elements_state -
+                 TC_CALL_bind_blend_state + 1 == TC_NUM_BIND_CSO_CALLS);
+   STATIC_ASSERT(TC_CALL_delete_vertex_elements_state -
+                 TC_CALL_delete_blend_state ==
+                 TC_CALL_bind_vertex_elements_state -
+                 TC_CALL_bind_blend_state);
 
    if (!pipe)
       return NULL;
@@ -2572,6 +2771,7 @@ threaded_context_create(struct pipe_context *pipe,
    for (unsigned i = 0; i < TC_MAX_BATCHES; i++) {
       tc->batch_slots[i].sentinel = TC_SENTINEL;
       tc->batch_slots[i].pipe = pipe;
+      tc->batch_slots[i].tc = tc;
       util_queue_fence_init(&tc->batch_slots[i].fence);
    }
 
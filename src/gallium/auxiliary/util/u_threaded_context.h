@@ -222,6 +222,9 @@ struct tc_unflushed_batch_token;
  */
 #define TC_CALLS_PER_BATCH    192
 
+/* The bind_*_state calls of CSOs, blend to vertex elements. */
+#define TC_NUM_BIND_CSO_CALLS 10
+
 /* Threshold for when to use the queue or sync. */
 #define TC_MAX_STRING_MARKER_BYTES  512
 
@@ -341,7 +344,11 @@ struct tc_batch {
    struct pipe_context *pipe;
    unsigned sentinel;
    unsigned num_total_call_slots;
+   struct threaded_context *tc;
    struct tc_unflushed_batch_token *token;
+   /* What coalescing removed from the batch when it was executed. */
+   unsigned num_merged_draws;
+   unsigned num_dropped_calls;
    struct util_queue_fence fence;
    struct tc_call call[TC_CALLS_PER_BATCH];
 };
@@ -360,6 +367,22 @@ struct threaded_context {
    unsigned num_offloaded_slots;
    unsigned num_direct_slots;
    unsigned num_syncs;
+   unsigned num_merged_draws;
+   unsigned num_dropped_calls;
+
+   /* Set by the driver after creating the context to drop the binds of the
+    * bound CSOs and the unused constant buffer sets of the batches, and to
+    * merge consecutive non-indexed draws of contiguous vertex ranges.
+    * The primitive IDs don't restart at the draws merged into another one,
+    * so drivers supporting them must not enable it.
+    */
+   bool coalesce_calls;
+
+   /* The CSOs bound by the executed batches, in the order of their bind
+    * calls. Only used by the thread executing the batches.
+    */
+   void *bound_cso[TC_NUM_BIND_CSO_CALLS];
+   unsigned bound_cso_valid;
 
    struct util_queue queue;
    struct util_queue_fence *fence;
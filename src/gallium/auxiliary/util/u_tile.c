@@ -40,6 +40,13 @@
 #include "util/u_surface.h"
 #include "util/u_tile.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+#include <arm_neon.h>
+#define U_TILE_NEON
+#endif
+
 
 /**
  * Move raw block of pixels from transfer object to user memory.
@@ -163,7 +170,24 @@ s8z24_get_tile_rgba(const unsigned *src,
 
    for (i = 0; i < h; i++) {
       float *pRow = p;
-      for (j = 0; j < w; j++, pRow += 4) {
+      j = 0;
+#if defined(PIPE_ARCH_SSE)
+      /* in doubles for the same rounding as the scalar code */
+      for (; j + 4 <= w; j += 4, pRow += 16) {
+         __m128i z = _mm_and_si128(_mm_loadu_si128((const __m128i *)src),
+                                   _mm_set1_epi32(0xffffff));
+         __m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(z), _mm_set1_pd(scale));
+         __m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(z, 8)),
+                                 _mm_set1_pd(scale));
+         __m128 zf = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+         _mm_storeu_ps(pRow, _mm_shuffle_ps(zf, zf, _MM_SHUFFLE(0, 0, 0, 0)));
+         _mm_storeu_ps(pRow + 4, _mm_shuffle_ps(zf, zf, _MM_SHUFFLE(1, 1, 1, 1)));
+         _mm_storeu_ps(pRow + 8, _mm_shuffle_ps(zf, zf, _MM_SHUFFLE(2, 2, 2, 2)));
+         _mm_storeu_ps(pRow + 12, _mm_shuffle_ps(zf, zf, _MM_SHUFFLE(3, 3, 3, 3)));
+         src += 4;
+      }
+#endif
+      for (; j < w; j++, pRow += 4) {
          pRow[0] =
          pRow[1] =
          pRow[2] =
@@ -353,6 +377,185 @@ x32_s8_get_tile_rgba(const unsigned *src,
    }
 }
 
+/*** PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_B8G8R8A8_UNORM ***/
+
+#if defined(PIPE_ARCH_SSE)
+
+/* float_to_ubyte() of each component */
+static inline __m128i
+float4_to_ubyte4(__m128 f)
+{
+   __m128i i = _mm_castps_si128(f);
+   __m128 t = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(255.0f / 256.0f)),
+                         _mm_set1_ps(32768.0f));
+   __m128i u = _mm_and_si128(_mm_castps_si128(t), _mm_set1_epi32(0xff));
+
+   u = _mm_andnot_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), u);
+   return _mm_or_si128(u, _mm_and_si128(_mm_cmpgt_epi32(i, _mm_set1_epi32(0x3f7fffff)),
+                                        _mm_set1_epi32(0xff)));
+}
+
+#elif defined(U_TILE_NEON)
+
+static inline uint8x8_t
+float4x2_to_ubyte8(float32x4_t lo, float32x4_t hi)
+{
+   float32x4_t f[2] = { lo, hi };
+   uint16x4_t u16[2];
+
+   for (unsigned k = 0; k < 2; k++) {
+      int32x4_t i = vreinterpretq_s32_f32(f[k]);
+      float32x4_t t = vaddq_f32(vmulq_n_f32(f[k], 255.0f / 256.0f),
+                                vdupq_n_f32(32768.0f));
+      uint32x4_t u = vandq_u32(vreinterpretq_u32_f32(t), vdupq_n_u32(0xff));
+
+      u = vbicq_u32(u, vcltq_s32(i, vdupq_n_s32(0)));
+      u = vorrq_u32(u, vandq_u32(vcgtq_s32(i, vdupq_n_s32(0x3f7fffff)),
+                                 vdupq_n_u32(0xff)));
+      u16[k] = vmovn_u32(u);
+   }
+
+   return vmovn_u16(vcombine_u16(u16[0], u16[1]));
+}
+
+static inline float32x4_t
+ubyte8_to_float4(uint8x8_t u, bool hi)
+{
+   uint16x8_t u16 = vmovl_u8(u);
+   uint32x4_t u32 = vmovl_u16(hi ? vget_high_u16(u16) : vget_low_u16(u16));
+
+   return vmulq_n_f32(vcvtq_f32_u32(u32), 1.0f / 255.0f);
+}
+
+#endif
+
+/**
+ * Unpack rows of 8-bit unorm RGBA or BGRA pixels, with alpha 1.0 without
+ * an alpha channel, like util_format_read_4f() does.
+ */
+static void
+rgba8_get_tile_rgba(const uint8_t *src,
+                    unsigned w, unsigned h,
+                    float *p,
+                    unsigned dst_stride,
+                    boolean bgra, boolean alpha)
+{
+   unsigned i, j;
+
+   for (i = 0; i < h; i++) {
+      float *pRow = p;
+      j = 0;
+#if defined(PIPE_ARCH_SSE)
+      const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+      const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(~0, ~0, ~0, 0));
+      const __m128 one = _mm_setr_ps(0.0f, 0.0f, 0.0f, alpha ? 0.0f : 1.0f);
+      for (; j + 4 <= w; j += 4) {
+         __m128i v = _mm_loadu_si128((const __m128i *)src);
+         __m128i v16[2] = {
+            _mm_unpacklo_epi8(v, _mm_setzero_si128()),
+            _mm_unpackhi_epi8(v, _mm_setzero_si128()),
+         };
+
+         for (unsigned k = 0; k < 4; k++, pRow += 4) {
+            __m128i c = k & 1 ?
+               _mm_unpackhi_epi16(v16[k / 2], _mm_setzero_si128()) :
+               _mm_unpacklo_epi16(v16[k / 2], _mm_setzero_si128());
+            if (bgra)
+               c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 0, 1, 2));
+
+            __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(c), scale);
+            if (!alpha)
+               f = _mm_or_ps(_mm_and_ps(f, rgb), one);
+            _mm_storeu_ps(pRow, f);
+         }
+         src += 16;
+      }
+#elif defined(U_TILE_NEON)
+      for (; j + 8 <= w; j += 8) {
+         uint8x8x4_t v = vld4_u8(src);
+
+         for (unsigned k = 0; k < 2; k++, pRow += 16) {
+            float32x4x4_t f;
+            f.val[0] = ubyte8_to_float4(v.val[bgra ? 2 : 0], k);
+            f.val[1] = ubyte8_to_float4(v.val[1], k);
+            f.val[2] = ubyte8_to_float4(v.val[bgra ? 0 : 2], k);
+            f.val[3] = alpha ? ubyte8_to_float4(v.val[3], k) : vdupq_n_f32(1.0f);
+            vst4q_f32(pRow, f);
+         }
+         src += 32;
+      }
+#endif
+      for (; j < w; j++, pRow += 4) {
+         pRow[0] = ubyte_to_float(src[bgra ? 2 : 0]);
+         pRow[1] = ubyte_to_float(src[1]);
+         pRow[2] = ubyte_to_float(src[bgra ? 0 : 2]);
+         pRow[3] = alpha ? ubyte_to_float(src[3]) : 1.0f;
+         src += 4;
+      }
+      p += dst_stride;
+   }
+}
+
+/**
+ * Pack rows of 8-bit unorm RGBA or BGRA pixels, with zero in the X
+ * channel without an alpha channel, like util_format_write_4f() does.
+ */
+static void
+rgba8_put_tile_rgba(uint8_t *dst,
+                    unsigned w, unsigned h,
+                    const float *p,
+                    unsigned src_stride,
+                    boolean bgra, boolean alpha)
+{
+   unsigned i, j;
+
+   for (i = 0; i < h; i++) {
+      const float *pRow = p;
+      j = 0;
+#if defined(PIPE_ARCH_SSE)
+      const __m128i mask = _mm_setr_epi32(~0, ~0, ~0, alpha ? ~0 : 0);
+      for (; j + 4 <= w; j += 4) {
+         __m128i c[4];
+
+         for (unsigned k = 0; k < 4; k++, pRow += 4) {
+            c[k] = float4_to_ubyte4(_mm_loadu_ps(pRow));
+            if (bgra)
+               c[k] = _mm_shuffle_epi32(c[k], _MM_SHUFFLE(3, 0, 1, 2));
+            c[k] = _mm_and_si128(c[k], mask);
+         }
+
+         _mm_storeu_si128((__m128i *)dst,
+                          _mm_packus_epi16(_mm_packs_epi32(c[0], c[1]),
+                                           _mm_packs_epi32(c[2], c[3])));
+         dst += 16;
+      }
+#elif defined(U_TILE_NEON)
+      for (; j + 8 <= w; j += 8) {
+         float32x4x4_t lo = vld4q_f32(pRow);
+         float32x4x4_t hi = vld4q_f32(pRow + 16);
+         uint8x8x4_t v;
+
+         v.val[bgra ? 2 : 0] = float4x2_to_ubyte8(lo.val[0], hi.val[0]);
+         v.val[1] = float4x2_to_ubyte8(lo.val[1], hi.val[1]);
+         v.val[bgra ? 0 : 2] = float4x2_to_ubyte8(lo.val[2], hi.val[2]);
+         v.val[3] = alpha ? float4x2_to_ubyte8(lo.val[3], hi.val[3]) :
+                            vdup_n_u8(0);
+         vst4_u8(dst, v);
+         pRow += 32;
+         dst += 32;
+      }
+#endif
+      for (; j < w; j++, pRow += 4) {
+         dst[bgra ? 2 : 0] = float_to_ubyte(pRow[0]);
+         dst[1] = float_to_ubyte(pRow[1]);
+         dst[bgra ? 0 : 2] = float_to_ubyte(pRow[2]);
+         dst[3] = alpha ? float_to_ubyte(pRow[3]) : 0;
+         dst += 4;
+      }
+      p += src_stride;
+   }
+}
+
 void
 pipe_tile_raw_to_rgba(enum pipe_format format,
                       const void *src,
@@ -392,6 +595,16 @@ pipe_tile_raw_to_rgba(enum pipe_format format,
    case PIPE_FORMAT_X32_S8X24_UINT:
       x32_s8_get_tile_rgba((unsigned *) src, w, h, dst, dst_stride);
       break;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+   case PIPE_FORMAT_R8G8B8X8_UNORM:
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+   case PIPE_FORMAT_B8G8R8X8_UNORM:
+      rgba8_get_tile_rgba((const uint8_t *) src, w, h, dst, dst_stride,
+                          format == PIPE_FORMAT_B8G8R8A8_UNORM ||
+                          format == PIPE_FORMAT_B8G8R8X8_UNORM,
+                          format == PIPE_FORMAT_R8G8B8A8_UNORM ||
+                          format == PIPE_FORMAT_B8G8R8A8_UNORM);
+      break;
    default:
       util_format_read_4f(format,
                           dst, dst_stride * sizeof(float),
@@ -514,6 +727,16 @@ pipe_put_tile_rgba_format(struct pipe_transfer *pt,
    case PIPE_FORMAT_Z32_FLOAT_S8X24_UINT:
       /*z32f_s8x24_put_tile_rgba((unsigned *) packed, w, h, p, src_stride);*/
       break;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+   case PIPE_FORMAT_R8G8B8X8_UNORM:
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+   case PIPE_FORMAT_B8G8R8X8_UNORM:
+      rgba8_put_tile_rgba((uint8_t *) packed, w, h, p, src_stride,
+                          format == PIPE_FORMAT_B8G8R8A8_UNORM ||
+                          format == PIPE_FORMAT_B8G8R8X8_UNORM,
+                          format == PIPE_FORMAT_R8G8B8A8_UNORM ||
+                          format == PIPE_FORMAT_B8G8R8A8_UNORM);
+      break;
    default:
       util_format_write_4f(format,
                            p, src_stride * sizeof(float),
@@ -618,7 +841,24 @@ pipe_get_tile_z(struct pipe_transfer *pt,
          const uint *ptrc
             = (const uint *)(map + y * pt->stride + x*4);
          for (i = 0; i < h; i++) {
-            for (j = 0; j < w; j++) {
+            j = 0;
+#if defined(PIPE_ARCH_SSE)
+            for (; j + 4 <= w; j += 4) {
+               __m128i z = _mm_loadu_si128((const __m128i *)(ptrc + j));
+               z = _mm_or_si128(_mm_slli_epi32(z, 8),
+                                _mm_and_si128(_mm_srli_epi32(z, 16),
+                                              _mm_set1_epi32(0xff)));
+               _mm_storeu_si128((__m128i *)(pDest + j), z);
+            }
+#elif defined(U_TILE_NEON)
+            for (; j + 4 <= w; j += 4) {
+               uint32x4_t z = vld1q_u32(ptrc + j);
+               z = vorrq_u32(vshlq_n_u32(z, 8),
+                             vandq_u32(vshrq_n_u32(z, 16), vdupq_n_u32(0xff)));
+               vst1q_u32(pDest + j, z);
+            }
+#endif
+            for (; j < w; j++) {
                /* convert 24-bit Z to 32-bit Z */
                pDest[j] = (ptrc[j] << 8) | ((ptrc[j] >> 16) & 0xff);
             }
@@ -633,7 +873,23 @@ pipe_get_tile_z(struct pipe_transfer *pt,
          const uint *ptrc
             = (const uint *)(map + y * pt->stride + x*4);
          for (i = 0; i < h; i++) {
-            for (j = 0; j < w; j++) {
+            j = 0;
+#if defined(PIPE_ARCH_SSE)
+            for (; j + 4 <= w; j += 4) {
+               __m128i z = _mm_loadu_si128((const __m128i *)(ptrc + j));
+               z = _mm_or_si128(_mm_and_si128(z, _mm_set1_epi32(0xffffff00)),
+                                _mm_srli_epi32(z, 24));
+               _mm_storeu_si128((__m128i *)(pDest + j), z);
+            }
+#elif defined(U_TILE_NEON)
+            for (; j + 4 <= w; j += 4) {
+               uint32x4_t z = vld1q_u32(ptrc + j);
+               z = vorrq_u32(vandq_u32(z, vdupq_n_u32(0xffffff00)),
+                             vshrq_n_u32(z, 24));
+               vst1q_u32(pDest + j, z);
+            }
+#endif
+            for (; j < w; j++) {
                /* convert 24-bit Z to 32-bit Z */
                pDest[j] = (ptrc[j] & 0xffffff00) | ((ptrc[j] >> 24) & 0xff);
             }
@@ -737,7 +993,24 @@ pipe_put_tile_z(struct pipe_transfer *pt,
          uint *pDest = (uint *) (map + y * pt->stride + x*4);
          /*assert((pt->usage & PIPE_TRANSFER_READ_WRITE) == PIPE_TRANSFER_READ_WRITE);*/
          for (i = 0; i < h; i++) {
-            for (j = 0; j < w; j++) {
+            j = 0;
+#if defined(PIPE_ARCH_SSE)
+            for (; j + 4 <= w; j += 4) {
+               __m128i d = _mm_loadu_si128((const __m128i *)(pDest + j));
+               __m128i z = _mm_loadu_si128((const __m128i *)(ptrc + j));
+               d = _mm_or_si128(_mm_and_si128(d, _mm_set1_epi32(0xff000000)),
+                                _mm_srli_epi32(z, 8));
+               _mm_storeu_si128((__m128i *)(pDest + j), d);
+            }
+#elif defined(U_TILE_NEON)
+            for (; j + 4 <= w; j += 4) {
+               uint32x4_t d = vld1q_u32(pDest + j);
+               d = vorrq_u32(vandq_u32(d, vdupq_n_u32(0xff000000)),
+                             vshrq_n_u32(vld1q_u32(ptrc + j), 8));
+               vst1q_u32(pDest + j, d);
+            }
+#endif
+            for (; j < w; j++) {
                /* convert 32-bit Z to 24-bit Z, preserve stencil */
                pDest[j] = (pDest[j] & 0xff000000) | ptrc[j] >> 8;
             }
@@ -764,7 +1037,25 @@ pipe_put_tile_z(struct pipe_transfer *pt,
          uint *pDest = (uint *) (map + y * pt->stride + x*4);
          /*assert((pt->usage & PIPE_TRANSFER_READ_WRITE) == PIPE_TRANSFER_READ_WRITE);*/
          for (i = 0; i < h; i++) {
-            for (j = 0; j < w; j++) {
+            j = 0;
+#if defined(PIPE_ARCH_SSE)
+            for (; j + 4 <= w; j += 4) {
+               __m128i d = _mm_loadu_si128((const __m128i *)(pDest + j));
+               __m128i z = _mm_loadu_si128((const __m128i *)(ptrc + j));
+               d = _mm_or_si128(_mm_and_si128(d, _mm_set1_epi32(0xff)),
+                                _mm_and_si128(z, _mm_set1_epi32(0xffffff00)));
+               _mm_storeu_si128((__m128i *)(pDest + j), d);
+            }
+#elif defined(U_TILE_NEON)
+            for (; j + 4 <= w; j += 4) {
+               uint32x4_t d = vld1q_u32(pDest + j);
+               d = vorrq_u32(vandq_u32(d, vdupq_n_u32(0xff)),
+                             vandq_u32(vld1q_u32(ptrc + j),
+                                       vdupq_n_u32(0xffffff00)));
+               vst1q_u32(pDest + j, d);
+            }
+#endif
+            for (; j < w; j++) {
                /* convert 32-bit Z to 24-bit Z, preserve stencil */
                pDest[j] = (pDest[j] & 0xff) | (ptrc[j] & 0xffffff00);
             }
@@ -36,6 +36,7 @@ struct u_transfer_helper {
    bool separate_z32s8;
    bool fake_rgtc;
    bool msaa_map;
+   bool staging_copies;
 };
 
 static inline bool handle_transfer(struct pipe_resource *prsc)
@@ -70,7 +71,8 @@ struct u_transfer {
    struct pipe_transfer *trans2;  /* 2nd transfer for s8 stencil buffer in z32s8 */
    void *ptr, *ptr2;              /* ptr to trans, and trans2 */
    void *staging;                 /* staging buffer */
-   struct pipe_resource *ss;      /* staging resource for MSAA resolves */
+   struct pipe_resource *ss;      /* staging resource for MSAA resolves and
+                                   * staging copies */
 };
 
 static inline struct u_transfer *
@@ -218,6 +220,101 @@ transfer_map_msaa(struct pipe_context *pctx,
    return ss_map;
 }
 
+/* Whether the map can go to a new staging resource blitted to the resource
+ * at unmap, instead of mapping the resource which waits for the GPU to be
+ * done with it.  The blit covers the whole box, so the map must discard it,
+ * and a blit of stencil needs the stencil export of the blitter.
+ */
+static bool
+use_staging_copies(struct pipe_context *pctx, struct pipe_resource *prsc,
+                   unsigned usage, const struct pipe_box *box)
+{
+   struct pipe_screen *pscreen = pctx->screen;
+   struct u_transfer_helper *helper = pscreen->transfer_helper;
+
+   if (!helper->staging_copies || box->depth != 1)
+      return false;
+
+   if (!(usage & PIPE_TRANSFER_WRITE) ||
+       !(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                  PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE)))
+      return false;
+
+   if (usage & (PIPE_TRANSFER_READ |
+                PIPE_TRANSFER_FLUSH_EXPLICIT |
+                PIPE_TRANSFER_PERSISTENT |
+                PIPE_TRANSFER_UNSYNCHRONIZED |
+                PIPE_TRANSFER_MAP_DIRECTLY))
+      return false;
+
+   if (util_format_has_stencil(util_format_description(prsc->format)) &&
+       !pscreen->get_param(pscreen, PIPE_CAP_SHADER_STENCIL_EXPORT))
+      return false;
+
+   return true;
+}
+
+/* Map a new staging resource in the format of the resource, through
+ * pctx->transfer_map() for the z32s8 and fake rgtc handling.  Nothing uses
+ * it yet, so the map doesn't wait, and the blit to the resource at unmap is
+ * pipelined with the rest of the command stream.
+ */
+static void *
+transfer_map_staging(struct pipe_context *pctx,
+                     struct pipe_resource *prsc,
+                     unsigned level, unsigned usage,
+                     const struct pipe_box *box,
+                     struct pipe_transfer **pptrans)
+{
+   struct pipe_screen *pscreen = pctx->screen;
+   struct u_transfer *trans = calloc(1, sizeof(*trans));
+   if (!trans)
+      return NULL;
+   struct pipe_transfer *ptrans = &trans->base;
+
+   pipe_resource_reference(&ptrans->resource, prsc);
+   ptrans->level = level;
+   ptrans->usage = usage;
+   ptrans->box = *box;
+
+   struct pipe_resource tmpl = {
+         .target = PIPE_TEXTURE_2D,
+         .format = prsc->format,
+         .width0 = box->width,
+         .height0 = box->height,
+         .depth0 = 1,
+         .array_size = 1,
+         .usage = PIPE_USAGE_STAGING,
+         .bind = PIPE_BIND_SAMPLER_VIEW,
+   };
+   trans->ss = pscreen->resource_create(pscreen, &tmpl);
+   if (!trans->ss)
+      goto fail;
+
+   struct pipe_box ss_box;
+   u_box_2d(0, 0, box->width, box->height, &ss_box);
+
+   void *ss_map = pctx->transfer_map(pctx, trans->ss, 0,
+                                     PIPE_TRANSFER_WRITE |
+                                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE |
+                                     PIPE_TRANSFER_UNSYNCHRONIZED,
+                                     &ss_box, &trans->trans);
+   if (!ss_map)
+      goto fail;
+
+   ptrans->stride = trans->trans->stride;
+   ptrans->layer_stride = trans->trans->layer_stride;
+
+   *pptrans = ptrans;
+   return ss_map;
+
+fail:
+   pipe_resource_reference(&trans->ss, NULL);
+   pipe_resource_reference(&ptrans->resource, NULL);
+   free(trans);
+   return NULL;
+}
+
 void *
 u_transfer_helper_transfer_map(struct pipe_context *pctx,
                                struct pipe_resource *prsc,
@@ -238,6 +335,9 @@ u_transfer_helper_transfer_map(struct pipe_context *pctx,
    if (helper->msaa_map && (prsc->nr_samples > 1))
       return transfer_map_msaa(pctx, prsc, level, usage, box, pptrans);
 
+   if (use_staging_copies(pctx, prsc, usage, box))
+      return transfer_map_staging(pctx, prsc, level, usage, box, pptrans);
+
    debug_assert(box->depth == 1);
 
    trans = calloc(1, sizeof(*trans));
@@ -278,32 +378,34 @@ u_transfer_helper_transfer_map(struct pipe_context *pctx,
                                                        trans->trans2->stride,
                                                        width, height);
       }
-   } else if (needs_pack(usage) &&
-              util_format_description(prsc->format)->layout == UTIL_FORMAT_LAYOUT_RGTC) {
-      switch (prsc->format) {
-      case PIPE_FORMAT_RGTC1_UNORM:
-      case PIPE_FORMAT_RGTC1_SNORM:
-      case PIPE_FORMAT_LATC1_UNORM:
-      case PIPE_FORMAT_LATC1_SNORM:
-         util_format_rgtc1_unorm_pack_rgba_8unorm(trans->staging,
-                                                  ptrans->stride,
-                                                  trans->ptr,
-                                                  trans->trans->stride,
-                                                  width, height);
-         break;
-      case PIPE_FORMAT_RGTC2_UNORM:
-      case PIPE_FORMAT_RGTC2_SNORM:
-      case PIPE_FORMAT_LATC2_UNORM:
-      case PIPE_FORMAT_LATC2_SNORM:
-         util_format_rgtc2_unorm_pack_rgba_8unorm(trans->staging,
-                                                  ptrans->stride,
-                                                  trans->ptr,
-                                                  trans->trans->stride,
-                                                  width, height);
-         break;
-      default:
-         assert(!"Unexpected format");
-         break;
+   } else if (util_format_description(prsc->format)->layout == UTIL_FORMAT_LAYOUT_RGTC) {
+      /* nothing to pack for a map which doesn't read */
+      if (needs_pack(usage)) {
+         switch (prsc->format) {
+         case PIPE_FORMAT_RGTC1_UNORM:
+         case PIPE_FORMAT_RGTC1_SNORM:
+         case PIPE_FORMAT_LATC1_UNORM:
+         case PIPE_FORMAT_LATC1_SNORM:
+            util_format_rgtc1_unorm_pack_rgba_8unorm(trans->staging,
+                                                     ptrans->stride,
+                                                     trans->ptr,
+                                                     trans->trans->stride,
+                                                     width, height);
+            break;
+         case PIPE_FORMAT_RGTC2_UNORM:
+         case PIPE_FORMAT_RGTC2_SNORM:
+         case PIPE_FORMAT_LATC2_UNORM:
+         case PIPE_FORMAT_LATC2_SNORM:
+            util_format_rgtc2_unorm_pack_rgba_8unorm(trans->staging,
+                                                     ptrans->stride,
+                                                     trans->ptr,
+                                                     trans->trans->stride,
+                                                     width, height);
+            break;
+         default:
+            assert(!"Unexpected format");
+            break;
+         }
       }
    } else {
       unreachable("bleh");
@@ -349,10 +451,11 @@ flush_region(struct pipe_context *pctx, struct pipe_transfer *ptrans,
       blit.dst.format = ptrans->resource->format;
       blit.dst.level = ptrans->level;
 
-      u_box_2d(ptrans->box.x + box->x,
-               ptrans->box.y + box->y,
-               box->width, box->height,
-               &blit.dst.box);
+      u_box_2d_zslice(ptrans->box.x + box->x,
+                      ptrans->box.y + box->y,
+                      ptrans->box.z,
+                      box->width, box->height,
+                      &blit.dst.box);
 
       blit.mask = util_format_get_mask(ptrans->resource->format);
       blit.filter = PIPE_TEX_FILTER_NEAREST;
@@ -455,24 +558,29 @@ u_transfer_helper_transfer_unmap(struct pipe_context *pctx,
    if (handle_transfer(ptrans->resource)) {
       struct u_transfer *trans = u_transfer(ptrans);
 
-      if (!(ptrans->usage & PIPE_TRANSFER_FLUSH_EXPLICIT)) {
-         struct pipe_box box;
-         u_box_2d(0, 0, ptrans->box.width, ptrans->box.height, &box);
-         flush_region(pctx, ptrans, &box);
-      }
+      struct pipe_box box;
+      u_box_2d(0, 0, ptrans->box.width, ptrans->box.height, &box);
 
       /* in MSAA case, there could be multiple levels of wrapping
-       * so don't call helper->vtbl->transfer_unmap() directly
+       * so don't call helper->vtbl->transfer_unmap() directly.  The
+       * wrapped transfer may write the staging resource at its unmap
+       * (z32s8 or fake rgtc), so blit it once that is done.
        */
       if (trans->ss) {
          pctx->transfer_unmap(pctx, trans->trans);
+         if (!(ptrans->usage & PIPE_TRANSFER_FLUSH_EXPLICIT))
+            flush_region(pctx, ptrans, &box);
          pipe_resource_reference(&trans->ss, NULL);
       } else {
+         if (!(ptrans->usage & PIPE_TRANSFER_FLUSH_EXPLICIT))
+            flush_region(pctx, ptrans, &box);
          helper->vtbl->transfer_unmap(pctx, trans->trans);
          if (trans->trans2)
             helper->vtbl->transfer_unmap(pctx, trans->trans2);
       }
 
+      pipe_resource_reference(&ptrans->resource, NULL);
+      free(trans->staging);
       free(trans);
    } else {
       helper->vtbl->transfer_unmap(pctx, ptrans);
@@ -483,7 +591,8 @@ struct u_transfer_helper *
 u_transfer_helper_create(const struct u_transfer_vtbl *vtbl,
                          bool separate_z32s8,
                          bool fake_rgtc,
-                         bool msaa_map)
+                         bool msaa_map,
+                         bool staging_copies)
 {
    struct u_transfer_helper *helper = calloc(1, sizeof(*helper));
 
@@ -491,6 +600,7 @@ u_transfer_helper_create(const struct u_transfer_vtbl *vtbl,
    helper->separate_z32s8 = separate_z32s8;
    helper->fake_rgtc = fake_rgtc;
    helper->msaa_map = msaa_map;
+   helper->staging_copies = staging_copies;
 
    return helper;
 }
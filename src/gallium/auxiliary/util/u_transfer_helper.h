@@ -42,6 +42,11 @@ extern "C" {
  *  1) populate u_transfer_vtbl and plug that into pipe_screen::transfer_helper
  *  2) plug the transfer helpers into pipe_screen/pipe_context
  *
+ * With staging_copies, maps writing and discarding a box of a z32s8 or fake
+ * RGTC resource don't map the resource, which waits for the GPU to be done
+ * with it: they map a new staging resource, blitted to the resource at
+ * unmap as done for MSAA resolves.
+ *
  * To avoid subclassing pipe_resource (and conflicting with threaded_context)
  * the vtbl contains setter/getter methods used for fake_rgct & separate_stencil
  * to access the internal_format and separate stencil buffer.
@@ -124,7 +129,8 @@ struct u_transfer_helper;
 struct u_transfer_helper * u_transfer_helper_create(const struct u_transfer_vtbl *vtbl,
                                                     bool separate_z32s8,
                                                     bool fake_rgtc,
-                                                    bool msaa_map);
+                                                    bool msaa_map,
+                                                    bool staging_copies);
 
 void u_transfer_helper_destroy(struct u_transfer_helper *helper);
 
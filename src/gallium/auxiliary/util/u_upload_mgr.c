@@ -32,12 +32,23 @@
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
 #include "pipe/p_context.h"
+#include "pipe/p_screen.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 
 #include "u_upload_mgr.h"
 
 
+#define U_UPLOAD_MAX_RING 8
+
+/* A full upload buffer kept for reuse. */
+struct u_upload_ring_buffer {
+   struct pipe_resource *buffer;
+   struct pipe_transfer *transfer; /* only kept with persistent mappings */
+   uint8_t *map;
+   struct pipe_fence_handle *fence; /* of a flush after it got full */
+};
+
 struct u_upload_mgr {
    struct pipe_context *pipe;
 
@@ -53,6 +64,13 @@ struct u_upload_mgr {
    uint8_t *map;    /* Pointer to the mapped upload buffer. */
    unsigned offset; /* Aligned offset to the upload buffer, pointing
                      * at the first unused byte. */
+
+   /* Full buffers, oldest first. */
+   struct u_upload_ring_buffer ring[U_UPLOAD_MAX_RING];
+   unsigned ring_size;     /* Max buffers kept, 0 without the ring. */
+   unsigned num_ring;
+
+   struct u_upload_stats stats;
 };
 
 
@@ -99,6 +117,7 @@ u_upload_create_default(struct pipe_context *pipe)
                           PIPE_USAGE_STREAM, 0);
 }
 
+/* Only the driver knows the fences, so clones start without the ring. */
 struct u_upload_mgr *
 u_upload_clone(struct pipe_context *pipe, struct u_upload_mgr *upload)
 {
@@ -143,10 +162,146 @@ u_upload_release_buffer(struct u_upload_mgr *upload)
 }
 
 
+void
+u_upload_enable_ring(struct u_upload_mgr *upload, unsigned num_buffers)
+{
+   upload->ring_size = MIN2(num_buffers, U_UPLOAD_MAX_RING);
+}
+
+
+boolean
+u_upload_needs_fence(struct u_upload_mgr *upload)
+{
+   /* the newest are tagged last */
+   return upload->num_ring &&
+          !upload->ring[upload->num_ring - 1].fence;
+}
+
+
+void
+u_upload_fence(struct u_upload_mgr *upload, struct pipe_fence_handle *fence)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+
+   for (unsigned i = upload->num_ring; i--; ) {
+      if (upload->ring[i].fence)
+         break;
+      screen->fence_reference(screen, &upload->ring[i].fence, fence);
+   }
+}
+
+
+const struct u_upload_stats *
+u_upload_get_stats(struct u_upload_mgr *upload)
+{
+   return &upload->stats;
+}
+
+
+static void
+u_upload_ring_release(struct u_upload_mgr *upload, unsigned i)
+{
+   struct u_upload_ring_buffer *ring = &upload->ring[i];
+   struct pipe_screen *screen = upload->pipe->screen;
+
+   if (ring->transfer)
+      pipe_transfer_unmap(upload->pipe, ring->transfer);
+   pipe_resource_reference(&ring->buffer, NULL);
+   screen->fence_reference(screen, &ring->fence, NULL);
+
+   upload->num_ring--;
+   memmove(ring, ring + 1, (upload->num_ring - i) * sizeof(*ring));
+}
+
+
+/* Move the current buffer to the ring, the oldest buffer makes room. */
+static void
+u_upload_ring_retire(struct u_upload_mgr *upload)
+{
+   struct u_upload_ring_buffer *ring;
+
+   if (upload->num_ring == upload->ring_size)
+      u_upload_ring_release(upload, 0);
+
+   if (!upload->map_persistent)
+      upload_unmap_internal(upload, TRUE);
+
+   ring = &upload->ring[upload->num_ring++];
+   ring->buffer = upload->buffer;
+   ring->transfer = upload->transfer;
+   ring->map = upload->map;
+   ring->fence = NULL;
+
+   upload->buffer = NULL;
+   upload->transfer = NULL;
+   upload->map = NULL;
+}
+
+
+/* Index of the oldest idle buffer of the ring with min_size bytes, or -1. */
+static int
+u_upload_ring_find_idle(struct u_upload_mgr *upload, unsigned min_size)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+
+   for (unsigned i = 0; i < upload->num_ring; i++) {
+      struct u_upload_ring_buffer *ring = &upload->ring[i];
+      /* a kept persistent mapping may hold a reference too */
+      int own_refs = 1 + (ring->transfer &&
+                          ring->transfer->resource == ring->buffer);
+
+      /* the buffers after it were tagged later, they aren't idle either */
+      if (!ring->fence || !screen->fence_finish(screen, NULL, ring->fence, 0))
+         return -1;
+
+      /* still bound somewhere, its content may be used again */
+      if (p_atomic_read(&ring->buffer->reference.count) > own_refs ||
+          ring->buffer->width0 < min_size)
+         continue;
+
+      return i;
+   }
+
+   return -1;
+}
+
+
+/* Swap the current buffer with an idle one of the ring if there's one,
+ * otherwise move it to the ring.
+ */
+static boolean
+u_upload_ring_reuse(struct u_upload_mgr *upload, unsigned min_size)
+{
+   struct u_upload_ring_buffer idle;
+   int i = u_upload_ring_find_idle(upload, min_size);
+
+   if (i < 0) {
+      u_upload_ring_retire(upload);
+      return FALSE;
+   }
+
+   idle = upload->ring[i];
+   upload->ring[i].buffer = NULL;
+   upload->ring[i].transfer = NULL;
+   u_upload_ring_release(upload, i);
+
+   u_upload_ring_retire(upload);
+
+   upload->buffer = idle.buffer;
+   upload->transfer = idle.transfer;
+   upload->map = idle.map;
+   upload->offset = 0;
+   upload->stats.buffers_recycled++;
+   return TRUE;
+}
+
+
 void
 u_upload_destroy(struct u_upload_mgr *upload)
 {
    u_upload_release_buffer(upload);
+   while (upload->num_ring)
+      u_upload_ring_release(upload, 0);
    FREE(upload);
 }
 
@@ -160,7 +315,12 @@ u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
 
    /* Release the old buffer, if present:
     */
-   u_upload_release_buffer(upload);
+   if (upload->ring_size && upload->buffer) {
+      if (u_upload_ring_reuse(upload, min_size))
+         return;
+   }
+   else
+      u_upload_release_buffer(upload);
 
    /* Allocate a new one:
     */
@@ -185,6 +345,7 @@ u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
    upload->buffer = screen->resource_create(screen, &buffer);
    if (upload->buffer == NULL)
       return;
+   upload->stats.buffers_created++;
 
    /* Map the new buffer. */
    upload->map = pipe_buffer_map_range(upload->pipe, upload->buffer,
@@ -260,6 +421,7 @@ u_upload_alloc(struct u_upload_mgr *upload,
    *out_offset = offset;
 
    upload->offset = offset + size;
+   upload->stats.bytes += size;
 }
 
 void
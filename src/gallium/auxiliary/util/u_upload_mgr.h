@@ -37,6 +37,13 @@
 
 struct pipe_context;
 struct pipe_resource;
+struct pipe_fence_handle;
+
+struct u_upload_stats {
+   uint64_t bytes;            /* bytes sub-allocated */
+   uint64_t buffers_created;  /* upload buffers created */
+   uint64_t buffers_recycled; /* idle ring buffers reused instead */
+};
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,6 +76,39 @@ u_upload_create_default(struct pipe_context *pipe);
 struct u_upload_mgr *
 u_upload_clone(struct pipe_context *pipe, struct u_upload_mgr *upload);
 
+/**
+ * Keep up to num_buffers full upload buffers around, and reuse the oldest
+ * one the GPU is done with instead of creating a new buffer when the
+ * current one is full. With persistent mappings they also stay mapped.
+ *
+ * The upload manager doesn't know when the GPU is done with a buffer, the
+ * driver has to pass the fence of each flush with u_upload_fence(). A full
+ * buffer is reused once the fence of a flush after it got full has
+ * signalled and nothing else holds a reference to it.
+ */
+void
+u_upload_enable_ring(struct u_upload_mgr *upload, unsigned num_buffers);
+
+/**
+ * Whether some full buffers of the ring wait for the fence of a flush, so
+ * that drivers only create a fence when it's needed.
+ */
+boolean
+u_upload_needs_fence(struct u_upload_mgr *upload);
+
+/**
+ * Tag the full buffers of the ring not tagged yet with the fence of a
+ * flush, which covers all their uses.
+ */
+void
+u_upload_fence(struct u_upload_mgr *upload, struct pipe_fence_handle *fence);
+
+/**
+ * Statistics since the upload manager was created.
+ */
+const struct u_upload_stats *
+u_upload_get_stats(struct u_upload_mgr *upload);
+
 /**
  * Destroy the upload manager.
  */
@@ -133,6 +133,28 @@ struct u_vbuf_elements {
    void *driver_cso;
 };
 
+#define U_VBUF_TRANSLATED_CACHE_SIZE 8
+
+struct u_vbuf_translated {
+   struct translate_key key;
+   uint32_t vb_mask;
+   int start_vertex;
+   unsigned num_vertices;
+   unsigned max_index;
+
+   /* The source ranges and the write serial of their buffers. */
+   struct {
+      struct pipe_resource *resource;
+      unsigned offset;
+      unsigned stride;
+      unsigned serial;
+   } vb[PIPE_MAX_ATTRIBS];
+
+   /* NULL if the entry is unused. */
+   struct pipe_resource *out_buffer;
+   unsigned out_offset;
+};
+
 enum {
    VB_VERTEX = 0,
    VB_INSTANCE = 1,
@@ -181,6 +203,11 @@ struct u_vbuf {
    uint32_t incompatible_vb_mask; /* each bit describes a corresp. buffer */
    /* Which buffer has a non-zero stride. */
    uint32_t nonzero_stride_vb_mask; /* each bit describes a corresp. buffer */
+
+   /* Recently translated vertices, reused while the source buffers aren't
+    * written. Only used if the screen has buffer_get_write_serial. */
+   struct u_vbuf_translated translated[U_VBUF_TRANSLATED_CACHE_SIZE];
+   unsigned next_translated;
 };
 
 static void *
@@ -367,6 +394,101 @@ void u_vbuf_set_vertex_elements(struct u_vbuf *mgr, unsigned count,
    mgr->ve = u_vbuf_set_vertex_elements_internal(mgr, count, states);
 }
 
+static boolean
+u_vbuf_translated_match(struct u_vbuf *mgr, const struct u_vbuf_translated *t,
+                        const struct translate_key *key, unsigned vb_mask,
+                        int start_vertex, unsigned num_vertices,
+                        unsigned max_index)
+{
+   struct pipe_screen *screen = mgr->pipe->screen;
+
+   if (!t->out_buffer || t->vb_mask != vb_mask ||
+       t->start_vertex != start_vertex ||
+       t->num_vertices != num_vertices || t->max_index != max_index ||
+       translate_key_compare(&t->key, key))
+      return FALSE;
+
+   while (vb_mask) {
+      unsigned i = u_bit_scan(&vb_mask);
+      struct pipe_vertex_buffer *vb = &mgr->vertex_buffer[i];
+
+      if (t->vb[i].resource != vb->buffer.resource ||
+          t->vb[i].offset != vb->buffer_offset ||
+          t->vb[i].stride != vb->stride ||
+          t->vb[i].serial !=
+             screen->buffer_get_write_serial(screen, vb->buffer.resource))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/* Look for vertices translated from the same ranges of the same buffers,
+ * which haven't been written since.
+ */
+static struct u_vbuf_translated *
+u_vbuf_translated_find(struct u_vbuf *mgr, const struct translate_key *key,
+                       unsigned vb_mask, int start_vertex,
+                       unsigned num_vertices, unsigned max_index)
+{
+   for (unsigned i = 0; i < U_VBUF_TRANSLATED_CACHE_SIZE; i++) {
+      struct u_vbuf_translated *t = &mgr->translated[i];
+
+      if (u_vbuf_translated_match(mgr, t, key, vb_mask, start_vertex,
+                                  num_vertices, max_index))
+         return t;
+   }
+
+   return NULL;
+}
+
+static void
+u_vbuf_translated_release(struct u_vbuf_translated *t)
+{
+   for (unsigned i = 0; i < PIPE_MAX_ATTRIBS; i++)
+      pipe_resource_reference(&t->vb[i].resource, NULL);
+   pipe_resource_reference(&t->out_buffer, NULL);
+}
+
+/* Remember the translated vertices, replacing the oldest entry. The
+ * entries hold references to the buffers, so that their addresses can't
+ * be reused by other buffers.
+ */
+static void
+u_vbuf_translated_add(struct u_vbuf *mgr, const struct translate_key *key,
+                      unsigned vb_mask, int start_vertex,
+                      unsigned num_vertices, unsigned max_index,
+                      struct pipe_resource *out_buffer, unsigned out_offset)
+{
+   struct pipe_screen *screen = mgr->pipe->screen;
+   struct u_vbuf_translated *t = &mgr->translated[mgr->next_translated];
+
+   mgr->next_translated =
+      (mgr->next_translated + 1) % U_VBUF_TRANSLATED_CACHE_SIZE;
+
+   u_vbuf_translated_release(t);
+
+   memcpy(&t->key, key, translate_keysize(key));
+   t->vb_mask = vb_mask;
+   t->start_vertex = start_vertex;
+   t->num_vertices = num_vertices;
+   t->max_index = max_index;
+
+   while (vb_mask) {
+      unsigned i = u_bit_scan(&vb_mask);
+      struct pipe_vertex_buffer *vb = &mgr->vertex_buffer[i];
+
+      pipe_resource_reference(&t->vb[i].resource, vb->buffer.resource);
+      t->vb[i].offset = vb->buffer_offset;
+      t->vb[i].stride = vb->stride;
+      t->vb[i].serial =
+         screen->buffer_get_write_serial(screen, vb->buffer.resource);
+   }
+
+   pipe_resource_reference(&t->out_buffer, out_buffer);
+   t->out_offset = out_offset;
+}
+
 void u_vbuf_destroy(struct u_vbuf *mgr)
 {
    struct pipe_screen *screen = mgr->pipe->screen;
@@ -383,6 +505,9 @@ void u_vbuf_destroy(struct u_vbuf *mgr)
 
    pipe_vertex_buffer_unreference(&mgr->aux_vertex_buffer_saved);
 
+   for (i = 0; i < U_VBUF_TRANSLATED_CACHE_SIZE; i++)
+      u_vbuf_translated_release(&mgr->translated[i]);
+
    translate_cache_destroy(mgr->translate_cache);
    cso_cache_delete(mgr->cso_cache);
    FREE(mgr);
@@ -400,6 +525,28 @@ u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
    struct pipe_resource *out_buffer = NULL;
    uint8_t *out_map;
    unsigned out_offset, mask;
+   struct pipe_screen *screen = mgr->pipe->screen;
+   const unsigned total_vertices = num_vertices;
+   const boolean cached = !unroll_indices &&
+                          !(vb_mask & mgr->user_vb_mask) &&
+                          screen->buffer_get_write_serial;
+
+   /* Reuse the vertices translated by a previous draw. */
+   if (cached) {
+      struct u_vbuf_translated *t =
+         u_vbuf_translated_find(mgr, key, vb_mask, start_vertex,
+                                total_vertices, info->max_index);
+      if (t) {
+         struct pipe_vertex_buffer *out = &mgr->real_vertex_buffer[out_vb];
+
+         pipe_vertex_buffer_unreference(out);
+         pipe_resource_reference(&out->buffer.resource, t->out_buffer);
+         out->buffer_offset = t->out_offset;
+         out->stride = key->output_stride;
+         out->is_user_buffer = false;
+         return PIPE_OK;
+      }
+   }
 
    /* Get a translate object. */
    tr = translate_cache_find(mgr->translate_cache, key);
@@ -514,6 +661,11 @@ u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
       }
    }
 
+   if (cached) {
+      u_vbuf_translated_add(mgr, key, vb_mask, start_vertex, total_vertices,
+                            info->max_index, out_buffer, out_offset);
+   }
+
    /* Setup the new vertex buffer. */
    mgr->real_vertex_buffer[out_vb].buffer_offset = out_offset;
    mgr->real_vertex_buffer[out_vb].stride = key->output_stride;
@@ -1187,7 +1187,7 @@ fd_resource_screen_init(struct pipe_screen *pscreen)
 	pscreen->resource_destroy = u_transfer_helper_resource_destroy;
 
 	pscreen->transfer_helper = u_transfer_helper_create(&transfer_vtbl,
-			true, fake_rgtc, true);
+			true, fake_rgtc, true, false);
 
 	if (!screen->setup_slices)
 		screen->setup_slices = fd_setup_slices;
@@ -440,7 +440,7 @@ int main(int argc, char **argv)
 		if (fd_mesa_debug & FD_DBG_OPTMSGS)
 			tgsi_dump(toks, 0);
 
-		nir = ir3_tgsi_to_nir(toks);
+		nir = ir3_tgsi_to_nir(compiler, toks);
 		NIR_PASS_V(nir, nir_lower_global_vars_to_local);
 	} else if (from_spirv) {
 		nir = load_spirv(filenames[0], entry, stage);
@@ -27,14 +27,25 @@
  */
 
 #include "util/ralloc.h"
+#include "nir/tgsi_to_nir.h"
 
 #include "ir3_compiler.h"
 
+/* the compiler is freed with ralloc_free() */
+static void
+ir3_compiler_destructor(void *ptr)
+{
+	struct ir3_compiler *compiler = ptr;
+	tgsi_to_nir_cache_destroy(compiler->ttn_cache);
+}
+
 struct ir3_compiler * ir3_compiler_create(struct fd_device *dev, uint32_t gpu_id)
 {
 	struct ir3_compiler *compiler = rzalloc(NULL, struct ir3_compiler);
 	compiler->dev = dev;
 	compiler->gpu_id = gpu_id;
 	compiler->set = ir3_ra_alloc_reg_set(compiler);
+	compiler->ttn_cache = tgsi_to_nir_cache_create();
+	ralloc_set_destructor(compiler, ir3_compiler_destructor);
 	return compiler;
 }
@@ -38,6 +38,8 @@ struct ir3_compiler {
 	uint32_t gpu_id;
 	struct ir3_ra_reg_set *set;
 	uint32_t shader_count;
+	/* NIR of the TGSI shaders created before, see tgsi_to_nir_cached() */
+	struct tgsi_to_nir_cache *ttn_cache;
 };
 
 struct ir3_compiler * ir3_compiler_create(struct fd_device *dev, uint32_t gpu_id);
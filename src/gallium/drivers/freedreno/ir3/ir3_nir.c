@@ -54,9 +54,9 @@ static const nir_shader_compiler_options options = {
 };
 
 struct nir_shader *
-ir3_tgsi_to_nir(const struct tgsi_token *tokens)
+ir3_tgsi_to_nir(struct ir3_compiler *compiler, const struct tgsi_token *tokens)
 {
-	return tgsi_to_nir(tokens, &options);
+	return tgsi_to_nir_cached(compiler->ttn_cache, tokens, &options);
 }
 
 const nir_shader_compiler_options *
@@ -318,7 +318,7 @@ ir3_shader_create(struct ir3_compiler *compiler,
 			DBG("dump tgsi: type=%d", shader->type);
 			tgsi_dump(cso->tokens, 0);
 		}
-		nir = ir3_tgsi_to_nir(cso->tokens);
+		nir = ir3_tgsi_to_nir(compiler, cso->tokens);
 	}
 	/* do first pass optimization, ignoring the key: */
 	shader->nir = ir3_optimize_nir(shader, nir, NULL);
@@ -367,7 +367,7 @@ ir3_shader_create_compute(struct ir3_compiler *compiler,
 			DBG("dump tgsi: type=%d", shader->type);
 			tgsi_dump(cso->prog, 0);
 		}
-		nir = ir3_tgsi_to_nir(cso->prog);
+		nir = ir3_tgsi_to_nir(compiler, cso->prog);
 	}
 
 	/* do first pass optimization, ignoring the key: */
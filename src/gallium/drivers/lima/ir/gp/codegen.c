@@ -564,11 +564,20 @@ bool gpir_codegen_prog(gpir_compiler *comp)
    if (!code)
       return false;
 
+   struct lima_shader_stats *stats = &comp->prog->stats;
+   stats->instrs = num_instr;
+   stats->max_slots = num_instr * GPIR_INSTR_SLOT_NUM;
+
    int instr_index = 0;
    list_for_each_entry(gpir_block, block, &comp->block_list, list) {
       list_for_each_entry(gpir_instr, instr, &block->instr_list, list) {
          gpir_codegen(code + instr_index, instr);
          instr_index++;
+
+         for (int i = 0; i < GPIR_INSTR_SLOT_NUM; i++) {
+            if (instr->slots[i])
+               stats->slots++;
+         }
       }
    }
 
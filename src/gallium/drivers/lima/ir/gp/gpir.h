@@ -331,6 +331,12 @@ typedef struct gpir_compiler {
 
    struct lima_vs_shader_state *prog;
    int constant_base;
+
+   /* blocks, nodes, deps, instrs and regs live as long as the compiler,
+    * they are bump allocated from here and freed with it in one go */
+   void *linear;
+   /* deps removed from the graph, reused by gpir_node_add_dep */
+   struct list_head dep_free_list;
 } gpir_compiler;
 
 #define GPIR_VALUE_REG_NUM 11
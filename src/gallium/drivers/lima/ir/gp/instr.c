@@ -30,7 +30,8 @@
 
 gpir_instr *gpir_instr_create(gpir_block *block)
 {
-   gpir_instr *instr = rzalloc(block, gpir_instr);
+   gpir_instr *instr = linear_zalloc_child(block->comp->linear,
+                                           sizeof(gpir_instr));
    if (unlikely(!instr))
       return NULL;
 
@@ -120,7 +120,8 @@ found:
       }
    }
 
-   comp->constant_base += 2;
+   /* viewport scale, translate and the instance id */
+   comp->constant_base += 3;
    return true;
 }
 
@@ -157,9 +158,17 @@ static bool gpir_lower_const(gpir_compiler *comp)
                   if (unlikely(!load))
                      return false;
 
-                  load->index = comp->constant_base + (index >> 2);
-                  load->component = index % 4;
-                  constant[index++] = c->value;
+                  /* the same value is loaded from the same component */
+                  int i;
+                  for (i = 0; i < index; i++) {
+                     if (constant[i].ui == c->value.ui)
+                        break;
+                  }
+                  if (i == index)
+                     constant[index++] = c->value;
+
+                  load->index = comp->constant_base + (i >> 2);
+                  load->component = i % 4;
 
                   gpir_node_replace_succ(&load->node, node);
 
@@ -173,6 +182,8 @@ static bool gpir_lower_const(gpir_compiler *comp)
             }
          }
       }
+
+      comp->prog->constant_size = index * sizeof(union fi);
    }
 
    return true;
@@ -191,6 +191,20 @@ static bool gpir_emit_intrinsic(gpir_block *block, nir_instr *ni)
 
       return true;
    }
+   case nir_intrinsic_load_instance_id:
+   {
+      /* instances are drawn one by one, the driver puts the instance
+       * id after the viewport transform uniforms */
+      gpir_load_node *load =
+         gpir_node_create_dest(block, gpir_op_load_uniform, &instr->dest);
+      if (unlikely(!load))
+         return false;
+
+      load->index = block->comp->constant_base + 2;
+      load->component = 0;
+
+      return true;
+   }
    case nir_intrinsic_store_output:
    {
       gpir_store_node *store = gpir_node_create(block, gpir_op_store_varying);
@@ -258,7 +272,7 @@ static bool (*gpir_emit_instr[nir_instr_type_phi])(gpir_block *, nir_instr *) =
 
 static gpir_block *gpir_block_create(gpir_compiler *comp)
 {
-   gpir_block *block = ralloc(comp, gpir_block);
+   gpir_block *block = linear_alloc_child(comp->linear, sizeof(gpir_block));
    if (!block)
       return NULL;
 
@@ -336,7 +350,7 @@ static bool gpir_emit_cf_list(gpir_compiler *comp, struct exec_list *list)
 
 gpir_reg *gpir_create_reg(gpir_compiler *comp)
 {
-   gpir_reg *reg = ralloc(comp, gpir_reg);
+   gpir_reg *reg = linear_alloc_child(comp->linear, sizeof(gpir_reg));
    reg->index = comp->cur_reg++;
    list_addtail(&reg->list, &comp->reg_list);
    list_inithead(&reg->defs_list);
@@ -348,8 +362,10 @@ static gpir_compiler *gpir_compiler_create(void *prog, unsigned num_reg, unsigne
 {
    gpir_compiler *comp = rzalloc(prog, gpir_compiler);
 
+   comp->linear = linear_alloc_parent(comp, 0);
    list_inithead(&comp->block_list);
    list_inithead(&comp->reg_list);
+   list_inithead(&comp->dep_free_list);
 
    for (int i = 0; i < num_reg; i++)
       gpir_create_reg(comp);
@@ -366,6 +382,18 @@ static int gpir_glsl_type_size(enum glsl_base_type type)
    return 4;
 }
 
+/* mediump and lowp varyings are stored as fp16, the varying descriptor
+ * converts them on store and load */
+static int gpir_varying_component_size(nir_variable *var)
+{
+   if (lima_fp16_varying ||
+       var->data.precision == GLSL_PRECISION_MEDIUM ||
+       var->data.precision == GLSL_PRECISION_LOW)
+      return 2;
+
+   return gpir_glsl_type_size(glsl_get_base_type(var->type));
+}
+
 bool gpir_compile_nir(struct lima_vs_shader_state *prog, struct nir_shader *nir)
 {
    nir_function_impl *func = nir_shader_get_entrypoint(nir);
@@ -393,6 +421,9 @@ bool gpir_compile_nir(struct lima_vs_shader_state *prog, struct nir_shader *nir)
    if (!gpir_value_regalloc_prog(comp))
       goto err_out0;
 
+   /* each value spilled to a physical reg gets a new one */
+   prog->stats.spills = comp->cur_reg - func->reg_alloc;
+
    if (!gpir_physical_regalloc_prog(comp))
       goto err_out0;
 
@@ -402,17 +433,26 @@ bool gpir_compile_nir(struct lima_vs_shader_state *prog, struct nir_shader *nir)
    if (!gpir_codegen_prog(comp))
       goto err_out0;
 
+   prog->stats.consts = prog->constant_size / sizeof(union fi);
+
+   prog->point_size_idx = -1;
    nir_foreach_variable(var, &nir->outputs) {
       if (var->data.location == VARYING_SLOT_POS)
          assert(var->data.driver_location == 0);
+      else if (var->data.location == VARYING_SLOT_PSIZ)
+         prog->point_size_idx = var->data.driver_location;
 
       struct lima_varying_info *v = prog->varying + var->data.driver_location;
-      if (!v->components) {
-         v->component_size = gpir_glsl_type_size(glsl_get_base_type(var->type));
+      if (!v->components)
          prog->num_varying++;
-      }
 
-      v->components += glsl_get_components(var->type);
+      /* a slot shared with a highp varying stays fp32 */
+      v->component_size = MAX2(v->component_size,
+                               gpir_varying_component_size(var));
+
+      /* linked shaders pack the varyings in the components of a slot */
+      v->components = MAX2(v->components, var->data.location_frac +
+                           glsl_get_components(var->type));
    }
 
    ralloc_free(comp);
@@ -282,7 +282,7 @@ void *gpir_node_create(gpir_block *block, gpir_op op)
 
    gpir_node_type type = gpir_op_infos[op].type;
    int size = node_size[type];
-   gpir_node *node = rzalloc_size(block, size);
+   gpir_node *node = linear_zalloc_child(block->comp->linear, size);
    if (unlikely(!node))
       return NULL;
 
@@ -319,7 +319,15 @@ gpir_dep *gpir_node_add_dep(gpir_node *succ, gpir_node *pred, int type)
       }
    }
 
-   gpir_dep *dep = ralloc(succ, gpir_dep);
+   gpir_compiler *comp = succ->block->comp;
+   gpir_dep *dep;
+   if (list_empty(&comp->dep_free_list))
+      dep = linear_alloc_child(comp->linear, sizeof(gpir_dep));
+   else {
+      dep = list_first_entry(&comp->dep_free_list, gpir_dep, succ_link);
+      list_del(&dep->succ_link);
+   }
+
    dep->type = type;
    dep->pred = pred;
    dep->succ = succ;
@@ -328,13 +336,20 @@ gpir_dep *gpir_node_add_dep(gpir_node *succ, gpir_node *pred, int type)
    return dep;
 }
 
+static void gpir_node_free_dep(gpir_dep *dep)
+{
+   gpir_compiler *comp = dep->succ->block->comp;
+
+   list_del(&dep->succ_link);
+   list_del(&dep->pred_link);
+   list_add(&dep->succ_link, &comp->dep_free_list);
+}
+
 void gpir_node_remove_dep(gpir_node *succ, gpir_node *pred)
 {
    gpir_node_foreach_pred(succ, dep) {
       if (dep->pred == pred) {
-         list_del(&dep->succ_link);
-         list_del(&dep->pred_link);
-         ralloc_free(dep);
+         gpir_node_free_dep(dep);
          return;
       }
    }
@@ -389,17 +404,11 @@ void gpir_node_insert_child(gpir_node *parent, gpir_node *child,
 
 void gpir_node_delete(gpir_node *node)
 {
-   gpir_node_foreach_succ_safe(node, dep) {
-      list_del(&dep->succ_link);
-      list_del(&dep->pred_link);
-      ralloc_free(dep);
-   }
+   gpir_node_foreach_succ_safe(node, dep)
+      gpir_node_free_dep(dep);
 
-   gpir_node_foreach_pred_safe(node, dep) {
-      list_del(&dep->succ_link);
-      list_del(&dep->pred_link);
-      ralloc_free(dep);
-   }
+   gpir_node_foreach_pred_safe(node, dep)
+      gpir_node_free_dep(dep);
 
    if (node->type == gpir_node_type_store) {
       gpir_store_node *store = gpir_node_to_store(node);
@@ -412,8 +421,8 @@ void gpir_node_delete(gpir_node *node)
          list_del(&load->reg_link);
    }
 
+   /* the node memory goes with the compiler linear allocator */
    list_del(&node->list);
-   ralloc_free(node);
 }
 
 static void gpir_node_print_node(gpir_node *node, int type, int space)
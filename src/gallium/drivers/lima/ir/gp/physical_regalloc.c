@@ -25,6 +25,7 @@
 #include <limits.h>
 
 #include "gpir.h"
+#include "lima_context.h"
 
 /* Linear scan register alloc for physical reg alloc of each
  * load/store node
@@ -113,12 +114,17 @@ bool gpir_physical_regalloc_prog(gpir_compiler *comp)
          }
       }
 
-      /* TODO: support spill to temp memory */
-      assert(i < GPIR_PHYSICAL_REG_NUM);
+      if (i == GPIR_PHYSICAL_REG_NUM) {
+         gpir_error("out of physical regs for spilled values\n");
+         return false;
+      }
    }
 
    /* update load/store node info for the real reg */
+   int num_reg = 0;
    list_for_each_entry(gpir_reg, reg, &comp->reg_list, list) {
+      num_reg = MAX2(num_reg, reg->index + 1);
+
       list_for_each_entry(gpir_store_node, store, &reg->defs_list, reg_link) {
          store->index = reg->index >> 2;
          store->component = reg->index % 4;
@@ -126,10 +132,12 @@ bool gpir_physical_regalloc_prog(gpir_compiler *comp)
 
       list_for_each_entry(gpir_load_node, load, &reg->uses_list, reg_link) {
          load->index = reg->index >> 2;
-         load->index = reg->index % 4;
+         load->component = reg->index % 4;
       }
    }
 
+   comp->prog->stats.regs = DIV_ROUND_UP(num_reg, 4);
+
    regalloc_print_result(comp);
    return true;
 }
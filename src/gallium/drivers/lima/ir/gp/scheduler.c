@@ -77,6 +77,13 @@
  * live, if n are scheduled in steps 3 and 4, there are 11-n left in step
  * 4 so at most 11-n-5 = 6-n are scheduled in step 5 and therefore 6 are
  * scheduled total, below the limit. So the algorithm will always succeed.
+ *
+ * The heuristic of step 6 takes the nodes with the longest latency
+ * weighted path to the leaves first, and among those the ones which fit
+ * in the fewest slots. When a node finds all its slots taken, an ALU node
+ * placed in one of them is moved to another free slot of the same
+ * instruction if that makes room, which changes nothing for the nodes
+ * scheduled so far.
  */
 
 static int gpir_min_dist_alu(gpir_dep *dep)
@@ -230,12 +237,36 @@ static void schedule_update_distance(gpir_node *node)
       if (pred->sched.dist < 0)
          schedule_update_distance(pred);
 
-      int dist = pred->sched.dist + 1;
+      /* fake deps may allow a negative or an impossible distance, they
+       * only count as one instruction on the critical path */
+      int latency = gpir_get_min_dist(dep);
+      if (latency < 1 || latency > 4)
+         latency = 1;
+
+      int dist = pred->sched.dist + latency;
       if (node->sched.dist < dist)
          node->sched.dist = dist;
    }
 }
 
+static int schedule_num_slots(gpir_node *node)
+{
+   int n = 0;
+   int *slots = gpir_op_infos[node->op].slots;
+   while (slots[n] != GPIR_INSTR_SLOT_END)
+      n++;
+   return n;
+}
+
+static bool schedule_before(gpir_node *a, gpir_node *b)
+{
+   if (a->sched.dist != b->sched.dist)
+      return a->sched.dist > b->sched.dist;
+
+   /* leave the flexible nodes for the slots still free afterwards */
+   return schedule_num_slots(a) < schedule_num_slots(b);
+}
+
 static void schedule_insert_ready_list(struct list_head *ready_list,
                                        gpir_node *insert_node)
 {
@@ -267,7 +298,7 @@ static void schedule_insert_ready_list(struct list_head *ready_list,
 
    struct list_head *insert_pos = ready_list;
    list_for_each_entry(gpir_node, node, ready_list, list) {
-      if (insert_node->sched.dist > node->sched.dist) {
+      if (schedule_before(insert_node, node)) {
          insert_pos = &node->list;
          break;
       }
@@ -361,6 +392,75 @@ static bool schedule_try_place_node(gpir_instr *instr, gpir_node *node)
    return false;
 }
 
+/* ALU nodes which can change slot within their instruction, the ones
+ * excluded either take two slots or have their latency, and so the
+ * schedule window of their predecessors, depend on the slot */
+static bool schedule_node_can_move_slot(gpir_node *node)
+{
+   return node->type == gpir_node_type_alu &&
+      node->op != gpir_op_mov &&
+      node->op != gpir_op_complex1 &&
+      node->op != gpir_op_select &&
+      !gpir_op_infos[node->op].may_consume_two_slots;
+}
+
+static bool schedule_try_move_slot(gpir_instr *instr, gpir_node *node)
+{
+   int old_pos = node->sched.pos;
+
+   int *slots = gpir_op_infos[node->op].slots;
+   for (int i = 0; slots[i] != GPIR_INSTR_SLOT_END; i++) {
+      if (slots[i] == old_pos)
+         continue;
+
+      node->sched.pos = slots[i];
+      if (gpir_instr_try_insert_node(instr, node))
+         return true;
+   }
+
+   node->sched.pos = old_pos;
+   return false;
+}
+
+/* try to make room for node by moving one ALU node of instr to another
+ * of its slots, everything is put back if it doesn't work */
+static bool schedule_try_place_node_displace(gpir_instr *instr, gpir_node *node)
+{
+   if (!schedule_node_can_move_slot(node) ||
+       instr->index < gpir_get_max_start(node) ||
+       instr->index > gpir_get_min_end(node))
+      return false;
+
+   int *slots = gpir_op_infos[node->op].slots;
+   for (int i = 0; slots[i] != GPIR_INSTR_SLOT_END; i++) {
+      gpir_node *other = instr->slots[slots[i]];
+      if (!other || !schedule_node_can_move_slot(other))
+         continue;
+
+      gpir_instr_remove_node(instr, other);
+
+      node->sched.instr = instr->index;
+      node->sched.pos = slots[i];
+      if (gpir_instr_try_insert_node(instr, node)) {
+         if (schedule_try_move_slot(instr, other)) {
+            gpir_debug("instr %d move node %d for node %d\n",
+                       instr->index, other->index, node->index);
+            return true;
+         }
+
+         gpir_instr_remove_node(instr, node);
+      }
+
+      node->sched.instr = -1;
+      node->sched.pos = -1;
+
+      MAYBE_UNUSED bool result = gpir_instr_try_insert_node(instr, other);
+      assert(result);
+   }
+
+   return false;
+}
+
 static gpir_node *schedule_create_move_node(gpir_node *node)
 {
    gpir_alu_node *move = gpir_node_create(node->block, gpir_op_mov);
@@ -522,6 +622,14 @@ static gpir_node *gpir_sched_instr_pass(gpir_instr *instr,
       }
    }
 
+   /* no slot left for any of them as placed, try moving nodes around */
+   list_for_each_entry(gpir_node, node, ready_list, list) {
+      if (node->sched.ready && schedule_try_place_node_displace(instr, node)) {
+         gpir_debug("remain fully ready node %d after move\n", node->index);
+         return node;
+      }
+   }
+
    return NULL;
 }
 
@@ -654,7 +762,7 @@ static void schedule_build_vreg_dependency(gpir_block *block)
 static void schedule_build_preg_dependency(gpir_compiler *comp)
 {
    /* merge reg with the same index */
-   gpir_reg *regs[GPIR_VALUE_REG_NUM] = {0};
+   gpir_reg *regs[GPIR_PHYSICAL_REG_NUM] = {0};
    list_for_each_entry(gpir_reg, reg, &comp->reg_list, list) {
       if (!regs[reg->index])
          regs[reg->index] = reg;
@@ -665,7 +773,7 @@ static void schedule_build_preg_dependency(gpir_compiler *comp)
    }
 
    /* calculate physical reg read/write dependency for load/store nodes */
-   for (int i = 0; i < GPIR_VALUE_REG_NUM; i++) {
+   for (int i = 0; i < GPIR_PHYSICAL_REG_NUM; i++) {
       gpir_reg *reg = regs[i];
       if (!reg)
          continue;
@@ -763,6 +871,30 @@ static void print_statistic(gpir_compiler *comp, int save_index)
    if (l % 4)
       printf("\n");
    printf("\ntotal: %d\n", n);
+
+   /* the longest path of each block and the ALU slots of the original
+    * nodes bound the instruction count from below */
+   int num_instr = 0, path_bound = 0, slot_bound = 0, num_alu = 0;
+   list_for_each_entry(gpir_block, block, &comp->block_list, list) {
+      int max_dist = 0, block_alu = 0;
+      list_for_each_entry(gpir_node, node, &block->node_list, list) {
+         if (node->index >= save_index)
+            continue;
+         if (node->sched.dist > max_dist)
+            max_dist = node->sched.dist;
+         if (node->type == gpir_node_type_alu)
+            block_alu++;
+      }
+
+      num_instr += list_length(&block->instr_list);
+      path_bound += max_dist + 1;
+      slot_bound += DIV_ROUND_UP(block_alu, 6);
+      num_alu += block_alu;
+   }
+
+   printf("---- how many instrs are scheduled ----\n");
+   printf("instrs: %d, critical path: %d, alu slots: %d (%d nodes)\n",
+          num_instr, path_bound, slot_bound, num_alu);
    printf("------------------------------------\n");
 }
 
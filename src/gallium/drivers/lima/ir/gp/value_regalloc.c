@@ -22,28 +22,97 @@
  *
  */
 
+#include <limits.h>
+
 #include "gpir.h"
 
 /* Linear scan register alloc for value reg alloc of each node */
 
-static int regalloc_spill_active_node(gpir_node *active[])
+/* uniform and attribute loads without an indirect offset can simply be
+ * done again where they're used, which needs no physical reg */
+static bool regalloc_can_rematerialize(gpir_node *node)
+{
+   return (node->op == gpir_op_load_uniform ||
+           node->op == gpir_op_load_attribute) &&
+      gpir_node_is_leaf(node);
+}
+
+/* cost of spilling node at sequence index cur: each use left has to
+ * load the value back, the sooner the first one comes the worse */
+static float regalloc_spill_cost(gpir_node *node, int cur)
+{
+   int num_uses = 0, next = INT_MAX;
+   gpir_node_foreach_succ(node, dep) {
+      int index = dep->succ->vreg.index;
+      if (index >= cur) {
+         num_uses++;
+         if (index < next)
+            next = index;
+      }
+   }
+
+   if (!num_uses)
+      return 0.0f;
+
+   return (float)num_uses / (next - cur + 1);
+}
+
+static void regalloc_rematerialize(gpir_node *node)
+{
+   gpir_load_node *load = gpir_node_to_load(node);
+
+   gpir_node_foreach_succ_safe(node, dep) {
+      gpir_node *succ = dep->succ;
+      gpir_load_node *clone = gpir_node_create(succ->block, node->op);
+      clone->index = load->index;
+      clone->component = load->component;
+
+      gpir_node_replace_pred(dep, &clone->node);
+      gpir_node_replace_child(succ, node, &clone->node);
+      list_addtail(&clone->node.list, &succ->list);
+
+      /* like the loads of a spill below */
+      clone->node.value_reg = node->value_reg;
+      clone->node.vreg.index =
+         (list_first_entry(&clone->node.list, gpir_node, list)->vreg.index +
+          list_last_entry(&clone->node.list, gpir_node, list)->vreg.index) / 2.0f;
+      clone->node.vreg.last = succ;
+   }
+
+   gpir_node_delete(node);
+}
+
+static int regalloc_spill_active_node(gpir_node *active[], int cur)
 {
+   /* the cheapest spill, with rematerializable nodes before any other */
    gpir_node *spill = NULL;
+   bool spill_remat = false;
+   float spill_cost = 0.0f;
    for (int i = 0; i < GPIR_VALUE_REG_NUM; i++) {
       if (gpir_op_infos[active[i]->op].spillless)
          continue;
 
-      /* spill farest node */
-      if (!spill ||
-          spill->vreg.last->vreg.index < active[i]->vreg.last->vreg.index) {
+      bool remat = regalloc_can_rematerialize(active[i]);
+      float cost = regalloc_spill_cost(active[i], cur);
+      if (!spill || (remat && !spill_remat) ||
+          (remat == spill_remat && cost < spill_cost)) {
          spill = active[i];
+         spill_remat = remat;
+         spill_cost = cost;
       }
    }
 
    assert(spill);
-   gpir_debug("value regalloc spill node %d for value reg %d\n",
+   gpir_debug("value regalloc %s node %d for value reg %d\n",
+              spill_remat ? "rematerialize" : "spill",
               spill->index, spill->value_reg);
 
+   if (spill_remat) {
+      int reg = spill->value_reg;
+      regalloc_rematerialize(spill);
+      return reg;
+   }
+
    /* create store node for spilled node */
    gpir_store_node *store = gpir_node_create(spill->block, gpir_op_store_reg);
    store->child = spill;
@@ -129,7 +198,7 @@ static void regalloc_block(gpir_block *block)
 
       /* need spill */
       if (i == GPIR_VALUE_REG_NUM) {
-         int spilled_reg = regalloc_spill_active_node(active);
+         int spilled_reg = regalloc_spill_active_node(active, node->vreg.index);
          active[spilled_reg] = node;
          node->value_reg = spilled_reg;
          gpir_debug("value regalloc node %d reuse reg %d\n",
@@ -28,6 +28,7 @@
 
 extern bool lima_shader_debug_gp;
 extern bool lima_shader_debug_pp;
+extern bool lima_fp16_varying;
 
 #define gpir_debug(...)                \
    do {                                \
@@ -52,6 +53,7 @@ struct ra_regs;
 struct nir_shader;
 struct lima_vs_shader_state;
 struct lima_fs_shader_state;
+struct lima_preshader;
 
 /* gpir interface */
 bool gpir_compile_nir(struct lima_vs_shader_state *prog, struct nir_shader *nir);
@@ -62,4 +64,15 @@ bool ppir_compile_nir(struct lima_fs_shader_state *prog, struct nir_shader *nir,
                       struct ra_regs *ra);
 struct ra_regs *ppir_regalloc_init(void *mem_ctx);
 
+/* lima_nir_algebraic.py */
+bool lima_nir_opt_algebraic_gp(struct nir_shader *shader);
+bool lima_nir_opt_algebraic_pp(struct nir_shader *shader);
+
+/* lima_nir_preshader.c */
+bool lima_nir_preshader(struct nir_shader *shader, struct lima_preshader *ps,
+                        void *mem_ctx);
+bool lima_preshader_is_valid(const struct lima_preshader *ps);
+void lima_preshader_run(const struct lima_preshader *ps, const float *uniforms,
+                        unsigned num_uniforms, float *outputs);
+
 #endif
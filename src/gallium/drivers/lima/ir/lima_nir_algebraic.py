@@ -0,0 +1,115 @@
+#
+# Copyright (c) 2018 Lima Project
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sub license,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the
+# next paragraph) shall be included in all copies or substantial portions
+# of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#
+
+import argparse
+import sys
+
+a = 'a'
+b = 'b'
+
+# rcp and rsqrt go through the gp complex unit, which takes the whole
+# complex1/complex2/impl chain, and through the single scalar combine
+# slot of a pp instr, so trade two of them for a mul
+complex_unit = [
+   (('~fmul', ('frcp(is_used_once)', a), ('frcp(is_used_once)', b)),
+    ('frcp', ('fmul', a, b))),
+   (('~fmul', ('frsq(is_used_once)', a), ('frsq(is_used_once)', b)),
+    ('frsq', ('fmul', a, b))),
+]
+
+gp_algebraic = complex_unit
+
+pp_algebraic = complex_unit + [
+   # ppir_lower_dot turns a dot into a vec mul feeding a sum, the negate
+   # is free on the mul srcs but needs a mov on the sum result
+   (('fneg', ('fdot2', a, b)), ('fdot2', ('fneg', a), b)),
+   (('fneg', ('fdot3', a, b)), ('fdot3', ('fneg', a), b)),
+   (('fneg', ('fdot4', a, b)), ('fdot4', ('fneg', a), b)),
+   (('fdot2', ('fneg', a), ('fneg', b)), ('fdot2', a, b)),
+   (('fdot3', ('fneg', a), ('fneg', b)), ('fdot3', a, b)),
+   (('fdot4', ('fneg', a), ('fneg', b)), ('fdot4', a, b)),
+
+   # pp alu works in fp16, clamps outside of its range only keep the inf
+   (('~fmin', a, '#b(is_ge_fp16_max)'), a),
+   (('~fmax', a, '#b(is_le_fp16_min)'), a),
+]
+
+helpers = """
+static inline bool
+is_ge_fp16_max(nir_alu_instr *instr, unsigned src, unsigned num_components,
+               const uint8_t *swizzle)
+{
+   nir_const_value *val = nir_src_as_const_value(instr->src[src].src);
+
+   if (!val)
+      return false;
+
+   for (unsigned i = 0; i < num_components; i++) {
+      if (val->f32[swizzle[i]] < 65504.0f)
+         return false;
+   }
+
+   return true;
+}
+
+static inline bool
+is_le_fp16_min(nir_alu_instr *instr, unsigned src, unsigned num_components,
+               const uint8_t *swizzle)
+{
+   nir_const_value *val = nir_src_as_const_value(instr->src[src].src);
+
+   if (!val)
+      return false;
+
+   for (unsigned i = 0; i < num_components; i++) {
+      if (val->f32[swizzle[i]] > -65504.0f)
+         return false;
+   }
+
+   return true;
+}
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-p', '--import-path', required=True)
+    args = parser.parse_args()
+    sys.path.insert(0, args.import_path)
+    run()
+
+
+def run():
+    import nir_algebraic  # pylint: disable=import-error
+
+    print '#include "nir.h"'
+    print '#include "ir/lima_ir.h"'
+    print helpers
+    print nir_algebraic.AlgebraicPass("lima_nir_opt_algebraic_gp",
+                                      gp_algebraic).render()
+    print nir_algebraic.AlgebraicPass("lima_nir_opt_algebraic_pp",
+                                      pp_algebraic).render()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "util/ralloc.h"
+#include "compiler/nir/nir.h"
+#include "compiler/nir/nir_builder.h"
+#include "compiler/nir/nir_constant_expressions.h"
+
+#include "lima_context.h"
+#include "lima_ir.h"
+
+/*
+ * Moves the alu ops computing from uniforms and constants alone, like the
+ * light directions normalized or the colors multiplied by fixed function,
+ * out of the fragment shader. Each of these exprs read by the rest of the
+ * shader becomes the load of a new uniform slot, after the ones of the
+ * shader uniforms, and lima_preshader_run fills it in with the result when
+ * the uniforms are uploaded for a draw.
+ */
+
+struct preshader_state {
+   struct lima_preshader *ps;
+   /* of each ssa def */
+   bool *uniform_only;
+   /* the value of each ssa def added, -1 before */
+   int *value;
+};
+
+static bool
+load_uniform_slot(nir_intrinsic_instr *intr, int *slot)
+{
+   nir_const_value *offset = nir_src_as_const_value(intr->src[0]);
+   if (!offset)
+      return false;
+
+   *slot = nir_intrinsic_base(intr) + offset->i32[0];
+   return true;
+}
+
+static bool
+instr_is_uniform_only(struct preshader_state *state, nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_load_const:
+      return nir_instr_as_load_const(instr)->def.bit_size == 32;
+
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+      int slot;
+
+      /* ppir loads the uniforms from the first component of the slot */
+      return intr->intrinsic == nir_intrinsic_load_uniform &&
+         intr->dest.is_ssa && intr->dest.ssa.bit_size == 32 &&
+         !nir_intrinsic_component(intr) && load_uniform_slot(intr, &slot);
+   }
+
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+
+      if (!alu->dest.dest.is_ssa || alu->dest.dest.ssa.bit_size != 32 ||
+          alu->dest.saturate)
+         return false;
+
+      for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         nir_alu_src *src = alu->src + i;
+
+         if (!src->src.is_ssa || src->src.ssa->bit_size != 32 ||
+             src->abs || src->negate ||
+             !state->uniform_only[src->src.ssa->index])
+            return false;
+      }
+      return true;
+   }
+
+   default:
+      return false;
+   }
+}
+
+/* a mov is a load of the uniform already */
+static bool
+alu_is_root(struct preshader_state *state, nir_alu_instr *alu)
+{
+   if (alu->op == nir_op_fmov || alu->op == nir_op_imov)
+      return false;
+
+   if (!list_empty(&alu->dest.dest.ssa.if_uses))
+      return true;
+
+   nir_foreach_use(src, &alu->dest.dest.ssa) {
+      nir_instr *user = src->parent_instr;
+      if (user->type != nir_instr_type_alu)
+         return true;
+
+      nir_alu_dest *dest = &nir_instr_as_alu(user)->dest;
+      if (!dest->dest.is_ssa || !state->uniform_only[dest->dest.ssa.index])
+         return true;
+   }
+
+   return false;
+}
+
+/* Returns the value of the def, the ones of its srcs added first, or -1
+ * when the preshader is full. */
+static int
+preshader_add_value(struct preshader_state *state, nir_ssa_def *def)
+{
+   struct lima_preshader *ps = state->ps;
+   nir_instr *instr = def->parent_instr;
+   struct lima_preshader_value value;
+
+   if (state->value[def->index] >= 0)
+      return state->value[def->index];
+
+   memset(&value, 0, sizeof(value));
+   value.num_components = def->num_components;
+
+   switch (instr->type) {
+   case nir_instr_type_load_const:
+      value.type = LIMA_PRESHADER_CONST;
+      memcpy(value.data, nir_instr_as_load_const(instr)->value.u32,
+             def->num_components * sizeof(uint32_t));
+      break;
+
+   case nir_instr_type_intrinsic: {
+      int slot;
+
+      load_uniform_slot(nir_instr_as_intrinsic(instr), &slot);
+      value.type = LIMA_PRESHADER_UNIFORM;
+      value.data[0] = slot;
+      break;
+   }
+
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+
+      value.type = LIMA_PRESHADER_ALU;
+      value.op = alu->op;
+      for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         int src = preshader_add_value(state, alu->src[i].src.ssa);
+         if (src < 0)
+            return -1;
+
+         value.src[i] = src;
+         memcpy(value.swizzle[i], alu->src[i].swizzle, 4);
+      }
+      break;
+   }
+
+   default:
+      unreachable("not uniform only");
+   }
+
+   if (ps->num_values == LIMA_PRESHADER_MAX_VALUES)
+      return -1;
+
+   ps->values[ps->num_values] = value;
+   state->value[def->index] = ps->num_values;
+   return ps->num_values++;
+}
+
+static void
+preshader_rewrite_root(nir_builder *b, nir_alu_instr *alu, int slot)
+{
+   nir_ssa_def *def = &alu->dest.dest.ssa;
+
+   b->cursor = nir_before_instr(&alu->instr);
+
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(b->shader, nir_intrinsic_load_uniform);
+   load->num_components = def->num_components;
+   load->src[0] = nir_src_for_ssa(nir_imm_int(b, 0));
+   nir_intrinsic_set_base(load, slot);
+   nir_intrinsic_set_range(load, 1);
+   nir_ssa_dest_init(&load->instr, &load->dest, def->num_components, 32,
+                     NULL);
+   nir_builder_instr_insert(b, &load->instr);
+
+   /* the alu is dead after, the dce removes the expr */
+   nir_ssa_def_rewrite_uses(def, nir_src_for_ssa(&load->dest.ssa));
+}
+
+/* The values and outputs are allocated from mem_ctx. Returns false, with
+ * no outputs, when there is no expr to move or the uniforms are indexed. */
+bool
+lima_nir_preshader(nir_shader *shader, struct lima_preshader *ps,
+                   void *mem_ctx)
+{
+   nir_function_impl *impl = nir_shader_get_entrypoint(shader);
+   void *tmp_ctx = ralloc_context(NULL);
+   struct preshader_state state;
+   int max_slot = -1;
+   bool progress = false;
+
+   memset(ps, 0, sizeof(*ps));
+   state.ps = ps;
+   state.uniform_only = rzalloc_array(tmp_ctx, bool, impl->ssa_alloc);
+   state.value = ralloc_array(tmp_ctx, int, impl->ssa_alloc);
+   ps->values = ralloc_array(tmp_ctx, struct lima_preshader_value,
+                             LIMA_PRESHADER_MAX_VALUES);
+   nir_alu_instr **roots = ralloc_array(tmp_ctx, nir_alu_instr *,
+                                        LIMA_PRESHADER_MAX_VALUES);
+   if (!state.uniform_only || !state.value || !ps->values || !roots)
+      goto out;
+
+   memset(state.value, -1, impl->ssa_alloc * sizeof(int));
+
+   /* the defs come before their uses but in phis, which aren't uniform
+    * only anyway */
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_intrinsic &&
+             nir_instr_as_intrinsic(instr)->intrinsic ==
+             nir_intrinsic_load_uniform) {
+            int slot;
+            if (!load_uniform_slot(nir_instr_as_intrinsic(instr), &slot))
+               goto out;
+            max_slot = MAX2(max_slot, slot);
+         }
+
+         if (instr_is_uniform_only(&state, instr)) {
+            nir_ssa_def *def = instr->type == nir_instr_type_alu ?
+               &nir_instr_as_alu(instr)->dest.dest.ssa :
+               instr->type == nir_instr_type_intrinsic ?
+               &nir_instr_as_intrinsic(instr)->dest.ssa :
+               &nir_instr_as_load_const(instr)->def;
+            state.uniform_only[def->index] = true;
+         }
+      }
+   }
+
+   ps->base = max_slot + 1;
+   int max_outputs = MIN2(LIMA_PRESHADER_MAX_VALUES,
+                          LIMA_MAX_CONST_BUFFER_SIZE / 16 - ps->base);
+   if (max_outputs <= 0)
+      goto out;
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type != nir_instr_type_alu)
+            continue;
+
+         nir_alu_instr *alu = nir_instr_as_alu(instr);
+         if (!state.uniform_only[alu->dest.dest.ssa.index] ||
+             !alu_is_root(&state, alu))
+            continue;
+
+         /* the rest stays in the shader once full */
+         if (ps->num_outputs == max_outputs ||
+             preshader_add_value(&state, &alu->dest.dest.ssa) < 0)
+            goto rewrite;
+
+         roots[ps->num_outputs++] = alu;
+      }
+   }
+
+rewrite:
+   if (!ps->num_outputs)
+      goto out;
+
+   /* the values added for a root which didn't fit come last */
+   nir_alu_instr *last = roots[ps->num_outputs - 1];
+   ps->num_values = state.value[last->dest.dest.ssa.index] + 1;
+   ps->outputs = ralloc_array(mem_ctx, uint8_t, ps->num_outputs);
+   struct lima_preshader_value *values =
+      ralloc_array(mem_ctx, struct lima_preshader_value, ps->num_values);
+   if (!ps->outputs || !values) {
+      ralloc_free(ps->outputs);
+      ralloc_free(values);
+      goto out;
+   }
+   memcpy(values, ps->values, ps->num_values * sizeof(*values));
+   ps->values = values;
+
+   nir_builder b;
+   nir_builder_init(&b, impl);
+   for (int i = 0; i < ps->num_outputs; i++) {
+      ps->outputs[i] = state.value[roots[i]->dest.dest.ssa.index];
+      preshader_rewrite_root(&b, roots[i], ps->base + i);
+   }
+
+   nir_metadata_preserve(impl, nir_metadata_block_index |
+                               nir_metadata_dominance);
+   progress = true;
+
+out:
+   if (!progress)
+      memset(ps, 0, sizeof(*ps));
+
+   ralloc_free(tmp_ctx);
+   return progress;
+}
+
+/* The values read only earlier ones and the outputs are values, as built
+ * above, for a preshader from somewhere else like the disk cache. */
+bool
+lima_preshader_is_valid(const struct lima_preshader *ps)
+{
+   if (ps->num_values <= 0 || ps->num_values > LIMA_PRESHADER_MAX_VALUES ||
+       ps->num_outputs <= 0 || ps->num_outputs > LIMA_PRESHADER_MAX_VALUES ||
+       ps->base < 0 ||
+       ps->base + ps->num_outputs > LIMA_MAX_CONST_BUFFER_SIZE / 16)
+      return false;
+
+   for (int i = 0; i < ps->num_values; i++) {
+      const struct lima_preshader_value *value = ps->values + i;
+
+      if (value->num_components > 4)
+         return false;
+
+      switch (value->type) {
+      case LIMA_PRESHADER_CONST:
+      case LIMA_PRESHADER_UNIFORM:
+         break;
+
+      case LIMA_PRESHADER_ALU: {
+         if (value->op >= nir_num_opcodes)
+            return false;
+
+         const nir_op_info *info = nir_op_infos + value->op;
+         if (info->num_inputs > 4)
+            return false;
+         for (unsigned j = 0; j < info->num_inputs; j++) {
+            if (value->src[j] >= i)
+               return false;
+            for (unsigned k = 0; k < 4; k++) {
+               if (value->swizzle[j][k] >= 4)
+                  return false;
+            }
+         }
+         break;
+      }
+
+      default:
+         return false;
+      }
+   }
+
+   for (int i = 0; i < ps->num_outputs; i++) {
+      if (ps->outputs[i] >= ps->num_values)
+         return false;
+   }
+
+   return true;
+}
+
+/* num_uniforms floats are read from uniforms, the part of a slot past
+ * them is 0. A vec4 slot of outputs each, the unused components 0. */
+void
+lima_preshader_run(const struct lima_preshader *ps, const float *uniforms,
+                   unsigned num_uniforms, float *outputs)
+{
+   nir_const_value values[LIMA_PRESHADER_MAX_VALUES];
+
+   for (int i = 0; i < ps->num_values; i++) {
+      const struct lima_preshader_value *value = ps->values + i;
+      nir_const_value *dest = values + i;
+
+      memset(dest, 0, sizeof(*dest));
+
+      switch (value->type) {
+      case LIMA_PRESHADER_CONST:
+         memcpy(dest->u32, value->data, sizeof(value->data));
+         break;
+
+      case LIMA_PRESHADER_UNIFORM:
+         for (unsigned j = 0; j < value->num_components; j++) {
+            unsigned index = value->data[0] * 4 + j;
+            if (index < num_uniforms)
+               dest->f32[j] = uniforms[index];
+         }
+         break;
+
+      case LIMA_PRESHADER_ALU: {
+         const nir_op_info *info = nir_op_infos + value->op;
+         nir_const_value src[4];
+
+         memset(src, 0, sizeof(src));
+         for (unsigned j = 0; j < info->num_inputs; j++) {
+            for (unsigned k = 0; k < 4; k++)
+               src[j].u32[k] = values[value->src[j]].u32[value->swizzle[j][k]];
+         }
+
+         *dest = nir_eval_const_opcode(value->op, value->num_components,
+                                       32, src);
+
+         /* the components past the dest ones may be garbage */
+         for (unsigned j = value->num_components; j < 4; j++)
+            dest->u32[j] = 0;
+         break;
+      }
+      }
+   }
+
+   for (int i = 0; i < ps->num_outputs; i++)
+      memcpy(outputs + i * 4, values[ps->outputs[i]].f32, 4 * sizeof(float));
+}
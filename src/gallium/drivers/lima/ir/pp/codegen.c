@@ -54,7 +54,9 @@ static void ppir_codegen_encode_varying(ppir_node *node, void *code)
    int num_components = load->num_components;
 
    if (num_components) {
-      assert(node->op == ppir_op_load_varying || node->op == ppir_op_load_coords);
+      assert(node->op == ppir_op_load_varying ||
+             node->op == ppir_op_load_coords ||
+             node->op == ppir_op_load_pointcoord);
 
       f->imm.dest = index >> 2;
       f->imm.mask = dest->write_mask << (index & 0x3);
@@ -67,6 +69,10 @@ static void ppir_codegen_encode_varying(ppir_node *node, void *code)
          f->imm.index = load->index >> 2;
       else
          f->imm.index = load->index >> alignment;
+
+      /* the coord of the fragment in the point sprite, not a varying */
+      if (node->op == ppir_op_load_pointcoord)
+         f->imm.source_type = 3;
    }
    else {
       assert(node->op == ppir_op_load_coords);
@@ -102,7 +108,13 @@ static void ppir_codegen_encode_uniform(ppir_node *node, void *code)
    ppir_codegen_field_uniform *f = code;
    ppir_load_node *load = ppir_node_to_load(node);
 
-   if (node->op == ppir_op_load_uniform) {
+   if (node->op == ppir_op_load_temp) {
+      /* fill of a vec4 spill slot, see ppir_regalloc_spill_reg */
+      f->source = ppir_codegen_uniform_src_temporary;
+      f->alignment = 2;
+      f->index = load->index;
+   }
+   else if (node->op == ppir_op_load_uniform) {
       int num_components = load->num_components;
       int alignment = num_components == 4 ? 2 : num_components - 1;
 
@@ -147,6 +159,18 @@ static void ppir_codegen_encode_vec_mul(ppir_node *node, void *code)
    case ppir_op_min:
       f->op = ppir_codegen_vec4_mul_op_min;
       break;
+   case ppir_op_lt:
+      f->op = ppir_codegen_vec4_mul_op_lt;
+      break;
+   case ppir_op_le:
+      f->op = ppir_codegen_vec4_mul_op_le;
+      break;
+   case ppir_op_eq:
+      f->op = ppir_codegen_vec4_mul_op_eq;
+      break;
+   case ppir_op_ne:
+      f->op = ppir_codegen_vec4_mul_op_neq;
+      break;
    default:
       break;
    }
@@ -196,6 +220,18 @@ static void ppir_codegen_encode_scl_mul(ppir_node *node, void *code)
    case ppir_op_min:
       f->op = ppir_codegen_float_mul_op_min;
       break;
+   case ppir_op_lt:
+      f->op = ppir_codegen_float_mul_op_lt;
+      break;
+   case ppir_op_le:
+      f->op = ppir_codegen_float_mul_op_le;
+      break;
+   case ppir_op_eq:
+      f->op = ppir_codegen_float_mul_op_eq;
+      break;
+   case ppir_op_ne:
+      f->op = ppir_codegen_float_mul_op_neq;
+      break;
    default:
       break;
    }
@@ -240,6 +276,28 @@ static void ppir_codegen_encode_vec_add(ppir_node *node, void *code)
       f->op = ppir_codegen_vec4_acc_op_sum4;
       dest_shift = 0;
       break;
+   case ppir_op_max:
+      f->op = ppir_codegen_vec4_acc_op_max;
+      break;
+   case ppir_op_min:
+      f->op = ppir_codegen_vec4_acc_op_min;
+      break;
+   case ppir_op_lt:
+      f->op = ppir_codegen_vec4_acc_op_lt;
+      break;
+   case ppir_op_le:
+      f->op = ppir_codegen_vec4_acc_op_le;
+      break;
+   case ppir_op_eq:
+      f->op = ppir_codegen_vec4_acc_op_eq;
+      break;
+   case ppir_op_ne:
+      f->op = ppir_codegen_vec4_acc_op_neq;
+      break;
+   case ppir_op_select:
+      /* the condition comes from ^fmul, see ppir_lower_select */
+      f->op = ppir_codegen_vec4_acc_op_sel;
+      break;
    default:
       break;
    }
@@ -293,6 +351,18 @@ static void ppir_codegen_encode_scl_add(ppir_node *node, void *code)
    case ppir_op_min:
       f->op = ppir_codegen_float_acc_op_min;
       break;
+   case ppir_op_lt:
+      f->op = ppir_codegen_float_acc_op_lt;
+      break;
+   case ppir_op_le:
+      f->op = ppir_codegen_float_acc_op_le;
+      break;
+   case ppir_op_eq:
+      f->op = ppir_codegen_float_acc_op_eq;
+      break;
+   case ppir_op_ne:
+      f->op = ppir_codegen_float_acc_op_neq;
+      break;
    default:
       break;
    }
@@ -320,6 +390,7 @@ static void ppir_codegen_encode_combine(ppir_node *node, void *code)
    ppir_alu_node *alu = ppir_node_to_alu(node);
 
    switch (node->op) {
+   case ppir_op_sqrt:
    case ppir_op_rsqrt:
    case ppir_op_log2:
    case ppir_op_exp2:
@@ -332,7 +403,7 @@ static void ppir_codegen_encode_combine(ppir_node *node, void *code)
       int dest_component = ffs(dest->write_mask) - 1;
       assert(dest_component >= 0);
       f->scalar.dest = ppir_target_get_dest_reg_index(dest) + dest_component;
-      f->scalar.dest = dest->modifier;
+      f->scalar.dest_modifier = dest->modifier;
 
       ppir_src *src = alu->src;
       f->scalar.arg0_src = get_scl_reg_index(src, dest_component);
@@ -340,6 +411,9 @@ static void ppir_codegen_encode_combine(ppir_node *node, void *code)
       f->scalar.arg0_negate = src->negate;
 
       switch (node->op) {
+      case ppir_op_sqrt:
+         f->scalar.op = ppir_codegen_combine_scalar_op_sqrt;
+         break;
       case ppir_op_rsqrt:
          f->scalar.op = ppir_codegen_combine_scalar_op_rsqrt;
          break;
@@ -363,7 +437,62 @@ static void ppir_codegen_encode_combine(ppir_node *node, void *code)
 
 static void ppir_codegen_encode_store_temp(ppir_node *node, void *code)
 {
-   
+   ppir_codegen_field_temp_write *f = code;
+   ppir_store_node *store = ppir_node_to_store(node);
+
+   /* spill slots are always a full vec4 from a head reg */
+   f->temp_write.dest = 0x3;
+   f->temp_write.source = ppir_target_get_src_reg_index(&store->src);
+   f->temp_write.alignment = 1;
+   f->temp_write.index = store->index;
+}
+
+/* empty blocks like the loop header have no instr, the target is the
+ * first instr laid out from the target block on */
+static ppir_instr *ppir_codegen_get_target_instr(ppir_block *target)
+{
+   ppir_compiler *comp = target->comp;
+
+   list_for_each_entry_from(ppir_block, block, &target->list,
+                            &comp->block_list, list) {
+      if (!list_empty(&block->instr_list))
+         return list_first_entry(&block->instr_list, ppir_instr, list);
+   }
+
+   return NULL;
+}
+
+static void ppir_codegen_encode_branch(ppir_node *node, void *code)
+{
+   ppir_codegen_field_branch *f = code;
+   ppir_branch_node *branch = ppir_node_to_branch(node);
+
+   if (node->op == ppir_op_discard) {
+      f->discard.word0 = PPIR_CODEGEN_DISCARD_WORD0;
+      f->discard.word1 = PPIR_CODEGEN_DISCARD_WORD1;
+      f->discard.word2 = PPIR_CODEGEN_DISCARD_WORD2;
+      return;
+   }
+
+   if (branch->num_src) {
+      f->branch.arg0_source = get_scl_reg_index(branch->src, 0);
+      f->branch.arg1_source = get_scl_reg_index(branch->src + 1, 0);
+      f->branch.cond_gt = branch->cond_gt;
+      f->branch.cond_eq = branch->cond_eq;
+      f->branch.cond_lt = branch->cond_lt;
+   }
+   else {
+      f->branch.cond_gt = true;
+      f->branch.cond_eq = true;
+      f->branch.cond_lt = true;
+   }
+
+   ppir_instr *target = ppir_codegen_get_target_instr(branch->target);
+   assert(target);
+
+   /* both are in words from the branch instr */
+   f->branch.target = target->offset - node->instr->offset;
+   f->branch.next_count = target->encode_size;
 }
 
 static void ppir_codegen_encode_const(ppir_const *constant, uint16_t *code)
@@ -385,6 +514,7 @@ ppir_codegen_encode_slot[PPIR_INSTR_SLOT_NUM] = {
    [PPIR_INSTR_SLOT_ALU_SCL_ADD] = ppir_codegen_encode_scl_add,
    [PPIR_INSTR_SLOT_ALU_COMBINE] = ppir_codegen_encode_combine,
    [PPIR_INSTR_SLOT_STORE_TEMP] = ppir_codegen_encode_store_temp,
+   [PPIR_INSTR_SLOT_BRANCH] = ppir_codegen_encode_branch,
 };
 
 static const int ppir_codegen_field_size[] = {
@@ -514,12 +644,24 @@ static void ppir_codegen_print_prog(ppir_compiler *comp)
 
 bool ppir_codegen_prog(ppir_compiler *comp)
 {
+   struct lima_shader_stats *stats = &comp->prog->stats;
+
    int size = 0;
    list_for_each_entry(ppir_block, block, &comp->block_list, list) {
       list_for_each_entry(ppir_instr, instr, &block->instr_list, list) {
-         size += get_instr_encode_size(instr);
+         instr->offset = size;
+         instr->encode_size = get_instr_encode_size(instr);
+         size += instr->encode_size;
+
+         stats->instrs++;
+         for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+            if (instr->slots[i])
+               stats->slots++;
+         }
+         stats->consts += instr->constant[0].num + instr->constant[1].num;
       }
    }
+   stats->max_slots = stats->instrs * PPIR_INSTR_SLOT_NUM;
 
    uint32_t *prog = rzalloc_size(comp->prog, size * sizeof(uint32_t));
    if (!prog)
@@ -28,13 +28,15 @@
 
 ppir_instr *ppir_instr_create(ppir_block *block)
 {
-   ppir_instr *instr = rzalloc(block, ppir_instr);
+   ppir_instr *instr = linear_zalloc_child(block->comp->linear,
+                                           sizeof(ppir_instr));
    if (!instr)
       return NULL;
 
    list_inithead(&instr->succ_list);
    list_inithead(&instr->pred_list);
 
+   instr->block = block;
    instr->index = block->comp->cur_instr_index++;
    instr->reg_pressure = -1;
 
@@ -50,7 +52,8 @@ void ppir_instr_add_dep(ppir_instr *succ, ppir_instr *pred)
          return;
    }
 
-   ppir_dep *dep = ralloc(succ, ppir_dep);
+   ppir_dep *dep = linear_alloc_child(succ->block->comp->linear,
+                                      sizeof(ppir_dep));
    dep->pred = pred;
    dep->succ = succ;
    list_addtail(&dep->pred_link, &succ->pred_list);
@@ -83,6 +86,9 @@ void ppir_instr_insert_mul_node(ppir_node *add, ppir_node *mul)
                   return;
                /* swap src0 and src1 if needed */
                if (src1) {
+                  if (add->op == ppir_op_lt || add->op == ppir_op_le)
+                     return;
+
                   ppir_src tmp = add_alu->src[0];
                   add_alu->src[0] = add_alu->src[1];
                   add_alu->src[1] = tmp;
@@ -133,13 +139,13 @@ static bool ppir_instr_insert_const(ppir_const *dst, const ppir_const *src,
 static void ppir_instr_update_src_pipeline(ppir_instr *instr, ppir_pipeline pipeline,
                                            ppir_dest *dest, uint8_t *swizzle)
 {
-   for (int i = PPIR_INSTR_SLOT_ALU_START; i <= PPIR_INSTR_SLOT_ALU_END; i++) {
-      if (!instr->slots[i])
+   for (int i = PPIR_INSTR_SLOT_ALU_START; i <= PPIR_INSTR_SLOT_BRANCH; i++) {
+      ppir_node *node = instr->slots[i];
+      if (!node)
          continue;
 
-      ppir_alu_node *alu = ppir_node_to_alu(instr->slots[i]);
-      for (int j = 0; j < alu->num_src; j++) {
-         ppir_src *src = alu->src + j;
+      for (int j = 0; j < ppir_node_get_src_num(node); j++) {
+         ppir_src *src = ppir_node_get_src(node, j);
          if (ppir_node_target_equal(src, dest)) {
             src->type = ppir_target_pipeline;
             src->pipeline = pipeline;
@@ -228,6 +234,7 @@ static struct {
    [PPIR_INSTR_SLOT_ALU_SCL_ADD] = { 4, "sadd" },
    [PPIR_INSTR_SLOT_ALU_COMBINE] = { 4, "comb" },
    [PPIR_INSTR_SLOT_STORE_TEMP] = { 4, "stor" },
+   [PPIR_INSTR_SLOT_BRANCH] = { 4, "brch" },
 };
 
 void ppir_instr_print_list(ppir_compiler *comp)
@@ -106,6 +106,13 @@ static bool ppir_lower_neg(ppir_block *block, ppir_node *node)
    ppir_alu_node *neg = ppir_node_to_alu(node);
    ppir_dest *dest = &neg->dest;
 
+   /* a reg may be read in other blocks, keep the write */
+   if (dest->type == ppir_target_register) {
+      node->op = ppir_op_mov;
+      neg->src->negate = !neg->src->negate;
+      return true;
+   }
+
    ppir_node_foreach_succ_safe(node, dep) {
       ppir_node *succ = dep->succ;
 
@@ -141,7 +148,7 @@ static bool ppir_lower_neg(ppir_block *block, ppir_node *node)
 
 static ppir_reg *create_reg(ppir_compiler *comp, int num_components)
 {
-   ppir_reg *r = ralloc(comp, ppir_reg);
+   ppir_reg *r = linear_alloc_child(comp->linear, sizeof(ppir_reg));
    if (!r)
       return NULL;
 
@@ -182,23 +189,13 @@ static bool ppir_lower_vec_to_scalar(ppir_block *block, ppir_node *node)
       /* change all successors to use reg r */
       ppir_node_foreach_succ(node, dep) {
          ppir_node *succ = dep->succ;
-         if (succ->type == ppir_node_type_alu) {
-            ppir_alu_node *sa = ppir_node_to_alu(succ);
-            for (int i = 0; i < sa->num_src; i++) {
-               ppir_src *src = sa->src + i;
-               if (ppir_node_target_equal(src, dest)) {
-                  src->type = ppir_target_register;
-                  src->reg = r;
-               }
+         for (int i = 0; i < ppir_node_get_src_num(succ); i++) {
+            ppir_src *src = ppir_node_get_src(succ, i);
+            if (ppir_node_target_equal(src, dest)) {
+               src->type = ppir_target_register;
+               src->reg = r;
             }
          }
-         else {
-            assert(succ->type == ppir_node_type_store);
-            ppir_store_node *ss = ppir_node_to_store(succ);
-            ppir_src *src = &ss->src;
-            src->type = ppir_target_register;
-            src->reg = r;
-         }
       }
    }
 
@@ -234,6 +231,46 @@ static bool ppir_lower_vec_to_scalar(ppir_block *block, ppir_node *node)
    return true;
 }
 
+/* the sel op picks "^fmul ? src1 : src0", move the condition into the
+ * fmul pipeline reg, node_to_instr puts the move in the select instr */
+static bool ppir_lower_select(ppir_block *block, ppir_node *node)
+{
+   ppir_alu_node *alu = ppir_node_to_alu(node);
+
+   ppir_alu_node *move = ppir_node_create(block, ppir_op_mov, -1, 0);
+   if (!move)
+      return false;
+   list_addtail(&move->node.list, &node->list);
+
+   move->src[0] = alu->src[0];
+   move->num_src = 1;
+
+   ppir_dest *dest = &move->dest;
+   dest->type = ppir_target_pipeline;
+   dest->pipeline = ppir_pipeline_reg_fmul;
+   dest->write_mask = 1;
+
+   ppir_node_foreach_pred_safe(node, dep) {
+      ppir_node *pred = dep->pred;
+      ppir_dest *pd = ppir_node_get_dest(pred);
+      if (!pd || !ppir_node_target_equal(alu->src, pd))
+         continue;
+
+      ppir_node_add_dep(&move->node, pred);
+      if (!ppir_node_target_equal(alu->src + 1, pd) &&
+          !ppir_node_target_equal(alu->src + 2, pd))
+         ppir_node_remove_dep(dep);
+   }
+   ppir_node_add_dep(node, &move->node);
+
+   ppir_src tmp = alu->src[1];
+   alu->src[0] = alu->src[2];
+   alu->src[1] = tmp;
+   alu->num_src = 2;
+
+   return true;
+}
+
 static bool ppir_lower_texture(ppir_block *block, ppir_node *node)
 {
    ppir_load_texture_node *load_tex = ppir_node_to_load_texture(node);
@@ -290,10 +327,12 @@ static bool (*ppir_lower_funcs[ppir_op_num])(ppir_block *, ppir_node *) = {
    [ppir_op_dot4] = ppir_lower_dot,
    [ppir_op_neg] = ppir_lower_neg,
    [ppir_op_rcp] = ppir_lower_vec_to_scalar,
+   [ppir_op_sqrt] = ppir_lower_vec_to_scalar,
    [ppir_op_rsqrt] = ppir_lower_vec_to_scalar,
    [ppir_op_log2] = ppir_lower_vec_to_scalar,
    [ppir_op_exp2] = ppir_lower_vec_to_scalar,
    [ppir_op_load_texture] = ppir_lower_texture,
+   [ppir_op_select] = ppir_lower_select,
 };
 
 bool ppir_lower_prog(ppir_compiler *comp)
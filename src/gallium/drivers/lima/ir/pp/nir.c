@@ -29,6 +29,7 @@
 #include "compiler/nir/nir.h"
 
 #include "ppir.h"
+#include "lima_context.h"
 
 static void *ppir_node_create_ssa(ppir_block *block, ppir_op op, nir_ssa_def *ssa)
 {
@@ -50,6 +51,16 @@ static void *ppir_node_create_ssa(ppir_block *block, ppir_op op, nir_ssa_def *ss
    return node;
 }
 
+static ppir_reg *ppir_get_reg(ppir_compiler *comp, int index)
+{
+   list_for_each_entry(ppir_reg, r, &comp->reg_list, list) {
+      if (r->index == index)
+         return r;
+   }
+
+   return NULL;
+}
+
 static void *ppir_node_create_reg(ppir_block *block, ppir_op op,
                                   nir_reg_dest *reg, unsigned mask)
 {
@@ -58,14 +69,7 @@ static void *ppir_node_create_reg(ppir_block *block, ppir_op op,
       return NULL;
 
    ppir_dest *dest = ppir_node_get_dest(node);
-
-   list_for_each_entry(ppir_reg, r, &block->comp->reg_list, list) {
-      if (r->index == reg->reg->index) {
-         dest->reg = r;
-         break;
-      }
-   }
-
+   dest->reg = ppir_get_reg(block->comp, reg->reg->index);
    dest->type = ppir_target_register;
    dest->write_mask = mask;
 
@@ -91,6 +95,66 @@ static void *ppir_node_create_dest(ppir_block *block, ppir_op op,
    return ppir_node_create(block, op, index, 0);
 }
 
+/* consts and uniforms are cheaper to load again than to keep in a reg */
+static ppir_node *ppir_node_clone_to_block(ppir_block *block, ppir_node *node)
+{
+   ppir_node *clone = ppir_node_create(block, node->op, -1, 0);
+   if (!clone)
+      return NULL;
+
+   if (node->type == ppir_node_type_const) {
+      ppir_const_node *c = ppir_node_to_const(node);
+      ppir_const_node *cc = ppir_node_to_const(clone);
+      cc->constant = c->constant;
+      cc->dest = c->dest;
+   }
+   else {
+      ppir_load_node *l = ppir_node_to_load(node);
+      ppir_load_node *cl = ppir_node_to_load(clone);
+      cl->index = l->index;
+      cl->num_components = l->num_components;
+      cl->dest = l->dest;
+   }
+
+   list_addtail(&clone->list, &block->node_list);
+   return clone;
+}
+
+/* ssa values and the pipeline regs don't survive the end of a block,
+ * a value read in another block is written to a reg instead */
+static bool ppir_node_ssa_to_reg(ppir_compiler *comp, ppir_node *node)
+{
+   ppir_dest *dest = ppir_node_get_dest(node);
+   if (dest->type == ppir_target_register)
+      return true;
+
+   ppir_reg *r = linear_zalloc_child(comp->linear, sizeof(ppir_reg));
+   if (!r)
+      return false;
+
+   r->index = comp->cur_reg_index++;
+   r->num_components = dest->ssa.num_components;
+   r->is_head = dest->ssa.is_head;
+   r->live_in = INT_MAX;
+   r->live_out = 0;
+   list_addtail(&r->list, &comp->reg_list);
+
+   ppir_node_foreach_succ(node, dep) {
+      ppir_node *succ = dep->succ;
+      for (int i = 0; i < ppir_node_get_src_num(succ); i++) {
+         ppir_src *src = ppir_node_get_src(succ, i);
+         if (ppir_node_target_equal(src, dest)) {
+            src->type = ppir_target_register;
+            src->reg = r;
+         }
+      }
+   }
+
+   dest->type = ppir_target_register;
+   dest->reg = r;
+   return true;
+}
+
 static void ppir_node_add_src(ppir_compiler *comp, ppir_node *node,
                               ppir_src *ps, nir_src *ns, unsigned mask)
 {
@@ -98,6 +162,15 @@ static void ppir_node_add_src(ppir_compiler *comp, ppir_node *node,
 
    if (ns->is_ssa) {
       child = comp->var_nodes[ns->ssa->index];
+      if (child->block != node->block) {
+         if (child->op == ppir_op_const || child->op == ppir_op_load_uniform)
+            child = ppir_node_clone_to_block(node->block, child);
+         else if (!ppir_node_ssa_to_reg(comp, child))
+            child = NULL;
+
+         if (!child)
+            return;
+      }
       ppir_node_add_dep(node, child);
    }
    else {
@@ -105,8 +178,14 @@ static void ppir_node_add_src(ppir_compiler *comp, ppir_node *node,
       while (mask) {
          int swizzle = ps->swizzle[u_bit_scan(&mask)];
          child = comp->var_nodes[(reg->index << 2) + comp->reg_base + swizzle];
-         ppir_node_add_dep(node, child);
+         /* no dep when written in another block or not at all */
+         if (child)
+            ppir_node_add_dep(node, child);
       }
+
+      ps->type = ppir_target_register;
+      ps->reg = ppir_get_reg(comp, reg->index);
+      return;
    }
 
    ppir_dest *dest = ppir_node_get_dest(child);
@@ -125,14 +204,60 @@ static int nir_to_ppir_opcodes[nir_num_opcodes] = {
    [nir_op_fdot2] = ppir_op_dot2,
    [nir_op_fdot3] = ppir_op_dot3,
    [nir_op_fdot4] = ppir_op_dot4,
+   [nir_op_fsqrt] = ppir_op_sqrt,
    [nir_op_frsq] = ppir_op_rsqrt,
    [nir_op_flog2] = ppir_op_log2,
    [nir_op_fexp2] = ppir_op_exp2,
    [nir_op_fmax] = ppir_op_max,
    [nir_op_fmin] = ppir_op_min,
    [nir_op_frcp] = ppir_op_rcp,
+   [nir_op_flt] = ppir_op_lt,
+   [nir_op_slt] = ppir_op_lt,
+   [nir_op_fge] = ppir_op_le,
+   [nir_op_sge] = ppir_op_le,
+   [nir_op_feq] = ppir_op_eq,
+   [nir_op_seq] = ppir_op_eq,
+   [nir_op_fne] = ppir_op_ne,
+   [nir_op_sne] = ppir_op_ne,
+   [nir_op_bcsel] = ppir_op_select,
+   [nir_op_fcsel] = ppir_op_select,
 };
 
+/* a comparison only used by ifs is done by the branch instr itself,
+ * which has no src modifiers and reads the srcs at the end of block */
+static bool ppir_alu_is_branch_cond(nir_alu_instr *instr)
+{
+   switch (instr->op) {
+   case nir_op_flt:
+   case nir_op_slt:
+   case nir_op_fge:
+   case nir_op_sge:
+   case nir_op_feq:
+   case nir_op_seq:
+   case nir_op_fne:
+   case nir_op_sne:
+      break;
+   default:
+      return false;
+   }
+
+   if (!instr->dest.dest.is_ssa)
+      return false;
+
+   nir_ssa_def *def = &instr->dest.dest.ssa;
+   if (def->num_components != 1 ||
+       !list_empty(&def->uses) || list_empty(&def->if_uses))
+      return false;
+
+   for (int i = 0; i < 2; i++) {
+      nir_alu_src *src = instr->src + i;
+      if (!src->src.is_ssa || src->abs || src->negate)
+         return false;
+   }
+
+   return true;
+}
+
 static ppir_node *ppir_emit_alu(ppir_block *block, nir_instr *ni)
 {
    nir_alu_instr *instr = nir_instr_as_alu(ni);
@@ -143,6 +268,24 @@ static ppir_node *ppir_emit_alu(ppir_block *block, nir_instr *ni)
       return NULL;
    }
 
+   /* emitted with the if in ppir_emit_if_branch */
+   if (ppir_alu_is_branch_cond(instr))
+      return NULL;
+
+   int cond_component = -1;
+   if (op == ppir_op_select) {
+      /* the condition of sel is the scalar ^fmul */
+      unsigned mask = instr->dest.write_mask;
+      while (mask) {
+         int swizzle = instr->src[0].swizzle[u_bit_scan(&mask)];
+         if (cond_component >= 0 && swizzle != cond_component) {
+            ppir_error("unsupported vector select condition\n");
+            return NULL;
+         }
+         cond_component = swizzle;
+      }
+   }
+
    ppir_alu_node *node = ppir_node_create_dest(block, op, &instr->dest.dest,
                                                instr->dest.write_mask);
    if (!node)
@@ -182,6 +325,24 @@ static ppir_node *ppir_emit_alu(ppir_block *block, nir_instr *ni)
       ps->negate = ns->negate;
    }
 
+   switch (instr->op) {
+   case nir_op_fge:
+   case nir_op_sge:
+   {
+      /* a >= b is done as b <= a */
+      ppir_src tmp = node->src[0];
+      node->src[0] = node->src[1];
+      node->src[1] = tmp;
+      break;
+   }
+   case nir_op_bcsel:
+   case nir_op_fcsel:
+      node->src[0].swizzle[0] = cond_component;
+      break;
+   default:
+      break;
+   }
+
    return &node->node;
 }
 
@@ -205,6 +366,17 @@ static ppir_node *ppir_emit_intrinsic(ppir_block *block, nir_instr *ni)
       lnode->index = nir_intrinsic_base(instr) * 4 + nir_intrinsic_component(instr);
       return &lnode->node;
 
+   case nir_intrinsic_load_point_coord:
+      if (!instr->dest.is_ssa)
+         mask = u_bit_consecutive(0, instr->num_components);
+
+      lnode = ppir_node_create_dest(block, ppir_op_load_pointcoord, &instr->dest, mask);
+      if (!lnode)
+         return NULL;
+
+      lnode->num_components = instr->num_components;
+      return &lnode->node;
+
    case nir_intrinsic_load_uniform:
       if (!instr->dest.is_ssa)
          mask = u_bit_consecutive(0, instr->num_components);
@@ -242,6 +414,10 @@ static ppir_node *ppir_emit_intrinsic(ppir_block *block, nir_instr *ni)
 
       return &snode->node;
 
+   case nir_intrinsic_discard:
+      block->comp->prog->uses_discard = true;
+      return ppir_node_create(block, ppir_op_discard, -1, 0);
+
    default:
       ppir_error("unsupported nir_intrinsic_instr %d\n", instr->intrinsic);
       return NULL;
@@ -319,8 +495,28 @@ static ppir_node *ppir_emit_tex(ppir_block *block, nir_instr *ni)
 
 static ppir_node *ppir_emit_jump(ppir_block *block, nir_instr *ni)
 {
-   ppir_error("nir_jump_instr not support\n");
-   return NULL;
+   nir_jump_instr *instr = nir_instr_as_jump(ni);
+   ppir_compiler *comp = block->comp;
+   ppir_block *target;
+
+   switch (instr->type) {
+   case nir_jump_break:
+      target = comp->loop_break_block;
+      break;
+   case nir_jump_continue:
+      target = comp->loop_cont_block;
+      break;
+   default:
+      ppir_error("nir_jump_instr %d not support\n", instr->type);
+      return NULL;
+   }
+
+   ppir_branch_node *branch = ppir_node_create(block, ppir_op_branch, -1, 0);
+   if (!branch)
+      return NULL;
+
+   branch->target = target;
+   return &branch->node;
 }
 
 static ppir_node *(*ppir_emit_instr[nir_instr_type_phi])(ppir_block *, nir_instr *) = {
@@ -334,16 +530,47 @@ static ppir_node *(*ppir_emit_instr[nir_instr_type_phi])(ppir_block *, nir_instr
 
 static ppir_block *ppir_block_create(ppir_compiler *comp)
 {
-   ppir_block *block = ralloc(comp, ppir_block);
+   ppir_block *block = linear_zalloc_child(comp->linear, sizeof(ppir_block));
    if (!block)
       return NULL;
 
    list_inithead(&block->node_list);
    list_inithead(&block->instr_list);
+   block->comp = comp;
 
    return block;
 }
 
+static bool ppir_node_reads_reg(ppir_node *node, ppir_reg *reg)
+{
+   for (int i = 0; i < ppir_node_get_src_num(node); i++) {
+      ppir_src *src = ppir_node_get_src(node, i);
+      if (src->type == ppir_target_register && src->reg == reg)
+         return true;
+   }
+
+   return false;
+}
+
+/* the deps only follow the values read, a reg write must also stay
+ * after the reads and writes of the same reg before it in the block */
+static void ppir_add_reg_write_deps(ppir_block *block)
+{
+   list_for_each_entry(ppir_node, node, &block->node_list, list) {
+      ppir_dest *dest = ppir_node_get_dest(node);
+      if (!dest || dest->type != ppir_target_register)
+         continue;
+
+      list_for_each_entry_from_rev(ppir_node, prev, node->list.prev,
+                                   &block->node_list, list) {
+         ppir_dest *pd = ppir_node_get_dest(prev);
+         if ((pd && pd->type == ppir_target_register && pd->reg == dest->reg) ||
+             ppir_node_reads_reg(prev, dest->reg))
+            ppir_node_add_dep(node, prev);
+      }
+   }
+}
+
 static bool ppir_emit_block(ppir_compiler *comp, nir_block *nblock)
 {
    ppir_block *block = ppir_block_create(comp);
@@ -351,7 +578,6 @@ static bool ppir_emit_block(ppir_compiler *comp, nir_block *nblock)
       return false;
 
    list_addtail(&block->list, &comp->block_list);
-   block->comp = comp;
 
    nir_foreach_instr(instr, nblock) {
       assert(instr->type < nir_instr_type_phi);
@@ -360,19 +586,178 @@ static bool ppir_emit_block(ppir_compiler *comp, nir_block *nblock)
          list_addtail(&node->list, &block->node_list);
    }
 
+   ppir_add_reg_write_deps(block);
    return true;
 }
 
+static ppir_block *ppir_get_last_block(ppir_compiler *comp)
+{
+   return list_last_entry(&comp->block_list, ppir_block, list);
+}
+
+static bool ppir_block_ends_with_jump(ppir_block *block)
+{
+   if (list_empty(&block->node_list))
+      return false;
+
+   ppir_node *node = list_last_entry(&block->node_list, ppir_node, list);
+   if (node->op != ppir_op_branch)
+      return false;
+
+   return !ppir_node_to_branch(node)->num_src;
+}
+
+static ppir_branch_node *ppir_emit_branch(ppir_block *block, ppir_block *target)
+{
+   ppir_branch_node *branch = ppir_node_create(block, ppir_op_branch, -1, 0);
+   if (!branch)
+      return NULL;
+
+   branch->target = target;
+   list_addtail(&branch->node.list, &block->node_list);
+   return branch;
+}
+
+/* jump over the then list when the condition is false */
+static ppir_branch_node *ppir_emit_if_branch(ppir_block *block, nir_if *nif)
+{
+   ppir_compiler *comp = block->comp;
+   ppir_branch_node *branch = ppir_node_create(block, ppir_op_branch, -1, 0);
+   if (!branch)
+      return NULL;
+
+   nir_src *cond = &nif->condition;
+   nir_alu_instr *cmp = NULL;
+   if (cond->is_ssa && cond->ssa->parent_instr->type == nir_instr_type_alu) {
+      cmp = nir_instr_as_alu(cond->ssa->parent_instr);
+      if (!ppir_alu_is_branch_cond(cmp))
+         cmp = NULL;
+   }
+
+   if (cmp) {
+      for (int i = 0; i < 2; i++) {
+         ppir_src *ps = branch->src + i;
+         ps->swizzle[0] = cmp->src[i].swizzle[0];
+         ppir_node_add_src(comp, &branch->node, ps, &cmp->src[i].src, 1);
+      }
+
+      switch (cmp->op) {
+      case nir_op_flt:
+      case nir_op_slt:
+         branch->cond_gt = branch->cond_eq = true;
+         break;
+      case nir_op_fge:
+      case nir_op_sge:
+         branch->cond_lt = true;
+         break;
+      case nir_op_feq:
+      case nir_op_seq:
+         branch->cond_gt = branch->cond_lt = true;
+         break;
+      default:
+         branch->cond_eq = true;
+         break;
+      }
+   }
+   else {
+      ppir_node_add_src(comp, &branch->node, branch->src, cond, 1);
+
+      ppir_const_node *zero = ppir_node_create(block, ppir_op_const, -1, 0);
+      if (!zero)
+         return NULL;
+
+      zero->constant.value[0].f = 0.0f;
+      zero->constant.num = 1;
+      zero->dest.type = ppir_target_ssa;
+      zero->dest.ssa.num_components = 1;
+      zero->dest.ssa.live_in = INT_MAX;
+      zero->dest.ssa.live_out = 0;
+      zero->dest.write_mask = 1;
+      list_addtail(&zero->node.list, &block->node_list);
+
+      ppir_node_target_assign(branch->src + 1, &zero->dest);
+      ppir_node_add_dep(&branch->node, &zero->node);
+      branch->cond_eq = true;
+   }
+   branch->num_src = 2;
+
+   list_addtail(&branch->node.list, &block->node_list);
+   return branch;
+}
+
+static bool ppir_emit_cf_list(ppir_compiler *comp, struct exec_list *list);
+
 static bool ppir_emit_if(ppir_compiler *comp, nir_if *nif)
 {
-   ppir_error("if nir_cf_node not support\n");
-   return false;
+   /* an if always follows a block */
+   ppir_block *block = ppir_get_last_block(comp);
+   ppir_branch_node *branch = ppir_emit_if_branch(block, nif);
+   if (!branch)
+      return false;
+
+   if (!ppir_emit_cf_list(comp, &nif->then_list))
+      return false;
+
+   ppir_block *then_end = ppir_get_last_block(comp);
+   ppir_block *else_block = NULL;
+   ppir_branch_node *jump = NULL;
+
+   nir_block *nelse = nir_if_first_else_block(nif);
+   if (nelse != nir_if_last_else_block(nif) ||
+       !exec_list_is_empty(&nelse->instr_list)) {
+      if (!ppir_block_ends_with_jump(then_end)) {
+         jump = ppir_emit_branch(then_end, NULL);
+         if (!jump)
+            return false;
+      }
+
+      if (!ppir_emit_cf_list(comp, &nif->else_list))
+         return false;
+
+      else_block = LIST_ENTRY(ppir_block, then_end->list.next, list);
+   }
+
+   ppir_block *after = ppir_block_create(comp);
+   if (!after)
+      return false;
+   list_addtail(&after->list, &comp->block_list);
+
+   branch->target = else_block ? else_block : after;
+   if (jump)
+      jump->target = after;
+
+   return true;
 }
 
 static bool ppir_emit_loop(ppir_compiler *comp, nir_loop *nloop)
 {
-   ppir_error("loop nir_cf_node not support\n");
-   return false;
+   ppir_block *save_break = comp->loop_break_block;
+   ppir_block *save_cont = comp->loop_cont_block;
+
+   /* empty header to continue to, the next iteration starts from the
+    * first instr of the body */
+   ppir_block *header = ppir_block_create(comp);
+   ppir_block *after = ppir_block_create(comp);
+   if (!header || !after)
+      return false;
+   list_addtail(&header->list, &comp->block_list);
+
+   comp->loop_break_block = after;
+   comp->loop_cont_block = header;
+
+   if (!ppir_emit_cf_list(comp, &nloop->body))
+      return false;
+
+   ppir_block *last = ppir_get_last_block(comp);
+   if (!ppir_block_ends_with_jump(last) && !ppir_emit_branch(last, header))
+      return false;
+
+   header->loop_end = last;
+   list_addtail(&after->list, &comp->block_list);
+
+   comp->loop_break_block = save_break;
+   comp->loop_cont_block = save_cont;
+   return true;
 }
 
 static bool ppir_emit_function(ppir_compiler *comp, nir_function_impl *nfunc)
@@ -418,8 +803,15 @@ static ppir_compiler *ppir_compiler_create(void *prog, unsigned num_reg, unsigne
    if (!comp)
       return NULL;
 
+   comp->linear = linear_alloc_parent(comp, 0);
+   if (!comp->linear) {
+      ralloc_free(comp);
+      return NULL;
+   }
+
    list_inithead(&comp->block_list);
    list_inithead(&comp->reg_list);
+   list_inithead(&comp->dep_free_list);
 
    comp->cur_reg_index = num_reg;
    comp->var_nodes = (ppir_node **)(comp + 1);
@@ -439,7 +831,7 @@ bool ppir_compile_nir(struct lima_fs_shader_state *prog, struct nir_shader *nir,
    comp->ra = ra;
 
    foreach_list_typed(nir_register, reg, node, &func->registers) {
-      ppir_reg *r = ralloc(comp, ppir_reg);
+      ppir_reg *r = linear_alloc_child(comp->linear, sizeof(ppir_reg));
       if (!r)
          return false;
 
@@ -452,6 +844,19 @@ bool ppir_compile_nir(struct lima_fs_shader_state *prog, struct nir_shader *nir,
 
    if (!ppir_emit_cf_list(comp, &func->body))
       goto err_out0;
+
+   /* the end instr writing the color is the last one of the shader */
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      if (block == ppir_get_last_block(comp))
+         break;
+
+      list_for_each_entry(ppir_node, node, &block->node_list, list) {
+         if (node->op == ppir_op_store_color) {
+            ppir_error("store color not in the last block\n");
+            goto err_out0;
+         }
+      }
+   }
    ppir_node_print_prog(comp);
 
    if (!ppir_lower_prog(comp))
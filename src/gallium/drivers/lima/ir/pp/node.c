@@ -80,6 +80,12 @@ const ppir_op_info ppir_op_infos[] = {
          PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_END
       },
    },
+   [ppir_op_sqrt] = {
+      .name = "sqrt",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_COMBINE, PPIR_INSTR_SLOT_END
+      },
+   },
    [ppir_op_rsqrt] = {
       .name = "rsqrt",
       .slots = (int []) {
@@ -114,6 +120,44 @@ const ppir_op_info ppir_op_infos[] = {
          PPIR_INSTR_SLOT_END
       },
    },
+   [ppir_op_lt] = {
+      .name = "lt",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_SCL_ADD, PPIR_INSTR_SLOT_ALU_SCL_MUL,
+         PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_ALU_VEC_MUL,
+         PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_le] = {
+      .name = "le",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_SCL_ADD, PPIR_INSTR_SLOT_ALU_SCL_MUL,
+         PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_ALU_VEC_MUL,
+         PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_eq] = {
+      .name = "eq",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_SCL_ADD, PPIR_INSTR_SLOT_ALU_SCL_MUL,
+         PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_ALU_VEC_MUL,
+         PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_ne] = {
+      .name = "ne",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_SCL_ADD, PPIR_INSTR_SLOT_ALU_SCL_MUL,
+         PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_ALU_VEC_MUL,
+         PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_select] = {
+      .name = "select",
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_ALU_VEC_ADD, PPIR_INSTR_SLOT_END
+      },
+   },
    [ppir_op_rcp] = {
       .name = "rcp",
       .slots = (int []) {
@@ -134,6 +178,13 @@ const ppir_op_info ppir_op_infos[] = {
          PPIR_INSTR_SLOT_VARYING, PPIR_INSTR_SLOT_END
       },
    },
+   [ppir_op_load_pointcoord] = {
+      .name = "ld_pntc",
+      .type = ppir_node_type_load,
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_VARYING, PPIR_INSTR_SLOT_END
+      },
+   },
    [ppir_op_load_uniform] = {
       .name = "ld_uni",
       .type = ppir_node_type_load,
@@ -148,10 +199,38 @@ const ppir_op_info ppir_op_infos[] = {
          PPIR_INSTR_SLOT_TEXLD, PPIR_INSTR_SLOT_END
       },
    },
+   [ppir_op_load_temp] = {
+      .name = "ld_temp",
+      .type = ppir_node_type_load,
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_UNIFORM, PPIR_INSTR_SLOT_END
+      },
+   },
    [ppir_op_const] = {
       .name = "const",
       .type = ppir_node_type_const,
    },
+   [ppir_op_branch] = {
+      .name = "branch",
+      .type = ppir_node_type_branch,
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_BRANCH, PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_discard] = {
+      .name = "discard",
+      .type = ppir_node_type_branch,
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_BRANCH, PPIR_INSTR_SLOT_END
+      },
+   },
+   [ppir_op_store_temp] = {
+      .name = "st_temp",
+      .type = ppir_node_type_store,
+      .slots = (int []) {
+         PPIR_INSTR_SLOT_STORE_TEMP, PPIR_INSTR_SLOT_END
+      },
+   },
    [ppir_op_store_color] = {
       .name = "st_col",
       .type = ppir_node_type_store,
@@ -167,11 +246,12 @@ void *ppir_node_create(ppir_block *block, ppir_op op, int index, unsigned mask)
       [ppir_node_type_load] = sizeof(ppir_load_node),
       [ppir_node_type_store] = sizeof(ppir_store_node),
       [ppir_node_type_load_texture] = sizeof(ppir_load_texture_node),
+      [ppir_node_type_branch] = sizeof(ppir_branch_node),
    };
 
    ppir_node_type type = ppir_op_infos[op].type;
    int size = node_size[type];
-   ppir_node *node = rzalloc_size(block, size);
+   ppir_node *node = linear_zalloc_child(comp->linear, size);
    if (!node)
       return NULL;
 
@@ -212,7 +292,15 @@ void ppir_node_add_dep(ppir_node *succ, ppir_node *pred)
          return;
    }
 
-   ppir_dep *dep = ralloc(succ, ppir_dep);
+   ppir_compiler *comp = succ->block->comp;
+   ppir_dep *dep;
+   if (list_empty(&comp->dep_free_list))
+      dep = linear_alloc_child(comp->linear, sizeof(ppir_dep));
+   else {
+      dep = list_first_entry(&comp->dep_free_list, ppir_dep, succ_link);
+      list_del(&dep->succ_link);
+   }
+
    dep->pred = pred;
    dep->succ = succ;
    list_addtail(&dep->pred_link, &succ->pred_list);
@@ -221,9 +309,11 @@ void ppir_node_add_dep(ppir_node *succ, ppir_node *pred)
 
 void ppir_node_remove_dep(ppir_dep *dep)
 {
+   ppir_node *succ = dep->succ;
+
    list_del(&dep->succ_link);
    list_del(&dep->pred_link);
-   ralloc_free(dep);
+   list_add(&dep->succ_link, &succ->block->comp->dep_free_list);
 }
 
 static void _ppir_node_replace_child(ppir_src *src, ppir_node *old_child, ppir_node *new_child)
@@ -246,6 +336,11 @@ void ppir_node_replace_child(ppir_node *parent, ppir_node *old_child, ppir_node
       ppir_store_node *store = ppir_node_to_store(parent);
       _ppir_node_replace_child(&store->src, old_child, new_child);
    }
+   else if (parent->type == ppir_node_type_branch) {
+      ppir_branch_node *branch = ppir_node_to_branch(parent);
+      for (int i = 0; i < branch->num_src; i++)
+         _ppir_node_replace_child(branch->src + i, old_child, new_child);
+   }
 }
 
 void ppir_node_replace_pred(ppir_dep *dep, ppir_node *new_pred)
@@ -271,8 +366,8 @@ void ppir_node_delete(ppir_node *node)
    ppir_node_foreach_pred_safe(node, dep)
       ppir_node_remove_dep(dep);
 
+   /* the node memory goes with the compiler linear allocator */
    list_del(&node->list);
-   ralloc_free(node);
 }
 
 static void ppir_node_print_node(ppir_node *node, int space)
@@ -93,7 +93,8 @@ static bool insert_to_each_succ_instr(ppir_block *block, ppir_node *node)
 
    ppir_node_foreach_succ_safe(node, dep) {
       ppir_node *succ = dep->succ;
-      assert(succ->type == ppir_node_type_alu);
+      assert(succ->type == ppir_node_type_alu ||
+             succ->type == ppir_node_type_branch);
 
       if (!ppir_instr_insert_node(succ->instr, node)) {
          /* create a move node to insert for failed node */
@@ -191,8 +192,18 @@ static bool ppir_do_node_to_instr(ppir_block *block, ppir_node *node)
       /* merge pred mul and succ add in the same instr can save a reg
        * by using pipeline reg ^vmul/^fmul */
       ppir_alu_node *alu = ppir_node_to_alu(node);
-      if (alu->dest.type == ppir_target_ssa &&
-          ppir_node_has_single_succ(node)) {
+      if (alu->dest.type == ppir_target_pipeline &&
+          alu->dest.pipeline == ppir_pipeline_reg_fmul) {
+         /* select condition from ppir_lower_select */
+         ppir_node *succ = ppir_node_first_succ(node);
+         assert(succ->op == ppir_op_select);
+         node->instr_pos = PPIR_INSTR_SLOT_ALU_SCL_MUL;
+         node->instr = succ->instr;
+         succ->instr->slots[node->instr_pos] = node;
+      }
+      else if (alu->dest.type == ppir_target_ssa &&
+               ppir_node_has_single_succ(node) &&
+               ppir_node_first_succ(node)->op != ppir_op_select) {
          ppir_node *succ = ppir_node_first_succ(node);
          if (succ->instr_pos == PPIR_INSTR_SLOT_ALU_VEC_ADD) {
             assert(alu->dest.ssa.num_components > 1);
@@ -223,7 +234,8 @@ static bool ppir_do_node_to_instr(ppir_block *block, ppir_node *node)
          load->dest.type = ppir_target_pipeline;
          load->dest.pipeline = ppir_pipeline_reg_uniform;
       }
-      else if (node->op == ppir_op_load_varying) {
+      else if (node->op == ppir_op_load_varying ||
+               node->op == ppir_op_load_pointcoord) {
          /* delay the load varying dup to scheduler */
          if (!create_new_instr(block, node))
             return false;
@@ -239,6 +251,7 @@ static bool ppir_do_node_to_instr(ppir_block *block, ppir_node *node)
       }
       break;
    case ppir_node_type_load_texture:
+   case ppir_node_type_branch:
       if (!create_new_instr(block, node))
          return false;
       break;
@@ -348,6 +361,8 @@ static bool ppir_create_instr_from_node(ppir_compiler *comp)
 static void ppir_build_instr_dependency(ppir_compiler *comp)
 {
    list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      ppir_instr *branch = NULL;
+
       list_for_each_entry(ppir_instr, instr, &block->instr_list, list) {
          for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
             ppir_node *node = instr->slots[i];
@@ -359,6 +374,167 @@ static void ppir_build_instr_dependency(ppir_compiler *comp)
                }
             }
          }
+
+         ppir_node *node = instr->slots[PPIR_INSTR_SLOT_BRANCH];
+         if (node && node->op == ppir_op_branch)
+            branch = instr;
+      }
+
+      /* the branch leaves the block, everything else including a
+       * discard goes before it */
+      if (branch) {
+         list_for_each_entry(ppir_instr, instr, &block->instr_list, list) {
+            if (instr != branch)
+               ppir_instr_add_dep(branch, instr);
+         }
+      }
+   }
+}
+
+/* nir registers are written and read without dependencies between the
+ * nodes, keep their instrs in place */
+static bool ppir_instr_uses_reg(ppir_instr *instr)
+{
+   for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+      ppir_node *node = instr->slots[i];
+      if (!node)
+         continue;
+
+      ppir_dest *dest = ppir_node_get_dest(node);
+      if (dest && dest->type == ppir_target_register)
+         return true;
+
+      if (node->type == ppir_node_type_alu ||
+          node->type == ppir_node_type_branch ||
+          node->type == ppir_node_type_load_texture) {
+         for (int j = 0; j < ppir_node_get_src_num(node); j++) {
+            if (ppir_node_get_src(node, j)->type == ppir_target_register)
+               return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+static bool ppir_instr_reaches(ppir_instr *from, ppir_instr *to, unsigned visit)
+{
+   if (from == to)
+      return true;
+
+   if (from->visit == visit)
+      return false;
+   from->visit = visit;
+
+   ppir_instr_foreach_succ(from, dep) {
+      if (ppir_instr_reaches(dep->succ, to, visit))
+         return true;
+   }
+
+   return false;
+}
+
+static bool ppir_instr_can_merge(ppir_instr *dst, ppir_instr *src,
+                                 unsigned *visit)
+{
+   if (dst->is_end || src->is_end)
+      return false;
+
+   for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+      if (dst->slots[i] && src->slots[i])
+         return false;
+   }
+
+   /* the combiner is left alone with what it was given */
+   if (dst->slots[PPIR_INSTR_SLOT_ALU_COMBINE] ||
+       src->slots[PPIR_INSTR_SLOT_ALU_COMBINE])
+      return false;
+
+   /* nodes read the const pipeline reg of their slot */
+   for (int i = 0; i < 2; i++) {
+      if (dst->constant[i].num && src->constant[i].num)
+         return false;
+   }
+
+   if (ppir_instr_uses_reg(dst) || ppir_instr_uses_reg(src))
+      return false;
+
+   /* merging must not create a cycle */
+   if (ppir_instr_reaches(dst, src, ++*visit) ||
+       ppir_instr_reaches(src, dst, ++*visit))
+      return false;
+
+   return true;
+}
+
+static void ppir_instr_merge(ppir_block *block, ppir_instr *dst, ppir_instr *src)
+{
+   ppir_debug("merge instr %d into %d\n", src->index, dst->index);
+
+   for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+      if (src->slots[i])
+         dst->slots[i] = src->slots[i];
+   }
+
+   for (int i = 0; i < 2; i++) {
+      if (src->constant[i].num)
+         dst->constant[i] = src->constant[i];
+   }
+
+   /* const and duplicated nodes point to the instr without a slot */
+   list_for_each_entry(ppir_node, node, &block->node_list, list) {
+      if (node->instr == src)
+         node->instr = dst;
+   }
+
+   ppir_instr_foreach_pred_safe(src, dep) {
+      ppir_instr *pred = dep->pred;
+      list_del(&dep->pred_link);
+      list_del(&dep->succ_link);
+      ppir_instr_add_dep(dst, pred);
+   }
+
+   ppir_instr_foreach_succ_safe(src, dep) {
+      ppir_instr *succ = dep->succ;
+      list_del(&dep->pred_link);
+      list_del(&dep->succ_link);
+      ppir_instr_add_dep(succ, dst);
+   }
+
+   list_del(&src->list);
+}
+
+/* Co-issue independent instrs which feed the same instr, their results
+ * are all live at that point anyway, so this doesn't add register
+ * pressure the way merging arbitrary instrs would. */
+static void ppir_merge_instr(ppir_compiler *comp)
+{
+   unsigned visit = 0;
+
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      list_for_each_entry(ppir_instr, instr, &block->instr_list, list) {
+         instr->visit = 0;
+      }
+
+      list_for_each_entry_safe(ppir_instr, instr, &block->instr_list, list) {
+         ppir_instr *dst = NULL;
+
+         ppir_instr_foreach_succ(instr, dep) {
+            ppir_instr *succ = dep->succ;
+            ppir_instr_foreach_pred(succ, sdep) {
+               ppir_instr *sibling = sdep->pred;
+               if (sibling != instr &&
+                   ppir_instr_can_merge(sibling, instr, &visit)) {
+                  dst = sibling;
+                  break;
+               }
+            }
+            if (dst)
+               break;
+         }
+
+         if (dst)
+            ppir_instr_merge(block, dst, instr);
       }
    }
 }
@@ -370,6 +546,8 @@ bool ppir_node_to_instr(ppir_compiler *comp)
    ppir_instr_print_list(comp);
 
    ppir_build_instr_dependency(comp);
+   ppir_merge_instr(comp);
+   ppir_instr_print_list(comp);
    ppir_instr_print_dep(comp);
 
    return true;
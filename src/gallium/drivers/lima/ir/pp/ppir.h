@@ -86,6 +86,8 @@ typedef enum {
    ppir_op_dot3,
    ppir_op_dot4,
 
+   ppir_op_lt,
+   ppir_op_le,
    ppir_op_gt,
    ppir_op_ge,
    ppir_op_eq,
@@ -95,13 +97,18 @@ typedef enum {
    ppir_op_load_uniform,
    ppir_op_load_varying,
    ppir_op_load_coords,
+   ppir_op_load_pointcoord,
    ppir_op_load_texture,
+   ppir_op_load_temp,
 
    ppir_op_store_temp,
    ppir_op_store_color,
 
    ppir_op_const,
 
+   ppir_op_branch,
+   ppir_op_discard,
+
    ppir_op_num,
 } ppir_op;
 
@@ -111,6 +118,7 @@ typedef enum {
    ppir_node_type_load,
    ppir_node_type_store,
    ppir_node_type_load_texture,
+   ppir_node_type_branch,
 } ppir_node_type;
 
 typedef struct {
@@ -164,6 +172,8 @@ typedef struct ppir_reg {
    bool is_head;
    /* instr live range */
    int live_in, live_out;
+   /* spilled to or filled from the stack, not to be spilled again */
+   bool spilled;
 } ppir_reg;
 
 typedef enum {
@@ -246,6 +256,16 @@ typedef struct {
    int sampler_dim;
 } ppir_load_texture_node;
 
+typedef struct {
+   ppir_node node;
+   /* jump to target when src[0] compares to src[1] as of the cond_* set,
+    * unconditional without src */
+   ppir_src src[2];
+   int num_src;
+   bool cond_gt, cond_eq, cond_lt;
+   struct ppir_block *target;
+} ppir_branch_node;
+
 enum ppir_instr_slot {
    PPIR_INSTR_SLOT_VARYING,
    PPIR_INSTR_SLOT_TEXLD,
@@ -256,6 +276,7 @@ enum ppir_instr_slot {
    PPIR_INSTR_SLOT_ALU_SCL_ADD,
    PPIR_INSTR_SLOT_ALU_COMBINE,
    PPIR_INSTR_SLOT_STORE_TEMP,
+   PPIR_INSTR_SLOT_BRANCH,
    PPIR_INSTR_SLOT_NUM,
    PPIR_INSTR_SLOT_END,
    PPIR_INSTR_SLOT_ALU_START = PPIR_INSTR_SLOT_ALU_VEC_MUL,
@@ -264,6 +285,7 @@ enum ppir_instr_slot {
 
 typedef struct ppir_instr {
    struct list_head list;
+   struct ppir_block *block;
    int index;
    bool printed;
    int seq; /* command sequence after schedule */
@@ -279,6 +301,13 @@ typedef struct ppir_instr {
    int est; /* earliest start time */
    int parent_index;
    bool scheduled;
+
+   /* for merging independent instrs */
+   unsigned visit;
+
+   /* for codegen, in words, branch targets are relative to them */
+   int offset;
+   int encode_size;
 } ppir_instr;
 
 typedef struct ppir_block {
@@ -290,6 +319,9 @@ typedef struct ppir_block {
    /* for scheduler */
    int sched_instr_index;
    int sched_instr_base;
+
+   /* set on the first block of a loop, the last block of its body */
+   struct ppir_block *loop_end;
 } ppir_block;
 
 struct ra_regs;
@@ -312,6 +344,16 @@ typedef struct ppir_compiler {
 
    /* for scheduler */
    int sched_instr_base;
+
+   /* branch targets of break and continue in the loop being emitted */
+   ppir_block *loop_break_block;
+   ppir_block *loop_cont_block;
+
+   /* blocks, nodes, instrs, deps and regs live as long as the compiler,
+    * they are bump allocated from here and freed with it in one go */
+   void *linear;
+   /* node deps removed from the graph, reused by ppir_node_add_dep */
+   struct list_head dep_free_list;
 } ppir_compiler;
 
 void *ppir_node_create(ppir_block *block, ppir_op op, int index, unsigned mask);
@@ -367,6 +409,7 @@ static inline ppir_node *ppir_node_first_pred(ppir_node *node)
 #define ppir_node_to_load(node) ((ppir_load_node *)(node))
 #define ppir_node_to_store(node) ((ppir_store_node *)(node))
 #define ppir_node_to_load_texture(node) ((ppir_load_texture_node *)(node))
+#define ppir_node_to_branch(node) ((ppir_branch_node *)(node))
 
 static inline ppir_dest *ppir_node_get_dest(ppir_node *node)
 {
@@ -384,6 +427,40 @@ static inline ppir_dest *ppir_node_get_dest(ppir_node *node)
    }
 }
 
+static inline int ppir_node_get_src_num(ppir_node *node)
+{
+   switch (node->type) {
+   case ppir_node_type_alu:
+      return ppir_node_to_alu(node)->num_src;
+   case ppir_node_type_branch:
+      return ppir_node_to_branch(node)->num_src;
+   case ppir_node_type_load:
+   case ppir_node_type_load_texture:
+   case ppir_node_type_store:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+static inline ppir_src *ppir_node_get_src(ppir_node *node, int n)
+{
+   switch (node->type) {
+   case ppir_node_type_alu:
+      return &ppir_node_to_alu(node)->src[n];
+   case ppir_node_type_branch:
+      return &ppir_node_to_branch(node)->src[n];
+   case ppir_node_type_load:
+      return &ppir_node_to_load(node)->src;
+   case ppir_node_type_load_texture:
+      return &ppir_node_to_load_texture(node)->src_coords;
+   case ppir_node_type_store:
+      return &ppir_node_to_store(node)->src;
+   default:
+      return NULL;
+   }
+}
+
 static inline void ppir_node_target_assign(ppir_src *src, ppir_dest *dest)
 {
    src->type = dest->type;
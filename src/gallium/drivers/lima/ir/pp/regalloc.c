@@ -22,10 +22,16 @@
  *
  */
 
+#include <stdlib.h>
+
 #include "util/ralloc.h"
+#include "util/bitset.h"
+#include "util/bitscan.h"
 #include "util/register_allocate.h"
+#include "util/os_time.h"
 
 #include "ppir.h"
+#include "lima_context.h"
 
 
 #define PPIR_FULL_REG_NUM  6
@@ -145,6 +151,31 @@ static ppir_reg *get_src_reg(ppir_src *src)
    }
 }
 
+/* drop the ssa regs of the last allocation round from the reg list,
+ * the liveness pass adds them back */
+static void ppir_regalloc_reset_liveness(ppir_compiler *comp, int num_reg)
+{
+   int n = 0;
+   list_for_each_entry_safe(ppir_reg, reg, &comp->reg_list, list) {
+      if (n++ < num_reg) {
+         reg->live_in = INT_MAX;
+         reg->live_out = 0;
+      }
+      else
+         list_del(&reg->list);
+   }
+
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      list_for_each_entry(ppir_node, node, &block->node_list, list) {
+         ppir_dest *dest = ppir_node_get_dest(node);
+         if (dest && dest->type == ppir_target_ssa) {
+            dest->ssa.live_in = INT_MAX;
+            dest->ssa.live_out = 0;
+         }
+      }
+   }
+}
+
 static ppir_reg *ppir_regalloc_build_liveness_info(ppir_compiler *comp)
 {
    ppir_reg *ret = NULL;
@@ -181,48 +212,257 @@ static ppir_reg *ppir_regalloc_build_liveness_info(ppir_compiler *comp)
          }
 
          /* update reg live_out from node src (read) */
-         switch (node->type) {
-         case ppir_node_type_alu:
-         {
-            ppir_alu_node *alu = ppir_node_to_alu(node);
-            for (int i = 0; i < alu->num_src; i++) {
-               ppir_reg *reg = get_src_reg(alu->src + i);
-               if (reg && node->instr->seq > reg->live_out)
-                  reg->live_out = node->instr->seq;
-            }
-            break;
-         }
-         case ppir_node_type_store:
-         {
-            ppir_store_node *store = ppir_node_to_store(node);
-            ppir_reg *reg = get_src_reg(&store->src);
+         for (int i = 0; i < ppir_node_get_src_num(node); i++) {
+            ppir_reg *reg = get_src_reg(ppir_node_get_src(node, i));
             if (reg && node->instr->seq > reg->live_out)
                reg->live_out = node->instr->seq;
-            break;
          }
-         case ppir_node_type_load:
-         {
-            ppir_load_node *load = ppir_node_to_load(node);
-            ppir_reg *reg = get_src_reg(&load->src);
-            if (reg && node->instr->seq > reg->live_out)
-               reg->live_out = node->instr->seq;
-            break;
+      }
+   }
+
+   return ret;
+}
+
+/* the ssa regs don't leave their block, but a nir reg live anywhere in a
+ * loop is live in the whole loop as the next iteration may read it
+ * before the write in instr order */
+static void ppir_regalloc_extend_loop_liveness(ppir_compiler *comp, int num_reg)
+{
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      if (!block->loop_end)
+         continue;
+
+      int start = INT_MAX, end = -1;
+      list_for_each_entry_from(ppir_block, b, &block->list,
+                               &comp->block_list, list) {
+         list_for_each_entry(ppir_instr, instr, &b->instr_list, list) {
+            start = MIN2(start, instr->seq);
+            end = MAX2(end, instr->seq);
          }
-         case ppir_node_type_load_texture:
-         {
-            ppir_load_texture_node *load_tex = ppir_node_to_load_texture(node);
-            ppir_reg *reg = get_src_reg(&load_tex->src_coords);
-            if (reg && node->instr->seq > reg->live_out)
-               reg->live_out = node->instr->seq;
+         if (b == block->loop_end)
             break;
-         }
-         default:
+      }
+
+      int n = 0;
+      list_for_each_entry(ppir_reg, reg, &comp->reg_list, list) {
+         if (n++ == num_reg)
             break;
+
+         if (reg->live_in <= end && reg->live_out >= start &&
+             reg->live_in <= reg->live_out) {
+            reg->live_in = MIN2(reg->live_in, start);
+            reg->live_out = MAX2(reg->live_out, end);
          }
       }
    }
+}
 
-   return ret;
+static int ppir_regalloc_cmp_live_in(const void *a, const void *b)
+{
+   const ppir_reg *ra = *(ppir_reg * const *)a;
+   const ppir_reg *rb = *(ppir_reg * const *)b;
+
+   if (ra->live_in != rb->live_in)
+      return ra->live_in < rb->live_in ? -1 : 1;
+   return 0;
+}
+
+/* sweep the live ranges by live_in keeping a bitset of the live ones
+ * instead of testing every pair of regs, regs[] is in graph node order
+ * and sorted[] a copy of it which gets sorted */
+static void ppir_regalloc_build_interference(struct ra_graph *g, ppir_reg **regs,
+                                             ppir_reg **sorted, int num)
+{
+   BITSET_WORD *live = rzalloc_array(g, BITSET_WORD, BITSET_WORDS(num));
+
+   qsort(sorted, num, sizeof(*sorted), ppir_regalloc_cmp_live_in);
+
+   for (int i = 0; i < num; i++) {
+      ppir_reg *reg = sorted[i];
+      BITSET_WORD tmp;
+      unsigned n;
+
+      BITSET_FOREACH_SET(n, tmp, live, num) {
+         ppir_reg *other = regs[n];
+         /* a range ending before this one starts also ends before all
+          * the following ones */
+         if (other->live_in < reg->live_in && other->live_out <= reg->live_in)
+            BITSET_CLEAR(live, n);
+         else
+            ra_add_node_interference(g, n, reg->index);
+      }
+
+      BITSET_SET(live, reg->index);
+   }
+}
+
+/* regs read by few instrs over a long live range are the cheap ones to
+ * spill, the fills are next to the reads and free the reg in between */
+static void ppir_regalloc_set_spill_cost(ppir_compiler *comp, struct ra_graph *g,
+                                         ppir_reg **regs, int num_reg, int num,
+                                         ppir_reg *end_reg)
+{
+   int *uses = rzalloc_array(g, int, num);
+
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      list_for_each_entry(ppir_node, node, &block->node_list, list) {
+         if (!node->instr)
+            continue;
+
+         for (int i = 0; i < ppir_node_get_src_num(node); i++) {
+            ppir_src *src = ppir_node_get_src(node, i);
+            ppir_reg *reg = src->ssa;
+            if (src->type == ppir_target_ssa && reg &&
+                reg->index < num && regs[reg->index] == reg)
+               uses[reg->index]++;
+         }
+      }
+   }
+
+   /* only ssa regs have a single def to store after */
+   for (int n = num_reg; n < num; n++) {
+      ppir_reg *reg = regs[n];
+      if (reg == end_reg || reg->spilled || reg->live_out <= reg->live_in)
+         continue;
+
+      ra_set_node_spill_cost(g, n, (float)(1 + uses[n]) /
+                             (reg->live_out - reg->live_in));
+   }
+}
+
+/* load the spilled reg into a new reg in an instr before succ */
+static ppir_reg *ppir_regalloc_create_fill(ppir_block *block, ppir_instr *succ,
+                                           ppir_reg *chosen, int slot, bool is_head)
+{
+   ppir_instr *instr = ppir_instr_create(block);
+   if (!instr)
+      return NULL;
+   list_del(&instr->list);
+   list_addtail(&instr->list, &succ->list);
+
+   ppir_load_node *load = ppir_node_create(block, ppir_op_load_temp, -1, 0);
+   if (!load)
+      return NULL;
+   list_addtail(&load->node.list, &block->node_list);
+
+   load->index = slot;
+   load->num_components = 4;
+   load->dest.type = ppir_target_pipeline;
+   load->dest.pipeline = ppir_pipeline_reg_uniform;
+
+   ppir_alu_node *mov = ppir_node_create(block, ppir_op_mov, -1, 0);
+   if (!mov)
+      return NULL;
+   list_addtail(&mov->node.list, &block->node_list);
+
+   mov->num_src = 1;
+   mov->src[0].type = ppir_target_pipeline;
+   mov->src[0].pipeline = ppir_pipeline_reg_uniform;
+   for (int i = 0; i < 4; i++)
+      mov->src[0].swizzle[i] = i;
+
+   mov->dest.type = ppir_target_ssa;
+   mov->dest.ssa.num_components = chosen->num_components;
+   mov->dest.ssa.is_head = is_head;
+   mov->dest.ssa.live_in = INT_MAX;
+   mov->dest.ssa.live_out = 0;
+   mov->dest.ssa.spilled = true;
+   mov->dest.write_mask = u_bit_consecutive(0, chosen->num_components);
+
+   if (!ppir_instr_insert_node(instr, &load->node) ||
+       !ppir_instr_insert_node(instr, &mov->node))
+      return NULL;
+
+   return &mov->dest.ssa;
+}
+
+/* store the spilled reg in an instr after pred */
+static bool ppir_regalloc_create_spill(ppir_block *block, ppir_instr *pred,
+                                       ppir_reg *chosen, int slot)
+{
+   ppir_instr *instr = ppir_instr_create(block);
+   if (!instr)
+      return false;
+   list_del(&instr->list);
+   list_add(&instr->list, &pred->list);
+
+   ppir_store_node *store = ppir_node_create(block, ppir_op_store_temp, -1, 0);
+   if (!store)
+      return false;
+   list_addtail(&store->node.list, &block->node_list);
+
+   store->index = slot;
+   store->src.type = ppir_target_ssa;
+   store->src.ssa = chosen;
+   for (int i = 0; i < 4; i++)
+      store->src.swizzle[i] = i;
+
+   return ppir_instr_insert_node(instr, &store->node);
+}
+
+/* store the reg to a vec4 slot of the PP stack after its def and load it
+ * back into a new reg before each instr reading it, the new regs only
+ * live for one instr so the next allocation round makes progress */
+static bool ppir_regalloc_spill_reg(ppir_compiler *comp, ppir_reg *chosen)
+{
+   int slot = comp->prog->stack_size++;
+   bool is_head = chosen->is_head;
+
+   /* temp write has no swizzle, the value has to start at x */
+   chosen->is_head = true;
+   chosen->spilled = true;
+
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      /* the spill instr added after the current one is skipped */
+      list_for_each_entry_safe(ppir_instr, instr, &block->instr_list, list) {
+         ppir_reg *fill = NULL;
+
+         for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+            ppir_node *node = instr->slots[i];
+            if (!node)
+               continue;
+
+            for (int j = 0; j < ppir_node_get_src_num(node); j++) {
+               ppir_src *src = ppir_node_get_src(node, j);
+               if (src->type != ppir_target_ssa || src->ssa != chosen)
+                  continue;
+
+               if (!fill) {
+                  fill = ppir_regalloc_create_fill(block, instr, chosen,
+                                                   slot, is_head);
+                  if (!fill)
+                     return false;
+               }
+               src->ssa = fill;
+            }
+         }
+
+         for (int i = 0; i < PPIR_INSTR_SLOT_NUM; i++) {
+            ppir_node *node = instr->slots[i];
+            if (!node)
+               continue;
+
+            ppir_dest *dest = ppir_node_get_dest(node);
+            if (dest && dest->type == ppir_target_ssa && &dest->ssa == chosen) {
+               if (!ppir_regalloc_create_spill(block, instr, chosen, slot))
+                  return false;
+            }
+         }
+      }
+   }
+
+   return true;
+}
+
+/* spill code adds instrs, the liveness needs seq in instr order */
+static void ppir_regalloc_update_seq(ppir_compiler *comp)
+{
+   int seq = 0;
+
+   list_for_each_entry(ppir_block, block, &comp->block_list, list) {
+      list_for_each_entry(ppir_instr, instr, &block->instr_list, list)
+         instr->seq = seq++;
+   }
 }
 
 static int get_phy_reg_index(int reg)
@@ -292,6 +532,17 @@ static void ppir_regalloc_print_result(ppir_compiler *comp)
                printf("%d", ppir_target_get_src_reg_index(&load_tex->src_coords));
                break;
             }
+            case ppir_node_type_branch:
+            {
+               ppir_branch_node *branch = ppir_node_to_branch(node);
+               for (int j = 0; j < branch->num_src; j++) {
+                  if (j)
+                     printf(" ");
+
+                  printf("%d", ppir_target_get_src_reg_index(branch->src + j));
+               }
+               break;
+            }
             default:
                break;
             }
@@ -304,12 +555,18 @@ static void ppir_regalloc_print_result(ppir_compiler *comp)
    printf("--------------------------\n");
 }
 
-bool ppir_regalloc_prog(ppir_compiler *comp)
+static bool ppir_regalloc_prog_try(ppir_compiler *comp, int num_reg,
+                                   ppir_reg **spill)
 {
    ppir_reg *end_reg = ppir_regalloc_build_liveness_info(comp);
+   ppir_regalloc_extend_loop_liveness(comp, num_reg);
 
-   struct ra_graph *g = ra_alloc_interference_graph(
-      comp->ra, list_length(&comp->reg_list));
+   int num = list_length(&comp->reg_list);
+   struct ra_graph *g = ra_alloc_interference_graph(comp->ra, num);
+   ppir_reg **regs = ralloc_array(g, ppir_reg *, num);
+   ppir_reg **sorted = ralloc_array(g, ppir_reg *, num);
+   if (!regs || !sorted)
+      goto err_out;
 
    int n = 0, end_reg_index = 0;
    list_for_each_entry(ppir_reg, reg, &comp->reg_list, list) {
@@ -318,55 +575,80 @@ bool ppir_regalloc_prog(ppir_compiler *comp)
          c += 4;
       if (reg == end_reg)
          end_reg_index = n;
-      ra_set_node_class(g, n++, c);
-   }
-
-   int n1 = 0;
-   list_for_each_entry(ppir_reg, reg1, &comp->reg_list, list) {
-      int n2 = n1 + 1;
-      list_for_each_entry_from(ppir_reg, reg2, reg1->list.next,
-                               &comp->reg_list, list) {
-         bool interference = false;
-         if (reg1->live_in < reg2->live_in) {
-            if (reg1->live_out > reg2->live_in)
-               interference = true;
-         }
-         else if (reg1->live_in > reg2->live_in) {
-            if (reg2->live_out > reg1->live_in)
-               interference = true;
-         }
-         else
-            interference = true;
+      ra_set_node_class(g, n, c);
 
-         if (interference)
-            ra_add_node_interference(g, n1, n2);
-
-         n2++;
-      }
-      n1++;
+      /* graph node of the reg until it gets the physical one */
+      reg->index = n;
+      regs[n] = sorted[n] = reg;
+      n++;
    }
 
+   ppir_regalloc_build_interference(g, regs, sorted, num);
+
    ra_set_node_reg(g, end_reg_index, ppir_ra_reg_base[ppir_ra_reg_class_vec4]);
 
    if (!ra_allocate(g)) {
-      ppir_error("ppir: regalloc fail\n");
+      ppir_regalloc_set_spill_cost(comp, g, regs, num_reg, num, end_reg);
+      int best = ra_get_best_spill_node(g);
+      if (best >= 0)
+         *spill = regs[best];
       goto err_out;
    }
 
-   n = 0;
-   list_for_each_entry(ppir_reg, reg, &comp->reg_list, list) {
-      int reg_index = ra_get_node_reg(g, n++);
-      reg->index = get_phy_reg_index(reg_index);
+   for (n = 0; n < num; n++) {
+      int reg_index = ra_get_node_reg(g, n);
+      regs[n]->index = get_phy_reg_index(reg_index);
    }
 
    ralloc_free(g);
-
-   if (lima_shader_debug_pp)
-      ppir_regalloc_print_result(comp);
-
    return true;
 
 err_out:
    ralloc_free(g);
    return false;
 }
+
+bool ppir_regalloc_prog(ppir_compiler *comp)
+{
+   /* the nir registers, ssa regs are added by each allocation round */
+   int num_reg = list_length(&comp->reg_list);
+   int64_t start = os_time_get();
+
+   while (true) {
+      ppir_reg *spill = NULL;
+
+      ppir_regalloc_reset_liveness(comp, num_reg);
+      if (ppir_regalloc_prog_try(comp, num_reg, &spill))
+         break;
+
+      if (!spill) {
+         ppir_error("ppir: regalloc fail\n");
+         return false;
+      }
+
+      if (comp->prog->stack_size >= LIMA_PP_MAX_STACK_SIZE) {
+         ppir_error("ppir: regalloc fail, out of stack to spill\n");
+         return false;
+      }
+
+      ppir_debug("regalloc spill reg %d to stack slot %d\n",
+                 spill->index, comp->prog->stack_size);
+
+      if (!ppir_regalloc_spill_reg(comp, spill))
+         return false;
+
+      ppir_regalloc_update_seq(comp);
+   }
+
+   int num_phy_reg = 0;
+   list_for_each_entry(ppir_reg, reg, &comp->reg_list, list)
+      num_phy_reg = MAX2(num_phy_reg, reg->index / 4 + 1);
+   comp->prog->stats.regs = num_phy_reg;
+   comp->prog->stats.spills = comp->prog->stack_size;
+   comp->prog->stats.regalloc_time = os_time_get() - start;
+
+   if (lima_shader_debug_pp)
+      ppir_regalloc_print_result(comp);
+
+   return true;
+}
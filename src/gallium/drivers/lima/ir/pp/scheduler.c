@@ -115,13 +115,47 @@ static void ppir_insert_ready_list(struct list_head *ready_list,
    list_addtail(&insert_instr->list, insert_pos);
 }
 
+/* Number of instrs between a load and the first use of its result for
+ * the use not to wait on it. These are estimates of the texture and
+ * varying fetch latency, not documented hardware numbers. */
+#define PPIR_TEXLD_LATENCY   4
+#define PPIR_VARYING_LATENCY 2
+
+static int ppir_instr_latency(ppir_instr *instr)
+{
+   if (instr->slots[PPIR_INSTR_SLOT_TEXLD])
+      return PPIR_TEXLD_LATENCY;
+   if (instr->slots[PPIR_INSTR_SLOT_VARYING])
+      return PPIR_VARYING_LATENCY;
+   return 1;
+}
+
+/* The schedule is built from the end, so an instr placed now lands
+ * right before the ones placed already. Take the first ready instr in
+ * the register pressure order whose result isn't needed too soon, which
+ * puts loads early and the ALU work between them and their uses. If
+ * every ready instr would stall, take the first one anyway. */
+static ppir_instr *ppir_schedule_pick(ppir_block *block,
+                                      struct list_head *ready_list)
+{
+   int index = block->sched_instr_index - 1;
+
+   list_for_each_entry(ppir_instr, instr, ready_list, list) {
+      if (instr->parent_index == INT_MAX ||
+          index <= instr->parent_index - ppir_instr_latency(instr))
+         return instr;
+   }
+
+   return list_first_entry(ready_list, ppir_instr, list);
+}
+
 static void ppir_schedule_ready_list(ppir_block *block,
                                      struct list_head *ready_list)
 {
    if (list_empty(ready_list))
       return;
 
-   ppir_instr *instr = list_first_entry(ready_list, ppir_instr, list);
+   ppir_instr *instr = ppir_schedule_pick(block, ready_list);
    list_del(&instr->list);
 
    /* schedule the instr to the block instr list */
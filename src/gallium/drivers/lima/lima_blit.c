@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include "util/u_blitter.h"
+#include "util/u_surface.h"
+#include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_debug.h"
+#include "util/u_inlines.h"
+
+#include "lima_context.h"
+#include "lima_resource.h"
+
+/* Blits and texture copies are drawn by u_blitter on the PP, so they
+ * don't wait for the GPU and queue up with the rendering. There's no
+ * tile reload, a PP job writes whole tiles, so only destinations whose
+ * touched tiles are fully covered can be drawn to. */
+
+void
+lima_blitter_save(struct lima_context *ctx)
+{
+   struct blitter_context *blitter = ctx->blitter;
+   struct lima_context_framebuffer *fb = &ctx->framebuffer;
+   struct lima_texture_stateobj *tex = &ctx->tex_stateobj;
+
+   util_blitter_save_vertex_buffer_slot(blitter, ctx->vertex_buffers.vb);
+   util_blitter_save_vertex_elements(blitter, ctx->vertex_elements);
+   util_blitter_save_vertex_shader(blitter, ctx->vs);
+   util_blitter_save_rasterizer(blitter, ctx->rasterizer);
+   util_blitter_save_viewport(blitter, &ctx->viewport.transform);
+   util_blitter_save_scissor(blitter, &ctx->scissor);
+   util_blitter_save_fragment_shader(blitter, ctx->fs_program);
+   util_blitter_save_blend(blitter, ctx->blend);
+   util_blitter_save_depth_stencil_alpha(blitter, ctx->zsa);
+   util_blitter_save_stencil_ref(blitter, &ctx->stencil_ref);
+   util_blitter_save_sample_mask(blitter, ctx->sample_mask);
+   util_blitter_save_render_condition(blitter,
+                                      (struct pipe_query *)ctx->render_cond_query,
+                                      ctx->render_cond_cond,
+                                      ctx->render_cond_mode);
+
+   struct pipe_framebuffer_state state = {
+      .width = fb->width,
+      .height = fb->height,
+      .samples = fb->samples,
+      .nr_cbufs = fb->cbuf ? 1 : 0,
+      .cbufs[0] = fb->cbuf,
+      .zsbuf = fb->zsbuf,
+   };
+   util_blitter_save_framebuffer(blitter, &state);
+
+   util_blitter_save_fragment_sampler_states(blitter, tex->num_samplers,
+                                             (void **)tex->samplers);
+   util_blitter_save_fragment_sampler_views(blitter, tex->num_textures,
+                                            tex->textures);
+}
+
+static bool
+lima_blit_edge_covered(int start, int end, int size)
+{
+   return (start % 16 == 0 || start <= 0) && (end % 16 == 0 || end >= size);
+}
+
+/* the PP writes 16x16 tiles to the linear, tile aligned levels of render
+ * targets only */
+bool
+lima_blit_dst_supported(struct pipe_resource *prsc, unsigned level,
+                        const struct pipe_box *box)
+{
+   struct lima_resource *res = lima_resource(prsc);
+
+   if (prsc->target == PIPE_BUFFER || res->tiled ||
+       !(prsc->bind & PIPE_BIND_RENDER_TARGET) || prsc->nr_samples > 1)
+      return false;
+
+   if (box->depth != 1)
+      return false;
+
+   int width = u_minify(prsc->width0, level);
+   int height = u_minify(prsc->height0, level);
+   return lima_blit_edge_covered(box->x, box->x + box->width, width) &&
+      lima_blit_edge_covered(box->y, box->y + box->height, height);
+}
+
+static bool
+lima_render_blit(struct lima_context *ctx, const struct pipe_blit_info *info)
+{
+   if (!(info->mask & PIPE_MASK_RGBA) || info->mask & PIPE_MASK_ZS)
+      return false;
+
+   /* the scissor can leave parts of the touched tiles undrawn */
+   if (info->scissor_enable)
+      return false;
+
+   struct pipe_box box = info->dst.box;
+   if (box.width < 0) {
+      box.x += box.width;
+      box.width = -box.width;
+   }
+   if (box.height < 0) {
+      box.y += box.height;
+      box.height = -box.height;
+   }
+
+   if (!lima_blit_dst_supported(info->dst.resource, info->dst.level, &box))
+      return false;
+
+   if (!util_blitter_is_blit_supported(ctx->blitter, info))
+      return false;
+
+   /* the jobs rendering to other surfaces of the destination have to go
+    * before the blit, the current one included */
+   lima_flush_job_writing_resource(ctx, info->dst.resource, true);
+
+   lima_blitter_save(ctx);
+   util_blitter_blit(ctx->blitter, info);
+   return true;
+}
+
+/* the storage of a multisampled resource holds the resolved pixels, so a
+ * resolve is a blit from a single sampled alias of it */
+static bool
+lima_resolve_blit(struct lima_context *ctx, struct pipe_blit_info *info)
+{
+   struct pipe_resource *src = info->src.resource;
+
+   /* sampling the alias doesn't find the job rendering to src */
+   lima_flush_job_writing_resource(ctx, src, true);
+
+   info->src.resource = lima_resource_create_resolved(ctx->base.screen, src);
+   if (!info->src.resource) {
+      info->src.resource = src;
+      return false;
+   }
+
+   bool ret = lima_render_blit(ctx, info) ||
+      util_try_blit_via_copy_region(&ctx->base, info);
+
+   pipe_resource_reference(&info->src.resource, NULL);
+   info->src.resource = src;
+   return ret;
+}
+
+static void
+lima_blit(struct pipe_context *pctx, const struct pipe_blit_info *blit_info)
+{
+   struct lima_context *ctx = lima_context(pctx);
+   struct pipe_blit_info info = *blit_info;
+
+   if (info.render_condition_enable &&
+       !lima_query_render_condition_passes(ctx))
+      return;
+
+   if (info.src.resource->nr_samples > 1 &&
+       info.dst.resource->nr_samples <= 1) {
+      if (lima_resolve_blit(ctx, &info))
+         return;
+   }
+   else if (lima_render_blit(ctx, &info))
+      return;
+
+   /* depth/stencil and what the PP can't draw go through the CPU */
+   if (util_try_blit_via_copy_region(pctx, &info))
+      return;
+
+   debug_printf("lima: unsupported blit %s -> %s\n",
+                util_format_short_name(info.src.resource->format),
+                util_format_short_name(info.dst.resource->format));
+}
+
+static void
+lima_resource_copy_region(struct pipe_context *pctx,
+                          struct pipe_resource *dst, unsigned dst_level,
+                          unsigned dstx, unsigned dsty, unsigned dstz,
+                          struct pipe_resource *src, unsigned src_level,
+                          const struct pipe_box *src_box)
+{
+   struct lima_context *ctx = lima_context(pctx);
+   struct pipe_box dst_box = {
+      .x = dstx,
+      .y = dsty,
+      .z = dstz,
+      .width = src_box->width,
+      .height = src_box->height,
+      .depth = src_box->depth,
+   };
+
+   if (dst->target != PIPE_BUFFER && src->target != PIPE_BUFFER &&
+       lima_blit_dst_supported(dst, dst_level, &dst_box) &&
+       util_blitter_is_copy_supported(ctx->blitter, dst, src)) {
+      lima_flush_job_writing_resource(ctx, dst, true);
+      lima_blitter_save(ctx);
+      util_blitter_copy_texture(ctx->blitter, dst, dst_level, dstx, dsty,
+                                dstz, src, src_level, src_box);
+      return;
+   }
+
+   util_resource_copy_region(pctx, dst, dst_level, dstx, dsty, dstz,
+                             src, src_level, src_box);
+}
+
+bool
+lima_blit_init(struct lima_context *ctx)
+{
+   ctx->blitter = util_blitter_create(&ctx->base);
+   if (!ctx->blitter)
+      return false;
+
+   ctx->base.blit = lima_blit;
+   ctx->base.resource_copy_region = lima_resource_copy_region;
+   return true;
+}
+
+void
+lima_blit_fini(struct lima_context *ctx)
+{
+   if (ctx->blitter)
+      util_blitter_destroy(ctx->blitter);
+}
@@ -22,6 +22,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -30,6 +31,7 @@
 #include "lima_drm.h"
 
 #include "util/u_hash_table.h"
+#include "util/u_math.h"
 #include "os/os_mman.h"
 
 #include "state_tracker/drm_driver.h"
@@ -37,6 +39,8 @@
 #include "lima_screen.h"
 #include "lima_bo.h"
 #include "lima_vamgr.h"
+#include "lima_util.h"
+#include "lima_trace.h"
 
 #define PTR_TO_UINT(x) ((unsigned)((intptr_t)(x)))
 
@@ -84,25 +88,174 @@ static void lima_close_kms_handle(struct lima_screen *screen, uint32_t handle)
    drmIoctl(screen->fd, DRM_IOCTL_GEM_CLOSE, &args);
 }
 
+static void lima_bo_destroy(struct lima_bo *bo)
+{
+   struct lima_screen *screen = bo->screen;
+   mtx_lock(&screen->bo_table_lock);
+   util_hash_table_remove(screen->bo_handles,
+                          (void *)(uintptr_t)bo->handle);
+   if (bo->flink_name)
+      util_hash_table_remove(screen->bo_flink_names,
+                             (void *)(uintptr_t)bo->flink_name);
+   mtx_unlock(&screen->bo_table_lock);
+
+   if (bo->va) {
+      lima_bo_va_unmap(bo, bo->va);
+      lima_va_range_free(bo->screen, bo->size, bo->va);
+   }
+
+   if (bo->map)
+      lima_bo_unmap(bo);
+
+   lima_close_kms_handle(screen, bo->handle);
+   free(bo);
+}
+
+void lima_bo_cache_init(struct lima_screen *screen)
+{
+   mtx_init(&screen->bo_cache_lock, mtx_plain);
+   for (int i = 0; i < LIMA_BO_CACHE_NUM_BUCKETS; i++)
+      list_inithead(&screen->bo_cache_buckets[i]);
+   list_inithead(&screen->bo_cache_time);
+}
+
+void lima_bo_cache_fini(struct lima_screen *screen)
+{
+   list_for_each_entry_safe(struct lima_bo, bo, &screen->bo_cache_time, time_list) {
+      list_del(&bo->size_list);
+      list_del(&bo->time_list);
+      lima_bo_destroy(bo);
+   }
+   mtx_destroy(&screen->bo_cache_lock);
+}
+
+static struct list_head *
+lima_bo_cache_get_bucket(struct lima_screen *screen, uint32_t size)
+{
+   /* round down to POT, all bigger bos go to the last bucket */
+   int index = util_logbase2(size);
+   index = CLAMP(index, LIMA_BO_CACHE_MIN_BUCKET, LIMA_BO_CACHE_MAX_BUCKET);
+   return &screen->bo_cache_buckets[index - LIMA_BO_CACHE_MIN_BUCKET];
+}
+
+static time_t lima_bo_cache_time(void)
+{
+   struct timespec time;
+   clock_gettime(CLOCK_MONOTONIC, &time);
+   return time.tv_sec;
+}
+
+/* called with bo_cache_lock held */
+static void
+lima_bo_cache_free_stale_bos(struct lima_screen *screen, time_t time)
+{
+   list_for_each_entry_safe(struct lima_bo, bo, &screen->bo_cache_time, time_list) {
+      /* time list is sorted by free time, oldest first */
+      if (time - bo->free_time <= 2)
+         break;
+
+      list_del(&bo->size_list);
+      list_del(&bo->time_list);
+      lima_bo_destroy(bo);
+   }
+}
+
+/* called with bo_cache_lock held */
+static void lima_bo_cache_add(struct lima_bo *bo, time_t time)
+{
+   struct lima_screen *screen = bo->screen;
+
+   bo->free_time = time;
+   list_addtail(&bo->size_list, lima_bo_cache_get_bucket(screen, bo->size));
+   list_addtail(&bo->time_list, &screen->bo_cache_time);
+}
+
+static bool lima_bo_cache_put(struct lima_bo *bo)
+{
+   struct lima_screen *screen = bo->screen;
+
+   if (!bo->cacheable)
+      return false;
+
+   mtx_lock(&screen->bo_cache_lock);
+
+   time_t time = lima_bo_cache_time();
+   lima_bo_cache_add(bo, time);
+   lima_bo_cache_free_stale_bos(screen, time);
+
+   mtx_unlock(&screen->bo_cache_lock);
+   return true;
+}
+
+static struct lima_bo *
+lima_bo_cache_get(struct lima_screen *screen, uint32_t size, uint32_t flags)
+{
+   struct lima_bo *bo = NULL;
+
+   mtx_lock(&screen->bo_cache_lock);
+
+   struct list_head *bucket = lima_bo_cache_get_bucket(screen, size);
+   list_for_each_entry(struct lima_bo, entry, bucket, size_list) {
+      if (entry->size < size || entry->flags != flags)
+         continue;
+
+      /* a bo still used by GPU is not worth waiting for, bos are
+       * put in order of free time, so later ones should be busy too */
+      if (!lima_bo_wait(entry, LIMA_GEM_WAIT_WRITE, 0))
+         break;
+
+      list_del(&entry->size_list);
+      list_del(&entry->time_list);
+      bo = entry;
+      break;
+   }
+
+   mtx_unlock(&screen->bo_cache_lock);
+
+   if (bo)
+      p_atomic_set(&bo->refcnt, 1);
+   return bo;
+}
+
 struct lima_bo *lima_bo_create(struct lima_screen *screen,
                                uint32_t size, uint32_t flags,
                                bool need_map, bool need_va)
 {
    struct lima_bo *bo;
+
+   size = align(size, LIMA_PAGE_SIZE);
+
+   bo = lima_bo_cache_get(screen, size, flags);
+   if (bo) {
+      /* bos are only taken from the cache once idle */
+      bo->gpu_ctx = LIMA_BO_CTX_NONE;
+      memset(bo->gpu_seqno, 0, sizeof(bo->gpu_seqno));
+      memset(bo->gpu_write_seqno, 0, sizeof(bo->gpu_write_seqno));
+      bo->captured = bo->capture_gpu_written = false;
+      if (!lima_bo_update(bo, need_map, need_va)) {
+         lima_bo_destroy(bo);
+         return NULL;
+      }
+      return bo;
+   }
+
+   if (!(bo = calloc(1, sizeof(*bo))))
+       return NULL;
+
    struct drm_lima_gem_create drm_request = {
       .size = size,
       .flags = flags,
    };
 
-   if (!(bo = calloc(1, sizeof(*bo))))
-       return NULL;
-
    if (drmIoctl(screen->fd, DRM_IOCTL_LIMA_GEM_CREATE, &drm_request))
       goto err_out0;
 
    bo->screen = screen;
    bo->size = drm_request.size;
+   bo->flags = flags;
    bo->handle = drm_request.handle;
+   bo->cacheable = true;
+   bo->gpu_ctx = LIMA_BO_CTX_NONE;
    p_atomic_set(&bo->refcnt, 1);
 
    if (!lima_bo_update(bo, need_map, need_va))
@@ -122,25 +275,42 @@ void lima_bo_free(struct lima_bo *bo)
    if (!p_atomic_dec_zero(&bo->refcnt))
       return;
 
-   struct lima_screen *screen = bo->screen;
-   mtx_lock(&screen->bo_table_lock);
-   util_hash_table_remove(screen->bo_handles,
-                          (void *)(uintptr_t)bo->handle);
-   if (bo->flink_name)
-      util_hash_table_remove(screen->bo_flink_names,
-                             (void *)(uintptr_t)bo->flink_name);
-   mtx_unlock(&screen->bo_table_lock);
+   if (lima_bo_cache_put(bo))
+      return;
 
-   if (bo->va) {
-      lima_bo_va_unmap(bo, bo->va);
-      lima_va_range_free(bo->screen, bo->size, bo->va);
-   }
+   lima_bo_destroy(bo);
+}
 
-   if (bo->map)
-      lima_bo_unmap(bo);
+/* same as lima_bo_free on each bo, but the ones going to the cache
+ * take the cache lock and the stale bo check once for all of them */
+void lima_bo_free_array(struct lima_bo **bos, unsigned num)
+{
+   struct lima_screen *screen = NULL;
+   time_t time = 0;
 
-   lima_close_kms_handle(screen, bo->handle);
-   free(bo);
+   for (unsigned i = 0; i < num; i++) {
+      struct lima_bo *bo = bos[i];
+
+      if (!p_atomic_dec_zero(&bo->refcnt))
+         continue;
+
+      if (!bo->cacheable) {
+         lima_bo_destroy(bo);
+         continue;
+      }
+
+      if (!screen) {
+         screen = bo->screen;
+         mtx_lock(&screen->bo_cache_lock);
+         time = lima_bo_cache_time();
+      }
+      lima_bo_cache_add(bo, time);
+   }
+
+   if (screen) {
+      lima_bo_cache_free_stale_bos(screen, time);
+      mtx_unlock(&screen->bo_cache_lock);
+   }
 }
 
 void *lima_bo_map(struct lima_bo *bo)
@@ -227,6 +397,9 @@ bool lima_bo_export(struct lima_bo *bo, struct winsys_handle *handle)
 {
    struct lima_screen *screen = bo->screen;
 
+   /* a bo shared with others can't be recycled in the cache */
+   bo->cacheable = false;
+
    switch (handle->type) {
    case DRM_API_HANDLE_TYPE_SHARED:
       if (!bo->flink_name) {
@@ -370,11 +543,38 @@ struct lima_bo *lima_bo_import(struct lima_screen *screen,
 
 bool lima_bo_wait(struct lima_bo *bo, uint32_t op, uint64_t timeout_ns)
 {
+   int64_t trace_begin = lima_trace_begin(bo->screen);
+
    struct drm_lima_gem_wait req = {
       .handle = bo->handle,
       .op = op,
       .timeout_ns = timeout_ns,
    };
 
-   return drmIoctl(bo->screen->fd, DRM_IOCTL_LIMA_GEM_WAIT, &req) == 0;
+   bool ret = drmIoctl(bo->screen->fd, DRM_IOCTL_LIMA_GEM_WAIT, &req) == 0;
+   /* the polls of the bo cache and busy checks don't wait */
+   if (timeout_ns)
+      lima_trace_end(bo->screen, "bo wait", trace_begin);
+   return ret;
+}
+
+/* before a submit of ctx using the bo, so other contexts don't take it
+ * for idle before its seqno is known */
+void lima_bo_claim_gpu_use(struct lima_bo *bo, int ctx)
+{
+   int old = p_atomic_cmpxchg(&bo->gpu_ctx, LIMA_BO_CTX_NONE, ctx);
+   if (old != LIMA_BO_CTX_NONE && old != ctx)
+      p_atomic_set(&bo->gpu_ctx, LIMA_BO_CTX_MANY);
+}
+
+/* record a submit using the bo, seqnos are per context and pipe */
+void lima_bo_mark_gpu_use(struct lima_bo *bo, int ctx, uint32_t pipe,
+                          uint32_t seqno, bool write)
+{
+   if (p_atomic_read(&bo->gpu_ctx) != ctx)
+      return;
+
+   p_atomic_set(&bo->gpu_seqno[pipe], seqno);
+   if (write)
+      p_atomic_set(&bo->gpu_write_seqno[pipe], seqno);
 }
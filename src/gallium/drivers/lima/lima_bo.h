@@ -26,29 +26,61 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "util/u_atomic.h"
+#include "util/list.h"
 
 struct lima_bo {
    struct lima_screen *screen;
    int refcnt;
 
    uint32_t size;
+   uint32_t flags;
    uint32_t handle;
    uint64_t offset;
    uint32_t flink_name;
 
    void *map;
    uint32_t va;
+
+   /* bo cache */
+   bool cacheable;
+   time_t free_time;
+   struct list_head size_list;
+   struct list_head time_list;
+
+   /* last GPU use, lets waits on idle bos skip the ioctl, only trusted
+    * for cacheable bos as the others may be used outside this process.
+    * gpu_ctx is claimed atomically before a submit and only goes from
+    * NONE to a context and on to MANY until the bo is recycled, the
+    * seqnos are only written by the context owning the bo. */
+   #define LIMA_BO_CTX_NONE -1
+   #define LIMA_BO_CTX_MANY -2
+   int gpu_ctx;
+   uint32_t gpu_seqno[2];
+   uint32_t gpu_write_seqno[2];
+
+   /* number of jobs using the bo which are not submitted yet */
+   int pending_jobs;
+
+   /* content last written to the capture, see lima_capture.c */
+   bool captured;
+   bool capture_gpu_written;
+   uint64_t capture_hash;
 };
 
 bool lima_bo_table_init(struct lima_screen *screen);
 void lima_bo_table_fini(struct lima_screen *screen);
 
+void lima_bo_cache_init(struct lima_screen *screen);
+void lima_bo_cache_fini(struct lima_screen *screen);
+
 struct lima_bo *lima_bo_create(struct lima_screen *screen,
                                uint32_t size, uint32_t flags,
                                bool need_map, bool need_va);
 void lima_bo_free(struct lima_bo *bo);
+void lima_bo_free_array(struct lima_bo **bos, unsigned num);
 
 static inline void lima_bo_reference(struct lima_bo *bo)
 {
@@ -68,5 +100,8 @@ struct lima_bo *lima_bo_import(struct lima_screen *screen,
                                struct winsys_handle *handle);
 
 bool lima_bo_wait(struct lima_bo *bo, uint32_t op, uint64_t timeout_ns);
+void lima_bo_claim_gpu_use(struct lima_bo *bo, int ctx);
+void lima_bo_mark_gpu_use(struct lima_bo *bo, int ctx, uint32_t pipe,
+                          uint32_t seqno, bool write);
 
 #endif
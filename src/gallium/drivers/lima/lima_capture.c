@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_dynarray.h"
+#include "util/u_queue.h"
+#include "util/os_time.h"
+
+#include "lima_drm.h"
+
+#include "lima_screen.h"
+#include "lima_capture.h"
+#include "lima_submit.h"
+#include "lima_bo.h"
+
+/* The records of a submit are built on the thread submitting it and the
+ * file is written by the capture thread, so a capture doesn't wait for
+ * the GPU or the disk. Only what the GPU reads and may have changed is
+ * copied, the bos are hashed to find out. */
+struct lima_capture {
+   FILE *fp;
+   /* the bo capture state is shared by the contexts of the screen */
+   mtx_t lock;
+   struct util_queue queue;
+   bool write_error;
+};
+
+struct lima_capture_job {
+   struct lima_capture *capture;
+   struct util_dynarray data;
+   struct util_queue_fence fence;
+};
+
+struct lima_capture *
+lima_capture_create(struct lima_screen *screen, const char *filename)
+{
+   struct lima_capture *capture = calloc(1, sizeof(*capture));
+   if (!capture)
+      return NULL;
+
+   capture->fp = fopen(filename, "wb");
+   if (!capture->fp)
+      goto err_out0;
+
+   /* the file grows as fast as the app submits, the queue with it */
+   if (!util_queue_init(&capture->queue, "lima_capture", 64, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      goto err_out1;
+
+   struct lima_capture_header header = {
+      .magic = LIMA_CAPTURE_MAGIC,
+      .version = LIMA_CAPTURE_VERSION,
+      .gpu_type = screen->gpu_type,
+      .num_pp = screen->num_pp,
+   };
+   if (fwrite(&header, sizeof(header), 1, capture->fp) != 1)
+      goto err_out2;
+
+   mtx_init(&capture->lock, mtx_plain);
+   return capture;
+
+err_out2:
+   util_queue_destroy(&capture->queue);
+err_out1:
+   fclose(capture->fp);
+err_out0:
+   free(capture);
+   return NULL;
+}
+
+void
+lima_capture_destroy(struct lima_capture *capture)
+{
+   util_queue_finish(&capture->queue);
+   util_queue_destroy(&capture->queue);
+   fclose(capture->fp);
+   mtx_destroy(&capture->lock);
+   free(capture);
+}
+
+static void
+lima_capture_job_execute(void *data, int thread_index)
+{
+   struct lima_capture_job *job = data;
+   struct lima_capture *capture = job->capture;
+
+   if (fwrite(util_dynarray_begin(&job->data), job->data.size, 1,
+              capture->fp) != 1 && !capture->write_error) {
+      fprintf(stderr, "lima: capture write error, the capture is truncated\n");
+      capture->write_error = true;
+   }
+}
+
+static void
+lima_capture_job_cleanup(void *data, int thread_index)
+{
+   struct lima_capture_job *job = data;
+
+   util_dynarray_fini(&job->data);
+   util_queue_fence_destroy(&job->fence);
+   free(job);
+}
+
+static struct lima_capture_job *
+lima_capture_job_create(struct lima_capture *capture)
+{
+   struct lima_capture_job *job = malloc(sizeof(*job));
+   if (!job)
+      return NULL;
+
+   job->capture = capture;
+   util_dynarray_init(&job->data, NULL);
+   util_queue_fence_init(&job->fence);
+   return job;
+}
+
+static void
+lima_capture_job_queue(struct lima_capture *capture,
+                       struct lima_capture_job *job)
+{
+   util_queue_add_job(&capture->queue, job, &job->fence,
+                      lima_capture_job_execute, lima_capture_job_cleanup);
+}
+
+static void *
+lima_capture_record(struct lima_capture_job *job, uint32_t type, uint32_t size)
+{
+   struct lima_capture_record *record =
+      util_dynarray_grow(&job->data, sizeof(*record) + size);
+   if (!record)
+      return NULL;
+
+   record->type = type;
+   record->size = size;
+   return record + 1;
+}
+
+static uint64_t
+lima_capture_hash(const void *data, uint32_t size)
+{
+   const uint64_t *p = data;
+   uint64_t hash = size;
+
+   /* bo sizes are page aligned */
+   for (uint32_t i = 0; i < size / sizeof(*p); i++)
+      hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+   return hash;
+}
+
+static void
+lima_capture_bo_content(struct lima_capture_job *job, struct lima_bo *bo)
+{
+   void *map = lima_bo_map(bo);
+   if (!map)
+      return;
+
+   uint64_t hash = lima_capture_hash(map, bo->size);
+   if (bo->captured && bo->capture_hash == hash)
+      return;
+
+   struct lima_capture_bo *cbo = lima_capture_record(
+      job, LIMA_CAPTURE_RECORD_BO, sizeof(*cbo) + bo->size);
+   if (!cbo)
+      return;
+
+   cbo->handle = bo->handle;
+   cbo->va = bo->va;
+   cbo->size = bo->size;
+   cbo->pad = 0;
+   memcpy(cbo + 1, map, bo->size);
+
+   bo->captured = true;
+   bo->capture_hash = hash;
+}
+
+void
+lima_capture_submit(struct lima_capture *capture, uint32_t ctx,
+                    uint32_t pipe, uint32_t flags, struct lima_bo **bos,
+                    struct drm_lima_gem_submit_bo *gem_bos, int nr_bos,
+                    union drm_lima_gem_submit_dep *deps, int nr_deps,
+                    void *frame, uint32_t frame_size)
+{
+   struct lima_capture_job *job = lima_capture_job_create(capture);
+   if (!job)
+      return;
+
+   mtx_lock(&capture->lock);
+
+   /* a bo written by the GPU may still be written while this runs and
+    * the replay writes it the same way */
+   for (int i = 0; i < nr_bos; i++) {
+      if (!bos[i]->capture_gpu_written)
+         lima_capture_bo_content(job, bos[i]);
+      if (gem_bos[i].flags & LIMA_SUBMIT_BO_WRITE)
+         bos[i]->capture_gpu_written = true;
+   }
+
+   uint32_t size = sizeof(struct lima_capture_submit) +
+      nr_bos * sizeof(struct lima_capture_submit_bo) +
+      nr_deps * sizeof(union drm_lima_gem_submit_dep) + frame_size;
+   struct lima_capture_submit *submit =
+      lima_capture_record(job, LIMA_CAPTURE_RECORD_SUBMIT, size);
+   if (submit) {
+      submit->time_ns = os_time_get_nano();
+      submit->ctx = ctx;
+      submit->pipe = pipe;
+      submit->flags = flags;
+      submit->nr_bos = nr_bos;
+      submit->nr_deps = nr_deps;
+      submit->frame_size = frame_size;
+
+      struct lima_capture_submit_bo *sbo = (void *)(submit + 1);
+      for (int i = 0; i < nr_bos; i++) {
+         sbo[i].handle = bos[i]->handle;
+         sbo[i].va = bos[i]->va;
+         sbo[i].size = bos[i]->size;
+         sbo[i].flags = gem_bos[i].flags;
+      }
+
+      void *p = sbo + nr_bos;
+      memcpy(p, deps, nr_deps * sizeof(union drm_lima_gem_submit_dep));
+      p += nr_deps * sizeof(union drm_lima_gem_submit_dep);
+      memcpy(p, frame, frame_size);
+   }
+
+   /* queued under the lock so the bo records stay in submit order */
+   lima_capture_job_queue(capture, job);
+
+   mtx_unlock(&capture->lock);
+}
+
+void
+lima_capture_fence(struct lima_capture *capture, uint32_t ctx,
+                   uint32_t pipe, bool submitted, uint32_t fence)
+{
+   struct lima_capture_job *job = lima_capture_job_create(capture);
+   if (!job)
+      return;
+
+   struct lima_capture_fence *cfence =
+      lima_capture_record(job, LIMA_CAPTURE_RECORD_FENCE, sizeof(*cfence));
+   if (cfence) {
+      cfence->ctx = ctx;
+      cfence->pipe = pipe;
+      cfence->fence = fence;
+      cfence->submitted = submitted;
+   }
+
+   lima_capture_job_queue(capture, job);
+}
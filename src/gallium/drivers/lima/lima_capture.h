@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef H_LIMA_CAPTURE
+#define H_LIMA_CAPTURE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* With LIMA_CAPTURE set the kernel submits are recorded to a binary file
+ * for replay: a lima_capture_header, then records each starting with a
+ * lima_capture_record. A submit record is preceded by a bo record for each
+ * of its bos whose content changed since it was last recorded, the bos
+ * only the GPU wrote to are left out. Fence records come once the kernel
+ * accepted the submit. */
+
+#define LIMA_CAPTURE_MAGIC   0x4350414c /* "LAPC" */
+#define LIMA_CAPTURE_VERSION 1
+
+struct lima_capture_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t gpu_type;
+   uint32_t num_pp;
+};
+
+enum lima_capture_record_type {
+   LIMA_CAPTURE_RECORD_BO = 1,
+   LIMA_CAPTURE_RECORD_SUBMIT,
+   LIMA_CAPTURE_RECORD_FENCE,
+};
+
+struct lima_capture_record {
+   uint32_t type;
+   /* bytes following this */
+   uint32_t size;
+};
+
+/* followed by size bytes of content */
+struct lima_capture_bo {
+   uint32_t handle;
+   uint32_t va;
+   uint32_t size;
+   uint32_t pad;
+};
+
+/* followed by nr_bos lima_capture_submit_bo, nr_deps
+ * drm_lima_gem_submit_dep and the frame */
+struct lima_capture_submit {
+   uint64_t time_ns;
+   uint32_t ctx;
+   uint32_t pipe;
+   uint32_t flags;
+   uint32_t nr_bos;
+   uint32_t nr_deps;
+   uint32_t frame_size;
+};
+
+struct lima_capture_submit_bo {
+   uint32_t handle;
+   uint32_t va;
+   uint32_t size;
+   uint32_t flags;
+};
+
+struct lima_capture_fence {
+   uint32_t ctx;
+   uint32_t pipe;
+   uint32_t fence;
+   uint32_t submitted;
+};
+
+struct lima_screen;
+struct lima_bo;
+struct lima_capture;
+struct drm_lima_gem_submit_bo;
+union drm_lima_gem_submit_dep;
+
+struct lima_capture *lima_capture_create(struct lima_screen *screen,
+                                         const char *filename);
+void lima_capture_destroy(struct lima_capture *capture);
+void lima_capture_submit(struct lima_capture *capture, uint32_t ctx,
+                         uint32_t pipe, uint32_t flags, struct lima_bo **bos,
+                         struct drm_lima_gem_submit_bo *gem_bos, int nr_bos,
+                         union drm_lima_gem_submit_dep *deps, int nr_deps,
+                         void *frame, uint32_t frame_size);
+void lima_capture_fence(struct lima_capture *capture, uint32_t ctx,
+                        uint32_t pipe, bool submitted, uint32_t fence);
+
+#endif
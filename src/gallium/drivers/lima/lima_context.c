@@ -26,11 +26,12 @@
 #include "util/u_upload_mgr.h"
 #include "util/u_math.h"
 #include "util/u_debug.h"
+#include "util/u_prim_restart.h"
 #include "util/u_transfer.h"
 #include "util/ralloc.h"
 #include "util/u_inlines.h"
-#include "util/u_suballoc.h"
 #include "util/hash_table.h"
+#include "util/u_threaded_context.h"
 
 #include "lima_screen.h"
 #include "lima_context.h"
@@ -39,53 +40,289 @@
 #include "lima_submit.h"
 #include "lima_util.h"
 #include "lima_fence.h"
+#include "lima_job.h"
+#include "lima_texture.h"
 
 #include <lima_drm.h>
 #include <xf86drm.h>
 
 int lima_ctx_num_plb = LIMA_CTX_PLB_DEF_NUM;
+bool lima_ctx_plb_adaptive = true;
+bool lima_async_submit = false;
+bool lima_pp_balance = false;
 
 uint32_t
 lima_ctx_buff_va(struct lima_context *ctx, enum lima_ctx_buff buff)
 {
    struct lima_ctx_buff_state *cbs = ctx->buffer_state + buff;
-   struct lima_resource *res = lima_resource(cbs->res);
-   lima_bo_update(res->bo, false, true);
-   return res->bo->va + cbs->offset;
+   return cbs->bo->va + cbs->offset;
 }
 
 void *
 lima_ctx_buff_map(struct lima_context *ctx, enum lima_ctx_buff buff)
 {
    struct lima_ctx_buff_state *cbs = ctx->buffer_state + buff;
-   struct lima_resource *res = lima_resource(cbs->res);
-   lima_bo_update(res->bo, true, false);
-   return res->bo->map + cbs->offset;
+   return cbs->bo->map + cbs->offset;
+}
+
+static bool
+lima_ctx_buff_bo_busy(struct lima_context *ctx, struct lima_bo *bo)
+{
+   /* pending and submitted jobs hold a reference until they retire */
+   if (p_atomic_read(&bo->refcnt) > 1)
+      return true;
+
+   /* state not re-allocated for each draw may still be used by later ones */
+   for (int i = 0; i < lima_ctx_buff_num; i++) {
+      if (ctx->buffer_state[i].bo == bo)
+         return true;
+   }
+
+   return false;
+}
+
+static bool
+lima_ctx_buff_bo_switch(struct lima_context *ctx, unsigned size)
+{
+   struct lima_bo **bos = util_dynarray_begin(&ctx->buff_bos);
+   unsigned num = ctx->buff_bos.size / sizeof(*bos);
+   struct lima_bo *bo = NULL;
+   unsigned n = 0;
+
+   /* pick an idle bo and release idle oversized ones */
+   for (unsigned i = 0; i < num; i++) {
+      if (bos[i] != ctx->buff_bo && !lima_ctx_buff_bo_busy(ctx, bos[i])) {
+         if (!bo && bos[i]->size >= size)
+            bo = bos[i];
+         else if (bos[i]->size > LIMA_CTX_BUFF_BO_SIZE) {
+            lima_bo_free(bos[i]);
+            continue;
+         }
+      }
+      bos[n++] = bos[i];
+   }
+   ctx->buff_bos.size = n * sizeof(*bos);
+
+   if (!bo) {
+      struct lima_screen *screen = lima_screen(ctx->base.screen);
+      bo = lima_bo_create(screen, MAX2(size, LIMA_CTX_BUFF_BO_SIZE), 0,
+                          true, true);
+      if (!bo)
+         return false;
+      util_dynarray_append(&ctx->buff_bos, struct lima_bo *, bo);
+   }
+
+   ctx->buff_bo = bo;
+   ctx->buff_bo_offset = 0;
+   return true;
 }
 
 void *
 lima_ctx_buff_alloc(struct lima_context *ctx, enum lima_ctx_buff buff,
-                    unsigned size, unsigned submit, bool uploader)
+                    unsigned size, unsigned submit)
 {
    struct lima_ctx_buff_state *cbs = ctx->buffer_state + buff;
-   void *ret = NULL;
 
+   cbs->bo = NULL;
    cbs->size = align(size, 0x40);
 
-   if (uploader)
-      u_upload_alloc(ctx->uploader, 0, cbs->size, 0x40, &cbs->offset,
-                     &cbs->res, &ret);
-   else
-      u_suballocator_alloc(ctx->suballocator, cbs->size, 0x10,
-                           &cbs->offset, &cbs->res);
+   if (!ctx->buff_bo ||
+       ctx->buff_bo_offset + cbs->size > ctx->buff_bo->size) {
+      if (!lima_ctx_buff_bo_switch(ctx, cbs->size))
+         return NULL;
+   }
+
+   cbs->bo = ctx->buff_bo;
+   cbs->offset = ctx->buff_bo_offset;
+   cbs->submit = submit;
+   ctx->buff_bo_offset += cbs->size;
+   ctx->stats[LIMA_QUERY_UPLOAD_BYTES] += cbs->size;
+
+   /* only add the bo to each pipe of the job once */
+   if (submit) {
+      struct lima_job *job = ctx->job;
+      assert(job);
+
+      if (job->buff_bo != cbs->bo) {
+         job->buff_bo = cbs->bo;
+         job->buff_bo_submit = 0;
+      }
+
+      submit &= ~job->buff_bo_submit;
+      if (submit & LIMA_CTX_BUFF_SUBMIT_GP)
+         lima_job_add_bo(job, LIMA_PIPE_GP, cbs->bo, LIMA_SUBMIT_BO_READ);
+      if (submit & LIMA_CTX_BUFF_SUBMIT_PP)
+         lima_job_add_bo(job, LIMA_PIPE_PP, cbs->bo, LIMA_SUBMIT_BO_READ);
+      job->buff_bo_submit |= submit;
+   }
+
+   return cbs->bo->map + cbs->offset;
+}
+
+struct lima_ctx_state_block {
+   const void *data;
+   unsigned size;
+   unsigned offset;
+};
+
+static uint32_t
+state_block_hash(const void *key)
+{
+   const struct lima_ctx_state_block *block = key;
+   return _mesa_hash_data(block->data, block->size);
+}
+
+static bool
+state_block_compare(const void *key1, const void *key2)
+{
+   const struct lima_ctx_state_block *block1 = key1;
+   const struct lima_ctx_state_block *block2 = key2;
+
+   return block1->size == block2->size &&
+      !memcmp(block1->data, block2->data, block1->size);
+}
+
+static void
+state_block_free(struct hash_entry *entry)
+{
+   ralloc_free(entry->data);
+}
+
+/* Blocks are only written to the free end of the state bo, so the ones
+ * read by pending jobs never change. A full bo goes to the ring of
+ * lima_ctx_buff_alloc, which takes it once the jobs using it retired. */
+static bool
+lima_ctx_state_bo_switch(struct lima_context *ctx)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   struct lima_bo *bo =
+      lima_bo_create(screen, LIMA_CTX_BUFF_BO_SIZE, 0, true, true);
+   if (!bo)
+      return false;
+
+   if (ctx->state_bo)
+      util_dynarray_append(&ctx->buff_bos, struct lima_bo *, ctx->state_bo);
+   _mesa_hash_table_clear(ctx->state_cache, state_block_free);
+
+   ctx->state_bo = bo;
+   ctx->state_bo_offset = 0;
+   return true;
+}
+
+/* The block of state_bo with the content of data, only uploaded when no
+ * earlier upload had the same. */
+static struct lima_ctx_state_block *
+lima_ctx_state_upload(struct lima_context *ctx, const void *data,
+                      unsigned size)
+{
+   struct lima_ctx_state_block key = { .data = data, .size = size };
+   uint32_t hash = state_block_hash(&key);
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(ctx->state_cache, hash, &key);
+
+   if (entry)
+      return entry->data;
+
+   unsigned aligned_size = align(size, 0x40);
+   if ((!ctx->state_bo ||
+        ctx->state_bo_offset + aligned_size > ctx->state_bo->size) &&
+       !lima_ctx_state_bo_switch(ctx))
+      return NULL;
+
+   struct lima_ctx_state_block *block =
+      ralloc_size(ctx->state_cache, sizeof(*block) + size);
+   if (!block)
+      return NULL;
+
+   memcpy(block + 1, data, size);
+   block->data = block + 1;
+   block->size = size;
+   block->offset = ctx->state_bo_offset;
+   _mesa_hash_table_insert_pre_hashed(ctx->state_cache, hash, block, block);
+
+   memcpy(ctx->state_bo->map + block->offset, data, size);
+   ctx->state_bo_offset += aligned_size;
+   ctx->stats[LIMA_QUERY_UPLOAD_BYTES] += aligned_size;
+   return block;
+}
+
+/* Like lima_ctx_buff_alloc with the content of the buffer in data, which
+ * is only uploaded when no earlier upload had the same. Static state
+ * like the constants and attribute tables of draws repeated every frame
+ * is then hashed and compared on the CPU instead of written again. */
+void *
+lima_ctx_buff_upload(struct lima_context *ctx, enum lima_ctx_buff buff,
+                     const void *data, unsigned size, unsigned submit)
+{
+   struct lima_ctx_buff_state *cbs = ctx->buffer_state + buff;
+
+   if (size > LIMA_CTX_STATE_MAX_SIZE) {
+      void *map = lima_ctx_buff_alloc(ctx, buff, size, submit);
+      if (map)
+         memcpy(map, data, size);
+      return map;
+   }
+
+   cbs->bo = NULL;
+   cbs->size = align(size, 0x40);
+
+   struct lima_ctx_state_block *block = lima_ctx_state_upload(ctx, data, size);
+   if (!block)
+      return NULL;
+
+   cbs->bo = ctx->state_bo;
+   cbs->offset = block->offset;
+   cbs->submit = submit;
 
-   struct lima_resource *res = lima_resource(cbs->res);
    if (submit & LIMA_CTX_BUFF_SUBMIT_GP)
-      lima_submit_add_bo(ctx->gp_submit, res->bo, LIMA_SUBMIT_BO_READ);
+      lima_job_add_bo(ctx->job, LIMA_PIPE_GP, cbs->bo, LIMA_SUBMIT_BO_READ);
    if (submit & LIMA_CTX_BUFF_SUBMIT_PP)
-      lima_submit_add_bo(ctx->pp_submit, res->bo, LIMA_SUBMIT_BO_READ);
+      lima_job_add_bo(ctx->job, LIMA_PIPE_PP, cbs->bo, LIMA_SUBMIT_BO_READ);
 
-   return ret;
+   return cbs->bo->map + cbs->offset;
+}
+
+/* Index arrays in application memory are state blocks too, so the short
+ * ones of quads and glyphs drawn again and again with the same content
+ * are hashed instead of uploaded on each draw. Returns the address of
+ * the indices for the GP of the current job, 0 when too large. */
+uint32_t
+lima_ctx_upload_indices(struct lima_context *ctx, const void *data,
+                        unsigned size)
+{
+   if (size > LIMA_CTX_STATE_MAX_SIZE)
+      return 0;
+
+   struct lima_ctx_state_block *block = lima_ctx_state_upload(ctx, data, size);
+   if (!block)
+      return 0;
+
+   lima_job_add_bo(ctx->job, LIMA_PIPE_GP, ctx->state_bo, LIMA_SUBMIT_BO_READ);
+   return ctx->state_bo->va + block->offset;
+}
+
+/* add bos of states kept from before to the current job */
+void
+lima_ctx_buff_submit(struct lima_context *ctx)
+{
+   struct lima_job *job = ctx->job;
+
+   job->buff_bo = ctx->buff_bo;
+   job->buff_bo_submit = 0;
+
+   for (int i = 0; i < lima_ctx_buff_num; i++) {
+      struct lima_ctx_buff_state *cbs = ctx->buffer_state + i;
+      if (!cbs->bo)
+         continue;
+
+      if (cbs->submit & LIMA_CTX_BUFF_SUBMIT_GP)
+         lima_job_add_bo(job, LIMA_PIPE_GP, cbs->bo, LIMA_SUBMIT_BO_READ);
+      if (cbs->submit & LIMA_CTX_BUFF_SUBMIT_PP)
+         lima_job_add_bo(job, LIMA_PIPE_PP, cbs->bo, LIMA_SUBMIT_BO_READ);
+
+      if (cbs->bo == ctx->buff_bo)
+         job->buff_bo_submit |= cbs->submit;
+   }
 }
 
 static int
@@ -97,7 +334,7 @@ lima_context_create_drm_ctx(struct lima_screen *screen)
 
    int ret = drmIoctl(screen->fd, DRM_IOCTL_LIMA_CTX, &req);
    if (ret)
-      return errno;
+      return -errno;
 
    return req.id;
 }
@@ -113,28 +350,176 @@ lima_context_free_drm_ctx(struct lima_screen *screen, int id)
    drmIoctl(screen->fd, DRM_IOCTL_LIMA_CTX, &req);
 }
 
+/* the GP stream has a slot for every PLB the ring can grow to, they are
+ * static for any framebuffer. Both are created by the first job, contexts
+ * which never draw don't allocate them, and they come from the bo cache
+ * of the screen where the PLBs of destroyed contexts end up. */
+static bool
+lima_ctx_plb_create(struct lima_context *ctx, int index, unsigned num_blk)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+
+   if (!ctx->plb_gp_stream) {
+      unsigned plb_gp_stream_size =
+         align(ctx->plb_gp_size * LIMA_CTX_PLB_MAX_NUM, LIMA_PAGE_SIZE);
+      ctx->plb_gp_stream =
+         lima_bo_create(screen, plb_gp_stream_size, 0, true, true);
+      if (!ctx->plb_gp_stream)
+         return false;
+   }
+
+   ctx->plb[index] = lima_bo_create(screen, num_blk * LIMA_CTX_PLB_BLK_SIZE,
+                                    0, false, true);
+   if (!ctx->plb[index])
+      return false;
+   ctx->plb_num_blk[index] = num_blk;
+
+   uint32_t *plb_gp_stream = ctx->plb_gp_stream->map + index * ctx->plb_gp_size;
+   for (int j = 0; j < num_blk; j++)
+      plb_gp_stream[j] = ctx->plb[index]->va + LIMA_CTX_PLB_BLK_SIZE * j;
+
+   return true;
+}
+
+/* Gives the PLB at index room for num_blk blocks. Pending jobs of the
+ * PLB have their draws recorded against the old bo and the GP stream
+ * slot can't change under a running GP job, so the PLB is only replaced
+ * when nothing uses it. The full framebuffer PP streams of m400 kept for
+ * the old bo are rebuilt on next use. */
+bool
+lima_ctx_plb_grow(struct lima_context *ctx, uint32_t index, unsigned num_blk)
+{
+   struct lima_bo *old = ctx->plb[index];
+
+   if (ctx->plb_num_blk[index] >= num_blk)
+      return true;
+
+   struct hash_entry *entry;
+   hash_table_foreach(ctx->jobs, entry) {
+      struct lima_job *job = entry->data;
+      if (job->plb_index == index)
+         return false;
+   }
+
+   if (!lima_ctx_bo_idle(ctx, old, true) &&
+       !lima_bo_wait(old, LIMA_GEM_WAIT_WRITE, 0))
+      return false;
+
+   if (!lima_ctx_plb_create(ctx, index, num_blk)) {
+      ctx->plb[index] = old;
+      return false;
+   }
+   lima_bo_free(old);
+
+   if (ctx->plb_pp_stream) {
+      mtx_lock(&ctx->plb_pp_stream_lock);
+      hash_table_foreach(ctx->plb_pp_stream, entry) {
+         struct lima_ctx_plb_pp_stream *s = entry->data;
+         if (s->key.plb_index == index && s->bo) {
+            lima_bo_free(s->bo);
+            s->bo = NULL;
+         }
+      }
+      mtx_unlock(&ctx->plb_pp_stream_lock);
+   }
+
+   return true;
+}
+
+/* group the tiles of fb in blocks sharing a polygon list, as few tiles
+ * per block as limit blocks allow */
+void
+lima_ctx_fb_blocking(struct lima_context_framebuffer *fb, unsigned limit)
+{
+   int width = fb->tiled_w;
+   int height = fb->tiled_h;
+
+   fb->shift_w = 0;
+   fb->shift_h = 0;
+   while ((width * height) > limit) {
+      if (width >= height) {
+         width = (width + 1) >> 1;
+         fb->shift_w++;
+      } else {
+         height = (height + 1) >> 1;
+         fb->shift_h++;
+      }
+   }
+
+   fb->block_w = width;
+   fb->block_h = height;
+
+   int max = MAX2(fb->shift_w, fb->shift_h);
+   if (max > 2)
+      fb->shift_max = 2;
+   else if (max)
+      fb->shift_max = 1;
+   else
+      fb->shift_max = 0;
+}
+
+/* A GP job which has to wait for the PP job of an earlier frame to stop
+ * reading its PLB can't overlap with it, add a PLB to the ring for the
+ * next job instead of reusing the oldest one. Gives the PLB index to use
+ * for the next job. */
+bool
+lima_ctx_plb_next(struct lima_context *ctx, uint32_t *index)
+{
+   if (ctx->plb_stalled) {
+      ctx->plb_stalled = false;
+
+      if (lima_ctx_plb_adaptive && ctx->num_plb < LIMA_CTX_PLB_MAX_NUM &&
+          lima_ctx_plb_create(ctx, ctx->num_plb, ctx->plb_max_blk)) {
+         ctx->plb_index = ctx->num_plb++;
+         debug_printf("lima: grow PLB ring to %u after %u stalls\n",
+                      ctx->num_plb, ctx->plb_stalls);
+      }
+   }
+
+   if (!ctx->plb[ctx->plb_index] &&
+       !lima_ctx_plb_create(ctx, ctx->plb_index, ctx->plb_max_blk))
+      return false;
+
+   *index = ctx->plb_index;
+   ctx->plb_index = (ctx->plb_index + 1) % ctx->num_plb;
+   return true;
+}
+
 static void
 lima_context_destroy(struct pipe_context *pctx)
 {
    struct lima_context *ctx = lima_context(pctx);
    struct lima_screen *screen = lima_screen(pctx->screen);
 
-   for (int i = 0; i < lima_ctx_buff_num; i++)
-      pipe_resource_reference(&ctx->buffer_state[i].res, NULL);
+   /* let the worker finish the queued submits */
+   if (util_queue_is_initialized(&ctx->submit_queue))
+      util_queue_destroy(&ctx->submit_queue);
 
+   lima_blit_fini(ctx);
+   lima_job_fini(ctx);
+   lima_fence_signal_deferred(ctx);
    lima_state_fini(ctx);
 
    slab_destroy_child(&ctx->transfer_pool);
+   slab_destroy_child(&ctx->transfer_pool_unsync);
 
-   if (ctx->suballocator)
-      u_suballocator_destroy(ctx->suballocator);
+   util_dynarray_foreach(&ctx->buff_bos, struct lima_bo *, bo)
+      lima_bo_free(*bo);
+   if (ctx->state_bo)
+      lima_bo_free(ctx->state_bo);
+   if (ctx->quad_index_bo)
+      lima_bo_free(ctx->quad_index_bo);
 
    if (ctx->uploader)
       u_upload_destroy(ctx->uploader);
 
+   util_prim_restart_cache_destroy(ctx->prim_restart);
+
    for (int i = 0; i < LIMA_CTX_PLB_MAX_NUM; i++) {
       if (ctx->plb[i])
          lima_bo_free(ctx->plb[i]);
+      if (ctx->tile_heap[i])
+         lima_bo_free(ctx->tile_heap[i]);
    }
 
    if (ctx->plb_gp_stream)
@@ -145,9 +530,22 @@ lima_context_destroy(struct pipe_context *pctx)
 
    lima_context_free_drm_ctx(screen, ctx->id);
 
+   mtx_destroy(&ctx->plb_pp_stream_lock);
    ralloc_free(ctx);
 }
 
+static void
+lima_set_debug_callback(struct pipe_context *pctx,
+                        const struct pipe_debug_callback *cb)
+{
+   struct lima_context *ctx = lima_context(pctx);
+
+   if (cb)
+      ctx->debug = *cb;
+   else
+      memset(&ctx->debug, 0, sizeof(ctx->debug));
+}
+
 static uint32_t
 plb_pp_stream_hash(const void *key)
 {
@@ -178,6 +576,9 @@ lima_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
 
    ctx->base.screen = pscreen;
    ctx->base.destroy = lima_context_destroy;
+   ctx->base.set_debug_callback = lima_set_debug_callback;
+
+   mtx_init(&ctx->plb_pp_stream_lock, mtx_plain);
 
    lima_resource_context_init(ctx);
    lima_fence_context_init(ctx);
@@ -187,50 +588,53 @@ lima_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
    lima_query_init(ctx);
 
    slab_create_child(&ctx->transfer_pool, &screen->transfer_pool);
+   slab_create_child(&ctx->transfer_pool_unsync, &screen->transfer_pool);
 
    ctx->uploader = u_upload_create_default(&ctx->base);
    if (!ctx->uploader)
       goto err_out;
+   /* lima_flush_jobs passes the fences */
+   u_upload_enable_ring(ctx->uploader, 4);
    ctx->base.stream_uploader = ctx->uploader;
    ctx->base.const_uploader = ctx->uploader;
    ctx->base.texture_subdata = u_default_texture_subdata;
 
-   /* for varying output which need not mmap */
-   ctx->suballocator =
-      u_suballocator_create(&ctx->base, 1024 * 1024, 0,
-                            PIPE_USAGE_STREAM, 0, false);
-   if (!ctx->suballocator)
+   ctx->prim_restart = util_prim_restart_cache_create();
+   if (!ctx->prim_restart)
       goto err_out;
 
-   util_dynarray_init(&ctx->vs_cmd_array, ctx);
-   util_dynarray_init(&ctx->plbu_cmd_array, ctx);
+   util_dynarray_init(&ctx->buff_bos, ctx);
+   util_dynarray_init(&ctx->state_scratch, ctx);
+   util_dynarray_init(&ctx->deferred_fences, ctx);
 
-   if (screen->gpu_type == LIMA_INFO_GPU_MALI450)
-      ctx->plb_max_blk = 4096;
-   else
-      ctx->plb_max_blk = 512;
-   ctx->plb_size = ctx->plb_max_blk * LIMA_CTX_PLB_BLK_SIZE;
-   ctx->plb_gp_size = ctx->plb_max_blk * 4;
+   ctx->state_cache = _mesa_hash_table_create(
+      ctx, state_block_hash, state_block_compare);
+   if (!ctx->state_cache)
+      goto err_out;
 
-   for (int i = 0; i < lima_ctx_num_plb; i++) {
-      ctx->plb[i] = lima_bo_create(screen, ctx->plb_size, 0, false, true);
-      if (!ctx->plb[i])
-         goto err_out;
-   }
+   if (!lima_job_init(ctx))
+      goto err_out;
 
-   unsigned plb_gp_stream_size =
-      align(ctx->plb_gp_size * lima_ctx_num_plb, LIMA_PAGE_SIZE);
-   ctx->plb_gp_stream =
-      lima_bo_create(screen, plb_gp_stream_size, 0, true, true);
-   if (!ctx->plb_gp_stream)
+   if (!lima_texture_init(ctx))
       goto err_out;
 
-   /* plb gp stream is static for any framebuffer */
-   for (int i = 0; i < lima_ctx_num_plb; i++) {
-      uint32_t *plb_gp_stream = ctx->plb_gp_stream->map + i * ctx->plb_gp_size;
-      for (int j = 0; j < ctx->plb_max_blk; j++)
-         plb_gp_stream[j] = ctx->plb[i]->va + LIMA_CTX_PLB_BLK_SIZE * j;
+   if (!lima_blit_init(ctx))
+      goto err_out;
+
+   ctx->sample_mask = ~0;
+
+   /* fine grouping fits 1080p with 2x2 tiles per block on m400 and
+    * single tiles on m450 */
+   if (screen->gpu_type == LIMA_INFO_GPU_MALI450) {
+      ctx->plb_max_blk = 4096;
+      ctx->plb_fine_max_blk = 8192;
    }
+   else {
+      ctx->plb_max_blk = 512;
+      ctx->plb_fine_max_blk = 2048;
+   }
+   ctx->plb_gp_size = ctx->plb_fine_max_blk * 4;
+   ctx->num_plb = lima_ctx_num_plb;
 
    if (screen->gpu_type == LIMA_INFO_GPU_MALI400) {
       ctx->plb_pp_stream = _mesa_hash_table_create(
@@ -239,6 +643,10 @@ lima_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
          goto err_out;
    }
 
+   if (lima_async_submit &&
+       !util_queue_init(&ctx->submit_queue, "lima_submit", 16, 1, 0))
+      goto err_out;
+
    ctx->gp_submit = lima_submit_create(ctx, LIMA_PIPE_GP);
    if (!ctx->gp_submit)
       goto err_out;
@@ -247,7 +655,20 @@ lima_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
    if (!ctx->pp_submit)
       goto err_out;
 
-   return &ctx->base;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED))
+      return &ctx->base;
+
+   struct threaded_context *tc = NULL;
+   struct pipe_context *pctx =
+      threaded_context_create(&ctx->base, &screen->transfer_pool,
+                              lima_replace_buffer_storage,
+                              lima_fence_create_unflushed, &tc);
+
+   /* each draw is a full gp/pp setup, there's no primitive ID */
+   if (tc)
+      tc->coalesce_calls = true;
+
+   return pctx;
 
 err_out:
    lima_context_destroy(&ctx->base);
@@ -257,6 +678,44 @@ err_out:
 bool
 lima_need_flush(struct lima_context *ctx, struct lima_bo *bo, bool write)
 {
-   return lima_submit_has_bo(ctx->gp_submit, bo, write) ||
-      lima_submit_has_bo(ctx->pp_submit, bo, write);
+   /* only look into the jobs when some of them use the bo */
+   if (p_atomic_read(&bo->pending_jobs)) {
+      struct hash_entry *entry;
+      hash_table_foreach(ctx->jobs, entry) {
+         if (lima_job_has_bo(entry->data, bo, write))
+            return true;
+      }
+   }
+
+   /* bos of queued submits only look busy to the kernel once the worker
+    * has passed them on, make sure it did before the caller waits on bo */
+   lima_submit_queue_finish(ctx);
+   return false;
+}
+
+/* tell from the last submits using bo that the GPU is done with it,
+ * false means the kernel has to be asked */
+bool
+lima_ctx_bo_idle(struct lima_context *ctx, struct lima_bo *bo, bool write)
+{
+   int gpu_ctx = p_atomic_read(&bo->gpu_ctx);
+   if (!bo->cacheable || gpu_ctx == LIMA_BO_CTX_MANY)
+      return false;
+
+   if (gpu_ctx == LIMA_BO_CTX_NONE)
+      return true;
+
+   if (gpu_ctx != ctx->id)
+      return false;
+
+   /* CPU reads only wait for GPU writes */
+   uint32_t *seqno = write ? bo->gpu_seqno : bo->gpu_write_seqno;
+   uint32_t gp_seqno = p_atomic_read(&seqno[LIMA_PIPE_GP]);
+   uint32_t pp_seqno = p_atomic_read(&seqno[LIMA_PIPE_PP]);
+   if (!lima_submit_seqno_signalled(ctx->gp_submit, gp_seqno) ||
+       !lima_submit_seqno_signalled(ctx->pp_submit, pp_seqno))
+      return false;
+
+   /* another context may have claimed the bo in the meantime */
+   return p_atomic_read(&bo->gpu_ctx) == ctx->id;
 }
@@ -25,12 +25,17 @@
 #ifndef H_LIMA_CONTEXT
 #define H_LIMA_CONTEXT
 
+#include <string.h>
+
 #include "util/slab.h"
 #include "util/u_dynarray.h"
+#include "util/u_queue.h"
 
 #include "pipe/p_context.h"
 #include "pipe/p_state.h"
 
+struct blitter_context;
+
 struct lima_context_framebuffer {
    struct pipe_surface *cbuf, *zsbuf;
    int width, height;
@@ -38,6 +43,8 @@ struct lima_context_framebuffer {
    int shift_w, shift_h;
    int block_w, block_h;
    int shift_max;
+   /* 0 or 4, the samples are resolved in the tile buffer on write back */
+   int samples;
 };
 
 struct lima_context_clear {
@@ -47,14 +54,120 @@ struct lima_context_clear {
    uint32_t stencil;
 };
 
+/* the CSOs carry their part of the render state words */
 struct lima_depth_stencil_alpha_state {
    struct pipe_depth_stencil_alpha_state base;
+   uint32_t depth_test;
+   uint32_t stencil_front;
+   uint32_t stencil_back;
+   uint32_t stencil_test;
+};
+
+/* vec4 slots of the PP stack a fragment shader can spill to */
+#define LIMA_PP_MAX_STACK_SIZE 16
+
+/* compile statistics of a shader, reported as shader info through the
+ * debug callback when it gets compiled or loaded from the disk cache */
+struct lima_shader_stats {
+   int instrs;
+   /* filled slots out of all the slots of the instrs */
+   int slots;
+   int max_slots;
+   /* vec4 registers */
+   int regs;
+   int spills;
+   /* constant components embedded in the shader */
+   int consts;
+   /* in us */
+   int64_t compile_time;
+   /* in us, of the pp register allocation */
+   int64_t regalloc_time;
+};
+
+/* entry of a shader state in the screen program cache, see lima_program.c */
+struct lima_program_ref {
+   /* sha1 of the shader and its compile options */
+   unsigned char key[20];
+   int refcnt;
+};
+
+/* the state lowered into a fragment shader, one compiled variant each */
+struct lima_fs_key {
+   float alpha_ref;
+   /* PIPE_FUNC_ALWAYS when the alpha test is disabled */
+   uint8_t alpha_func;
+   /* PIPE_SWIZZLE_* of the sampler views, the hw has no swizzle */
+   uint8_t swizzles[PIPE_MAX_SAMPLERS][4];
+   /* drawing point sprites, the sprite fields are 0 otherwise */
+   bool points;
+   bool sprite_coord_lower_left;
+   /* generic inputs replaced by the point coord, as in the rasterizer */
+   uint32_t sprite_coord_enable;
+};
+
+/* The uniform only expressions of a fragment shader, evaluated on the cpu
+ * for each draw into the uniform slots the shader loads them from. The
+ * values are in the order they are computed in, an alu reads earlier ones.
+ */
+#define LIMA_PRESHADER_MAX_VALUES 128
+
+enum lima_preshader_value_type {
+   LIMA_PRESHADER_CONST,
+   LIMA_PRESHADER_UNIFORM,
+   LIMA_PRESHADER_ALU,
+};
+
+struct lima_preshader_value {
+   uint8_t type;
+   uint8_t num_components;
+   /* nir_op of an alu */
+   uint16_t op;
+   uint8_t src[4];
+   uint8_t swizzle[4][4];
+   /* the constant, or the vec4 slot of the uniform in data[0] */
+   uint32_t data[4];
+};
+
+struct lima_preshader {
+   int num_values;
+   struct lima_preshader_value *values;
+   /* the results go to the vec4 slots from base on, after the ones of the
+    * shader uniforms, a value each */
+   int base;
+   int num_outputs;
+   uint8_t *outputs;
 };
 
 struct lima_fs_shader_state {
    void *shader;
    int shader_size;
+   /* vec4 slots of the PP stack used by the spilled regs */
+   int stack_size;
+   /* the depth test can't run before the shader then */
+   bool uses_discard;
+   bool writes_depth;
+   /* num_outputs is 0 without uniform only expressions */
+   struct lima_preshader preshader;
+   struct lima_shader_stats stats;
    struct lima_bo *bo;
+   uint32_t bo_offset;
+   /* signalled once the compile queue is done with the shader */
+   struct util_queue_fence ready;
+   struct lima_fs_key key;
+};
+
+/* the fragment shader CSO, variants are compiled from its NIR when a
+ * draw needs them and looked up by their key */
+struct lima_fs_program {
+   struct nir_shader *nir;
+   /* serialized nir of a program created from the state key alone */
+   void *nir_blob;
+   size_t nir_blob_size;
+   /* ref.key is set, the variants go to the disk cache */
+   bool cache;
+   mtx_t lock;
+   struct hash_table *variants;
+   struct lima_program_ref ref;
 };
 
 #define LIMA_MAX_VARYING_NUM 13
@@ -63,6 +176,7 @@ struct lima_varying_info {
    int components;
    int component_size;
    int offset;
+   uint32_t format;
 };
 
 struct lima_vs_shader_state {
@@ -73,24 +187,43 @@ struct lima_vs_shader_state {
    void *constant;
    int constant_size;
 
+   bool uses_instance_id;
+
    struct lima_varying_info varying[LIMA_MAX_VARYING_NUM];
    int varying_stride;
    int num_varying;
+   /* the varying of gl_PointSize, -1 if not written. It is read by the
+    * plbu and not passed to the pp */
+   int point_size_idx;
+   /* RSW encoding of the varying types, the bits that don't fit in
+    * varying_types go to the low bits of varyings_address */
+   uint32_t varying_types;
+   uint32_t varying_address_bits;
+
+   struct lima_shader_stats stats;
 
    struct lima_bo *bo;
+   uint32_t bo_offset;
+   /* signalled once the compile queue is done with the shader */
+   struct util_queue_fence ready;
+   struct lima_program_ref ref;
 };
 
 struct lima_rasterizer_state {
    struct pipe_rasterizer_state base;
+   uint32_t depth_test;
 };
 
 struct lima_blend_state {
    struct pipe_blend_state base;
+   uint32_t alpha_blend;
 };
 
 struct lima_vertex_element_state {
    struct pipe_vertex_element pipe[PIPE_MAX_ATTRIBS];
    unsigned num_elements;
+   /* some elements advance per instance */
+   bool instanced;
 };
 
 struct lima_context_vertex_buffer {
@@ -105,6 +238,9 @@ struct lima_context_viewport_state {
    float near, far;
 };
 
+/* PIPE_SHADER_CAP_MAX_CONST_BUFFER_SIZE */
+#define LIMA_MAX_CONST_BUFFER_SIZE 4096
+
 struct lima_context_constant_buffer {
    const void *buffer;
    uint32_t size;
@@ -123,13 +259,15 @@ enum lima_ctx_buff {
    lima_ctx_buff_pp_uniform_array,
    lima_ctx_buff_pp_uniform,
    lima_ctx_buff_pp_tex_desc,
+   lima_ctx_buff_pp_plb_stream,
    lima_ctx_buff_num,
 };
 
 struct lima_ctx_buff_state {
-   struct pipe_resource *res;
+   struct lima_bo *bo;
    unsigned offset;
    unsigned size;
+   unsigned submit;
 };
 
 struct lima_texture_stateobj {
@@ -139,6 +277,17 @@ struct lima_texture_stateobj {
    unsigned num_samplers;
 };
 
+/* the set of the texture descriptor list in ctx buff */
+struct lima_tex_desc_list {
+   unsigned num;
+   struct lima_sampler_view *textures[PIPE_MAX_SAMPLERS];
+   struct lima_sampler_state *samplers[PIPE_MAX_SAMPLERS];
+   uint32_t va[PIPE_MAX_SAMPLERS];
+};
+
+/* m450 has up to 8 PPs */
+#define LIMA_MAX_PP 8
+
 struct lima_ctx_plb_pp_stream_key {
    uint32_t plb_index;
    uint32_t tiled_w;
@@ -149,7 +298,37 @@ struct lima_ctx_plb_pp_stream {
    struct lima_ctx_plb_pp_stream_key key;
    uint32_t refcnt;
    struct lima_bo *bo;
-   uint32_t offset[4];
+   uint32_t offset[LIMA_MAX_PP];
+};
+
+/* driver specific queries, PIPE_QUERY_DRIVER_SPECIFIC + index, counted
+ * by the driver as the kernel has no access to the GP/PP counters */
+enum lima_query_driver {
+   LIMA_QUERY_DRAW_CALLS,
+   LIMA_QUERY_MERGED_DRAWS,
+   LIMA_QUERY_VERTICES,
+   LIMA_QUERY_PRIMITIVES,
+   LIMA_QUERY_GP_CMD_BYTES,
+   LIMA_QUERY_JOBS,
+   LIMA_QUERY_PP_TILES,
+   /* tiles in the static streams of each PP, not known with the DLBU */
+   LIMA_QUERY_PP0_TILES,
+   LIMA_QUERY_PP7_TILES = LIMA_QUERY_PP0_TILES + LIMA_MAX_PP - 1,
+   LIMA_QUERY_PLB_STALLS,
+   LIMA_QUERY_FLUSHES,
+   LIMA_QUERY_TRANSFER_FLUSHES,
+   LIMA_QUERY_RESOURCE_FLUSHES,
+   LIMA_QUERY_UPLOAD_BYTES,
+   LIMA_QUERY_UPLOADER_BYTES,
+   LIMA_QUERY_UPLOADER_RECYCLES,
+   LIMA_QUERY_SUBMIT_BOS,
+   LIMA_QUERY_BO_WAIT_TIME,
+   LIMA_QUERY_SHADER_WAIT_TIME,
+   LIMA_QUERY_FRAMES,
+   /* earlier frames still on the GPU at the end of each frame, over
+    * lima-frames the average latency in frames */
+   LIMA_QUERY_QUEUED_FRAMES,
+   LIMA_QUERY_DRIVER_NUM,
 };
 
 struct lima_context {
@@ -174,15 +353,21 @@ struct lima_context {
    } dirty;
 
    struct u_upload_mgr *uploader;
-   struct u_suballocator *suballocator;
+
+   /* the hardware has no primitive restart, draws are split at the
+    * restart indices, remembered for static index buffers */
+   struct util_prim_restart_cache *prim_restart;
 
    struct slab_child_pool transfer_pool;
+   struct slab_child_pool transfer_pool_unsync;
 
    struct lima_context_framebuffer framebuffer;
    struct lima_context_viewport_state viewport;
    struct pipe_scissor_state scissor;
    struct lima_context_clear clear;
    struct lima_vs_shader_state *vs;
+   struct lima_fs_program *fs_program;
+   /* the variant of fs_program for the current state */
    struct lima_fs_shader_state *fs;
    struct lima_vertex_element_state *vertex_elements;
    struct lima_context_vertex_buffer vertex_buffers;
@@ -191,33 +376,128 @@ struct lima_context {
    struct pipe_blend_color blend_color;
    struct lima_blend_state *blend;
    struct pipe_stencil_ref stencil_ref;
+   unsigned sample_mask;
    struct lima_context_constant_buffer const_buffer[PIPE_SHADER_TYPES];
+   /* fragment constants of the pp uniform buffer in ctx buff */
+   float pp_uniform[LIMA_MAX_CONST_BUFFER_SIZE / sizeof(float)];
+   uint32_t pp_uniform_size;
+   /* of the fs which got its preshader results in the buffer */
+   const struct lima_preshader *pp_uniform_preshader;
    struct lima_texture_stateobj tex_stateobj;
+   /* (view, sampler) -> descriptor without the level addresses */
+   struct hash_table *tex_desc_cache;
+   struct lima_tex_desc_list tex_desc_list;
+
+   /* occlusion predicate noting the draws, if any */
+   struct lima_query *occlusion_query;
+   bool queries_active;
+   /* the query of the render condition, draws are skipped when its
+    * result equals the condition */
+   struct lima_query *render_cond_query;
+   bool render_cond_cond;
+   enum pipe_render_cond_flag render_cond_mode;
+   /* running totals read by the driver specific queries */
+   uint64_t stats[LIMA_QUERY_DRIVER_NUM];
+   /* PP seqnos of the last frames, for LIMA_QUERY_QUEUED_FRAMES */
+   #define LIMA_MAX_QUEUED_FRAMES 8
+   uint32_t frame_seqno[LIMA_MAX_QUEUED_FRAMES];
+   unsigned num_frames;
+
+   struct pipe_debug_callback debug;
 
    #define LIMA_CTX_PLB_MIN_NUM  1
    #define LIMA_CTX_PLB_MAX_NUM  4
    #define LIMA_CTX_PLB_DEF_NUM  2
    #define LIMA_CTX_PLB_BLK_SIZE 512
+   /* PLB index of the PP streams of clear only jobs which have no PLB */
+   #define LIMA_CTX_PLB_CLEAR_INDEX   LIMA_CTX_PLB_MAX_NUM
+   #define LIMA_CTX_PLB_PP_STREAM_NUM (LIMA_CTX_PLB_MAX_NUM + 1)
+   /* blocks of the tile grouping of the framebuffer, frames with short
+    * polygon lists get finer grouping with up to plb_fine_max_blk blocks,
+    * the PLBs grow to it when first used so */
    unsigned plb_max_blk;
-   unsigned plb_size;
+   unsigned plb_fine_max_blk;
    unsigned plb_gp_size;
+   unsigned plb_num_blk[LIMA_CTX_PLB_MAX_NUM];
 
    struct lima_bo *plb[LIMA_CTX_PLB_MAX_NUM];
    struct lima_bo *plb_gp_stream;
+   /* surfaces are created and destroyed outside of the driver thread
+    * with the threaded context */
+   mtx_t plb_pp_stream_lock;
    struct hash_table *plb_pp_stream;
-   struct lima_ctx_plb_pp_stream *current_plb_pp_stream;
    uint32_t plb_index;
 
-   struct lima_ctx_buff_state buffer_state[lima_ctx_buff_num];
+   /* PLBs in the ring, grown up to LIMA_CTX_PLB_MAX_NUM when the GP job
+    * of a frame had to wait for an earlier PP job still reading its PLB */
+   unsigned num_plb;
+   unsigned plb_stalls;
+   bool plb_stalled;
+
+   /* GP tile heap for polygon lists overflowing their PLB block, one per
+    * PLB and sized at flush time from the primitive count of the frame */
+   #define LIMA_CTX_TILE_HEAP_MIN_SIZE  0x10000
+   #define LIMA_CTX_TILE_HEAP_MAX_SIZE  0x1000000
+   #define LIMA_CTX_TILE_HEAP_PRIM_SIZE 32
+   struct lima_bo *tile_heap[LIMA_CTX_PLB_MAX_NUM];
 
-   struct util_dynarray vs_cmd_array;
-   struct util_dynarray plbu_cmd_array;
+   struct lima_ctx_buff_state buffer_state[lima_ctx_buff_num];
 
-   unsigned num_draws;
+   /* CPU copy of the render state in lima_ctx_buff_pp_plb_rsw */
+   uint32_t render_state[16];
+
+   /* start vertex and vertex buffer bo addresses of the attribute table
+    * in lima_ctx_buff_gp_attribute_info */
+   unsigned attribute_start;
+   unsigned attribute_instance;
+   uint32_t attribute_va[PIPE_MAX_ATTRIBS];
+   unsigned gp_uniform_instance;
+   /* inputs of the gp uniform buffer in ctx buff, state trackers set the
+    * same constants and viewport again a lot */
+   float gp_uniform[LIMA_MAX_CONST_BUFFER_SIZE / sizeof(float)];
+   uint32_t gp_uniform_size;
+   float gp_uniform_viewport[8];
+   struct lima_vs_shader_state *gp_uniform_vs;
+
+   /* ring of mapped bos with va for lima_ctx_buff_alloc */
+   #define LIMA_CTX_BUFF_BO_SIZE (1024 * 1024)
+   struct util_dynarray buff_bos;
+   struct lima_bo *buff_bo;
+   unsigned buff_bo_offset;
+
+   /* state blocks up to LIMA_CTX_STATE_MAX_SIZE uploaded once to state_bo,
+    * the draws of later jobs and frames with the same content point to
+    * them again, see lima_ctx_buff_upload */
+   #define LIMA_CTX_STATE_MAX_SIZE 0x4000
+   struct hash_table *state_cache;
+   struct lima_bo *state_bo;
+   unsigned state_bo_offset;
+   struct util_dynarray state_scratch;
+   /* 16 bit indices of quads split in two triangles, for the user index
+    * arrays that are, see lima_user_indices_va */
+   #define LIMA_QUAD_INDEX_MAX_QUADS (0x10000 / 4)
+   struct lima_bo *quad_index_bo;
+
+   /* pending jobs keyed by framebuffer, the same jobs in the order they
+    * were created in which they're submitted, and the one of the current
+    * framebuffer once it's been drawn to, see lima_job.c */
+   struct hash_table *jobs;
+   struct list_head job_list;
+   struct lima_job *job;
 
    struct lima_submit *gp_submit;
    struct lima_submit *pp_submit;
 
+   /* fences of deferred flushes, signalled by the next flush submitting
+    * the jobs, see lima_fence_defer */
+   struct util_dynarray deferred_fences;
+
+   /* blits and texture copies on the PP, see lima_blit.c */
+   struct blitter_context *blitter;
+
+   /* optional worker doing the submit ioctls, see LIMA_ASYNC_SUBMIT */
+   struct util_queue submit_queue;
+
    int id;
 };
 
@@ -227,8 +507,33 @@ lima_context(struct pipe_context *pctx)
    return (struct lima_context *)pctx;
 }
 
+/* the preshader whose results the pp uniform buffer of the fs needs */
+static inline const struct lima_preshader *
+lima_fs_preshader(const struct lima_fs_shader_state *fs)
+{
+   return fs->preshader.num_outputs ? &fs->preshader : NULL;
+}
+
+/* the uploaded pp uniform buffer has these constants and the results of
+ * the preshader of the bound fs, or none for an fs without one */
+static inline bool
+lima_pp_uniform_is_current(const struct lima_context *ctx,
+                           const float *const_buff, size_t size)
+{
+   return ctx->buffer_state[lima_ctx_buff_pp_uniform].bo &&
+          ctx->buffer_state[lima_ctx_buff_pp_uniform_array].bo &&
+          ctx->pp_uniform_preshader == lima_fs_preshader(ctx->fs) &&
+          ctx->pp_uniform_size == size &&
+          !memcmp(ctx->pp_uniform, const_buff, size);
+}
+
 struct lima_sampler_state {
    struct pipe_sampler_state base;
+
+   /* filter and wrap bits of texture descriptor words 1 and 2 */
+   uint32_t desc1;
+   uint32_t desc2;
+   bool mipmap;
 };
 
 static inline struct lima_sampler_state *
@@ -237,8 +542,14 @@ lima_sampler_state(struct pipe_sampler_state *psstate)
    return (struct lima_sampler_state *)psstate;
 }
 
+#define LIMA_TEX_DESC_VIEW_WORDS 7
+
 struct lima_sampler_view {
    struct pipe_sampler_view base;
+
+   /* descriptor words before the level addresses */
+   uint32_t desc[LIMA_TEX_DESC_VIEW_WORDS];
+   unsigned desc_size;
 };
 
 static inline struct lima_sampler_view *
@@ -253,19 +564,40 @@ lima_sampler_view(struct pipe_sampler_view *psview)
 uint32_t lima_ctx_buff_va(struct lima_context *ctx, enum lima_ctx_buff buff);
 void *lima_ctx_buff_map(struct lima_context *ctx, enum lima_ctx_buff buff);
 void *lima_ctx_buff_alloc(struct lima_context *ctx, enum lima_ctx_buff buff,
-                          unsigned size, unsigned submit, bool uploader);
+                          unsigned size, unsigned submit);
+void *lima_ctx_buff_upload(struct lima_context *ctx, enum lima_ctx_buff buff,
+                           const void *data, unsigned size, unsigned submit);
+void lima_ctx_buff_submit(struct lima_context *ctx);
+uint32_t lima_ctx_upload_indices(struct lima_context *ctx, const void *data,
+                                 unsigned size);
 
 void lima_state_init(struct lima_context *ctx);
 void lima_state_fini(struct lima_context *ctx);
 void lima_draw_init(struct lima_context *ctx);
 void lima_program_init(struct lima_context *ctx);
 void lima_query_init(struct lima_context *ctx);
+void lima_query_add_draw(struct lima_context *ctx);
+bool lima_query_render_condition_passes(struct lima_context *ctx);
+bool lima_blit_init(struct lima_context *ctx);
+void lima_blit_fini(struct lima_context *ctx);
+void lima_blitter_save(struct lima_context *ctx);
+bool lima_blit_dst_supported(struct pipe_resource *prsc, unsigned level,
+                             const struct pipe_box *box);
 
 struct pipe_context *
 lima_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags);
 
 void lima_flush(struct lima_context *ctx);
+void lima_flush_job_writing_resource(struct lima_context *ctx,
+                                     struct pipe_resource *prsc, bool current);
+void lima_flush_job_using_bo(struct lima_context *ctx, struct lima_bo *bo,
+                             struct lima_job *except);
 
 bool lima_need_flush(struct lima_context *ctx, struct lima_bo *bo, bool write);
+bool lima_ctx_bo_idle(struct lima_context *ctx, struct lima_bo *bo, bool write);
+bool lima_ctx_plb_next(struct lima_context *ctx, uint32_t *index);
+bool lima_ctx_plb_grow(struct lima_context *ctx, uint32_t index,
+                       unsigned num_blk);
+void lima_ctx_fb_blocking(struct lima_context_framebuffer *fb, unsigned limit);
 
 #endif
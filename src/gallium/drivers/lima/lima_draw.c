@@ -24,13 +24,22 @@
  */
 
 #include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_atomic.h"
 #include "util/u_format.h"
 #include "util/u_debug.h"
 #include "util/u_half.h"
 #include "util/u_helpers.h"
 #include "util/u_inlines.h"
 #include "util/u_pack_color.h"
+#include "util/u_prim.h"
+#include "util/u_prim_restart.h"
+#include "util/u_surface.h"
+#include "util/u_blitter.h"
 #include "util/hash_table.h"
+#include "util/half_float.h"
+#include "util/u_threaded_context.h"
+#include "util/u_upload_mgr.h"
 
 #include "lima_context.h"
 #include "lima_screen.h"
@@ -41,9 +50,16 @@
 #include "lima_texture.h"
 #include "lima_util.h"
 #include "lima_fence.h"
+#include "lima_job.h"
+#include "lima_trace.h"
+#include "ir/lima_ir.h"
 
 #include <lima_drm.h>
 
+/* uniforms the driver adds after the vs constant buffer: viewport scale,
+ * viewport translate and the instance id, one vec4 each */
+#define LIMA_GP_UNIFORM_DRIVER_SIZE 48
+
 struct lima_gp_frame_reg {
    uint32_t vs_cmd_start;
    uint32_t vs_cmd_end;
@@ -79,6 +95,13 @@ struct lima_pp_frame_reg {
    uint32_t foureight;
 };
 
+#define LIMA_PIXEL_FORMAT_BGR_565   0x00
+#define LIMA_PIXEL_FORMAT_BGRA_5551 0x01
+#define LIMA_PIXEL_FORMAT_BGRA_4444 0x02
+#define LIMA_PIXEL_FORMAT_BGRA_8888 0x03
+#define LIMA_PIXEL_FORMAT_Z16       0x0e
+#define LIMA_PIXEL_FORMAT_Z24S8     0x0f
+
 struct lima_pp_wb_reg {
    uint32_t type;
    uint32_t address;
@@ -94,16 +117,17 @@ struct lima_pp_wb_reg {
    uint32_t unused2;
 };
 
+/* the tile buffers of the job start with the clear values, the caller
+ * adds the cleared tiles to the damage */
 static void
-lima_clear(struct pipe_context *pctx, unsigned buffers,
-           const union pipe_color_union *color, double depth, unsigned stencil)
+lima_job_clear(struct lima_context *ctx, struct lima_job *job,
+               unsigned buffers, const union pipe_color_union *color,
+               double depth, unsigned stencil)
 {
-   debug_checkpoint();
-
-   struct lima_context *ctx = lima_context(pctx);
-   struct lima_context_clear *clear = &ctx->clear;
+   struct lima_context_clear *clear = &job->clear;
 
-   clear->buffers = buffers;
+   clear->buffers |= buffers;
+   job->resolve |= buffers;
 
    if (buffers & PIPE_CLEAR_COLOR0)
       clear->color =
@@ -118,111 +142,355 @@ lima_clear(struct pipe_context *pctx, unsigned buffers,
    if (buffers & PIPE_CLEAR_STENCIL)
       clear->stencil = stencil;
 
+   ctx->clear = *clear;
    ctx->dirty |= LIMA_CONTEXT_DIRTY_CLEAR;
+
+   /* the PP job writes the cleared color buffer even without any draw */
+   if (job->fb.cbuf) {
+      struct lima_resource *res = lima_resource(job->fb.cbuf->texture);
+      lima_job_add_bo(job, LIMA_PIPE_PP, res->bo, LIMA_SUBMIT_BO_WRITE);
+   }
 }
 
 static void
-hilbert_rotate(int n, int *x, int *y, int rx, int ry)
+lima_clear(struct pipe_context *pctx, unsigned buffers,
+           const union pipe_color_union *color, double depth, unsigned stencil)
 {
-   if (ry == 0) {
-      if (rx == 1) {
-         *x = n-1 - *x;
-         *y = n-1 - *y;
-      }
+   debug_checkpoint();
+
+   struct lima_context *ctx = lima_context(pctx);
+
+   if (!lima_query_render_condition_passes(ctx))
+      return;
+
+   struct lima_job *job = lima_job_get(ctx);
+   if (!job)
+      return;
+
+   lima_job_clear(ctx, job, buffers, color, depth, stencil);
+
+   /* the clear isn't scissored, every tile gets it */
+   lima_job_add_damage(job, 0, 0, job->fb.width, job->fb.height, 0);
+}
+
+/* The clear values only apply to whole tiles, before the draws of the
+ * job. A rect which covers its tiles is cleared on the PP alone if the job
+ * has no draw yet and no other clear rect, the tiles outside of the job
+ * damage being left alone. */
+static bool
+lima_clear_rect_is_tiled(struct lima_job *job,
+                         const struct pipe_scissor_state *rect)
+{
+   struct lima_context_framebuffer *fb = &job->fb;
+   struct pipe_scissor_state *damage = &job->damage;
+
+   if (job->num_draws)
+      return false;
+
+   if (rect->minx % 16 || rect->miny % 16 ||
+       (rect->maxx % 16 && rect->maxx != fb->width) ||
+       (rect->maxy % 16 && rect->maxy != fb->height))
+      return false;
+
+   if (damage->minx >= damage->maxx || damage->miny >= damage->maxy)
+      return true;
+
+   return damage->minx == rect->minx >> 4 &&
+      damage->miny == rect->miny >> 4 &&
+      damage->maxx == align(rect->maxx, 16) >> 4 &&
+      damage->maxy == align(rect->maxy, 16) >> 4;
+}
+
+/* clear of a rect of the surfaces the current job renders to */
+static void
+lima_clear_rect(struct lima_context *ctx, unsigned buffers,
+                const union pipe_color_union *color, double depth,
+                unsigned stencil, unsigned x, unsigned y,
+                unsigned width, unsigned height)
+{
+   struct lima_job *job = lima_job_get(ctx);
+   if (!job)
+      return;
+
+   struct pipe_scissor_state rect = {
+      .minx = x,
+      .miny = y,
+      .maxx = MIN2(x + width, job->fb.width),
+      .maxy = MIN2(y + height, job->fb.height),
+   };
+   if (rect.minx >= rect.maxx || rect.miny >= rect.maxy)
+      return;
 
-      /* Swap x and y */
-      int t  = *x;
-      *x = *y;
-      *y = t;
+   if (lima_clear_rect_is_tiled(job, &rect)) {
+      lima_job_clear(ctx, job, buffers, color, depth, stencil);
+      lima_job_add_damage(job, rect.minx, rect.miny, rect.maxx, rect.maxy, 0);
+      return;
    }
+
+   /* a quad drawn in the job, after its draws. The callers checked the
+    * render condition if it applies, lima_blitter_save() saves it so the
+    * blitter turns it off for the quad and restores it afterwards. */
+   lima_blitter_save(ctx);
+   util_blitter_clear_rect(ctx->blitter, job->fb.width, job->fb.height,
+                           buffers, color, depth, stencil, &rect);
 }
 
 static void
-hilbert_coords(int n, int d, int *x, int *y)
+lima_clear_render_target(struct pipe_context *pctx, struct pipe_surface *dst,
+                         const union pipe_color_union *color,
+                         unsigned dstx, unsigned dsty,
+                         unsigned width, unsigned height,
+                         bool render_condition_enabled)
 {
-   int rx, ry, i, t=d;
+   struct lima_context *ctx = lima_context(pctx);
+
+   if (render_condition_enabled && !lima_query_render_condition_passes(ctx))
+      return;
+
+   if (dst == ctx->framebuffer.cbuf)
+      lima_clear_rect(ctx, PIPE_CLEAR_COLOR0, color, 0, 0,
+                      dstx, dsty, width, height);
+   else
+      util_clear_render_target(pctx, dst, color, dstx, dsty, width, height);
+}
+
+static void
+lima_clear_depth_stencil(struct pipe_context *pctx, struct pipe_surface *dst,
+                         unsigned clear_flags, double depth, unsigned stencil,
+                         unsigned dstx, unsigned dsty,
+                         unsigned width, unsigned height,
+                         bool render_condition_enabled)
+{
+   struct lima_context *ctx = lima_context(pctx);
+   static const union pipe_color_union color;
+
+   if (render_condition_enabled && !lima_query_render_condition_passes(ctx))
+      return;
+
+   if (dst == ctx->framebuffer.zsbuf)
+      lima_clear_rect(ctx, clear_flags & PIPE_CLEAR_DEPTHSTENCIL, &color,
+                      depth, stencil, dstx, dsty, width, height);
+   else
+      util_clear_depth_stencil(pctx, dst, clear_flags, depth, stencil,
+                               dstx, dsty, width, height);
+}
+
+/* Point d of the hilbert curve filling a 2^dim square, walking two bits
+ * of d per level with a 4 state table packed in the constants: x and y
+ * bits in the first two, next state in the last one. */
+static void
+hilbert_coords(int dim, int d, int *x, int *y)
+{
+   unsigned state = 0;
 
    *x = *y = 0;
 
-   for (i = 0; (1 << i) < n; i++) {
+   for (int i = 2 * dim - 2; i >= 0; i -= 2) {
+      unsigned row = (state << 2) | ((d >> i) & 3);
+
+      *x = (*x << 1) | ((0x936C >> row) & 1);
+      *y = (*y << 1) | ((0x39C6 >> row) & 1);
+      state = (0x3E6B94C1 >> (row * 2)) & 3;
+   }
+}
+
+struct lima_tile_order {
+   unsigned num_tiles;
+   /* x | y << 8 of each tile */
+   uint16_t tiles[];
+};
+
+/* Tiles of a framebuffer in hilbert order, shared by every context of
+ * the screen for each framebuffer size. PP streams follow this order so
+ * that consecutive tiles, split among the PPs, are close to each other. */
+static struct lima_tile_order *
+lima_get_tile_order(struct lima_screen *screen, int tiled_w, int tiled_h)
+{
+   void *key = (void *)(uintptr_t)((tiled_w << 16) | tiled_h);
+   struct lima_tile_order *order = NULL;
+
+   mtx_lock(&screen->tile_order_lock);
 
-      rx = 1 & (t / 2);
-      ry = 1 & (t ^ rx);
+   struct hash_entry *entry =
+      _mesa_hash_table_search(screen->tile_order, key);
+   if (entry) {
+      order = entry->data;
+      goto out;
+   }
 
-      hilbert_rotate(1 << i, x, y, rx, ry);
+   order = ralloc_size(screen->tile_order, sizeof(*order) +
+                       tiled_w * tiled_h * sizeof(order->tiles[0]));
+   if (!order)
+      goto out;
 
-      *x += rx << i;
-      *y += ry << i;
+   int dim = util_logbase2_ceil(MAX2(tiled_w, tiled_h));
+   int count = 1 << (dim + dim);
 
-      t /= 4;
+   order->num_tiles = 0;
+   for (int i = 0; i < count; i++) {
+      int x, y;
+      hilbert_coords(dim, i, &x, &y);
+      if (x < tiled_w && y < tiled_h)
+         order->tiles[order->num_tiles++] = x | (y << 8);
    }
+
+   _mesa_hash_table_insert(screen->tile_order, key, order);
+
+out:
+   mtx_unlock(&screen->tile_order_lock);
+   return order;
+}
+
+bool
+lima_draw_screen_init(struct lima_screen *screen)
+{
+   screen->tile_order = _mesa_hash_table_create(
+      screen, _mesa_hash_pointer, _mesa_key_pointer_equal);
+   if (!screen->tile_order)
+      return false;
+
+   mtx_init(&screen->tile_order_lock, mtx_plain);
+   return true;
 }
 
+void
+lima_draw_screen_fini(struct lima_screen *screen)
+{
+   mtx_destroy(&screen->tile_order_lock);
+}
+
+
+/* carefully calculate each stream start address:
+ * 1. size: each stream size may be different as the number of tiles
+ *    of each pp may be different
+ * 2. alignment: each stream address should be 0x20 aligned
+ * returns the size of all the streams
+ */
+static unsigned
+lima_plb_pp_stream_offsets(int num_pp, const int *num_tiles, uint32_t *offset)
+{
+   int size = 0;
+
+   for (int i = 0; i < num_pp; i++) {
+      offset[i] = size;
+      size = align(size + num_tiles[i] * 16 + 8, 0x20);
+   }
+
+   return size;
+}
+
+/* interleave the tiles among the PPs so that each PP's render target
+ * is close enough to the others, which should result close workload */
 static void
-lima_update_plb(struct lima_context *ctx, struct lima_ctx_plb_pp_stream *s)
+lima_plb_pp_stream_interleave(int num_pp, int count, int *num_tiles)
+{
+   for (int i = 0; i < num_pp; i++)
+      num_tiles[i] = count / num_pp + (i < count % num_pp);
+}
+
+/* Split the hilbert ordered tiles in contiguous ranges of the same
+ * estimated cost for each PP instead. A tile costs its write back plus
+ * the weight of each draw that may cover it. */
+static void
+lima_plb_pp_stream_balance(struct lima_context *ctx, struct lima_job *job,
+                           struct lima_tile_order *order, int *num_tiles)
 {
-   struct lima_context_framebuffer *fb = &ctx->framebuffer;
    struct lima_screen *screen = lima_screen(ctx->base.screen);
+   struct lima_context_framebuffer *fb = &job->fb;
+   struct pipe_scissor_state *rect = &job->damage;
+   int num_pp = screen->num_pp;
+   int stride = fb->tiled_w + 1;
+   uint32_t *cost = job->tile_cost;
+
+   /* turn the difference array of the draw rects into tile costs */
+   for (int y = 0; y < fb->tiled_h; y++) {
+      for (int x = 0; x < fb->tiled_w; x++) {
+         uint32_t *c = cost + y * stride + x;
+         if (x)
+            *c += c[-1];
+         if (y)
+            *c += c[-stride];
+         if (x && y)
+            *c -= c[-stride - 1];
+      }
+   }
 
-   if (s->bo)
-      return;
+   uint64_t total = 0;
+   for (int y = rect->miny; y < rect->maxy; y++) {
+      for (int x = rect->minx; x < rect->maxx; x++)
+         total += 1 + cost[y * stride + x];
+   }
 
-   /* carefully calculate each stream start address:
-    * 1. overflow: each stream size may be different due to
-    *    fb->tiled_w * fb->tiled_h can't be divided by num_pp,
-    *    extra size should be added to the preceeding stream
-    * 2. alignment: each stream address should be 0x20 aligned
-    */
-   int i, num_pp = screen->num_pp;
-   int delta = fb->tiled_w * fb->tiled_h / num_pp * 16 + 8;
-   int remain = fb->tiled_w * fb->tiled_h % num_pp;
-   int offset = 0;
+   uint64_t sum = 0;
+   int pp = 0;
+   memset(num_tiles, 0, num_pp * sizeof(*num_tiles));
 
-   for (i = 0; i < num_pp; i++) {
-      s->offset[i] = offset;
+   for (int i = 0; i < order->num_tiles; i++) {
+      int x = order->tiles[i] & 0xff;
+      int y = order->tiles[i] >> 8;
 
-      offset += delta;
-      if (remain) {
-         offset += 16;
-         remain--;
-      }
-      offset = align(offset, 0x20);
+      if (x < rect->minx || x >= rect->maxx ||
+          y < rect->miny || y >= rect->maxy)
+         continue;
+
+      if (pp < num_pp - 1 && sum * num_pp >= total * (pp + 1))
+         pp++;
+
+      sum += 1 + cost[y * stride + x];
+      num_tiles[pp]++;
    }
+}
 
-   unsigned size = align(offset, LIMA_PAGE_SIZE);
-   s->bo = lima_bo_create(screen, size, 0, true, true);
+/* fill the PP streams visiting the tiles of rect, in tile units, the
+ * tiles go to each PP in turn or in contiguous ranges of num_tiles */
+static void
+lima_pack_plb_pp_stream(struct lima_context *ctx, struct lima_job *job,
+                        uint32_t plb_index, struct pipe_scissor_state *rect,
+                        const int *num_tiles, bool contiguous,
+                        void *map, uint32_t va, uint32_t *offset)
+{
+   struct lima_context_framebuffer *fb = &job->fb;
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   bool clear_only = plb_index == LIMA_CTX_PLB_CLEAR_INDEX;
+   int i, num_pp = screen->num_pp;
 
-   /* use hilbert_coords to generates 1D to 2D relationship.
-    * 1D for pp stream index and 2D for plb block x/y on framebuffer.
-    * if multi pp, interleave the 1D index to make each pp's render target
-    * close enough which should result close workload
-    */
-   int max = MAX2(fb->tiled_w, fb->tiled_h);
-   int dim = util_logbase2_ceil(max);
-   int count = 1 << (dim + dim);
-   int index = 0;
-   uint32_t *stream[4];
-   int si[4] = {0};
+   struct lima_tile_order *order =
+      lima_get_tile_order(screen, fb->tiled_w, fb->tiled_h);
+   uint32_t *stream[LIMA_MAX_PP];
+   int si[LIMA_MAX_PP] = {0};
+   int index = 0, pp = 0, pp_end = num_tiles[0];
 
    for (i = 0; i < num_pp; i++)
-      stream[i] = s->bo->map + s->offset[i];
+      stream[i] = map + offset[i];
 
-   for (i = 0; i < count; i++) {
-      int x, y;
-      hilbert_coords(max, i, &x, &y);
-      if (x < fb->tiled_w && y < fb->tiled_h) {
-         int pp = index % num_pp;
-         int offset = ((y >> fb->shift_h) * fb->block_w +
-                       (x >> fb->shift_w)) * LIMA_CTX_PLB_BLK_SIZE;
-         int plb_va = ctx->plb[s->key.plb_index]->va + offset;
-
-         stream[pp][si[pp]++] = 0;
-         stream[pp][si[pp]++] = 0xB8000000 | x | (y << 8);
-         stream[pp][si[pp]++] = 0xE0000002 | ((plb_va >> 3) & ~0xE0000003);
-         stream[pp][si[pp]++] = 0xB0000000;
+   for (i = 0; order && i < order->num_tiles; i++) {
+      int x = order->tiles[i] & 0xff;
+      int y = order->tiles[i] >> 8;
+
+      if (x < rect->minx || x >= rect->maxx ||
+          y < rect->miny || y >= rect->maxy)
+         continue;
+
+      if (!contiguous)
+         pp = index % num_pp;
+      else {
+         while (index >= pp_end)
+            pp_end += num_tiles[++pp];
+      }
 
-         index++;
+      stream[pp][si[pp]++] = 0;
+      stream[pp][si[pp]++] = 0xB8000000 | x | (y << 8);
+
+      /* tiles of clear only jobs have no polygon list to call */
+      if (!clear_only) {
+         int block = (y >> fb->shift_h) * fb->block_w + (x >> fb->shift_w);
+         int plb_va = ctx->plb[plb_index]->va + block * LIMA_CTX_PLB_BLK_SIZE;
+         stream[pp][si[pp]++] = 0xE0000002 | ((plb_va >> 3) & ~0xE0000003);
       }
+
+      stream[pp][si[pp]++] = 0xB0000000;
+
+      index++;
    }
 
    for (i = 0; i < num_pp; i++) {
@@ -231,13 +499,79 @@ lima_update_plb(struct lima_context *ctx, struct lima_ctx_plb_pp_stream *s)
 
       lima_dump_command_stream_print(
          stream[i], si[i] * 4, false, "pp plb stream %d at va %x\n",
-         i, s->bo->va + s->offset[i]);
+         i, va + offset[i]);
    }
 }
 
+/* PP streams covering the whole framebuffer are kept for each surface
+ * size and PLB */
+static void
+lima_update_plb(struct lima_context *ctx, struct lima_job *job,
+                struct lima_ctx_plb_pp_stream *s)
+{
+   struct lima_context_framebuffer *fb = &job->fb;
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   int num_tiles[LIMA_MAX_PP];
+
+   if (s->bo)
+      return;
+
+   lima_plb_pp_stream_interleave(screen->num_pp, fb->tiled_w * fb->tiled_h,
+                                 num_tiles);
+   unsigned size = lima_plb_pp_stream_offsets(screen->num_pp, num_tiles,
+                                              s->offset);
+   s->bo = lima_bo_create(screen, align(size, LIMA_PAGE_SIZE), 0, true, true);
+
+   struct pipe_scissor_state rect = {
+      .maxx = fb->tiled_w,
+      .maxy = fb->tiled_h,
+   };
+   lima_pack_plb_pp_stream(ctx, job, s->key.plb_index, &rect, num_tiles,
+                           false, s->bo->map, s->bo->va, s->offset);
+}
+
+/* the PP streams of a job only touching some tiles or balancing the
+ * tiles among the PPs are built at flush time, tiles outside of them
+ * keep their content */
+static void
+lima_update_job_pp_stream(struct lima_context *ctx, struct lima_job *job,
+                          uint32_t *stream_va, int *num_tiles)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   struct pipe_scissor_state *damage = &job->damage;
+   struct lima_context_framebuffer *fb = &job->fb;
+   struct lima_tile_order *order =
+      lima_get_tile_order(screen, fb->tiled_w, fb->tiled_h);
+   uint32_t offset[LIMA_MAX_PP];
+
+   bool balance = job->tile_cost && order;
+   if (balance)
+      lima_plb_pp_stream_balance(ctx, job, order, num_tiles);
+   else
+      lima_plb_pp_stream_interleave(
+         screen->num_pp, (damage->maxx - damage->minx) *
+         (damage->maxy - damage->miny), num_tiles);
+
+   unsigned size = lima_plb_pp_stream_offsets(screen->num_pp, num_tiles, offset);
+   void *map = lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_plb_stream, size, 0);
+   uint32_t va = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_plb_stream);
+
+   lima_pack_plb_pp_stream(ctx, job, job->plb_pp_stream->key.plb_index,
+                           damage, num_tiles, balance, map, va, offset);
+   lima_submit_add_bo(ctx->pp_submit,
+                      ctx->buffer_state[lima_ctx_buff_pp_plb_stream].bo,
+                      LIMA_SUBMIT_BO_READ);
+
+   for (int i = 0; i < screen->num_pp; i++)
+      stream_va[i] = va + offset[i];
+}
+
+
 enum lima_attrib_type {
    LIMA_ATTRIB_FLOAT = 0x000,
-   /* todo: find out what lives here. */
+   LIMA_ATTRIB_I32   = 0x001,
+   LIMA_ATTRIB_U32   = 0x002,
+   LIMA_ATTRIB_FP16  = 0x003,
    LIMA_ATTRIB_I16   = 0x004,
    LIMA_ATTRIB_U16   = 0x005,
    LIMA_ATTRIB_I8    = 0x006,
@@ -246,7 +580,9 @@ enum lima_attrib_type {
    LIMA_ATTRIB_U8N   = 0x009,
    LIMA_ATTRIB_I16N  = 0x00A,
    LIMA_ATTRIB_U16N  = 0x00B,
-   /* todo: where is the 32 int */
+   /* todo: find out what lives here. */
+   LIMA_ATTRIB_I32N  = 0x00D,
+   LIMA_ATTRIB_U32N  = 0x00E,
    /* todo: find out what lives here. */
    LIMA_ATTRIB_FIXED = 0x101
 };
@@ -258,8 +594,11 @@ lima_pipe_format_to_attrib_type(enum pipe_format format)
    int i = util_format_get_first_non_void_channel(format);
    const struct util_format_channel_description *c = desc->channel + i;
 
+   /* only formats lima_format_vertex_supported accepts get here */
    switch (c->type) {
    case UTIL_FORMAT_TYPE_FLOAT:
+      if (c->size == 16)
+         return LIMA_ATTRIB_FP16;
       return LIMA_ATTRIB_FLOAT;
    case UTIL_FORMAT_TYPE_FIXED:
       return LIMA_ATTRIB_FIXED;
@@ -276,6 +615,12 @@ lima_pipe_format_to_attrib_type(enum pipe_format format)
          else
             return LIMA_ATTRIB_I16;
       }
+      else if (c->size == 32) {
+         if (c->normalized)
+            return LIMA_ATTRIB_I32N;
+         else
+            return LIMA_ATTRIB_I32;
+      }
       break;
    case UTIL_FORMAT_TYPE_UNSIGNED:
       if (c->size == 8) {
@@ -290,17 +635,32 @@ lima_pipe_format_to_attrib_type(enum pipe_format format)
          else
             return LIMA_ATTRIB_U16;
       }
+      else if (c->size == 32) {
+         if (c->normalized)
+            return LIMA_ATTRIB_U32N;
+         else
+            return LIMA_ATTRIB_U32;
+      }
       break;
    }
 
    return LIMA_ATTRIB_FLOAT;
 }
 
+/* number of vertices the GP shades for a draw */
+static inline unsigned
+lima_draw_num_vertices(const struct pipe_draw_info *info)
+{
+   return info->index_size ? info->max_index - info->min_index + 1 : info->count;
+}
+
 static void
-lima_pack_vs_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
+lima_pack_vs_cmd(struct lima_context *ctx, struct lima_job *job,
+                 const struct pipe_draw_info *info)
 {
    int i = 0, max_n = 24;
-   uint32_t *vs_cmd = util_dynarray_enlarge(&ctx->vs_cmd_array, max_n * 4);
+   uint32_t *vs_cmd = util_dynarray_enlarge(&job->vs_cmd_array, max_n * 4);
+   unsigned base = job->vs_cmd_array.size / 4;
 
    if (!info->index_size) {
       vs_cmd[i++] = 0x00028000; /* ARRAYS_SEMAPHORE_BEGIN_1 */
@@ -309,11 +669,12 @@ lima_pack_vs_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
       vs_cmd[i++] = 0x50000000; /* ARRAYS_SEMAPHORE */
    }
 
-   int uniform_size = ctx->const_buffer[PIPE_SHADER_VERTEX].size + ctx->vs->constant_size + 32;
+   int uniform_size = ctx->const_buffer[PIPE_SHADER_VERTEX].size + ctx->vs->constant_size +
+      LIMA_GP_UNIFORM_DRIVER_SIZE;
    vs_cmd[i++] = lima_ctx_buff_va(ctx, lima_ctx_buff_gp_uniform);
    vs_cmd[i++] = 0x30000000 | (align(uniform_size, 16) << 12); /* UNIFORMS_ADDRESS */
 
-   vs_cmd[i++] = ctx->vs->bo->va;
+   vs_cmd[i++] = ctx->vs->bo->va + ctx->vs->bo_offset;
    vs_cmd[i++] = 0x40000000 | ((ctx->vs->shader_size >> 4) << 16); /* SHADER_ADDRESS */
 
    vs_cmd[i++] = (ctx->vs->prefetch << 20) | ((align(ctx->vs->shader_size, 16) / 16 - 1) << 10);
@@ -331,10 +692,12 @@ lima_pack_vs_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
    vs_cmd[i++] = lima_ctx_buff_va(ctx, lima_ctx_buff_gp_attribute_info);
    vs_cmd[i++] = 0x20000000 | (num_attributes << 17); /* ATTRIBUTES_ADDRESS */
 
+   job->last_draw.vs_cmd_varyings = base + i;
    vs_cmd[i++] = lima_ctx_buff_va(ctx, lima_ctx_buff_gp_varying_info);
    vs_cmd[i++] = 0x20000008 | (num_varryings << 17); /* VARYINGS_ADDRESS */
 
-   unsigned num = info->index_size ? (info->max_index - info->min_index + 1) : info->count;
+   job->last_draw.vs_cmd_draw = base + i;
+   unsigned num = lima_draw_num_vertices(info);
    vs_cmd[i++] = (num << 24) | (info->index_size ? 1 : 0);
    vs_cmd[i++] = 0x00000000 | (num >> 8); /* DRAW */
 
@@ -345,7 +708,7 @@ lima_pack_vs_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
    vs_cmd[i++] = 0x50000000; /* ARRAYS_SEMAPHORE */
 
    assert(i <= max_n);
-   ctx->vs_cmd_array.size += i * 4;
+   job->vs_cmd_array.size += i * 4;
 
    lima_dump_command_stream_print(vs_cmd, i * 4, false, "add vs cmd\n");
 }
@@ -362,44 +725,143 @@ lima_is_scissor_zero(struct lima_context *ctx)
       && scissor->miny == scissor->maxy;
 }
 
-static void
-lima_pack_plbu_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
+/* PLB setup of the frame, returns the number of words packed */
+static int
+lima_pack_plbu_head(struct lima_context *ctx, struct lima_job *job,
+                    uint32_t *plbu_cmd)
 {
-   int i = 0, max_n = 40;
-   uint32_t *plbu_cmd = util_dynarray_enlarge(&ctx->plbu_cmd_array, max_n * 4);
+   struct lima_context_framebuffer *fb = &job->fb;
+   int i = 0;
 
-   /* first draw need create a PLBU command header */
-   if (!ctx->plbu_cmd_array.size) {
-      struct lima_context_framebuffer *fb = &ctx->framebuffer;
+   plbu_cmd[i++] = 0x00000200;
+   plbu_cmd[i++] = 0x1000010B; /* PRIMITIVE_SETUP */
+   job->plbu_state.primitive_setup = 0x00000200;
 
-      plbu_cmd[i++] = 0x00000200;
-      plbu_cmd[i++] = 0x1000010B; /* PRIMITIVE_SETUP */
+   plbu_cmd[i++] = (fb->shift_max << 28) | (fb->shift_h << 16) | fb->shift_w;
+   plbu_cmd[i++] = 0x1000010C; /* BLOCK_STEP */
+
+   plbu_cmd[i++] = ((fb->tiled_w - 1) << 24) | ((fb->tiled_h - 1) << 8);
+   plbu_cmd[i++] = 0x10000109; /* TILED_DIMENSIONS */
+
+   plbu_cmd[i++] = fb->block_w;
+   plbu_cmd[i++] = 0x30000000; /* PLBU_BLOCK_STRIDE */
+
+   plbu_cmd[i++] = ctx->plb_gp_stream->va + job->plb_index * ctx->plb_gp_size;
+   plbu_cmd[i++] = 0x28000000 | (fb->block_w * fb->block_h - 1); /* PLBU_ARRAY_ADDRESS */
+
+   plbu_cmd[i++] = fui(ctx->viewport.x);
+   plbu_cmd[i++] = 0x10000107; /* VIEWPORT_X */
 
-      plbu_cmd[i++] = (fb->shift_max << 28) | (fb->shift_h << 16) | fb->shift_w;
-      plbu_cmd[i++] = 0x1000010C; /* BLOCK_STEP */
+   plbu_cmd[i++] = fui(ctx->viewport.width);
+   plbu_cmd[i++] = 0x10000108; /* VIEWPORT_W */
 
-      plbu_cmd[i++] = ((fb->tiled_w - 1) << 24) | ((fb->tiled_h - 1) << 8);
-      plbu_cmd[i++] = 0x10000109; /* TILED_DIMENSIONS */
+   plbu_cmd[i++] = fui(ctx->viewport.y);
+   plbu_cmd[i++] = 0x10000105; /* VIEWPORT_Y */
 
-      plbu_cmd[i++] = fb->block_w;
-      plbu_cmd[i++] = 0x30000000; /* PLBU_BLOCK_STRIDE */
+   plbu_cmd[i++] = fui(ctx->viewport.height);
+   plbu_cmd[i++] = 0x10000106; /* VIEWPORT_H */
 
-      plbu_cmd[i++] = ctx->plb_gp_stream->va + ctx->plb_index * ctx->plb_gp_size;
-      plbu_cmd[i++] = 0x28000000 | (fb->block_w * fb->block_h - 1); /* PLBU_ARRAY_ADDRESS */
+   return i;
+}
+
+/* the pixels a draw can reach, its viewport cut by the scissor and the
+ * framebuffer, returns false if there are none */
+static bool
+lima_draw_bounds(struct lima_context *ctx, struct lima_job *job,
+                 struct pipe_scissor_state *bounds)
+{
+   int minx = floorf(ctx->viewport.x);
+   int miny = floorf(ctx->viewport.y);
+   int maxx = ceilf(ctx->viewport.x + ctx->viewport.width);
+   int maxy = ceilf(ctx->viewport.y + ctx->viewport.height);
+
+   if (ctx->rasterizer->base.scissor) {
+      struct pipe_scissor_state *scissor = &ctx->scissor;
+      minx = MAX2(minx, scissor->minx);
+      miny = MAX2(miny, scissor->miny);
+      maxx = MIN2(maxx, scissor->maxx);
+      maxy = MIN2(maxy, scissor->maxy);
+   }
 
-      plbu_cmd[i++] = fui(ctx->viewport.x);
-      plbu_cmd[i++] = 0x10000107; /* VIEWPORT_X */
+   bounds->minx = MAX2(minx, 0);
+   bounds->miny = MAX2(miny, 0);
+   bounds->maxx = MAX2(MIN2(maxx, job->fb.width), 0);
+   bounds->maxy = MAX2(MIN2(maxy, job->fb.height), 0);
+   return bounds->minx < bounds->maxx && bounds->miny < bounds->maxy;
+}
+
+static const uint16_t lima_quad_indices[6] = { 0, 1, 2, 0, 2, 3 };
 
-      plbu_cmd[i++] = fui(ctx->viewport.width);
-      plbu_cmd[i++] = 0x10000108; /* VIEWPORT_W */
+/* the quad of the first index, -1 if the indices aren't whole quads */
+static int
+lima_user_indices_first_quad(const struct pipe_draw_info *info)
+{
+   const uint16_t *indices = (const uint16_t *)info->index.user + info->start;
 
-      plbu_cmd[i++] = fui(ctx->viewport.y);
-      plbu_cmd[i++] = 0x10000105; /* VIEWPORT_Y */
+   if (info->index_size != 2 || !info->count || info->count % 6 ||
+       indices[0] % 4 || info->primitive_restart)
+      return -1;
 
-      plbu_cmd[i++] = fui(ctx->viewport.height);
-      plbu_cmd[i++] = 0x10000106; /* VIEWPORT_H */
+   for (unsigned i = 0; i < info->count; i += 6) {
+      unsigned base = indices[0] + i / 6 * 4;
+      for (int j = 0; j < 6; j++) {
+         if (indices[i + j] != base + lima_quad_indices[j])
+            return -1;
+      }
    }
 
+   return indices[0] / 4;
+}
+
+static bool
+lima_create_quad_index_bo(struct lima_context *ctx)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   unsigned size = LIMA_QUAD_INDEX_MAX_QUADS * sizeof(lima_quad_indices);
+
+   ctx->quad_index_bo = lima_bo_create(screen, size, 0, true, true);
+   if (!ctx->quad_index_bo)
+      return false;
+
+   uint16_t *map = ctx->quad_index_bo->map;
+   for (unsigned q = 0; q < LIMA_QUAD_INDEX_MAX_QUADS; q++) {
+      for (int j = 0; j < 6; j++)
+         *map++ = q * 4 + lima_quad_indices[j];
+   }
+   return true;
+}
+
+/* The address of the indices of a draw from application memory without
+ * going through the uploader: the quad index bo when they are quads, or
+ * a state block when short enough. 0 when neither applies. */
+static uint32_t
+lima_user_indices_va(struct lima_context *ctx, const struct pipe_draw_info *info)
+{
+   int quad = lima_user_indices_first_quad(info);
+   if (quad >= 0 && (ctx->quad_index_bo || lima_create_quad_index_bo(ctx))) {
+      lima_job_add_bo(ctx->job, LIMA_PIPE_GP, ctx->quad_index_bo,
+                      LIMA_SUBMIT_BO_READ);
+      return ctx->quad_index_bo->va + quad * sizeof(lima_quad_indices);
+   }
+
+   return lima_ctx_upload_indices(
+      ctx, (const uint8_t *)info->index.user + info->start * info->index_size,
+      info->count * info->index_size);
+}
+
+static void
+lima_pack_plbu_cmd(struct lima_context *ctx, struct lima_job *job,
+                   const struct pipe_draw_info *info)
+{
+   struct lima_job_plbu_state *state = &job->plbu_state;
+   int i = 0, max_n = 40;
+   uint32_t *plbu_cmd = util_dynarray_enlarge(&job->plbu_cmd_array, max_n * 4);
+   unsigned base = job->plbu_cmd_array.size / 4;
+
+   /* first draw need create a PLBU command header */
+   if (!job->plbu_cmd_array.size)
+      i += lima_pack_plbu_head(ctx, job, plbu_cmd);
+
    /* If it's zero scissor, we skip adding all other commands */
    if (lima_is_scissor_zero(ctx))
       goto done;
@@ -418,58 +880,120 @@ lima_pack_plbu_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
       if (cf & PIPE_FACE_BACK)
          cull |= ccw ? 0x00020000 : 0x00040000;
    }
-   plbu_cmd[i++] = 0x00002000 | 0x00000200 | cull |
+   /* Lines take their width from the LOW_PRIM_SIZE command, and so do
+    * points when the shader doesn't write gl_PointSize. Otherwise the
+    * PLBU reads the size of each point from the GP output. */
+   bool lines = info->mode >= PIPE_PRIM_LINES &&
+      info->mode < PIPE_PRIM_TRIANGLES;
+   bool points = info->mode == PIPE_PRIM_POINTS;
+   bool force_prim_size = lines ||
+      (points && ctx->vs->point_size_idx == -1);
+
+   /* the PLBU keeps its state between the draws of a stream, only emit
+    * what differs from the last commands */
+   uint32_t primitive_setup = 0x00002000 | 0x00000200 | cull |
+      (force_prim_size ? 0x00001000 : 0) |
       (info->index_size == 2 ? 0x00000400 : 0);
-   plbu_cmd[i++] = 0x1000010B; /* PRIMITIVE_SETUP */
+   if (state->primitive_setup != primitive_setup) {
+      plbu_cmd[i++] = primitive_setup;
+      plbu_cmd[i++] = 0x1000010B; /* PRIMITIVE_SETUP */
+      state->primitive_setup = primitive_setup;
+   }
 
    uint32_t gl_position_va = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_gl_pos);
+   job->last_draw.plbu_cmd_rsw = base + i;
    plbu_cmd[i++] = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_plb_rsw);
    plbu_cmd[i++] = 0x80000000 | (gl_position_va >> 4); /* RSW_VERTEX_ARRAY */
 
-   /* TODO
-    * - we should set it only for the first draw that enabled the scissor and for
-    *   latter draw only if scissor is dirty
-    * - check why scissor is not affecting bounds of region cleared by glClear
-    */
-   if (ctx->rasterizer->base.scissor) {
-      struct pipe_scissor_state *scissor = &ctx->scissor;
-      plbu_cmd[i++] = (scissor->minx << 30) | (scissor->maxy - 1) << 15 | scissor->miny;
-      plbu_cmd[i++] = 0x70000000 | (scissor->maxx - 1) << 13 | (scissor->minx >> 2); /* PLBU_CMD_SCISSORS */
+   if (force_prim_size) {
+      uint32_t prim_size = fui(lines ? ctx->rasterizer->base.line_width :
+                               ctx->rasterizer->base.point_size);
+      if (!state->prim_size_set || state->prim_size != prim_size) {
+         plbu_cmd[i++] = prim_size;
+         plbu_cmd[i++] = 0x1000010D; /* LOW_PRIM_SIZE */
+         state->prim_size_set = true;
+         state->prim_size = prim_size;
+      }
+   }
+   else if (points) {
+      /* the sizes follow the positions, see lima_update_varying */
+      plbu_cmd[i++] = gl_position_va + 4 * 4 * lima_draw_num_vertices(info);
+      plbu_cmd[i++] = 0x10000102; /* INDEXED_PT_SIZE */
    }
 
-   plbu_cmd[i++] = 0x00000000;
-   plbu_cmd[i++] = 0x1000010A; /* ?? */
+   /* The PLBU only bins the primitives against the tiles inside of the
+    * scissor, which is the viewport cut by the scissor state even when
+    * the rasterizer doesn't scissor, so the primitives of a small
+    * viewport skip the tests of the rest of the framebuffer.
+    * TODO: check why scissor is not affecting bounds of region cleared
+    * by glClear */
+   struct pipe_scissor_state bounds;
+   if (lima_draw_bounds(ctx, job, &bounds)) {
+      uint32_t scissor_cmd[2] = {
+         (bounds.minx << 30) | (bounds.maxy - 1) << 15 | bounds.miny,
+         0x70000000 | (bounds.maxx - 1) << 13 | (bounds.minx >> 2),
+      };
+      if (memcmp(state->scissor, scissor_cmd, sizeof(scissor_cmd))) {
+         plbu_cmd[i++] = scissor_cmd[0];
+         plbu_cmd[i++] = scissor_cmd[1]; /* PLBU_CMD_SCISSORS */
+         memcpy(state->scissor, scissor_cmd, sizeof(scissor_cmd));
+      }
+   }
+
+   if (!state->unknown_10a) {
+      plbu_cmd[i++] = 0x00000000;
+      plbu_cmd[i++] = 0x1000010A; /* ?? */
+      state->unknown_10a = true;
+   }
 
-   plbu_cmd[i++] = fui(ctx->viewport.near);
-   plbu_cmd[i++] = 0x1000010E; /* DEPTH_RANGE_NEAR */
+   uint32_t depth_near = fui(ctx->viewport.near);
+   uint32_t depth_far = fui(ctx->viewport.far);
+   if (!state->depth_range || state->depth_near != depth_near ||
+       state->depth_far != depth_far) {
+      plbu_cmd[i++] = depth_near;
+      plbu_cmd[i++] = 0x1000010E; /* DEPTH_RANGE_NEAR */
 
-   plbu_cmd[i++] = fui(ctx->viewport.far);
-   plbu_cmd[i++] = 0x1000010F; /* DEPTH_RANGE_FAR */
+      plbu_cmd[i++] = depth_far;
+      plbu_cmd[i++] = 0x1000010F; /* DEPTH_RANGE_FAR */
+
+      state->depth_range = true;
+      state->depth_near = depth_near;
+      state->depth_far = depth_far;
+   }
 
    if (info->index_size) {
       plbu_cmd[i++] = gl_position_va;
       plbu_cmd[i++] = 0x10000100; /* INDEXED_DEST */
 
-      struct pipe_resource *indexbuf = NULL;
-      unsigned index_offset = 0;
-      struct lima_resource *res;
-      if (info->has_user_indices) {
-         util_upload_index_buffer(&ctx->base, info, &indexbuf, &index_offset);
-         res = lima_resource(indexbuf);
+      uint32_t indices_va = 0;
+      if (info->has_user_indices)
+         indices_va = lima_user_indices_va(ctx, info);
+
+      if (!indices_va) {
+         struct pipe_resource *indexbuf = NULL;
+         unsigned index_offset = 0;
+         struct lima_resource *res;
+         if (info->has_user_indices) {
+            util_upload_index_buffer(&ctx->base, info, &indexbuf, &index_offset);
+            res = lima_resource(indexbuf);
+         }
+         else
+            res = lima_resource(info->index.resource);
+
+         lima_bo_update(res->bo, false, true);
+         lima_job_add_bo(job, LIMA_PIPE_GP, res->bo, LIMA_SUBMIT_BO_READ);
+         indices_va = res->bo->va + info->start * info->index_size + index_offset;
+
+         if (indexbuf)
+            pipe_resource_reference(&indexbuf, NULL);
       }
-      else
-         res = lima_resource(info->index.resource);
 
-      lima_bo_update(res->bo, false, true);
-      lima_submit_add_bo(ctx->gp_submit, res->bo, LIMA_SUBMIT_BO_READ);
-      plbu_cmd[i++] = res->bo->va + info->start * info->index_size + index_offset;
+      plbu_cmd[i++] = indices_va;
       plbu_cmd[i++] = 0x10000101; /* INDICES */
-
-      if (indexbuf)
-         pipe_resource_reference(&indexbuf, NULL);
    }
    else {
       /* can this make the attribute info static? */
+      job->last_draw.plbu_cmd_draw = base + i;
       plbu_cmd[i++] = (info->count << 24) | info->start;
       plbu_cmd[i++] = 0x00000000 | 0x00000000 |
          ((info->mode & 0x1F) << 16) | (info->count >> 8); /* DRAW | DRAW_ARRAYS */
@@ -487,7 +1011,7 @@ lima_pack_plbu_cmd(struct lima_context *ctx, const struct pipe_draw_info *info)
 
 done:
    assert(i <= max_n);
-   ctx->plbu_cmd_array.size += i * 4;
+   job->plbu_cmd_array.size += i * 4;
 
    lima_dump_command_stream_print(plbu_cmd, i * 4, false, "add plbu cmd\n");
 }
@@ -511,206 +1035,49 @@ struct lima_render_state {
    uint32_t varyings_address;
 };
 
-static int
-lima_blend_func(enum pipe_blend_func pipe)
-{
-   switch (pipe) {
-   case PIPE_BLEND_ADD:
-      return 2;
-   case PIPE_BLEND_SUBTRACT:
-      return 0;
-   case PIPE_BLEND_REVERSE_SUBTRACT:
-      return 1;
-   case PIPE_BLEND_MIN:
-      return 4;
-   case PIPE_BLEND_MAX:
-      return 5;
-   }
-   return -1;
-}
-
-static int
-lima_blend_factor(enum pipe_blendfactor pipe)
-{
-   switch (pipe) {
-   case PIPE_BLENDFACTOR_ONE:
-      return 11;
-   case PIPE_BLENDFACTOR_SRC_COLOR:
-      return 0;
-   case PIPE_BLENDFACTOR_SRC_ALPHA:
-      return 16;
-   case PIPE_BLENDFACTOR_DST_ALPHA:
-      return 17;
-   case PIPE_BLENDFACTOR_DST_COLOR:
-      return 1;
-   case PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE:
-      return 7;
-   case PIPE_BLENDFACTOR_CONST_COLOR:
-      return 2;
-   case PIPE_BLENDFACTOR_CONST_ALPHA:
-      return 18;
-   case PIPE_BLENDFACTOR_ZERO:
-      return 3;
-   case PIPE_BLENDFACTOR_INV_SRC_COLOR:
-      return 8;
-   case PIPE_BLENDFACTOR_INV_SRC_ALPHA:
-      return 24;
-   case PIPE_BLENDFACTOR_INV_DST_ALPHA:
-      return 25;
-   case PIPE_BLENDFACTOR_INV_DST_COLOR:
-      return 9;
-   case PIPE_BLENDFACTOR_INV_CONST_COLOR:
-      return 10;
-   case PIPE_BLENDFACTOR_INV_CONST_ALPHA:
-      return 26;
-   case PIPE_BLENDFACTOR_SRC1_COLOR:
-   case PIPE_BLENDFACTOR_SRC1_ALPHA:
-   case PIPE_BLENDFACTOR_INV_SRC1_COLOR:
-   case PIPE_BLENDFACTOR_INV_SRC1_ALPHA:
-      return -1; /* not support */
-   }
-   return -1;
-}
-
-static int
-lima_calculate_alpha_blend(enum pipe_blend_func rgb_func, enum pipe_blend_func alpha_func,
-                           enum pipe_blendfactor rgb_src_factor, enum pipe_blendfactor rgb_dst_factor,
-                           enum pipe_blendfactor alpha_src_factor, enum pipe_blendfactor alpha_dst_factor)
-{
-   return lima_blend_func(rgb_func) |
-      (lima_blend_func(alpha_func) << 3) |
-      (lima_blend_factor(rgb_src_factor) << 6) |
-      (lima_blend_factor(rgb_dst_factor) << 11) |
-      ((lima_blend_factor(alpha_src_factor) & 0xF) << 16) |
-      ((lima_blend_factor(alpha_dst_factor) & 0xF) << 20) |
-      0x0C000000; /* need check if this GLESv1 glAlphaFunc */
-}
-
-static int
-lima_stencil_op(enum pipe_stencil_op pipe)
-{
-   switch (pipe) {
-   case PIPE_STENCIL_OP_KEEP:
-      return 0;
-   case PIPE_STENCIL_OP_ZERO:
-      return 2;
-   case PIPE_STENCIL_OP_REPLACE:
-      return 1;
-   case PIPE_STENCIL_OP_INCR:
-      return 6;
-   case PIPE_STENCIL_OP_DECR:
-      return 7;
-   case PIPE_STENCIL_OP_INCR_WRAP:
-      return 4;
-   case PIPE_STENCIL_OP_DECR_WRAP:
-      return 5;
-   case PIPE_STENCIL_OP_INVERT:
-      return 3;
-   }
-   return -1;
-}
-
-static int
-lima_calculate_depth_test(struct pipe_depth_state *depth, struct pipe_rasterizer_state *rst)
-{
-   enum pipe_compare_func func = (depth->enabled ? depth->func : PIPE_FUNC_ALWAYS);
-
-   int offset_scale = 0;
-
-   //TODO: implement polygon offset
-#if 0
-   if (rst->offset_scale < -32)
-      offset_scale = -32;
-   else if (rst->offset_scale > 31)
-      offset_scale = 31;
-   else
-      offset_scale = rst->offset_scale * 4;
-
-   if (offset_scale < 0)
-      offset_scale = 0x100 + offset_scale;
-#endif
-
-   return (depth->enabled && depth->writemask) |
-      ((int)func << 1) |
-      (offset_scale << 16) |
-      0x30; /* find out what is this */
-}
-
 static void
 lima_pack_render_state(struct lima_context *ctx)
 {
-   struct lima_render_state *render =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_plb_rsw,
-                          sizeof(*render), LIMA_CTX_BUFF_SUBMIT_PP, true);
-
-   /* do hw support RGBA independ blend?
-    * PIPE_CAP_INDEP_BLEND_ENABLE
-    *
-    * how to handle the no cbuf only zbuf case?
-    */
-   struct pipe_rt_blend_state *rt = ctx->blend->base.rt;
+   struct lima_render_state rsw = {0}, *render = &rsw;
+
    render->blend_color_bg = float_to_ubyte(ctx->blend_color.color[2]) |
       (float_to_ubyte(ctx->blend_color.color[1]) << 16);
    render->blend_color_ra = float_to_ubyte(ctx->blend_color.color[0]) |
       (float_to_ubyte(ctx->blend_color.color[3]) << 16);
 
-   if (rt->blend_enable) {
-      render->alpha_blend = lima_calculate_alpha_blend(rt->rgb_func, rt->alpha_func,
-         rt->rgb_src_factor, rt->rgb_dst_factor,
-         rt->alpha_src_factor, rt->alpha_dst_factor);
-   }
-   else {
-      /*
-       * Special handling for blending disabled.
-       * Binary driver is generating the same alpha_value,
-       * as when we would just enable blending, without changing/setting any blend equation/params.
-       * Normaly in this case mesa would set all rt fields (func/factor) to zero.
-       */
-      render->alpha_blend = lima_calculate_alpha_blend(PIPE_BLEND_ADD, PIPE_BLEND_ADD,
-         PIPE_BLENDFACTOR_ONE, PIPE_BLENDFACTOR_ZERO,
-         PIPE_BLENDFACTOR_ONE, PIPE_BLENDFACTOR_ZERO);
-   }
-
-   render->alpha_blend |= (rt->colormask & PIPE_MASK_RGBA) << 28;
-
-   struct pipe_rasterizer_state *rst = &ctx->rasterizer->base;
-   struct pipe_depth_state *depth = &ctx->zsa->base.depth;
-   render->depth_test = lima_calculate_depth_test(depth, rst);
+   render->alpha_blend = ctx->blend->alpha_blend;
+   render->depth_test = ctx->zsa->depth_test | ctx->rasterizer->depth_test;
 
    /* overlap with plbu? any place can remove one? */
    render->depth_range = float_to_ushort(ctx->viewport.near) |
       (float_to_ushort(ctx->viewport.far) << 16);
 
-#if 0
-   struct pipe_stencil_state *stencil = ctx->zsa->base.stencil;
-   struct pipe_stencil_ref *ref = &ctx->stencil_ref;
-   render->stencil_front = stencil[0].func |
-      (lima_stencil_op(stencil[0].fail_op) << 3) |
-      (lima_stencil_op(stencil[0].zfail_op) << 6) |
-      (lima_stencil_op(stencil[0].zpass_op) << 9) |
-      (ref->ref_value[0] << 16) |
-      (stencil[0].valuemask << 24);
-   render->stencil_back = stencil[1].func |
-      (lima_stencil_op(stencil[1].fail_op) << 3) |
-      (lima_stencil_op(stencil[1].zfail_op) << 6) |
-      (lima_stencil_op(stencil[1].zpass_op) << 9) |
-      (ref->ref_value[1] << 16) |
-      (stencil[1].valuemask << 24);
-#else
-   render->stencil_front = 0xff000007;
-   render->stencil_back = 0xff000007;
-#endif
-
-   /* seems not correct? */
-   //struct pipe_alpha_state *alpha = &ctx->zsa->base.alpha;
-   render->stencil_test = 0;
-   //(stencil->enabled ? 0xFF : 0x00) | (float_to_ubyte(alpha->ref_value) << 16)
-
-   /* need more investigation */
-   render->multi_sample = 0x0000F807;
+   render->stencil_front = ctx->zsa->stencil_front;
+   render->stencil_back = ctx->zsa->stencil_back;
+   render->stencil_test = ctx->zsa->stencil_test;
+   if (ctx->zsa->base.stencil[0].enabled) {
+      struct pipe_stencil_ref *ref = &ctx->stencil_ref;
+      bool two_side = ctx->zsa->base.stencil[1].enabled;
+
+      render->stencil_front |= ref->ref_value[0] << 16;
+      render->stencil_back |= ref->ref_value[two_side ? 1 : 0] << 16;
+   }
+
+   /* bits 12-15 are the sample mask, the low bits enable the 4x pattern
+    * of the tile buffer */
+   if (ctx->framebuffer.samples && ctx->rasterizer->base.multisample) {
+      render->multi_sample = 0x00000868 | ((ctx->sample_mask & 0xF) << 12);
+      if (ctx->blend->base.alpha_to_coverage)
+         render->multi_sample |= 1 << 7;
+      if (ctx->blend->base.alpha_to_one)
+         render->multi_sample |= 1 << 8;
+   }
+   else
+      render->multi_sample = 0x0000F807;
 
    render->shader_address =
-      ctx->fs->bo->va | (((uint32_t *)ctx->fs->bo->map)[0] & 0x1F);
+      (ctx->fs->bo->va + ctx->fs->bo_offset) |
+      (((uint32_t *)(ctx->fs->bo->map + ctx->fs->bo_offset))[0] & 0x1F);
 
    /* seems not needed */
    render->uniforms_address = 0x00000000;
@@ -718,9 +1085,26 @@ lima_pack_render_state(struct lima_context *ctx)
    render->textures_address = 0x00000000;
 
    /* more investigation */
-   render->aux0 = 0x00000300 | (ctx->vs->varying_stride >> 3);
+   render->aux0 = ctx->vs->varying_stride >> 3;
    render->aux1 = 0x00003000;
 
+   /* Early Z rejects the fragments failing the depth and stencil tests
+    * before the shader runs, which is only right when the shader can't
+    * drop fragments or change their depth. Forward pixel kill then stops
+    * the shading of queued fragments an opaque one covers later, which
+    * needs the fragments to fully replace the color. */
+   struct lima_fs_shader_state *fs = ctx->fs;
+   struct pipe_rt_blend_state *rt = &ctx->blend->base.rt[0];
+   bool early_z = !fs->uses_discard && !fs->writes_depth &&
+      !ctx->zsa->base.alpha.enabled && !ctx->blend->base.alpha_to_coverage;
+   bool pixel_kill = early_z && !rt->blend_enable &&
+      (rt->colormask & PIPE_MASK_RGBA) == PIPE_MASK_RGBA;
+
+   if (early_z)
+      render->aux0 |= 0x300;
+   if (pixel_kill)
+      render->aux0 |= 0x1000;
+
    if (ctx->tex_stateobj.num_samplers) {
       render->textures_address = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_tex_desc);
       render->aux0 |= ctx->tex_stateobj.num_samplers << 14;
@@ -734,49 +1118,72 @@ lima_pack_render_state(struct lima_context *ctx)
       render->aux1 |= 0x10000;
    }
 
-   if (ctx->vs->num_varying > 1) {
-      render->varying_types = 0x00000000;
-      render->varyings_address = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_varying);
-      for (int i = 1; i < ctx->vs->num_varying; i++) {
-         int val;
-
-         struct lima_varying_info *v = ctx->vs->varying + i;
-         if (v->component_size == 4)
-            val = v->components == 4 ? 0 : 1;
-         else
-            val = v->components == 4 ? 2 : 3;
-
-         int index = i - 1;
-         if (index < 10)
-            render->varying_types |= val << (3 * index);
-         else if (index == 10) {
-            render->varying_types |= val << 30;
-            render->varyings_address |= val >> 2;
-         }
-         else if (index == 11)
-            render->varyings_address |= val << 1;
-      }
+   if (ctx->vs->varying_stride) {
+      render->varying_types = ctx->vs->varying_types;
+      render->varyings_address = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_varying) |
+         ctx->vs->varying_address_bits;
    }
    else {
       render->varying_types = 0x00000000;
       render->varyings_address = 0x00000000;
    }
 
+   /* Draws with the same state share the render state, it's kept in ctx
+    * buffer state so each new job gets its bo. Draws with varyings never
+    * do as each has its own varying buffer. */
+   STATIC_ASSERT(sizeof(rsw) == sizeof(ctx->render_state));
+   if (ctx->buffer_state[lima_ctx_buff_pp_plb_rsw].bo &&
+       !memcmp(&rsw, ctx->render_state, sizeof(rsw)))
+      return;
+
+   render = lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_plb_rsw,
+                                sizeof(*render), LIMA_CTX_BUFF_SUBMIT_PP);
+   memcpy(render, &rsw, sizeof(rsw));
+   memcpy(ctx->render_state, &rsw, sizeof(rsw));
+
    lima_dump_command_stream_print(
       render, sizeof(*render), false, "add render state at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_pp_plb_rsw));
 }
 
 static void
-lima_update_gp_attribute_info(struct lima_context *ctx, const struct pipe_draw_info *info)
+lima_update_gp_attribute_info(struct lima_context *ctx, const struct pipe_draw_info *info,
+                              unsigned instance)
 {
    struct lima_vertex_element_state *ve = ctx->vertex_elements;
    struct lima_context_vertex_buffer *vb = &ctx->vertex_buffers;
+   unsigned start = info->index_size ? info->min_index : info->start;
+
+   /* only per instance elements depend on the instance */
+   if (!ve->instanced)
+      instance = 0;
+
+   /* The table only changes with the vertex state, the start vertex and
+    * the address of the vertex buffer bos, which are replaced when the
+    * buffers get renamed. The ctx buff state of the table brings it to
+    * new jobs, the vertex buffer bos have to be added to them. */
+   bool reuse = !(ctx->dirty & (LIMA_CONTEXT_DIRTY_VERTEX_ELEM |
+                                LIMA_CONTEXT_DIRTY_VERTEX_BUFF)) &&
+      ctx->buffer_state[lima_ctx_buff_gp_attribute_info].bo &&
+      ctx->attribute_start == start &&
+      ctx->attribute_instance == instance;
+
+   for (unsigned mask = vb->enabled_mask; reuse && mask;) {
+      int i = u_bit_scan(&mask);
+      struct lima_resource *res = lima_resource(vb->vb[i].buffer.resource);
+      reuse = res->bo->va == ctx->attribute_va[i];
+   }
 
-   uint32_t *attribute =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_attribute_info,
-                          ve->num_elements * 8, LIMA_CTX_BUFF_SUBMIT_GP, true);
+   if (reuse) {
+      for (unsigned mask = vb->enabled_mask; mask;) {
+         int i = u_bit_scan(&mask);
+         struct lima_resource *res = lima_resource(vb->vb[i].buffer.resource);
+         lima_job_add_bo(ctx->job, LIMA_PIPE_GP, res->bo, LIMA_SUBMIT_BO_READ);
+      }
+      return;
+   }
 
+   uint32_t attribute[PIPE_MAX_ATTRIBS * 2];
    int n = 0;
    for (int i = 0; i < ve->num_elements; i++) {
       struct pipe_vertex_element *pve = ve->pipe + i;
@@ -788,46 +1195,97 @@ lima_update_gp_attribute_info(struct lima_context *ctx, const struct pipe_draw_i
       struct lima_resource *res = lima_resource(pvb->buffer.resource);
       lima_bo_update(res->bo, false, true);
 
-      lima_submit_add_bo(ctx->gp_submit, res->bo, LIMA_SUBMIT_BO_READ);
+      lima_job_add_bo(ctx->job, LIMA_PIPE_GP, res->bo, LIMA_SUBMIT_BO_READ);
+
+      /* per instance elements read the same value for all vertices */
+      unsigned stride = pvb->stride;
+      unsigned offset = start * stride;
+      if (pve->instance_divisor) {
+         offset = (instance / pve->instance_divisor) * stride;
+         stride = 0;
+      }
 
-      unsigned start = info->index_size ? info->min_index : info->start;
       attribute[n++] = res->bo->va + pvb->buffer_offset + pve->src_offset
-         + start * pvb->stride;
-      attribute[n++] = (pvb->stride << 11) |
+         + offset;
+      attribute[n++] = (stride << 11) |
          (lima_pipe_format_to_attrib_type(pve->src_format) << 2) |
          (util_format_get_nr_components(pve->src_format) - 1);
    }
 
+   lima_ctx_buff_upload(ctx, lima_ctx_buff_gp_attribute_info, attribute,
+                        n * 4, LIMA_CTX_BUFF_SUBMIT_GP);
+
+   ctx->attribute_start = start;
+   ctx->attribute_instance = instance;
+   for (unsigned mask = vb->enabled_mask; mask;) {
+      int i = u_bit_scan(&mask);
+      struct lima_resource *res = lima_resource(vb->vb[i].buffer.resource);
+      ctx->attribute_va[i] = res->bo->va;
+   }
+
    lima_dump_command_stream_print(
       attribute, n * 4, false, "update attribute info at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_gp_attribute_info));
 }
 
 static void
-lima_update_gp_uniform(struct lima_context *ctx)
+lima_update_gp_uniform(struct lima_context *ctx, unsigned instance)
 {
    struct lima_context_constant_buffer *ccb =
       ctx->const_buffer + PIPE_SHADER_VERTEX;
    struct lima_vs_shader_state *vs = ctx->vs;
+   unsigned size = ccb->size + vs->constant_size + LIMA_GP_UNIFORM_DRIVER_SIZE;
+
+   float viewport[8];
+   memcpy(viewport, ctx->viewport.transform.scale, 12);
+   viewport[3] = 0.0f;
+   memcpy(viewport + 4, ctx->viewport.transform.translate, 12);
+   viewport[7] = 0.0f;
+
+   /* the shader constants don't change, so the buffer uploaded before
+    * is still good for the same constant buffer, viewport and instance */
+   if (ctx->buffer_state[lima_ctx_buff_gp_uniform].bo &&
+       ctx->gp_uniform_vs == vs &&
+       ctx->gp_uniform_size == ccb->size &&
+       (!vs->uses_instance_id || ctx->gp_uniform_instance == instance) &&
+       !memcmp(ctx->gp_uniform_viewport, viewport, sizeof(viewport)) &&
+       (!ccb->size || !memcmp(ctx->gp_uniform, ccb->buffer, ccb->size)))
+      return;
 
-   void *vs_const_buff =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_uniform,
-                          ccb->size + vs->constant_size + 32,
-                          LIMA_CTX_BUFF_SUBMIT_GP, true);
+   /* built on the CPU for lima_ctx_buff_upload to find an earlier upload
+    * of the same content */
+   util_dynarray_clear(&ctx->state_scratch);
+   void *vs_const_buff = util_dynarray_resize(&ctx->state_scratch, size);
 
    if (ccb->buffer)
       memcpy(vs_const_buff, ccb->buffer, ccb->size);
 
-   memcpy(vs_const_buff + ccb->size, ctx->viewport.transform.scale,
-          sizeof(ctx->viewport.transform.scale));
-   memcpy(vs_const_buff + ccb->size + 16, ctx->viewport.transform.translate,
-          sizeof(ctx->viewport.transform.translate));
+   memcpy(vs_const_buff + ccb->size, viewport, sizeof(viewport));
+
+   /* the GP has no integers, gl_InstanceID is read as a float */
+   float instance_id[4] = { instance, 0.0f, 0.0f, 0.0f };
+   memcpy(vs_const_buff + ccb->size + 32, instance_id, sizeof(instance_id));
+   ctx->gp_uniform_instance = instance;
 
    if (vs->constant)
-      memcpy(vs_const_buff + ccb->size + 32, vs->constant, vs->constant_size);
+      memcpy(vs_const_buff + ccb->size + LIMA_GP_UNIFORM_DRIVER_SIZE,
+             vs->constant, vs->constant_size);
+
+   lima_ctx_buff_upload(ctx, lima_ctx_buff_gp_uniform, vs_const_buff, size,
+                        LIMA_CTX_BUFF_SUBMIT_GP);
+
+   memcpy(ctx->gp_uniform_viewport, viewport, sizeof(viewport));
+   if (ccb->size <= sizeof(ctx->gp_uniform)) {
+      if (ccb->size)
+         memcpy(ctx->gp_uniform, ccb->buffer, ccb->size);
+      ctx->gp_uniform_vs = vs;
+      ctx->gp_uniform_size = ccb->size;
+   }
+   else
+      ctx->gp_uniform_vs = NULL;
 
    lima_dump_command_stream_print(
-      vs_const_buff, ccb->size + vs->constant_size + 32, true,
+      vs_const_buff, size, true,
       "update gp uniform at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_gp_uniform));
 }
@@ -837,29 +1295,63 @@ lima_update_pp_uniform(struct lima_context *ctx)
 {
    const float *const_buff = ctx->const_buffer[PIPE_SHADER_FRAGMENT].buffer;
    size_t const_buff_size = ctx->const_buffer[PIPE_SHADER_FRAGMENT].size / sizeof(float);
+   const struct lima_preshader *ps = lima_fs_preshader(ctx->fs);
 
    if (!const_buff)
       return;
 
+   /* the same constants set again keep the buffer uploaded before, the
+    * preshader results in it too if they are of the same fs, and a plain
+    * fs needs a buffer without the results of another one's */
+   size_t size = const_buff_size * sizeof(float);
+   if (lima_pp_uniform_is_current(ctx, const_buff, size))
+      return;
+
+   /* the results go after the uniforms the fs reads */
+   size_t num = const_buff_size;
+   if (ps)
+      num = MAX2(num, (ps->base + ps->num_outputs) * 4);
+
+   util_dynarray_clear(&ctx->state_scratch);
    uint16_t *fp16_const_buff =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_uniform,
-                          const_buff_size * sizeof(uint16_t),
-                          LIMA_CTX_BUFF_SUBMIT_PP, true);
+      util_dynarray_resize(&ctx->state_scratch, num * sizeof(uint16_t));
 
-   uint32_t *array =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_uniform_array,
-                          4, LIMA_CTX_BUFF_SUBMIT_PP, true);
+   util_float_to_half_array(fp16_const_buff, const_buff, const_buff_size);
 
-   for (int i = 0; i < const_buff_size; i++)
-       fp16_const_buff[i] = util_float_to_half(const_buff[i]);
+   if (ps) {
+      float results[LIMA_PRESHADER_MAX_VALUES * 4];
 
-   *array = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_uniform);
+      memset(fp16_const_buff + const_buff_size, 0,
+             (num - const_buff_size) * sizeof(uint16_t));
+      lima_preshader_run(ps, const_buff, const_buff_size, results);
+      util_float_to_half_array(fp16_const_buff + ps->base * 4, results,
+                               ps->num_outputs * 4);
+   }
+
+   /* the same data shares its upload and so its address in the array */
+   if (!lima_ctx_buff_upload(ctx, lima_ctx_buff_pp_uniform, fp16_const_buff,
+                             num * sizeof(uint16_t),
+                             LIMA_CTX_BUFF_SUBMIT_PP))
+      return;
+
+   ctx->pp_uniform_preshader = ps;
+
+   uint32_t array = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_uniform);
+   lima_ctx_buff_upload(ctx, lima_ctx_buff_pp_uniform_array, &array, 4,
+                        LIMA_CTX_BUFF_SUBMIT_PP);
+
+   if (size <= sizeof(ctx->pp_uniform)) {
+      memcpy(ctx->pp_uniform, const_buff, size);
+      ctx->pp_uniform_size = size;
+   }
+   else
+      ctx->pp_uniform_size = 0;
 
    lima_dump_command_stream_print(
-      fp16_const_buff, const_buff_size * 2, false, "add pp uniform data at va %x\n",
+      fp16_const_buff, num * 2, false, "add pp uniform data at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_pp_uniform));
    lima_dump_command_stream_print(
-      array, 4, false, "add pp uniform info at va %x\n",
+      &array, 4, false, "add pp uniform info at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_pp_uniform_array));
 }
 
@@ -870,47 +1362,39 @@ lima_update_varying(struct lima_context *ctx, const struct pipe_draw_info *info)
 
    uint32_t *varying =
       lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_varying_info,
-                          vs->num_varying * 8, LIMA_CTX_BUFF_SUBMIT_GP, true);
+                          vs->num_varying * 8, LIMA_CTX_BUFF_SUBMIT_GP);
    int n = 0;
 
+   /* the GP writes one output per shaded vertex, that is the index
+    * range of indexed draws and not their index count */
+   unsigned num = lima_draw_num_vertices(info);
+
    /* should be LIMA_SUBMIT_BO_WRITE for GP, but each draw will use
-    * different part of this bo, so no need to set exclusive constraint */
+    * different part of this bo, so no need to set exclusive constraint.
+    * The point sizes the PLBU reads go after the positions. */
+   bool point_size = vs->point_size_idx != -1;
    lima_ctx_buff_alloc(ctx, lima_ctx_buff_sh_gl_pos,
-                       4 * 4 * info->count,
-                       LIMA_CTX_BUFF_SUBMIT_GP | LIMA_CTX_BUFF_SUBMIT_PP,
-                       false);
+                       4 * 4 * num + (point_size ? 4 * num : 0),
+                       LIMA_CTX_BUFF_SUBMIT_GP | LIMA_CTX_BUFF_SUBMIT_PP);
 
    /* for gl_Position */
    varying[n++] = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_gl_pos);
-   varying[n++] = 0x8020;
-
-   int offset = 0;
-   for (int i = 1; i < vs->num_varying; i++) {
-      struct lima_varying_info *v = vs->varying + i;
-
-      v->components = align(v->components, 2);
-
-      int size = v->components * v->component_size;
-      size = align(size, 8);
-      if (size == 16)
-         offset = align(offset, 16);
-
-      v->offset = offset;
-      offset += size;
-   }
-   vs->varying_stride = align(offset, 8);
+   varying[n++] = vs->varying[0].format;
 
-   if (vs->num_varying > 1)
+   if (vs->varying_stride)
       lima_ctx_buff_alloc(ctx, lima_ctx_buff_sh_varying,
-                          vs->varying_stride * info->count,
-                          LIMA_CTX_BUFF_SUBMIT_GP | LIMA_CTX_BUFF_SUBMIT_PP,
-                          false);
+                          vs->varying_stride * num,
+                          LIMA_CTX_BUFF_SUBMIT_GP | LIMA_CTX_BUFF_SUBMIT_PP);
 
    for (int i = 1; i < vs->num_varying; i++) {
       struct lima_varying_info *v = vs->varying + i;
-      varying[n++] = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_varying) + v->offset;
-      varying[n++] = (vs->varying_stride << 11) | (v->components - 1) |
-         (v->component_size == 2 ? 0x0C : 0);
+      if (i == vs->point_size_idx)
+         varying[n++] = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_gl_pos) +
+            4 * 4 * num;
+      else
+         varying[n++] = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_varying) +
+            v->offset;
+      varying[n++] = v->format;
    }
 
    lima_dump_command_stream_print(
@@ -918,89 +1402,237 @@ lima_update_varying(struct lima_context *ctx, const struct pipe_draw_info *info)
       lima_ctx_buff_va(ctx, lima_ctx_buff_gp_varying_info));
 }
 
+/* bos of the frame, added on the first draw or when flushing a job
+ * without draws, clear only jobs without GP job don't touch the PLB */
 static void
-lima_update_submit_bo(struct lima_context *ctx)
+lima_update_frame_bo(struct lima_context *ctx, struct lima_job *job,
+                     bool use_plb)
 {
-   lima_submit_add_bo(ctx->gp_submit, ctx->vs->bo, LIMA_SUBMIT_BO_READ);
-   lima_submit_add_bo(ctx->pp_submit, ctx->fs->bo, LIMA_SUBMIT_BO_READ);
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
 
-   if (!ctx->num_draws) {
-      struct lima_screen *screen = lima_screen(ctx->base.screen);
-      lima_submit_add_bo(ctx->gp_submit, ctx->plb_gp_stream, LIMA_SUBMIT_BO_READ);
-      lima_submit_add_bo(ctx->gp_submit, ctx->plb[ctx->plb_index], LIMA_SUBMIT_BO_WRITE);
-      lima_submit_add_bo(ctx->gp_submit, screen->gp_buffer, LIMA_SUBMIT_BO_READ);
+   if (use_plb) {
+      lima_job_add_bo(job, LIMA_PIPE_GP, ctx->plb_gp_stream, LIMA_SUBMIT_BO_READ);
+      lima_job_add_bo(job, LIMA_PIPE_GP, ctx->plb[job->plb_index], LIMA_SUBMIT_BO_WRITE);
 
       lima_dump_command_stream_print(
-         ctx->plb_gp_stream->map + ctx->plb_index * ctx->plb_gp_size,
+         ctx->plb_gp_stream->map + job->plb_index * ctx->plb_gp_size,
          ctx->plb_gp_size, false, "gp plb stream at va %x\n",
-         ctx->plb_gp_stream->va + ctx->plb_index * ctx->plb_gp_size);
-
-      if (ctx->plb_pp_stream) {
-         struct lima_ctx_plb_pp_stream_key key = {
-            .plb_index = ctx->plb_index,
-            .tiled_w = ctx->framebuffer.tiled_w,
-            .tiled_h = ctx->framebuffer.tiled_h,
-         };
-
-         struct hash_entry *entry =
-            _mesa_hash_table_search(ctx->plb_pp_stream, &key);
-         struct lima_ctx_plb_pp_stream *s = entry->data;
-         lima_update_plb(ctx, s);
-         ctx->current_plb_pp_stream = s;
-
-         lima_submit_add_bo(ctx->pp_submit, s->bo, LIMA_SUBMIT_BO_READ);
+         ctx->plb_gp_stream->va + job->plb_index * ctx->plb_gp_size);
+   }
+
+   if (ctx->plb_pp_stream) {
+      struct lima_ctx_plb_pp_stream_key key = {
+         .plb_index = use_plb ? job->plb_index : LIMA_CTX_PLB_CLEAR_INDEX,
+         .tiled_w = job->fb.tiled_w,
+         .tiled_h = job->fb.tiled_h,
+      };
+
+      /* the job holds the surfaces keeping the stream alive */
+      mtx_lock(&ctx->plb_pp_stream_lock);
+      struct hash_entry *entry =
+         _mesa_hash_table_search(ctx->plb_pp_stream, &key);
+      mtx_unlock(&ctx->plb_pp_stream_lock);
+
+      struct lima_ctx_plb_pp_stream *s = entry->data;
+      job->plb_pp_stream = s;
+
+      /* the kept streams are for the grouping of the framebuffer */
+      if (!job->fine_blocking || !use_plb) {
+         lima_update_plb(ctx, job, s);
+         lima_job_add_bo(job, LIMA_PIPE_PP, s->bo, LIMA_SUBMIT_BO_READ);
       }
+   }
 
-      struct lima_resource *res = lima_resource(ctx->framebuffer.cbuf->texture);
-      lima_submit_add_bo(ctx->pp_submit, res->bo, LIMA_SUBMIT_BO_WRITE);
-      lima_submit_add_bo(ctx->pp_submit, ctx->plb[ctx->plb_index], LIMA_SUBMIT_BO_READ);
-      lima_submit_add_bo(ctx->pp_submit, screen->pp_buffer, LIMA_SUBMIT_BO_READ);
+   if (job->fb.cbuf) {
+      struct lima_resource *res = lima_resource(job->fb.cbuf->texture);
+      lima_job_add_bo(job, LIMA_PIPE_PP, res->bo, LIMA_SUBMIT_BO_WRITE);
    }
+   if (use_plb)
+      lima_job_add_bo(job, LIMA_PIPE_PP, ctx->plb[job->plb_index], LIMA_SUBMIT_BO_READ);
+   lima_job_add_bo(job, LIMA_PIPE_PP, screen->pp_buffer, LIMA_SUBMIT_BO_READ);
 }
 
 static void
-lima_draw_vbo(struct pipe_context *pctx, const struct pipe_draw_info *info)
+lima_update_submit_bo(struct lima_context *ctx, struct lima_job *job)
 {
-   debug_checkpoint();
+   lima_job_add_bo(job, LIMA_PIPE_GP, ctx->vs->bo, LIMA_SUBMIT_BO_READ);
+   lima_job_add_bo(job, LIMA_PIPE_PP, ctx->fs->bo, LIMA_SUBMIT_BO_READ);
+   job->pp_max_stack_size = MAX2(job->pp_max_stack_size, ctx->fs->stack_size);
 
-   struct lima_context *ctx = lima_context(pctx);
+   if (!job->num_draws)
+      lima_update_frame_bo(ctx, job, true);
+}
 
-   if (!ctx->vs || !ctx->fs) {
-      debug_warn_once("no shader, skip draw\n");
+/* a draw only reaches the tiles of its viewport, cut by the scissor */
+static void
+lima_update_damage(struct lima_context *ctx, struct lima_job *job,
+                   const struct pipe_draw_info *info)
+{
+   struct pipe_scissor_state bounds;
+   if (!lima_draw_bounds(ctx, job, &bounds))
       return;
+
+   /* the fragment shader size is the best idea of how expensive each
+    * covered pixel is known at draw time */
+   unsigned cost = 1 + ctx->fs->shader_size / 16;
+   lima_job_add_damage(job, bounds.minx, bounds.miny, bounds.maxx,
+                       bounds.maxy, cost);
+
+   if (info->instance_count)
+      lima_query_add_draw(ctx);
+}
+
+static void lima_flush_sampled_jobs(struct lima_context *ctx);
+
+#define LIMA_SCAN_INDICES(type, indices, info, min, max)          \
+   do {                                                          \
+      const type *idx = (const type *)(indices);                 \
+      for (unsigned i = 0; i < (info)->count; i++) {             \
+         if ((info)->primitive_restart &&                        \
+             idx[i] == (info)->restart_index)                    \
+            continue;                                            \
+         if (idx[i] < min)                                       \
+            min = idx[i];                                        \
+         if (idx[i] > max)                                       \
+            max = idx[i];                                        \
+      }                                                          \
+   } while (0)
+
+static void
+lima_scan_index_bounds(const void *indices, struct pipe_draw_info *info)
+{
+   unsigned min = ~0u, max = 0;
+
+   switch (info->index_size) {
+   case 1:
+      LIMA_SCAN_INDICES(uint8_t, indices, info, min, max);
+      break;
+   case 2:
+      LIMA_SCAN_INDICES(uint16_t, indices, info, min, max);
+      break;
+   default:
+      LIMA_SCAN_INDICES(uint32_t, indices, info, min, max);
+      break;
    }
 
-   if (!lima_update_vs_state(ctx) || !lima_update_fs_state(ctx))
-      return;
+   /* all indices are restart ones, nothing gets drawn */
+   if (min > max)
+      min = max = 0;
 
-   lima_dump_command_stream_print(
-      ctx->vs->bo->map, ctx->vs->shader_size, false,
-      "add vs at va %x\n", ctx->vs->bo->va);
+   info->min_index = min;
+   info->max_index = max;
+}
 
-   lima_dump_command_stream_print(
-      ctx->fs->bo->map, ctx->fs->shader_size, false,
-      "add fs at va %x\n", ctx->fs->bo->va);
+static inline bool
+lima_index_cache_match(struct lima_index_cache_entry *e,
+                       const struct pipe_draw_info *info, uint32_t offset)
+{
+   return e->offset == offset && e->count == info->count &&
+      e->index_size == info->index_size &&
+      e->primitive_restart == info->primitive_restart &&
+      (!info->primitive_restart || e->restart_index == info->restart_index);
+}
 
-   lima_update_submit_bo(ctx);
+/* The state tracker leaves min_index at 0 and max_index at ~0 when the
+ * application gave no index bounds. Scan the indices here instead, and
+ * remember the result for static index buffers so that a mesh drawn in
+ * every frame only gets scanned once. */
+static bool
+lima_update_index_bounds(struct pipe_draw_info *info)
+{
+   struct lima_resource *res = NULL;
+   const uint8_t *indices;
+
+   if (info->has_user_indices)
+      indices = info->index.user;
+   else {
+      res = lima_resource(info->index.resource);
+      if (!lima_bo_update(res->bo, true, false))
+         return false;
+      indices = res->bo->map;
+   }
+
+   uint32_t offset = info->start * info->index_size;
+   indices += offset;
+
+   /* stream and persistently mapped buffers are written without going
+    * through transfer_map each time, so they can't be cached */
+   struct pipe_resource *pres = res ? &res->base.b : NULL;
+   if (!pres || pres->usage == PIPE_USAGE_STREAM ||
+       pres->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT) {
+      lima_scan_index_bounds(indices, info);
+      return true;
+   }
 
-   lima_update_gp_attribute_info(ctx, info);
+   struct lima_index_cache *cache = res->index_cache;
+   if (!cache) {
+      cache = res->index_cache = CALLOC_STRUCT(lima_index_cache);
+      if (!cache) {
+         lima_scan_index_bounds(indices, info);
+         return true;
+      }
+   }
+
+   unsigned serial = p_atomic_read(&res->write_serial);
+   if (cache->serial != serial) {
+      cache->serial = serial;
+      cache->num = 0;
+      cache->next = 0;
+   }
+
+   for (unsigned i = 0; i < cache->num; i++) {
+      struct lima_index_cache_entry *e = cache->entries + i;
+      if (lima_index_cache_match(e, info, offset)) {
+         info->min_index = e->min_index;
+         info->max_index = e->max_index;
+         return true;
+      }
+   }
+
+   lima_scan_index_bounds(indices, info);
+
+   struct lima_index_cache_entry *e = cache->entries + cache->next;
+   e->offset = offset;
+   e->count = info->count;
+   e->restart_index = info->restart_index;
+   e->index_size = info->index_size;
+   e->primitive_restart = info->primitive_restart;
+   e->min_index = info->min_index;
+   e->max_index = info->max_index;
+
+   cache->next = (cache->next + 1) % LIMA_INDEX_CACHE_SIZE;
+   if (cache->num < LIMA_INDEX_CACHE_SIZE)
+      cache->num++;
+
+   return true;
+}
+
+static void
+lima_pack_draw(struct lima_context *ctx, struct lima_job *job,
+               const struct pipe_draw_info *info, unsigned instance)
+{
+   lima_update_gp_attribute_info(ctx, info, instance);
 
    if ((ctx->dirty & LIMA_CONTEXT_DIRTY_CONST_BUFF &&
         ctx->const_buffer[PIPE_SHADER_VERTEX].dirty) ||
        ctx->dirty & LIMA_CONTEXT_DIRTY_VIEWPORT ||
-       ctx->dirty & LIMA_CONTEXT_DIRTY_SHADER_VERT) {
-      lima_update_gp_uniform(ctx);
+       ctx->dirty & LIMA_CONTEXT_DIRTY_SHADER_VERT ||
+       (ctx->vs->uses_instance_id && ctx->gp_uniform_instance != instance)) {
+      lima_update_gp_uniform(ctx, instance);
       ctx->const_buffer[PIPE_SHADER_VERTEX].dirty = false;
    }
 
    lima_update_varying(ctx, info);
 
    /* If it's zero scissor, don't build vs cmd list */
-   if (!lima_is_scissor_zero(ctx))
-      lima_pack_vs_cmd(ctx, info);
+   bool scissor_zero = lima_is_scissor_zero(ctx);
+   if (!scissor_zero)
+      lima_pack_vs_cmd(ctx, job, info);
 
-   if (ctx->dirty & LIMA_CONTEXT_DIRTY_CONST_BUFF &&
-       ctx->const_buffer[PIPE_SHADER_FRAGMENT].dirty) {
+   /* the buffer has the preshader results of the fs it was built for */
+   if ((ctx->dirty & LIMA_CONTEXT_DIRTY_CONST_BUFF &&
+        ctx->const_buffer[PIPE_SHADER_FRAGMENT].dirty) ||
+       ctx->pp_uniform_preshader != lima_fs_preshader(ctx->fs)) {
       lima_update_pp_uniform(ctx);
       ctx->const_buffer[PIPE_SHADER_FRAGMENT].dirty = false;
    }
@@ -1009,37 +1641,229 @@ lima_draw_vbo(struct pipe_context *pctx, const struct pipe_draw_info *info)
       lima_update_textures(ctx);
 
    lima_pack_render_state(ctx);
-   lima_pack_plbu_cmd(ctx, info);
+   lima_pack_plbu_cmd(ctx, job, info);
+
+   /* only lists of whole primitives can be extended by the next draw */
+   unsigned count = info->count;
+   u_trim_pipe_prim(info->mode, &count);
+
+   struct lima_job_draw *last = &job->last_draw;
+   /* the point sizes are not patched for the merged range */
+   last->mergeable = !info->index_size && !scissor_zero &&
+      info->instance_count == 1 &&
+      ctx->vs->point_size_idx == -1 &&
+      count == info->count &&
+      (info->mode == PIPE_PRIM_POINTS || info->mode == PIPE_PRIM_LINES ||
+       info->mode == PIPE_PRIM_TRIANGLES);
+   last->mode = info->mode;
+   last->start = info->start;
+   last->count = info->count;
+}
+
+#define LIMA_MAX_MERGED_VERTICES 0xffff
+
+/* A non-indexed draw continuing the vertex range of the last draw of the
+ * job, with no state change in between, is merged into that draw. The
+ * per vertex buffers and the render state pointing to them are packed
+ * again for the whole range, then the commands of the last draw get
+ * patched to use them and draw the whole range. */
+static bool
+lima_merge_draw(struct lima_context *ctx, struct lima_job *job,
+                const struct pipe_draw_info *info)
+{
+   struct lima_job_draw *last = &job->last_draw;
+
+   if (!last->mergeable || ctx->dirty || info->index_size ||
+       info->instance_count != 1 ||
+       info->mode != last->mode ||
+       info->start != last->start + last->count ||
+       last->count + info->count > LIMA_MAX_MERGED_VERTICES)
+      return false;
+
+   struct pipe_draw_info merged = *info;
+   merged.start = last->start;
+   merged.count = last->count + info->count;
+
+   lima_update_varying(ctx, &merged);
+   lima_pack_render_state(ctx);
+
+   uint32_t *vs_cmd = job->vs_cmd_array.data;
+   vs_cmd[last->vs_cmd_varyings] =
+      lima_ctx_buff_va(ctx, lima_ctx_buff_gp_varying_info);
+   vs_cmd[last->vs_cmd_draw] = merged.count << 24;
+   vs_cmd[last->vs_cmd_draw + 1] = merged.count >> 8; /* DRAW */
+
+   uint32_t *plbu_cmd = job->plbu_cmd_array.data;
+   uint32_t gl_position_va = lima_ctx_buff_va(ctx, lima_ctx_buff_sh_gl_pos);
+   plbu_cmd[last->plbu_cmd_rsw] = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_plb_rsw);
+   plbu_cmd[last->plbu_cmd_rsw + 1] =
+      0x80000000 | (gl_position_va >> 4); /* RSW_VERTEX_ARRAY */
+   plbu_cmd[last->plbu_cmd_draw] = (merged.count << 24) | merged.start;
+   plbu_cmd[last->plbu_cmd_draw + 1] =
+      ((merged.mode & 0x1F) << 16) | (merged.count >> 8); /* DRAW | DRAW_ARRAYS */
+
+   unsigned count = info->count;
+   u_trim_pipe_prim(info->mode, &count);
+
+   last->mergeable = count == info->count;
+   last->count = merged.count;
+   return true;
+}
+
+static void
+lima_draw_vbo(struct pipe_context *pctx, const struct pipe_draw_info *info)
+{
+   debug_checkpoint();
+
+   struct lima_context *ctx = lima_context(pctx);
+
+   if (!ctx->vs || !ctx->fs_program) {
+      debug_warn_once("no shader, skip draw\n");
+      return;
+   }
+
+   if (!lima_query_render_condition_passes(ctx))
+      return;
+
+   if (info->index_size && info->primitive_restart) {
+      util_draw_vbo_without_prim_restart_cached(pctx, ctx->prim_restart, info);
+      return;
+   }
+
+   struct pipe_draw_info local_info;
+   if (info->index_size && info->max_index == ~0u) {
+      local_info = *info;
+      if (!lima_update_index_bounds(&local_info)) {
+         fprintf(stderr, "lima: map index buffer fail\n");
+         return;
+      }
+      info = &local_info;
+   }
+
+   /* jobs rendering to a texture sampled here have to be done first */
+   lima_flush_sampled_jobs(ctx);
+
+   struct lima_job *job = lima_job_get(ctx);
+   if (!job)
+      return;
+
+   if (!lima_update_vs_state(ctx) || !lima_update_fs_state(ctx, info))
+      return;
+
+   lima_dump_command_stream_print(
+      ctx->vs->bo->map + ctx->vs->bo_offset, ctx->vs->shader_size, false,
+      "add vs at va %x\n", ctx->vs->bo->va + ctx->vs->bo_offset);
+
+   lima_dump_command_stream_print(
+      ctx->fs->bo->map + ctx->fs->bo_offset, ctx->fs->shader_size, false,
+      "add fs at va %x\n", ctx->fs->bo->va + ctx->fs->bo_offset);
+
+   lima_update_submit_bo(ctx, job);
+
+   /* instances are drawn one after the other, each with its own attribute
+    * table for per instance elements, instance id and vertex outputs, the
+    * rest of the state is uploaded for the first one only */
+   if (!lima_merge_draw(ctx, job, info)) {
+      for (unsigned instance = 0; instance < info->instance_count; instance++) {
+         lima_pack_draw(ctx, job, info, instance);
+         ctx->dirty = 0;
+      }
+   }
+   else
+      ctx->stats[LIMA_QUERY_MERGED_DRAWS]++;
+
+   unsigned num_prims = info->instance_count *
+      u_decomposed_prims_for_vertices(info->mode, info->count);
+   job->tile_heap_usage += LIMA_CTX_TILE_HEAP_PRIM_SIZE * num_prims;
+
+   ctx->stats[LIMA_QUERY_DRAW_CALLS]++;
+   ctx->stats[LIMA_QUERY_PRIMITIVES] += num_prims;
+   ctx->stats[LIMA_QUERY_VERTICES] +=
+      (uint64_t)lima_draw_num_vertices(info) * info->instance_count;
+
+   lima_update_damage(ctx, job, info);
+
+   job->resolve |= PIPE_CLEAR_COLOR0;
+   if (job->fb.zsbuf) {
+      struct pipe_depth_stencil_alpha_state *zsa = &ctx->zsa->base;
+      if (zsa->depth.enabled && zsa->depth.writemask)
+         job->resolve |= PIPE_CLEAR_DEPTH;
+      if (zsa->stencil[0].enabled)
+         job->resolve |= PIPE_CLEAR_STENCIL;
+   }
 
    ctx->dirty = 0;
-   ctx->num_draws++;
+   job->num_draws++;
+}
+
+/* There's no way to read back how much of the tile heap a GP job used,
+ * so size it from the number of primitives binned in the frame, and
+ * replace it when it's too small or much larger than needed. The old
+ * bo stays alive until the jobs using it are done. */
+static struct lima_bo *
+lima_update_tile_heap(struct lima_context *ctx, struct lima_job *job)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   struct lima_bo **heap = ctx->tile_heap + job->plb_index;
+   uint32_t size = MAX2(job->tile_heap_usage, LIMA_CTX_TILE_HEAP_MIN_SIZE);
+
+   size = MIN2(util_next_power_of_two(size), LIMA_CTX_TILE_HEAP_MAX_SIZE);
+
+   if (*heap && ((*heap)->size < size || (*heap)->size > size * 4)) {
+      lima_bo_free(*heap);
+      *heap = NULL;
+   }
+
+   if (!*heap)
+      *heap = lima_bo_create(screen, size, 0, false, true);
+
+   return *heap;
 }
 
 static void
-lima_finish_plbu_cmd(struct lima_context *ctx)
+lima_finish_plbu_cmd(struct lima_context *ctx, struct lima_job *job)
 {
    int i = 0;
-   uint32_t *plbu_cmd = util_dynarray_enlarge(&ctx->plbu_cmd_array, 2 * 4);
+   uint32_t *plbu_cmd = util_dynarray_enlarge(&job->plbu_cmd_array, 22 * 4);
+
+   /* jobs without draws still need the PLB set up for the PP job */
+   if (!job->plbu_cmd_array.size)
+      i += lima_pack_plbu_head(ctx, job, plbu_cmd);
 
    plbu_cmd[i++] = 0x00000000;
    plbu_cmd[i++] = 0x50000000; /* END */
 
-   ctx->plbu_cmd_array.size += i * 4;
+   job->plbu_cmd_array.size += i * 4;
 }
 
 static void
-lima_pack_pp_frame_reg(struct lima_context *ctx, uint32_t *frame_reg,
-                       uint32_t *wb_reg)
+lima_pack_pp_frame_reg(struct lima_context *ctx, struct lima_job *job,
+                       uint32_t *frame_reg, uint32_t *wb_reg)
 {
-   struct lima_resource *res = lima_resource(ctx->framebuffer.cbuf->texture);
-   lima_bo_update(res->bo, false, true);
+   struct lima_context_framebuffer *fb = &job->fb;
 
+   /* the tile buffer is 8 bits per channel, the channel layout gives the
+    * bits kept of each one on write back */
+   uint32_t pixel_format = LIMA_PIXEL_FORMAT_BGRA_8888;
+   uint32_t channel_layout = 0x8888;
    bool swap_channels = false;
-   switch (ctx->framebuffer.cbuf->format) {
+   switch (fb->cbuf ? fb->cbuf->format : PIPE_FORMAT_NONE) {
    case PIPE_FORMAT_R8G8B8A8_UNORM:
    case PIPE_FORMAT_R8G8B8X8_UNORM:
       swap_channels = true;
       break;
+   case PIPE_FORMAT_B5G6R5_UNORM:
+      pixel_format = LIMA_PIXEL_FORMAT_BGR_565;
+      channel_layout = 0x8565;
+      break;
+   case PIPE_FORMAT_B5G5R5A1_UNORM:
+      pixel_format = LIMA_PIXEL_FORMAT_BGRA_5551;
+      channel_layout = 0x1555;
+      break;
+   case PIPE_FORMAT_B4G4R4A4_UNORM:
+      pixel_format = LIMA_PIXEL_FORMAT_BGRA_4444;
+      channel_layout = 0x4444;
+      break;
    default:
       break;
    }
@@ -1048,50 +1872,85 @@ lima_pack_pp_frame_reg(struct lima_context *ctx, uint32_t *frame_reg,
    struct lima_screen *screen = lima_screen(ctx->base.screen);
    frame->render_address = screen->pp_buffer->va + pp_frame_rsw_offset;
    frame->flags = 0x02;
-   frame->clear_value_depth = ctx->clear.depth;
-   frame->clear_value_stencil = ctx->clear.stencil;
-   frame->clear_value_color = ctx->clear.color;
-   frame->clear_value_color_1 = ctx->clear.color;
-   frame->clear_value_color_2 = ctx->clear.color;
-   frame->clear_value_color_3 = ctx->clear.color;
+   frame->clear_value_depth = job->clear.depth;
+   frame->clear_value_stencil = job->clear.stencil;
+   frame->clear_value_color = job->clear.color;
+   frame->clear_value_color_1 = job->clear.color;
+   frame->clear_value_color_2 = job->clear.color;
+   frame->clear_value_color_3 = job->clear.color;
    frame->one = 1;
-   frame->supersampled_height = ctx->framebuffer.height * 2 - 1;
+   frame->supersampled_height = fb->height * 2 - 1;
    frame->dubya = 0x77;
    frame->onscreen = 1;
-   frame->blocking = (ctx->framebuffer.shift_max << 28) |
-      (ctx->framebuffer.shift_h << 16) | ctx->framebuffer.shift_w;
+   frame->blocking = (fb->shift_max << 28) |
+      (fb->shift_h << 16) | fb->shift_w;
+   /* the same for 4x MSAA, the tile buffer holds the samples of each
+    * pixel and write back averages them, so the resource only stores the
+    * resolved pixels */
    frame->scale = 0xE0C;
-   frame->foureight = 0x8888;
+   frame->foureight = channel_layout;
+
+   /* every PP job runs alone on the PPs, so the stack reserved in the
+    * screen's pp buffer is shared by all of them */
+   if (job->pp_max_stack_size) {
+      frame->fragment_stack_address = screen->pp_buffer->va + pp_stack_offset;
+      frame->fragment_stack_size =
+         job->pp_max_stack_size << 16 | job->pp_max_stack_size;
+   }
 
    struct lima_pp_wb_reg *wb = (void *)wb_reg;
-   wb[0].type = 0x02; /* 1 for depth, stencil */
-   wb[0].address = res->bo->va;
-   wb[0].pixel_format = 0x03; /* BGRA8888 */
-   wb[0].pitch = res->stride / 8;
-   wb[0].mrt_bits = swap_channels ? 0x4 : 0x0;
+   if (fb->cbuf) {
+      struct lima_resource *res = lima_resource(fb->cbuf->texture);
+      lima_bo_update(res->bo, false, true);
+
+      wb[0].type = 0x02; /* 1 for depth, stencil */
+      unsigned level = fb->cbuf->u.tex.level;
+      wb[0].address = res->bo->va + res->levels[level].offset +
+         fb->cbuf->u.tex.first_layer * res->levels[level].layer_stride;
+      wb[0].pixel_format = pixel_format;
+      wb[0].pitch = res->levels[level].stride / 8;
+      wb[0].mrt_bits = swap_channels ? 0x4 : 0x0;
+   }
+
+   /* the depth and stencil of the tile buffer are 24 and 8 bits, Z16
+    * keeps the upper depth bits, Z24S8 stores them packed like
+    * PIPE_FORMAT_Z24_UNORM_S8_UINT */
+   if (lima_job_writes_zsbuf(job)) {
+      struct lima_resource *zres = lima_resource(fb->zsbuf->texture);
+      unsigned zlevel = fb->zsbuf->u.tex.level;
+
+      wb[1].type = 0x01;
+      wb[1].address = zres->bo->va + zres->levels[zlevel].offset +
+         fb->zsbuf->u.tex.first_layer * zres->levels[zlevel].layer_stride;
+      wb[1].pixel_format = fb->zsbuf->format == PIPE_FORMAT_Z16_UNORM ?
+         LIMA_PIXEL_FORMAT_Z16 : LIMA_PIXEL_FORMAT_Z24S8;
+      wb[1].pitch = zres->levels[zlevel].stride / 8;
+   }
 }
 
 static void
-_lima_flush(struct lima_context *ctx)
+lima_flush_gp(struct lima_context *ctx, struct lima_job *job)
 {
-   lima_finish_plbu_cmd(ctx);
+   lima_finish_plbu_cmd(ctx, job);
 
-   int vs_cmd_size = ctx->vs_cmd_array.size;
-   int plbu_cmd_size = ctx->plbu_cmd_array.size;
+   int vs_cmd_size = job->vs_cmd_array.size;
+   int plbu_cmd_size = job->plbu_cmd_array.size;
+   ctx->stats[LIMA_QUERY_GP_CMD_BYTES] += vs_cmd_size + plbu_cmd_size;
 
    void *vs_cmd =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_vs_cmd, vs_cmd_size,
-                          LIMA_CTX_BUFF_SUBMIT_GP, true);
-   memcpy(vs_cmd, util_dynarray_begin(&ctx->vs_cmd_array), vs_cmd_size);
-   util_dynarray_clear(&ctx->vs_cmd_array);
+      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_vs_cmd, vs_cmd_size, 0);
+   memcpy(vs_cmd, util_dynarray_begin(&job->vs_cmd_array), vs_cmd_size);
+   lima_job_add_bo(job, LIMA_PIPE_GP,
+                   ctx->buffer_state[lima_ctx_buff_gp_vs_cmd].bo,
+                   LIMA_SUBMIT_BO_READ);
 
    void *plbu_cmd =
-      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_plbu_cmd, plbu_cmd_size,
-                          LIMA_CTX_BUFF_SUBMIT_GP, true);
-   memcpy(plbu_cmd, util_dynarray_begin(&ctx->plbu_cmd_array), plbu_cmd_size);
-   util_dynarray_clear(&ctx->plbu_cmd_array);
+      lima_ctx_buff_alloc(ctx, lima_ctx_buff_gp_plbu_cmd, plbu_cmd_size, 0);
+   memcpy(plbu_cmd, util_dynarray_begin(&job->plbu_cmd_array), plbu_cmd_size);
+   lima_job_add_bo(job, LIMA_PIPE_GP,
+                   ctx->buffer_state[lima_ctx_buff_gp_plbu_cmd].bo,
+                   LIMA_SUBMIT_BO_READ);
 
-   struct lima_screen *screen = lima_screen(ctx->base.screen);
    uint32_t vs_cmd_va = lima_ctx_buff_va(ctx, lima_ctx_buff_gp_vs_cmd);
    uint32_t plbu_cmd_va = lima_ctx_buff_va(ctx, lima_ctx_buff_gp_plbu_cmd);
    struct drm_lima_gp_frame gp_frame;
@@ -1100,8 +1959,19 @@ _lima_flush(struct lima_context *ctx)
    gp_frame_reg->vs_cmd_end = vs_cmd_va + vs_cmd_size;
    gp_frame_reg->plbu_cmd_start = plbu_cmd_va;
    gp_frame_reg->plbu_cmd_end = plbu_cmd_va + plbu_cmd_size;
-   gp_frame_reg->tile_heap_start = screen->gp_buffer->va + gp_tile_heap_offset;
-   gp_frame_reg->tile_heap_end = screen->gp_buffer->va + gp_buffer_size;
+
+   struct lima_bo *tile_heap = lima_update_tile_heap(ctx, job);
+   if (tile_heap) {
+      lima_job_add_bo(job, LIMA_PIPE_GP, tile_heap, LIMA_SUBMIT_BO_WRITE);
+      lima_job_add_bo(job, LIMA_PIPE_PP, tile_heap, LIMA_SUBMIT_BO_READ);
+      gp_frame_reg->tile_heap_start = tile_heap->va;
+      gp_frame_reg->tile_heap_end = tile_heap->va + tile_heap->size;
+   }
+   else {
+      fprintf(stderr, "lima: create tile heap fail\n");
+      gp_frame_reg->tile_heap_start = 0;
+      gp_frame_reg->tile_heap_end = 0;
+   }
 
    lima_dump_command_stream_print(
       vs_cmd, vs_cmd_size, false, "flush vs cmd at va %x\n", vs_cmd_va);
@@ -1112,6 +1982,20 @@ _lima_flush(struct lima_context *ctx)
    lima_dump_command_stream_print(
       &gp_frame, sizeof(gp_frame), false, "add gp frame\n");
 
+   /* the GP job writing the PLB has to wait for the PP job of the frame
+    * which used it last, see lima_ctx_plb_next() */
+   struct lima_bo *plb = ctx->plb[job->plb_index];
+   if (!lima_ctx_bo_idle(ctx, plb, true) &&
+       !lima_bo_wait(plb, LIMA_GEM_WAIT_WRITE, 0)) {
+      ctx->plb_stalls++;
+      ctx->stats[LIMA_QUERY_PLB_STALLS]++;
+      ctx->plb_stalled = true;
+      debug_printf("lima: GP waits for PLB %d reuse, %u stalls\n",
+                   job->plb_index, ctx->plb_stalls);
+   }
+
+   lima_job_add_bos_to_submit(job, LIMA_PIPE_GP, ctx->gp_submit);
+   ctx->stats[LIMA_QUERY_SUBMIT_BOS] += job->bos[LIMA_PIPE_GP]->entries;
    if (!lima_submit_start(ctx->gp_submit, &gp_frame, sizeof(gp_frame)))
       fprintf(stderr, "gp submit error\n");
 
@@ -1122,43 +2006,96 @@ _lima_flush(struct lima_context *ctx)
             pos, 4 * 4 * 16, true, "gl_pos dump at va %x\n",
             lima_ctx_buff_va(ctx, lima_ctx_buff_sh_gl_pos));
 
-         lima_bo_update(ctx->plb[ctx->plb_index], true, false);
-         uint32_t *plb = ctx->plb[ctx->plb_index]->map;
+         lima_bo_update(ctx->plb[job->plb_index], true, false);
+         uint32_t *plb = ctx->plb[job->plb_index]->map;
          lima_dump_command_stream_print(
             plb, LIMA_CTX_PLB_BLK_SIZE, false, "plb dump at va %x\n",
-            ctx->plb[ctx->plb_index]->va);
+            ctx->plb[job->plb_index]->va);
       }
       else
          fprintf(stderr, "gp submit wait error\n");
    }
+}
+
+static void
+_lima_flush(struct lima_context *ctx, struct lima_job *job, bool need_sync_fd)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+
+   /* Without draws the PP job only has to clear the tiles, which is done
+    * from the clear values of the frame registers. PP streams of m400
+    * are built here so they can skip calling the polygon lists and the
+    * GP job, the DLBU of m450 always reads the PLB the GP job sets up. */
+   bool pp_only = !job->num_draws && ctx->plb_pp_stream;
+   if (!job->num_draws)
+      lima_update_frame_bo(ctx, job, !pp_only);
+
+   if (!pp_only)
+      lima_flush_gp(ctx, job);
+
+   if (lima_job_writes_zsbuf(job)) {
+      struct lima_resource *zres = lima_resource(job->fb.zsbuf->texture);
+      lima_bo_update(zres->bo, false, true);
+      lima_job_add_bo(job, LIMA_PIPE_PP, zres->bo, LIMA_SUBMIT_BO_WRITE);
+   }
+
+   lima_job_add_bos_to_submit(job, LIMA_PIPE_PP, ctx->pp_submit);
+   ctx->stats[LIMA_QUERY_SUBMIT_BOS] += job->bos[LIMA_PIPE_PP]->entries;
+   if (need_sync_fd)
+      lima_submit_need_sync_fd(ctx->pp_submit);
+
+   if (job->num_draws && job->fb.cbuf)
+      lima_resource(job->fb.cbuf->texture)->plb_usage = job->tile_heap_usage;
+
+   struct pipe_scissor_state *damage = &job->damage;
+   ctx->stats[LIMA_QUERY_JOBS]++;
+   ctx->stats[LIMA_QUERY_PP_TILES] +=
+      (damage->maxx - damage->minx) * (damage->maxy - damage->miny);
+
+   uint32_t stream_va[LIMA_MAX_PP];
+   if (ctx->plb_pp_stream) {
+      struct lima_ctx_plb_pp_stream *s = job->plb_pp_stream;
+      int num_tiles[LIMA_MAX_PP];
+
+      if (lima_job_damage_is_full(job) && !job->tile_cost &&
+          (!job->fine_blocking || pp_only)) {
+         lima_plb_pp_stream_interleave(screen->num_pp,
+                                       job->fb.tiled_w * job->fb.tiled_h,
+                                       num_tiles);
+         for (int i = 0; i < screen->num_pp; i++)
+            stream_va[i] = s->bo->va + s->offset[i];
+      }
+      else
+         lima_update_job_pp_stream(ctx, job, stream_va, num_tiles);
+
+      for (int i = 0; i < screen->num_pp; i++)
+         ctx->stats[LIMA_QUERY_PP0_TILES + i] += num_tiles[i];
+   }
 
    if (screen->gpu_type == LIMA_INFO_GPU_MALI400) {
       struct drm_lima_m400_pp_frame pp_frame = {0};
-      lima_pack_pp_frame_reg(ctx, pp_frame.frame, pp_frame.wb);
+      lima_pack_pp_frame_reg(ctx, job, pp_frame.frame, pp_frame.wb);
       pp_frame.num_pp = screen->num_pp;
-
-      struct lima_ctx_plb_pp_stream *s = ctx->current_plb_pp_stream;
-      for (int i = 0; i < screen->num_pp; i++)
-         pp_frame.plbu_array_address[i] = s->bo->va + s->offset[i];
+      memcpy(pp_frame.plbu_array_address, stream_va,
+             screen->num_pp * sizeof(*stream_va));
 
       lima_dump_command_stream_print(
          &pp_frame, sizeof(pp_frame), false, "add pp frame\n");
 
       if (!lima_submit_start(ctx->pp_submit, &pp_frame, sizeof(pp_frame)))
          fprintf(stderr, "pp submit error\n");
-
-      ctx->current_plb_pp_stream = NULL;
    }
    else {
       struct drm_lima_m450_pp_frame pp_frame = {0};
-      lima_pack_pp_frame_reg(ctx, pp_frame.frame, pp_frame.wb);
+      lima_pack_pp_frame_reg(ctx, job, pp_frame.frame, pp_frame.wb);
 
-      struct lima_context_framebuffer *fb = &ctx->framebuffer;
-      pp_frame.dlbu_regs[0] = ctx->plb[ctx->plb_index]->va;
+      struct lima_context_framebuffer *fb = &job->fb;
+      pp_frame.dlbu_regs[0] = ctx->plb[job->plb_index]->va;
       pp_frame.dlbu_regs[1] = ((fb->tiled_h - 1) << 16) | (fb->tiled_w - 1);
       unsigned s = util_logbase2(LIMA_CTX_PLB_BLK_SIZE) - 7;
       pp_frame.dlbu_regs[2] = (s << 28) | (fb->shift_h << 16) | fb->shift_w;
-      pp_frame.dlbu_regs[3] = ((fb->tiled_h - 1) << 24) | ((fb->tiled_w - 1) << 16);
+      pp_frame.dlbu_regs[3] = ((damage->maxy - 1) << 24) | ((damage->maxx - 1) << 16) |
+         (damage->miny << 8) | damage->minx;
 
       lima_dump_command_stream_print(
          &pp_frame, sizeof(pp_frame), false, "add pp frame\n");
@@ -1167,19 +2104,140 @@ _lima_flush(struct lima_context *ctx)
          fprintf(stderr, "pp submit error\n");
    }
 
-   ctx->num_draws = 0;
-   ctx->plb_index = (ctx->plb_index + 1) % lima_ctx_num_plb;
+   lima_job_free(ctx, job);
+}
+
+/* submit every pending job, the ones without draws or clear are just
+ * dropped, returns false if there was nothing to submit */
+static bool
+lima_flush_jobs(struct lima_context *ctx, bool need_sync_fd)
+{
+   struct lima_job *last = NULL;
+
+   list_for_each_entry(struct lima_job, job, &ctx->job_list, link) {
+      if (lima_job_has_work(job))
+         last = job;
+   }
+
+   if (!last) {
+      lima_job_fini(ctx);
+      lima_fence_signal_deferred(ctx);
+      return false;
+   }
+
+   /* in creation order, fence is created from the last PP submit */
+   list_for_each_entry_safe(struct lima_job, job, &ctx->job_list, link) {
+      if (lima_job_has_work(job))
+         _lima_flush(ctx, job, job == last && need_sync_fd);
+      else
+         lima_job_free(ctx, job);
+   }
+   lima_fence_signal_deferred(ctx);
+
+   /* the full upload buffers get reused once the jobs are done with them,
+    * only needed once per buffer so waiting for the submit is fine */
+   if (ctx->uploader && u_upload_needs_fence(ctx->uploader)) {
+      struct pipe_fence_handle *fence = lima_fence_create(ctx, -1);
+      if (fence) {
+         u_upload_fence(ctx->uploader, fence);
+         ctx->base.screen->fence_reference(ctx->base.screen, &fence, NULL);
+      }
+   }
+   return true;
+}
+
+/* submit the jobs rendering to res if there're some pending, the job of
+ * the current framebuffer only if asked */
+void
+lima_flush_job_writing_resource(struct lima_context *ctx,
+                                struct pipe_resource *prsc, bool current)
+{
+   list_for_each_entry_safe(struct lima_job, job, &ctx->job_list, link) {
+      if (!lima_job_has_work(job) || (job == ctx->job && !current))
+         continue;
+
+      if ((job->fb.cbuf && job->fb.cbuf->texture == prsc) ||
+          (job->fb.zsbuf && job->fb.zsbuf->texture == prsc)) {
+         ctx->stats[LIMA_QUERY_RESOURCE_FLUSHES]++;
+         _lima_flush(ctx, job, false);
+      }
+   }
+}
+
+/* submit the other jobs which read or write bo, before a job starts to
+ * render to it */
+void
+lima_flush_job_using_bo(struct lima_context *ctx, struct lima_bo *bo,
+                        struct lima_job *except)
+{
+   if (!p_atomic_read(&bo->pending_jobs))
+      return;
+
+   list_for_each_entry_safe(struct lima_job, job, &ctx->job_list, link) {
+      if (job != except && lima_job_has_work(job) &&
+          lima_job_has_bo(job, bo, true)) {
+         ctx->stats[LIMA_QUERY_RESOURCE_FLUSHES]++;
+         _lima_flush(ctx, job, false);
+      }
+   }
+}
+
+static void
+lima_flush_sampled_jobs(struct lima_context *ctx)
+{
+   struct lima_texture_stateobj *lima_tex = &ctx->tex_stateobj;
+
+   for (int i = 0; i < lima_tex->num_textures; i++) {
+      if (lima_tex->textures[i])
+         lima_flush_job_writing_resource(ctx, lima_tex->textures[i]->texture,
+                                         false);
+   }
 }
 
 void
 lima_flush(struct lima_context *ctx)
 {
-   if (!ctx->num_draws) {
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   int64_t trace_begin = lima_trace_begin(screen);
+
+   if (!lima_flush_jobs(ctx, false))
       debug_printf("%s: do nothing\n", __FUNCTION__);
-      return;
+
+   /* callers flush to wait for the bos of the jobs afterwards */
+   lima_submit_queue_finish(ctx);
+
+   lima_trace_end(screen, "flush", trace_begin);
+}
+
+/* The frames queued on the GPU make for the latency of the app, bounded
+ * by the max_frames_in_flight throttling of the window system code. */
+static void
+lima_end_frame(struct lima_context *ctx)
+{
+   unsigned num_frames = MIN2(ctx->num_frames, LIMA_MAX_QUEUED_FRAMES);
+   uint32_t seqno;
+
+   for (unsigned i = 0; i < num_frames; i++) {
+      if (!lima_submit_seqno_signalled(ctx->pp_submit, ctx->frame_seqno[i]))
+         ctx->stats[LIMA_QUERY_QUEUED_FRAMES]++;
    }
 
-   _lima_flush(ctx);
+   if (lima_submit_get_fence(ctx->pp_submit, &seqno)) {
+      ctx->frame_seqno[ctx->num_frames++ % LIMA_MAX_QUEUED_FRAMES] = seqno;
+      ctx->stats[LIMA_QUERY_FRAMES]++;
+   }
+}
+
+static bool
+lima_has_pending_jobs(struct lima_context *ctx)
+{
+   struct hash_entry *entry;
+
+   hash_table_foreach(ctx->jobs, entry) {
+      if (lima_job_has_work(entry->data))
+         return true;
+   }
+   return false;
 }
 
 static void
@@ -1189,15 +2247,50 @@ lima_pipe_flush(struct pipe_context *pctx, struct pipe_fence_handle **fence,
    debug_printf("%s: flags=%x\n", __FUNCTION__, flags);
 
    struct lima_context *ctx = lima_context(pctx);
-   if (!ctx->num_draws) {
-      debug_printf("%s: do nothing\n", __FUNCTION__);
+   struct lima_screen *screen = lima_screen(pctx->screen);
+   bool fence_fd = (flags & PIPE_FLUSH_FENCE_FD) && fence;
+
+   /* the fence of a deferred flush gets the submit of the next flush, so
+    * glFenceSync() doesn't split the frame in more GP/PP jobs; a sync fd
+    * only comes with the submit */
+   if ((flags & PIPE_FLUSH_DEFERRED) && !fence_fd &&
+       lima_has_pending_jobs(ctx)) {
+      if (fence) {
+         if (!(flags & TC_FLUSH_ASYNC))
+            *fence = lima_fence_create_unflushed(pctx, NULL);
+         if (*fence)
+            lima_fence_defer(ctx, *fence);
+      }
       return;
    }
 
-   if ((flags & PIPE_FLUSH_FENCE_FD) && fence)
-      lima_submit_need_sync_fd(ctx->pp_submit);
+   int64_t trace_begin = lima_trace_begin(screen);
+   bool flushed = lima_flush_jobs(ctx, fence_fd);
+   lima_trace_end(screen, "flush", trace_begin);
+
+   if (flushed) {
+      ctx->stats[LIMA_QUERY_FLUSHES]++;
+      if (flags & PIPE_FLUSH_END_OF_FRAME)
+         lima_end_frame(ctx);
+   }
 
-   _lima_flush(ctx);
+   /* the threaded context created the fence before handing the flush to
+    * the driver thread, it has to be signalled even without any job */
+   if (flags & TC_FLUSH_ASYNC) {
+      if (fence)
+         lima_fence_signal(*fence, flushed ?
+                           lima_submit_get_sync_fd(ctx->pp_submit) : -1);
+      return;
+   }
+
+   if (!flushed) {
+      debug_printf("%s: do nothing\n", __FUNCTION__);
+
+      /* the fence of the jobs already submitted, none if they're done */
+      if (fence && !fence_fd)
+         *fence = lima_fence_create(ctx, -1);
+      return;
+   }
 
    if (fence)
       *fence = lima_fence_create(ctx, lima_submit_get_sync_fd(ctx->pp_submit));
@@ -1207,6 +2300,8 @@ void
 lima_draw_init(struct lima_context *ctx)
 {
    ctx->base.clear = lima_clear;
+   ctx->base.clear_render_target = lima_clear_render_target;
+   ctx->base.clear_depth_stencil = lima_clear_depth_stencil;
    ctx->base.draw_vbo = lima_draw_vbo;
    ctx->base.flush = lima_pipe_flush;
 }
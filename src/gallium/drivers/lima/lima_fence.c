@@ -26,6 +26,9 @@
 
 #include <util/u_memory.h>
 #include <util/u_inlines.h>
+#include <util/u_queue.h>
+#include <util/u_threaded_context.h>
+#include <util/os_time.h>
 
 #include "lima_drm.h"
 
@@ -33,12 +36,20 @@
 #include "lima_context.h"
 #include "lima_fence.h"
 #include "lima_submit.h"
+#include "lima_trace.h"
 
 struct pipe_fence_handle {
    struct pipe_reference reference;
    struct lima_context *ctx;
    uint32_t seqno;
    int sync_fd;
+   /* no job was pending when it got signalled */
+   bool idle;
+
+   /* fences of asynchronous flushes of the threaded context are created
+    * before the flush in the driver thread fills them */
+   struct util_queue_fence ready;
+   struct tc_unflushed_batch_token *tc_token;
 };
 
 static void
@@ -62,6 +73,16 @@ lima_fence_server_sync(struct pipe_context *pctx,
    struct lima_context *ctx = lima_context(pctx);
    union drm_lima_gem_submit_dep dep;
 
+   /* the jobs of a context run in order, which a deferred fence of this
+    * context still waiting for its flush also relies on */
+   if (fence->ctx == ctx)
+      return;
+
+   /* flushes are executed in order in the driver thread */
+   util_queue_fence_wait(&fence->ready);
+   if (fence->idle)
+      return;
+
    if (fence->sync_fd >= 0) {
       dep.type = LIMA_SUBMIT_DEP_SYNC_FD;
       dep.sync_fd.fd = fence->sync_fd;
@@ -97,15 +118,83 @@ lima_fence_create(struct lima_context *ctx, int sync_fd)
 
    pipe_reference_init(&fence->reference, 1);
    fence->ctx = ctx;
+   util_queue_fence_init(&fence->ready);
+
+   if (!lima_fence_signal(fence, sync_fd)) {
+      util_queue_fence_destroy(&fence->ready);
+      FREE(fence);
+      return NULL;
+   }
+
+   return fence;
+}
+
+/* create_fence callback of the threaded context, called outside of the
+ * driver thread so only store the context, also the fence of deferred
+ * flushes without a token */
+struct pipe_fence_handle *
+lima_fence_create_unflushed(struct pipe_context *pctx,
+                            struct tc_unflushed_batch_token *token)
+{
+   struct pipe_fence_handle *fence;
+
+   fence = CALLOC_STRUCT(pipe_fence_handle);
+   if (!fence)
+      return NULL;
+
+   pipe_reference_init(&fence->reference, 1);
+   fence->ctx = lima_context(pctx);
+   fence->sync_fd = -1;
+   util_queue_fence_init(&fence->ready);
+   util_queue_fence_reset(&fence->ready);
+   tc_unflushed_batch_token_reference(&fence->tc_token, token);
+
+   return fence;
+}
+
+/* point the fence to the last PP submit, false if there's none */
+bool
+lima_fence_signal(struct pipe_fence_handle *fence, int sync_fd)
+{
+   bool ret = true;
+
    fence->sync_fd = sync_fd;
    if (sync_fd < 0) {
-      if (!lima_submit_get_fence(ctx->pp_submit, &fence->seqno)) {
-         FREE(fence);
-         return NULL;
-      }
+      ret = lima_submit_get_fence(fence->ctx->pp_submit, &fence->seqno);
+      fence->idle = !ret;
    }
 
-   return fence;
+   util_queue_fence_signal(&fence->ready);
+   tc_unflushed_batch_token_reference(&fence->tc_token, NULL);
+
+   return ret;
+}
+
+/* a deferred flush of the context only holds the fence, the jobs stay
+ * pending for the following draws */
+void
+lima_fence_defer(struct lima_context *ctx, struct pipe_fence_handle *fence)
+{
+   struct pipe_fence_handle *ref = NULL;
+
+   ctx->base.screen->fence_reference(ctx->base.screen, &ref, fence);
+   util_dynarray_append(&ctx->deferred_fences, struct pipe_fence_handle *,
+                        ref);
+}
+
+/* once every pending job is submitted, their fences are the one of the
+ * last PP submit */
+void
+lima_fence_signal_deferred(struct lima_context *ctx)
+{
+   struct pipe_screen *screen = ctx->base.screen;
+
+   util_dynarray_foreach(&ctx->deferred_fences, struct pipe_fence_handle *,
+                         fence) {
+      lima_fence_signal(*fence, -1);
+      screen->fence_reference(screen, fence, NULL);
+   }
+   util_dynarray_clear(&ctx->deferred_fences);
 }
 
 static int
@@ -114,6 +203,8 @@ lima_fence_get_fd(struct pipe_screen *pscreen,
 {
    debug_checkpoint();
 
+   util_queue_fence_wait(&fence->ready);
+
    assert(fence->sync_fd >= 0);
    return dup(fence->sync_fd);
 }
@@ -123,6 +214,8 @@ lima_fence_destroy(struct pipe_fence_handle *fence)
 {
    if (fence->sync_fd >= 0)
       close(fence->sync_fd);
+   tc_unflushed_batch_token_reference(&fence->tc_token, NULL);
+   util_queue_fence_destroy(&fence->ready);
    FREE(fence);
 }
 
@@ -138,11 +231,40 @@ lima_fence_reference(struct pipe_screen *pscreen,
    *ptr = fence;
 }
 
-static boolean
-lima_fence_finish(struct pipe_screen *pscreen, struct pipe_context *pctx,
-                  struct pipe_fence_handle *fence, uint64_t timeout)
+static bool
+lima_fence_wait(struct pipe_context *pctx, struct pipe_fence_handle *fence,
+                uint64_t timeout)
 {
-   debug_checkpoint();
+   if (!util_queue_fence_is_signalled(&fence->ready)) {
+      struct tc_unflushed_batch_token *token = fence->tc_token;
+
+      /* the flush filling the fence may still be in an unsubmitted batch
+       * of the threaded context, or be a deferred flush, which only the
+       * next flush of the lima context submits. Executing the batch
+       * clears token->tc while the flush stays deferred, so the own
+       * context, behind the threaded one or not, is always flushed */
+      if (pctx && threaded_context_unwrap_unsync(pctx) == &fence->ctx->base)
+         pctx->flush(pctx, NULL, timeout ? 0 : PIPE_FLUSH_ASYNC);
+      else if (token && pctx)
+         threaded_context_flush(pctx, token, timeout == 0);
+
+      if (!timeout)
+         return false;
+
+      if (timeout == PIPE_TIMEOUT_INFINITE)
+         util_queue_fence_wait(&fence->ready);
+      else {
+         int64_t abs_timeout = os_time_get_absolute_timeout(timeout);
+         if (!util_queue_fence_wait_timeout(&fence->ready, abs_timeout))
+            return false;
+
+         int64_t time = os_time_get_nano();
+         timeout = abs_timeout > time ? abs_timeout - time : 0;
+      }
+   }
+
+   if (fence->idle)
+      return true;
 
    if (fence->sync_fd >= 0) {
       debug_printf("wait sync fd %d\n", fence->sync_fd);
@@ -153,6 +275,23 @@ lima_fence_finish(struct pipe_screen *pscreen, struct pipe_context *pctx,
    return lima_submit_wait_fence(fence->ctx->pp_submit, fence->seqno, timeout);
 }
 
+static boolean
+lima_fence_finish(struct pipe_screen *pscreen, struct pipe_context *pctx,
+                  struct pipe_fence_handle *fence, uint64_t timeout)
+{
+   debug_checkpoint();
+
+   struct lima_screen *screen = lima_screen(pscreen);
+   int64_t trace_begin = lima_trace_begin(screen);
+
+   bool ret = lima_fence_wait(pctx, fence, timeout);
+
+   /* polls don't stall */
+   if (timeout)
+      lima_trace_end(screen, "fence finish", trace_begin);
+   return ret;
+}
+
 void
 lima_fence_screen_init(struct lima_screen *screen)
 {
@@ -25,12 +25,23 @@
 #ifndef H_LIMA_FENCE
 #define H_LIMA_FENCE
 
+#include <stdbool.h>
+
 struct pipe_fence_handle;
+struct pipe_context;
 struct lima_context;
 struct lima_screen;
+struct tc_unflushed_batch_token;
 
 struct pipe_fence_handle *
 lima_fence_create(struct lima_context *ctx, int sync_fd);
+struct pipe_fence_handle *
+lima_fence_create_unflushed(struct pipe_context *pctx,
+                            struct tc_unflushed_batch_token *token);
+bool lima_fence_signal(struct pipe_fence_handle *fence, int sync_fd);
+void lima_fence_defer(struct lima_context *ctx,
+                      struct pipe_fence_handle *fence);
+void lima_fence_signal_deferred(struct lima_context *ctx);
 
 void lima_fence_screen_init(struct lima_screen *screen);
 void lima_fence_context_init(struct lima_context *ctx);
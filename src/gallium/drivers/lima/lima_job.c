@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "util/ralloc.h"
+#include "util/hash_table.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+
+#include "lima_context.h"
+#include "lima_screen.h"
+#include "lima_job.h"
+#include "lima_bo.h"
+#include "lima_resource.h"
+#include "lima_submit.h"
+
+#include <lima_drm.h>
+
+static uint32_t
+lima_job_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct lima_job_key));
+}
+
+static bool
+lima_job_key_compare(const void *key1, const void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct lima_job_key)) == 0;
+}
+
+bool
+lima_job_init(struct lima_context *ctx)
+{
+   list_inithead(&ctx->job_list);
+   ctx->jobs = _mesa_hash_table_create(ctx, lima_job_key_hash,
+                                       lima_job_key_compare);
+   return ctx->jobs != NULL;
+}
+
+void
+lima_job_fini(struct lima_context *ctx)
+{
+   if (!ctx->jobs)
+      return;
+
+   list_for_each_entry_safe(struct lima_job, job, &ctx->job_list, link)
+      lima_job_free(ctx, job);
+}
+
+/* Tiles sharing a polygon list all run the primitives of the list, so
+ * fewer tiles per block cut the PP work on primitives outside of the
+ * tile. A frame whose lists filled a quarter of the blocks of the finer
+ * grouping at most last time gets it, busier frames keep the grouping
+ * of the framebuffer rather than overflowing more blocks to the tile
+ * heap. */
+static void
+lima_job_choose_blocking(struct lima_context *ctx, struct lima_job *job)
+{
+   struct lima_context_framebuffer *fb = &job->fb;
+   uint32_t usage = lima_resource(fb->cbuf->texture)->plb_usage;
+
+   if (!usage || fb->block_w * fb->block_h == fb->tiled_w * fb->tiled_h)
+      return;
+
+   struct lima_context_framebuffer fine = *fb;
+   lima_ctx_fb_blocking(&fine, ctx->plb_fine_max_blk);
+
+   unsigned num_blk = fine.block_w * fine.block_h;
+   if (num_blk == fb->block_w * fb->block_h ||
+       usage > num_blk * LIMA_CTX_PLB_BLK_SIZE / 4)
+      return;
+
+   if (!lima_ctx_plb_grow(ctx, job->plb_index, num_blk))
+      return;
+
+   fb->shift_w = fine.shift_w;
+   fb->shift_h = fine.shift_h;
+   fb->block_w = fine.block_w;
+   fb->block_h = fine.block_h;
+   fb->shift_max = fine.shift_max;
+   job->fine_blocking = true;
+}
+
+static struct lima_job *
+lima_job_create(struct lima_context *ctx)
+{
+   struct lima_job *job = rzalloc(ctx, struct lima_job);
+   if (!job)
+      return NULL;
+
+   if (!lima_ctx_plb_next(ctx, &job->plb_index)) {
+      ralloc_free(job);
+      return NULL;
+   }
+
+   for (int i = 0; i < ARRAY_SIZE(job->bos); i++) {
+      job->bos[i] = _mesa_hash_table_create(job, _mesa_hash_pointer,
+                                            _mesa_key_pointer_equal);
+      if (!job->bos[i]) {
+         ralloc_free(job);
+         return NULL;
+      }
+   }
+
+   util_dynarray_init(&job->vs_cmd_array, job);
+   util_dynarray_init(&job->plbu_cmd_array, job);
+
+   job->fb = ctx->framebuffer;
+   job->fb.cbuf = NULL;
+   job->fb.zsbuf = NULL;
+   pipe_surface_reference(&job->fb.cbuf, ctx->framebuffer.cbuf);
+   pipe_surface_reference(&job->fb.zsbuf, ctx->framebuffer.zsbuf);
+
+   job->key.cbuf = job->fb.cbuf;
+   job->key.zsbuf = job->fb.zsbuf;
+
+   if (job->fb.cbuf)
+      lima_job_choose_blocking(ctx, job);
+
+   /* empty damage */
+   job->damage.minx = job->fb.tiled_w;
+   job->damage.miny = job->fb.tiled_h;
+
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   if (lima_pp_balance && ctx->plb_pp_stream && screen->num_pp > 1) {
+      job->tile_cost = rzalloc_array(job, uint32_t,
+                                     (job->fb.tiled_w + 1) * (job->fb.tiled_h + 1));
+      if (!job->tile_cost) {
+         ralloc_free(job);
+         return NULL;
+      }
+   }
+
+   /* before any clear of this job, keep the last clear values */
+   job->clear = ctx->clear;
+   job->clear.buffers = 0;
+
+   _mesa_hash_table_insert(ctx->jobs, &job->key, job);
+   list_addtail(&job->link, &ctx->job_list);
+   return job;
+}
+
+struct lima_job *
+lima_job_get(struct lima_context *ctx)
+{
+   if (ctx->job)
+      return ctx->job;
+
+   struct lima_job_key key = {
+      .cbuf = ctx->framebuffer.cbuf,
+      .zsbuf = ctx->framebuffer.zsbuf,
+   };
+
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->jobs, &key);
+   struct lima_job *job = entry ? entry->data : lima_job_create(ctx);
+   if (!job)
+      return NULL;
+
+   /* the jobs submitted before this one still have to read what it
+    * overwrites, and write what it renders on top of */
+   if (job->fb.cbuf)
+      lima_flush_job_using_bo(ctx, lima_resource(job->fb.cbuf->texture)->bo, job);
+   if (job->fb.zsbuf)
+      lima_flush_job_using_bo(ctx, lima_resource(job->fb.zsbuf->texture)->bo, job);
+
+   ctx->job = job;
+
+   /* state kept in ctx buffs and texture descriptors from before the
+    * switch references bos this job doesn't know about yet */
+   lima_ctx_buff_submit(ctx);
+   ctx->dirty |= LIMA_CONTEXT_DIRTY_TEXTURES;
+
+   return job;
+}
+
+void
+lima_job_free(struct lima_context *ctx, struct lima_job *job)
+{
+   if (ctx->job == job)
+      ctx->job = NULL;
+
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->jobs, &job->key);
+   if (entry)
+      _mesa_hash_table_remove(ctx->jobs, entry);
+   list_del(&job->link);
+
+   for (int i = 0; i < ARRAY_SIZE(job->bos); i++) {
+      hash_table_foreach(job->bos[i], entry) {
+         struct lima_bo *bo = (struct lima_bo *)entry->key;
+         p_atomic_dec(&bo->pending_jobs);
+         lima_bo_free(bo);
+      }
+   }
+
+   pipe_surface_reference(&job->fb.cbuf, NULL);
+   pipe_surface_reference(&job->fb.zsbuf, NULL);
+
+   ralloc_free(job);
+}
+
+void
+lima_job_add_bo(struct lima_job *job, int pipe, struct lima_bo *bo,
+                uint32_t flags)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(job->bos[pipe], bo);
+   if (entry) {
+      entry->data = (void *)((uintptr_t)entry->data | flags);
+      return;
+   }
+
+   /* the bo must stay around until the job is submitted */
+   lima_bo_reference(bo);
+   p_atomic_inc(&bo->pending_jobs);
+   _mesa_hash_table_insert(job->bos[pipe], bo, (void *)(uintptr_t)flags);
+}
+
+bool
+lima_job_has_bo(struct lima_job *job, struct lima_bo *bo, bool all)
+{
+   for (int i = 0; i < ARRAY_SIZE(job->bos); i++) {
+      struct hash_entry *entry = _mesa_hash_table_search(job->bos[i], bo);
+      if (!entry)
+         continue;
+
+      if (all || ((uintptr_t)entry->data & LIMA_SUBMIT_BO_WRITE))
+         return true;
+   }
+
+   return false;
+}
+
+void
+lima_job_add_bos_to_submit(struct lima_job *job, int pipe,
+                           struct lima_submit *submit)
+{
+   struct hash_entry *entry;
+   hash_table_foreach(job->bos[pipe], entry)
+      lima_submit_add_bo(submit, (struct lima_bo *)entry->key,
+                         (uintptr_t)entry->data);
+}
+
+/* drop the pending writes of pending jobs to an invalidated attachment */
+void
+lima_job_invalidate_resource(struct lima_context *ctx,
+                             struct pipe_resource *prsc)
+{
+   struct hash_entry *entry;
+   hash_table_foreach(ctx->jobs, entry) {
+      struct lima_job *job = entry->data;
+
+      if (job->fb.cbuf && job->fb.cbuf->texture == prsc)
+         job->resolve &= ~PIPE_CLEAR_COLOR0;
+
+      if (job->fb.zsbuf && job->fb.zsbuf->texture == prsc)
+         job->resolve &= ~PIPE_CLEAR_DEPTHSTENCIL;
+   }
+}
+
+/* extend the damage of the job with a rect in pixels, adding cost to
+ * each of its tiles */
+void
+lima_job_add_damage(struct lima_job *job, int minx, int miny,
+                    int maxx, int maxy, unsigned cost)
+{
+   struct lima_context_framebuffer *fb = &job->fb;
+
+   minx = CLAMP(minx, 0, fb->width) >> 4;
+   miny = CLAMP(miny, 0, fb->height) >> 4;
+   maxx = align(CLAMP(maxx, 0, fb->width), 16) >> 4;
+   maxy = align(CLAMP(maxy, 0, fb->height), 16) >> 4;
+
+   /* what's outside of the damage region of the frame is left alone */
+   if (fb->cbuf) {
+      struct lima_resource *res = lima_resource(fb->cbuf->texture);
+      if (res->has_damage) {
+         minx = MAX2(minx, res->damage.minx);
+         miny = MAX2(miny, res->damage.miny);
+         maxx = MIN2(maxx, res->damage.maxx);
+         maxy = MIN2(maxy, res->damage.maxy);
+      }
+   }
+
+   if (minx >= maxx || miny >= maxy)
+      return;
+
+   job->damage.minx = MIN2(job->damage.minx, minx);
+   job->damage.miny = MIN2(job->damage.miny, miny);
+   job->damage.maxx = MAX2(job->damage.maxx, maxx);
+   job->damage.maxy = MAX2(job->damage.maxy, maxy);
+
+   if (job->tile_cost && cost) {
+      int stride = fb->tiled_w + 1;
+      job->tile_cost[miny * stride + minx] += cost;
+      job->tile_cost[miny * stride + maxx] -= cost;
+      job->tile_cost[maxy * stride + minx] -= cost;
+      job->tile_cost[maxy * stride + maxx] += cost;
+   }
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef H_LIMA_JOB
+#define H_LIMA_JOB
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/list.h"
+#include "util/u_dynarray.h"
+
+#include "lima_context.h"
+
+struct lima_bo;
+struct lima_submit;
+struct hash_table;
+
+struct lima_job_key {
+   struct pipe_surface *cbuf;
+   struct pipe_surface *zsbuf;
+};
+
+/* PLBU state set by the commands already in plbu_cmd_array */
+struct lima_job_plbu_state {
+   uint32_t primitive_setup;
+   uint32_t scissor[2];
+   bool depth_range;
+   uint32_t depth_near;
+   uint32_t depth_far;
+   bool unknown_10a;
+   bool prim_size_set;
+   uint32_t prim_size;
+};
+
+/* the last draw of a job, which a following draw can be merged into */
+struct lima_job_draw {
+   bool mergeable;
+   unsigned mode;
+   unsigned start;
+   unsigned count;
+
+   /* word indices of its commands in the command arrays */
+   unsigned vs_cmd_varyings;
+   unsigned vs_cmd_draw;
+   unsigned plbu_cmd_rsw;
+   unsigned plbu_cmd_draw;
+};
+
+/* All the work recorded for one framebuffer until it's flushed, a GP
+ * and a PP job once submitted. Switching framebuffers resumes the job
+ * of the new one instead of flushing the current one. */
+struct lima_job {
+   struct lima_job_key key;
+   /* link in lima_context::job_list */
+   struct list_head link;
+
+   /* holds references to the surfaces */
+   struct lima_context_framebuffer fb;
+   struct lima_context_clear clear;
+
+   /* PIPE_CLEAR_* buffers cleared or drawn to and not invalidated since,
+    * only their tile content has to be written back */
+   unsigned resolve;
+
+   /* tiles the job can touch, tile content outside of them is kept */
+   struct pipe_scissor_state damage;
+
+   /* difference array of the estimated cost of each tile, tiled_w + 1
+    * per row, only when balancing the tiles among m400 PPs */
+   uint32_t *tile_cost;
+
+   struct util_dynarray vs_cmd_array;
+   struct util_dynarray plbu_cmd_array;
+   unsigned num_draws;
+
+   struct lima_job_plbu_state plbu_state;
+   struct lima_job_draw last_draw;
+
+   uint32_t plb_index;
+   /* finer tile grouping than the framebuffer one, the full framebuffer
+    * PP streams of m400 don't apply */
+   bool fine_blocking;
+   struct lima_ctx_plb_pp_stream *plb_pp_stream;
+   /* PP stack vec4 slots per thread the fs of the draws spill to */
+   int pp_max_stack_size;
+   uint32_t tile_heap_usage;
+
+   /* bo -> LIMA_SUBMIT_BO_* flags for each pipe, holding a bo reference */
+   struct hash_table *bos[2];
+
+   /* ctx buff bo already added to this job and for which pipes */
+   struct lima_bo *buff_bo;
+   unsigned buff_bo_submit;
+};
+
+/* depth and stencil are only written back when a draw or clear left
+ * them valid and nothing invalidated them, so a depth buffer which is
+ * never read costs no memory traffic */
+static inline bool
+lima_job_writes_zsbuf(struct lima_job *job)
+{
+   return job->fb.zsbuf && (job->resolve & PIPE_CLEAR_DEPTHSTENCIL);
+}
+
+/* the PP job writes back the color buffer and the depth stencil buffer
+ * left valid, a job with neither cleared or drawn to since, or with them
+ * invalidated, has no result */
+static inline bool
+lima_job_has_work(struct lima_job *job)
+{
+   bool color = job->fb.cbuf && (job->resolve & PIPE_CLEAR_COLOR0);
+   return (color || lima_job_writes_zsbuf(job)) &&
+      job->damage.minx < job->damage.maxx &&
+      job->damage.miny < job->damage.maxy;
+}
+
+static inline bool
+lima_job_damage_is_full(struct lima_job *job)
+{
+   return !job->damage.minx && !job->damage.miny &&
+      job->damage.maxx == job->fb.tiled_w &&
+      job->damage.maxy == job->fb.tiled_h;
+}
+
+void lima_job_add_damage(struct lima_job *job, int minx, int miny,
+                         int maxx, int maxy, unsigned cost);
+
+bool lima_job_init(struct lima_context *ctx);
+void lima_job_fini(struct lima_context *ctx);
+
+struct lima_job *lima_job_get(struct lima_context *ctx);
+void lima_job_free(struct lima_context *ctx, struct lima_job *job);
+
+void lima_job_add_bo(struct lima_job *job, int pipe, struct lima_bo *bo,
+                     uint32_t flags);
+bool lima_job_has_bo(struct lima_job *job, struct lima_bo *bo, bool all);
+void lima_job_add_bos_to_submit(struct lima_job *job, int pipe,
+                                struct lima_submit *submit);
+void lima_job_invalidate_resource(struct lima_context *ctx,
+                                  struct pipe_resource *prsc);
+
+#endif
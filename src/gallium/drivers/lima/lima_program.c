@@ -25,9 +25,21 @@
 #include "util/u_memory.h"
 #include "util/ralloc.h"
 #include "util/u_debug.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+#include "util/disk_cache.h"
+#include "util/os_time.h"
+#include "util/hash_table.h"
+#include "util/mesa-sha1.h"
+#include "compiler/blob.h"
 
 #include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_from_mesa.h"
 #include "compiler/nir/nir.h"
+#include "compiler/nir/nir_builder.h"
+#include "compiler/nir/nir_serialize.h"
 #include "nir/tgsi_to_nir.h"
 
 #include "pipe/p_state.h"
@@ -36,21 +48,38 @@
 #include "lima_context.h"
 #include "lima_program.h"
 #include "lima_bo.h"
+#include "lima_texture.h"
 #include "ir/lima_ir.h"
 
+/* the gp has no flow control, an if or a loop left fails the compile so
+ * every if is flattened and every loop with a known trip count unrolled */
 static const nir_shader_compiler_options vs_nir_options = {
    .lower_ffma = true,
+   .lower_flrp32 = true,
    .lower_fpow = true,
    .lower_ffract = true,
    .lower_fdiv = true,
+   .lower_fsat = true,
    .lower_fsqrt = true,
    .lower_sub = true,
+   .max_unroll_iterations = 128,
+   .max_unroll_instructions = 4096,
+   .max_select_flatten_cost = UINT_MAX,
 };
 
+/* mul and add are kept apart for the pp, ppir puts them in one instr
+ * with the vec mul result piped to the vec add. Branches are expensive on
+ * the pp, short loops are unrolled and ifs of up to 32 alu ops run both
+ * sides and sel the result */
 static const nir_shader_compiler_options fs_nir_options = {
+   .lower_ffma = true,
+   .lower_flrp32 = true,
    .lower_fpow = true,
    .lower_fdiv = true,
    .lower_sub = true,
+   .max_unroll_iterations = 32,
+   .max_unroll_instructions = 1024,
+   .max_select_flatten_cost = 32,
 };
 
 const void *
@@ -75,7 +104,7 @@ type_size(const struct glsl_type *type)
 static void
 lima_program_optimize_vs_nir(struct nir_shader *s)
 {
-   bool progress;
+   nir_pass_loop loop;
 
    NIR_PASS_V(s, nir_opt_global_to_local);
    NIR_PASS_V(s, nir_lower_regs_to_ssa);
@@ -83,26 +112,27 @@ lima_program_optimize_vs_nir(struct nir_shader *s)
    NIR_PASS_V(s, nir_lower_io_to_scalar,
               nir_var_shader_in|nir_var_shader_out|nir_var_uniform);
 
-   do {
-      progress = false;
-
-      NIR_PASS_V(s, nir_lower_vars_to_ssa);
-      NIR_PASS(progress, s, nir_lower_alu_to_scalar);
-      NIR_PASS(progress, s, nir_lower_phis_to_scalar);
-      NIR_PASS(progress, s, nir_copy_prop);
-      NIR_PASS(progress, s, nir_opt_remove_phis);
-      NIR_PASS(progress, s, nir_opt_dce);
-      NIR_PASS(progress, s, nir_opt_dead_cf);
-      NIR_PASS(progress, s, nir_opt_cse);
-      NIR_PASS(progress, s, nir_opt_peephole_select, 8);
-      NIR_PASS(progress, s, nir_opt_algebraic);
-      NIR_PASS(progress, s, nir_opt_constant_folding);
-      NIR_PASS(progress, s, nir_opt_undef);
-      NIR_PASS(progress, s, nir_opt_loop_unroll,
-               nir_var_shader_in |
-               nir_var_shader_out |
-               nir_var_local);
-   } while (progress);
+   nir_pass_loop_init(&loop);
+   while (nir_pass_loop_iterate(&loop)) {
+      NIR_LOOP_PASS_V(&loop, s, nir_lower_vars_to_ssa);
+      NIR_LOOP_PASS(&loop, s, nir_lower_alu_to_scalar);
+      NIR_LOOP_PASS(&loop, s, nir_lower_phis_to_scalar);
+      NIR_LOOP_PASS(&loop, s, nir_copy_prop);
+      NIR_LOOP_PASS(&loop, s, nir_opt_remove_phis);
+      NIR_LOOP_PASS(&loop, s, nir_opt_dce);
+      NIR_LOOP_PASS(&loop, s, nir_opt_dead_cf);
+      NIR_LOOP_PASS(&loop, s, nir_opt_cse);
+      NIR_LOOP_PASS(&loop, s, nir_opt_peephole_select, 8);
+      NIR_LOOP_PASS(&loop, s, nir_opt_algebraic);
+      NIR_LOOP_PASS(&loop, s, lima_nir_opt_algebraic_gp);
+      NIR_LOOP_PASS(&loop, s, nir_opt_constant_folding);
+      NIR_LOOP_PASS(&loop, s, nir_opt_undef);
+      NIR_LOOP_PASS(&loop, s, nir_opt_loop_unroll,
+                    nir_var_shader_in |
+                    nir_var_shader_out |
+                    nir_var_local);
+   }
+   nir_pass_loop_finish(&loop, "lima vs");
 
    NIR_PASS_V(s, nir_lower_locals_to_regs);
    NIR_PASS_V(s, nir_convert_from_ssa, true);
@@ -110,34 +140,70 @@ lima_program_optimize_vs_nir(struct nir_shader *s)
    nir_sweep(s);
 }
 
+/* the scalar unit ops are split per component again by the pp lowering,
+ * and a select only has a scalar condition
+ */
+static bool
+lima_vectorize_filter(const nir_instr *instr, void *data)
+{
+   switch (nir_instr_as_alu(instr)->op) {
+   case nir_op_frcp:
+   case nir_op_frsq:
+   case nir_op_fsqrt:
+   case nir_op_fexp2:
+   case nir_op_flog2:
+   case nir_op_bcsel:
+   case nir_op_fcsel:
+      return false;
+   default:
+      return true;
+   }
+}
+
 static void
-lima_program_optimize_fs_nir(struct nir_shader *s)
+lima_program_optimize_fs_nir(struct nir_shader *s,
+                             struct lima_fs_shader_state *so)
 {
-   bool progress;
+   nir_pass_loop loop;
 
    NIR_PASS_V(s, nir_opt_global_to_local);
    NIR_PASS_V(s, nir_lower_regs_to_ssa);
 
-   do {
-      progress = false;
-
-      NIR_PASS_V(s, nir_lower_vars_to_ssa);
-      //NIR_PASS(progress, s, nir_lower_alu_to_scalar);
-      NIR_PASS(progress, s, nir_lower_phis_to_scalar);
-      NIR_PASS(progress, s, nir_copy_prop);
-      NIR_PASS(progress, s, nir_opt_remove_phis);
-      NIR_PASS(progress, s, nir_opt_dce);
-      NIR_PASS(progress, s, nir_opt_dead_cf);
-      NIR_PASS(progress, s, nir_opt_cse);
-      NIR_PASS(progress, s, nir_opt_peephole_select, 8);
-      NIR_PASS(progress, s, nir_opt_algebraic);
-      NIR_PASS(progress, s, nir_opt_constant_folding);
-      NIR_PASS(progress, s, nir_opt_undef);
-      NIR_PASS(progress, s, nir_opt_loop_unroll,
-               nir_var_shader_in |
-               nir_var_shader_out |
-               nir_var_local);
-   } while (progress);
+   nir_pass_loop_init(&loop);
+   while (nir_pass_loop_iterate(&loop)) {
+      NIR_LOOP_PASS_V(&loop, s, nir_lower_vars_to_ssa);
+      //NIR_LOOP_PASS(&loop, s, nir_lower_alu_to_scalar);
+      NIR_LOOP_PASS(&loop, s, nir_lower_phis_to_scalar);
+      NIR_LOOP_PASS(&loop, s, nir_copy_prop);
+      NIR_LOOP_PASS(&loop, s, nir_opt_remove_phis);
+      NIR_LOOP_PASS(&loop, s, nir_opt_dce);
+      NIR_LOOP_PASS(&loop, s, nir_opt_dead_cf);
+      NIR_LOOP_PASS(&loop, s, nir_opt_cse);
+      /* ifs with texture loads or discard, or more alu ops than the
+       * options allow, keep a branch */
+      NIR_LOOP_PASS(&loop, s, nir_opt_peephole_select, 8);
+      NIR_LOOP_PASS(&loop, s, nir_opt_algebraic);
+      NIR_LOOP_PASS(&loop, s, lima_nir_opt_algebraic_pp);
+      /* the scalar ops of the glsl lowering back to the vec4 alus */
+      NIR_LOOP_PASS(&loop, s, nir_opt_vectorize, lima_vectorize_filter,
+                    NULL);
+      NIR_LOOP_PASS(&loop, s, nir_opt_constant_folding);
+      NIR_LOOP_PASS(&loop, s, nir_opt_undef);
+      NIR_LOOP_PASS(&loop, s, nir_opt_loop_unroll,
+                    nir_var_shader_in |
+                    nir_var_shader_out |
+                    nir_var_local);
+   }
+   nir_pass_loop_finish(&loop, "lima fs");
+
+   /* the uniform only exprs left run on the cpu once per draw, before the
+    * source mods get out of the alus; the dce below removes them */
+   NIR_PASS_V(s, lima_nir_preshader, &so->preshader, so);
+
+   /* neg and abs are free on pp alu srcs, sat is the clamp outmod */
+   NIR_PASS_V(s, nir_lower_to_source_mods);
+   NIR_PASS_V(s, nir_copy_prop);
+   NIR_PASS_V(s, nir_opt_dce);
 
    NIR_PASS_V(s, nir_lower_locals_to_regs);
    NIR_PASS_V(s, nir_convert_from_ssa, true);
@@ -147,44 +213,951 @@ lima_program_optimize_fs_nir(struct nir_shader *s)
    nir_sweep(s);
 }
 
-static void *
-lima_create_fs_state(struct pipe_context *pctx,
-                     const struct pipe_shader_state *cso)
+/* the ref is part of the variant key, so it's a constant of the shader */
+static void
+lima_nir_lower_alpha_ref(nir_shader *s, float ref)
 {
-   struct lima_screen *screen = lima_screen(pctx->screen);
-   struct lima_fs_shader_state *so = rzalloc(NULL, struct lima_fs_shader_state);
+   nir_foreach_function(function, s) {
+      if (!function->impl)
+         continue;
 
-   if (!so)
-      return NULL;
+      nir_builder b;
+      nir_builder_init(&b, function->impl);
 
-   debug_checkpoint();
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr_safe(instr, block) {
+            if (instr->type != nir_instr_type_intrinsic)
+               continue;
+
+            nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+            if (intr->intrinsic != nir_intrinsic_load_alpha_ref_float)
+               continue;
+
+            b.cursor = nir_before_instr(instr);
+            nir_ssa_def_rewrite_uses(&intr->dest.ssa,
+                                     nir_src_for_ssa(nir_imm_float(&b, ref)));
+            nir_instr_remove(instr);
+         }
+      }
+
+      nir_metadata_preserve(function->impl, nir_metadata_block_index |
+                            nir_metadata_dominance);
+   }
+}
+
+/* ppir only has an unconditional discard, put it in an if. The block
+ * list changes, so the walk starts over after each one. */
+static bool
+lima_nir_lower_discard_if_impl(nir_function_impl *impl)
+{
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type != nir_instr_type_intrinsic)
+            continue;
+
+         nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+         if (intr->intrinsic != nir_intrinsic_discard_if)
+            continue;
+
+         nir_builder b;
+         nir_builder_init(&b, impl);
+         b.cursor = nir_before_instr(instr);
+
+         nir_if *nif = nir_push_if(&b, nir_ssa_for_src(&b, intr->src[0], 1));
+         nir_intrinsic_instr *discard =
+            nir_intrinsic_instr_create(b.shader, nir_intrinsic_discard);
+         nir_builder_instr_insert(&b, &discard->instr);
+         nir_pop_if(&b, nif);
+
+         nir_instr_remove(instr);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void
+lima_nir_lower_discard_if(nir_shader *s)
+{
+   nir_foreach_function(function, s) {
+      if (!function->impl)
+         continue;
+
+      while (lima_nir_lower_discard_if_impl(function->impl))
+         nir_metadata_preserve(function->impl, nir_metadata_none);
+   }
+}
+
+/* gl_PointCoord, and the texcoords replaced on point sprites, are the
+ * coord of the fragment in the point instead of a varying. The vs has no
+ * output for gl_PointCoord, the fs inputs after it move down a slot. */
+static void
+lima_nir_lower_point_coord(nir_shader *s, const struct lima_fs_key *key)
+{
+   uint32_t replace = 0;
+   int pntc_base = -1;
+
+   nir_foreach_variable(var, &s->inputs) {
+      gl_varying_slot slot = var->data.location;
+      int generic = -1;
+
+      if (slot == VARYING_SLOT_PNTC)
+         pntc_base = var->data.driver_location;
+      else if (slot >= VARYING_SLOT_VAR0 ||
+               (slot >= VARYING_SLOT_TEX0 && slot <= VARYING_SLOT_TEX7))
+         generic = tgsi_get_generic_gl_varying_index(slot, false);
+
+      if (var->data.driver_location < 32 &&
+          (slot == VARYING_SLOT_PNTC ||
+           (generic >= 0 && generic < 32 &&
+            key->sprite_coord_enable & (1u << generic))))
+         replace |= 1u << var->data.driver_location;
+   }
+
+   if (!replace)
+      return;
+
+   nir_foreach_function(function, s) {
+      if (!function->impl)
+         continue;
+
+      nir_builder b;
+      nir_builder_init(&b, function->impl);
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr_safe(instr, block) {
+            if (instr->type != nir_instr_type_intrinsic)
+               continue;
+
+            nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+            if (intr->intrinsic != nir_intrinsic_load_input)
+               continue;
+
+            int base = nir_intrinsic_base(intr);
+            if (!(replace & (1u << base))) {
+               if (pntc_base >= 0 && base > pntc_base)
+                  nir_intrinsic_set_base(intr, base - 1);
+               continue;
+            }
+
+            b.cursor = nir_before_instr(instr);
+            nir_ssa_def *coord = nir_load_point_coord(&b);
+            nir_ssa_def *t = nir_channel(&b, coord, 1);
+            if (key->sprite_coord_lower_left)
+               t = nir_fsub(&b, nir_imm_float(&b, 1.0), t);
+
+            /* a replaced texcoord is (s, t, 0, 1) */
+            nir_ssa_def *comps[4] = {
+               nir_channel(&b, coord, 0), t,
+               nir_imm_float(&b, 0.0), nir_imm_float(&b, 1.0),
+            };
+            unsigned first = nir_intrinsic_component(intr);
+            nir_ssa_def *value =
+               nir_vec(&b, comps + first, intr->num_components);
 
+            nir_ssa_def_rewrite_uses(&intr->dest.ssa, nir_src_for_ssa(value));
+            nir_instr_remove(instr);
+         }
+      }
+
+      nir_metadata_preserve(function->impl, nir_metadata_block_index |
+                            nir_metadata_dominance);
+   }
+}
+
+static const uint8_t lima_identity_swizzle[4] = {
+   PIPE_SWIZZLE_X, PIPE_SWIZZLE_Y, PIPE_SWIZZLE_Z, PIPE_SWIZZLE_W,
+};
+
+static void
+lima_program_lower_fs_key(nir_shader *s, const struct lima_fs_key *key)
+{
+   if (key->alpha_func != PIPE_FUNC_ALWAYS) {
+      NIR_PASS_V(s, nir_lower_alpha_test,
+                 (enum compare_func)key->alpha_func, false);
+      NIR_PASS_V(s, lima_nir_lower_alpha_ref, key->alpha_ref);
+      NIR_PASS_V(s, lima_nir_lower_discard_if);
+   }
+
+   NIR_PASS_V(s, lima_nir_lower_point_coord, key);
+
+   nir_lower_tex_options tex_options = { 0 };
+   for (int i = 0; i < PIPE_MAX_SAMPLERS; i++) {
+      if (!memcmp(key->swizzles[i], lima_identity_swizzle, 4))
+         continue;
+
+      tex_options.swizzle_result |= 1 << i;
+      memcpy(tex_options.swizzles[i], key->swizzles[i], 4);
+   }
+
+   if (tex_options.swizzle_result)
+      NIR_PASS_V(s, nir_lower_tex, &tex_options);
+}
+
+/* Compiled shaders are sub-allocated from a list of screen wide heap
+ * chunks, so that all the shaders used by a submit normally end up in
+ * one bo. Allocation is a simple bump pointer, a chunk only gets rewound
+ * once all its shaders are deleted and no submit holds a reference to
+ * its bo any more, so code the GPU may still execute is never overwritten.
+ */
+struct lima_shader_heap_chunk {
+   struct list_head list;
+   struct lima_bo *bo;
+   uint32_t offset;
+   int num_shaders;
+};
+
+#define LIMA_SHADER_ALIGN 0x40
+
+static bool
+lima_shader_heap_alloc(struct lima_screen *screen, const void *shader,
+                       int size, struct lima_bo **bo, uint32_t *offset)
+{
+   struct lima_shader_heap_chunk *found = NULL;
+   uint32_t aligned_size = align(size, LIMA_SHADER_ALIGN);
+
+   mtx_lock(&screen->shader_heap_lock);
+
+   list_for_each_entry(struct lima_shader_heap_chunk, chunk,
+                       &screen->shader_heap, list) {
+      /* only the heap itself holds the bo, no pending or running job */
+      if (!chunk->num_shaders && p_atomic_read(&chunk->bo->refcnt) == 1)
+         chunk->offset = 0;
+
+      if (chunk->bo->size - chunk->offset >= aligned_size) {
+         found = chunk;
+         break;
+      }
+   }
+
+   if (!found) {
+      found = calloc(1, sizeof(*found));
+      if (!found)
+         goto err_out0;
+
+      found->bo = lima_bo_create(
+         screen, MAX2(aligned_size, LIMA_SHADER_HEAP_CHUNK_SIZE), 0, true, true);
+      if (!found->bo)
+         goto err_out1;
+
+      list_addtail(&found->list, &screen->shader_heap);
+   }
+
+   memcpy(found->bo->map + found->offset, shader, size);
+   *bo = found->bo;
+   *offset = found->offset;
+   found->offset += aligned_size;
+   found->num_shaders++;
+
+   mtx_unlock(&screen->shader_heap_lock);
+   return true;
+
+err_out1:
+   free(found);
+err_out0:
+   mtx_unlock(&screen->shader_heap_lock);
+   return false;
+}
+
+/* the code goes to the heap once compiled or loaded from the disk cache
+ * and the CPU copy is dropped, so that a state shared through the program
+ * cache is never written at draw time */
+static bool
+lima_program_upload(struct lima_screen *screen, void **shader, int size,
+                    struct lima_bo **bo, uint32_t *offset)
+{
+   bool ret = lima_shader_heap_alloc(screen, *shader, size, bo, offset);
+   if (!ret)
+      fprintf(stderr, "lima: alloc shader fail\n");
+
+   ralloc_free(*shader);
+   *shader = NULL;
+   return ret;
+}
+
+static void
+lima_shader_heap_free(struct lima_screen *screen, struct lima_bo *bo)
+{
+   mtx_lock(&screen->shader_heap_lock);
+
+   list_for_each_entry(struct lima_shader_heap_chunk, chunk,
+                       &screen->shader_heap, list) {
+      if (chunk->bo != bo)
+         continue;
+
+      /* keep the last chunk around for reuse, the others can be released
+       * right away as in flight jobs hold their own bo reference */
+      if (!--chunk->num_shaders && chunk->list.next != chunk->list.prev) {
+         list_del(&chunk->list);
+         lima_bo_free(chunk->bo);
+         free(chunk);
+      }
+      break;
+   }
+
+   mtx_unlock(&screen->shader_heap_lock);
+}
+
+static uint32_t
+lima_program_cache_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(((struct lima_program_ref *)0)->key));
+}
+
+static bool
+lima_program_cache_compare(const void *key1, const void *key2)
+{
+   return memcmp(key1, key2, sizeof(((struct lima_program_ref *)0)->key)) == 0;
+}
+
+void
+lima_program_screen_init(struct lima_screen *screen)
+{
+   mtx_init(&screen->shader_heap_lock, mtx_plain);
+   list_inithead(&screen->shader_heap);
+
+   /* no program cache if this fails, every create compiles */
+   mtx_init(&screen->program_cache_lock, mtx_plain);
+   screen->program_cache = _mesa_hash_table_create(
+      screen, lima_program_cache_hash, lima_program_cache_compare);
+
+   /* every TGSI create translates if this fails */
+   screen->ttn_cache = tgsi_to_nir_cache_create();
+}
+
+/* A shader created again, by another context or by the app recreating
+ * its programs, gets the state of the first one with a new reference
+ * instead of a compile. The state is shared until the last delete. */
+static struct lima_program_ref *
+lima_program_cache_ref(struct lima_screen *screen, struct lima_program_ref *ref)
+{
+   if (!screen->program_cache)
+      return ref;
+
+   mtx_lock(&screen->program_cache_lock);
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(screen->program_cache, ref->key);
+   if (entry) {
+      ref = entry->data;
+      ref->refcnt++;
+   }
+   else
+      _mesa_hash_table_insert(screen->program_cache, ref->key, ref);
+
+   mtx_unlock(&screen->program_cache_lock);
+   return ref;
+}
+
+/* returns true when the state has to be freed */
+static bool
+lima_program_cache_unref(struct lima_screen *screen, struct lima_program_ref *ref)
+{
+   if (!screen->program_cache)
+      return true;
+
+   mtx_lock(&screen->program_cache_lock);
+
+   bool last = !--ref->refcnt;
+   if (last) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(screen->program_cache, ref->key);
+      if (entry && entry->data == ref)
+         _mesa_hash_table_remove(screen->program_cache, entry);
+   }
+
+   mtx_unlock(&screen->program_cache_lock);
+   return last;
+}
+
+/* the disk cache is keyed on the shader as the state tracker passes it,
+ * the driver and compiler build and the GPU name are part of every key
+ * through the cache itself */
+void
+lima_program_disk_cache_init(struct lima_screen *screen)
+{
+   /* a cached shader wouldn't print anything */
+   if (lima_shader_debug_gp || lima_shader_debug_pp)
+      return;
+
+   uint32_t timestamp;
+   if (!disk_cache_get_function_timestamp(lima_program_disk_cache_init,
+                                          &timestamp))
+      return;
+
+   char timestamp_str[16];
+   snprintf(timestamp_str, sizeof(timestamp_str), "%u", timestamp);
+   screen->disk_cache =
+      disk_cache_create(screen->base.get_name(&screen->base), timestamp_str, 0);
+}
+
+void
+lima_program_compile_queue_init(struct lima_screen *screen)
+{
+   /* debug output of shaders compiled in parallel would be interleaved */
+   if (!lima_shader_threads || lima_shader_debug_gp || lima_shader_debug_pp)
+      return;
+
+   if (!util_queue_init(&screen->shader_queue, "lima_shader", 64,
+                        lima_shader_threads, UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      fprintf(stderr, "lima: fail to create shader compile queue\n");
+}
+
+void
+lima_program_screen_fini(struct lima_screen *screen)
+{
+   if (util_queue_is_initialized(&screen->shader_queue))
+      util_queue_destroy(&screen->shader_queue);
+
+   disk_cache_destroy(screen->disk_cache);
+
+   /* all the states are deleted with their contexts */
+   if (screen->program_cache)
+      assert(!_mesa_hash_table_num_entries(screen->program_cache));
+   mtx_destroy(&screen->program_cache_lock);
+   tgsi_to_nir_cache_destroy(screen->ttn_cache);
+
+   list_for_each_entry_safe(struct lima_shader_heap_chunk, chunk,
+                            &screen->shader_heap, list) {
+      list_del(&chunk->list);
+      lima_bo_free(chunk->bo);
+      free(chunk);
+   }
+   mtx_destroy(&screen->shader_heap_lock);
+}
+
+/* NIR optimization and the gpir/ppir backends run on the screen compile
+ * queue, the shader state is usable once its ready fence signals and
+ * a failed compile leaves it without code */
+struct lima_compile_job {
+   struct lima_screen *screen;
+   void *so;
    nir_shader *nir;
-   if (cso->type == PIPE_SHADER_IR_NIR) {
-      nir = cso->ir.nir;
+   bool cache;
+   cache_key key;
+   struct pipe_debug_callback debug;
+};
 
-      NIR_PASS_V(nir, nir_lower_io, nir_var_all, type_size,
-                 (nir_lower_io_options)0);
+static void
+lima_program_report_stats(struct pipe_debug_callback *debug, const char *name,
+                          struct lima_shader_stats *stats)
+{
+   pipe_debug_message(debug, SHADER_INFO,
+                      "%s shader: %d inst, %d/%d slots, %d regs, %d spills, "
+                      "%d consts, %"PRId64" us",
+                      name, stats->instrs, stats->slots, stats->max_slots,
+                      stats->regs, stats->spills, stats->consts,
+                      stats->compile_time);
+}
+
+/* a callback which can't be called from the compile queue makes the
+ * compile synchronous to get the shader info */
+static bool
+lima_program_compile(struct lima_screen *screen, void *so,
+                     struct util_queue_fence *ready, nir_shader *nir,
+                     bool cache, cache_key key,
+                     const struct pipe_debug_callback *debug,
+                     util_queue_execute_func compile)
+{
+   struct lima_compile_job *job = malloc(sizeof(*job));
+   if (!job) {
+      ralloc_free(nir);
+      return false;
+   }
+
+   job->screen = screen;
+   job->so = so;
+   job->nir = nir;
+   job->cache = cache;
+   if (cache)
+      memcpy(job->key, key, sizeof(cache_key));
+   job->debug = *debug;
+
+   if (util_queue_is_initialized(&screen->shader_queue) &&
+       (!debug->debug_message || debug->async)) {
+      util_queue_add_job(&screen->shader_queue, job, ready, compile, NULL);
+      return true;
+   }
+
+   compile(job, 0);
+   return true;
+}
+
+/* the key of the program cache, and of the disk cache when there is one,
+ * taken from the key of the state tracker when it gives one */
+static bool
+lima_program_cache_key(struct lima_screen *screen, enum pipe_shader_type stage,
+                       const struct pipe_shader_state *cso,
+                       const unsigned char *state_key, cache_key key)
+{
+   if (!screen->disk_cache && !screen->program_cache)
+      return false;
+
+   struct blob blob;
+   blob_init(&blob);
+   blob_write_uint32(&blob, stage);
+   blob_write_uint32(&blob, lima_fp16_varying);
+   if (state_key)
+      blob_write_bytes(&blob, state_key, sizeof(cache_key));
+   else if (cso->type == PIPE_SHADER_IR_NIR) {
+      blob_write_uint32(&blob, cso->type);
+      nir_serialize(&blob, cso->ir.nir);
    }
    else {
-      assert(cso->type == PIPE_SHADER_IR_TGSI);
+      blob_write_uint32(&blob, cso->type);
+      blob_write_bytes(&blob, cso->tokens,
+                       tgsi_num_tokens(cso->tokens) * sizeof(struct tgsi_token));
+   }
+
+   bool ret = !blob.out_of_memory;
+   if (ret && screen->disk_cache)
+      disk_cache_compute_key(screen->disk_cache, blob.data, blob.size, key);
+   else if (ret)
+      _mesa_sha1_compute(blob.data, blob.size, key);
+
+   blob_finish(&blob);
+   return ret;
+}
+
+static bool
+lima_fs_cache_load(struct lima_screen *screen, cache_key key,
+                   struct lima_fs_shader_state *so)
+{
+   size_t size;
+   void *data = disk_cache_get(screen->disk_cache, key, &size);
+   if (!data)
+      return false;
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, data, size);
+   so->shader_size = blob_read_uint32(&blob);
+   so->stack_size = blob_read_uint32(&blob);
+   so->uses_discard = blob_read_uint32(&blob);
+   so->writes_depth = blob_read_uint32(&blob);
+   blob_copy_bytes(&blob, &so->stats, sizeof(so->stats));
+   so->shader = ralloc_size(so, so->shader_size);
+   if (so->shader)
+      blob_copy_bytes(&blob, so->shader, so->shader_size);
+
+   struct lima_preshader *ps = &so->preshader;
+   ps->num_values = blob_read_uint32(&blob);
+   ps->base = blob_read_uint32(&blob);
+   ps->num_outputs = blob_read_uint32(&blob);
+   if (ps->num_outputs &&
+       ps->num_values >= 0 && ps->num_values <= LIMA_PRESHADER_MAX_VALUES &&
+       ps->num_outputs > 0 && ps->num_outputs <= LIMA_PRESHADER_MAX_VALUES) {
+      ps->values = ralloc_array(so, struct lima_preshader_value,
+                                ps->num_values);
+      ps->outputs = ralloc_array(so, uint8_t, ps->num_outputs);
+      if (ps->values && ps->outputs) {
+         blob_copy_bytes(&blob, ps->values,
+                         ps->num_values * sizeof(*ps->values));
+         blob_copy_bytes(&blob, ps->outputs, ps->num_outputs);
+      }
+   }
+
+   /* a bad entry would make the draws read past the preshader values,
+    * compiling again is safer */
+   bool ret = so->shader && !blob.overrun && blob.current == blob.end &&
+      (!ps->num_outputs ||
+       (ps->values && ps->outputs && lima_preshader_is_valid(ps)));
+   if (!ret) {
+      ralloc_free(so->shader);
+      so->shader = NULL;
+      ralloc_free(ps->values);
+      ralloc_free(ps->outputs);
+      memset(ps, 0, sizeof(*ps));
+      so->stack_size = 0;
+      so->uses_discard = false;
+      so->writes_depth = false;
+      memset(&so->stats, 0, sizeof(so->stats));
+   }
+
+   free(data);
+   return ret;
+}
+
+static void
+lima_fs_cache_store(struct lima_screen *screen, cache_key key,
+                    struct lima_fs_shader_state *so)
+{
+   struct blob blob;
+   blob_init(&blob);
+   blob_write_uint32(&blob, so->shader_size);
+   blob_write_uint32(&blob, so->stack_size);
+   blob_write_uint32(&blob, so->uses_discard);
+   blob_write_uint32(&blob, so->writes_depth);
+   blob_write_bytes(&blob, &so->stats, sizeof(so->stats));
+   blob_write_bytes(&blob, so->shader, so->shader_size);
 
-      nir = tgsi_to_nir(cso->tokens, &fs_nir_options);
+   struct lima_preshader *ps = &so->preshader;
+   blob_write_uint32(&blob, ps->num_values);
+   blob_write_uint32(&blob, ps->base);
+   blob_write_uint32(&blob, ps->num_outputs);
+   if (ps->num_outputs) {
+      blob_write_bytes(&blob, ps->values,
+                       ps->num_values * sizeof(*ps->values));
+      blob_write_bytes(&blob, ps->outputs, ps->num_outputs);
    }
 
-   lima_program_optimize_fs_nir(nir);
+   if (!blob.out_of_memory)
+      disk_cache_put(screen->disk_cache, key, blob.data, blob.size, NULL);
+
+   blob_finish(&blob);
+}
+
+/* everything after the io lowering, the standalone compiler runs this
+ * on the shaders it loads too */
+bool
+lima_program_compile_fs_nir(struct lima_fs_shader_state *so,
+                            struct nir_shader *nir, struct ra_regs *ra)
+{
+   int64_t start = os_time_get();
+
+   lima_program_lower_fs_key(nir, &so->key);
+   lima_program_optimize_fs_nir(nir, so);
+
+   so->writes_depth = nir->info.outputs_written &
+      (1ull << FRAG_RESULT_DEPTH);
 
    if (lima_shader_debug_pp)
       nir_print_shader(nir, stdout);
 
-   if (!ppir_compile_nir(so, nir, screen->pp_ra)) {
+   if (!ppir_compile_nir(so, nir, ra))
+      return false;
+
+   so->stats.compile_time = os_time_get() - start;
+   return true;
+}
+
+static void
+lima_compile_fs(void *data, int thread_index)
+{
+   struct lima_compile_job *job = data;
+   struct lima_fs_shader_state *so = job->so;
+
+   if (lima_program_compile_fs_nir(so, job->nir, job->screen->pp_ra)) {
+      lima_program_report_stats(&job->debug, "FS", &so->stats);
+
+      if (job->cache)
+         lima_fs_cache_store(job->screen, job->key, so);
+
+      lima_program_upload(job->screen, &so->shader, so->shader_size,
+                          &so->bo, &so->bo_offset);
+   }
+   else
+      so->shader = NULL;
+
+   ralloc_free(job->nir);
+   free(job);
+}
+
+static uint32_t
+lima_fs_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct lima_fs_key));
+}
+
+static bool
+lima_fs_key_compare(const void *key1, const void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct lima_fs_key)) == 0;
+}
+
+void
+lima_fs_key_init(struct lima_fs_key *key)
+{
+   /* hashed and compared as bytes, padding included */
+   memset(key, 0, sizeof(*key));
+   key->alpha_func = PIPE_FUNC_ALWAYS;
+   for (int i = 0; i < PIPE_MAX_SAMPLERS; i++)
+      memcpy(key->swizzles[i], lima_identity_swizzle, 4);
+}
+
+static void
+lima_fs_key_update(struct lima_context *ctx, struct lima_fs_key *key,
+                   bool points)
+{
+   lima_fs_key_init(key);
+
+   if (ctx->zsa) {
+      struct pipe_alpha_state *alpha = &ctx->zsa->base.alpha;
+
+      if (alpha->enabled && alpha->func != PIPE_FUNC_ALWAYS) {
+         key->alpha_func = alpha->func;
+         /* no variant per ref when nothing passes anyway */
+         if (alpha->func != PIPE_FUNC_NEVER)
+            key->alpha_ref = alpha->ref_value;
+      }
+   }
+
+   struct lima_texture_stateobj *tex = &ctx->tex_stateobj;
+   for (unsigned i = 0; i < tex->num_textures; i++) {
+      struct pipe_sampler_view *view = tex->textures[i];
+      if (!view)
+         continue;
+
+      key->swizzles[i][0] = view->swizzle_r;
+      key->swizzles[i][1] = view->swizzle_g;
+      key->swizzles[i][2] = view->swizzle_b;
+      key->swizzles[i][3] = view->swizzle_a;
+
+      const unsigned char *format_swizzle =
+         lima_texture_format_swizzle(view->format);
+      if (format_swizzle) {
+         unsigned char view_swizzle[4];
+         memcpy(view_swizzle, key->swizzles[i], 4);
+         util_format_compose_swizzles(format_swizzle, view_swizzle,
+                                      key->swizzles[i]);
+      }
+   }
+
+   struct pipe_rasterizer_state *rast = &ctx->rasterizer->base;
+   if (points && rast->point_quad_rasterization) {
+      key->points = true;
+      key->sprite_coord_lower_left =
+         rast->sprite_coord_mode == PIPE_SPRITE_COORD_LOWER_LEFT;
+      key->sprite_coord_enable = rast->sprite_coord_enable;
+   }
+}
+
+static void
+lima_fs_variant_cache_key(struct lima_screen *screen,
+                          struct lima_fs_program *prog,
+                          const struct lima_fs_key *key,
+                          cache_key variant_key)
+{
+   unsigned char data[sizeof(prog->ref.key) + sizeof(*key)];
+
+   memcpy(data, prog->ref.key, sizeof(prog->ref.key));
+   memcpy(data + sizeof(prog->ref.key), key, sizeof(*key));
+   disk_cache_compute_key(screen->disk_cache, data, sizeof(data), variant_key);
+}
+
+/* A program created from the state key alone has the NIR of the key
+ * serialized, the variants missing from the disk cache deserialize it. */
+static nir_shader *
+lima_fs_program_nir(struct lima_fs_program *prog)
+{
+   if (prog->nir || !prog->nir_blob)
+      return prog->nir;
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, prog->nir_blob, prog->nir_blob_size);
+   prog->nir = nir_deserialize(prog, &fs_nir_options, &blob);
+   if (blob.overrun || blob.current != blob.end) {
+      ralloc_free(prog->nir);
+      prog->nir = NULL;
+   }
+
+   free(prog->nir_blob);
+   prog->nir_blob = NULL;
+   return prog->nir;
+}
+
+/* with the state key, the lowered NIR goes to the disk cache under the
+ * program key for the creates from the key alone */
+static void
+lima_fs_program_store_nir(struct lima_screen *screen,
+                          struct lima_fs_program *prog)
+{
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, prog->nir);
+
+   if (!blob.out_of_memory)
+      disk_cache_put(screen->disk_cache, prog->ref.key, blob.data, blob.size,
+                     NULL);
+
+   blob_finish(&blob);
+}
+
+/* Returns the variant of the key, a new one is loaded from the disk cache
+ * or queued for compile. That happens under the lock, so a draw of another
+ * context sharing the program finds it either ready or with its fence
+ * reset, the caller waits for the fence before using it. */
+static struct lima_fs_shader_state *
+lima_fs_program_get_variant(struct lima_screen *screen,
+                            struct lima_fs_program *prog,
+                            const struct lima_fs_key *key,
+                            struct pipe_debug_callback *debug)
+{
+   struct lima_fs_shader_state *so;
+
+   mtx_lock(&prog->lock);
+
+   struct hash_entry *entry = _mesa_hash_table_search(prog->variants, key);
+   if (entry) {
+      so = entry->data;
+      goto out;
+   }
+
+   so = rzalloc(NULL, struct lima_fs_shader_state);
+   if (!so)
+      goto out;
+
+   util_queue_fence_init(&so->ready);
+   so->key = *key;
+
+   if (!_mesa_hash_table_insert(prog->variants, &so->key, so)) {
+      util_queue_fence_destroy(&so->ready);
       ralloc_free(so);
-      return NULL;
+      so = NULL;
+      goto out;
+   }
+
+   bool cache = prog->cache && screen->disk_cache;
+   cache_key variant_key;
+   if (cache) {
+      lima_fs_variant_cache_key(screen, prog, key, variant_key);
+
+      if (lima_fs_cache_load(screen, variant_key, so)) {
+         lima_program_report_stats(debug, "FS", &so->stats);
+         lima_program_upload(screen, &so->shader, so->shader_size,
+                             &so->bo, &so->bo_offset);
+         goto out;
+      }
+   }
+
+   /* a failed compile leaves the variant without code like any other */
+   nir_shader *nir = lima_fs_program_nir(prog);
+   if (nir) {
+      lima_program_compile(screen, so, &so->ready,
+                           nir_shader_clone(NULL, nir),
+                           cache, variant_key, debug, lima_compile_fs);
    }
 
+out:
+   mtx_unlock(&prog->lock);
    return so;
 }
 
+static void
+lima_fs_program_free(struct lima_screen *screen, struct lima_fs_program *prog)
+{
+   struct hash_entry *entry;
+
+   hash_table_foreach(prog->variants, entry) {
+      struct lima_fs_shader_state *so = entry->data;
+
+      util_queue_fence_wait(&so->ready);
+      util_queue_fence_destroy(&so->ready);
+
+      if (so->bo)
+         lima_shader_heap_free(screen, so->bo);
+
+      ralloc_free(so);
+   }
+
+   free(prog->nir_blob);
+   mtx_destroy(&prog->lock);
+   ralloc_free(prog);
+}
+
+/* without the shader state, it is created from the disk cache alone */
+static void *
+lima_fs_state_create(struct pipe_context *pctx,
+                     const struct pipe_shader_state *cso,
+                     const unsigned char *state_key)
+{
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_screen *screen = lima_screen(pctx->screen);
+   struct lima_fs_program *prog = rzalloc(NULL, struct lima_fs_program);
+
+   if (!prog)
+      return NULL;
+
+   debug_checkpoint();
+
+   prog->variants = _mesa_hash_table_create(prog, lima_fs_key_hash,
+                                            lima_fs_key_compare);
+   if (!prog->variants) {
+      ralloc_free(prog);
+      return NULL;
+   }
+
+   mtx_init(&prog->lock, mtx_plain);
+   prog->ref.refcnt = 1;
+
+   /* keyed on the shader as passed, before the io lowering below */
+   prog->cache = lima_program_cache_key(screen, PIPE_SHADER_FRAGMENT, cso,
+                                        state_key, prog->ref.key);
+
+   if (!cso) {
+      if (prog->cache && screen->disk_cache)
+         prog->nir_blob = disk_cache_get(screen->disk_cache, prog->ref.key,
+                                         &prog->nir_blob_size);
+
+      if (!prog->nir_blob) {
+         mtx_destroy(&prog->lock);
+         ralloc_free(prog);
+         return NULL;
+      }
+   }
+   else {
+      nir_shader *nir;
+      if (cso->type == PIPE_SHADER_IR_NIR) {
+         nir = cso->ir.nir;
+
+         NIR_PASS_V(nir, nir_lower_io, nir_var_all, type_size,
+                    (nir_lower_io_options)0);
+      }
+      else {
+         assert(cso->type == PIPE_SHADER_IR_TGSI);
+
+         nir = tgsi_to_nir_cached(screen->ttn_cache, cso->tokens,
+                                  &fs_nir_options);
+      }
+      prog->nir = nir;
+      ralloc_steal(prog, nir);
+
+      if (state_key && prog->cache && screen->disk_cache)
+         lima_fs_program_store_nir(screen, prog);
+   }
+
+   /* the program is complete before a create of the same shader can
+    * get it from the program cache */
+   if (prog->cache) {
+      struct lima_program_ref *ref = lima_program_cache_ref(screen, &prog->ref);
+      if (ref != &prog->ref) {
+         free(prog->nir_blob);
+         mtx_destroy(&prog->lock);
+         ralloc_free(prog);
+         return container_of(ref, prog, ref);
+      }
+   }
+
+   /* the variant of the default state is the likely one, get it compiled
+    * in the background right away */
+   struct lima_fs_key key;
+   lima_fs_key_init(&key);
+
+   struct lima_fs_shader_state *so =
+      lima_fs_program_get_variant(screen, prog, &key, &ctx->debug);
+
+   /* a shader compiled already can still be refused at create time */
+   if (!so || (util_queue_fence_is_signalled(&so->ready) && !so->bo))
+      goto err_out;
+
+   return prog;
+
+err_out:
+   /* a create of the same shader in between owns it now */
+   if (prog->cache && !lima_program_cache_unref(screen, &prog->ref))
+      return NULL;
+
+   lima_fs_program_free(screen, prog);
+   return NULL;
+}
+
+static void *
+lima_create_fs_state(struct pipe_context *pctx,
+                     const struct pipe_shader_state *cso)
+{
+   return lima_fs_state_create(pctx, cso, NULL);
+}
+
 static void
 lima_bind_fs_state(struct pipe_context *pctx, void *hwcso)
 {
@@ -192,65 +1165,287 @@ lima_bind_fs_state(struct pipe_context *pctx, void *hwcso)
 
    struct lima_context *ctx = lima_context(pctx);
 
-   ctx->fs = hwcso;
+   ctx->fs_program = hwcso;
+   ctx->fs = NULL;
    ctx->dirty |= LIMA_CONTEXT_DIRTY_SHADER_FRAG;
 }
 
 static void
 lima_delete_fs_state(struct pipe_context *pctx, void *hwcso)
 {
-   struct lima_fs_shader_state *so = hwcso;
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_screen *screen = lima_screen(pctx->screen);
+   struct lima_fs_program *prog = hwcso;
 
-   if (so->bo)
-      lima_bo_free(so->bo);
+   /* a new variant may get the same address, and the buffer may have the
+    * results of this one's preshader over the constants of a plain fs */
+   ctx->pp_uniform_preshader = NULL;
+   ctx->pp_uniform_size = 0;
 
-   ralloc_free(so);
+   if (!lima_program_cache_unref(screen, &prog->ref))
+      return;
+
+   lima_fs_program_free(screen, prog);
+}
+
+/* the time draws spend waiting for the compile queue */
+static void
+lima_program_wait(struct lima_context *ctx, struct util_queue_fence *ready)
+{
+   if (util_queue_fence_is_signalled(ready))
+      return;
+
+   /* the draw needs it now, don't let it wait behind precompiles */
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   if (util_queue_is_initialized(&screen->shader_queue))
+      util_queue_promote_job(&screen->shader_queue, ready);
+
+   int64_t start = os_time_get();
+   util_queue_fence_wait(ready);
+   ctx->stats[LIMA_QUERY_SHADER_WAIT_TIME] += os_time_get() - start;
 }
 
 bool
 lima_update_vs_state(struct lima_context *ctx)
 {
    struct lima_vs_shader_state *vs = ctx->vs;
-   if (!vs->bo) {
-      struct lima_screen *screen = lima_screen(ctx->base.screen);
-      vs->bo = lima_bo_create(screen, vs->shader_size, 0, true, true);
-      if (!vs->bo) {
-         fprintf(stderr, "lima: create vs shader bo fail\n");
-         return false;
-      }
 
-      memcpy(vs->bo->map, vs->shader, vs->shader_size);
-      ralloc_free(vs->shader);
-      vs->shader = NULL;
+   lima_program_wait(ctx, &vs->ready);
+   if (!vs->bo) {
+      fprintf(stderr, "lima: compile vs shader fail\n");
+      return false;
    }
 
    return true;
 }
 
+/* the variant for the bound state, a draw with a new state compiles it */
 bool
-lima_update_fs_state(struct lima_context *ctx)
+lima_update_fs_state(struct lima_context *ctx, const struct pipe_draw_info *info)
 {
+   bool points = info->mode == PIPE_PRIM_POINTS &&
+      ctx->rasterizer->base.point_quad_rasterization;
+
+   if (!ctx->fs || ctx->fs->key.points != points ||
+       ctx->dirty & (LIMA_CONTEXT_DIRTY_ZSA | LIMA_CONTEXT_DIRTY_TEXTURES |
+                     LIMA_CONTEXT_DIRTY_RASTERIZER)) {
+      struct lima_fs_key key;
+      lima_fs_key_update(ctx, &key, points);
+
+      if (!ctx->fs || memcmp(&key, &ctx->fs->key, sizeof(key))) {
+         struct lima_fs_shader_state *fs = lima_fs_program_get_variant(
+            lima_screen(ctx->base.screen), ctx->fs_program, &key, &ctx->debug);
+         if (!fs) {
+            fprintf(stderr, "lima: alloc fs shader variant fail\n");
+            return false;
+         }
+
+         ctx->fs = fs;
+         ctx->dirty |= LIMA_CONTEXT_DIRTY_SHADER_FRAG;
+      }
+   }
+
    struct lima_fs_shader_state *fs = ctx->fs;
+
+   lima_program_wait(ctx, &fs->ready);
    if (!fs->bo) {
-      struct lima_screen *screen = lima_screen(ctx->base.screen);
-      fs->bo = lima_bo_create(screen, fs->shader_size, 0, true, true);
-      if (!fs->bo) {
-         fprintf(stderr, "lima: create fs shader bo fail\n");
-         return false;
+      fprintf(stderr, "lima: compile fs shader fail\n");
+      return false;
+   }
+
+   return true;
+}
+
+/* the varying layout only depends on the compiled shader, so compute
+ * offsets, descriptor formats and the RSW encoding once here */
+static void
+lima_program_layout_varying(struct lima_vs_shader_state *vs)
+{
+   for (int i = 1; i < vs->num_varying; i++) {
+      if (i != vs->point_size_idx)
+         vs->varying[i].components = align(vs->varying[i].components, 2);
+   }
+
+   /* each varying has its own address, so lay out the 16 byte aligned
+    * ones first and the 8 byte ones after them without padding */
+   int offset = 0;
+   for (int pass = 0; pass < 2; pass++) {
+      for (int i = 1; i < vs->num_varying; i++) {
+         struct lima_varying_info *v = vs->varying + i;
+         if (i == vs->point_size_idx)
+            continue;
+
+         int size = align(v->components * v->component_size, 8);
+         bool vec4 = size == 16;
+         if (vec4 != (pass == 0))
+            continue;
+
+         v->offset = offset;
+         offset += size;
       }
+   }
+   vs->varying_stride = align(offset, 8);
+
+   /* for gl_Position */
+   vs->varying[0].format = 0x8020;
 
-      memcpy(fs->bo->map, fs->shader, fs->shader_size);
-      ralloc_free(fs->shader);
-      fs->shader = NULL;
+   /* gl_PointSize is a float array of its own, only read by the plbu,
+    * so the fs inputs are the other varyings */
+   if (vs->point_size_idx != -1)
+      vs->varying[vs->point_size_idx].format = 0x2021;
+
+   vs->varying_types = 0;
+   vs->varying_address_bits = 0;
+   int index = 0;
+   for (int i = 1; i < vs->num_varying; i++) {
+      struct lima_varying_info *v = vs->varying + i;
+      int val;
+
+      if (i == vs->point_size_idx)
+         continue;
+
+      v->format = (vs->varying_stride << 11) | (v->components - 1) |
+         (v->component_size == 2 ? 0x0C : 0);
+
+      if (v->component_size == 4)
+         val = v->components == 4 ? 0 : 1;
+      else
+         val = v->components == 4 ? 2 : 3;
+
+      if (index < 10)
+         vs->varying_types |= val << (3 * index);
+      else if (index == 10) {
+         vs->varying_types |= val << 30;
+         vs->varying_address_bits |= val >> 2;
+      }
+      else if (index == 11)
+         vs->varying_address_bits |= val << 1;
+      index++;
    }
+}
+
+/* the varyings are cached with their final layout, everything from the
+ * varying array up to the shader bo is copied as is */
+#define LIMA_VS_CACHE_STATE_SIZE \
+   (offsetof(struct lima_vs_shader_state, bo) - \
+    offsetof(struct lima_vs_shader_state, varying))
+
+static bool
+lima_vs_cache_load(struct lima_screen *screen, cache_key key,
+                   struct lima_vs_shader_state *so)
+{
+   size_t size;
+   void *data = disk_cache_get(screen->disk_cache, key, &size);
+   if (!data)
+      return false;
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, data, size);
+   so->shader_size = blob_read_uint32(&blob);
+   so->prefetch = blob_read_uint32(&blob);
+   so->constant_size = blob_read_uint32(&blob);
+   so->uses_instance_id = blob_read_uint32(&blob);
+   blob_copy_bytes(&blob, so->varying, LIMA_VS_CACHE_STATE_SIZE);
+
+   bool ret = !blob.overrun;
+   if (ret) {
+      so->shader = ralloc_size(so, so->shader_size);
+      if (so->shader)
+         blob_copy_bytes(&blob, so->shader, so->shader_size);
+      if (so->constant_size) {
+         so->constant = ralloc_size(so, so->constant_size);
+         if (so->constant)
+            blob_copy_bytes(&blob, so->constant, so->constant_size);
+      }
+
+      ret = so->shader && (so->constant || !so->constant_size) &&
+         !blob.overrun && blob.current == blob.end;
+   }
+
+   /* compile it again, which sets every field this touched */
+   if (!ret) {
+      ralloc_free(so->shader);
+      ralloc_free(so->constant);
+      memset(so, 0, offsetof(struct lima_vs_shader_state, bo));
+   }
+
+   free(data);
+   return ret;
+}
+
+static void
+lima_vs_cache_store(struct lima_screen *screen, cache_key key,
+                    struct lima_vs_shader_state *so)
+{
+   struct blob blob;
+   blob_init(&blob);
+   blob_write_uint32(&blob, so->shader_size);
+   blob_write_uint32(&blob, so->prefetch);
+   blob_write_uint32(&blob, so->constant_size);
+   blob_write_uint32(&blob, so->uses_instance_id);
+   blob_write_bytes(&blob, so->varying, LIMA_VS_CACHE_STATE_SIZE);
+   blob_write_bytes(&blob, so->shader, so->shader_size);
+   blob_write_bytes(&blob, so->constant, so->constant_size);
+
+   if (!blob.out_of_memory)
+      disk_cache_put(screen->disk_cache, key, blob.data, blob.size, NULL);
+
+   blob_finish(&blob);
+}
+
+bool
+lima_program_compile_vs_nir(struct lima_vs_shader_state *so,
+                            struct nir_shader *nir)
+{
+   int64_t start = os_time_get();
+
+   lima_program_optimize_vs_nir(nir);
+
+   if (lima_shader_debug_gp)
+      nir_print_shader(nir, stdout);
+
+   so->uses_instance_id = nir->info.system_values_read &
+      (1ull << SYSTEM_VALUE_INSTANCE_ID);
 
+   if (!gpir_compile_nir(so, nir))
+      return false;
+
+   lima_program_layout_varying(so);
+
+   so->stats.compile_time = os_time_get() - start;
    return true;
 }
 
+static void
+lima_compile_vs(void *data, int thread_index)
+{
+   struct lima_compile_job *job = data;
+   struct lima_vs_shader_state *so = job->so;
+
+   if (lima_program_compile_vs_nir(so, job->nir)) {
+      lima_program_report_stats(&job->debug, "VS", &so->stats);
+
+      if (job->cache)
+         lima_vs_cache_store(job->screen, job->key, so);
+
+      lima_program_upload(job->screen, &so->shader, so->shader_size,
+                          &so->bo, &so->bo_offset);
+   }
+   else
+      so->shader = NULL;
+
+   ralloc_free(job->nir);
+   free(job);
+}
+
+/* without the shader state, it is created from the disk cache alone */
 static void *
-lima_create_vs_state(struct pipe_context *pctx,
-                     const struct pipe_shader_state *cso)
+lima_vs_state_create(struct pipe_context *pctx,
+                     const struct pipe_shader_state *cso,
+                     const unsigned char *state_key)
 {
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_screen *screen = lima_screen(pctx->screen);
    struct lima_vs_shader_state *so = rzalloc(NULL, struct lima_vs_shader_state);
 
    if (!so)
@@ -258,6 +1453,44 @@ lima_create_vs_state(struct pipe_context *pctx,
 
    debug_checkpoint();
 
+   util_queue_fence_init(&so->ready);
+   so->ref.refcnt = 1;
+
+   bool cache = lima_program_cache_key(screen, PIPE_SHADER_VERTEX, cso,
+                                       state_key, so->ref.key);
+   if (cache) {
+      struct lima_program_ref *ref = lima_program_cache_ref(screen, &so->ref);
+      if (ref != &so->ref) {
+         struct lima_vs_shader_state *old = container_of(ref, so, ref);
+
+         util_queue_fence_destroy(&so->ready);
+         ralloc_free(so);
+         if (cso && cso->type == PIPE_SHADER_IR_NIR)
+            ralloc_free(cso->ir.nir);
+
+         if (util_queue_fence_is_signalled(&old->ready) && !old->bo) {
+            lima_program_cache_unref(screen, &old->ref);
+            return NULL;
+         }
+         return old;
+      }
+
+      if (screen->disk_cache &&
+          lima_vs_cache_load(screen, so->ref.key, so)) {
+         lima_program_report_stats(&ctx->debug, "VS", &so->stats);
+         if (cso && cso->type == PIPE_SHADER_IR_NIR)
+            ralloc_free(cso->ir.nir);
+
+         if (!lima_program_upload(screen, &so->shader, so->shader_size,
+                                  &so->bo, &so->bo_offset))
+            goto err_out;
+         return so;
+      }
+   }
+
+   if (!cso)
+      goto err_out;
+
    nir_shader *nir;
    if (cso->type == PIPE_SHADER_IR_NIR) {
       nir = cso->ir.nir;
@@ -268,20 +1501,50 @@ lima_create_vs_state(struct pipe_context *pctx,
    else {
       assert(cso->type == PIPE_SHADER_IR_TGSI);
 
-      nir = tgsi_to_nir(cso->tokens, &vs_nir_options);
+      nir = tgsi_to_nir_cached(screen->ttn_cache, cso->tokens,
+                               &vs_nir_options);
    }
 
-   lima_program_optimize_vs_nir(nir);
+   if (!lima_program_compile(screen, so, &so->ready, nir,
+                             cache && screen->disk_cache, so->ref.key,
+                             &ctx->debug, lima_compile_vs) ||
+       /* a shader compiled already can still be refused at create time */
+       (util_queue_fence_is_signalled(&so->ready) && !so->bo))
+      goto err_out;
 
-   if (lima_shader_debug_gp)
-      nir_print_shader(nir, stdout);
+   return so;
 
-   if (!gpir_compile_nir(so, nir)) {
-      ralloc_free(so);
+err_out:
+   /* a create of the same shader in between owns it now */
+   if (cache && !lima_program_cache_unref(screen, &so->ref))
       return NULL;
-   }
 
-   return so;
+   util_queue_fence_destroy(&so->ready);
+   ralloc_free(so);
+   return NULL;
+}
+
+static void *
+lima_create_vs_state(struct pipe_context *pctx,
+                     const struct pipe_shader_state *cso)
+{
+   return lima_vs_state_create(pctx, cso, NULL);
+}
+
+static void *
+lima_create_cached_shader_state(struct pipe_context *pctx,
+                                enum pipe_shader_type shader,
+                                const struct pipe_shader_state *cso,
+                                const unsigned char *key)
+{
+   switch (shader) {
+   case PIPE_SHADER_VERTEX:
+      return lima_vs_state_create(pctx, cso, key);
+   case PIPE_SHADER_FRAGMENT:
+      return lima_fs_state_create(pctx, cso, key);
+   default:
+      return NULL;
+   }
 }
 
 static void
@@ -298,10 +1561,22 @@ lima_bind_vs_state(struct pipe_context *pctx, void *hwcso)
 static void
 lima_delete_vs_state(struct pipe_context *pctx, void *hwcso)
 {
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_screen *screen = lima_screen(pctx->screen);
    struct lima_vs_shader_state *so = hwcso;
 
+   /* a new shader may get the same address */
+   if (ctx->gp_uniform_vs == so)
+      ctx->gp_uniform_vs = NULL;
+
+   if (!lima_program_cache_unref(screen, &so->ref))
+      return;
+
+   util_queue_fence_wait(&so->ready);
+   util_queue_fence_destroy(&so->ready);
+
    if (so->bo)
-      lima_bo_free(so->bo);
+      lima_shader_heap_free(lima_screen(pctx->screen), so->bo);
 
    ralloc_free(so);
 }
@@ -316,4 +1591,6 @@ lima_program_init(struct lima_context *ctx)
    ctx->base.create_vs_state = lima_create_vs_state;
    ctx->base.bind_vs_state = lima_bind_vs_state;
    ctx->base.delete_vs_state = lima_delete_vs_state;
+
+   ctx->base.create_cached_shader_state = lima_create_cached_shader_state;
 }
@@ -27,9 +27,30 @@
 
 #include "pipe/p_defines.h"
 
+struct lima_screen;
+struct lima_context;
+struct lima_vs_shader_state;
+struct lima_fs_shader_state;
+struct lima_fs_key;
+struct nir_shader;
+struct ra_regs;
+struct pipe_draw_info;
+
 const void *lima_program_get_compiler_options(enum pipe_shader_type shader);
 
+void lima_fs_key_init(struct lima_fs_key *key);
+bool lima_program_compile_vs_nir(struct lima_vs_shader_state *so,
+                                 struct nir_shader *nir);
+bool lima_program_compile_fs_nir(struct lima_fs_shader_state *so,
+                                 struct nir_shader *nir, struct ra_regs *ra);
+
 bool lima_update_vs_state(struct lima_context *ctx);
-bool lima_update_fs_state(struct lima_context *ctx);
+bool lima_update_fs_state(struct lima_context *ctx,
+                          const struct pipe_draw_info *info);
+
+void lima_program_screen_init(struct lima_screen *screen);
+void lima_program_screen_fini(struct lima_screen *screen);
+void lima_program_disk_cache_init(struct lima_screen *screen);
+void lima_program_compile_queue_init(struct lima_screen *screen);
 
 #endif
@@ -23,79 +23,335 @@
  */
 
 /**
- * Stub support for occlusion queries.
+ * Occlusion queries.
  *
- * Since we expose support for GL 2.0, we have to expose occlusion queries,
- * but the spec allows you to expose 0 query counter bits, so we just return 0
- * as the result of all our queries.
+ * The lima kernel interface has no way to read the PP performance
+ * counters, so the number of samples passed can't be read back from the
+ * hardware. Only the predicates are supported, with a conservative
+ * answer: an object is reported occluded when none of its draws reached
+ * a pixel of the viewport and scissor rectangle, it counts as visible
+ * otherwise, depth and stencil tests aside. There's no sample count to
+ * give, so PIPE_QUERY_OCCLUSION_COUNTER queries can't be created until
+ * the counters can be read. The result is known when the query ends, so
+ * it never has to wait for the GPU, and conditional rendering drops the
+ * draws of an occluded object while the commands are built, before any
+ * of the GP, PLBU or PP work.
+ *
+ * For the same reason the driver specific queries listed by the HUD and
+ * AMD_performance_monitor are counters the driver keeps itself while it
+ * builds and submits the jobs in place of the hardware counters.
  */
 
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
+#include "util/u_upload_mgr.h"
 
 #include "lima_context.h"
+#include "lima_screen.h"
 
 struct lima_query
 {
-   uint8_t pad;
+   /* the threaded context tracks unflushed queries in here */
+   struct threaded_query base;
+
+   unsigned type;
+   /* some draw of the occlusion predicate reached a pixel, or the value
+    * of the driver specific counter */
+   uint64_t samples;
+   /* driver specific counter when the query began */
+   uint64_t start;
 };
 
+enum lima_query_group {
+   LIMA_QUERY_GROUP_GP,
+   LIMA_QUERY_GROUP_PP,
+   LIMA_QUERY_GROUP_CPU,
+   LIMA_QUERY_GROUP_NUM,
+};
+
+static const struct pipe_driver_query_info lima_driver_query_list[] = {
+#define QUERY(_name, _query, _type, _group) {             \
+      .name = _name,                                      \
+      .query_type = PIPE_QUERY_DRIVER_SPECIFIC + _query,  \
+      .type = PIPE_DRIVER_QUERY_TYPE_ ## _type,           \
+      .result_type = PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE,\
+      .group_id = LIMA_QUERY_GROUP_ ## _group,            \
+   }
+   QUERY("lima-draw-calls", LIMA_QUERY_DRAW_CALLS, UINT64, GP),
+   QUERY("lima-merged-draws", LIMA_QUERY_MERGED_DRAWS, UINT64, GP),
+   QUERY("lima-vertices", LIMA_QUERY_VERTICES, UINT64, GP),
+   QUERY("lima-primitives", LIMA_QUERY_PRIMITIVES, UINT64, GP),
+   QUERY("lima-gp-cmd-bytes", LIMA_QUERY_GP_CMD_BYTES, BYTES, GP),
+   QUERY("lima-jobs", LIMA_QUERY_JOBS, UINT64, PP),
+   QUERY("lima-pp-tiles", LIMA_QUERY_PP_TILES, UINT64, PP),
+   QUERY("lima-plb-stalls", LIMA_QUERY_PLB_STALLS, UINT64, PP),
+   QUERY("lima-pp0-tiles", LIMA_QUERY_PP0_TILES + 0, UINT64, PP),
+   QUERY("lima-pp1-tiles", LIMA_QUERY_PP0_TILES + 1, UINT64, PP),
+   QUERY("lima-pp2-tiles", LIMA_QUERY_PP0_TILES + 2, UINT64, PP),
+   QUERY("lima-pp3-tiles", LIMA_QUERY_PP0_TILES + 3, UINT64, PP),
+   QUERY("lima-pp4-tiles", LIMA_QUERY_PP0_TILES + 4, UINT64, PP),
+   QUERY("lima-pp5-tiles", LIMA_QUERY_PP0_TILES + 5, UINT64, PP),
+   QUERY("lima-pp6-tiles", LIMA_QUERY_PP0_TILES + 6, UINT64, PP),
+   QUERY("lima-pp7-tiles", LIMA_QUERY_PP0_TILES + 7, UINT64, PP),
+   QUERY("lima-flushes", LIMA_QUERY_FLUSHES, UINT64, CPU),
+   QUERY("lima-transfer-flushes", LIMA_QUERY_TRANSFER_FLUSHES, UINT64, CPU),
+   QUERY("lima-resource-flushes", LIMA_QUERY_RESOURCE_FLUSHES, UINT64, CPU),
+   QUERY("lima-upload-bytes", LIMA_QUERY_UPLOAD_BYTES, BYTES, CPU),
+   QUERY("lima-uploader-bytes", LIMA_QUERY_UPLOADER_BYTES, BYTES, CPU),
+   QUERY("lima-uploader-recycles", LIMA_QUERY_UPLOADER_RECYCLES, UINT64, CPU),
+   QUERY("lima-submit-bos", LIMA_QUERY_SUBMIT_BOS, UINT64, CPU),
+   QUERY("lima-bo-wait-time", LIMA_QUERY_BO_WAIT_TIME, MICROSECONDS, CPU),
+   QUERY("lima-shader-wait-time", LIMA_QUERY_SHADER_WAIT_TIME, MICROSECONDS, CPU),
+   QUERY("lima-frames", LIMA_QUERY_FRAMES, UINT64, PP),
+   QUERY("lima-queued-frames", LIMA_QUERY_QUEUED_FRAMES, UINT64, PP),
+#undef QUERY
+};
+
+static const char *lima_driver_query_group_names[] = {
+   [LIMA_QUERY_GROUP_GP] = "GP",
+   [LIMA_QUERY_GROUP_PP] = "PP",
+   [LIMA_QUERY_GROUP_CPU] = "CPU",
+};
+
+static bool
+lima_query_is_driver(unsigned type)
+{
+   return type >= PIPE_QUERY_DRIVER_SPECIFIC &&
+      type < PIPE_QUERY_DRIVER_SPECIFIC + LIMA_QUERY_DRIVER_NUM;
+}
+
+static bool
+lima_query_is_occlusion(unsigned type)
+{
+   return type == PIPE_QUERY_OCCLUSION_PREDICATE ||
+      type == PIPE_QUERY_OCCLUSION_PREDICATE_CONSERVATIVE;
+}
+
+void
+lima_query_add_draw(struct lima_context *ctx)
+{
+   if (ctx->occlusion_query && ctx->queries_active)
+      ctx->occlusion_query->samples = 1;
+}
+
+/* The results are already known, so the wait and no wait modes of the
+ * render condition are the same. */
+bool
+lima_query_render_condition_passes(struct lima_context *ctx)
+{
+   struct lima_query *query = ctx->render_cond_query;
+
+   if (!query)
+      return true;
+
+   return (query->samples == 0) == ctx->render_cond_cond;
+}
+
+/* the uploader keeps its own counters */
+static uint64_t
+lima_query_stat(struct lima_context *ctx, unsigned index)
+{
+   const struct u_upload_stats *upload = u_upload_get_stats(ctx->uploader);
+
+   switch (index) {
+   case LIMA_QUERY_UPLOADER_BYTES:
+      return upload->bytes;
+   case LIMA_QUERY_UPLOADER_RECYCLES:
+      return upload->buffers_recycled;
+   default:
+      return ctx->stats[index];
+   }
+}
+
 static struct pipe_query *
 lima_create_query(struct pipe_context *ctx, unsigned query_type, unsigned index)
 {
    debug_checkpoint();
+
+   /* no sample counts, see above */
+   if (query_type == PIPE_QUERY_OCCLUSION_COUNTER)
+      return NULL;
+
    struct lima_query *query = calloc(1, sizeof(*query));
+   if (!query)
+      return NULL;
+
+   query->type = query_type;
 
    /* Note that struct pipe_query isn't actually defined anywhere. */
    return (struct pipe_query *)query;
 }
 
 static void
-lima_destroy_query(struct pipe_context *ctx, struct pipe_query *query)
+lima_destroy_query(struct pipe_context *pctx, struct pipe_query *pquery)
 {
    debug_checkpoint();
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_query *query = (struct lima_query *)pquery;
+
+   if (ctx->occlusion_query == query)
+      ctx->occlusion_query = NULL;
+   if (ctx->render_cond_query == query)
+      ctx->render_cond_query = NULL;
+
    free(query);
 }
 
 static boolean
-lima_begin_query(struct pipe_context *ctx, struct pipe_query *query)
+lima_begin_query(struct pipe_context *pctx, struct pipe_query *pquery)
 {
    debug_checkpoint();
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_query *query = (struct lima_query *)pquery;
+
+   query->samples = 0;
+
+   if (lima_query_is_occlusion(query->type))
+      ctx->occlusion_query = query;
+   else if (lima_query_is_driver(query->type))
+      query->start = lima_query_stat(ctx,
+                                     query->type - PIPE_QUERY_DRIVER_SPECIFIC);
+
    return true;
 }
 
 static bool
-lima_end_query(struct pipe_context *ctx, struct pipe_query *query)
+lima_end_query(struct pipe_context *pctx, struct pipe_query *pquery)
 {
    debug_checkpoint();
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_query *query = (struct lima_query *)pquery;
+
+   if (ctx->occlusion_query == query)
+      ctx->occlusion_query = NULL;
+   else if (lima_query_is_driver(query->type))
+      query->samples = lima_query_stat(ctx,
+                                       query->type - PIPE_QUERY_DRIVER_SPECIFIC) -
+         query->start;
+
    return true;
 }
 
 static boolean
-lima_get_query_result(struct pipe_context *ctx, struct pipe_query *query,
+lima_get_query_result(struct pipe_context *ctx, struct pipe_query *pquery,
                      boolean wait, union pipe_query_result *vresult)
 {
    debug_checkpoint();
-   uint64_t *result = &vresult->u64;
+   struct lima_query *query = (struct lima_query *)pquery;
 
-   *result = 0;
+   switch (query->type) {
+   case PIPE_QUERY_OCCLUSION_PREDICATE:
+   case PIPE_QUERY_OCCLUSION_PREDICATE_CONSERVATIVE:
+      vresult->b = query->samples != 0;
+      break;
+   default:
+      vresult->u64 = lima_query_is_driver(query->type) ? query->samples : 0;
+      break;
+   }
 
    return true;
 }
 
 static void
-lima_set_active_query_state(struct pipe_context *pipe, boolean enable)
+lima_set_active_query_state(struct pipe_context *pctx, boolean enable)
 {
    debug_checkpoint();
+   struct lima_context *ctx = lima_context(pctx);
+
+   /* meta operations like blits don't count */
+   ctx->queries_active = enable;
+}
+
+static void
+lima_render_condition(struct pipe_context *pctx, struct pipe_query *pquery,
+                      boolean condition, enum pipe_render_cond_flag mode)
+{
+   debug_checkpoint();
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_query *query = (struct lima_query *)pquery;
+
+   /* only the occlusion results say whether anything got drawn */
+   if (query && !lima_query_is_occlusion(query->type))
+      query = NULL;
+
+   ctx->render_cond_query = query;
+   ctx->render_cond_cond = condition;
+   ctx->render_cond_mode = mode;
 }
 
 void
 lima_query_init(struct lima_context *pctx)
 {
+   pctx->queries_active = true;
+
    pctx->base.create_query = lima_create_query;
    pctx->base.destroy_query = lima_destroy_query;
    pctx->base.begin_query = lima_begin_query;
    pctx->base.end_query = lima_end_query;
    pctx->base.get_query_result = lima_get_query_result;
    pctx->base.set_active_query_state = lima_set_active_query_state;
+   pctx->base.render_condition = lima_render_condition;
 }
 
+/* only the PPs of the GPU have a tile count */
+static bool
+lima_driver_query_exists(struct lima_screen *screen,
+                         const struct pipe_driver_query_info *info)
+{
+   unsigned query = info->query_type - PIPE_QUERY_DRIVER_SPECIFIC;
+
+   return query < LIMA_QUERY_PP0_TILES ||
+      query >= LIMA_QUERY_PP0_TILES + LIMA_MAX_PP ||
+      query < LIMA_QUERY_PP0_TILES + screen->num_pp;
+}
+
+static int
+lima_get_driver_query_info(struct pipe_screen *pscreen, unsigned index,
+                           struct pipe_driver_query_info *info)
+{
+   struct lima_screen *screen = lima_screen(pscreen);
+   unsigned num = 0;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(lima_driver_query_list); i++) {
+      if (!lima_driver_query_exists(screen, lima_driver_query_list + i))
+         continue;
+
+      if (info && num == index) {
+         *info = lima_driver_query_list[i];
+         return 1;
+      }
+      num++;
+   }
+
+   return info ? 0 : num;
+}
+
+static int
+lima_get_driver_query_group_info(struct pipe_screen *pscreen, unsigned index,
+                                 struct pipe_driver_query_group_info *info)
+{
+   if (!info)
+      return LIMA_QUERY_GROUP_NUM;
+
+   if (index >= LIMA_QUERY_GROUP_NUM)
+      return 0;
+
+   info->name = lima_driver_query_group_names[index];
+   info->num_queries = 0;
+   for (unsigned i = 0; i < ARRAY_SIZE(lima_driver_query_list); i++) {
+      if (lima_driver_query_list[i].group_id == index &&
+          lima_driver_query_exists(lima_screen(pscreen),
+                                   lima_driver_query_list + i))
+         info->num_queries++;
+   }
+   /* the counters are free running, any number can be active */
+   info->max_active_queries = info->num_queries;
+   return 1;
+}
+
+void
+lima_query_screen_init(struct lima_screen *screen)
+{
+   screen->base.get_driver_query_info = lima_get_driver_query_info;
+   screen->base.get_driver_query_group_info = lima_get_driver_query_group_info;
+}
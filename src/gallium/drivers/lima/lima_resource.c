@@ -24,10 +24,14 @@
 
 #include "util/u_memory.h"
 #include "util/u_format.h"
+#include "util/u_gen_mipmap.h"
 #include "util/u_inlines.h"
 #include "util/u_math.h"
 #include "util/u_debug.h"
+#include "util/u_atomic.h"
+#include "util/os_time.h"
 #include "util/u_transfer.h"
+#include "util/u_surface.h"
 #include "util/hash_table.h"
 #include "renderonly/renderonly.h"
 
@@ -38,8 +42,116 @@
 #include "lima_resource.h"
 #include "lima_bo.h"
 #include "lima_util.h"
+#include "lima_tiling.h"
+#include "lima_job.h"
+#include "lima_trace.h"
 #include "lima_drm.h"
 
+/* a scanout buffer of a destroyed resource, the display driver's dumb
+ * buffer and its import stay alive to skip both for the next scanout
+ * resource of the same size and format. KMS waits for our writes through
+ * the implicit fence the kernel attaches to the shared bo. */
+struct lima_scanout_cache_entry {
+   struct list_head link;
+   struct renderonly_scanout *scanout;
+   struct lima_bo *bo;
+   enum pipe_format format;
+   unsigned width, height;
+   uint32_t stride;
+};
+
+static void
+lima_scanout_cache_entry_free(struct lima_screen *screen,
+                              struct lima_scanout_cache_entry *entry)
+{
+   list_del(&entry->link);
+   renderonly_scanout_destroy(entry->scanout, screen->ro);
+   lima_bo_free(entry->bo);
+   FREE(entry);
+}
+
+static struct pipe_resource *
+lima_scanout_cache_get(struct pipe_screen *pscreen,
+                       const struct pipe_resource *templat,
+                       unsigned width, unsigned height)
+{
+   struct lima_screen *screen = lima_screen(pscreen);
+   struct lima_scanout_cache_entry *entry = NULL;
+
+   mtx_lock(&screen->scanout_cache_lock);
+   list_for_each_entry(struct lima_scanout_cache_entry, e,
+                       &screen->scanout_cache, link) {
+      if (e->format == templat->format &&
+          e->width == width && e->height == height) {
+         list_del(&e->link);
+         screen->scanout_cache_num--;
+         entry = e;
+         break;
+      }
+   }
+   mtx_unlock(&screen->scanout_cache_lock);
+
+   if (!entry)
+      return NULL;
+
+   struct lima_resource *res = CALLOC_STRUCT(lima_resource);
+   if (!res) {
+      list_inithead(&entry->link);
+      lima_scanout_cache_entry_free(screen, entry);
+      return NULL;
+   }
+
+   struct pipe_resource *pres = &res->base.b;
+   *pres = *templat;
+   pres->screen = pscreen;
+   pipe_reference_init(&pres->reference, 1);
+   threaded_resource_init(pres);
+   res->base.is_shared = true;
+   res->levels[0].stride = entry->stride;
+   res->levels[0].layer_stride = entry->stride *
+      util_format_get_nblocksy(pres->format, pres->height0);
+   res->bo = entry->bo;
+   res->scanout = entry->scanout;
+
+   FREE(entry);
+   return pres;
+}
+
+/* takes the scanout and the bo of res, false if they're still needed */
+static bool
+lima_scanout_cache_put(struct lima_screen *screen, struct lima_resource *res)
+{
+   struct pipe_resource *pres = &res->base.b;
+
+   if (!res->scanout || !res->bo || res->exported)
+      return false;
+
+   struct lima_scanout_cache_entry *entry =
+      CALLOC_STRUCT(lima_scanout_cache_entry);
+   if (!entry)
+      return false;
+
+   entry->scanout = res->scanout;
+   entry->bo = res->bo;
+   entry->format = pres->format;
+   entry->width = align(pres->width0, 16);
+   entry->height = align(pres->height0, 16);
+   entry->stride = res->levels[0].stride;
+
+   mtx_lock(&screen->scanout_cache_lock);
+   list_add(&entry->link, &screen->scanout_cache);
+   /* drop the oldest one */
+   if (++screen->scanout_cache_num > LIMA_SCANOUT_CACHE_SIZE) {
+      lima_scanout_cache_entry_free(
+         screen, LIST_ENTRY(struct lima_scanout_cache_entry,
+                            screen->scanout_cache.prev, link));
+      screen->scanout_cache_num--;
+   }
+   mtx_unlock(&screen->scanout_cache_lock);
+
+   return true;
+}
+
 static struct pipe_resource *
 lima_resource_create_scanout(struct pipe_screen *pscreen,
                              const struct pipe_resource *templat,
@@ -50,6 +162,10 @@ lima_resource_create_scanout(struct pipe_screen *pscreen,
    struct winsys_handle handle;
    struct pipe_resource *pres;
 
+   pres = lima_scanout_cache_get(pscreen, templat, width, height);
+   if (pres)
+      return pres;
+
    struct pipe_resource scanout_templat = *templat;
    scanout_templat.width0 = width;
    scanout_templat.height0 = height;
@@ -76,6 +192,29 @@ lima_resource_create_scanout(struct pipe_screen *pscreen,
    return pres;
 }
 
+static bool
+lima_resource_should_tile(const struct pipe_resource *templat)
+{
+   /* PP write back and the other users of these buffers expect linear */
+   if (templat->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL |
+                        PIPE_BIND_SCANOUT | PIPE_BIND_SHARED |
+                        PIPE_BIND_LINEAR))
+      return false;
+
+   if (!(templat->bind & PIPE_BIND_SAMPLER_VIEW))
+      return false;
+
+   if (templat->target != PIPE_TEXTURE_2D &&
+       templat->target != PIPE_TEXTURE_RECT)
+      return false;
+
+   if (templat->array_size > 1 || templat->depth0 > 1)
+      return false;
+
+   return util_format_get_blockwidth(templat->format) == 1 &&
+      util_format_get_blockheight(templat->format) == 1;
+}
+
 static struct pipe_resource *
 lima_resource_create_bo(struct pipe_screen *pscreen,
                         const struct pipe_resource *templat,
@@ -89,25 +228,48 @@ lima_resource_create_bo(struct pipe_screen *pscreen,
    if (!res)
       return NULL;
 
-   res->base = *templat;
-   res->base.screen = pscreen;
-   pipe_reference_init(&res->base.reference, 1);
+   pres = &res->base.b;
+   *pres = *templat;
+   pres->screen = pscreen;
+   pipe_reference_init(&pres->reference, 1);
+
+   res->tiled = lima_resource_should_tile(pres);
+
+   /* levels are placed one after another, texture descriptors only hold
+    * the upper 26 bits of each level address */
+   uint32_t size = 0;
+   bool should_align = res->tiled ||
+      pres->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL);
+   for (int i = 0; i <= pres->last_level; i++) {
+      struct lima_resource_level *level = res->levels + i;
+      unsigned w = u_minify(width, i);
+      unsigned h = u_minify(height, i);
+
+      if (should_align) {
+         w = align(w, LIMA_TILE_SIZE);
+         h = align(h, LIMA_TILE_SIZE);
+      }
 
-   /* TODO: mipmap */
-   pres = &res->base;
-   res->stride = util_format_get_stride(pres->format, width);
+      level->stride = util_format_get_stride(pres->format, w);
+      level->layer_stride = level->stride *
+         util_format_get_nblocksy(pres->format, h);
+      level->offset = size;
 
-   uint32_t size = res->stride *
-      util_format_get_nblocksy(pres->format, height) *
-      pres->array_size * pres->depth0;
+      size += align(level->layer_stride * pres->array_size *
+                    u_minify(pres->depth0, i), 0x40);
+   }
    size = align(size, LIMA_PAGE_SIZE);
 
-   res->bo = lima_bo_create(screen, size, 0, false, false);
+   /* buffers are mapped upfront, unsynchronized maps of the threaded
+    * context come from the application thread */
+   res->bo = lima_bo_create(screen, size, 0, pres->target == PIPE_BUFFER,
+                            false);
    if (!res->bo) {
       FREE(res);
       return NULL;
    }
 
+   threaded_resource_init(pres);
    return pres;
 }
 
@@ -149,15 +311,48 @@ lima_resource_destroy(struct pipe_screen *pscreen, struct pipe_resource *pres)
    struct lima_screen *screen = lima_screen(pscreen);
    struct lima_resource *res = lima_resource(pres);
 
-   if (res->bo)
-      lima_bo_free(res->bo);
+   if (!lima_scanout_cache_put(screen, res)) {
+      if (res->bo)
+         lima_bo_free(res->bo);
 
-   if (res->scanout)
-      renderonly_scanout_destroy(res->scanout, screen->ro);
+      if (res->scanout)
+         renderonly_scanout_destroy(res->scanout, screen->ro);
+   }
+
+   FREE(res->index_cache);
 
+   threaded_resource_deinit(pres);
    FREE(res);
 }
 
+/* a single sampled resource on the storage of a multisampled one, which
+ * already holds the pixels resolved by the PP write back */
+struct pipe_resource *
+lima_resource_create_resolved(struct pipe_screen *pscreen,
+                              struct pipe_resource *prsc)
+{
+   struct lima_resource *src = lima_resource(prsc);
+   struct lima_resource *res;
+
+   res = CALLOC_STRUCT(lima_resource);
+   if (!res)
+      return NULL;
+
+   struct pipe_resource *pres = &res->base.b;
+   *pres = *prsc;
+   pres->next = NULL;
+   pres->nr_samples = 0;
+   pipe_reference_init(&pres->reference, 1);
+   threaded_resource_init(pres);
+
+   res->bo = src->bo;
+   lima_bo_reference(res->bo);
+   res->tiled = src->tiled;
+   memcpy(res->levels, src->levels, sizeof(res->levels));
+
+   return pres;
+}
+
 static struct pipe_resource *
 lima_resource_from_handle(struct pipe_screen *pscreen,
         const struct pipe_resource *templat,
@@ -170,11 +365,24 @@ lima_resource_from_handle(struct pipe_screen *pscreen,
    if (!res)
       return NULL;
 
-   struct pipe_resource *pres = &res->base;
+   struct pipe_resource *pres = &res->base.b;
    *pres = *templat;
    pres->screen = pscreen;
    pipe_reference_init(&pres->reference, 1);
-   res->stride = handle->stride;
+   threaded_resource_init(pres);
+   res->base.is_shared = true;
+   res->levels[0].stride = handle->stride;
+   res->levels[0].layer_stride = handle->stride *
+      util_format_get_nblocksy(pres->format, pres->height0);
+   /* the planes of a video frame often share one buffer */
+   res->levels[0].offset = handle->offset;
+
+   /* texture descriptors only hold the upper 26 bits of the address */
+   if (handle->offset & 0x3f) {
+      debug_error("import buffer offset not properly aligned\n");
+      FREE(res);
+      return NULL;
+   }
 
    res->bo = lima_bo_import(screen, handle);
    if (!res->bo) {
@@ -182,8 +390,17 @@ lima_resource_from_handle(struct pipe_screen *pscreen,
       return NULL;
    }
 
-   /* check alignment for the buffer */
-   if (pres->bind & PIPE_BIND_RENDER_TARGET) {
+   if (res->bo->size < handle->offset + res->levels[0].layer_stride) {
+      debug_error("import buffer too small\n");
+      lima_resource_destroy(pscreen, pres);
+      return NULL;
+   }
+
+   /* check alignment for the buffer, the YUV planes are imported with the
+    * render target bind too but are only sampled */
+   if (pres->bind & PIPE_BIND_RENDER_TARGET &&
+       pscreen->is_format_supported(pscreen, pres->format, pres->target, 0,
+                                    PIPE_BIND_RENDER_TARGET)) {
       unsigned width, height, stride, size;
 
       width = align(pres->width0, 16);
@@ -191,7 +408,8 @@ lima_resource_from_handle(struct pipe_screen *pscreen,
       stride = util_format_get_stride(pres->format, width);
       size = util_format_get_2d_size(pres->format, stride, height);
 
-      if (res->stride != stride || res->bo->size < size) {
+      if (res->levels[0].stride != stride ||
+          res->bo->size < handle->offset + size) {
          debug_error("import buffer not properly aligned\n");
          lima_resource_destroy(pscreen, pres);
          return NULL;
@@ -217,10 +435,77 @@ lima_resource_get_handle(struct pipe_screen *pscreen,
    if (!lima_bo_export(res->bo, handle))
       return FALSE;
 
-   handle->stride = res->stride;
+   res->base.is_shared = true;
+   if (handle->type != DRM_API_HANDLE_TYPE_KMS)
+      res->exported = true;
+
+   handle->stride = res->levels[0].stride;
+   handle->offset = res->levels[0].offset;
    return TRUE;
 }
 
+/* the tiles outside of the region aren't rendered to, so they keep the
+ * content of the frame the buffer age tells the application about */
+static void
+lima_resource_set_damage_region(struct pipe_screen *pscreen,
+                                struct pipe_resource *pres,
+                                unsigned int nrects,
+                                const struct pipe_box *rects)
+{
+   struct lima_resource *res = lima_resource(pres);
+   int tiled_w = align(pres->width0, 16) >> 4;
+   int tiled_h = align(pres->height0, 16) >> 4;
+
+   res->has_damage = nrects > 0;
+   if (!nrects)
+      return;
+
+   struct pipe_scissor_state *damage = &res->damage;
+   damage->minx = tiled_w;
+   damage->miny = tiled_h;
+   damage->maxx = 0;
+   damage->maxy = 0;
+
+   for (unsigned i = 0; i < nrects; i++) {
+      const struct pipe_box *rect = rects + i;
+      if (rect->width <= 0 || rect->height <= 0)
+         continue;
+
+      /* the rects have the origin at the bottom left */
+      int minx = CLAMP(rect->x, 0, (int)pres->width0) >> 4;
+      int maxx = align(CLAMP(rect->x + rect->width, 0,
+                             (int)pres->width0), 16) >> 4;
+      int miny = CLAMP((int)pres->height0 - rect->y - rect->height, 0,
+                       (int)pres->height0) >> 4;
+      int maxy = align(CLAMP((int)pres->height0 - rect->y, 0,
+                             (int)pres->height0), 16) >> 4;
+
+      damage->minx = MIN2(damage->minx, minx);
+      damage->miny = MIN2(damage->miny, miny);
+      damage->maxx = MAX2(damage->maxx, maxx);
+      damage->maxy = MAX2(damage->maxy, maxy);
+   }
+
+   /* only empty rects, nothing changes */
+   if (damage->minx > damage->maxx || damage->miny > damage->maxy)
+      damage->minx = damage->maxx = damage->miny = damage->maxy = 0;
+}
+
+static unsigned
+lima_buffer_get_write_serial(struct pipe_screen *pscreen,
+                             struct pipe_resource *pres)
+{
+   struct lima_resource *res = lima_resource(pres);
+
+   /* like for the index cache, persistent maps write without transfer_map
+    * and stream buffers aren't worth caching */
+   if (pres->usage == PIPE_USAGE_STREAM ||
+       pres->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
+      return p_atomic_inc_return(&res->write_serial);
+
+   return p_atomic_read(&res->write_serial);
+}
+
 void
 lima_resource_screen_init(struct lima_screen *screen)
 {
@@ -228,6 +513,20 @@ lima_resource_screen_init(struct lima_screen *screen)
    screen->base.resource_from_handle = lima_resource_from_handle;
    screen->base.resource_destroy = lima_resource_destroy;
    screen->base.resource_get_handle = lima_resource_get_handle;
+   screen->base.set_damage_region = lima_resource_set_damage_region;
+   screen->base.buffer_get_write_serial = lima_buffer_get_write_serial;
+
+   mtx_init(&screen->scanout_cache_lock, mtx_plain);
+   list_inithead(&screen->scanout_cache);
+}
+
+void
+lima_resource_screen_fini(struct lima_screen *screen)
+{
+   list_for_each_entry_safe(struct lima_scanout_cache_entry, entry,
+                            &screen->scanout_cache, link)
+      lima_scanout_cache_entry_free(screen, entry);
+   mtx_destroy(&screen->scanout_cache_lock);
 }
 
 static struct pipe_surface *
@@ -261,12 +560,14 @@ lima_surface_create(struct pipe_context *pctx,
 
    struct lima_context *ctx = lima_context(pctx);
    if (ctx->plb_pp_stream) {
+      mtx_lock(&ctx->plb_pp_stream_lock);
+
       struct lima_ctx_plb_pp_stream_key key = {
          .tiled_w = surf->tiled_w,
          .tiled_h = surf->tiled_h,
       };
 
-      for (int i = 0; i < lima_ctx_num_plb; i++) {
+      for (int i = 0; i < LIMA_CTX_PLB_PP_STREAM_NUM; i++) {
          key.plb_index = i;
 
          struct hash_entry *entry =
@@ -286,6 +587,8 @@ lima_surface_create(struct pipe_context *pctx,
             _mesa_hash_table_insert(ctx->plb_pp_stream, &s->key, s);
          }
       }
+
+      mtx_unlock(&ctx->plb_pp_stream_lock);
    }
 
    debug_printf("%s: pres=%p psurf=%p\n", __func__, pres, psurf);
@@ -300,12 +603,14 @@ lima_surface_destroy(struct pipe_context *pctx, struct pipe_surface *psurf)
    struct lima_context *ctx = lima_context(pctx);
 
    if (ctx->plb_pp_stream) {
+      mtx_lock(&ctx->plb_pp_stream_lock);
+
       struct lima_ctx_plb_pp_stream_key key = {
          .tiled_w = surf->tiled_w,
          .tiled_h = surf->tiled_h,
       };
 
-      for (int i = 0; i < lima_ctx_num_plb; i++) {
+      for (int i = 0; i < LIMA_CTX_PLB_PP_STREAM_NUM; i++) {
          key.plb_index = i;
 
          struct hash_entry *entry =
@@ -318,12 +623,180 @@ lima_surface_destroy(struct pipe_context *pctx, struct pipe_surface *psurf)
             ralloc_free(s);
          }
       }
+
+      mtx_unlock(&ctx->plb_pp_stream_lock);
    }
 
    pipe_resource_reference(&psurf->texture, NULL);
    FREE(surf);
 }
 
+static bool
+lima_resource_bo_busy(struct lima_context *ctx, struct lima_bo *bo, bool write)
+{
+   if (lima_need_flush(ctx, bo, write))
+      return true;
+
+   if (lima_ctx_bo_idle(ctx, bo, write))
+      return false;
+
+   unsigned op = write ? LIMA_GEM_WAIT_WRITE : LIMA_GEM_WAIT_READ;
+   return !lima_bo_wait(bo, op, 0);
+}
+
+/* Give a busy resource a fresh backing bo so that the caller can write
+ * it without waiting for the GPU, jobs still using the old bo hold their
+ * own reference to it. When keep_content is set the old content is copied
+ * over, which is only possible when the GPU is not writing the old bo.
+ */
+static bool
+lima_resource_rename(struct lima_context *ctx, struct lima_resource *res,
+                     bool keep_content)
+{
+   struct lima_screen *screen = lima_screen(ctx->base.screen);
+   struct pipe_resource *pres = &res->base.b;
+   struct lima_bo *old = res->bo;
+
+   /* shared bos can't be replaced behind the other users' back, pending
+    * draws to a render target resolve to res->bo at flush time, and a
+    * persistent mapping must keep pointing to the bo the GPU uses */
+   if (res->scanout || !old->cacheable ||
+       pres->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL) ||
+       pres->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
+      return false;
+
+   if (keep_content) {
+      if (lima_resource_bo_busy(ctx, old, false) ||
+          !lima_bo_update(old, true, false))
+         return false;
+   }
+
+   struct lima_bo *bo = lima_bo_create(screen, old->size, old->flags,
+                                       keep_content ||
+                                       pres->target == PIPE_BUFFER, false);
+   if (!bo)
+      return false;
+
+   if (keep_content)
+      memcpy(bo->map, old->map, old->size);
+
+   res->bo = bo;
+   lima_bo_free(old);
+
+   /* texture descriptors hold the bo address */
+   if (pres->target != PIPE_BUFFER)
+      ctx->dirty |= LIMA_CONTEXT_DIRTY_TEXTURES;
+
+   return true;
+}
+
+/* bos are mapped write-combined, so reads are uncached. Read back maps of
+ * staging resources and of render targets, which is how glReadPixels gets
+ * at the pixels, get a copy in cached memory made by one pass of
+ * sequential loads, the readers' scattered and per pixel accesses then
+ * run at memory speed. */
+static bool
+lima_transfer_should_copy_read(struct pipe_resource *pres, unsigned usage)
+{
+   if (pres->usage != PIPE_USAGE_STAGING &&
+       !(pres->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL)))
+      return false;
+
+   return usage & PIPE_TRANSFER_READ &&
+      !(usage & (PIPE_TRANSFER_WRITE | PIPE_TRANSFER_MAP_DIRECTLY |
+                 PIPE_TRANSFER_PERSISTENT | PIPE_TRANSFER_COHERENT));
+}
+
+/* Writes discarding a box of a busy render target texture go to a fresh
+ * staging texture instead, which the PP copies to the texture on unmap.
+ * The CPU doesn't wait and the copy is ordered after the jobs already
+ * using the texture. Only what lima_blit_dst_supported() accepts can be
+ * copied on the PP. */
+static bool
+lima_transfer_should_stage(struct lima_context *ctx, struct lima_resource *res,
+                           unsigned level, unsigned usage,
+                           const struct pipe_box *box)
+{
+   struct pipe_resource *pres = &res->base.b;
+
+   if (pres->target == PIPE_BUFFER || !lima_transfer_usage_can_stage(usage))
+      return false;
+
+   if (!lima_blit_dst_supported(pres, level, box))
+      return false;
+
+   if (!pres->screen->is_format_supported(pres->screen, pres->format,
+                                          PIPE_TEXTURE_2D, 0,
+                                          PIPE_BIND_SAMPLER_VIEW))
+      return false;
+
+   return lima_resource_bo_busy(ctx, res->bo, true);
+}
+
+static void *
+lima_transfer_map_staging(struct lima_context *ctx, struct pipe_resource *pres,
+                          unsigned level, unsigned usage,
+                          const struct pipe_box *box,
+                          struct pipe_transfer **pptrans)
+{
+   struct pipe_context *pctx = &ctx->base;
+   struct pipe_resource tmpl = {
+      .target = PIPE_TEXTURE_2D,
+      .format = pres->format,
+      .width0 = box->width,
+      .height0 = box->height,
+      .depth0 = 1,
+      .array_size = 1,
+      .usage = PIPE_USAGE_STAGING,
+      .bind = PIPE_BIND_SAMPLER_VIEW | PIPE_BIND_LINEAR,
+   };
+
+   struct pipe_resource *staging =
+      pctx->screen->resource_create(pctx->screen, &tmpl);
+   if (!staging)
+      return NULL;
+
+   struct pipe_box staging_box;
+   struct pipe_transfer *staging_transfer;
+   u_box_2d(0, 0, box->width, box->height, &staging_box);
+   void *map = pctx->transfer_map(pctx, staging, 0, PIPE_TRANSFER_WRITE,
+                                  &staging_box, &staging_transfer);
+   if (!map)
+      goto err_out0;
+
+   struct lima_transfer *trans = slab_alloc(&ctx->transfer_pool);
+   if (!trans)
+      goto err_out1;
+
+   /* draws recorded before the write still read the old content */
+   if (lima_need_flush(ctx, lima_resource(pres)->bo, true)) {
+      ctx->stats[LIMA_QUERY_TRANSFER_FLUSHES]++;
+      lima_flush(ctx);
+   }
+
+   memset(trans, 0, sizeof(*trans));
+   struct pipe_transfer *ptrans = &trans->base.b;
+
+   pipe_resource_reference(&ptrans->resource, pres);
+   ptrans->level = level;
+   ptrans->usage = usage;
+   ptrans->box = *box;
+   ptrans->stride = staging_transfer->stride;
+   ptrans->layer_stride = staging_transfer->layer_stride;
+
+   trans->staging_res = staging;
+   trans->staging_transfer = staging_transfer;
+
+   *pptrans = ptrans;
+   return map;
+
+err_out1:
+   pctx->transfer_unmap(pctx, staging_transfer);
+err_out0:
+   pipe_resource_reference(&staging, NULL);
+   return NULL;
+}
+
 static void *
 lima_transfer_map(struct pipe_context *pctx,
                   struct pipe_resource *pres,
@@ -334,44 +807,146 @@ lima_transfer_map(struct pipe_context *pctx,
 {
    struct lima_context *ctx = lima_context(pctx);
    struct lima_resource *res = lima_resource(pres);
-   struct lima_bo *bo = res->bo;
+   struct lima_bo *bo;
    struct lima_transfer *trans;
    struct pipe_transfer *ptrans;
 
    debug_printf("%s: pres=%p\n", __func__, pres);
 
+   if (usage & PIPE_TRANSFER_WRITE)
+      p_atomic_inc(&res->write_serial);
+
+   if (lima_transfer_should_stage(ctx, res, level, usage, box)) {
+      void *map = lima_transfer_map_staging(ctx, pres, level, usage, box,
+                                            pptrans);
+      if (map)
+         return map;
+   }
+
    /* use once buffers are made sure to not read/write overlapped
     * range, so no need to sync */
-   if (pres->usage != PIPE_USAGE_STREAM) {
-      if (usage & PIPE_TRANSFER_READ_WRITE) {
-         if (lima_need_flush(ctx, bo, usage & PIPE_TRANSFER_WRITE))
+   if (pres->usage != PIPE_USAGE_STREAM &&
+       !(usage & PIPE_TRANSFER_UNSYNCHRONIZED) &&
+       usage & PIPE_TRANSFER_READ_WRITE) {
+      bool write = usage & PIPE_TRANSFER_WRITE;
+      bool renamed = false;
+
+      /* discarded content doesn't need to wait for the GPU, only the
+       * untouched part of a buffer needs to be carried over, the threaded
+       * context does its own buffer invalidation */
+      if (write && !(usage & TC_TRANSFER_MAP_NO_INVALIDATE) &&
+          lima_resource_bo_busy(ctx, res->bo, true)) {
+         if (usage & PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE)
+            renamed = lima_resource_rename(ctx, res, false);
+         else if (usage & PIPE_TRANSFER_DISCARD_RANGE &&
+                  pres->target == PIPE_BUFFER)
+            renamed = lima_resource_rename(ctx, res, true);
+      }
+
+      if (!renamed) {
+         struct lima_screen *screen = lima_screen(pres->screen);
+         int64_t trace_begin = lima_trace_begin(screen);
+
+         if (lima_need_flush(ctx, res->bo, write)) {
+            ctx->stats[LIMA_QUERY_TRANSFER_FLUSHES]++;
             lima_flush(ctx);
+         }
 
-         unsigned op = usage & PIPE_TRANSFER_WRITE ?
-            LIMA_GEM_WAIT_WRITE : LIMA_GEM_WAIT_READ;
-         lima_bo_wait(bo, op, PIPE_TIMEOUT_INFINITE);
+         /* the flush above got the GPU going, the caller comes back
+          * once the fence of the jobs using the bo has signaled */
+         if (usage & PIPE_TRANSFER_DONTBLOCK &&
+             lima_resource_bo_busy(ctx, res->bo, write)) {
+            lima_trace_end(screen, "transfer map sync", trace_begin);
+            return NULL;
+         }
+
+         if (!lima_ctx_bo_idle(ctx, res->bo, write)) {
+            unsigned op = write ? LIMA_GEM_WAIT_WRITE : LIMA_GEM_WAIT_READ;
+            int64_t start = os_time_get();
+            lima_bo_wait(res->bo, op, PIPE_TIMEOUT_INFINITE);
+            ctx->stats[LIMA_QUERY_BO_WAIT_TIME] += os_time_get() - start;
+         }
+
+         lima_trace_end(screen, "transfer map sync", trace_begin);
       }
    }
 
+   /* tiled textures can only be accessed through a linear staging copy */
+   if (res->tiled && usage & PIPE_TRANSFER_MAP_DIRECTLY)
+      return NULL;
+
+   bo = res->bo;
    if (!lima_bo_update(bo, true, false))
       return NULL;
 
-   trans = slab_alloc(&ctx->transfer_pool);
+   /* unsynchronized maps of the threaded context don't come from the
+    * driver thread, they're freed on unmap in the driver thread though */
+   if (usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+      trans = slab_alloc(&ctx->transfer_pool_unsync);
+   else
+      trans = slab_alloc(&ctx->transfer_pool);
    if (!trans)
       return NULL;
 
    memset(trans, 0, sizeof(*trans));
-   ptrans = &trans->base;
+   ptrans = &trans->base.b;
 
    pipe_resource_reference(&ptrans->resource, pres);
    ptrans->level = level;
    ptrans->usage = usage;
    ptrans->box = *box;
-   ptrans->stride = res->stride;
+   ptrans->stride = res->levels[level].stride;
+   ptrans->layer_stride = res->levels[level].layer_stride;
+
+   void *map = bo->map + res->levels[level].offset;
+
+   if (res->tiled) {
+      ptrans->stride = util_format_get_stride(pres->format, box->width);
+      ptrans->layer_stride = ptrans->stride * box->height;
+
+      trans->staging = malloc(ptrans->layer_stride);
+      if (!trans->staging) {
+         pipe_resource_reference(&ptrans->resource, NULL);
+         slab_free(&ctx->transfer_pool, trans);
+         return NULL;
+      }
+
+      if (usage & PIPE_TRANSFER_READ)
+         lima_load_tiled_image(trans->staging, map,
+                               box->x, box->y, box->width, box->height,
+                               ptrans->stride, res->levels[level].stride,
+                               util_format_get_blocksize(pres->format));
+
+      *pptrans = ptrans;
+      return trans->staging;
+   }
+
+   if (lima_transfer_should_copy_read(pres, usage)) {
+      unsigned nblocksx = util_format_get_nblocksx(pres->format, box->width);
+      unsigned nblocksy = util_format_get_nblocksy(pres->format, box->height);
+      unsigned row_size = nblocksx * util_format_get_blocksize(pres->format);
+      void *src = map + box->z * ptrans->layer_stride +
+         box->y / util_format_get_blockheight(pres->format) * ptrans->stride +
+         box->x / util_format_get_blockwidth(pres->format) *
+         util_format_get_blocksize(pres->format);
+
+      trans->staging = malloc(row_size * nblocksy * box->depth);
+      if (trans->staging) {
+         util_copy_box(trans->staging, pres->format, row_size,
+                       row_size * nblocksy, 0, 0, 0,
+                       box->width, box->height, box->depth,
+                       src, ptrans->stride, ptrans->layer_stride, 0, 0, 0);
+
+         ptrans->stride = row_size;
+         ptrans->layer_stride = row_size * nblocksy;
+         *pptrans = ptrans;
+         return trans->staging;
+      }
+   }
 
    *pptrans = ptrans;
 
-   return bo->map + box->z * ptrans->layer_stride +
+   return map + box->z * ptrans->layer_stride +
       box->y / util_format_get_blockheight(pres->format) * ptrans->stride +
       box->x / util_format_get_blockwidth(pres->format) *
       util_format_get_blocksize(pres->format);
@@ -382,6 +957,9 @@ lima_transfer_flush_region(struct pipe_context *pctx,
                            struct pipe_transfer *ptrans,
                            const struct pipe_box *box)
 {
+   /* bo mappings are write-combined and the bo stays mapped until it's
+    * destroyed, so CPU writes reach memory by the time a job using them
+    * is submitted and persistent mappings are coherent as they are */
    debug_checkpoint();
 }
 
@@ -392,10 +970,179 @@ lima_transfer_unmap(struct pipe_context *pctx,
    struct lima_context *ctx = lima_context(pctx);
    struct lima_transfer *trans = lima_transfer(ptrans);
 
+   if (trans->staging_res) {
+      struct pipe_box *box = &ptrans->box;
+      struct pipe_box src_box;
+
+      pctx->transfer_unmap(pctx, trans->staging_transfer);
+
+      u_box_2d(0, 0, box->width, box->height, &src_box);
+      pctx->resource_copy_region(pctx, ptrans->resource, ptrans->level,
+                                 box->x, box->y, box->z,
+                                 trans->staging_res, 0, &src_box);
+      pipe_resource_reference(&trans->staging_res, NULL);
+   }
+
+   if (trans->staging) {
+      struct lima_resource *res = lima_resource(ptrans->resource);
+      struct pipe_box *box = &ptrans->box;
+
+      if (ptrans->usage & PIPE_TRANSFER_WRITE)
+         lima_store_tiled_image(res->bo->map + res->levels[ptrans->level].offset,
+                                trans->staging,
+                                box->x, box->y, box->width, box->height,
+                                res->levels[ptrans->level].stride, ptrans->stride,
+                                util_format_get_blocksize(ptrans->resource->format));
+      free(trans->staging);
+   }
+
    pipe_resource_reference(&ptrans->resource, NULL);
    slab_free(&ctx->transfer_pool, trans);
 }
 
+static bool
+lima_mipmap_format_supported(enum pipe_format format)
+{
+   const struct util_format_description *desc = util_format_description(format);
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB)
+      return false;
+
+   for (int i = 0; i < desc->nr_channels; i++) {
+      const struct util_format_channel_description *c = desc->channel + i;
+      if (c->size != 8)
+         return false;
+      if (c->type != UTIL_FORMAT_TYPE_VOID &&
+          !(c->type == UTIL_FORMAT_TYPE_UNSIGNED && c->normalized))
+         return false;
+   }
+
+   return true;
+}
+
+/* 2x2 box filter, edge texels are repeated for odd sizes */
+static void
+lima_mipmap_box_filter(uint8_t *dst, unsigned dst_stride,
+                       unsigned dst_width, unsigned dst_height,
+                       const uint8_t *src, unsigned src_stride,
+                       unsigned src_width, unsigned src_height,
+                       unsigned cpp)
+{
+   for (unsigned y = 0; y < dst_height; y++) {
+      const uint8_t *row0 = src + MIN2(y * 2, src_height - 1) * src_stride;
+      const uint8_t *row1 = src + MIN2(y * 2 + 1, src_height - 1) * src_stride;
+      uint8_t *d = dst + y * dst_stride;
+
+      for (unsigned x = 0; x < dst_width; x++) {
+         unsigned x0 = MIN2(x * 2, src_width - 1) * cpp;
+         unsigned x1 = MIN2(x * 2 + 1, src_width - 1) * cpp;
+
+         for (unsigned c = 0; c < cpp; c++)
+            d[x * cpp + c] = (row0[x0 + c] + row0[x1 + c] +
+                              row1[x0 + c] + row1[x1 + c] + 2) >> 2;
+      }
+   }
+}
+
+static boolean
+lima_generate_mipmap(struct pipe_context *pctx,
+                     struct pipe_resource *prsc,
+                     enum pipe_format format,
+                     unsigned base_level,
+                     unsigned last_level,
+                     unsigned first_layer,
+                     unsigned last_layer)
+{
+   struct pipe_box box;
+   u_box_2d(0, 0, prsc->width0, prsc->height0, &box);
+
+   /* whole levels can always be drawn to when the PP can draw to the
+    * resource at all */
+   if (lima_blit_dst_supported(prsc, base_level, &box) &&
+       util_gen_mipmap(pctx, prsc, format, base_level, last_level,
+                       first_layer, last_layer, PIPE_TEX_FILTER_LINEAR))
+      return TRUE;
+
+   /* filter on the CPU where it's cheap, everything else falls back to
+    * the state tracker */
+   if (format != prsc->format || !lima_mipmap_format_supported(format) ||
+       (prsc->target != PIPE_TEXTURE_2D && prsc->target != PIPE_TEXTURE_RECT))
+      return FALSE;
+
+   unsigned cpp = util_format_get_blocksize(format);
+
+   for (unsigned layer = first_layer; layer <= last_layer; layer++) {
+      for (unsigned level = base_level + 1; level <= last_level; level++) {
+         struct pipe_transfer *src_trans, *dst_trans;
+         struct pipe_box src_box, dst_box;
+         unsigned src_width = u_minify(prsc->width0, level - 1);
+         unsigned src_height = u_minify(prsc->height0, level - 1);
+         unsigned dst_width = u_minify(prsc->width0, level);
+         unsigned dst_height = u_minify(prsc->height0, level);
+
+         u_box_2d_zslice(0, 0, layer, src_width, src_height, &src_box);
+         u_box_2d_zslice(0, 0, layer, dst_width, dst_height, &dst_box);
+
+         const uint8_t *src =
+            pctx->transfer_map(pctx, prsc, level - 1, PIPE_TRANSFER_READ,
+                               &src_box, &src_trans);
+         if (!src)
+            return FALSE;
+
+         uint8_t *dst =
+            pctx->transfer_map(pctx, prsc, level,
+                               PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE,
+                               &dst_box, &dst_trans);
+         if (!dst) {
+            pctx->transfer_unmap(pctx, src_trans);
+            return FALSE;
+         }
+
+         lima_mipmap_box_filter(dst, dst_trans->stride, dst_width, dst_height,
+                                src, src_trans->stride, src_width, src_height,
+                                cpp);
+
+         pctx->transfer_unmap(pctx, dst_trans);
+         pctx->transfer_unmap(pctx, src_trans);
+      }
+   }
+
+   return TRUE;
+}
+
+/* called in the driver thread for buffers the threaded context
+ * invalidated, jobs still using the old bo hold their own reference */
+void
+lima_replace_buffer_storage(struct pipe_context *pctx,
+                            struct pipe_resource *dst,
+                            struct pipe_resource *src)
+{
+   struct lima_resource *rdst = lima_resource(dst);
+   struct lima_resource *rsrc = lima_resource(src);
+
+   /* draws read buffer addresses at draw time, nothing to rebind */
+   lima_bo_reference(rsrc->bo);
+   lima_bo_free(rdst->bo);
+   rdst->bo = rsrc->bo;
+   p_atomic_inc(&rdst->write_serial);
+}
+
+static void
+lima_invalidate_resource(struct pipe_context *pctx, struct pipe_resource *prsc)
+{
+   struct lima_context *ctx = lima_context(pctx);
+   struct lima_resource *res = lima_resource(prsc);
+
+   if (prsc->target == PIPE_BUFFER) {
+      if (lima_resource_bo_busy(ctx, res->bo, true))
+         lima_resource_rename(ctx, res, false);
+      return;
+   }
+
+   lima_job_invalidate_resource(ctx, prsc);
+}
+
 static void
 lima_flush_resource(struct pipe_context *pctx, struct pipe_resource *resource)
 {
@@ -417,4 +1164,7 @@ lima_resource_context_init(struct lima_context *ctx)
    ctx->base.transfer_unmap = lima_transfer_unmap;
 
    ctx->base.flush_resource = lima_flush_resource;
+   ctx->base.invalidate_resource = lima_invalidate_resource;
+
+   ctx->base.generate_mipmap = lima_generate_mipmap;
 }
@@ -26,15 +26,58 @@
 #define H_LIMA_RESOURCE
 
 #include "pipe/p_state.h"
+#include "util/u_threaded_context.h"
 
-struct lima_screen;
+#include "lima_screen.h"
+
+struct lima_resource_level {
+   uint32_t stride;
+   uint32_t layer_stride;
+   uint32_t offset;
+};
+
+#define LIMA_INDEX_CACHE_SIZE 8
+
+struct lima_index_cache_entry {
+   uint32_t offset;
+   uint32_t count;
+   uint32_t restart_index;
+   uint8_t index_size;
+   bool primitive_restart;
+
+   uint32_t min_index;
+   uint32_t max_index;
+};
+
+/* index bounds of the ranges drawn from an index buffer, only used in
+ * the driver thread and dropped when write_serial changes */
+struct lima_index_cache {
+   unsigned serial;
+   unsigned num;
+   unsigned next;
+   struct lima_index_cache_entry entries[LIMA_INDEX_CACHE_SIZE];
+};
 
 struct lima_resource {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    struct renderonly_scanout *scanout;
    struct lima_bo *bo;
-   uint32_t stride;
+   bool tiled;
+   /* the bo went to another process, the scanout can't be reused */
+   bool exported;
+   /* tiles the current frame changes, from EGL_KHR_partial_update */
+   bool has_damage;
+   struct pipe_scissor_state damage;
+   /* estimated polygon list bytes of the last frame drawn to it */
+   uint32_t plb_usage;
+
+   struct lima_resource_level levels[LIMA_MAX_MIP_LEVELS];
+
+   /* bumped on each CPU write, unsynchronized maps of the threaded
+    * context come from the application thread */
+   unsigned write_serial;
+   struct lima_index_cache *index_cache;
 };
 
 struct lima_surface {
@@ -43,7 +86,11 @@ struct lima_surface {
 };
 
 struct lima_transfer {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
+   void *staging;
+   /* linear resource the PP copies to the mapped one on unmap */
+   struct pipe_resource *staging_res;
+   struct pipe_transfer *staging_transfer;
 };
 
 static inline struct lima_resource *
@@ -64,10 +111,35 @@ lima_transfer(struct pipe_transfer *trans)
    return (struct lima_transfer *)trans;
 }
 
+/* The staging texture of a map is copied whole to the texture on unmap,
+ * so only a write discarding the old content of the box can go to one. */
+static inline bool
+lima_transfer_usage_can_stage(unsigned usage)
+{
+   return usage & PIPE_TRANSFER_WRITE &&
+      usage & (PIPE_TRANSFER_DISCARD_RANGE |
+               PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE) &&
+      !(usage & (PIPE_TRANSFER_READ | PIPE_TRANSFER_UNSYNCHRONIZED |
+                 PIPE_TRANSFER_MAP_DIRECTLY | PIPE_TRANSFER_PERSISTENT |
+                 TC_TRANSFER_MAP_THREADED_UNSYNC));
+}
+
 void
 lima_resource_screen_init(struct lima_screen *screen);
 
+void
+lima_resource_screen_fini(struct lima_screen *screen);
+
 void
 lima_resource_context_init(struct lima_context *ctx);
 
+struct pipe_resource *
+lima_resource_create_resolved(struct pipe_screen *pscreen,
+                              struct pipe_resource *prsc);
+
+void
+lima_replace_buffer_storage(struct pipe_context *pctx,
+                            struct pipe_resource *dst,
+                            struct pipe_resource *src);
+
 #endif
@@ -23,9 +23,11 @@
  */
 
 #include <string.h>
+#include <unistd.h>
 
 #include "util/ralloc.h"
 #include "util/u_debug.h"
+#include "util/u_format.h"
 #include "renderonly/renderonly.h"
 
 #include "lima_screen.h"
@@ -35,6 +37,8 @@
 #include "lima_vamgr.h"
 #include "lima_bo.h"
 #include "lima_fence.h"
+#include "lima_capture.h"
+#include "lima_trace.h"
 #include "ir/lima_ir.h"
 
 #include "xf86drm.h"
@@ -50,22 +54,36 @@ lima_screen_destroy(struct pipe_screen *pscreen)
       lima_dump_command_stream = NULL;
    }
 
+   if (screen->capture)
+      lima_capture_destroy(screen->capture);
+
+   if (screen->trace)
+      lima_trace_destroy(screen->trace);
+
    slab_destroy_parent(&screen->transfer_pool);
 
+   lima_resource_screen_fini(screen);
+
    if (screen->ro)
       free(screen->ro);
 
-   if (screen->gp_buffer)
-      lima_bo_free(screen->gp_buffer);
-
    if (screen->pp_buffer)
       lima_bo_free(screen->pp_buffer);
 
+   lima_draw_screen_fini(screen);
+   lima_program_screen_fini(screen);
+   lima_bo_cache_fini(screen);
    lima_bo_table_fini(screen);
    lima_vamgr_fini(screen);
    ralloc_free(screen);
 }
 
+static struct disk_cache *
+lima_screen_get_disk_shader_cache(struct pipe_screen *pscreen)
+{
+   return lima_screen(pscreen)->disk_cache;
+}
+
 static const char *
 lima_screen_get_name(struct pipe_screen *pscreen)
 {
@@ -104,13 +122,19 @@ lima_screen_get_param(struct pipe_screen *pscreen, enum pipe_cap param)
    case PIPE_CAP_ACCELERATED:
    case PIPE_CAP_UMA:
    case PIPE_CAP_ALLOW_MAPPED_BUFFERS_DURING_EXECUTION:
-   case PIPE_CAP_FORCE_COMPUTE_MINMAX_INDICES:
+   case PIPE_CAP_BUFFER_MAP_PERSISTENT_COHERENT:
    case PIPE_CAP_NATIVE_FENCE_FD:
+   case PIPE_CAP_INVALIDATE_BUFFER:
+   case PIPE_CAP_VERTEX_ELEMENT_INSTANCE_DIVISOR:
+   case PIPE_CAP_PRIMITIVE_RESTART:
+   case PIPE_CAP_POINT_SPRITE:
+   case PIPE_CAP_CONDITIONAL_RENDER:
+   case PIPE_CAP_CONDITIONAL_RENDER_INVERTED:
+   case PIPE_CAP_CLEAR_SCISSORED:
       return 1;
 
-   /* Unimplemented, but for exporting OpenGL 2.0 */
+   /* only the predicates, see lima_query.c, for exporting OpenGL 2.0 */
    case PIPE_CAP_OCCLUSION_QUERY:
-   case PIPE_CAP_POINT_SPRITE:
       return 1;
 
    case PIPE_CAP_MAX_TEXTURE_2D_LEVELS:
@@ -160,7 +184,7 @@ get_vertex_shader_param(struct lima_screen *screen,
       return LIMA_MAX_VARYING_NUM; /* varying */
 
    case PIPE_SHADER_CAP_MAX_CONST_BUFFER_SIZE:
-      return 4096; /* need investigate */
+      return LIMA_MAX_CONST_BUFFER_SIZE; /* need investigate */
    case PIPE_SHADER_CAP_MAX_CONST_BUFFERS:
       return 1;
 
@@ -181,13 +205,18 @@ get_fragment_shader_param(struct lima_screen *screen,
       return LIMA_MAX_VARYING_NUM - 1; /* varying, minus gl_Position */
 
    case PIPE_SHADER_CAP_MAX_CONST_BUFFER_SIZE:
-      return 4096; /* need investigate */
+      return LIMA_MAX_CONST_BUFFER_SIZE; /* need investigate */
    case PIPE_SHADER_CAP_MAX_CONST_BUFFERS:
       return 1;
 
    case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
       return 16; /* need investigate */
 
+   /* dependent texture loads are plain instrs on the PP, a low limit
+    * here would make the GLSL linker stop packing varyings */
+   case PIPE_SHADER_CAP_MAX_TEX_INDIRECTIONS:
+      return 16384;
+
    case PIPE_SHADER_CAP_PREFERRED_IR:
       return PIPE_SHADER_IR_NIR;
 
@@ -214,6 +243,39 @@ lima_screen_get_shader_param(struct pipe_screen *pscreen,
    }
 }
 
+/* The GP fetches 1 to 4 channels of the same type in memory order,
+ * converting them to floats: 8, 16 and 32 bit normalized or scaled
+ * integers, 16 and 32 bit floats and 16.16 fixed point. Packed formats
+ * like 10_10_10_2, swizzled ones like BGRA and pure integers have no
+ * attribute type, u_vbuf translates those. */
+static bool
+lima_format_vertex_supported(enum pipe_format format)
+{
+   const struct util_format_description *desc = util_format_description(format);
+
+   if (!desc || desc->layout != UTIL_FORMAT_LAYOUT_PLAIN || !desc->is_array ||
+       util_format_is_pure_integer(format))
+      return false;
+
+   for (unsigned i = 0; i < desc->nr_channels; i++) {
+      if (desc->swizzle[i] != PIPE_SWIZZLE_X + i)
+         return false;
+   }
+
+   const struct util_format_channel_description *c = desc->channel;
+   switch (c->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      return c->size == 16 || c->size == 32;
+   case UTIL_FORMAT_TYPE_FIXED:
+      return c->size == 32;
+   case UTIL_FORMAT_TYPE_SIGNED:
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      return c->size == 8 || c->size == 16 || c->size == 32;
+   default:
+      return false;
+   }
+}
+
 static boolean
 lima_screen_is_format_supported(struct pipe_screen *pscreen,
                                 enum pipe_format format,
@@ -229,8 +291,13 @@ lima_screen_is_format_supported(struct pipe_screen *pscreen,
       return FALSE;
    }
 
-   if (sample_count)
-      return FALSE;
+   /* 4x MSAA is only in the tile buffer, the resource holds the resolved
+    * pixels and can't be sampled per sample */
+   if (sample_count > 1) {
+      if (sample_count != 4 || target != PIPE_TEXTURE_2D ||
+          usage & ~(PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL))
+         return FALSE;
+   }
 
    if (usage & PIPE_BIND_RENDER_TARGET) {
       switch (format) {
@@ -238,6 +305,9 @@ lima_screen_is_format_supported(struct pipe_screen *pscreen,
       case PIPE_FORMAT_B8G8R8X8_UNORM:
       case PIPE_FORMAT_R8G8B8A8_UNORM:
       case PIPE_FORMAT_R8G8B8X8_UNORM:
+      case PIPE_FORMAT_B5G6R5_UNORM:
+      case PIPE_FORMAT_B5G5R5A1_UNORM:
+      case PIPE_FORMAT_B4G4R4A4_UNORM:
          break;
       default:
          return FALSE;
@@ -256,12 +326,8 @@ lima_screen_is_format_supported(struct pipe_screen *pscreen,
    }
 
    if (usage & PIPE_BIND_VERTEX_BUFFER) {
-      switch (format) {
-      case PIPE_FORMAT_R32G32B32_FLOAT:
-         break;
-      default:
+      if (!lima_format_vertex_supported(format))
          return FALSE;
-      }
    }
 
    if (usage & PIPE_BIND_INDEX_BUFFER) {
@@ -281,6 +347,16 @@ lima_screen_is_format_supported(struct pipe_screen *pscreen,
       case PIPE_FORMAT_R8G8B8A8_UNORM:
       case PIPE_FORMAT_B8G8R8X8_UNORM:
       case PIPE_FORMAT_B8G8R8A8_UNORM:
+      case PIPE_FORMAT_B5G6R5_UNORM:
+      case PIPE_FORMAT_B5G5R5A1_UNORM:
+      case PIPE_FORMAT_B4G4R4A4_UNORM:
+      case PIPE_FORMAT_L8_UNORM:
+      case PIPE_FORMAT_A8_UNORM:
+      case PIPE_FORMAT_I8_UNORM:
+      case PIPE_FORMAT_L8A8_UNORM:
+      case PIPE_FORMAT_R8_UNORM:
+      case PIPE_FORMAT_R8G8_UNORM:
+      case PIPE_FORMAT_ETC1_RGB8:
          break;
       default:
          return FALSE;
@@ -302,7 +378,7 @@ lima_screen_get_compiler_options(struct pipe_screen *pscreen,
 static bool
 lima_screen_query_info(struct lima_screen *screen)
 {
-   struct drm_lima_info drm_info;
+   struct drm_lima_info drm_info = {0};
 
    if (drmIoctl(screen->fd, DRM_IOCTL_LIMA_INFO, &drm_info))
       return false;
@@ -324,6 +400,8 @@ lima_screen_query_info(struct lima_screen *screen)
 
 bool lima_shader_debug_gp = false;
 bool lima_shader_debug_pp = false;
+bool lima_fp16_varying = false;
+int lima_shader_threads = 0;
 
 static void
 lima_screen_parse_env(void)
@@ -357,6 +435,33 @@ lima_screen_parse_env(void)
                  dump_command);
    }
 
+   /* like the KHR_parallel_shader_compile hint, 0 compiles every shader
+    * when it is created */
+   int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   lima_shader_threads =
+      debug_get_num_option("LIMA_SHADER_THREADS", MAX2(num_cpus - 1, 0));
+   if (lima_shader_threads < 0 || lima_shader_threads > LIMA_MAX_SHADER_THREADS) {
+      fprintf(stderr, "lima: LIMA_SHADER_THREADS %d out of range [0 %d]\n",
+              lima_shader_threads, LIMA_MAX_SHADER_THREADS);
+      lima_shader_threads = CLAMP(lima_shader_threads, 0, LIMA_MAX_SHADER_THREADS);
+   }
+
+   /* highp varyings in fp16 too, for apps without precision qualifiers */
+   lima_fp16_varying = debug_get_bool_option("LIMA_FP16_VARYING", false);
+   if (lima_fp16_varying)
+      printf("lima: enable fp16 varyings\n");
+
+   lima_async_submit = debug_get_bool_option("LIMA_ASYNC_SUBMIT", false);
+   if (lima_async_submit)
+      printf("lima: enable async submit\n");
+
+   lima_pp_balance = debug_get_bool_option("LIMA_PP_BALANCE", false);
+   if (lima_pp_balance)
+      printf("lima: enable pp tile balance\n");
+
+   /* a PLB count set by the user is kept, otherwise it's only the
+    * initial size of the ring */
+   lima_ctx_plb_adaptive = !debug_get_option("LIMA_CTX_NUM_PLB", NULL);
    lima_ctx_num_plb = debug_get_num_option("LIMA_CTX_NUM_PLB", LIMA_CTX_PLB_DEF_NUM);
    if (lima_ctx_num_plb > LIMA_CTX_PLB_MAX_NUM ||
        lima_ctx_num_plb < LIMA_CTX_PLB_MIN_NUM) {
@@ -387,15 +492,18 @@ lima_screen_create(int fd, struct renderonly *ro)
    if (!lima_bo_table_init(screen))
       goto err_out1;
 
-   screen->pp_ra = ppir_regalloc_init(screen);
-   if (!screen->pp_ra)
-      goto err_out2;
+   lima_bo_cache_init(screen);
+   lima_program_screen_init(screen);
 
-   screen->gp_buffer = lima_bo_create(screen, gp_buffer_size, 0, false, true);
-   if (!screen->gp_buffer)
+   if (!lima_draw_screen_init(screen))
       goto err_out2;
 
-   screen->pp_buffer = lima_bo_create(screen, pp_buffer_size, 0, true, true);
+   screen->pp_ra = ppir_regalloc_init(screen);
+   if (!screen->pp_ra)
+      goto err_out3;
+
+   screen->pp_buffer = lima_bo_create(screen, pp_buffer_size(screen->num_pp),
+                                      0, true, true);
    if (!screen->pp_buffer)
       goto err_out3;
 
@@ -431,9 +539,11 @@ lima_screen_create(int fd, struct renderonly *ro)
    screen->base.context_create = lima_context_create;
    screen->base.is_format_supported = lima_screen_is_format_supported;
    screen->base.get_compiler_options = lima_screen_get_compiler_options;
+   screen->base.get_disk_shader_cache = lima_screen_get_disk_shader_cache;
 
    lima_resource_screen_init(screen);
    lima_fence_screen_init(screen);
+   lima_query_screen_init(screen);
 
    slab_create_parent(&screen->transfer_pool, sizeof(struct lima_transfer), 16);
 
@@ -441,13 +551,35 @@ lima_screen_create(int fd, struct renderonly *ro)
 
    lima_screen_parse_env();
 
+   const char *capture = debug_get_option("LIMA_CAPTURE", NULL);
+   if (capture) {
+      screen->capture = lima_capture_create(screen, capture);
+      if (screen->capture)
+         printf("lima: capture submits to file %s\n", capture);
+      else
+         fprintf(stderr, "lima: fail to open capture file %s\n", capture);
+   }
+
+   const char *trace = debug_get_option("LIMA_TRACE", NULL);
+   if (trace) {
+      screen->trace = lima_trace_create(screen, trace);
+      if (screen->trace)
+         printf("lima: trace to file %s\n", trace);
+      else
+         fprintf(stderr, "lima: fail to open trace file %s\n", trace);
+   }
+   lima_program_disk_cache_init(screen);
+   lima_program_compile_queue_init(screen);
+
    return &screen->base;
 
 err_out4:
    lima_bo_free(screen->pp_buffer);
 err_out3:
-   lima_bo_free(screen->gp_buffer);
+   lima_draw_screen_fini(screen);
 err_out2:
+   lima_program_screen_fini(screen);
+   lima_bo_cache_fini(screen);
    lima_bo_table_fini(screen);
 err_out1:
    lima_vamgr_fini(screen);
@@ -29,17 +29,23 @@
 
 #include "util/slab.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "os/os_thread.h"
 
 #include "pipe/p_screen.h"
 
 extern FILE *lima_dump_command_stream;
 extern int lima_ctx_num_plb;
+extern bool lima_ctx_plb_adaptive;
+extern bool lima_async_submit;
+extern bool lima_pp_balance;
+extern int lima_shader_threads;
 
 /* max texture size is 4096x4096 */
 #define LIMA_MAX_MIP_LEVELS 13
 
 struct ra_regs;
+struct disk_cache;
 
 struct lima_screen {
    struct pipe_screen base;
@@ -53,8 +59,14 @@ struct lima_screen {
    int num_pp;
 
    /* va mgr */
+   #define LIMA_VA_NUM_BUCKETS 32
    mtx_t va_lock;
-   struct list_head va_holes;
+   struct list_head va_buckets[LIMA_VA_NUM_BUCKETS];
+   uint32_t va_bucket_mask;
+   struct hash_table *va_hole_start;
+   struct hash_table *va_hole_end;
+   uint64_t va_free_size;
+   unsigned va_num_holes;
    uint64_t va_start;
    uint64_t va_end;
 
@@ -63,19 +75,57 @@ struct lima_screen {
    struct util_hash_table *bo_handles;
    struct util_hash_table *bo_flink_names;
 
+   /* bo cache, bucket i holds bos of size [2^(i+12), 2^(i+13)) */
+   #define LIMA_BO_CACHE_MIN_BUCKET  12 /* 4KB */
+   #define LIMA_BO_CACHE_MAX_BUCKET  22 /* 4MB */
+   #define LIMA_BO_CACHE_NUM_BUCKETS \
+      (LIMA_BO_CACHE_MAX_BUCKET - LIMA_BO_CACHE_MIN_BUCKET + 1)
+   mtx_t bo_cache_lock;
+   struct list_head bo_cache_buckets[LIMA_BO_CACHE_NUM_BUCKETS];
+   struct list_head bo_cache_time;
+
+   /* shader heap, see lima_program.c */
+   #define LIMA_SHADER_HEAP_CHUNK_SIZE 0x10000
+   mtx_t shader_heap_lock;
+   struct list_head shader_heap;
+
+   /* hilbert ordered tiles of each framebuffer size, see lima_draw.c */
+   mtx_t tile_order_lock;
+   struct hash_table *tile_order;
+
+   /* released scanout buffers waiting for a new one of the same size and
+    * format, see lima_resource.c */
+   #define LIMA_SCANOUT_CACHE_SIZE 4
+   mtx_t scanout_cache_lock;
+   struct list_head scanout_cache;
+   unsigned scanout_cache_num;
+
    struct slab_parent_pool transfer_pool;
 
    struct ra_regs *pp_ra;
-
-   struct lima_bo *gp_buffer;
-   #define gp_tile_heap_offset       0x000000
-   #define gp_buffer_size            0x100000
+   struct disk_cache *disk_cache;
+   /* created shader states by their lima_program_ref key */
+   mtx_t program_cache_lock;
+   struct hash_table *program_cache;
+   /* NIR of the TGSI shaders created before, see tgsi_to_nir_cached() */
+   struct tgsi_to_nir_cache *ttn_cache;
+   /* NIR to GP/PP code of created shaders, see lima_program.c */
+   #define LIMA_MAX_SHADER_THREADS 8
+   struct util_queue shader_queue;
+
+   /* LIMA_CAPTURE file of the submits, see lima_capture.c */
+   struct lima_capture *capture;
+   /* LIMA_TRACE timeline of the submits and waits, see lima_trace.c */
+   struct lima_trace *trace;
 
    struct lima_bo *pp_buffer;
    #define pp_frame_rsw_offset       0x0000
    #define pp_clear_program_offset   0x0040
    #define pp_stack_offset           0x0080
-   #define pp_buffer_size            0x2000
+   /* bytes of each stack vec4 slot for the 128 threads of a PP */
+   #define pp_stack_pp_size          0x0800
+   #define pp_buffer_size(num_pp) \
+      (pp_stack_offset + (num_pp) * LIMA_PP_MAX_STACK_SIZE * pp_stack_pp_size)
 };
 
 static inline struct lima_screen *
@@ -87,4 +137,8 @@ lima_screen(struct pipe_screen *pscreen)
 struct pipe_screen *
 lima_screen_create(int fd, struct renderonly *ro);
 
+bool lima_draw_screen_init(struct lima_screen *screen);
+void lima_query_screen_init(struct lima_screen *screen);
+void lima_draw_screen_fini(struct lima_screen *screen);
+
 #endif
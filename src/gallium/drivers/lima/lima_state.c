@@ -27,12 +27,14 @@
 #include "util/u_inlines.h"
 #include "util/u_helpers.h"
 #include "util/u_debug.h"
+#include "util/u_framebuffer.h"
 
 #include "pipe/p_state.h"
 
 #include "lima_screen.h"
 #include "lima_context.h"
 #include "lima_resource.h"
+#include "lima_texture.h"
 
 static void
 lima_set_framebuffer_state(struct pipe_context *pctx,
@@ -45,8 +47,9 @@ lima_set_framebuffer_state(struct pipe_context *pctx,
 
    struct lima_context *ctx = lima_context(pctx);
 
-   /* submit need framebuffer info, flush before change it */
-   lima_flush(ctx);
+   /* the job of the old framebuffer stays pending, the next draw picks
+    * up the job of the new one */
+   ctx->job = NULL;
 
    struct lima_context_framebuffer *fb = &ctx->framebuffer;
 
@@ -56,6 +59,9 @@ lima_set_framebuffer_state(struct pipe_context *pctx,
    /* need align here? */
    fb->width = framebuffer->width;
    fb->height = framebuffer->height;
+   fb->samples = util_framebuffer_get_num_samples(framebuffer);
+   if (fb->samples <= 1)
+      fb->samples = 0;
 
    int width = align(framebuffer->width, 16) >> 4;
    int height = align(framebuffer->height, 16) >> 4;
@@ -63,30 +69,8 @@ lima_set_framebuffer_state(struct pipe_context *pctx,
       fb->tiled_w = width;
       fb->tiled_h = height;
 
-      int limit = ctx->plb_max_blk;
-      while ((width * height) > limit) {
-         if (width >= height) {
-            width = (width + 1) >> 1;
-            fb->shift_w++;
-         } else {
-            height = (height + 1) >> 1;
-            fb->shift_h++;
-         }
-      }
-
-      fb->block_w = width;
-      fb->block_h = height;
-
-      int max;
-      if (fb->shift_h > fb->shift_w)
-         max = fb->shift_h;
-      else
-         max = fb->shift_w;
-
-      if (max > 2)
-         fb->shift_max = 2;
-      else if (max)
-         fb->shift_max = 1;
+      /* jobs may pick a finer grouping, see lima_job_choose_blocking() */
+      lima_ctx_fb_blocking(fb, ctx->plb_max_blk);
 
       debug_printf("fb dim change tiled=%d/%d block=%d/%d shift=%d/%d\n",
                    fb->tiled_w, fb->tiled_h, fb->block_w, fb->block_h,
@@ -103,6 +87,147 @@ lima_set_polygon_stipple(struct pipe_context *pctx,
    debug_checkpoint();
 }
 
+static int
+lima_blend_func(enum pipe_blend_func pipe)
+{
+   switch (pipe) {
+   case PIPE_BLEND_ADD:
+      return 2;
+   case PIPE_BLEND_SUBTRACT:
+      return 0;
+   case PIPE_BLEND_REVERSE_SUBTRACT:
+      return 1;
+   case PIPE_BLEND_MIN:
+      return 4;
+   case PIPE_BLEND_MAX:
+      return 5;
+   }
+   return -1;
+}
+
+static int
+lima_blend_factor(enum pipe_blendfactor pipe)
+{
+   switch (pipe) {
+   case PIPE_BLENDFACTOR_ONE:
+      return 11;
+   case PIPE_BLENDFACTOR_SRC_COLOR:
+      return 0;
+   case PIPE_BLENDFACTOR_SRC_ALPHA:
+      return 16;
+   case PIPE_BLENDFACTOR_DST_ALPHA:
+      return 17;
+   case PIPE_BLENDFACTOR_DST_COLOR:
+      return 1;
+   case PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE:
+      return 7;
+   case PIPE_BLENDFACTOR_CONST_COLOR:
+      return 2;
+   case PIPE_BLENDFACTOR_CONST_ALPHA:
+      return 18;
+   case PIPE_BLENDFACTOR_ZERO:
+      return 3;
+   case PIPE_BLENDFACTOR_INV_SRC_COLOR:
+      return 8;
+   case PIPE_BLENDFACTOR_INV_SRC_ALPHA:
+      return 24;
+   case PIPE_BLENDFACTOR_INV_DST_ALPHA:
+      return 25;
+   case PIPE_BLENDFACTOR_INV_DST_COLOR:
+      return 9;
+   case PIPE_BLENDFACTOR_INV_CONST_COLOR:
+      return 10;
+   case PIPE_BLENDFACTOR_INV_CONST_ALPHA:
+      return 26;
+   case PIPE_BLENDFACTOR_SRC1_COLOR:
+   case PIPE_BLENDFACTOR_SRC1_ALPHA:
+   case PIPE_BLENDFACTOR_INV_SRC1_COLOR:
+   case PIPE_BLENDFACTOR_INV_SRC1_ALPHA:
+      return -1; /* not support */
+   }
+   return -1;
+}
+
+static int
+lima_calculate_alpha_blend(enum pipe_blend_func rgb_func, enum pipe_blend_func alpha_func,
+                           enum pipe_blendfactor rgb_src_factor, enum pipe_blendfactor rgb_dst_factor,
+                           enum pipe_blendfactor alpha_src_factor, enum pipe_blendfactor alpha_dst_factor)
+{
+   return lima_blend_func(rgb_func) |
+      (lima_blend_func(alpha_func) << 3) |
+      (lima_blend_factor(rgb_src_factor) << 6) |
+      (lima_blend_factor(rgb_dst_factor) << 11) |
+      ((lima_blend_factor(alpha_src_factor) & 0xF) << 16) |
+      ((lima_blend_factor(alpha_dst_factor) & 0xF) << 20) |
+      0x0C000000; /* need check if this GLESv1 glAlphaFunc */
+}
+
+static int
+lima_stencil_op(enum pipe_stencil_op pipe)
+{
+   switch (pipe) {
+   case PIPE_STENCIL_OP_KEEP:
+      return 0;
+   case PIPE_STENCIL_OP_ZERO:
+      return 2;
+   case PIPE_STENCIL_OP_REPLACE:
+      return 1;
+   case PIPE_STENCIL_OP_INCR:
+      return 6;
+   case PIPE_STENCIL_OP_DECR:
+      return 7;
+   case PIPE_STENCIL_OP_INCR_WRAP:
+      return 4;
+   case PIPE_STENCIL_OP_DECR_WRAP:
+      return 5;
+   case PIPE_STENCIL_OP_INVERT:
+      return 3;
+   }
+   return -1;
+}
+
+static uint32_t
+lima_calculate_stencil(struct pipe_stencil_state *stencil)
+{
+   return stencil->func |
+      (lima_stencil_op(stencil->fail_op) << 3) |
+      (lima_stencil_op(stencil->zfail_op) << 6) |
+      (lima_stencil_op(stencil->zpass_op) << 9) |
+      (stencil->valuemask << 24);
+}
+
+static int
+lima_calculate_depth_test(struct pipe_depth_state *depth)
+{
+   enum pipe_compare_func func = (depth->enabled ? depth->func : PIPE_FUNC_ALWAYS);
+
+   return (depth->enabled && depth->writemask) |
+      ((int)func << 1) |
+      0x30; /* find out what is this */
+}
+
+/* polygon offset bits of the depth test word */
+static int
+lima_calculate_depth_offset(struct pipe_rasterizer_state *rst)
+{
+   int offset_scale = 0;
+
+   //TODO: implement polygon offset
+#if 0
+   if (rst->offset_scale < -32)
+      offset_scale = -32;
+   else if (rst->offset_scale > 31)
+      offset_scale = 31;
+   else
+      offset_scale = rst->offset_scale * 4;
+
+   if (offset_scale < 0)
+      offset_scale = 0x100 + offset_scale;
+#endif
+
+   return offset_scale << 16;
+}
+
 static void *
 lima_create_depth_stencil_alpha_state(struct pipe_context *pctx,
                                       const struct pipe_depth_stencil_alpha_state *cso)
@@ -120,6 +245,28 @@ lima_create_depth_stencil_alpha_state(struct pipe_context *pctx,
 
    so->base = *cso;
 
+   so->depth_test = lima_calculate_depth_test(&so->base.depth);
+
+   /* the stencil ref values go to bits 16-23 at draw time, the low bytes
+    * of the stencil test word are the front and back write masks */
+   struct pipe_stencil_state *stencil = so->base.stencil;
+   if (stencil[0].enabled) {
+      so->stencil_front = lima_calculate_stencil(stencil);
+      so->stencil_back = so->stencil_front;
+      so->stencil_test = stencil[0].writemask | (stencil[0].writemask << 8);
+
+      if (stencil[1].enabled) {
+         so->stencil_back = lima_calculate_stencil(stencil + 1);
+         so->stencil_test = stencil[0].writemask | (stencil[1].writemask << 8);
+      }
+   }
+   else {
+      /* always pass, keep, full masks */
+      so->stencil_front = 0xff000007;
+      so->stencil_back = 0xff000007;
+      so->stencil_test = 0x0000ffff;
+   }
+
    return so;
 }
 
@@ -154,6 +301,8 @@ lima_create_rasterizer_state(struct pipe_context *pctx,
 
    so->base = *cso;
 
+   so->depth_test = lima_calculate_depth_offset(&so->base);
+
    return so;
 }
 
@@ -188,6 +337,31 @@ lima_create_blend_state(struct pipe_context *pctx,
 
    so->base = *cso;
 
+   /* do hw support RGBA independ blend?
+    * PIPE_CAP_INDEP_BLEND_ENABLE
+    *
+    * how to handle the no cbuf only zbuf case?
+    */
+   struct pipe_rt_blend_state *rt = so->base.rt;
+   if (rt->blend_enable) {
+      so->alpha_blend = lima_calculate_alpha_blend(rt->rgb_func, rt->alpha_func,
+         rt->rgb_src_factor, rt->rgb_dst_factor,
+         rt->alpha_src_factor, rt->alpha_dst_factor);
+   }
+   else {
+      /*
+       * Special handling for blending disabled.
+       * Binary driver is generating the same alpha_value,
+       * as when we would just enable blending, without changing/setting any blend equation/params.
+       * Normaly in this case mesa would set all rt fields (func/factor) to zero.
+       */
+      so->alpha_blend = lima_calculate_alpha_blend(PIPE_BLEND_ADD, PIPE_BLEND_ADD,
+         PIPE_BLENDFACTOR_ONE, PIPE_BLENDFACTOR_ZERO,
+         PIPE_BLENDFACTOR_ONE, PIPE_BLENDFACTOR_ZERO);
+   }
+
+   so->alpha_blend |= (rt->colormask & PIPE_MASK_RGBA) << 28;
+
    return so;
 }
 
@@ -223,6 +397,11 @@ lima_create_vertex_elements_state(struct pipe_context *pctx, unsigned num_elemen
    memcpy(so->pipe, elements, sizeof(*elements) * num_elements);
    so->num_elements = num_elements;
 
+   for (unsigned i = 0; i < num_elements; i++) {
+      if (elements[i].instance_divisor)
+         so->instanced = true;
+   }
+
    return so;
 }
 
@@ -336,6 +515,15 @@ lima_set_stencil_ref(struct pipe_context *pctx,
    ctx->dirty |= LIMA_CONTEXT_DIRTY_STENCIL_REF;
 }
 
+static void
+lima_set_sample_mask(struct pipe_context *pctx, unsigned sample_mask)
+{
+   struct lima_context *ctx = lima_context(pctx);
+
+   /* packed in the render state of each draw */
+   ctx->sample_mask = sample_mask;
+}
+
 static void
 lima_set_constant_buffer(struct pipe_context *pctx,
                          enum pipe_shader_type shader, uint index,
@@ -376,6 +564,7 @@ lima_create_sampler_state(struct pipe_context *pctx,
       return NULL;
 
    memcpy(so, cso, sizeof(*cso));
+   lima_texture_pack_sampler(so);
 
    return so;
 }
@@ -383,6 +572,7 @@ lima_create_sampler_state(struct pipe_context *pctx,
 static void
 lima_sampler_state_delete(struct pipe_context *pctx, void *sstate)
 {
+   lima_texture_forget(lima_context(pctx), NULL, sstate);
    free(sstate);
 }
 
@@ -428,6 +618,8 @@ lima_create_sampler_view(struct pipe_context *pctx, struct pipe_resource *prsc,
    so->base.reference.count = 1;
    so->base.context = pctx;
 
+   lima_texture_pack_view(so);
+
    return &so->base;
 }
 
@@ -437,6 +629,7 @@ lima_sampler_view_destroy(struct pipe_context *pctx,
 {
    struct lima_sampler_view *view = lima_sampler_view(pview);
 
+   lima_texture_forget(lima_context(pctx), view, NULL);
    pipe_resource_reference(&pview->texture, NULL);
 
    free(view);
@@ -478,6 +671,7 @@ lima_state_init(struct lima_context *ctx)
    ctx->base.set_scissor_states = lima_set_scissor_states;
    ctx->base.set_blend_color = lima_set_blend_color;
    ctx->base.set_stencil_ref = lima_set_stencil_ref;
+   ctx->base.set_sample_mask = lima_set_sample_mask;
 
    ctx->base.set_vertex_buffers = lima_set_vertex_buffers;
    ctx->base.set_constant_buffer = lima_set_constant_buffer;
@@ -23,6 +23,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "xf86drm.h"
 #include "lima_drm.h"
@@ -30,18 +31,44 @@
 #include "util/list.h"
 #include "util/ralloc.h"
 #include "util/u_dynarray.h"
+#include "util/hash_table.h"
+#include "util/u_queue.h"
 
 #include "lima_screen.h"
 #include "lima_context.h"
 #include "lima_submit.h"
 #include "lima_bo.h"
 #include "lima_util.h"
+#include "lima_capture.h"
+#include "lima_trace.h"
 
 struct lima_submit_job {
    struct list_head list;
+   struct lima_submit *submit;
+
+   /* kernel submit arguments, filled on the application thread */
+   struct util_dynarray gem_bos;
+   struct util_dynarray deps;
+   uint32_t flags;
+   union {
+      struct drm_lima_gp_frame gp;
+      struct drm_lima_m400_pp_frame m400;
+      struct drm_lima_m450_pp_frame m450;
+   } frame;
+   uint32_t frame_size;
+
+   /* kernel submit results, only valid once ready is signalled */
+   struct util_queue_fence ready;
+   bool submitted;
    uint32_t fence;
+   uint32_t done;
+   int sync_fd;
 
    struct util_dynarray bos;
+
+   /* bos of jobs retired before this one, released by whoever runs
+    * the submit, the worker when there's one */
+   struct util_dynarray retired_bos;
 };
 
 struct lima_submit {
@@ -49,15 +76,24 @@ struct lima_submit {
    uint32_t pipe;
    uint32_t ctx;
 
-   int sync_fd;
+   /* submit worker of the context, NULL to submit synchronously */
+   struct util_queue *queue;
+
    bool need_sync_fd;
 
-   struct util_dynarray gem_bos;
-   struct util_dynarray deps;
+   /* bo -> index of its entry in current_job->gem_bos */
+   struct hash_table *bo_index;
 
+   /* all jobs up to this kernel fence seqno are known to be done */
+   uint32_t signalled_seqno;
+
+   /* newest job first */
    struct list_head busy_job_list;
    struct list_head free_job_list;
    struct lima_submit_job *current_job;
+
+   /* bos of retired jobs waiting to be released in one batch */
+   struct util_dynarray retired_bos;
 };
 
 
@@ -75,11 +111,19 @@ struct lima_submit *lima_submit_create(struct lima_context *ctx, uint32_t pipe)
    s->pipe = pipe;
    s->ctx = ctx->id;
 
-   util_dynarray_init(&s->gem_bos, s);
-   util_dynarray_init(&s->deps, s);
+   if (util_queue_is_initialized(&ctx->submit_queue))
+      s->queue = &ctx->submit_queue;
+
+   s->bo_index = _mesa_hash_table_create(s, _mesa_hash_pointer,
+                                         _mesa_key_pointer_equal);
+   if (!s->bo_index) {
+      ralloc_free(s);
+      return NULL;
+   }
 
    list_inithead(&s->busy_job_list);
    list_inithead(&s->free_job_list);
+   util_dynarray_init(&s->retired_bos, s);
    return s;
 }
 
@@ -91,7 +135,12 @@ static struct lima_submit_job *lima_submit_job_alloc(struct lima_submit *submit)
       job = rzalloc(submit, struct lima_submit_job);
       if (!job)
          return NULL;
+      job->submit = submit;
+      util_dynarray_init(&job->gem_bos, job);
+      util_dynarray_init(&job->deps, job);
       util_dynarray_init(&job->bos, job);
+      util_dynarray_init(&job->retired_bos, job);
+      util_queue_fence_init(&job->ready);
    }
    else {
       job = list_first_entry(&submit->free_job_list, struct lima_submit_job, list);
@@ -101,34 +150,66 @@ static struct lima_submit_job *lima_submit_job_alloc(struct lima_submit *submit)
    return job;
 }
 
+static void lima_release_bos(struct util_dynarray *bos)
+{
+   lima_bo_free_array(util_dynarray_begin(bos),
+                      bos->size / sizeof(struct lima_bo *));
+   util_dynarray_clear(bos);
+}
+
+/* the bo references are only collected, see lima_release_bos */
 static void lima_submit_job_free(struct lima_submit *submit,
                                  struct lima_submit_job *job)
 {
-   util_dynarray_foreach(&job->bos, struct lima_bo *, bo) {
-      lima_bo_free(*bo);
-   }
+   if (job->bos.size)
+      memcpy(util_dynarray_grow(&submit->retired_bos, job->bos.size),
+             util_dynarray_begin(&job->bos), job->bos.size);
    util_dynarray_clear(&job->bos);
+   util_dynarray_clear(&job->gem_bos);
+   util_dynarray_clear(&job->deps);
    list_add(&job->list, &submit->free_job_list);
 }
 
+static struct lima_submit_job *
+lima_submit_current_job(struct lima_submit *submit)
+{
+   if (!submit->current_job)
+      submit->current_job = lima_submit_job_alloc(submit);
+   return submit->current_job;
+}
+
+static struct drm_lima_gem_submit_bo *
+lima_submit_find_bo(struct lima_submit *submit, struct lima_bo *bo)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(submit->bo_index, bo);
+   if (!entry)
+      return NULL;
+
+   return util_dynarray_element(&submit->current_job->gem_bos,
+                                struct drm_lima_gem_submit_bo,
+                                (uintptr_t)entry->data);
+}
+
 bool lima_submit_add_bo(struct lima_submit *submit, struct lima_bo *bo, uint32_t flags)
 {
-   util_dynarray_foreach(&submit->gem_bos, struct drm_lima_gem_submit_bo, gem_bo) {
-      if (bo->handle == gem_bo->handle) {
-         gem_bo->flags |= flags;
-         return true;
-      }
+   struct drm_lima_gem_submit_bo *gem_bo = lima_submit_find_bo(submit, bo);
+   if (gem_bo) {
+      gem_bo->flags |= flags;
+      return true;
    }
 
+   struct lima_submit_job *job = lima_submit_current_job(submit);
+   if (!job)
+      return false;
+
+   uintptr_t index = job->gem_bos.size / sizeof(struct drm_lima_gem_submit_bo);
+   _mesa_hash_table_insert(submit->bo_index, bo, (void *)index);
+
    struct drm_lima_gem_submit_bo *submit_bo =
-      util_dynarray_grow(&submit->gem_bos, sizeof(*submit_bo));
+      util_dynarray_grow(&job->gem_bos, sizeof(*submit_bo));
    submit_bo->handle = bo->handle;
    submit_bo->flags = flags;
 
-   if (!submit->current_job)
-      submit->current_job = lima_submit_job_alloc(submit);
-
-   struct lima_submit_job *job = submit->current_job;
    struct lima_bo **jbo = util_dynarray_grow(&job->bos, sizeof(*jbo));
    *jbo = bo;
 
@@ -138,57 +219,181 @@ bool lima_submit_add_bo(struct lima_submit *submit, struct lima_bo *bo, uint32_t
    return true;
 }
 
-bool lima_submit_start(struct lima_submit *submit, void *frame, uint32_t size)
+/* runs on the submit worker when there's one, the job is left alone by
+ * the application thread until ready is signalled */
+static void lima_submit_job_execute(void *data, int thread_index)
 {
+   struct lima_submit_job *job = data;
+   struct lima_submit *submit = job->submit;
+   int64_t trace_begin = lima_trace_begin(submit->screen);
+
    union drm_lima_gem_submit req = {
       .in = {
          .ctx = submit->ctx,
          .pipe = submit->pipe,
-         .nr_bos = submit->gem_bos.size / sizeof(struct drm_lima_gem_submit_bo),
-         .bos = VOID2U64(util_dynarray_begin(&submit->gem_bos)),
-         .frame = VOID2U64(frame),
-         .frame_size = size,
-         .deps = submit->deps.size ? VOID2U64(util_dynarray_begin(&submit->deps)) : 0,
-         .nr_deps = submit->deps.size / sizeof(union drm_lima_gem_submit_dep),
-         .flags = submit->need_sync_fd ? LIMA_SUBMIT_FLAG_SYNC_FD_OUT : 0,
+         .nr_bos = job->gem_bos.size / sizeof(struct drm_lima_gem_submit_bo),
+         .bos = VOID2U64(util_dynarray_begin(&job->gem_bos)),
+         .frame = VOID2U64(&job->frame),
+         .frame_size = job->frame_size,
+         .deps = job->deps.size ? VOID2U64(util_dynarray_begin(&job->deps)) : 0,
+         .nr_deps = job->deps.size / sizeof(union drm_lima_gem_submit_dep),
+         .flags = job->flags,
       },
    };
 
-   bool ret = drmIoctl(submit->screen->fd, DRM_IOCTL_LIMA_GEM_SUBMIT, &req) == 0;
+   struct lima_bo **bos = util_dynarray_begin(&job->bos);
+   for (int i = 0; i < req.in.nr_bos; i++)
+      lima_bo_claim_gpu_use(bos[i], submit->ctx);
 
-   struct lima_submit_job *job = submit->current_job;
-   if (ret) {
+   job->submitted = drmIoctl(submit->screen->fd, DRM_IOCTL_LIMA_GEM_SUBMIT, &req) == 0;
+   if (job->submitted) {
       job->fence = req.out.fence;
-      list_add(&job->list, &submit->busy_job_list);
+      job->done = req.out.done;
+      job->sync_fd = job->flags & LIMA_SUBMIT_FLAG_SYNC_FD_OUT ?
+         req.out.sync_fd : -1;
+
+      struct drm_lima_gem_submit_bo *gem_bos =
+         util_dynarray_begin(&job->gem_bos);
+      for (int i = 0; i < req.in.nr_bos; i++)
+         lima_bo_mark_gpu_use(bos[i], submit->ctx, submit->pipe, job->fence,
+                              gem_bos[i].flags & LIMA_SUBMIT_BO_WRITE);
+   }
+   else
+      job->sync_fd = -1;
 
-      submit->sync_fd = submit->need_sync_fd ? req.out.sync_fd : -1;
+   lima_trace_end(submit->screen, "submit ioctl", trace_begin);
+   if (submit->screen->trace && job->submitted)
+      lima_trace_gpu_job(submit->screen->trace, submit->ctx, submit->pipe,
+                         job->fence, trace_begin);
 
-      int i = 0;
-      list_for_each_entry_safe(struct lima_submit_job, j,
-                               &submit->busy_job_list, list) {
-         if (i++ >= req.out.done) {
-            list_del(&j->list);
-            lima_submit_job_free(submit, j);
+   if (submit->screen->capture)
+      lima_capture_fence(submit->screen->capture, submit->ctx, submit->pipe,
+                         job->submitted, job->fence);
+
+   /* only after the ioctl, to not delay the submit */
+   lima_release_bos(&job->retired_bos);
+
+   if (submit->queue) {
+      if (!job->submitted)
+         fprintf(stderr, "lima: %s submit error\n",
+                 submit->pipe == LIMA_PIPE_GP ? "gp" : "pp");
+
+      /* sync fd deps were duplicated when queued */
+      util_dynarray_foreach(&job->deps, union drm_lima_gem_submit_dep, dep) {
+         if (dep->type == LIMA_SUBMIT_DEP_SYNC_FD)
+            close(dep->sync_fd.fd);
+      }
+   }
+}
+
+/* free the jobs the kernel reported done on the newest finished submit
+ * and the ones which failed to submit */
+static void lima_submit_retire(struct lima_submit *submit)
+{
+   struct lima_submit_job *newest = NULL;
+   unsigned i = 0;
+
+   list_for_each_entry_safe(struct lima_submit_job, j,
+                            &submit->busy_job_list, list) {
+      if (!util_queue_fence_is_signalled(&j->ready))
+         continue;
+
+      if (j->submitted) {
+         if (!newest) {
+            newest = j;
+
+            /* the kernel reports how many of the last jobs still run */
+            uint32_t seqno = j->fence - j->done;
+            if (!lima_submit_seqno_signalled(submit, seqno))
+               submit->signalled_seqno = seqno;
          }
+         if (i++ < newest->done &&
+             !lima_submit_seqno_signalled(submit, j->fence))
+            continue;
       }
+
+      list_del(&j->list);
+      lima_submit_job_free(submit, j);
    }
-   else
+}
+
+/* wait for the last queued job to reach the kernel */
+static struct lima_submit_job *
+lima_submit_newest_job(struct lima_submit *submit)
+{
+   while (!list_empty(&submit->busy_job_list)) {
+      struct lima_submit_job *job =
+         list_first_entry(&submit->busy_job_list, struct lima_submit_job, list);
+
+      util_queue_fence_wait(&job->ready);
+      if (job->submitted)
+         return job;
+
+      list_del(&job->list);
       lima_submit_job_free(submit, job);
+      lima_release_bos(&submit->retired_bos);
+   }
+
+   return NULL;
+}
+
+bool lima_submit_start(struct lima_submit *submit, void *frame, uint32_t size)
+{
+   struct lima_submit_job *job = lima_submit_current_job(submit);
+   if (!job)
+      return false;
+
+   int64_t trace_begin = lima_trace_begin(submit->screen);
+
+   assert(size <= sizeof(job->frame));
+   memcpy(&job->frame, frame, size);
+   job->frame_size = size;
+   job->flags = submit->need_sync_fd ? LIMA_SUBMIT_FLAG_SYNC_FD_OUT : 0;
+
+   /* the bo references the retired jobs held go with this job instead of
+    * being dropped here, so the submit cost doesn't grow with them */
+   lima_submit_retire(submit);
+   struct util_dynarray retired = job->retired_bos;
+   job->retired_bos = submit->retired_bos;
+   submit->retired_bos = retired;
+
+   list_add(&job->list, &submit->busy_job_list);
+
+   /* the bos are copied before the GPU can change them */
+   if (submit->screen->capture)
+      lima_capture_submit(submit->screen->capture, submit->ctx, submit->pipe,
+                          job->flags, util_dynarray_begin(&job->bos),
+                          util_dynarray_begin(&job->gem_bos),
+                          job->gem_bos.size / sizeof(struct drm_lima_gem_submit_bo),
+                          util_dynarray_begin(&job->deps),
+                          job->deps.size / sizeof(union drm_lima_gem_submit_dep),
+                          &job->frame, size);
+
+   bool ret = true;
+   if (submit->queue)
+      util_queue_add_job(submit->queue, job, &job->ready,
+                         lima_submit_job_execute, NULL);
+   else {
+      lima_submit_job_execute(job, 0);
+      ret = job->submitted;
+   }
 
-   util_dynarray_clear(&submit->gem_bos);
-   util_dynarray_clear(&submit->deps);
+   _mesa_hash_table_clear(submit->bo_index, NULL);
    submit->need_sync_fd = false;
    submit->current_job = NULL;
+
+   lima_trace_end(submit->screen, "submit", trace_begin);
    return ret;
 }
 
 bool lima_submit_wait(struct lima_submit *submit, uint64_t timeout_ns)
 {
-   if (list_empty(&submit->busy_job_list))
+   int64_t trace_begin = lima_trace_begin(submit->screen);
+
+   struct lima_submit_job *job = lima_submit_newest_job(submit);
+   if (!job)
       return true;
 
-   struct lima_submit_job *job =
-      list_first_entry(&submit->busy_job_list, struct lima_submit_job, list);
    struct drm_lima_wait_fence req = {
       .pipe = submit->pipe,
       .seq = job->fence,
@@ -198,36 +403,31 @@ bool lima_submit_wait(struct lima_submit *submit, uint64_t timeout_ns)
 
    bool ret = drmIoctl(submit->screen->fd, DRM_IOCTL_LIMA_WAIT_FENCE, &req) == 0;
    if (ret) {
+      submit->signalled_seqno = job->fence;
       list_for_each_entry_safe(struct lima_submit_job, j,
                                &submit->busy_job_list, list) {
          list_del(&j->list);
          lima_submit_job_free(submit, j);
       }
+      lima_release_bos(&submit->retired_bos);
    }
+
+   lima_trace_end(submit->screen, "submit wait", trace_begin);
    return ret;
 }
 
-bool lima_submit_has_bo(struct lima_submit *submit, struct lima_bo *bo, bool all)
+/* seqnos of the context wrap around after 2^32 submits */
+bool lima_submit_seqno_signalled(struct lima_submit *submit, uint32_t seqno)
 {
-   util_dynarray_foreach(&submit->gem_bos, struct drm_lima_gem_submit_bo, gem_bo) {
-      if (bo->handle == gem_bo->handle) {
-         if (all)
-            return true;
-         else
-            return gem_bo->flags & LIMA_SUBMIT_BO_WRITE;
-      }
-   }
-
-   return false;
+   return (int32_t)(submit->signalled_seqno - seqno) >= 0;
 }
 
 bool lima_submit_get_fence(struct lima_submit *submit, uint32_t *fence)
 {
-   if (list_empty(&submit->busy_job_list))
+   struct lima_submit_job *job = lima_submit_newest_job(submit);
+   if (!job)
       return false;
 
-   struct lima_submit_job *job =
-      list_first_entry(&submit->busy_job_list, struct lima_submit_job, list);
    *fence = job->fence;
    return true;
 }
@@ -238,6 +438,8 @@ bool lima_submit_wait_fence(struct lima_submit *submit, uint32_t fence,
    if (!lima_get_absolute_timeout(&timeout_ns))
       return false;
 
+   int64_t trace_begin = lima_trace_begin(submit->screen);
+
    struct drm_lima_wait_fence req = {
       .pipe = submit->pipe,
       .seq = fence,
@@ -245,15 +447,26 @@ bool lima_submit_wait_fence(struct lima_submit *submit, uint32_t fence,
       .ctx = submit->ctx,
    };
 
-   return drmIoctl(submit->screen->fd, DRM_IOCTL_LIMA_WAIT_FENCE, &req) == 0;
+   bool ret = drmIoctl(submit->screen->fd, DRM_IOCTL_LIMA_WAIT_FENCE, &req) == 0;
+   lima_trace_end(submit->screen, "fence wait", trace_begin);
+   return ret;
 }
 
 bool lima_submit_add_dep(struct lima_submit *submit,
                          union drm_lima_gem_submit_dep *dep)
 {
+   struct lima_submit_job *job = lima_submit_current_job(submit);
+   if (!job)
+      return false;
+
    union drm_lima_gem_submit_dep *submit_dep =
-      util_dynarray_grow(&submit->deps, sizeof(*submit_dep));
+      util_dynarray_grow(&job->deps, sizeof(*submit_dep));
    *submit_dep = *dep;
+
+   /* the fence owning the fd may be gone when the worker submits */
+   if (submit->queue && dep->type == LIMA_SUBMIT_DEP_SYNC_FD)
+      submit_dep->sync_fd.fd = dup(dep->sync_fd.fd);
+
    return true;
 }
 
@@ -264,5 +477,12 @@ void lima_submit_need_sync_fd(struct lima_submit *submit)
 
 int lima_submit_get_sync_fd(struct lima_submit *submit)
 {
-   return submit->sync_fd;
+   struct lima_submit_job *job = lima_submit_newest_job(submit);
+   return job ? job->sync_fd : -1;
+}
+
+void lima_submit_queue_finish(struct lima_context *ctx)
+{
+   if (util_queue_is_initialized(&ctx->submit_queue))
+      util_queue_finish(&ctx->submit_queue);
 }
@@ -26,8 +26,11 @@
 #include "util/u_memory.h"
 #include "util/u_upload_mgr.h"
 #include "util/u_math.h"
+#include "util/u_format.h"
 #include "util/u_debug.h"
 #include "util/u_transfer.h"
+#include "util/hash_table.h"
+#include "util/ralloc.h"
 
 #include "lima_bo.h"
 #include "lima_context.h"
@@ -36,16 +39,30 @@
 #include "lima_resource.h"
 #include "lima_submit.h"
 #include "lima_util.h"
+#include "lima_job.h"
 
 #include <lima_drm.h>
 
+#define LIMA_TEXEL_FORMAT_L8           0x09
+#define LIMA_TEXEL_FORMAT_A8           0x0a
+#define LIMA_TEXEL_FORMAT_I8           0x0b
 #define LIMA_TEXEL_FORMAT_BGR_565      0x0e
+#define LIMA_TEXEL_FORMAT_BGRA_5551    0x0f
+#define LIMA_TEXEL_FORMAT_BGRA_4444    0x10
+#define LIMA_TEXEL_FORMAT_L8A8         0x11
 #define LIMA_TEXEL_FORMAT_RGB_888      0x15
 #define LIMA_TEXEL_FORMAT_RGBA_8888    0x16
+#define LIMA_TEXEL_FORMAT_ETC1_RGB8    0x20
 
-#define lima_tex_desc_size 64
+#define lima_min_tex_desc_size 64
 #define lima_tex_list_size 64
 
+/* level addresses start at bit 30 of desc word 6, each one holds the
+ * 26 msbs of the address and they are packed next to each other */
+#define LIMA_TEX_DESC_VA_WORD       6
+#define LIMA_TEX_DESC_VA_BIT_OFFSET 30
+#define LIMA_TEX_DESC_VA_BIT_SIZE   26
+
 static uint32_t pipe_format_to_lima(enum pipe_format pformat)
 {
    unsigned swap_chans, flag1, format;
@@ -73,6 +90,55 @@ static uint32_t pipe_format_to_lima(enum pipe_format pformat)
       flag1 = 0;
       format = LIMA_TEXEL_FORMAT_BGR_565;
       break;
+   case PIPE_FORMAT_B5G5R5A1_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_BGRA_5551;
+      break;
+   case PIPE_FORMAT_B4G4R4A4_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_BGRA_4444;
+      break;
+   /* the luminance, alpha and intensity formats are expanded by the
+    * texture unit, no swizzle needed */
+   case PIPE_FORMAT_L8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_L8;
+      break;
+   case PIPE_FORMAT_A8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_A8;
+      break;
+   case PIPE_FORMAT_I8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_I8;
+      break;
+   case PIPE_FORMAT_L8A8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_L8A8;
+      break;
+   /* the planes of YUV images, see lima_texture_format_swizzle */
+   case PIPE_FORMAT_R8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_L8;
+      break;
+   case PIPE_FORMAT_R8G8_UNORM:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_L8A8;
+      break;
+   /* compressed textures are never tiled, see lima_resource_should_tile */
+   case PIPE_FORMAT_ETC1_RGB8:
+      swap_chans = 0;
+      flag1 = 0;
+      format = LIMA_TEXEL_FORMAT_ETC1_RGB8;
+      break;
    default:
       assert(0);
       break;
@@ -81,22 +147,75 @@ static uint32_t pipe_format_to_lima(enum pipe_format pformat)
    return (swap_chans << 7) | (flag1 << 6) | format;
 }
 
+static const unsigned char lima_r8_swizzle[4] = {
+   PIPE_SWIZZLE_X, PIPE_SWIZZLE_0, PIPE_SWIZZLE_0, PIPE_SWIZZLE_1,
+};
+
+static const unsigned char lima_r8g8_swizzle[4] = {
+   PIPE_SWIZZLE_X, PIPE_SWIZZLE_W, PIPE_SWIZZLE_0, PIPE_SWIZZLE_1,
+};
+
+/* R8 and R8G8 are sampled as L8 and L8A8, the swizzle getting their
+ * channels back from the texel returned, NULL for the other formats */
+const unsigned char *
+lima_texture_format_swizzle(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R8_UNORM:
+      return lima_r8_swizzle;
+   case PIPE_FORMAT_R8G8_UNORM:
+      return lima_r8g8_swizzle;
+   default:
+      return NULL;
+   }
+}
+
+static unsigned
+lima_calc_tex_desc_size(struct lima_sampler_view *texture)
+{
+   unsigned num_levels =
+      texture->base.u.tex.last_level - texture->base.u.tex.first_level + 1;
+   unsigned va_bits = LIMA_TEX_DESC_VA_WORD * 32 + LIMA_TEX_DESC_VA_BIT_OFFSET +
+      num_levels * LIMA_TEX_DESC_VA_BIT_SIZE;
+
+   return align(DIV_ROUND_UP(va_bits, 8), lima_min_tex_desc_size);
+}
+
 static void
-lima_update_tex_desc(struct lima_context *ctx, struct lima_sampler_state *sampler,
-                     struct lima_sampler_view *texture, void *pdesc)
+lima_tex_desc_set_va(uint32_t *desc, int level, uint32_t va)
+{
+   unsigned bit = LIMA_TEX_DESC_VA_WORD * 32 + LIMA_TEX_DESC_VA_BIT_OFFSET +
+      level * LIMA_TEX_DESC_VA_BIT_SIZE;
+   unsigned word = bit / 32;
+
+   bit %= 32;
+   va >>= 32 - LIMA_TEX_DESC_VA_BIT_SIZE;
+
+   desc[word] |= va << bit;
+   if (bit > 32 - LIMA_TEX_DESC_VA_BIT_SIZE)
+      desc[word + 1] |= va >> (32 - bit);
+}
+
+/* words of the descriptor only depending on the view, the level
+ * addresses are added when the descriptor list is built */
+void
+lima_texture_pack_view(struct lima_sampler_view *view)
 {
-   uint32_t *desc = pdesc;
+   uint32_t *desc = view->desc;
    unsigned width, height, layout;
-   struct pipe_resource *prsc = texture->base.texture;
+   struct pipe_resource *prsc = view->base.texture;
    struct lima_resource *lima_res = lima_resource(prsc);
+   unsigned first_level = view->base.u.tex.first_level;
+
+   memset(desc, 0, sizeof(view->desc));
 
    /* TODO: - do we need to align width/height to 16?
             - does hardware support stride different from width? */
-   width = prsc->width0;
-   height = prsc->height0;
+   width = u_minify(prsc->width0, first_level);
+   height = u_minify(prsc->height0, first_level);
 
-   /* "Swizzled" textures aren't supported yet */
-   layout = 0;
+   /* 16x16 tiled or linear */
+   layout = lima_res->tiled ? 3 : 0;
 
    desc[0] = pipe_format_to_lima(prsc->format);
 
@@ -106,72 +225,192 @@ lima_update_tex_desc(struct lima_context *ctx, struct lima_sampler_state *sample
    desc[3] = 0x10000 | (height << 3) | (width >> 10);
    desc[6] = layout << 13;
 
-   lima_submit_add_bo(ctx->pp_submit, lima_res->bo, LIMA_SUBMIT_BO_READ);
-   lima_bo_update(lima_res->bo, false, true);
+   /* the rows of imported linear buffers, like the planes of video
+    * frames, aren't always packed */
+   if (!lima_res->tiled &&
+       lima_res->levels[first_level].stride !=
+       util_format_get_stride(prsc->format, width)) {
+      desc[0] |= lima_res->levels[first_level].stride << 16;
+      desc[2] |= 0x100;
+   }
 
-   /* attach level 0 */
-   desc[6] &= ~0xc0000000;
-   desc[6] |= lima_res->bo->va << 24;
-   desc[7] &= ~0x00ffffff;
-   desc[7] |= lima_res->bo->va >> 8;
+   view->desc_size = lima_calc_tex_desc_size(view);
+}
+
+/* filter and wrap bits of the sampler, the lod range also depends on
+ * the levels of the view */
+void
+lima_texture_pack_sampler(struct lima_sampler_state *sampler)
+{
+   sampler->desc1 = sampler->desc2 = 0;
+   sampler->mipmap = true;
+
+   switch (sampler->base.min_mip_filter) {
+   case PIPE_TEX_MIPFILTER_LINEAR:
+      sampler->desc2 |= 0x0600;
+      break;
+   case PIPE_TEX_MIPFILTER_NEAREST:
+      break;
+   case PIPE_TEX_MIPFILTER_NONE:
+   default:
+      sampler->mipmap = false;
+      break;
+   }
 
-   desc[1] &= ~0xff000000;
    switch (sampler->base.mag_img_filter) {
    case PIPE_TEX_FILTER_LINEAR:
-      desc[2] &= ~0x1000;
       /* no mipmap, filter_mag = linear */
-      desc[1] |= 0x80000000;
+      sampler->desc1 |= 0x80000000;
       break;
    case PIPE_TEX_FILTER_NEAREST:
    default:
-      desc[2] |= 0x1000;
+      sampler->desc2 |= 0x1000;
       break;
    }
 
    switch (sampler->base.min_img_filter) {
-      break;
    case PIPE_TEX_FILTER_LINEAR:
-      desc[2] &= ~0x0800;
       break;
    case PIPE_TEX_FILTER_NEAREST:
    default:
-      desc[2] |= 0x0800;
+      sampler->desc2 |= 0x0800;
       break;
    }
 
    /* Only clamp to edge and mirror repeat are supported */
-   desc[2] &= ~0xe000;
    switch (sampler->base.wrap_s) {
    case PIPE_TEX_WRAP_CLAMP:
    case PIPE_TEX_WRAP_CLAMP_TO_EDGE:
    case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-      desc[2] |= 0x2000;
+      sampler->desc2 |= 0x2000;
       break;
    case PIPE_TEX_WRAP_REPEAT:
    case PIPE_TEX_WRAP_MIRROR_REPEAT:
-      desc[2] |= 0x8000;
+      sampler->desc2 |= 0x8000;
       break;
    }
 
    /* Only clamp to edge and mirror repeat are supported */
-   desc[2] &= ~0x070000;
    switch (sampler->base.wrap_s) {
    case PIPE_TEX_WRAP_CLAMP:
    case PIPE_TEX_WRAP_CLAMP_TO_EDGE:
    case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-      desc[2] |= 0x010000;
+      sampler->desc2 |= 0x010000;
       break;
    case PIPE_TEX_WRAP_REPEAT:
    case PIPE_TEX_WRAP_MIRROR_REPEAT:
-      desc[2] |= 0x040000;
+      sampler->desc2 |= 0x040000;
       break;
    }
 }
 
+struct lima_tex_desc_key {
+   struct lima_sampler_view *view;
+   struct lima_sampler_state *sampler;
+};
+
+struct lima_tex_desc {
+   struct lima_tex_desc_key key;
+   uint32_t desc[];
+};
+
+static uint32_t
+lima_tex_desc_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct lima_tex_desc_key));
+}
+
+static bool
+lima_tex_desc_compare(const void *key1, const void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct lima_tex_desc_key)) == 0;
+}
+
+/* the descriptor of a view and sampler pair without the level addresses */
+static struct lima_tex_desc *
+lima_get_tex_desc(struct lima_context *ctx, struct lima_sampler_state *sampler,
+                  struct lima_sampler_view *texture)
+{
+   struct lima_tex_desc_key key = {
+      .view = texture,
+      .sampler = sampler,
+   };
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(ctx->tex_desc_cache, &key);
+   if (entry)
+      return entry->data;
+
+   struct lima_tex_desc *td =
+      rzalloc_size(ctx->tex_desc_cache, sizeof(*td) + texture->desc_size);
+   if (!td)
+      return NULL;
+
+   td->key = key;
+   memcpy(td->desc, texture->desc, sizeof(texture->desc));
+
+   /* lod range in 4.4 fixed point, the mip filter sits next to the
+    * min filter */
+   unsigned first_level = texture->base.u.tex.first_level;
+   unsigned last_level = texture->base.u.tex.last_level;
+   float max_lod = MIN2(sampler->base.max_lod,
+                        sampler->base.min_lod + (last_level - first_level));
+   unsigned min_lod_fixed = CLAMP(sampler->base.min_lod, 0.0f, 15.0f) * 16;
+   unsigned max_lod_fixed = CLAMP(max_lod, 0.0f, 15.0f) * 16;
+   if (!sampler->mipmap)
+      max_lod_fixed = min_lod_fixed;
+
+   td->desc[1] |= (min_lod_fixed << 12) | (max_lod_fixed << 20) |
+      sampler->desc1;
+   td->desc[2] |= sampler->desc2;
+
+   _mesa_hash_table_insert(ctx->tex_desc_cache, &td->key, td);
+   return td;
+}
+
+/* called when a view or sampler is destroyed, a new one could reuse
+ * its address */
+void
+lima_texture_forget(struct lima_context *ctx, struct lima_sampler_view *view,
+                    struct lima_sampler_state *sampler)
+{
+   struct lima_tex_desc_list *list = &ctx->tex_desc_list;
+   struct hash_entry *entry;
+
+   hash_table_foreach(ctx->tex_desc_cache, entry) {
+      struct lima_tex_desc *td = entry->data;
+      if ((view && td->key.view == view) ||
+          (sampler && td->key.sampler == sampler)) {
+         _mesa_hash_table_remove(ctx->tex_desc_cache, entry);
+         ralloc_free(td);
+      }
+   }
+
+   for (int i = 0; i < list->num; i++) {
+      if ((view && list->textures[i] == view) ||
+          (sampler && list->samplers[i] == sampler)) {
+         list->num = 0;
+         break;
+      }
+   }
+}
+
+bool
+lima_texture_init(struct lima_context *ctx)
+{
+   ctx->tex_desc_cache = _mesa_hash_table_create(
+      ctx, lima_tex_desc_hash, lima_tex_desc_compare);
+   return !!ctx->tex_desc_cache;
+}
+
+/* Descriptors are built from the prepacked pair and the level addresses.
+ * When the same set is bound again with the textures still in the same
+ * bos, the descriptor list uploaded before is used again. */
 void
 lima_update_textures(struct lima_context *ctx)
 {
    struct lima_texture_stateobj *lima_tex = &ctx->tex_stateobj;
+   struct lima_tex_desc_list *list = &ctx->tex_desc_list;
 
    assert (lima_tex->num_samplers <= 16);
 
@@ -179,20 +418,71 @@ lima_update_textures(struct lima_context *ctx)
    if (!lima_tex->num_samplers)
       return;
 
-   unsigned size = lima_tex_list_size + lima_tex->num_samplers * lima_tex_desc_size;
+   bool reuse = ctx->buffer_state[lima_ctx_buff_pp_tex_desc].bo &&
+      list->num == lima_tex->num_samplers;
+
+   for (int i = 0; i < lima_tex->num_samplers; i++) {
+      struct lima_sampler_view *texture = lima_sampler_view(lima_tex->textures[i]);
+      struct lima_resource *res = lima_resource(texture->base.texture);
+
+      lima_job_add_bo(ctx->job, LIMA_PIPE_PP, res->bo, LIMA_SUBMIT_BO_READ);
+
+      reuse = reuse && res->bo->va && list->va[i] == res->bo->va &&
+         list->textures[i] == texture &&
+         list->samplers[i] == lima_sampler_state(lima_tex->samplers[i]);
+   }
+
+   if (reuse)
+      return;
+
+   unsigned size = lima_tex_list_size;
+   for (int i = 0; i < lima_tex->num_samplers; i++) {
+      struct lima_sampler_view *texture = lima_sampler_view(lima_tex->textures[i]);
+      size += texture->desc_size;
+   }
+
    uint32_t *descs =
       lima_ctx_buff_alloc(ctx, lima_ctx_buff_pp_tex_desc,
-                          size, LIMA_CTX_BUFF_SUBMIT_PP, true);
+                          size, LIMA_CTX_BUFF_SUBMIT_PP);
 
+   bool complete = true;
+   list->num = 0;
+
+   off_t offset = lima_tex_list_size;
    for (int i = 0; i < lima_tex->num_samplers; i++) {
-      off_t offset = lima_tex_desc_size * i + lima_tex_list_size;
       struct lima_sampler_state *sampler = lima_sampler_state(lima_tex->samplers[i]);
       struct lima_sampler_view *texture = lima_sampler_view(lima_tex->textures[i]);
+      struct lima_resource *res = lima_resource(texture->base.texture);
+      uint32_t *desc = (void *)descs + offset;
 
       descs[i] = lima_ctx_buff_va(ctx, lima_ctx_buff_pp_tex_desc) + offset;
-      lima_update_tex_desc(ctx, sampler, texture, (void *)descs + offset);
+
+      struct lima_tex_desc *td = lima_get_tex_desc(ctx, sampler, texture);
+      if (td)
+         memcpy(desc, td->desc, texture->desc_size);
+      else {
+         memset(desc, 0, texture->desc_size);
+         complete = false;
+      }
+
+      lima_bo_update(res->bo, false, true);
+
+      /* attach all levels of the view */
+      unsigned first_level = texture->base.u.tex.first_level;
+      unsigned last_level = texture->base.u.tex.last_level;
+      for (unsigned l = first_level; l <= last_level; l++)
+         lima_tex_desc_set_va(desc, l - first_level,
+                              res->bo->va + res->levels[l].offset);
+
+      list->textures[i] = texture;
+      list->samplers[i] = sampler;
+      list->va[i] = res->bo->va;
+      offset += texture->desc_size;
    }
 
+   if (complete)
+      list->num = lima_tex->num_samplers;
+
    lima_dump_command_stream_print(
       descs, size, false, "add textures_desc at va %x\n",
       lima_ctx_buff_va(ctx, lima_ctx_buff_pp_tex_desc));
@@ -25,6 +25,17 @@
 #ifndef H_LIMA_TEXTURE
 #define H_LIMA_TEXTURE
 
+#include "pipe/p_format.h"
+
+struct lima_sampler_view;
+struct lima_sampler_state;
+
+const unsigned char *lima_texture_format_swizzle(enum pipe_format format);
+void lima_texture_pack_view(struct lima_sampler_view *view);
+void lima_texture_pack_sampler(struct lima_sampler_state *sampler);
+void lima_texture_forget(struct lima_context *ctx, struct lima_sampler_view *view,
+                         struct lima_sampler_state *sampler);
+bool lima_texture_init(struct lima_context *ctx);
 void lima_update_textures(struct lima_context *ctx);
 
 #endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "lima_tiling.h"
+
+/* The offset of pixel (x, y) in a tile is built by interleaving bits,
+ * bit 2i is x_i ^ y_i and bit 2i+1 is y_i, so it can be split into a
+ * x and a y part combined with xor. */
+static const uint8_t lima_tile_x_bits[LIMA_TILE_SIZE] = {
+   0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+   0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55,
+};
+
+static const uint8_t lima_tile_y_bits[LIMA_TILE_SIZE] = {
+   0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+   0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff,
+};
+
+/* always inlined with a constant bpp, so that the texel copy becomes a
+ * single load/store instead of a memcpy call */
+static inline __attribute__((always_inline)) void
+lima_tiling_copy(uint8_t *tiled, uint8_t *linear,
+                 unsigned x, unsigned y, unsigned w, unsigned h,
+                 unsigned tiled_stride, unsigned linear_stride,
+                 unsigned bpp, bool store)
+{
+   unsigned tile_size = LIMA_TILE_SIZE * LIMA_TILE_SIZE * bpp;
+
+   for (unsigned py = y; py < y + h; py++) {
+      uint8_t *tile_row = tiled + (py / LIMA_TILE_SIZE) * tiled_stride * LIMA_TILE_SIZE;
+      uint8_t *lin = linear + (py - y) * linear_stride;
+      unsigned y_bits = lima_tile_y_bits[py % LIMA_TILE_SIZE];
+
+      for (unsigned px = x; px < x + w; px++, lin += bpp) {
+         uint8_t *t = tile_row + (px / LIMA_TILE_SIZE) * tile_size +
+            (lima_tile_x_bits[px % LIMA_TILE_SIZE] ^ y_bits) * bpp;
+
+         if (store)
+            memcpy(t, lin, bpp);
+         else
+            memcpy(lin, t, bpp);
+      }
+   }
+}
+
+static void
+lima_tiling(uint8_t *tiled, uint8_t *linear,
+            unsigned x, unsigned y, unsigned w, unsigned h,
+            unsigned tiled_stride, unsigned linear_stride,
+            unsigned bpp, bool store)
+{
+   switch (bpp) {
+   case 1:
+      lima_tiling_copy(tiled, linear, x, y, w, h, tiled_stride, linear_stride, 1, store);
+      break;
+   case 2:
+      lima_tiling_copy(tiled, linear, x, y, w, h, tiled_stride, linear_stride, 2, store);
+      break;
+   case 3:
+      lima_tiling_copy(tiled, linear, x, y, w, h, tiled_stride, linear_stride, 3, store);
+      break;
+   case 4:
+      lima_tiling_copy(tiled, linear, x, y, w, h, tiled_stride, linear_stride, 4, store);
+      break;
+   default:
+      lima_tiling_copy(tiled, linear, x, y, w, h, tiled_stride, linear_stride, bpp, store);
+      break;
+   }
+}
+
+void
+lima_load_tiled_image(void *dst, const void *src,
+                      unsigned x, unsigned y, unsigned w, unsigned h,
+                      unsigned dst_stride, unsigned tiled_stride,
+                      unsigned bpp)
+{
+   lima_tiling((uint8_t *)src, dst, x, y, w, h, tiled_stride, dst_stride,
+               bpp, false);
+}
+
+void
+lima_store_tiled_image(void *dst, const void *src,
+                       unsigned x, unsigned y, unsigned w, unsigned h,
+                       unsigned tiled_stride, unsigned src_stride,
+                       unsigned bpp)
+{
+   lima_tiling(dst, (uint8_t *)src, x, y, w, h, tiled_stride, src_stride,
+               bpp, true);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef H_LIMA_TILING
+#define H_LIMA_TILING
+
+#include <stdint.h>
+
+/* Textures are stored in 16x16 pixel tiles, tiles are laid out in rows and
+ * the pixels inside a tile are in an interleaved order. tiled_stride is the
+ * byte stride of one pixel row of the 16 aligned texture. */
+#define LIMA_TILE_SIZE 16
+
+void lima_load_tiled_image(void *dst, const void *src,
+                           unsigned x, unsigned y, unsigned w, unsigned h,
+                           unsigned dst_stride, unsigned tiled_stride,
+                           unsigned bpp);
+void lima_store_tiled_image(void *dst, const void *src,
+                            unsigned x, unsigned y, unsigned w, unsigned h,
+                            unsigned tiled_stride, unsigned src_stride,
+                            unsigned bpp);
+
+#endif
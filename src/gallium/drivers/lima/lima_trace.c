@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "xf86drm.h"
+#include "lima_drm.h"
+
+#include "util/u_queue.h"
+#include "util/os_time.h"
+
+#include "lima_screen.h"
+#include "lima_trace.h"
+
+/* The events go to a ring buffer which the trace thread writes to the
+ * file once it's half full, an event finding the ring full is dropped
+ * so that tracing never waits for the disk.
+ *
+ * The kernel doesn't report when a job runs. A thread for each pipe
+ * waits for the fences in submit order and takes the time it wakes up as
+ * the end of the job, a job begins when it's submitted or when the
+ * previous job of the pipe ends. Jobs of other processes are not seen
+ * and make the jobs around them look longer. */
+
+#define LIMA_TRACE_RING_SIZE 4096
+
+/* thread ids of the GP and PP in the trace */
+#define LIMA_TRACE_TID_GPU(pipe) (-1 - (int)(pipe))
+
+struct lima_trace_event {
+   const char *name;
+   int64_t begin;
+   int64_t end;
+   int tid;
+   /* GPU jobs only */
+   uint32_t ctx;
+   uint32_t fence;
+};
+
+struct lima_trace {
+   struct lima_screen *screen;
+   FILE *fp;
+   int pid;
+
+   mtx_t lock;
+   struct lima_trace_event ring[LIMA_TRACE_RING_SIZE];
+   uint32_t head;
+   uint32_t tail;
+   unsigned num_dropped;
+
+   /* writes the ring to the file */
+   struct util_queue queue;
+   struct util_queue_fence drain_fence;
+   bool first_event;
+
+   /* wait the fences of each pipe, the last job end is only used by
+    * the thread of its pipe */
+   struct util_queue gpu_queue[2];
+   int64_t gpu_last_end[2];
+};
+
+struct lima_trace_gpu_job {
+   struct lima_trace *trace;
+   uint32_t ctx;
+   uint32_t pipe;
+   uint32_t fence;
+   int64_t submit_time;
+   struct util_queue_fence ready;
+};
+
+static void
+lima_trace_write_thread_name(struct lima_trace *trace, int tid,
+                             const char *name)
+{
+   fprintf(trace->fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+           "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+           trace->first_event ? "" : ",\n", trace->pid, tid, name);
+   trace->first_event = false;
+}
+
+struct lima_trace *
+lima_trace_create(struct lima_screen *screen, const char *filename)
+{
+   struct lima_trace *trace = calloc(1, sizeof(*trace));
+   if (!trace)
+      return NULL;
+
+   trace->screen = screen;
+   trace->pid = getpid();
+   trace->first_event = true;
+
+   trace->fp = fopen(filename, "w");
+   if (!trace->fp)
+      goto err_out0;
+
+   if (!util_queue_init(&trace->queue, "lima_trace", 8, 1, 0))
+      goto err_out1;
+
+   /* the submits of all the contexts can be waited for, never drop one */
+   if (!util_queue_init(&trace->gpu_queue[LIMA_PIPE_GP], "lima_trace_gp",
+                        64, 1, UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      goto err_out2;
+
+   if (!util_queue_init(&trace->gpu_queue[LIMA_PIPE_PP], "lima_trace_pp",
+                        64, 1, UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      goto err_out3;
+
+   fprintf(trace->fp, "[\n");
+   lima_trace_write_thread_name(trace, LIMA_TRACE_TID_GPU(LIMA_PIPE_GP),
+                                "lima GP");
+   lima_trace_write_thread_name(trace, LIMA_TRACE_TID_GPU(LIMA_PIPE_PP),
+                                "lima PP");
+
+   mtx_init(&trace->lock, mtx_plain);
+   util_queue_fence_init(&trace->drain_fence);
+   return trace;
+
+err_out3:
+   util_queue_destroy(&trace->gpu_queue[LIMA_PIPE_GP]);
+err_out2:
+   util_queue_destroy(&trace->queue);
+err_out1:
+   fclose(trace->fp);
+err_out0:
+   free(trace);
+   return NULL;
+}
+
+static void
+lima_trace_write_event(struct lima_trace *trace, struct lima_trace_event *e)
+{
+   fprintf(trace->fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+           "\"ts\":%.3f,\"dur\":%.3f", trace->first_event ? "" : ",\n",
+           e->name, trace->pid, e->tid, e->begin / 1000.0,
+           (e->end - e->begin) / 1000.0);
+
+   if (e->tid < 0)
+      fprintf(trace->fp, ",\"args\":{\"ctx\":%u,\"fence\":%u}",
+              e->ctx, e->fence);
+
+   fprintf(trace->fp, "}");
+   trace->first_event = false;
+}
+
+/* the events are copied out in chunks so the lock isn't held while
+ * printing */
+static void
+lima_trace_drain(void *data, int thread_index)
+{
+   struct lima_trace *trace = data;
+   struct lima_trace_event events[64];
+
+   while (true) {
+      mtx_lock(&trace->lock);
+      unsigned num = MIN2(trace->head - trace->tail, ARRAY_SIZE(events));
+      for (unsigned i = 0; i < num; i++)
+         events[i] = trace->ring[(trace->tail + i) % LIMA_TRACE_RING_SIZE];
+      trace->tail += num;
+      mtx_unlock(&trace->lock);
+
+      if (!num)
+         break;
+
+      for (unsigned i = 0; i < num; i++)
+         lima_trace_write_event(trace, events + i);
+   }
+
+   fflush(trace->fp);
+}
+
+static void
+lima_trace_add(struct lima_trace *trace, struct lima_trace_event *e)
+{
+   mtx_lock(&trace->lock);
+
+   uint32_t num = trace->head - trace->tail;
+   if (num == LIMA_TRACE_RING_SIZE)
+      trace->num_dropped++;
+   else {
+      trace->ring[trace->head++ % LIMA_TRACE_RING_SIZE] = *e;
+
+      if (num + 1 >= LIMA_TRACE_RING_SIZE / 2 &&
+          util_queue_fence_is_signalled(&trace->drain_fence))
+         util_queue_add_job(&trace->queue, trace, &trace->drain_fence,
+                            lima_trace_drain, NULL);
+   }
+
+   mtx_unlock(&trace->lock);
+}
+
+void
+lima_trace_destroy(struct lima_trace *trace)
+{
+   for (int i = 0; i < ARRAY_SIZE(trace->gpu_queue); i++) {
+      util_queue_finish(&trace->gpu_queue[i]);
+      util_queue_destroy(&trace->gpu_queue[i]);
+   }
+
+   util_queue_finish(&trace->queue);
+   util_queue_destroy(&trace->queue);
+
+   lima_trace_drain(trace, 0);
+   if (trace->num_dropped)
+      fprintf(stderr, "lima: trace dropped %u events\n", trace->num_dropped);
+
+   fprintf(trace->fp, "\n]\n");
+   fclose(trace->fp);
+
+   util_queue_fence_destroy(&trace->drain_fence);
+   mtx_destroy(&trace->lock);
+   free(trace);
+}
+
+void
+lima_trace_cpu(struct lima_trace *trace, const char *name, int64_t begin)
+{
+   struct lima_trace_event e = {
+      .name = name,
+      .begin = begin,
+      .end = os_time_get_nano(),
+      .tid = syscall(SYS_gettid),
+   };
+
+   lima_trace_add(trace, &e);
+}
+
+static void
+lima_trace_gpu_job_execute(void *data, int thread_index)
+{
+   struct lima_trace_gpu_job *job = data;
+   struct lima_trace *trace = job->trace;
+
+   struct drm_lima_wait_fence req = {
+      .ctx = job->ctx,
+      .pipe = job->pipe,
+      .seq = job->fence,
+      .timeout_ns = OS_TIMEOUT_INFINITE,
+   };
+
+   /* fails when the context is gone, the job end is unknown */
+   if (drmIoctl(trace->screen->fd, DRM_IOCTL_LIMA_WAIT_FENCE, &req))
+      return;
+
+   struct lima_trace_event e = {
+      .name = job->pipe == LIMA_PIPE_GP ? "gp job" : "pp job",
+      .begin = MAX2(job->submit_time, trace->gpu_last_end[job->pipe]),
+      .end = os_time_get_nano(),
+      .tid = LIMA_TRACE_TID_GPU(job->pipe),
+      .ctx = job->ctx,
+      .fence = job->fence,
+   };
+   trace->gpu_last_end[job->pipe] = e.end;
+
+   lima_trace_add(trace, &e);
+}
+
+static void
+lima_trace_gpu_job_cleanup(void *data, int thread_index)
+{
+   struct lima_trace_gpu_job *job = data;
+
+   util_queue_fence_destroy(&job->ready);
+   free(job);
+}
+
+void
+lima_trace_gpu_job(struct lima_trace *trace, uint32_t ctx, uint32_t pipe,
+                   uint32_t fence, int64_t submit_time)
+{
+   struct lima_trace_gpu_job *job = malloc(sizeof(*job));
+   if (!job)
+      return;
+
+   job->trace = trace;
+   job->ctx = ctx;
+   job->pipe = pipe;
+   job->fence = fence;
+   job->submit_time = submit_time;
+   util_queue_fence_init(&job->ready);
+
+   util_queue_add_job(&trace->gpu_queue[pipe], job, &job->ready,
+                      lima_trace_gpu_job_execute, lima_trace_gpu_job_cleanup);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#ifndef H_LIMA_TRACE
+#define H_LIMA_TRACE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/os_time.h"
+
+#include "lima_screen.h"
+
+/* With LIMA_TRACE set the CPU phases that may stall the application and
+ * the GP/PP jobs are written to a Chrome trace JSON file, which the
+ * Chrome trace viewer and Perfetto load. Times are CLOCK_MONOTONIC. */
+
+struct lima_trace;
+
+struct lima_trace *lima_trace_create(struct lima_screen *screen,
+                                     const char *filename);
+void lima_trace_destroy(struct lima_trace *trace);
+void lima_trace_cpu(struct lima_trace *trace, const char *name,
+                    int64_t begin);
+void lima_trace_gpu_job(struct lima_trace *trace, uint32_t ctx,
+                        uint32_t pipe, uint32_t fence, int64_t submit_time);
+
+/* the name has to be a string constant, it's only printed later */
+static inline int64_t
+lima_trace_begin(struct lima_screen *screen)
+{
+   return screen->trace ? os_time_get_nano() : 0;
+}
+
+static inline void
+lima_trace_end(struct lima_screen *screen, const char *name, int64_t begin)
+{
+   if (screen->trace)
+      lima_trace_cpu(screen->trace, name, begin);
+}
+
+#endif
@@ -28,39 +28,143 @@
 #include "lima_util.h"
 
 #include "util/u_math.h"
+#include "util/bitscan.h"
+#include "util/hash_table.h"
+
+/* Free VA holes are kept in size class lists, list i holds holes of
+ * [2^i, 2^(i+1)) pages, so allocation only needs a first fit search
+ * in the matching class, any hole in a higher class fits for sure.
+ * Each hole is also indexed by its start and end address for O(1)
+ * coalescing with its neighbours when a range is freed. */
 
 struct lima_va_hole {
    struct list_head list;
    uint64_t offset;
-   uint64_t size;
+   uint64_t end;
+   unsigned bucket;
 };
 
+static uint32_t
+va_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(uint64_t));
+}
+
+static bool
+va_key_equal(const void *a, const void *b)
+{
+   return *(const uint64_t *)a == *(const uint64_t *)b;
+}
+
+static unsigned
+va_hole_bucket(uint64_t size)
+{
+   unsigned index = util_logbase2(size / LIMA_PAGE_SIZE);
+   return MIN2(index, LIMA_VA_NUM_BUCKETS - 1);
+}
+
+static void
+va_hole_insert(struct lima_screen *screen, struct lima_va_hole *hole)
+{
+   hole->bucket = va_hole_bucket(hole->end - hole->offset);
+   list_add(&hole->list, &screen->va_buckets[hole->bucket]);
+   screen->va_bucket_mask |= 1u << hole->bucket;
+
+   _mesa_hash_table_insert(screen->va_hole_start, &hole->offset, hole);
+   _mesa_hash_table_insert(screen->va_hole_end, &hole->end, hole);
+}
+
+static void
+va_hole_remove(struct lima_screen *screen, struct lima_va_hole *hole)
+{
+   list_del(&hole->list);
+   if (list_empty(&screen->va_buckets[hole->bucket]))
+      screen->va_bucket_mask &= ~(1u << hole->bucket);
+
+   struct hash_entry *entry;
+   entry = _mesa_hash_table_search(screen->va_hole_start, &hole->offset);
+   _mesa_hash_table_remove(screen->va_hole_start, entry);
+   entry = _mesa_hash_table_search(screen->va_hole_end, &hole->end);
+   _mesa_hash_table_remove(screen->va_hole_end, entry);
+}
+
 bool lima_vamgr_init(struct lima_screen *screen)
 {
    struct lima_va_hole *hole;
 
-   list_inithead(&screen->va_holes);
-   mtx_init(&screen->va_lock, mtx_plain);
+   for (int i = 0; i < LIMA_VA_NUM_BUCKETS; i++)
+      list_inithead(&screen->va_buckets[i]);
+   screen->va_bucket_mask = 0;
+
+   screen->va_hole_start =
+      _mesa_hash_table_create(screen, va_key_hash, va_key_equal);
+   if (!screen->va_hole_start)
+      return false;
+
+   screen->va_hole_end =
+      _mesa_hash_table_create(screen, va_key_hash, va_key_equal);
+   if (!screen->va_hole_end)
+      goto err_out0;
 
    hole = malloc(sizeof(*hole));
    if (!hole)
-      return false;
+      goto err_out1;
+
+   mtx_init(&screen->va_lock, mtx_plain);
 
    hole->offset = screen->va_start;
-   hole->size = screen->va_end;
-   list_add(&hole->list, &screen->va_holes);
+   hole->end = screen->va_end;
+   va_hole_insert(screen, hole);
+   screen->va_free_size = hole->end - hole->offset;
+   screen->va_num_holes = 1;
    return true;
+
+err_out1:
+   _mesa_hash_table_destroy(screen->va_hole_end, NULL);
+err_out0:
+   _mesa_hash_table_destroy(screen->va_hole_start, NULL);
+   return false;
 }
 
 void lima_vamgr_fini(struct lima_screen *screen)
 {
-   list_for_each_entry_safe(struct lima_va_hole, hole, &screen->va_holes, list) {
-      list_del(&hole->list);
-      free(hole);
+   for (int i = 0; i < LIMA_VA_NUM_BUCKETS; i++) {
+      list_for_each_entry_safe(struct lima_va_hole, hole,
+                               &screen->va_buckets[i], list) {
+         list_del(&hole->list);
+         free(hole);
+      }
    }
+
+   _mesa_hash_table_destroy(screen->va_hole_start, NULL);
+   _mesa_hash_table_destroy(screen->va_hole_end, NULL);
    mtx_destroy(&screen->va_lock);
 }
 
+static struct lima_va_hole *
+va_hole_find(struct lima_screen *screen, uint64_t size)
+{
+   unsigned bucket = va_hole_bucket(size);
+
+   /* holes in the same class may be smaller than size */
+   list_for_each_entry(struct lima_va_hole, hole,
+                       &screen->va_buckets[bucket], list) {
+      if (hole->end - hole->offset >= size)
+         return hole;
+   }
+
+   uint32_t mask = screen->va_bucket_mask;
+   if (bucket + 1 < LIMA_VA_NUM_BUCKETS)
+      mask &= ~((2u << bucket) - 1);
+   else
+      mask = 0;
+   if (!mask)
+      return NULL;
+
+   return list_first_entry(&screen->va_buckets[ffs(mask) - 1],
+                           struct lima_va_hole, list);
+}
+
 bool lima_va_range_alloc(struct lima_screen *screen, uint32_t size, uint32_t *va)
 {
    bool ret = false;
@@ -69,44 +173,28 @@ bool lima_va_range_alloc(struct lima_screen *screen, uint32_t size, uint32_t *va
 
    mtx_lock(&screen->va_lock);
 
-   list_for_each_entry(struct lima_va_hole, hole, &screen->va_holes, list) {
-      if (hole->size == size) {
-         *va = hole->offset;
-         ret = true;
+   struct lima_va_hole *hole = va_hole_find(screen, size);
+   if (hole) {
+      *va = hole->offset;
+      ret = true;
 
-         list_del(&hole->list);
+      va_hole_remove(screen, hole);
+      if (hole->end - hole->offset == size) {
          free(hole);
-         break;
+         screen->va_num_holes--;
       }
-      else if (hole->size > size) {
-         *va = hole->offset;
-         ret = true;
-
+      else {
          hole->offset += size;
-         hole->size -= size;
-         break;
+         va_hole_insert(screen, hole);
       }
+
+      screen->va_free_size -= size;
    }
 
    mtx_unlock(&screen->va_lock);
    return ret;
 }
 
-static bool add_va_hole(struct list_head *head, uint32_t size, uint32_t va)
-{
-   struct lima_va_hole *hole;
-
-   hole = malloc(sizeof(*hole));
-   if (!hole)
-      return false;
-
-   hole->offset = va;
-   hole->size = size;
-
-   list_addtail(&hole->list, head);
-   return true;
-}
-
 bool lima_va_range_free(struct lima_screen *screen, uint32_t size, uint32_t va)
 {
    bool ret = true;
@@ -114,43 +202,80 @@ bool lima_va_range_free(struct lima_screen *screen, uint32_t size, uint32_t va)
    va &= ~(LIMA_PAGE_SIZE - 1);
    size = align(size, LIMA_PAGE_SIZE);
 
+   uint64_t start = va;
+   uint64_t end = start + size;
+
    mtx_lock(&screen->va_lock);
 
-   if (list_empty(&screen->va_holes))
-      ret = add_va_hole(&screen->va_holes, size, va);
+   struct hash_entry *entry;
+   struct lima_va_hole *prev = NULL, *next = NULL;
+
+   entry = _mesa_hash_table_search(screen->va_hole_end, &start);
+   if (entry)
+      prev = entry->data;
+   entry = _mesa_hash_table_search(screen->va_hole_start, &end);
+   if (entry)
+      next = entry->data;
+
+   if (prev && next) {
+      va_hole_remove(screen, prev);
+      va_hole_remove(screen, next);
+      prev->end = next->end;
+      va_hole_insert(screen, prev);
+      free(next);
+      screen->va_num_holes--;
+   }
+   else if (prev) {
+      va_hole_remove(screen, prev);
+      prev->end = end;
+      va_hole_insert(screen, prev);
+   }
+   else if (next) {
+      va_hole_remove(screen, next);
+      next->offset = start;
+      va_hole_insert(screen, next);
+   }
    else {
-      list_for_each_entry(struct lima_va_hole, hole, &screen->va_holes, list) {
-         if (va + size == hole->offset) {
-            hole->offset = va;
-            hole->size += size;
-            break;
-         }
-         else if (va + size < hole->offset) {
-            ret = add_va_hole(&hole->list, size, va);
-            break;
-         }
-         else if (va == hole->offset + hole->size) {
-            if (hole->list.next != &screen->va_holes) {
-               struct lima_va_hole *next;
-               next = list_first_entry(&hole->list, struct lima_va_hole, list);
-               if (next->offset == va + size) {
-                  size += next->size;
-                  list_del(&next->list);
-                  free(next);
-               }
-            }
-            hole->size += size;
-            break;
-         }
-         else if (va > hole->offset + hole->size) {
-            if (hole->list.next == &screen->va_holes) {
-               ret = add_va_hole(&screen->va_holes, size, va);
-               break;
-            }
-         }
+      struct lima_va_hole *hole = malloc(sizeof(*hole));
+      if (hole) {
+         hole->offset = start;
+         hole->end = end;
+         va_hole_insert(screen, hole);
+         screen->va_num_holes++;
       }
+      else
+         ret = false;
    }
 
+   if (ret)
+      screen->va_free_size += size;
+
    mtx_unlock(&screen->va_lock);
    return ret;
 }
+
+void lima_va_get_stats(struct lima_screen *screen, struct lima_va_stats *stats)
+{
+   mtx_lock(&screen->va_lock);
+
+   stats->free_size = screen->va_free_size;
+   stats->num_holes = screen->va_num_holes;
+   stats->largest_hole = 0;
+
+   if (screen->va_bucket_mask) {
+      unsigned bucket = util_last_bit(screen->va_bucket_mask) - 1;
+      list_for_each_entry(struct lima_va_hole, hole,
+                          &screen->va_buckets[bucket], list) {
+         stats->largest_hole = MAX2(stats->largest_hole, hole->end - hole->offset);
+      }
+   }
+
+   /* percent of free space not usable by the largest allocation */
+   if (stats->free_size)
+      stats->fragmentation =
+         100 - stats->largest_hole * 100 / stats->free_size;
+   else
+      stats->fragmentation = 0;
+
+   mtx_unlock(&screen->va_lock);
+}
@@ -25,6 +25,14 @@
 #define H_LIMA_VAMGR
 
 #include <stdbool.h>
+#include <stdint.h>
+
+struct lima_va_stats {
+   uint64_t free_size;
+   uint64_t largest_hole;
+   unsigned num_holes;
+   unsigned fragmentation; /* in percent */
+};
 
 bool lima_vamgr_init(struct lima_screen *screen);
 void lima_vamgr_fini(struct lima_screen *screen);
@@ -32,4 +40,6 @@ void lima_vamgr_fini(struct lima_screen *screen);
 bool lima_va_range_alloc(struct lima_screen *screen, uint32_t size, uint32_t *va);
 bool lima_va_range_free(struct lima_screen *screen, uint32_t size, uint32_t va);
 
+void lima_va_get_stats(struct lima_screen *screen, struct lima_va_stats *stats);
+
 #endif
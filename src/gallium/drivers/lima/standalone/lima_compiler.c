@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/* Compiles shaders with the driver pipeline without a GPU or a GL context,
+ * prints the code and the same stats as the debug callback. With several
+ * files and --repeat it times the compile of a shader corpus. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "util/ralloc.h"
+#include "util/os_time.h"
+
+#include "tgsi/tgsi_text.h"
+#include "tgsi/tgsi_parse.h"
+#include "nir/tgsi_to_nir.h"
+#include "compiler/nir/nir.h"
+#include "compiler/nir_types.h"
+#include "compiler/glsl/standalone.h"
+#include "compiler/glsl/glsl_to_nir.h"
+
+#include "lima_context.h"
+#include "lima_program.h"
+#include "ir/lima_ir.h"
+
+static int
+type_size(const struct glsl_type *type)
+{
+   return glsl_count_attribute_slots(type, false);
+}
+
+static void
+insert_sorted(struct exec_list *var_list, nir_variable *new_var)
+{
+   nir_foreach_variable(var, var_list) {
+      if (var->data.location > new_var->data.location) {
+         exec_node_insert_node_before(&var->node, &new_var->node);
+         return;
+      }
+   }
+   exec_list_push_tail(var_list, &new_var->node);
+}
+
+/* the state tracker numbers the varyings in slot order, which puts
+ * gl_Position first */
+static void
+sort_varyings(struct exec_list *var_list)
+{
+   struct exec_list new_list;
+   exec_list_make_empty(&new_list);
+   nir_foreach_variable_safe(var, var_list) {
+      exec_node_remove(&var->node);
+      insert_sorted(&new_list, var);
+   }
+   exec_list_move_nodes_to(&new_list, var_list);
+}
+
+static nir_shader *
+load_glsl(char *file, gl_shader_stage stage)
+{
+   static const struct standalone_options options = {
+      .glsl_version = 120,
+      .do_link = true,
+   };
+
+   struct gl_shader_program *prog =
+      standalone_compile_shader(&options, 1, &file);
+   if (!prog)
+      errx(1, "couldn't parse `%s'", file);
+
+   const void *compiler_options = lima_program_get_compiler_options(
+      stage == MESA_SHADER_VERTEX ? PIPE_SHADER_VERTEX : PIPE_SHADER_FRAGMENT);
+   nir_shader *nir = glsl_to_nir(prog, stage, compiler_options);
+
+   /* what the state tracker does before passing the shader */
+   NIR_PASS_V(nir, nir_lower_io_to_temporaries,
+              nir_shader_get_entrypoint(nir), true, true);
+   NIR_PASS_V(nir, nir_lower_global_vars_to_local);
+   NIR_PASS_V(nir, nir_split_var_copies);
+   NIR_PASS_V(nir, nir_lower_var_copies);
+   NIR_PASS_V(nir, nir_lower_io_types);
+
+   sort_varyings(&nir->inputs);
+   nir_assign_var_locations(&nir->inputs, &nir->num_inputs, type_size);
+   sort_varyings(&nir->outputs);
+   nir_assign_var_locations(&nir->outputs, &nir->num_outputs, type_size);
+   nir_assign_var_locations(&nir->uniforms, &nir->num_uniforms, type_size);
+
+   NIR_PASS_V(nir, nir_lower_system_values);
+   NIR_PASS_V(nir, nir_lower_samplers, prog);
+
+   /* and what lima_create_*_state does */
+   NIR_PASS_V(nir, nir_lower_io, nir_var_all, type_size,
+              (nir_lower_io_options)0);
+
+   /* the program stays, the NIR points to its types */
+   return nir;
+}
+
+static nir_shader *
+load_tgsi(const char *file)
+{
+   int fd = open(file, O_RDONLY);
+   if (fd == -1)
+      errx(1, "couldn't open `%s'", file);
+
+   struct stat st;
+   if (fstat(fd, &st))
+      errx(1, "couldn't stat `%s'", file);
+
+   char *text = calloc(1, st.st_size + 1);
+   if (!text || read(fd, text, st.st_size) != st.st_size)
+      errx(1, "couldn't read `%s'", file);
+   close(fd);
+
+   static struct tgsi_token tokens[65536];
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      errx(1, "couldn't parse `%s'", file);
+   free(text);
+
+   const void *compiler_options = lima_program_get_compiler_options(
+      tgsi_get_processor_type(tokens));
+   if (!compiler_options)
+      errx(1, "`%s' is not a vertex or fragment shader", file);
+
+   return tgsi_to_nir(tokens, compiler_options);
+}
+
+/* there's no disassembler yet, print the words of each instr */
+static void
+print_vs(struct lima_vs_shader_state *so)
+{
+   uint32_t *data = so->shader;
+
+   for (int i = 0; i < so->shader_size / 16; i++) {
+      printf("%03d:", i);
+      for (int j = 0; j < 4; j++)
+         printf(" %08x", data[i * 4 + j]);
+      printf("\n");
+   }
+
+   float *constant = so->constant;
+   for (int i = 0; i < so->constant_size / 16; i++) {
+      printf("const %03d: %f %f %f %f\n", i, constant[i * 4],
+             constant[i * 4 + 1], constant[i * 4 + 2], constant[i * 4 + 3]);
+   }
+}
+
+static void
+print_fs(struct lima_fs_shader_state *so)
+{
+   uint32_t *data = so->shader;
+   int num = so->shader_size / 4;
+
+   /* the low 5 bits of the first word are the size of the instr */
+   for (int i = 0, index = 0; i < num; index++) {
+      int size = data[i] & 0x1f;
+      if (!size)
+         break;
+
+      printf("%03d:", index);
+      for (int j = 0; j < size && i + j < num; j++)
+         printf(" %08x", data[i + j]);
+      printf("\n");
+
+      i += size;
+   }
+}
+
+static void
+print_stats(const char *name, struct lima_shader_stats *stats)
+{
+   printf("%s: %d inst, %d/%d slots, %d regs, %d spills, %d consts, "
+          "%"PRId64" us, %"PRId64" us regalloc\n",
+          name, stats->instrs, stats->slots, stats->max_slots,
+          stats->regs, stats->spills, stats->consts, stats->compile_time,
+          stats->regalloc_time);
+}
+
+static void
+add_stats(struct lima_shader_stats *total, struct lima_shader_stats *stats)
+{
+   total->instrs += stats->instrs;
+   total->slots += stats->slots;
+   total->max_slots += stats->max_slots;
+   total->regs += stats->regs;
+   total->spills += stats->spills;
+   total->consts += stats->consts;
+   total->compile_time += stats->compile_time;
+   total->regalloc_time += stats->regalloc_time;
+}
+
+/* each compile runs on its own clone, the stats are the ones of the
+ * fastest run */
+static bool
+compile(const char *file, nir_shader *nir, struct ra_regs *ra,
+        int repeat, bool print, struct lima_shader_stats *total)
+{
+   struct lima_shader_stats best = {0};
+
+   for (int i = 0; i < repeat; i++) {
+      nir_shader *clone = nir_shader_clone(NULL, nir);
+      struct lima_shader_stats stats;
+      bool ret;
+
+      if (nir->info.stage == MESA_SHADER_VERTEX) {
+         struct lima_vs_shader_state *so =
+            rzalloc(NULL, struct lima_vs_shader_state);
+
+         ret = lima_program_compile_vs_nir(so, clone);
+         if (ret && print && !i)
+            print_vs(so);
+         stats = so->stats;
+         ralloc_free(so);
+      }
+      else {
+         struct lima_fs_shader_state *so =
+            rzalloc(NULL, struct lima_fs_shader_state);
+
+         lima_fs_key_init(&so->key);
+         ret = lima_program_compile_fs_nir(so, clone, ra);
+         if (ret && print && !i)
+            print_fs(so);
+         stats = so->stats;
+         ralloc_free(so);
+      }
+
+      ralloc_free(clone);
+
+      if (!ret) {
+         fprintf(stderr, "%s: compile fail\n", file);
+         return false;
+      }
+
+      if (!i || stats.compile_time < best.compile_time)
+         best = stats;
+   }
+
+   print_stats(file, &best);
+   add_stats(total, &best);
+   return true;
+}
+
+static void
+print_usage(void)
+{
+   printf("Usage: lima_compiler [OPTIONS]... <file.vert | file.frag | file.tgsi>...\n");
+   printf("    --verbose        - print the NIR and the gpir/ppir debug output\n");
+   printf("    --fp16-varying   - store mediump and lowp varyings as fp16\n");
+   printf("    --repeat N       - compile each shader N times, keep the fastest\n");
+   printf("    --quiet          - only print the stats\n");
+   printf("    --help           - show this message\n");
+}
+
+int
+main(int argc, char **argv)
+{
+   int n = 1, repeat = 1;
+   bool print = true;
+
+   while (n < argc) {
+      if (!strcmp(argv[n], "--verbose")) {
+         lima_shader_debug_gp = true;
+         lima_shader_debug_pp = true;
+         n++;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--fp16-varying")) {
+         lima_fp16_varying = true;
+         n++;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--repeat")) {
+         if (n + 1 == argc)
+            errx(1, "--repeat needs a count");
+         repeat = MAX2(atoi(argv[n + 1]), 1);
+         n += 2;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--quiet")) {
+         print = false;
+         n++;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--help")) {
+         print_usage();
+         return 0;
+      }
+
+      break;
+   }
+
+   if (n == argc) {
+      print_usage();
+      return 1;
+   }
+
+   struct ra_regs *ra = ppir_regalloc_init(NULL);
+   if (!ra)
+      errx(1, "couldn't create the pp register set");
+
+   struct lima_shader_stats total = {0};
+   int num_shaders = 0, num_fail = 0;
+   int64_t start = os_time_get();
+
+   for (; n < argc; n++) {
+      char *file = argv[n];
+      char *ext = strrchr(file, '.');
+      nir_shader *nir;
+
+      if (ext && !strcmp(ext, ".vert"))
+         nir = load_glsl(file, MESA_SHADER_VERTEX);
+      else if (ext && !strcmp(ext, ".frag"))
+         nir = load_glsl(file, MESA_SHADER_FRAGMENT);
+      else if (ext && !strcmp(ext, ".tgsi"))
+         nir = load_tgsi(file);
+      else {
+         print_usage();
+         return 1;
+      }
+
+      if (print)
+         printf("; %s\n", file);
+
+      if (!compile(file, nir, ra, repeat, print, &total))
+         num_fail++;
+      num_shaders++;
+
+      ralloc_free(nir);
+   }
+
+   if (num_shaders > 1) {
+      print_stats("total", &total);
+      printf("%d shaders, %d failed, %"PRId64" us wall\n",
+             num_shaders, num_fail, os_time_get() - start);
+   }
+
+   ralloc_free(ra);
+   return num_fail ? 1 : 0;
+}
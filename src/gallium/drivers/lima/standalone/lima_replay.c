@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/* Submits the jobs of a LIMA_CAPTURE file again, see lima_capture.h, and
+ * reports the GPU time of the frames. A frame ends with a PP job. By
+ * default the jobs are queued like the driver did, one frame ahead, and
+ * the frame time is the time between the ends of two frames. With
+ * --serial each job is waited for, which gives the GP and PP time of
+ * each frame without the overlap. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "xf86drm.h"
+#include "lima_drm.h"
+
+#include "util/macros.h"
+#include "util/u_dynarray.h"
+#include "util/hash_table.h"
+#include "util/os_time.h"
+
+#include "lima_capture.h"
+
+#define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+
+struct replay_bo {
+   uint32_t handle;
+   uint32_t va;
+   uint32_t size;
+   void *map;
+};
+
+struct replay_submit {
+   struct lima_capture_submit *submit;
+   /* the captured fence and the one of the current replay loop */
+   bool has_capture_fence;
+   uint32_t capture_fence;
+   uint32_t fence;
+   bool submitted;
+   /* submit index each fence dep waits for, -1 if it's dropped */
+   int *dep_submits;
+};
+
+enum replay_event_type {
+   REPLAY_EVENT_BO,
+   REPLAY_EVENT_SUBMIT,
+};
+
+struct replay_event {
+   enum replay_event_type type;
+   union {
+      struct lima_capture_bo *bo;
+      int submit;
+   };
+};
+
+struct replay {
+   int fd;
+   void *data;
+   size_t size;
+   struct lima_capture_header *header;
+
+   struct util_dynarray events;
+   struct util_dynarray submits;
+
+   /* capture handle -> replay_bo */
+   struct hash_table *bos;
+   uint64_t bo_memory;
+   int num_bos;
+
+   /* capture ctx id -> replay ctx id + 1 */
+   struct hash_table *ctxs;
+
+   int num_dropped_deps;
+};
+
+static void *
+read_capture(const char *file, size_t *size)
+{
+   int fd = open(file, O_RDONLY);
+   if (fd == -1)
+      errx(1, "couldn't open `%s'", file);
+
+   struct stat st;
+   if (fstat(fd, &st))
+      errx(1, "couldn't stat `%s'", file);
+
+   void *data = malloc(st.st_size);
+   if (!data || read(fd, data, st.st_size) != st.st_size)
+      errx(1, "couldn't read `%s'", file);
+   close(fd);
+
+   *size = st.st_size;
+   return data;
+}
+
+static struct replay_submit *
+replay_submit(struct replay *r, int index)
+{
+   return util_dynarray_element(&r->submits, struct replay_submit, index);
+}
+
+static void
+parse_capture(struct replay *r)
+{
+   if (r->size < sizeof(*r->header))
+      errx(1, "capture too small");
+
+   r->header = r->data;
+   if (r->header->magic != LIMA_CAPTURE_MAGIC ||
+       r->header->version != LIMA_CAPTURE_VERSION)
+      errx(1, "not a lima capture or an unsupported version");
+
+   /* submits without their fence yet, fences come in submit order for
+    * each ctx and pipe */
+   struct util_dynarray pending;
+   util_dynarray_init(&pending, NULL);
+
+   size_t offset = sizeof(*r->header);
+   while (offset + sizeof(struct lima_capture_record) <= r->size) {
+      struct lima_capture_record *record = r->data + offset;
+      void *payload = record + 1;
+
+      offset += sizeof(*record) + record->size;
+      if (offset > r->size) {
+         warnx("the capture is truncated");
+         break;
+      }
+
+      switch (record->type) {
+      case LIMA_CAPTURE_RECORD_BO: {
+         struct replay_event *e = util_dynarray_grow(&r->events, sizeof(*e));
+         e->type = REPLAY_EVENT_BO;
+         e->bo = payload;
+         break;
+      }
+      case LIMA_CAPTURE_RECORD_SUBMIT: {
+         int index = r->submits.size / sizeof(struct replay_submit);
+         struct replay_submit *s = util_dynarray_grow(&r->submits, sizeof(*s));
+         memset(s, 0, sizeof(*s));
+         s->submit = payload;
+
+         struct replay_event *e = util_dynarray_grow(&r->events, sizeof(*e));
+         e->type = REPLAY_EVENT_SUBMIT;
+         e->submit = index;
+
+         util_dynarray_append(&pending, int, index);
+         break;
+      }
+      case LIMA_CAPTURE_RECORD_FENCE: {
+         struct lima_capture_fence *f = payload;
+         int *p = util_dynarray_begin(&pending);
+         int num = pending.size / sizeof(int);
+
+         for (int i = 0; i < num; i++) {
+            struct replay_submit *s = replay_submit(r, p[i]);
+            if (s->submit->ctx != f->ctx || s->submit->pipe != f->pipe)
+               continue;
+
+            s->has_capture_fence = f->submitted;
+            s->capture_fence = f->fence;
+            memmove(p + i, p + i + 1, (num - i - 1) * sizeof(int));
+            pending.size -= sizeof(int);
+            break;
+         }
+         break;
+      }
+      default:
+         warnx("skip unknown record type %u", record->type);
+         break;
+      }
+   }
+
+   util_dynarray_fini(&pending);
+
+   /* a fence dep waits for the last earlier submit with that fence */
+   int num_submits = r->submits.size / sizeof(struct replay_submit);
+   for (int i = 0; i < num_submits; i++) {
+      struct replay_submit *s = replay_submit(r, i);
+      union drm_lima_gem_submit_dep *deps = (void *)((char *)(s->submit + 1) +
+         s->submit->nr_bos * sizeof(struct lima_capture_submit_bo));
+
+      s->dep_submits = malloc(s->submit->nr_deps * sizeof(int));
+      if (s->submit->nr_deps && !s->dep_submits)
+         errx(1, "out of memory");
+
+      for (int j = 0; j < s->submit->nr_deps; j++) {
+         s->dep_submits[j] = -1;
+
+         /* the fd of a sync fd dep is long gone */
+         if (deps[j].type != LIMA_SUBMIT_DEP_FENCE) {
+            r->num_dropped_deps++;
+            continue;
+         }
+
+         for (int k = i - 1; k >= 0; k--) {
+            struct replay_submit *t = replay_submit(r, k);
+            if (t->has_capture_fence && t->submit->ctx == deps[j].fence.ctx &&
+                t->submit->pipe == deps[j].fence.pipe &&
+                t->capture_fence == deps[j].fence.seq) {
+               s->dep_submits[j] = k;
+               break;
+            }
+         }
+
+         if (s->dep_submits[j] < 0)
+            r->num_dropped_deps++;
+      }
+   }
+}
+
+static void
+replay_bo_free(struct replay *r, struct replay_bo *bo)
+{
+   struct drm_lima_gem_va va = {
+      .handle = bo->handle,
+      .op = LIMA_VA_OP_UNMAP,
+      .va = bo->va,
+   };
+   drmIoctl(r->fd, DRM_IOCTL_LIMA_GEM_VA, &va);
+
+   if (bo->map)
+      munmap(bo->map, bo->size);
+
+   struct drm_gem_close close = { .handle = bo->handle };
+   drmIoctl(r->fd, DRM_IOCTL_GEM_CLOSE, &close);
+
+   free(bo);
+}
+
+/* the bo of the capture handle at that va, a handle the capture reused
+ * for another bo or a bo overlapping the va range replaces the old one */
+static struct replay_bo *
+replay_get_bo(struct replay *r, uint32_t capture_handle, uint32_t va,
+              uint32_t size)
+{
+   struct hash_entry *entry =
+      _mesa_hash_table_search(r->bos, (void *)(uintptr_t)capture_handle);
+   if (entry) {
+      struct replay_bo *bo = entry->data;
+      if (bo->va == va && bo->size == size)
+         return bo;
+   }
+
+   struct hash_entry *e;
+   hash_table_foreach(r->bos, e) {
+      struct replay_bo *bo = e->data;
+      if (bo->va < va + size && va < bo->va + bo->size) {
+         r->bo_memory -= bo->size;
+         r->num_bos--;
+         replay_bo_free(r, bo);
+         _mesa_hash_table_remove(r->bos, e);
+      }
+   }
+
+   struct replay_bo *bo = calloc(1, sizeof(*bo));
+   if (!bo)
+      errx(1, "out of memory");
+
+   struct drm_lima_gem_create create = { .size = size };
+   if (drmIoctl(r->fd, DRM_IOCTL_LIMA_GEM_CREATE, &create))
+      errx(1, "couldn't create a bo of size %u", size);
+   bo->handle = create.handle;
+   bo->va = va;
+   bo->size = size;
+
+   struct drm_lima_gem_va gem_va = {
+      .handle = bo->handle,
+      .op = LIMA_VA_OP_MAP,
+      .va = va,
+   };
+   if (drmIoctl(r->fd, DRM_IOCTL_LIMA_GEM_VA, &gem_va))
+      errx(1, "couldn't map a bo at va %x", va);
+
+   _mesa_hash_table_insert(r->bos, (void *)(uintptr_t)capture_handle, bo);
+   r->bo_memory += size;
+   r->num_bos++;
+   return bo;
+}
+
+static void
+replay_upload_bo(struct replay *r, struct lima_capture_bo *cbo)
+{
+   struct replay_bo *bo = replay_get_bo(r, cbo->handle, cbo->va, cbo->size);
+
+   if (!bo->map) {
+      struct drm_lima_gem_info info = { .handle = bo->handle };
+      if (drmIoctl(r->fd, DRM_IOCTL_LIMA_GEM_INFO, &info))
+         errx(1, "couldn't get the info of a bo");
+
+      bo->map = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     r->fd, info.offset);
+      if (bo->map == MAP_FAILED)
+         errx(1, "couldn't map a bo");
+   }
+
+   memcpy(bo->map, cbo + 1, cbo->size);
+}
+
+static uint32_t
+replay_get_ctx(struct replay *r, uint32_t capture_ctx)
+{
+   /* ctx ids start at 0, the key is offset by one */
+   void *key = (void *)(uintptr_t)(capture_ctx + 1);
+   struct hash_entry *entry = _mesa_hash_table_search(r->ctxs, key);
+   if (entry)
+      return (uintptr_t)entry->data - 1;
+
+   struct drm_lima_ctx req = { .op = LIMA_CTX_OP_CREATE };
+   if (drmIoctl(r->fd, DRM_IOCTL_LIMA_CTX, &req))
+      errx(1, "couldn't create a context");
+
+   _mesa_hash_table_insert(r->ctxs, key, (void *)(uintptr_t)(req.id + 1));
+   return req.id;
+}
+
+static void
+replay_wait(struct replay *r, struct replay_submit *s)
+{
+   if (!s->submitted)
+      return;
+
+   struct drm_lima_wait_fence req = {
+      .ctx = replay_get_ctx(r, s->submit->ctx),
+      .pipe = s->submit->pipe,
+      .seq = s->fence,
+      .timeout_ns = OS_TIMEOUT_INFINITE,
+   };
+   if (drmIoctl(r->fd, DRM_IOCTL_LIMA_WAIT_FENCE, &req))
+      warnx("wait fence error");
+}
+
+static void
+replay_submit_job(struct replay *r, int index)
+{
+   struct replay_submit *s = replay_submit(r, index);
+   struct lima_capture_submit *cs = s->submit;
+   struct lima_capture_submit_bo *cbos = (void *)(cs + 1);
+   union drm_lima_gem_submit_dep *cdeps = (void *)(cbos + cs->nr_bos);
+   void *frame = cdeps + cs->nr_deps;
+
+   struct drm_lima_gem_submit_bo bos[cs->nr_bos];
+   for (int i = 0; i < cs->nr_bos; i++) {
+      struct replay_bo *bo =
+         replay_get_bo(r, cbos[i].handle, cbos[i].va, cbos[i].size);
+      bos[i].handle = bo->handle;
+      bos[i].flags = cbos[i].flags;
+   }
+
+   union drm_lima_gem_submit_dep deps[cs->nr_deps + 1];
+   int nr_deps = 0;
+   for (int i = 0; i < cs->nr_deps; i++) {
+      if (s->dep_submits[i] < 0)
+         continue;
+
+      struct replay_submit *t = replay_submit(r, s->dep_submits[i]);
+      if (!t->submitted)
+         continue;
+
+      deps[nr_deps].fence.type = LIMA_SUBMIT_DEP_FENCE;
+      deps[nr_deps].fence.ctx = replay_get_ctx(r, t->submit->ctx);
+      deps[nr_deps].fence.pipe = t->submit->pipe;
+      deps[nr_deps].fence.seq = t->fence;
+      nr_deps++;
+   }
+
+   union drm_lima_gem_submit req = {
+      .in = {
+         .ctx = replay_get_ctx(r, cs->ctx),
+         .pipe = cs->pipe,
+         .nr_bos = cs->nr_bos,
+         .bos = VOID2U64(bos),
+         .frame = VOID2U64(frame),
+         .frame_size = cs->frame_size,
+         .deps = nr_deps ? VOID2U64(deps) : 0,
+         .nr_deps = nr_deps,
+         /* nobody waits for the sync fd */
+         .flags = cs->flags & ~LIMA_SUBMIT_FLAG_SYNC_FD_OUT,
+      },
+   };
+
+   s->submitted = drmIoctl(r->fd, DRM_IOCTL_LIMA_GEM_SUBMIT, &req) == 0;
+   if (s->submitted)
+      s->fence = req.out.fence;
+   else
+      warnx("%s submit error", cs->pipe == LIMA_PIPE_GP ? "gp" : "pp");
+}
+
+static int
+compare_time(const void *a, const void *b)
+{
+   int64_t ta = *(const int64_t *)a, tb = *(const int64_t *)b;
+   return ta < tb ? -1 : ta > tb;
+}
+
+static void
+print_distribution(const char *name, int64_t *times, int num)
+{
+   if (!num)
+      return;
+
+   int64_t sum = 0;
+   for (int i = 0; i < num; i++)
+      sum += times[i];
+
+   qsort(times, num, sizeof(*times), compare_time);
+   printf("%s: avg %.3f, min %.3f, median %.3f, p90 %.3f, p99 %.3f, "
+          "max %.3f ms\n", name, sum / 1e6 / num, times[0] / 1e6,
+          times[num / 2] / 1e6, times[num * 9 / 10] / 1e6,
+          times[num * 99 / 100] / 1e6, times[num - 1] / 1e6);
+}
+
+static void
+print_usage(void)
+{
+   printf("Usage: lima_replay [OPTIONS]... <capture>\n");
+   printf("    --device PATH    - lima DRM device (default /dev/dri/renderD128)\n");
+   printf("    --loops N        - replay the capture N times (default 1)\n");
+   printf("    --serial         - wait for each job, gives the GP and PP time\n");
+   printf("    --help           - show this message\n");
+}
+
+int
+main(int argc, char **argv)
+{
+   const char *device = "/dev/dri/renderD128";
+   int n = 1, loops = 1;
+   bool serial = false;
+
+   while (n < argc) {
+      if (!strcmp(argv[n], "--device") && n + 1 < argc) {
+         device = argv[n + 1];
+         n += 2;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--loops") && n + 1 < argc) {
+         loops = MAX2(atoi(argv[n + 1]), 1);
+         n += 2;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--serial")) {
+         serial = true;
+         n++;
+         continue;
+      }
+
+      if (!strcmp(argv[n], "--help")) {
+         print_usage();
+         return 0;
+      }
+
+      break;
+   }
+
+   if (n + 1 != argc) {
+      print_usage();
+      return 1;
+   }
+
+   struct replay r = {0};
+   r.data = read_capture(argv[n], &r.size);
+   util_dynarray_init(&r.events, NULL);
+   util_dynarray_init(&r.submits, NULL);
+   parse_capture(&r);
+
+   r.fd = open(device, O_RDWR | O_CLOEXEC);
+   if (r.fd < 0)
+      errx(1, "couldn't open `%s'", device);
+
+   r.bos = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                   _mesa_key_pointer_equal);
+   r.ctxs = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                    _mesa_key_pointer_equal);
+   if (!r.bos || !r.ctxs)
+      errx(1, "out of memory");
+
+   int num_events = r.events.size / sizeof(struct replay_event);
+   int num_submits = r.submits.size / sizeof(struct replay_submit);
+   int num_frames = 0;
+   for (int i = 0; i < num_submits; i++)
+      num_frames += replay_submit(&r, i)->submit->pipe == LIMA_PIPE_PP;
+
+   int64_t *frame_times = calloc(num_frames * loops + 1, sizeof(int64_t));
+   int64_t *gp_times = calloc(num_frames * loops + 1, sizeof(int64_t));
+   int64_t *pp_times = calloc(num_frames * loops + 1, sizeof(int64_t));
+   if (!frame_times || !gp_times || !pp_times)
+      errx(1, "out of memory");
+
+   int frame = 0;
+   int64_t start = os_time_get_nano();
+   int64_t frame_end = start;
+
+   for (int loop = 0; loop < loops; loop++) {
+      struct replay_submit *last_pp = NULL;
+
+      for (int i = 0; i < num_events; i++) {
+         struct replay_event *e =
+            util_dynarray_element(&r.events, struct replay_event, i);
+
+         if (e->type == REPLAY_EVENT_BO) {
+            replay_upload_bo(&r, e->bo);
+            continue;
+         }
+
+         struct replay_submit *s = replay_submit(&r, e->submit);
+         bool pp = s->submit->pipe == LIMA_PIPE_PP;
+         int64_t submit_time = os_time_get_nano();
+
+         replay_submit_job(&r, e->submit);
+
+         if (serial) {
+            replay_wait(&r, s);
+            int64_t t = os_time_get_nano() - submit_time;
+            if (pp)
+               pp_times[frame] += t;
+            else
+               gp_times[frame] += t;
+         }
+
+         if (!pp)
+            continue;
+
+         /* the GPU works on this frame while the previous one ends */
+         if (!serial && last_pp)
+            replay_wait(&r, last_pp);
+         last_pp = s;
+
+         int64_t now = os_time_get_nano();
+         if (serial)
+            frame_times[frame] = gp_times[frame] + pp_times[frame];
+         else if (frame || loop)
+            frame_times[frame] = now - frame_end;
+         frame_end = now;
+         frame++;
+      }
+
+      if (last_pp)
+         replay_wait(&r, last_pp);
+   }
+
+   int64_t total = os_time_get_nano() - start;
+
+   printf("%d frames, %d jobs per loop, %d loops, %.3f ms total\n",
+          num_frames, num_submits, loops, total / 1e6);
+   if (serial) {
+      print_distribution("gp time", gp_times, frame);
+      print_distribution("pp time", pp_times, frame);
+      print_distribution("frame time", frame_times, frame);
+   }
+   else if (frame > 1) {
+      /* the first frame has no previous end */
+      print_distribution("frame time", frame_times + 1, frame - 1);
+   }
+   printf("bo memory: %"PRIu64" KB in %d bos\n", r.bo_memory >> 10, r.num_bos);
+   if (r.num_dropped_deps)
+      printf("%d deps dropped, sync fds and fences of missing jobs\n",
+             r.num_dropped_deps);
+
+   struct hash_entry *e;
+   hash_table_foreach(r.bos, e)
+      replay_bo_free(&r, e->data);
+   _mesa_hash_table_destroy(r.bos, NULL);
+   _mesa_hash_table_destroy(r.ctxs, NULL);
+
+   for (int i = 0; i < num_submits; i++)
+      free(replay_submit(&r, i)->dep_submits);
+   util_dynarray_fini(&r.events);
+   util_dynarray_fini(&r.submits);
+   free(frame_times);
+   free(gp_times);
+   free(pp_times);
+   free(r.data);
+   close(r.fd);
+   return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Test of when the pp uniform buffer has to be built again, switching the
+ * bound fs between ones with and without a preshader while the constants
+ * stay the same.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lima_context.h"
+
+static int failures;
+
+#define CHECK(cond) \
+   do { \
+      if (!(cond)) { \
+         fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+         failures++; \
+      } \
+   } while (0)
+
+static const float consts[8] = { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0 };
+static const float other_consts[8] = { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 9.0 };
+
+/* what lima_update_pp_uniform keeps of a buffer it uploaded */
+static void
+upload(struct lima_context *ctx)
+{
+   ctx->buffer_state[lima_ctx_buff_pp_uniform].bo = (struct lima_bo *)1;
+   ctx->buffer_state[lima_ctx_buff_pp_uniform_array].bo = (struct lima_bo *)1;
+   memcpy(ctx->pp_uniform, consts, sizeof(consts));
+   ctx->pp_uniform_size = sizeof(consts);
+   ctx->pp_uniform_preshader = lima_fs_preshader(ctx->fs);
+}
+
+/* the check of the draw, without the dirty constants */
+static bool
+needs_update(struct lima_context *ctx)
+{
+   return ctx->pp_uniform_preshader != lima_fs_preshader(ctx->fs);
+}
+
+int
+main(void)
+{
+   struct lima_context *ctx = calloc(1, sizeof(*ctx));
+   struct lima_fs_shader_state preshader_fs = { 0 }, plain_fs = { 0 };
+   struct lima_fs_shader_state other_fs = { 0 };
+   uint8_t outputs[1] = { 0 };
+
+   preshader_fs.preshader.base = 1;
+   preshader_fs.preshader.num_outputs = 1;
+   preshader_fs.preshader.outputs = outputs;
+   other_fs.preshader = preshader_fs.preshader;
+
+   CHECK(lima_fs_preshader(&plain_fs) == NULL);
+   CHECK(lima_fs_preshader(&preshader_fs) == &preshader_fs.preshader);
+
+   /* nothing uploaded yet */
+   ctx->fs = &plain_fs;
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+   upload(ctx);
+   CHECK(!needs_update(ctx));
+   CHECK(lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+
+   /* the preshader results are not in the buffer of the plain fs */
+   ctx->fs = &preshader_fs;
+   CHECK(needs_update(ctx));
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+   upload(ctx);
+   CHECK(!needs_update(ctx));
+   CHECK(lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+
+   /* the results of slot 1 are over the constants the plain fs reads */
+   ctx->fs = &plain_fs;
+   CHECK(needs_update(ctx));
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+   upload(ctx);
+   CHECK(lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+
+   /* nor are the results of one preshader the ones of another */
+   ctx->fs = &preshader_fs;
+   upload(ctx);
+   ctx->fs = &other_fs;
+   CHECK(needs_update(ctx));
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+
+   /* other constants for the same fs */
+   ctx->fs = &preshader_fs;
+   upload(ctx);
+   CHECK(!lima_pp_uniform_is_current(ctx, other_consts, sizeof(consts)));
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts) / 2));
+
+   /* what lima_delete_fs_state leaves of the buffer of a deleted fs */
+   ctx->pp_uniform_preshader = NULL;
+   ctx->pp_uniform_size = 0;
+   ctx->fs = &plain_fs;
+   CHECK(!lima_pp_uniform_is_current(ctx, consts, sizeof(consts)));
+
+   free(ctx);
+
+   if (failures) {
+      fprintf(stderr, "%d checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
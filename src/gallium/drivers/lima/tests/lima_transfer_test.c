@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Test of which texture maps may go to a staging texture copied whole to
+ * the texture on unmap: a write of part of the box has to keep the rest of
+ * the old content, so it maps the texture itself.
+ */
+
+#include <stdio.h>
+
+#include "lima_context.h"
+#include "lima_resource.h"
+
+static int failures;
+
+#define CHECK(cond) \
+   do { \
+      if (!(cond)) { \
+         fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+         failures++; \
+      } \
+   } while (0)
+
+int
+main(void)
+{
+   /* writes which may leave part of the box as it was */
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_FLUSH_EXPLICIT));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_DONTBLOCK));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_READ_WRITE));
+
+   /* the old content of the box is discarded */
+   CHECK(lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                       PIPE_TRANSFER_DISCARD_RANGE));
+   CHECK(lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                       PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE));
+   CHECK(lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                       PIPE_TRANSFER_DISCARD_RANGE |
+                                       PIPE_TRANSFER_FLUSH_EXPLICIT));
+
+   /* nothing to read back from a staging texture, or no wait to avoid */
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_READ |
+                                        PIPE_TRANSFER_DISCARD_RANGE));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_READ_WRITE |
+                                        PIPE_TRANSFER_DISCARD_RANGE));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_DISCARD_RANGE |
+                                        PIPE_TRANSFER_UNSYNCHRONIZED));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_DISCARD_RANGE |
+                                        TC_TRANSFER_MAP_THREADED_UNSYNC));
+
+   /* the mapping has to be of the texture itself */
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_DISCARD_RANGE |
+                                        PIPE_TRANSFER_MAP_DIRECTLY));
+   CHECK(!lima_transfer_usage_can_stage(PIPE_TRANSFER_WRITE |
+                                        PIPE_TRANSFER_DISCARD_RANGE |
+                                        PIPE_TRANSFER_PERSISTENT));
+
+   if (failures) {
+      fprintf(stderr, "%d checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "lp_limits.h"
 
 /**
  * Various counters
@@ -62,6 +63,11 @@ struct lp_counters
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   /** Per rasterizer thread */
+   unsigned nr_rast_bins[LP_MAX_THREADS];
+   unsigned nr_stolen_bins[LP_MAX_THREADS];
+   int64_t rast_busy_time[LP_MAX_THREADS];  /**< in microseconds */
 };
 
 
@@ -70,7 +70,7 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, MAX2(1, rast->num_threads) );
 }
 
 
@@ -684,12 +684,17 @@ rasterize_scene(struct lp_rasterizer_task *task,
       {
          struct cmd_bin *bin;
          int i, j;
+         int64_t t0 = os_time_get();
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
+            LP_COUNT(nr_rast_bins[task->thread_index]);
          }
+
+         LP_COUNT_ADD(rast_busy_time[task->thread_index], os_time_get() - t0);
       }
    }
 
@@ -25,6 +25,12 @@
  *
  **************************************************************************/
 
+#include "pipe/p_config.h"
+
+#if defined(PIPE_OS_LINUX)
+#include <sys/mman.h>
+#endif
+
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -34,6 +40,7 @@
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -46,23 +53,227 @@ struct resource_ref {
 };
 
 
+/**
+ * The data blocks of the scenes are allocated from slabs of 2 MiB, which
+ * can be backed by a huge page, and recycled from one scene to the next
+ * by a pool shared by the scenes of a setup context.
+ */
+#define LP_SCENE_SLAB_SIZE (2 * 1024 * 1024)
+#define LP_SCENE_SLAB_BLOCKS 31
+
+/** Number of released scenes over which the peak usage is measured */
+#define LP_SCENE_POOL_WINDOW 32
+
+struct lp_scene_slab {
+   struct lp_scene_slab *next;
+   unsigned num_free;
+   boolean release;
+   struct data_block blocks[LP_SCENE_SLAB_BLOCKS];
+};
+
+
+struct lp_scene_pool {
+   /* Blocks are taken by the setup thread and given back by the
+    * rasterizer thread which ends the scene.
+    */
+   mtx_t mutex;
+
+   struct lp_scene_slab *slabs;
+   unsigned num_slabs;
+
+   struct data_block *free_blocks;
+   unsigned num_used;
+
+   /* Peak number of blocks in use, over the current window and the
+    * previous one.  The pool keeps the slabs needed for that many blocks.
+    */
+   unsigned peak, last_peak;
+   unsigned released;
+};
+
+
+struct lp_scene_pool *
+lp_scene_pool_create(void)
+{
+   struct lp_scene_pool *pool = CALLOC_STRUCT(lp_scene_pool);
+   if (!pool)
+      return NULL;
+
+   (void) mtx_init(&pool->mutex, mtx_plain);
+
+   return pool;
+}
+
+
+void
+lp_scene_pool_destroy(struct lp_scene_pool *pool)
+{
+   struct lp_scene_slab *slab, *next;
+
+   assert(pool->num_used == 0);
+
+   for (slab = pool->slabs; slab; slab = next) {
+      next = slab->next;
+      align_free(slab);
+   }
+
+   mtx_destroy(&pool->mutex);
+   FREE(pool);
+}
+
+
+static boolean
+lp_scene_pool_add_slab(struct lp_scene_pool *pool)
+{
+   struct lp_scene_slab *slab;
+   unsigned i;
+
+   STATIC_ASSERT(sizeof(struct lp_scene_slab) <= LP_SCENE_SLAB_SIZE);
+
+   slab = align_malloc(LP_SCENE_SLAB_SIZE, LP_SCENE_SLAB_SIZE);
+   if (!slab)
+      return FALSE;
+
+#if defined(MADV_HUGEPAGE)
+   madvise(slab, LP_SCENE_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+
+   slab->num_free = LP_SCENE_SLAB_BLOCKS;
+   slab->release = FALSE;
+   for (i = 0; i < LP_SCENE_SLAB_BLOCKS; i++) {
+      slab->blocks[i].slab = slab;
+      slab->blocks[i].next = pool->free_blocks;
+      pool->free_blocks = &slab->blocks[i];
+   }
+
+   slab->next = pool->slabs;
+   pool->slabs = slab;
+   pool->num_slabs++;
+
+   return TRUE;
+}
+
+
+static struct data_block *
+lp_scene_pool_get(struct lp_scene_pool *pool)
+{
+   struct data_block *block = NULL;
+
+   mtx_lock(&pool->mutex);
+
+   if (pool->free_blocks || lp_scene_pool_add_slab(pool)) {
+      block = pool->free_blocks;
+      pool->free_blocks = block->next;
+      block->slab->num_free--;
+
+      pool->num_used++;
+      pool->peak = MAX2(pool->peak, pool->num_used);
+   }
+
+   mtx_unlock(&pool->mutex);
+
+   return block;
+}
+
+
+/**
+ * Free the unused slabs beyond those needed for the recent peak usage.
+ * Called with the pool mutex held.
+ */
+static void
+lp_scene_pool_trim(struct lp_scene_pool *pool)
+{
+   unsigned needed = DIV_ROUND_UP(MAX2(pool->peak, pool->last_peak),
+                                  LP_SCENE_SLAB_BLOCKS);
+   unsigned excess = pool->num_slabs > needed ? pool->num_slabs - needed : 0;
+   struct lp_scene_slab **pslab, *slab;
+   struct data_block **pblock;
+
+   if (!excess)
+      return;
+
+   for (slab = pool->slabs; slab && excess; slab = slab->next) {
+      if (slab->num_free == LP_SCENE_SLAB_BLOCKS) {
+         slab->release = TRUE;
+         excess--;
+      }
+   }
+
+   pblock = &pool->free_blocks;
+   while (*pblock) {
+      if ((*pblock)->slab->release)
+         *pblock = (*pblock)->next;
+      else
+         pblock = &(*pblock)->next;
+   }
+
+   pslab = &pool->slabs;
+   while ((slab = *pslab)) {
+      if (slab->release) {
+         *pslab = slab->next;
+         pool->num_slabs--;
+         align_free(slab);
+      }
+      else
+         pslab = &slab->next;
+   }
+}
+
+
+/**
+ * Give back the blocks of a scene.
+ */
+static void
+lp_scene_pool_put(struct lp_scene_pool *pool, struct data_block *blocks)
+{
+   struct data_block *block, *next;
+
+   mtx_lock(&pool->mutex);
+
+   for (block = blocks; block; block = next) {
+      next = block->next;
+      block->slab->num_free++;
+      block->next = pool->free_blocks;
+      pool->free_blocks = block;
+      pool->num_used--;
+   }
+
+   if (++pool->released == LP_SCENE_POOL_WINDOW) {
+      lp_scene_pool_trim(pool);
+      pool->last_peak = pool->peak;
+      pool->peak = pool->num_used;
+      pool->released = 0;
+   }
+
+   mtx_unlock(&pool->mutex);
+}
+
+
 /**
  * Create a new scene object.
- * \param queue  the queue to put newly rendered/emptied scenes into
+ * \param pool  the pool to allocate the scene data blocks from
  */
 struct lp_scene *
-lp_scene_create( struct pipe_context *pipe )
+lp_scene_create( struct pipe_context *pipe, struct lp_scene_pool *pool )
 {
    struct lp_scene *scene = CALLOC_STRUCT(lp_scene);
+   unsigned i;
+
    if (!scene)
       return NULL;
 
    scene->pipe = pipe;
+   scene->pool = pool;
 
    scene->data.head =
       CALLOC_STRUCT(data_block);
+   if (!scene->data.head) {
+      FREE(scene);
+      return NULL;
+   }
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
+   for (i = 0; i < LP_MAX_THREADS; i++)
+      (void) mtx_init(&scene->queues[i].mutex, mtx_plain);
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -89,8 +300,11 @@ lp_scene_create( struct pipe_context *pipe )
 void
 lp_scene_destroy(struct lp_scene *scene)
 {
+   unsigned i;
+
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
+   for (i = 0; i < LP_MAX_THREADS; i++)
+      mtx_destroy(&scene->queues[i].mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
@@ -274,19 +488,31 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                       j, scene->resource_reference_size);
    }
 
-   /* Free all scene data blocks:
+   /* Give the scene data blocks back to the pool, except the scene's own
+    * first block, which the new blocks have been put in front of:
     */
    {
       struct data_block_list *list = &scene->data;
-      struct data_block *block, *tmp;
+      struct data_block *block, *tmp, *first = NULL, *blocks = NULL;
 
-      for (block = list->head->next; block; block = tmp) {
+      for (block = list->head; block; block = tmp) {
          tmp = block->next;
-	 FREE(block);
+         if (block->slab) {
+            block->next = blocks;
+            blocks = block;
+         }
+         else {
+            first = block;
+         }
       }
 
-      list->head->next = NULL;
-      list->head->used = 0;
+      if (blocks)
+         lp_scene_pool_put(scene->pool, blocks);
+
+      assert(first);
+      first->next = NULL;
+      first->used = 0;
+      list->head = first;
    }
 
    lp_fence_reference(&scene->fence, NULL);
@@ -336,7 +562,7 @@ lp_scene_new_data_block( struct lp_scene *scene )
       return NULL;
    }
    else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
+      struct data_block *block = lp_scene_pool_get(scene->pool);
       if (!block)
          return NULL;
       
@@ -449,61 +675,166 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/** Estimated cost of rasterizing a bin: its number of commands */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
+{
+   const struct cmd_block *block;
+   unsigned cost = 0;
+
+   for (block = bin->head; block; block = block->next)
+      cost += block->count;
+
+   return cost;
+}
+
+
+/** Most expensive bins first */
+static int
+compare_bin_cost(const void *pa, const void *pb)
+{
+   const struct lp_bin_cost *a = pa, *b = pb;
+
+   if (a->cost != b->cost)
+      return a->cost > b->cost ? -1 : 1;
+   if (a->y != b->y)
+      return a->y < b->y ? -1 : 1;
+   return a->x < b->x ? -1 : (a->x > b->x);
+}
+
+
+/** Grouped by queue, most expensive bins first within a queue */
+static int
+compare_bin_queue(const void *pa, const void *pb)
+{
+   const struct lp_bin_cost *a = pa, *b = pb;
+
+   if (a->queue != b->queue)
+      return a->queue < b->queue ? -1 : 1;
+   return compare_bin_cost(pa, pb);
+}
+
+
+/**
+ * Distribute the non-empty bins over num_queues rasterizer threads.
+ * Bins are assigned from the most expensive one, each to the queue with
+ * the lowest estimated cost so far, so the queues end up with about the
+ * same amount of work; what the estimate gets wrong is corrected by the
+ * threads stealing bins from each other, see lp_scene_bin_iter_next().
+ * Called by one thread, before the others start rasterizing.
+ */
+void
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_queues )
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   unsigned num_bins = 0;
+   unsigned x, y, i, q;
+
+   assert(num_queues >= 1 && num_queues <= LP_MAX_THREADS);
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         struct lp_bin_cost *c;
+
+         if (!bin->head)
+            continue;
+
+         c = &scene->queued_bins[num_bins++];
+         c->cost = bin_cost(bin);
+         c->x = x;
+         c->y = y;
+      }
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+
+   for (q = 0; q < num_queues; q++) {
+      scene->queues[q].head = 0;
+      scene->queues[q].tail = 0;
+      scene->queues[q].cost = 0;
+   }
+   scene->num_queues = num_queues;
+
+   if (num_queues == 1) {
+      /* keep the memory order, there's no one to balance with */
+      scene->queues[0].tail = num_bins;
+      return;
+   }
+
+   qsort(scene->queued_bins, num_bins, sizeof scene->queued_bins[0],
+         compare_bin_cost);
+
+   for (i = 0; i < num_bins; i++) {
+      struct lp_bin_cost *c = &scene->queued_bins[i];
+      unsigned min = 0;
+
+      for (q = 1; q < num_queues; q++) {
+         if (scene->queues[q].cost < scene->queues[min].cost)
+            min = q;
+      }
+
+      c->queue = min;
+      scene->queues[min].cost += c->cost;
+      scene->queues[min].tail++;
+   }
+
+   qsort(scene->queued_bins, num_bins, sizeof scene->queued_bins[0],
+         compare_bin_queue);
+
+   /* turn the bin counts into ranges of queued_bins */
+   for (q = 0, i = 0; q < num_queues; q++) {
+      scene->queues[q].head = i;
+      i += scene->queues[q].tail;
+      scene->queues[q].tail = i;
    }
-   return TRUE;
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+/** Take the bin at the head of a queue, or steal the one at its tail */
+static boolean
+take_bin(struct lp_scene *scene, unsigned queue, boolean steal,
+         int *x, int *y)
 {
-   scene->curr_x = scene->curr_y = -1;
+   struct lp_bin_queue *q = &scene->queues[queue];
+   const struct lp_bin_cost *c = NULL;
+
+   mtx_lock(&q->mutex);
+   if (q->head < q->tail)
+      c = &scene->queued_bins[steal ? --q->tail : q->head++];
+   mtx_unlock(&q->mutex);
+
+   if (!c)
+      return FALSE;
+
+   *x = c->x;
+   *y = c->y;
+   return TRUE;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Return pointer to next bin to be rendered by the given rasterizer
+ * thread: the next in its own queue, or when that is empty, one stolen
+ * from the end of another thread's queue.  NULL when all the bins are
+ * taken.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned queue,
+                        int *x, int *y )
 {
-   struct cmd_bin *bin = NULL;
+   unsigned i;
 
-   mtx_lock(&scene->mutex);
+   assert(queue < scene->num_queues);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+   if (take_bin(scene, queue, FALSE, x, y))
+      return lp_scene_get_bin(scene, *x, *y);
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   for (i = 1; i < scene->num_queues; i++) {
+      if (take_bin(scene, (queue + i) % scene->num_queues, TRUE, x, y)) {
+         LP_COUNT(nr_stolen_bins[queue]);
+         return lp_scene_get_bin(scene, *x, *y);
+      }
+   }
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return NULL;
 }
 
 
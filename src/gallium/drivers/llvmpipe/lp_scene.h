@@ -40,6 +40,8 @@
 #include "lp_debug.h"
 
 struct lp_scene_queue;
+struct lp_scene_pool;
+struct lp_scene_slab;
 struct lp_rast_state;
 
 /* We're limited to 2K by 2K for 32bit fixed point rasterization.
@@ -86,6 +88,7 @@ struct data_block {
    ubyte data[DATA_BLOCK_SIZE];
    unsigned used;
    struct data_block *next;
+   struct lp_scene_slab *slab;  /**< NULL for the scene's first block */
 };
 
 
@@ -98,6 +101,26 @@ struct cmd_bin {
    struct cmd_block *head;
    struct cmd_block *tail;
 };
+
+
+/**
+ * The bins assigned to a rasterizer thread, in the order they are to be
+ * rasterized: indices [head, tail) of lp_scene::queued_bins.  The thread
+ * takes its bins from the head, the others steal from the tail once
+ * their own queue is empty.
+ */
+struct lp_bin_queue {
+   mtx_t mutex;
+   unsigned head, tail;
+   uint64_t cost;  /**< estimated cost of the bins assigned */
+};
+
+
+struct lp_bin_cost {
+   unsigned cost;
+   uint8_t x, y;
+   uint8_t queue;
+};
    
 
 /**
@@ -127,6 +150,7 @@ struct resource_ref;
  */
 struct lp_scene {
    struct pipe_context *pipe;
+   struct lp_scene_pool *pool;
    struct lp_fence *fence;
 
    /* The queries still active at end of scene */
@@ -173,8 +197,10 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /** For distributing the bins over the rasterizer threads */
+   struct lp_bin_queue queues[LP_MAX_THREADS];
+   unsigned num_queues;
+   struct lp_bin_cost queued_bins[TILES_X * TILES_Y];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -182,7 +208,12 @@ struct lp_scene {
 
 
 
-struct lp_scene *lp_scene_create(struct pipe_context *pipe);
+struct lp_scene_pool *lp_scene_pool_create(void);
+
+void lp_scene_pool_destroy(struct lp_scene_pool *pool);
+
+struct lp_scene *lp_scene_create(struct pipe_context *pipe,
+                                 struct lp_scene_pool *pool);
 
 void lp_scene_destroy(struct lp_scene *scene);
 
@@ -379,10 +410,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_queues );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned queue,
+                        int *x, int *y );
 
 
 
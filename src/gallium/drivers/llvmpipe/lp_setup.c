@@ -1293,6 +1293,8 @@ lp_setup_destroy( struct lp_setup_context *setup )
       lp_scene_destroy(scene);
    }
 
+   lp_scene_pool_destroy(setup->scene_pool);
+
    lp_fence_reference(&setup->last_fence, NULL);
 
    FREE( setup );
@@ -1333,9 +1335,14 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
+   setup->scene_pool = lp_scene_pool_create();
+   if (!setup->scene_pool) {
+      goto no_scene_pool;
+   }
+
    /* create some empty scenes */
    for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
+      setup->scenes[i] = lp_scene_create( pipe, setup->scene_pool );
       if (!setup->scenes[i]) {
          goto no_scenes;
       }
@@ -1360,6 +1367,8 @@ no_scenes:
       }
    }
 
+   lp_scene_pool_destroy(setup->scene_pool);
+no_scene_pool:
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
    FREE(setup);
@@ -89,6 +89,7 @@ struct lp_setup_context
    unsigned num_threads;
    unsigned scene_idx;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   struct lp_scene_pool *scene_pool;     /**< data blocks of the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
    struct lp_fence *last_fence;
@@ -49,6 +49,9 @@
 #elif defined(_ARCH_PWR8) && defined(PIPE_ARCH_LITTLE_ENDIAN)
 #include <altivec.h>
 #include "util/u_pwr8.h"
+#elif defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+#include <arm_neon.h>
+#define LP_SETUP_NEON
 #endif
 
 #if !defined(PIPE_ARCH_SSE)
@@ -312,6 +315,31 @@ do_triangle_ccw(struct lp_setup_context *setup,
        */
       int adj = (setup->bottom_edge_rule != 0) ? 1 : 0;
 
+#if defined(LP_SETUP_NEON)
+      /* x and y side by side, the unused 4th vertex a copy of the 1st */
+      int32x4_t vertx = vsetq_lane_s32(position->x[0],
+                                       vld1q_s32(position->x), 3);
+      int32x4_t verty = vsetq_lane_s32(position->y[0],
+                                       vld1q_s32(position->y), 3);
+      int32x2_t min = vpmin_s32(vmin_s32(vget_low_s32(vertx),
+                                         vget_high_s32(vertx)),
+                                vmin_s32(vget_low_s32(verty),
+                                         vget_high_s32(verty)));
+      int32x2_t max = vpmax_s32(vmax_s32(vget_low_s32(vertx),
+                                         vget_high_s32(vertx)),
+                                vmax_s32(vget_low_s32(verty),
+                                         vget_high_s32(verty)));
+      int32x2_t adj0 = vset_lane_s32(adj, vdup_n_s32(0), 1);
+
+      min = vshr_n_s32(vadd_s32(min, adj0), FIXED_ORDER);
+      max = vshr_n_s32(vadd_s32(max, vsub_s32(adj0, vdup_n_s32(1))),
+                       FIXED_ORDER);
+
+      bbox.x0 = vget_lane_s32(min, 0);
+      bbox.x1 = vget_lane_s32(max, 0);
+      bbox.y0 = vget_lane_s32(min, 1);
+      bbox.y1 = vget_lane_s32(max, 1);
+#else
       /* Inclusive x0, exclusive x1 */
       bbox.x0 =  MIN3(position->x[0], position->x[1], position->x[2]) >> FIXED_ORDER;
       bbox.x1 = (MAX3(position->x[0], position->x[1], position->x[2]) - 1) >> FIXED_ORDER;
@@ -319,6 +347,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
       /* Inclusive / exclusive depending upon adj (bottom-left or top-right) */
       bbox.y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
+#endif
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -586,6 +615,72 @@ do_triangle_ccw(struct lp_setup_context *setup,
       STORE_PLANE(plane[2], p2);
 #undef STORE_PLANE
    } else
+#elif defined(LP_SETUP_NEON)
+   if (1) {
+      int32x4_t vertx, verty;
+      int32x4_t shufx, shufy;
+      int32x4_t dcdx, dcdy;
+      int32x4_t dcdx_neg_mask;
+      int32x4_t dcdy_neg_mask;
+      int32x4_t dcdx_zero_mask;
+      int32x4_t top_left_flag, c_dec;
+      int32x4_t eo;
+      int64x2_t c01, c23;
+      PIPE_ALIGN_VAR(16) int64_t c[4];
+      PIPE_ALIGN_VAR(16) int32_t temp_dcdx[4], temp_dcdy[4], temp_eo[4];
+      int i;
+
+      vertx = vld1q_s32(position->x); /* vertex x coords */
+      verty = vld1q_s32(position->y); /* vertex y coords */
+
+      /* the coords of the next vertices: 1, 2, 0 */
+      shufx = vsetq_lane_s32(position->x[0], vextq_s32(vertx, vertx, 1), 2);
+      shufy = vsetq_lane_s32(position->y[0], vextq_s32(verty, verty, 1), 2);
+
+      dcdx = vsubq_s32(verty, shufy);
+      dcdy = vsubq_s32(vertx, shufx);
+
+      dcdx_neg_mask = vshrq_n_s32(dcdx, 31);
+      dcdx_zero_mask = vreinterpretq_s32_u32(vceqq_s32(dcdx, vdupq_n_s32(0)));
+      dcdy_neg_mask = vshrq_n_s32(dcdy, 31);
+
+      top_left_flag = vdupq_n_s32((setup->bottom_edge_rule == 0) ? ~0 : 0);
+
+      c_dec = vorrq_s32(dcdx_neg_mask,
+                        vandq_s32(dcdx_zero_mask,
+                                  veorq_s32(dcdy_neg_mask, top_left_flag)));
+
+      /* 64 bit arithmetic, NEON has the signed widening mul */
+      c01 = vsubq_s64(vmull_s32(vget_low_s32(dcdx), vget_low_s32(vertx)),
+                      vmull_s32(vget_low_s32(dcdy), vget_low_s32(verty)));
+      c23 = vsubq_s64(vmull_s32(vget_high_s32(dcdx), vget_high_s32(vertx)),
+                      vmull_s32(vget_high_s32(dcdy), vget_high_s32(verty)));
+      c01 = vsubq_s64(c01, vmovl_s32(vget_low_s32(c_dec)));
+      c23 = vsubq_s64(c23, vmovl_s32(vget_high_s32(c_dec)));
+
+      /* Scale up to match c:
+       */
+      dcdx = vshlq_n_s32(dcdx, FIXED_ORDER);
+      dcdy = vshlq_n_s32(dcdy, FIXED_ORDER);
+
+      /* Calculate trivial reject values:
+       */
+      eo = vsubq_s32(vbicq_s32(dcdy, dcdy_neg_mask),
+                     vandq_s32(dcdx_neg_mask, dcdx));
+
+      vst1q_s64(&c[0], c01);
+      vst1q_s64(&c[2], c23);
+      vst1q_s32(temp_dcdx, dcdx);
+      vst1q_s32(temp_dcdy, dcdy);
+      vst1q_s32(temp_eo, eo);
+
+      for (i = 0; i < 3; i++) {
+         plane[i].c = c[i];
+         plane[i].dcdx = temp_dcdx[i];
+         plane[i].dcdy = temp_dcdy[i];
+         plane[i].eo = temp_eo[i];
+      }
+   } else
 #endif
    {
       int i;
@@ -747,6 +842,41 @@ floor_pot(uint32_t n)
 }
 
 
+#if defined(LP_SETUP_NEON)
+/**
+ * Test a tile against the planes, in pairs: returns non-zero if it is
+ * outside one of them, and the mask of the ones it isn't fully inside of in
+ * partial.  The planes from nr_planes to nr_vplanes are padding.
+ */
+static inline int
+classify_tile_neon(int nr_vplanes, const int64_t *cx, const int64_t *eo,
+                   const int64_t *ei, int *partial)
+{
+   int64x2_t out = vdupq_n_s64(0);
+   uint64x2_t bits = vdupq_n_u64(0);
+   int64x2_t shift = vcombine_s64(vcreate_s64(0), vcreate_s64(1));
+   int i;
+
+   for (i = 0; i < nr_vplanes; i += 2) {
+      int64x2_t vcx = vld1q_s64(&cx[i]);
+      int64x2_t planeout = vaddq_s64(vcx, vld1q_s64(&eo[i]));
+      int64x2_t planepartial = vsubq_s64(vaddq_s64(vcx, vld1q_s64(&ei[i])),
+                                         vdupq_n_s64(1));
+
+      out = vorrq_s64(out, planeout);
+      /* the sign bits moved to the bits of the planes */
+      bits = vorrq_u64(bits,
+                       vshlq_u64(vshrq_n_u64(vreinterpretq_u64_s64(planepartial),
+                                             63), shift));
+      shift = vaddq_s64(shift, vdupq_n_s64(2));
+   }
+
+   *partial = (int)(vgetq_lane_u64(bits, 0) | vgetq_lane_u64(bits, 1));
+   return (int)((vgetq_lane_s64(out, 0) | vgetq_lane_s64(out, 1)) >> 63);
+}
+#endif
+
+
 boolean
 lp_setup_bin_triangle(struct lp_setup_context *setup,
                       struct lp_rast_triangle *tri,
@@ -878,7 +1008,13 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       int iy0 = trimmed_box.y0 / TILE_SIZE;
       int ix1 = trimmed_box.x1 / TILE_SIZE;
       int iy1 = trimmed_box.y1 / TILE_SIZE;
-      
+#if defined(LP_SETUP_NEON)
+      /* padded to the pairs the planes are tested in */
+      const int nr_vplanes = align(nr_planes, 2);
+#else
+      const int nr_vplanes = nr_planes;
+#endif
+
       for (i = 0; i < nr_planes; i++) {
          c[i] = (plane[i].c + 
                  IMUL64(plane[i].dcdy, iy0) * TILE_SIZE -
@@ -893,6 +1029,10 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
          ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
       }
 
+      /* never outside, the partial bits are masked out below */
+      for (; i < nr_vplanes; i++)
+         c[i] = ei[i] = eo[i] = xstep[i] = ystep[i] = 0;
+
 
 
       /* Test tile-sized blocks against the triangle.
@@ -905,7 +1045,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
          boolean in = FALSE;  /* are we inside the triangle? */
          int64_t cx[MAX_PLANES];
 
-         for (i = 0; i < nr_planes; i++)
+         for (i = 0; i < nr_vplanes; i++)
             cx[i] = c[i];
 
          for (x = ix0; x <= ix1; x++)
@@ -913,12 +1053,17 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
             int out = 0;
             int partial = 0;
 
+#if defined(LP_SETUP_NEON)
+            out = classify_tile_neon(nr_vplanes, cx, eo, ei, &partial);
+            partial &= (1 << nr_planes) - 1;
+#else
             for (i = 0; i < nr_planes; i++) {
                int64_t planeout = cx[i] + eo[i];
                int64_t planepartial = cx[i] + ei[i] - 1;
                out |= (int) (planeout >> 63);
                partial |= ((int) (planepartial >> 63)) & (1<<i);
             }
+#endif
 
             if (out) {
                /* do nothing */
@@ -952,12 +1097,12 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
             }
 
             /* Iterate cx values across the region: */
-            for (i = 0; i < nr_planes; i++)
+            for (i = 0; i < nr_vplanes; i++)
                cx[i] += xstep[i];
          }
 
          /* Iterate c values down the region: */
-         for (i = 0; i < nr_planes; i++)
+         for (i = 0; i < nr_vplanes; i++)
             c[i] += ystep[i];
       }
    }
@@ -1043,6 +1188,32 @@ calc_fixed_position(struct lp_setup_context *setup,
    _mm_store_si128((__m128i *)&position->x[0], x0120);
    _mm_store_si128((__m128i *)&position->y[0], y0120);
 
+#elif defined(LP_SETUP_NEON)
+   /* x0 x1 x2 - and y0 y1 y2 -, rounded as util_iround, away from zero */
+   float32x4x2_t vxy = vuzpq_f32(vcombine_f32(vld1_f32(v0[0]), vld1_f32(v1[0])),
+                                 vcombine_f32(vld1_f32(v2[0]), vdup_n_f32(0.0f)));
+   float32x4_t pix_offset = vdupq_n_f32(setup->pixel_offset);
+   float32x4_t fixed_one = vdupq_n_f32((float)FIXED_ONE);
+   float32x4_t half = vdupq_n_f32(0.5f);
+   float32x4_t fx = vmulq_f32(vsubq_f32(vxy.val[0], pix_offset), fixed_one);
+   float32x4_t fy = vmulq_f32(vsubq_f32(vxy.val[1], pix_offset), fixed_one);
+   int32x4_t x, y;
+
+   fx = vaddq_f32(fx, vbslq_f32(vcltq_f32(fx, vdupq_n_f32(0.0f)),
+                                vnegq_f32(half), half));
+   fy = vaddq_f32(fy, vbslq_f32(vcltq_f32(fy, vdupq_n_f32(0.0f)),
+                                vnegq_f32(half), half));
+   x = vsetq_lane_s32(0, vcvtq_s32_f32(fx), 3); // should be unused
+   y = vsetq_lane_s32(0, vcvtq_s32_f32(fy), 3);
+   vst1q_s32(position->x, x);
+   vst1q_s32(position->y, y);
+
+   position->dx01 = position->x[0] - position->x[1];
+   position->dy01 = position->y[0] - position->y[1];
+
+   position->dx20 = position->x[2] - position->x[0];
+   position->dy20 = position->y[2] - position->y[0];
+
 #else
    position->x[0] = subpixel_snap(v0[0][0] - setup->pixel_offset);
    position->x[1] = subpixel_snap(v1[0][0] - setup->pixel_offset);
@@ -39,6 +39,7 @@
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_init.h"
 #include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_intr.h"
 
 #include "lp_test.h"
 
@@ -219,6 +220,91 @@ const float rsqrt_values[] = {
 };
 
 
+/*
+ * The fast rsqrt is only meant to have ~10 bits.
+ */
+const float fast_rsqrt_values[] = {
+   0.0, // must yield infinity
+   1.0,
+   1e-007, 4.0,
+   100000, 1e+035,
+#if (__STDC_VERSION__ >= 199901L)
+   INFINITY,
+#endif
+};
+
+
+static LLVMValueRef
+build_min_nan_other(struct lp_build_context *bld, LLVMValueRef a)
+{
+   return lp_build_min_ext(bld, a, bld->one, GALLIVM_NAN_RETURN_OTHER);
+}
+
+
+static float fminonef(float x)
+{
+   return fminf(x, 1.0f);
+}
+
+
+static LLVMValueRef
+build_max_nan_other(struct lp_build_context *bld, LLVMValueRef a)
+{
+   return lp_build_max_ext(bld, a, bld->zero, GALLIVM_NAN_RETURN_OTHER);
+}
+
+
+static float fmaxzerof(float x)
+{
+   return fmaxf(x, 0.0f);
+}
+
+
+const float minmax_values[] = {
+   -INFINITY,
+   -60,
+   -1,
+   -1e-007,
+   0,
+   1e-007,
+   0.99,
+   1,
+   2,
+   INFINITY,
+   NAN
+};
+
+
+static LLVMValueRef
+build_iround(struct lp_build_context *bld, LLVMValueRef a)
+{
+   return lp_build_int_to_float(bld, lp_build_iround(bld, a));
+}
+
+
+/*
+ * Round values representable as 32bit ints, without ties, which are
+ * rounded differently by the generic path.
+ */
+const float iround_values[] = {
+      -10.0, -1, 0.0, 12.0,
+      -1.49, -0.25, 1.25, 2.51,
+      -0.99, -0.01, 0.01, 0.99,
+      1.401298464324817e-45f, // smallest denormal
+      -1.401298464324817e-45f,
+      1.62981451e-08f,
+      -1.62981451e-08f,
+      4194305.0f, // 2^22 + 1
+      -4194305.0f,
+      2147483520.0f, // largest float smaller than 2^31
+      -2147483648.0f,
+      FLT_EPSILON,
+      -FLT_EPSILON,
+      1.0f - 0.5f*FLT_EPSILON,
+      -1.0f + FLT_EPSILON
+};
+
+
 const float sincos_values[] = {
    -INFINITY,
    -5*M_PI/4,
@@ -304,10 +390,14 @@ unary_tests[] = {
    {"log", &lp_build_log_safe, &logf, log2_values, ARRAY_SIZE(log2_values), 20.0 },
    {"rcp", &lp_build_rcp, &rcpf, rcp_values, ARRAY_SIZE(rcp_values), 20.0 },
    {"rsqrt", &lp_build_rsqrt, &rsqrtf, rsqrt_values, ARRAY_SIZE(rsqrt_values), 20.0 },
+   {"fast_rsqrt", &lp_build_fast_rsqrt, &rsqrtf, fast_rsqrt_values, ARRAY_SIZE(fast_rsqrt_values), 10.0 },
+   {"min", &build_min_nan_other, &fminonef, minmax_values, ARRAY_SIZE(minmax_values), 24.0 },
+   {"max", &build_max_nan_other, &fmaxzerof, minmax_values, ARRAY_SIZE(minmax_values), 24.0 },
    {"sin", &lp_build_sin, &sinf, sincos_values, ARRAY_SIZE(sincos_values), 20.0 },
    {"cos", &lp_build_cos, &cosf, sincos_values, ARRAY_SIZE(sincos_values), 20.0 },
    {"sgn", &lp_build_sgn, &sgnf, sgn_values, ARRAY_SIZE(sgn_values), 20.0 },
    {"round", &lp_build_round, &nearbyintf, round_values, ARRAY_SIZE(round_values), 24.0 },
+   {"iround", &build_iround, &nearbyintf, iround_values, ARRAY_SIZE(iround_values), 24.0 },
    {"trunc", &lp_build_trunc, &truncf, round_values, ARRAY_SIZE(round_values), 24.0 },
    {"floor", &lp_build_floor, &floorf, round_values, ARRAY_SIZE(round_values), 24.0 },
    {"ceil", &lp_build_ceil, &ceilf, round_values, ARRAY_SIZE(round_values), 24.0 },
@@ -459,10 +549,10 @@ test_unary(unsigned verbose, FILE *fp, const struct unary_test_t *test, unsigned
          }
 
          if (test->ref == &nearbyintf && length == 2 && 
-             ref != roundf(testval)) {
+             !LP_HAS_AARCH64_NEON && ref != roundf(testval)) {
             /* FIXME: The generic (non SSE) path in lp_build_iround, which is
              * always taken for length==2 regardless of native round support,
-             * does not round to even. */
+             * does not round to even.  AArch64 NEON rounds any length. */
             expected_pass = FALSE;
          }
 
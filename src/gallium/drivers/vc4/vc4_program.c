@@ -2479,7 +2479,8 @@ vc4_shader_state_create(struct pipe_context *pctx,
                         tgsi_dump(cso->tokens, 0);
                         fprintf(stderr, "\n");
                 }
-                s = tgsi_to_nir(cso->tokens, &nir_options);
+                s = tgsi_to_nir_cached(vc4_screen(pctx->screen)->ttn_cache,
+                                       cso->tokens, &nir_options);
         }
 
         NIR_PASS_V(s, nir_opt_global_to_local);
@@ -33,6 +33,7 @@
 #include "util/u_format.h"
 #include "util/u_hash_table.h"
 #include "util/ralloc.h"
+#include "nir/tgsi_to_nir.h"
 
 #include <xf86drm.h>
 #include "drm_fourcc.h"
@@ -101,6 +102,7 @@ vc4_screen_destroy(struct pipe_screen *pscreen)
         struct vc4_screen *screen = vc4_screen(pscreen);
 
         util_hash_table_destroy(screen->bo_handles);
+        tgsi_to_nir_cache_destroy(screen->ttn_cache);
         vc4_bufmgr_destroy(pscreen);
         slab_destroy_parent(&screen->transfer_pool);
         free(screen->ro);
@@ -672,6 +674,7 @@ vc4_screen_create(int fd, struct renderonly *ro)
         list_inithead(&screen->bo_cache.time_list);
         (void) mtx_init(&screen->bo_handles_mutex, mtx_plain);
         screen->bo_handles = util_hash_table_create(handle_hash, handle_compare);
+        screen->ttn_cache = tgsi_to_nir_cache_create();
 
         screen->has_control_flow =
                 vc4_has_feature(screen, DRM_VC4_PARAM_SUPPORTS_BRANCHES);
@@ -718,6 +721,7 @@ vc4_screen_create(int fd, struct renderonly *ro)
 
 fail:
         close(fd);
+        tgsi_to_nir_cache_destroy(screen->ttn_cache);
         ralloc_free(pscreen);
         return NULL;
 }
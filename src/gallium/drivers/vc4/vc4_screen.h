@@ -90,6 +90,9 @@ struct vc4_screen {
         struct util_hash_table *bo_handles;
         mtx_t bo_handles_mutex;
 
+        /** NIR of the TGSI shaders created before. */
+        struct tgsi_to_nir_cache *ttn_cache;
+
         uint32_t bo_size;
         uint32_t bo_count;
         bool has_control_flow;
@@ -889,8 +889,10 @@ vc5_resource_screen_init(struct pipe_screen *pscreen)
         pscreen->resource_from_handle = vc5_resource_from_handle;
         pscreen->resource_get_handle = vc5_resource_get_handle;
         pscreen->resource_destroy = u_transfer_helper_resource_destroy;
+        /* the render blits already copy these formats for MSAA resolves */
         pscreen->transfer_helper = u_transfer_helper_create(&transfer_vtbl,
-                                                            true, true, true);
+                                                            true, true, true,
+                                                            true);
 }
 
 void
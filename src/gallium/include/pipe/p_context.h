@@ -245,6 +245,23 @@ struct pipe_context {
    void   (*bind_tes_state)(struct pipe_context *, void *);
    void   (*delete_tes_state)(struct pipe_context *, void *);
 
+   /**
+    * Create a vertex or fragment shader state keyed on a SHA-1 that the
+    * state tracker computes with the disk cache of the screen
+    * (pipe_screen::get_disk_shader_cache) from everything the shader is
+    * made of, so that the same key always means the same shader. The
+    * driver caches the binary under the key instead of hashing the IR.
+    *
+    * With a NULL state the shader is created from the cached binary alone,
+    * NULL is returned when there is none and the state tracker creates it
+    * again with the IR. The state is bound and deleted like the ones of
+    * create_vs_state and create_fs_state. Optional.
+    */
+   void * (*create_cached_shader_state)(struct pipe_context *,
+                                        enum pipe_shader_type shader,
+                                        const struct pipe_shader_state *,
+                                        const unsigned char *key);
+
    void * (*create_vertex_elements_state)(struct pipe_context *,
                                           unsigned num_elements,
                                           const struct pipe_vertex_element *);
@@ -796,6 +796,7 @@ enum pipe_cap
    PIPE_CAP_CONSTBUF0_FLAGS,
    PIPE_CAP_PACKED_UNIFORMS,
    PIPE_CAP_FORCE_COMPUTE_MINMAX_INDICES,
+   PIPE_CAP_CLEAR_SCISSORED,
 };
 
 /**
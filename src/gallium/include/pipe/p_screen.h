@@ -259,9 +259,29 @@ struct pipe_screen {
     */
    void (*resource_changed)(struct pipe_screen *, struct pipe_resource *pt);
 
+   /**
+    * Set the region of a window system buffer the current frame changes,
+    * for EGL_KHR_partial_update. The rects have their origin at the bottom
+    * left, nrects 0 resets it to the whole resource. Optional.
+    */
+   void (*set_damage_region)(struct pipe_screen *screen,
+                             struct pipe_resource *resource,
+                             unsigned int nrects,
+                             const struct pipe_box *rects);
+
    void (*resource_destroy)(struct pipe_screen *,
 			    struct pipe_resource *pt);
 
+   /**
+    * Return a number that changes each time the contents of a buffer may
+    * have changed, so that data derived from them can be cached. Buffers
+    * written without the driver seeing it, like persistently mapped ones,
+    * get a new number at each call. Optional, without it such data isn't
+    * cached.
+    */
+   unsigned (*buffer_get_write_serial)(struct pipe_screen *screen,
+                                       struct pipe_resource *buffer);
+
 
    /**
     * Do any special operations to ensure frontbuffer contents are
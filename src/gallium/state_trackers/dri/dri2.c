@@ -35,6 +35,7 @@
 #include "util/u_inlines.h"
 #include "util/u_format.h"
 #include "util/u_debug.h"
+#include "util/u_box.h"
 #include "state_tracker/drm_driver.h"
 #include "state_tracker/st_cb_bufferobjects.h"
 #include "state_tracker/st_cb_fbo.h"
@@ -2036,6 +2037,59 @@ static const __DRI2configQueryExtension dri2GalliumConfigQueryExtension = {
    .configQueryf        = dri2GalliumConfigQueryf,
 };
 
+/**
+ * \brief the DRI2bufferDamageExtension set_damage_region method
+ */
+static void
+dri2_set_damage_region(__DRIdrawable *dPriv, unsigned int nrects, int *rects)
+{
+   struct dri_drawable *drawable = dri_drawable(dPriv);
+   struct dri_context *ctx = dri_context(dPriv->driContextPriv);
+   enum st_attachment_type statt = ST_ATTACHMENT_BACK_LEFT;
+   struct pipe_resource *resource = NULL;
+   struct pipe_box *boxes = NULL;
+
+   if (nrects) {
+      /* after a swap the textures are the old ones until validated */
+      if (!ctx || !drawable->base.validate(ctx->st, &drawable->base,
+                                           &statt, 1, &resource))
+         return;
+   } else {
+      /* the reset after a swap is for the buffer that was just presented */
+      struct pipe_resource **textures =
+         drawable->stvis.samples > 1 ? drawable->msaa_textures
+                                     : drawable->textures;
+      pipe_resource_reference(&resource, textures[statt]);
+   }
+
+   if (!resource)
+      return;
+
+   if (nrects) {
+      boxes = CALLOC(nrects, sizeof(*boxes));
+      if (!boxes) {
+         pipe_resource_reference(&resource, NULL);
+         return;
+      }
+
+      for (unsigned i = 0; i < nrects; i++) {
+         int *rect = &rects[i * 4];
+         u_box_2d(rect[0], rect[1], rect[2], rect[3], &boxes[i]);
+      }
+   }
+
+   resource->screen->set_damage_region(resource->screen, resource,
+                                       nrects, boxes);
+
+   FREE(boxes);
+   pipe_resource_reference(&resource, NULL);
+}
+
+/* set_damage_region is filled in if the driver has it */
+static __DRI2bufferDamageExtension dri2BufferDamageExtension = {
+   .base = { __DRI2_BUFFER_DAMAGE, 1 },
+};
+
 /*
  * Backend function init_screen.
  */
@@ -2050,6 +2104,7 @@ static const __DRIextension *dri_screen_extensions[] = {
    &dri2FenceExtension.base,
    &dri2InteropExtension.base,
    &dri2NoErrorExtension.base,
+   &dri2BufferDamageExtension.base,
    NULL
 };
 
@@ -2064,6 +2119,7 @@ static const __DRIextension *dri_robust_screen_extensions[] = {
    &dri2InteropExtension.base,
    &dri2Robustness.base,
    &dri2NoErrorExtension.base,
+   &dri2BufferDamageExtension.base,
    NULL
 };
 
@@ -2113,6 +2169,14 @@ dri2_init_screen(__DRIscreen * sPriv)
       screen->default_throttle_frames = throttle_ret->val.val_int;
    }
 
+   /* interactive apps may want fewer frames queued than the driver does */
+   int max_frames_in_flight =
+      driQueryOptioni(&screen->dev->option_cache, "max_frames_in_flight");
+   if (max_frames_in_flight >= 0) {
+      screen->throttling_enabled = max_frames_in_flight > 0;
+      screen->default_throttle_frames = max_frames_in_flight;
+   }
+
    if (pscreen->resource_create_with_modifiers)
       dri2ImageExtension.createImageWithModifiers =
          dri2_create_image_with_modifiers;
@@ -2133,6 +2197,9 @@ dri2_init_screen(__DRIscreen * sPriv)
       }
    }
 
+   if (pscreen->set_damage_region)
+      dri2BufferDamageExtension.set_damage_region = dri2_set_damage_region;
+
    if (pscreen->get_param(pscreen, PIPE_CAP_DEVICE_RESET_STATUS_QUERY)) {
       sPriv->extensions = dri_robust_screen_extensions;
       screen->has_reset_status_query = true;
@@ -0,0 +1,546 @@
+/**************************************************************************
+ *
+ * Copyright © 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Measures the CPU cost of draws in a pipe driver: each test draws small
+ * triangles with one kind of state changed before every draw and reports
+ * the time spent in the state changes and draw_vbo, and in the flush at
+ * the end of each frame. The GPU time is left out, the frame is waited
+ * for after the next one was recorded.
+ *
+ * The CSOs are bound directly to leave the cso_context cache out.
+ */
+
+#define WIDTH 256
+#define HEIGHT 256
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* u_box_2d */
+#include "util/u_box.h"
+/* u_sampler_view_default_template */
+#include "util/u_sampler.h"
+/* util_make_[fragment|vertex]_*_shader */
+#include "util/u_simple_shaders.h"
+/* os_time_get_nano */
+#include "util/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+enum test {
+	TEST_NONE,
+	TEST_SHADER,
+	TEST_TEXTURE,
+	TEST_CONSTBUF,
+	TEST_BLEND,
+	TEST_FRAMEBUFFER,
+	NUM_TESTS,
+};
+
+static const char *test_names[NUM_TESTS] = {
+	[TEST_NONE] = "none",
+	[TEST_SHADER] = "shader",
+	[TEST_TEXTURE] = "texture",
+	[TEST_CONSTBUF] = "constbuf",
+	[TEST_BLEND] = "blend",
+	[TEST_FRAMEBUFFER] = "framebuffer",
+};
+
+struct program
+{
+	struct pipe_loader_device **devs;
+	struct pipe_loader_device *dev;
+	int num_devs;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+
+	/* two of each state the tests switch between */
+	void *blend[2];
+	void *fs[2];
+	struct pipe_sampler_view *view[2];
+	struct pipe_resource *tex[2];
+	struct pipe_resource *target[2];
+	struct pipe_framebuffer_state framebuffer[2];
+
+	void *depthstencil;
+	void *rasterizer;
+	void *sampler;
+	void *velem;
+	void *vs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+};
+
+static struct pipe_resource *create_texture(struct program *p, unsigned bind)
+{
+	struct pipe_resource tmplt;
+	memset(&tmplt, 0, sizeof(tmplt));
+	tmplt.target = PIPE_TEXTURE_2D;
+	tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+	tmplt.width0 = WIDTH;
+	tmplt.height0 = HEIGHT;
+	tmplt.depth0 = 1;
+	tmplt.array_size = 1;
+	tmplt.last_level = 0;
+	tmplt.bind = bind;
+
+	return p->screen->resource_create(p->screen, &tmplt);
+}
+
+static bool init_prog(struct program *p, const char *driver)
+{
+	struct pipe_surface surf_tmpl;
+	int i;
+
+	/* find the device of the driver, or the first one */
+	p->num_devs = pipe_loader_probe(NULL, 0);
+	p->devs = CALLOC(p->num_devs, sizeof(*p->devs));
+	pipe_loader_probe(p->devs, p->num_devs);
+
+	for (i = 0; i < p->num_devs; i++) {
+		if (!driver || !strcmp(p->devs[i]->driver_name, driver)) {
+			p->dev = p->devs[i];
+			break;
+		}
+	}
+	if (!p->dev) {
+		fprintf(stderr, "no device for driver %s\n", driver);
+		return false;
+	}
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	if (!p->screen)
+		return false;
+
+	/* create the pipe driver context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	if (!p->pipe)
+		return false;
+
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	/* vertex buffer, position and texcoord of a small triangle */
+	{
+		float vertices[3][2][4] = {
+			{
+				{ 0.0f, -0.1f, 0.0f, 1.0f },
+				{ 0.5f, 0.0f, 0.0f, 1.0f }
+			},
+			{
+				{ -0.1f, 0.1f, 0.0f, 1.0f },
+				{ 0.0f, 1.0f, 0.0f, 1.0f }
+			},
+			{
+				{ 0.1f, 0.1f, 0.0f, 1.0f },
+				{ 1.0f, 1.0f, 0.0f, 1.0f }
+			}
+		};
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_DEFAULT, sizeof(vertices));
+		pipe_buffer_write(p->pipe, p->vbuf, 0, sizeof(vertices), vertices);
+	}
+
+	/* render targets */
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	for (i = 0; i < 2; i++) {
+		p->target[i] = create_texture(p, PIPE_BIND_RENDER_TARGET |
+					      PIPE_BIND_SAMPLER_VIEW);
+		memset(&p->framebuffer[i], 0, sizeof(p->framebuffer[i]));
+		p->framebuffer[i].width = WIDTH;
+		p->framebuffer[i].height = HEIGHT;
+		p->framebuffer[i].nr_cbufs = 1;
+		p->framebuffer[i].cbufs[0] =
+			p->pipe->create_surface(p->pipe, p->target[i], &surf_tmpl);
+	}
+
+	/* sampled textures */
+	for (i = 0; i < 2; i++) {
+		struct pipe_sampler_view v_tmplt;
+		uint32_t *data = MALLOC(WIDTH * HEIGHT * 4);
+		struct pipe_box box;
+
+		p->tex[i] = create_texture(p, PIPE_BIND_SAMPLER_VIEW);
+
+		memset(data, i ? 0x80 : 0xff, WIDTH * HEIGHT * 4);
+		u_box_2d(0, 0, WIDTH, HEIGHT, &box);
+		p->pipe->texture_subdata(p->pipe, p->tex[i], 0,
+					 PIPE_TRANSFER_WRITE, &box, data,
+					 WIDTH * 4, 0);
+		FREE(data);
+
+		u_sampler_view_default_template(&v_tmplt, p->tex[i],
+						p->tex[i]->format);
+		p->view[i] = p->pipe->create_sampler_view(p->pipe, p->tex[i],
+							  &v_tmplt);
+	}
+
+	/* disabled and additive blending */
+	for (i = 0; i < 2; i++) {
+		struct pipe_blend_state blend;
+		memset(&blend, 0, sizeof(blend));
+		blend.rt[0].colormask = PIPE_MASK_RGBA;
+		if (i) {
+			blend.rt[0].blend_enable = 1;
+			blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+			blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_ONE;
+			blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_ONE;
+			blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+			blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+			blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ONE;
+		}
+		p->blend[i] = p->pipe->create_blend_state(p->pipe, &blend);
+	}
+
+	/* no-op depth/stencil/alpha */
+	{
+		struct pipe_depth_stencil_alpha_state depthstencil;
+		memset(&depthstencil, 0, sizeof(depthstencil));
+		p->depthstencil =
+			p->pipe->create_depth_stencil_alpha_state(p->pipe,
+								  &depthstencil);
+	}
+
+	/* rasterizer */
+	{
+		struct pipe_rasterizer_state rasterizer;
+		memset(&rasterizer, 0, sizeof(rasterizer));
+		rasterizer.cull_face = PIPE_FACE_NONE;
+		rasterizer.half_pixel_center = 1;
+		rasterizer.bottom_edge_rule = 1;
+		rasterizer.depth_clip = 1;
+		p->rasterizer = p->pipe->create_rasterizer_state(p->pipe,
+								 &rasterizer);
+	}
+
+	/* sampler */
+	{
+		struct pipe_sampler_state sampler;
+		memset(&sampler, 0, sizeof(sampler));
+		sampler.wrap_s = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+		sampler.wrap_t = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+		sampler.wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+		sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+		sampler.min_img_filter = PIPE_TEX_MIPFILTER_LINEAR;
+		sampler.mag_img_filter = PIPE_TEX_MIPFILTER_LINEAR;
+		sampler.normalized_coords = 1;
+		p->sampler = p->pipe->create_sampler_state(p->pipe, &sampler);
+	}
+
+	/* vertex elements state */
+	{
+		struct pipe_vertex_element velem[2];
+		memset(velem, 0, sizeof(velem));
+		velem[0].src_offset = 0 * 4 * sizeof(float);
+		velem[0].vertex_buffer_index = 0;
+		velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+		velem[1].src_offset = 1 * 4 * sizeof(float);
+		velem[1].vertex_buffer_index = 0;
+		velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+		p->velem = p->pipe->create_vertex_elements_state(p->pipe, 2, velem);
+	}
+
+	/* vertex shader */
+	{
+		const enum tgsi_semantic semantic_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_GENERIC };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, FALSE);
+	}
+
+	/* fragment shaders sampling the texture and passing the texcoord */
+	p->fs[0] = util_make_fragment_tex_shader(p->pipe, TGSI_TEXTURE_2D,
+						 TGSI_INTERPOLATE_LINEAR,
+						 TGSI_RETURN_TYPE_FLOAT,
+						 TGSI_RETURN_TYPE_FLOAT,
+						 false, false);
+	p->fs[1] = util_make_fragment_passthrough_shader(p->pipe,
+		TGSI_SEMANTIC_GENERIC, TGSI_INTERPOLATE_LINEAR, TRUE);
+
+	return true;
+}
+
+static void close_prog(struct program *p)
+{
+	int i;
+
+	if (p->pipe) {
+		for (i = 0; i < 2; i++) {
+			p->pipe->delete_blend_state(p->pipe, p->blend[i]);
+			p->pipe->delete_fs_state(p->pipe, p->fs[i]);
+			pipe_sampler_view_reference(&p->view[i], NULL);
+			pipe_surface_reference(&p->framebuffer[i].cbufs[0], NULL);
+			pipe_resource_reference(&p->tex[i], NULL);
+			pipe_resource_reference(&p->target[i], NULL);
+		}
+
+		p->pipe->delete_depth_stencil_alpha_state(p->pipe, p->depthstencil);
+		p->pipe->delete_rasterizer_state(p->pipe, p->rasterizer);
+		p->pipe->delete_sampler_state(p->pipe, p->sampler);
+		p->pipe->delete_vertex_elements_state(p->pipe, p->velem);
+		p->pipe->delete_vs_state(p->pipe, p->vs);
+		pipe_resource_reference(&p->vbuf, NULL);
+
+		p->pipe->destroy(p->pipe);
+	}
+
+	if (p->screen)
+		p->screen->destroy(p->screen);
+	pipe_loader_release(p->devs, p->num_devs);
+
+	FREE(p->devs);
+	FREE(p);
+}
+
+/* the state of the none test, the others change one part per draw */
+static void bind_state(struct program *p)
+{
+	struct pipe_viewport_state viewport;
+	struct pipe_vertex_buffer vbuf;
+
+	p->pipe->set_framebuffer_state(p->pipe, &p->framebuffer[0]);
+	p->pipe->bind_blend_state(p->pipe, p->blend[0]);
+	p->pipe->bind_depth_stencil_alpha_state(p->pipe, p->depthstencil);
+	p->pipe->bind_rasterizer_state(p->pipe, p->rasterizer);
+
+	viewport.scale[0] = WIDTH / 2.0f;
+	viewport.scale[1] = HEIGHT / 2.0f;
+	viewport.scale[2] = 0.5f;
+	viewport.translate[0] = WIDTH / 2.0f;
+	viewport.translate[1] = HEIGHT / 2.0f;
+	viewport.translate[2] = 0.5f;
+	p->pipe->set_viewport_states(p->pipe, 0, 1, &viewport);
+
+	p->pipe->bind_sampler_states(p->pipe, PIPE_SHADER_FRAGMENT, 0, 1,
+				     &p->sampler);
+	p->pipe->set_sampler_views(p->pipe, PIPE_SHADER_FRAGMENT, 0, 1,
+				   &p->view[0]);
+
+	p->pipe->bind_vs_state(p->pipe, p->vs);
+	p->pipe->bind_fs_state(p->pipe, p->fs[0]);
+	p->pipe->bind_vertex_elements_state(p->pipe, p->velem);
+
+	memset(&vbuf, 0, sizeof(vbuf));
+	vbuf.stride = 2 * 4 * sizeof(float);
+	vbuf.buffer.resource = p->vbuf;
+	p->pipe->set_vertex_buffers(p->pipe, 0, 1, &vbuf);
+}
+
+static void change_state(struct program *p, enum test test, int draw)
+{
+	int i = draw & 1;
+
+	switch (test) {
+	case TEST_NONE:
+		break;
+	case TEST_SHADER:
+		p->pipe->bind_fs_state(p->pipe, p->fs[i]);
+		break;
+	case TEST_TEXTURE:
+		p->pipe->set_sampler_views(p->pipe, PIPE_SHADER_FRAGMENT, 0, 1,
+					   &p->view[i]);
+		break;
+	case TEST_CONSTBUF: {
+		float constants[4] = { draw, 0.0f, 0.0f, 0.0f };
+		struct pipe_constant_buffer cb = {
+			.buffer_size = sizeof(constants),
+			.user_buffer = constants,
+		};
+		p->pipe->set_constant_buffer(p->pipe, PIPE_SHADER_VERTEX, 0, &cb);
+		break;
+	}
+	case TEST_BLEND:
+		p->pipe->bind_blend_state(p->pipe, p->blend[i]);
+		break;
+	case TEST_FRAMEBUFFER:
+		p->pipe->set_framebuffer_state(p->pipe, &p->framebuffer[i]);
+		/* the first draws to each target start with a clear */
+		if (draw < 2)
+			p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, &p->clear_color, 0, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void run_test(struct program *p, enum test test, int num_draws,
+		     int num_frames)
+{
+	struct pipe_fence_handle *fence = NULL;
+	struct pipe_draw_info info;
+	int64_t draw_time = 0, flush_time = 0, wait_time = 0;
+	int frame, draw;
+
+	memset(&info, 0, sizeof(info));
+	info.mode = PIPE_PRIM_TRIANGLES;
+	info.count = 3;
+	info.instance_count = 1;
+	info.max_index = 2;
+
+	bind_state(p);
+
+	/* the first frame compiles the shaders and allocates the buffers */
+	for (frame = -1; frame < num_frames; frame++) {
+		struct pipe_fence_handle *new_fence = NULL;
+		int64_t start, end;
+
+		p->pipe->set_framebuffer_state(p->pipe, &p->framebuffer[0]);
+		p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, &p->clear_color, 0, 0);
+
+		start = os_time_get_nano();
+		for (draw = 0; draw < num_draws; draw++) {
+			change_state(p, test, draw);
+			p->pipe->draw_vbo(p->pipe, &info);
+		}
+		end = os_time_get_nano();
+		if (frame >= 0)
+			draw_time += end - start;
+
+		start = end;
+		p->pipe->flush(p->pipe, &new_fence, 0);
+		end = os_time_get_nano();
+		if (frame >= 0)
+			flush_time += end - start;
+
+		/* keep one frame in flight like an application would */
+		start = end;
+		if (fence) {
+			p->screen->fence_finish(p->screen, NULL, fence,
+						PIPE_TIMEOUT_INFINITE);
+			p->screen->fence_reference(p->screen, &fence, NULL);
+		}
+		fence = new_fence;
+		end = os_time_get_nano();
+		if (frame >= 0)
+			wait_time += end - start;
+	}
+
+	if (fence) {
+		p->screen->fence_finish(p->screen, NULL, fence,
+					PIPE_TIMEOUT_INFINITE);
+		p->screen->fence_reference(p->screen, &fence, NULL);
+	}
+
+	printf("%-12s %10.1f ns/draw %10.1f us/flush %10.1f us/wait\n",
+	       test_names[test],
+	       (double)draw_time / ((int64_t)num_draws * num_frames),
+	       flush_time / 1000.0 / num_frames, wait_time / 1000.0 / num_frames);
+}
+
+static void print_usage(void)
+{
+	int i;
+
+	printf("Usage: draw-overhead [OPTIONS]... [TEST]...\n");
+	printf("    --driver NAME    - pipe loader driver, like lima or swrast\n");
+	printf("                       (GALLIUM_DRIVER picks softpipe or llvmpipe)\n");
+	printf("    --draws N        - draws per frame (default 1000)\n");
+	printf("    --frames N       - frames per test (default 100)\n");
+	printf("    --help           - show this message\n");
+	printf("Tests:");
+	for (i = 0; i < NUM_TESTS; i++)
+		printf(" %s", test_names[i]);
+	printf(", all by default\n");
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p;
+	const char *driver = NULL;
+	int num_draws = 1000, num_frames = 100;
+	bool tests[NUM_TESTS] = {0};
+	bool any_test = false;
+	int n, i;
+
+	for (n = 1; n < argc; n++) {
+		if (!strcmp(argv[n], "--driver") && n + 1 < argc)
+			driver = argv[++n];
+		else if (!strcmp(argv[n], "--draws") && n + 1 < argc)
+			num_draws = MAX2(atoi(argv[++n]), 1);
+		else if (!strcmp(argv[n], "--frames") && n + 1 < argc)
+			num_frames = MAX2(atoi(argv[++n]), 1);
+		else if (!strcmp(argv[n], "--help")) {
+			print_usage();
+			return 0;
+		}
+		else {
+			for (i = 0; i < NUM_TESTS; i++) {
+				if (!strcmp(argv[n], test_names[i]))
+					break;
+			}
+			if (i == NUM_TESTS) {
+				print_usage();
+				return 1;
+			}
+			tests[i] = true;
+			any_test = true;
+		}
+	}
+
+	p = CALLOC_STRUCT(program);
+	if (!init_prog(p, driver)) {
+		close_prog(p);
+		return 1;
+	}
+
+	printf("%s, %d draws x %d frames\n",
+	       p->screen->get_name(p->screen), num_draws, num_frames);
+
+	for (i = 0; i < NUM_TESTS; i++) {
+		if (!any_test || tests[i])
+			run_test(p, i, num_draws, num_frames);
+	}
+
+	close_prog(p);
+
+	return 0;
+}
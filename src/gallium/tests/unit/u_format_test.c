@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <float.h>
 
 #include "util/u_half.h"
@@ -673,6 +674,125 @@ test_format_pack_s_8uint(const struct util_format_description *format_desc,
 }
 
 
+/*
+ * The test cases above are single pixels, which never reach the SIMD row
+ * kernels of u_format_pack.py and u_format_zs.c.  Rows of random pixels are
+ * converted whole and again pixel by pixel, where only the C kernels run,
+ * and both results must be the same.
+ */
+
+#define ROW_TEST_WIDTH 37
+#define ROW_TEST_HEIGHT 3
+#define ROW_TEST_STRIDE (ROW_TEST_WIDTH * 4 + 12)
+
+enum row_func {
+   ROW_UNPACK_RGBA_8UNORM,
+   ROW_PACK_RGBA_8UNORM,
+   ROW_UNPACK_Z_32UNORM,
+   ROW_UNPACK_S_8UINT,
+};
+
+
+static void
+convert_rows(const struct util_format_description *format_desc,
+             enum row_func func,
+             uint8_t *dst, unsigned dst_stride,
+             const uint8_t *src, unsigned src_stride,
+             unsigned width, unsigned height)
+{
+   switch (func) {
+   case ROW_UNPACK_RGBA_8UNORM:
+      format_desc->unpack_rgba_8unorm(dst, dst_stride, src, src_stride,
+                                      width, height);
+      break;
+   case ROW_PACK_RGBA_8UNORM:
+      format_desc->pack_rgba_8unorm(dst, dst_stride, src, src_stride,
+                                    width, height);
+      break;
+   case ROW_UNPACK_Z_32UNORM:
+      format_desc->unpack_z_32unorm((uint32_t *)dst, dst_stride,
+                                    src, src_stride, width, height);
+      break;
+   case ROW_UNPACK_S_8UINT:
+      format_desc->unpack_s_8uint(dst, dst_stride, src, src_stride,
+                                  width, height);
+      break;
+   }
+}
+
+
+static boolean
+test_format_rows(const struct util_format_description *format_desc,
+                 enum row_func func, const char *suffix,
+                 unsigned src_bytes, unsigned dst_bytes)
+{
+   static uint32_t src[ROW_TEST_HEIGHT][ROW_TEST_STRIDE / 4];
+   static uint32_t whole[ROW_TEST_HEIGHT][ROW_TEST_STRIDE / 4];
+   static uint32_t single[ROW_TEST_HEIGHT][ROW_TEST_STRIDE / 4];
+   uint32_t seed = format_desc->format;
+   unsigned x, y;
+   boolean success = TRUE;
+
+   for (y = 0; y < ROW_TEST_HEIGHT; ++y) {
+      for (x = 0; x < ROW_TEST_STRIDE / 4; ++x) {
+         seed = seed * 1103515245 + 12345;
+         src[y][x] = (seed >> 16) | (seed << 16);
+      }
+   }
+
+   memset(whole, 0, sizeof whole);
+   memset(single, 0, sizeof single);
+
+   convert_rows(format_desc, func,
+                (uint8_t *)whole, sizeof whole[0],
+                (const uint8_t *)src, sizeof src[0],
+                ROW_TEST_WIDTH, ROW_TEST_HEIGHT);
+
+   for (y = 0; y < ROW_TEST_HEIGHT; ++y) {
+      for (x = 0; x < ROW_TEST_WIDTH; ++x) {
+         convert_rows(format_desc, func,
+                      (uint8_t *)single[y] + x * dst_bytes, 0,
+                      (const uint8_t *)src[y] + x * src_bytes, 0, 1, 1);
+      }
+
+      if (memcmp(whole[y], single[y], ROW_TEST_WIDTH * dst_bytes)) {
+         printf("FAILED: util_format_%s_%s of a row differs from the "
+                "pixels one by one\n", format_desc->short_name, suffix);
+         success = FALSE;
+      }
+   }
+
+   return success;
+}
+
+
+static boolean
+test_all_rows(const struct util_format_description *format_desc)
+{
+   unsigned bytes = format_desc->block.bits / 8;
+   boolean success = TRUE;
+
+   if (format_desc->block.width != 1 || format_desc->block.height != 1 ||
+       bytes > 4)
+      return TRUE;
+
+   if (format_desc->unpack_rgba_8unorm)
+      success &= test_format_rows(format_desc, ROW_UNPACK_RGBA_8UNORM,
+                                  "unpack_rgba_8unorm", bytes, 4);
+   if (format_desc->pack_rgba_8unorm)
+      success &= test_format_rows(format_desc, ROW_PACK_RGBA_8UNORM,
+                                  "pack_rgba_8unorm", 4, bytes);
+   if (format_desc->unpack_z_32unorm)
+      success &= test_format_rows(format_desc, ROW_UNPACK_Z_32UNORM,
+                                  "unpack_z_32unorm", bytes, 4);
+   if (format_desc->unpack_s_8uint)
+      success &= test_format_rows(format_desc, ROW_UNPACK_S_8UINT,
+                                  "unpack_s_8uint", bytes, 1);
+
+   return success;
+}
+
+
 typedef boolean
 (*test_func_t)(const struct util_format_description *format_desc,
                const struct util_format_test_case *test);
@@ -743,6 +863,10 @@ test_all(void)
       TEST_ONE_FUNC(pack_s_8uint);
 
 #     undef TEST_ONE_FUNC
+
+      if (!test_all_rows(format_desc)) {
+         success = FALSE;
+      }
    }
 
    return success;
@@ -0,0 +1,186 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Lima Project
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Test case for the call coalescing of u_threaded_context, against a mock
+ * driver context recording the calls it gets.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_threaded_context.h"
+#include "util/u_upload_mgr.h"
+
+
+static int num_binds, num_draws, num_cb_sets;
+static struct pipe_draw_info draws[16];
+static int error;
+
+
+#define check(cond) \
+   do { \
+      if (!(cond)) { \
+         fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                 #cond); \
+         error = 1; \
+      } \
+   } while (0)
+
+
+static void
+mock_bind_fs_state(struct pipe_context *pipe, void *state)
+{
+   num_binds++;
+}
+
+
+static void
+mock_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
+{
+   if (num_draws < ARRAY_SIZE(draws))
+      draws[num_draws] = *info;
+   num_draws++;
+}
+
+
+static void
+mock_set_constant_buffer(struct pipe_context *pipe,
+                         enum pipe_shader_type shader, uint index,
+                         const struct pipe_constant_buffer *cb)
+{
+   num_cb_sets++;
+}
+
+
+static void
+mock_flush(struct pipe_context *pipe, struct pipe_fence_handle **fence,
+           unsigned flags)
+{
+}
+
+
+static void
+mock_destroy(struct pipe_context *pipe)
+{
+   u_upload_destroy(pipe->stream_uploader);
+}
+
+
+static int
+mock_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return 64;
+}
+
+
+static void
+draw(struct pipe_context *ctx, unsigned start, unsigned count)
+{
+   struct pipe_draw_info info = {0};
+
+   info.mode = PIPE_PRIM_TRIANGLES;
+   info.instance_count = 1;
+   info.start = start;
+   info.count = count;
+   /* as the state tracker sets them for non-indexed draws */
+   info.min_index = start;
+   info.max_index = start + count - 1;
+   ctx->draw_vbo(ctx, &info);
+}
+
+
+int main(int argc, char **argv)
+{
+   static struct pipe_screen screen;
+   static struct pipe_context pipe;
+   struct slab_parent_pool pool;
+   struct threaded_context *tc = NULL;
+   struct pipe_constant_buffer cb = {0};
+   void *fs = (void *)0x1000, *other_fs = (void *)0x2000;
+
+   screen.get_param = mock_get_param;
+   pipe.screen = &screen;
+   pipe.bind_fs_state = mock_bind_fs_state;
+   pipe.draw_vbo = mock_draw_vbo;
+   pipe.set_constant_buffer = mock_set_constant_buffer;
+   pipe.flush = mock_flush;
+   pipe.destroy = mock_destroy;
+   pipe.stream_uploader = u_upload_create_default(&pipe);
+   pipe.const_uploader = pipe.stream_uploader;
+
+   slab_create_parent(&pool, 64, 16);
+
+   /* the context is only wrapped with threading enabled */
+   setenv("GALLIUM_THREAD", "1", 1);
+   struct pipe_context *ctx =
+      threaded_context_create(&pipe, &pool, NULL, NULL, &tc);
+   if (!ctx || !tc) {
+      fprintf(stderr, "threaded_context_create failed\n");
+      return 1;
+   }
+   tc->coalesce_calls = true;
+
+   ctx->bind_fs_state(ctx, fs);
+   ctx->set_constant_buffer(ctx, PIPE_SHADER_FRAGMENT, 0, &cb); /* dead */
+   ctx->set_constant_buffer(ctx, PIPE_SHADER_FRAGMENT, 0, &cb);
+   draw(ctx, 0, 6);
+   ctx->bind_fs_state(ctx, fs); /* already bound */
+   draw(ctx, 6, 3);             /* merged */
+   draw(ctx, 9, 3);             /* merged */
+   draw(ctx, 20, 3);            /* not contiguous */
+   ctx->bind_fs_state(ctx, other_fs);
+   draw(ctx, 23, 3);            /* the state changed */
+   ctx->set_constant_buffer(ctx, PIPE_SHADER_FRAGMENT, 0, &cb);
+   draw(ctx, 26, 3);            /* the constant buffer set is used */
+   ctx->flush(ctx, NULL, 0);
+
+   check(num_binds == 2);
+   check(num_cb_sets == 2);
+   check(num_draws == 4);
+   check(draws[0].start == 0 && draws[0].count == 12);
+   check(draws[0].min_index == 0 && draws[0].max_index == 11);
+   check(draws[1].start == 20 && draws[1].count == 3);
+   check(tc->num_merged_draws == 2);
+   check(tc->num_dropped_calls == 2);
+
+   /* the next batch knows which fs is bound */
+   ctx->bind_fs_state(ctx, other_fs);
+   ctx->flush(ctx, NULL, 0);
+   check(num_binds == 2);
+
+   ctx->destroy(ctx);
+   slab_destroy_parent(&pool);
+
+   printf("%s\n", error ? "FAIL" : "PASS");
+   return error;
+}
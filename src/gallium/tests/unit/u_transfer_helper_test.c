@@ -0,0 +1,418 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Lima Project
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+
+/*
+ * Test case for the staging copies of u_transfer_helper, against a mock
+ * screen and context: writes discarding a box of a busy z32s8 or fake RGTC
+ * resource go to a staging resource blitted to it, other maps of it wait.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_box.h"
+#include "util/u_format.h"
+#include "util/u_format_rgtc.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_transfer_helper.h"
+
+
+#define SIZE 16
+
+
+struct mock_resource {
+   struct pipe_resource base;
+   enum pipe_format internal_format;
+   struct pipe_resource *stencil;
+   unsigned stride;
+   uint8_t *data;
+   /* the GPU is using it, a synchronized map waits */
+   boolean busy;
+};
+
+static boolean stencil_export;
+static int num_resources, num_transfers, num_stalls, num_blits;
+static int error;
+
+
+#define check(cond) \
+   do { \
+      if (!(cond)) { \
+         fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                 #cond); \
+         error = 1; \
+      } \
+   } while (0)
+
+
+static inline struct mock_resource *
+mock_resource(struct pipe_resource *prsc)
+{
+   return (struct mock_resource *)prsc;
+}
+
+
+static int
+mock_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return param == PIPE_CAP_SHADER_STENCIL_EXPORT ? stencil_export : 0;
+}
+
+
+static struct pipe_resource *
+mock_resource_create(struct pipe_screen *screen,
+                     const struct pipe_resource *templat)
+{
+   struct mock_resource *res = CALLOC_STRUCT(mock_resource);
+
+   res->base = *templat;
+   res->base.screen = screen;
+   pipe_reference_init(&res->base.reference, 1);
+   res->internal_format = templat->format;
+   res->stride = util_format_get_stride(templat->format, templat->width0);
+   res->data = CALLOC(util_format_get_nblocksy(templat->format,
+                                               templat->height0),
+                      res->stride);
+   num_resources++;
+   return &res->base;
+}
+
+
+static void
+mock_resource_destroy(struct pipe_screen *screen, struct pipe_resource *prsc)
+{
+   FREE(mock_resource(prsc)->data);
+   FREE(prsc);
+   num_resources--;
+}
+
+
+static void *
+mock_transfer_map(struct pipe_context *pipe, struct pipe_resource *prsc,
+                  unsigned level, unsigned usage, const struct pipe_box *box,
+                  struct pipe_transfer **out_transfer)
+{
+   struct mock_resource *res = mock_resource(prsc);
+   struct pipe_transfer *transfer = CALLOC_STRUCT(pipe_transfer);
+   enum pipe_format format = res->internal_format;
+
+   if (res->busy && !(usage & PIPE_TRANSFER_UNSYNCHRONIZED))
+      num_stalls++;
+
+   pipe_resource_reference(&transfer->resource, prsc);
+   transfer->level = level;
+   transfer->usage = usage;
+   transfer->box = *box;
+   transfer->stride = res->stride;
+   *out_transfer = transfer;
+   num_transfers++;
+   return res->data +
+          util_format_get_nblocksy(format, box->y) * res->stride +
+          util_format_get_stride(format, box->x);
+}
+
+
+static void
+mock_transfer_flush_region(struct pipe_context *pipe,
+                           struct pipe_transfer *transfer,
+                           const struct pipe_box *box)
+{
+}
+
+
+static void
+mock_transfer_unmap(struct pipe_context *pipe, struct pipe_transfer *transfer)
+{
+   pipe_resource_reference(&transfer->resource, NULL);
+   FREE(transfer);
+   num_transfers--;
+}
+
+
+static enum pipe_format
+mock_get_internal_format(struct pipe_resource *prsc)
+{
+   return mock_resource(prsc)->internal_format;
+}
+
+
+static void
+mock_set_stencil(struct pipe_resource *prsc, struct pipe_resource *stencil)
+{
+   mock_resource(prsc)->stencil = stencil;
+}
+
+
+static struct pipe_resource *
+mock_get_stencil(struct pipe_resource *prsc)
+{
+   return mock_resource(prsc)->stencil;
+}
+
+
+static void
+copy_rect(struct mock_resource *dst, const struct pipe_box *dst_box,
+          struct mock_resource *src, const struct pipe_box *src_box)
+{
+   unsigned cpp = util_format_get_blocksize(dst->internal_format);
+
+   check(dst->internal_format == src->internal_format);
+
+   for (int y = 0; y < src_box->height; y++) {
+      memcpy(dst->data + (dst_box->y + y) * dst->stride + dst_box->x * cpp,
+             src->data + (src_box->y + y) * src->stride + src_box->x * cpp,
+             src_box->width * cpp);
+   }
+}
+
+
+/* as done by the GPU, between the internal formats */
+static void
+mock_blit(struct pipe_context *pipe, const struct pipe_blit_info *info)
+{
+   struct mock_resource *src = mock_resource(info->src.resource);
+   struct mock_resource *dst = mock_resource(info->dst.resource);
+
+   check(info->src.format == info->dst.format);
+   check(info->dst.format == dst->base.format);
+   check(info->mask == util_format_get_mask(dst->base.format));
+   check(info->src.box.width == info->dst.box.width &&
+         info->src.box.height == info->dst.box.height);
+
+   copy_rect(dst, &info->dst.box, src, &info->src.box);
+   if (dst->stencil) {
+      copy_rect(mock_resource(dst->stencil), &info->dst.box,
+                mock_resource(src->stencil), &info->src.box);
+   }
+   num_blits++;
+}
+
+
+static const struct u_transfer_vtbl transfer_vtbl = {
+   .resource_create       = mock_resource_create,
+   .resource_destroy      = mock_resource_destroy,
+   .transfer_map          = mock_transfer_map,
+   .transfer_unmap        = mock_transfer_unmap,
+   .transfer_flush_region = mock_transfer_flush_region,
+   .get_internal_format   = mock_get_internal_format,
+   .set_stencil           = mock_set_stencil,
+   .get_stencil           = mock_get_stencil,
+};
+
+
+static struct pipe_resource *
+create_busy(struct pipe_screen *screen, enum pipe_format format)
+{
+   struct pipe_resource templat = {
+      .target = PIPE_TEXTURE_2D,
+      .format = format,
+      .width0 = SIZE,
+      .height0 = SIZE,
+      .depth0 = 1,
+      .array_size = 1,
+   };
+   struct pipe_resource *prsc = screen->resource_create(screen, &templat);
+
+   mock_resource(prsc)->busy = TRUE;
+   if (mock_resource(prsc)->stencil)
+      mock_resource(mock_resource(prsc)->stencil)->busy = TRUE;
+   return prsc;
+}
+
+
+/* Writes the 8x8 box at 4,4 of a z32s8 resource, checks the depth and
+ * stencil of all of it and returns the number of blits.
+ */
+static int
+test_z32s8(struct pipe_context *pipe, unsigned usage, boolean staged)
+{
+   struct pipe_resource *prsc =
+      create_busy(pipe->screen, PIPE_FORMAT_Z32_FLOAT_S8X24_UINT);
+   struct mock_resource *res = mock_resource(prsc);
+   struct mock_resource *stencil = mock_resource(res->stencil);
+   struct pipe_transfer *transfer;
+   struct pipe_box box;
+   uint8_t *map;
+   int stalls = num_stalls, blits = num_blits;
+
+   u_box_2d(4, 4, 8, 8, &box);
+   map = pipe->transfer_map(pipe, prsc, 0, usage, &box, &transfer);
+   check(map && transfer->stride >= 8 * 8);
+   check((num_stalls == stalls) == staged);
+
+   for (int y = 0; y < 8; y++) {
+      for (int x = 0; x < 8; x++) {
+         float z = (x + y * 8) / 64.0f;
+         uint32_t s = 0x100 | (x ^ y) | (y << 4);
+
+         memcpy(map + y * transfer->stride + x * 8, &z, 4);
+         memcpy(map + y * transfer->stride + x * 8 + 4, &s, 4);
+      }
+   }
+   if (usage & PIPE_TRANSFER_FLUSH_EXPLICIT) {
+      u_box_2d(0, 0, 8, 8, &box);
+      pipe->transfer_flush_region(pipe, transfer, &box);
+   }
+   pipe->transfer_unmap(pipe, transfer);
+   check((num_stalls == stalls) == staged);
+   check((num_blits != blits) == staged);
+
+   for (int y = 0; y < SIZE; y++) {
+      for (int x = 0; x < SIZE; x++) {
+         boolean inside = x >= 4 && x < 12 && y >= 4 && y < 12;
+         float z = inside ? (x - 4 + (y - 4) * 8) / 64.0f : 0.0f;
+         uint8_t s = inside ? ((x - 4) ^ (y - 4)) | ((y - 4) << 4) : 0;
+         float rz;
+
+         memcpy(&rz, res->data + y * res->stride + x * 4, 4);
+         check(rz == z);
+         check(stencil->data[y * stencil->stride + x] == s);
+      }
+   }
+
+   pipe_resource_reference(&prsc, NULL);
+   return num_blits - blits;
+}
+
+
+/* the same for the RGTC1 blocks of a fake RGTC resource */
+static void
+test_rgtc(struct pipe_context *pipe, unsigned usage, boolean staged)
+{
+   struct pipe_resource *prsc =
+      create_busy(pipe->screen, PIPE_FORMAT_RGTC1_UNORM);
+   struct mock_resource *res = mock_resource(prsc);
+   struct pipe_transfer *transfer;
+   struct pipe_box box;
+   uint8_t blocks[2 * 2 * 8], expected[8 * 8 * 4];
+   uint8_t *map;
+   int stalls = num_stalls, blits = num_blits;
+
+   for (unsigned i = 0; i < sizeof(blocks); i++)
+      blocks[i] = i * 37 + 11;
+   util_format_rgtc1_unorm_unpack_rgba_8unorm(expected, 8 * 4, blocks, 2 * 8,
+                                              8, 8);
+
+   u_box_2d(4, 4, 8, 8, &box);
+   map = pipe->transfer_map(pipe, prsc, 0, usage, &box, &transfer);
+   check(map);
+   check((num_stalls == stalls) == staged);
+
+   for (int y = 0; y < 2; y++)
+      memcpy(map + y * transfer->stride, blocks + y * 2 * 8, 2 * 8);
+   pipe->transfer_unmap(pipe, transfer);
+   check((num_stalls == stalls) == staged);
+   check((num_blits != blits) == staged);
+
+   for (int y = 0; y < SIZE; y++) {
+      for (int x = 0; x < SIZE; x++) {
+         boolean inside = x >= 4 && x < 12 && y >= 4 && y < 12;
+         uint8_t zero[4] = { 0 };
+         const uint8_t *texel = inside ?
+            expected + (y - 4) * 8 * 4 + (x - 4) * 4 : zero;
+
+         check(!memcmp(res->data + y * res->stride + x * 4, texel, 4));
+      }
+   }
+
+   pipe_resource_reference(&prsc, NULL);
+}
+
+
+static void
+test_staging_copies(void)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct u_transfer_helper *staging, *direct;
+
+   memset(&screen, 0, sizeof(screen));
+   screen.get_param = mock_get_param;
+   screen.resource_create = u_transfer_helper_resource_create;
+   screen.resource_destroy = u_transfer_helper_resource_destroy;
+
+   memset(&pipe, 0, sizeof(pipe));
+   pipe.screen = &screen;
+   pipe.transfer_map = u_transfer_helper_transfer_map;
+   pipe.transfer_flush_region = u_transfer_helper_transfer_flush_region;
+   pipe.transfer_unmap = u_transfer_helper_transfer_unmap;
+   pipe.blit = mock_blit;
+
+   staging = u_transfer_helper_create(&transfer_vtbl, true, true, false, true);
+   direct = u_transfer_helper_create(&transfer_vtbl, true, true, false, false);
+
+   screen.transfer_helper = staging;
+   stencil_export = TRUE;
+
+   check(test_z32s8(&pipe, PIPE_TRANSFER_WRITE |
+                           PIPE_TRANSFER_DISCARD_RANGE, TRUE) == 1);
+   check(test_z32s8(&pipe, PIPE_TRANSFER_WRITE |
+                           PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE, TRUE) == 1);
+   test_rgtc(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE, TRUE);
+
+   /* the staging copy would write the rest of the box, or has to be read */
+   test_z32s8(&pipe, PIPE_TRANSFER_WRITE, FALSE);
+   test_z32s8(&pipe, PIPE_TRANSFER_READ_WRITE | PIPE_TRANSFER_DISCARD_RANGE,
+              FALSE);
+   test_z32s8(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_FLUSH_EXPLICIT, FALSE);
+   test_rgtc(&pipe, PIPE_TRANSFER_WRITE, FALSE);
+
+   /* the blitter can't write the stencil */
+   stencil_export = FALSE;
+   test_z32s8(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE, FALSE);
+   test_rgtc(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE, TRUE);
+
+   screen.transfer_helper = direct;
+   stencil_export = TRUE;
+   test_z32s8(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE, FALSE);
+   test_rgtc(&pipe, PIPE_TRANSFER_WRITE | PIPE_TRANSFER_DISCARD_RANGE, FALSE);
+
+   u_transfer_helper_destroy(staging);
+   u_transfer_helper_destroy(direct);
+
+   check(num_resources == 0);
+   check(num_transfers == 0);
+}
+
+
+int main(int argc, char **argv)
+{
+   test_staging_copies();
+
+   printf("%s\n", error ? "FAIL" : "PASS");
+   return error;
+}
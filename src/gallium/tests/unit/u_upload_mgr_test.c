@@ -0,0 +1,293 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Lima Project
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Test case for the ring of upload buffers of u_upload_mgr, against a mock
+ * screen and context, with and without persistent mappings.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_upload_mgr.h"
+
+
+#define BUFFER_SIZE 4096
+
+
+struct pipe_fence_handle {
+   struct pipe_reference reference;
+   boolean signalled;
+};
+
+struct mock_resource {
+   struct pipe_resource base;
+   uint8_t data[BUFFER_SIZE];
+};
+
+
+static boolean persistent;
+static int num_resources, num_transfers, num_fences;
+static int error;
+
+
+#define check(cond) \
+   do { \
+      if (!(cond)) { \
+         fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                 #cond); \
+         error = 1; \
+      } \
+   } while (0)
+
+
+static int
+mock_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return param == PIPE_CAP_BUFFER_MAP_PERSISTENT_COHERENT ? persistent : 0;
+}
+
+
+static struct pipe_resource *
+mock_resource_create(struct pipe_screen *screen,
+                     const struct pipe_resource *templat)
+{
+   struct mock_resource *res = CALLOC_STRUCT(mock_resource);
+
+   if (templat->width0 > BUFFER_SIZE)
+      return NULL;
+
+   res->base = *templat;
+   res->base.screen = screen;
+   pipe_reference_init(&res->base.reference, 1);
+   num_resources++;
+   return &res->base;
+}
+
+
+static void
+mock_resource_destroy(struct pipe_screen *screen, struct pipe_resource *res)
+{
+   FREE(res);
+   num_resources--;
+}
+
+
+static struct pipe_fence_handle *
+mock_fence_create(void)
+{
+   struct pipe_fence_handle *fence = CALLOC_STRUCT(pipe_fence_handle);
+
+   pipe_reference_init(&fence->reference, 1);
+   num_fences++;
+   return fence;
+}
+
+
+static void
+mock_fence_reference(struct pipe_screen *screen,
+                     struct pipe_fence_handle **ptr,
+                     struct pipe_fence_handle *fence)
+{
+   if (pipe_reference(*ptr ? &(*ptr)->reference : NULL,
+                      fence ? &fence->reference : NULL)) {
+      FREE(*ptr);
+      num_fences--;
+   }
+   *ptr = fence;
+}
+
+
+static boolean
+mock_fence_finish(struct pipe_screen *screen, struct pipe_context *ctx,
+                  struct pipe_fence_handle *fence, uint64_t timeout)
+{
+   return fence->signalled;
+}
+
+
+static void *
+mock_transfer_map(struct pipe_context *pipe, struct pipe_resource *resource,
+                  unsigned level, unsigned usage, const struct pipe_box *box,
+                  struct pipe_transfer **out_transfer)
+{
+   struct pipe_transfer *transfer = CALLOC_STRUCT(pipe_transfer);
+
+   check(!(usage & PIPE_TRANSFER_PERSISTENT) == !persistent);
+
+   pipe_resource_reference(&transfer->resource, resource);
+   transfer->usage = usage;
+   transfer->box = *box;
+   *out_transfer = transfer;
+   num_transfers++;
+   return ((struct mock_resource *)resource)->data + box->x;
+}
+
+
+static void
+mock_transfer_flush_region(struct pipe_context *pipe,
+                           struct pipe_transfer *transfer,
+                           const struct pipe_box *box)
+{
+}
+
+
+static void
+mock_transfer_unmap(struct pipe_context *pipe, struct pipe_transfer *transfer)
+{
+   pipe_resource_reference(&transfer->resource, NULL);
+   FREE(transfer);
+   num_transfers--;
+}
+
+
+/* Fills the current upload buffer at once, the next upload needs another
+ * one.  Returns the buffer with a reference.
+ */
+static struct pipe_resource *
+upload_full(struct u_upload_mgr *upload, uint8_t value)
+{
+   struct pipe_resource *buffer = NULL;
+   unsigned offset;
+   void *ptr;
+
+   u_upload_alloc(upload, 0, BUFFER_SIZE, 4, &offset, &buffer, &ptr);
+   check(buffer && ptr && offset == 0);
+   if (!ptr)
+      return buffer;
+
+   memset(ptr, value, BUFFER_SIZE);
+   /* the data lands in the resource, through a new or a kept mapping */
+   check(((struct mock_resource *)buffer)->data[BUFFER_SIZE - 1] == value);
+   u_upload_unmap(upload);
+   return buffer;
+}
+
+
+static void
+test_ring(void)
+{
+   static struct pipe_screen screen;
+   static struct pipe_context pipe;
+   struct pipe_resource *a, *b, *c, *buffer, *old_a, *old_c;
+   struct pipe_fence_handle *f1, *f2, *f3;
+   const struct u_upload_stats *stats;
+   struct u_upload_mgr *upload;
+
+   screen.get_param = mock_get_param;
+   screen.resource_create = mock_resource_create;
+   screen.resource_destroy = mock_resource_destroy;
+   screen.fence_reference = mock_fence_reference;
+   screen.fence_finish = mock_fence_finish;
+   pipe.screen = &screen;
+   pipe.transfer_map = mock_transfer_map;
+   pipe.transfer_flush_region = mock_transfer_flush_region;
+   pipe.transfer_unmap = mock_transfer_unmap;
+
+   upload = u_upload_create(&pipe, BUFFER_SIZE, PIPE_BIND_VERTEX_BUFFER,
+                            PIPE_USAGE_STREAM, 0);
+   u_upload_enable_ring(upload, 2);
+   stats = u_upload_get_stats(upload);
+
+   a = upload_full(upload, 1);
+   check(!u_upload_needs_fence(upload));
+
+   /* a goes to the ring, waiting for a fence */
+   b = upload_full(upload, 2);
+   check(b != a);
+   check(u_upload_needs_fence(upload));
+   f1 = mock_fence_create();
+   u_upload_fence(upload, f1);
+   check(!u_upload_needs_fence(upload));
+
+   /* the GPU isn't done with a */
+   c = upload_full(upload, 3);
+   check(c != a && c != b);
+   f2 = mock_fence_create();
+   u_upload_fence(upload, f2);
+   check(stats->buffers_created == 3 && stats->buffers_recycled == 0);
+
+   /* the oldest idle buffer comes back */
+   f1->signalled = TRUE;
+   old_a = a;
+   pipe_resource_reference(&a, NULL);
+   buffer = upload_full(upload, 4);
+   check(buffer == old_a);
+   pipe_resource_reference(&buffer, NULL);
+   check(stats->buffers_created == 3 && stats->buffers_recycled == 1);
+
+   /* b is idle but still referenced, as if it was bound, so c comes back */
+   f2->signalled = TRUE;
+   f3 = mock_fence_create();
+   f3->signalled = TRUE;
+   u_upload_fence(upload, f3);
+   old_c = c;
+   pipe_resource_reference(&c, NULL);
+   buffer = upload_full(upload, 5);
+   check(buffer == old_c);
+   pipe_resource_reference(&buffer, NULL);
+   check(stats->buffers_created == 3 && stats->buffers_recycled == 2);
+
+   /* without fences, the ring drops its oldest buffers */
+   for (unsigned i = 0; i < 8; i++) {
+      buffer = upload_full(upload, 6 + i);
+      pipe_resource_reference(&buffer, NULL);
+   }
+   check(num_resources <= 2 + 1 + 1); /* the ring, the current one and b */
+   check(stats->bytes == 13 * BUFFER_SIZE);
+
+   u_upload_destroy(upload);
+   pipe_resource_reference(&b, NULL);
+   mock_fence_reference(&screen, &f1, NULL);
+   mock_fence_reference(&screen, &f2, NULL);
+   mock_fence_reference(&screen, &f3, NULL);
+
+   check(num_resources == 0);
+   check(num_transfers == 0);
+   check(num_fences == 0);
+}
+
+
+int main(int argc, char **argv)
+{
+   persistent = FALSE;
+   test_ring();
+   persistent = TRUE;
+   test_ring();
+
+   printf("%s\n", error ? "FAIL" : "PASS");
+   return error;
+}
@@ -0,0 +1,284 @@
+#!/usr/bin/env python2
+##########################################################################
+#
+# Copyright 2018 Lima Project
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sub license, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice (including the
+# next paragraph) shall be included in all copies or substantial portions
+# of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+# OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR
+# ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+'''Decode the binary traces of GALLIUM_TRACE_BINARY, see tr_dump_bin.h.'''
+
+
+import optparse
+import struct
+import sys
+
+
+MAGIC = b'GTRB'
+VERSION = 1
+
+(CALL_BEGIN, CALL_END, ARG_BEGIN, ARG_END, RET_BEGIN, RET_END,
+ BOOL, INT, UINT, FLOAT, BYTES, STRING, ENUM, ARRAY_BEGIN, ARRAY_END,
+ ELEM_BEGIN, ELEM_END, STRUCT_BEGIN, STRUCT_END, MEMBER_BEGIN, MEMBER_END,
+ NULL, PTR) = range(1, 24)
+
+
+class FormatError(Exception):
+    pass
+
+
+class BinaryTraceReader:
+    '''Calls the handler method of each token of the trace.'''
+
+    def __init__(self, stream):
+        self.data = bytearray(stream.read())
+        self.pos = 0
+        self.names = []
+
+    def byte(self):
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def uint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7f) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def int(self):
+        value = self.uint()
+        return (value >> 1) ^ -(value & 1)
+
+    def double(self):
+        value, = struct.unpack('<d', bytes(self.data[self.pos:self.pos + 8]))
+        self.pos += 8
+        return value
+
+    def blob(self):
+        size = self.uint()
+        value = self.data[self.pos:self.pos + size]
+        if len(value) != size:
+            raise IndexError
+        self.pos += size
+        return value
+
+    def name(self):
+        index = self.uint()
+        if index:
+            return self.names[index - 1]
+        name = self.blob().decode('latin-1')
+        self.names.append(name)
+        return name
+
+    def read(self, handler):
+        if self.data[:len(MAGIC)] != MAGIC:
+            raise FormatError('not a binary trace')
+        self.pos = len(MAGIC)
+        if self.uint() != VERSION:
+            raise FormatError('unsupported binary trace version')
+
+        operands = {
+            CALL_BEGIN: lambda: (self.uint(), self.name(), self.name()),
+            CALL_END: lambda: (self.uint(),),
+            ARG_BEGIN: lambda: (self.name(),),
+            BOOL: lambda: (self.uint(),),
+            INT: lambda: (self.int(),),
+            UINT: lambda: (self.uint(),),
+            FLOAT: lambda: (self.double(),),
+            BYTES: lambda: (self.blob(),),
+            STRING: lambda: (self.blob(),),
+            ENUM: lambda: (self.name(),),
+            STRUCT_BEGIN: lambda: (self.name(),),
+            MEMBER_BEGIN: lambda: (self.name(),),
+            PTR: lambda: (self.uint(),),
+        }
+
+        try:
+            while self.pos < len(self.data):
+                op = self.byte()
+                if op < CALL_BEGIN or op > PTR:
+                    raise FormatError('unknown op %u at %u' % (op, self.pos - 1))
+                args = operands[op]() if op in operands else ()
+                handler(op, *args)
+        except IndexError:
+            # the traced process didn't exit cleanly
+            sys.stderr.write('warning: truncated trace\n')
+
+
+def escape(value):
+    if not isinstance(value, bytearray):
+        value = bytearray(value.encode('latin-1'))
+    out = []
+    for c in value:
+        if c == ord('<'):
+            out.append('&lt;')
+        elif c == ord('>'):
+            out.append('&gt;')
+        elif c == ord('&'):
+            out.append('&amp;')
+        elif c == ord('\''):
+            out.append('&apos;')
+        elif c == ord('"'):
+            out.append('&quot;')
+        elif c >= 0x20 and c <= 0x7e:
+            out.append(chr(c))
+        else:
+            out.append('&#%u;' % c)
+    return ''.join(out)
+
+
+class XmlWriter:
+    '''Writes the XML the trace driver writes without GALLIUM_TRACE_BINARY.'''
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.stream.write("<?xml version='1.0' encoding='UTF-8'?>\n")
+        self.stream.write("<?xml-stylesheet type='text/xsl' href='trace.xsl'?>\n")
+        self.stream.write("<trace version='0.1'>\n")
+
+    def __call__(self, op, *args):
+        write = self.stream.write
+        if op == CALL_BEGIN:
+            no, klass, method = args
+            write("\t<call no='%u' class='%s' method='%s'>\n" %
+                  (no, escape(klass), escape(method)))
+        elif op == CALL_END:
+            write('\t\t<time><int>%u</int></time>\n' % args[0])
+            write('\t</call>\n')
+        elif op == ARG_BEGIN:
+            write("\t\t<arg name='%s'>" % escape(args[0]))
+        elif op == ARG_END:
+            write('</arg>\n')
+        elif op == RET_BEGIN:
+            write('\t\t<ret>')
+        elif op == RET_END:
+            write('</ret>\n')
+        elif op == BOOL:
+            write('<bool>%u</bool>' % args[0])
+        elif op == INT:
+            write('<int>%i</int>' % args[0])
+        elif op == UINT:
+            write('<uint>%u</uint>' % args[0])
+        elif op == FLOAT:
+            write('<float>%g</float>' % args[0])
+        elif op == BYTES:
+            write('<bytes>')
+            write(''.join(['%02X' % c for c in args[0]]))
+            write('</bytes>')
+        elif op == STRING:
+            write('<string>%s</string>' % escape(args[0]))
+        elif op == ENUM:
+            write('<enum>%s</enum>' % escape(args[0]))
+        elif op == ARRAY_BEGIN:
+            write('<array>')
+        elif op == ARRAY_END:
+            write('</array>')
+        elif op == ELEM_BEGIN:
+            write('<elem>')
+        elif op == ELEM_END:
+            write('</elem>')
+        elif op == STRUCT_BEGIN:
+            write("<struct name='%s'>" % args[0])
+        elif op == STRUCT_END:
+            write('</struct>')
+        elif op == MEMBER_BEGIN:
+            write("<member name='%s'>" % args[0])
+        elif op == MEMBER_END:
+            write('</member>')
+        elif op == NULL:
+            write('<null/>')
+        elif op == PTR:
+            write('<ptr>0x%08x</ptr>' % args[0])
+
+    def finish(self):
+        self.stream.write('</trace>\n')
+
+
+class StatsWriter:
+    '''Sums up the number of calls and their times per method.'''
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.method = None
+        self.stats = {}
+
+    def __call__(self, op, *args):
+        if op == CALL_BEGIN:
+            self.method = args[1] + '::' + args[2]
+        elif op == CALL_END and self.method is not None:
+            stat = self.stats.setdefault(self.method, [0, 0, 0])
+            stat[0] += 1
+            stat[1] += args[0]
+            stat[2] = max(stat[2], args[0])
+            self.method = None
+
+    def finish(self):
+        write = self.stream.write
+        calls = sum([stat[0] for stat in self.stats.values()])
+        total = sum([stat[1] for stat in self.stats.values()])
+        write('%-48s %10s %12s %10s %10s\n' %
+              ('method', 'calls', 'total (us)', 'mean (us)', 'max (us)'))
+        for method, stat in sorted(self.stats.items(),
+                                   key=lambda item: -item[1][1]):
+            write('%-48s %10u %12u %10.1f %10u\n' %
+                  (method, stat[0], stat[1], float(stat[1]) / stat[0],
+                   stat[2]))
+        write('%-48s %10u %12u\n' % ('total', calls, total))
+
+
+def main():
+    optparser = optparse.OptionParser(
+        usage='\n\t%prog [options] TRACE')
+    optparser.add_option(
+        '-s', '--stats', action='store_true', dest='stats', default=False,
+        help='print the number of calls and their times per method instead of the XML trace')
+    optparser.add_option(
+        '-o', '--output', metavar='FILE', dest='output',
+        help='output file, stdout by default')
+    (options, args) = optparser.parse_args(sys.argv[1:])
+
+    if len(args) != 1:
+        optparser.error('wrong number of arguments')
+
+    output = open(options.output, 'wt') if options.output else sys.stdout
+    if options.stats:
+        writer = StatsWriter(output)
+    else:
+        writer = XmlWriter(output)
+
+    with open(args[0], 'rb') as stream:
+        reader = BinaryTraceReader(stream)
+    try:
+        reader.read(writer)
+    except FormatError as e:
+        sys.stderr.write('error: %s\n' % e)
+        sys.exit(1)
+    writer.finish()
+
+
+if __name__ == '__main__':
+    main()
@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <xf86drm.h>
 
 #include "c11/threads.h"
 #include "util/u_hash_table.h"
@@ -57,28 +58,40 @@ lima_drm_screen_destroy(struct pipe_screen *pscreen)
    }
 }
 
-static unsigned hash_fd(void *key)
+/* The device behind an fd. The card and render nodes of the GPU are
+ * different files, the render node of both identifies the GPU, so that
+ * EGL, GBM and VA share a screen whichever node they opened.
+ */
+static dev_t
+lima_drm_device(int fd)
 {
-   int fd = pointer_to_intptr(key);
+   char *name = drmGetRenderDeviceNameFromFd(fd);
    struct stat stat;
+   int ret = -1;
 
-   fstat(fd, &stat);
+   if (name) {
+      ret = stat(name, &stat);
+      free(name);
+   }
+   if (ret)
+      ret = fstat(fd, &stat);
 
-   return stat.st_dev ^ stat.st_ino ^ stat.st_rdev;
+   return ret ? 0 : stat.st_rdev;
+}
+
+static unsigned hash_fd(void *key)
+{
+   dev_t dev = lima_drm_device(pointer_to_intptr(key));
+
+   return dev ^ ((uint64_t)dev >> 32);
 }
 
 static int compare_fd(void *key1, void *key2)
 {
    int fd1 = pointer_to_intptr(key1);
    int fd2 = pointer_to_intptr(key2);
-   struct stat stat1, stat2;
-
-   fstat(fd1, &stat1);
-   fstat(fd2, &stat2);
 
-   return stat1.st_dev != stat2.st_dev ||
-          stat1.st_ino != stat2.st_ino ||
-          stat1.st_rdev != stat2.st_rdev;
+   return lima_drm_device(fd1) != lima_drm_device(fd2);
 }
 
 struct pipe_screen *
@@ -49,7 +49,9 @@
 #include "gbmint.h"
 #include "loader.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/macros.h"
+#include "util/os_time.h"
 
 /* For importing wl_buffer */
 #if HAVE_WAYLAND_PLATFORM
@@ -64,6 +66,9 @@
 #define DRM_FORMAT_MOD_LINEAR 0
 #endif
 
+/* How long a released BO is kept for reuse */
+#define GBM_DRI_BO_CACHE_TIMEOUT_NS (1000 * 1000 * 1000LL)
+
 static __DRIimage *
 dri_lookup_egl_image(__DRIscreen *screen, void *image, void *data)
 {
@@ -715,6 +720,9 @@ gbm_dri_bo_get_fd(struct gbm_bo *_bo)
    if (!dri->image->queryImage(bo->image, __DRI_IMAGE_ATTRIB_FD, &fd))
       return -1;
 
+   /* another process may still use it after it is destroyed */
+   bo->exported = true;
+
    return fd;
 }
 
@@ -889,10 +897,8 @@ gbm_dri_bo_get_modifier(struct gbm_bo *_bo)
 }
 
 static void
-gbm_dri_bo_destroy(struct gbm_bo *_bo)
+gbm_dri_bo_free(struct gbm_dri_device *dri, struct gbm_dri_bo *bo)
 {
-   struct gbm_dri_device *dri = gbm_dri_device(_bo->gbm);
-   struct gbm_dri_bo *bo = gbm_dri_bo(_bo);
    struct drm_mode_destroy_dumb arg;
 
    if (bo->image != NULL) {
@@ -907,6 +913,86 @@ gbm_dri_bo_destroy(struct gbm_bo *_bo)
    free(bo);
 }
 
+/* Drops the cached BOs past their timeout and, the oldest first, past the
+ * cache size. Called with the device mutex held.
+ */
+static void
+gbm_dri_bo_cache_prune(struct gbm_dri_device *dri, unsigned size, int64_t now)
+{
+   list_for_each_entry_safe(struct gbm_dri_bo, bo, &dri->bo_cache,
+                            cache_link) {
+      if (dri->bo_cache_count <= size &&
+          now - bo->cache_time < GBM_DRI_BO_CACHE_TIMEOUT_NS)
+         break;
+
+      list_del(&bo->cache_link);
+      dri->bo_cache_count--;
+      gbm_dri_bo_free(dri, bo);
+   }
+}
+
+static uint32_t
+gbm_dri_modifiers_hash(const uint64_t *modifiers, unsigned count)
+{
+   return count ? _mesa_hash_data(modifiers, count * sizeof(*modifiers)) : 0;
+}
+
+/* Takes the most recently released BO matching the allocation out of the
+ * cache. Its content is that left by its previous user.
+ */
+static struct gbm_dri_bo *
+gbm_dri_bo_cache_get(struct gbm_dri_device *dri,
+                     uint32_t width, uint32_t height,
+                     uint32_t format, uint32_t usage,
+                     const uint64_t *modifiers, unsigned count)
+{
+   uint32_t modifiers_hash = gbm_dri_modifiers_hash(modifiers, count);
+   struct gbm_dri_bo *found = NULL;
+
+   mtx_lock(&dri->mutex);
+   gbm_dri_bo_cache_prune(dri, dri->bo_cache_size, os_time_get_nano());
+
+   list_for_each_entry_rev(struct gbm_dri_bo, bo, &dri->bo_cache,
+                           cache_link) {
+      if (bo->base.width == width && bo->base.height == height &&
+          bo->base.format == format && bo->usage == usage &&
+          bo->num_modifiers == count &&
+          bo->modifiers_hash == modifiers_hash) {
+         list_del(&bo->cache_link);
+         dri->bo_cache_count--;
+         found = bo;
+         break;
+      }
+   }
+   mtx_unlock(&dri->mutex);
+
+   if (found) {
+      found->base.user_data = NULL;
+      found->base.destroy_user_data = NULL;
+   }
+
+   return found;
+}
+
+static void
+gbm_dri_bo_destroy(struct gbm_bo *_bo)
+{
+   struct gbm_dri_device *dri = gbm_dri_device(_bo->gbm);
+   struct gbm_dri_bo *bo = gbm_dri_bo(_bo);
+
+   if (dri->bo_cache_size && bo->cacheable && !bo->exported) {
+      mtx_lock(&dri->mutex);
+      bo->cache_time = os_time_get_nano();
+      list_addtail(&bo->cache_link, &dri->bo_cache);
+      dri->bo_cache_count++;
+      gbm_dri_bo_cache_prune(dri, dri->bo_cache_size, bo->cache_time);
+      mtx_unlock(&dri->mutex);
+      return;
+   }
+
+   gbm_dri_bo_free(dri, bo);
+}
+
 static struct gbm_bo *
 gbm_dri_bo_import(struct gbm_device *gbm,
                   uint32_t type, void *buffer, uint32_t usage)
@@ -1152,6 +1238,13 @@ gbm_dri_bo_create(struct gbm_device *gbm,
    if (usage & GBM_BO_USE_WRITE || dri->image == NULL)
       return create_dumb(gbm, width, height, format, usage);
 
+   if (dri->bo_cache_size) {
+      bo = gbm_dri_bo_cache_get(dri, width, height, format, usage,
+                                modifiers, count);
+      if (bo)
+         return &bo->base;
+   }
+
    bo = calloc(1, sizeof *bo);
    if (bo == NULL)
       return NULL;
@@ -1221,6 +1314,11 @@ gbm_dri_bo_create(struct gbm_device *gbm,
    dri->image->queryImage(bo->image, __DRI_IMAGE_ATTRIB_STRIDE,
                           (int *) &bo->base.stride);
 
+   bo->cacheable = true;
+   bo->usage = usage;
+   bo->num_modifiers = count;
+   bo->modifiers_hash = gbm_dri_modifiers_hash(modifiers, count);
+
    return &bo->base;
 
 failed:
@@ -1369,6 +1467,8 @@ dri_destroy(struct gbm_device *gbm)
    struct gbm_dri_device *dri = gbm_dri_device(gbm);
    unsigned i;
 
+   gbm_dri_bo_cache_prune(dri, 0, INT64_MAX);
+
    if (dri->context)
       dri->core->destroyContext(dri->context);
 
@@ -1420,6 +1520,12 @@ dri_device_create(int fd)
 
    mtx_init(&dri->mutex, mtx_plain);
 
+   /* Number of released BOs kept for reuse. Only for the users which don't
+    * destroy a BO the display or another device may still access.
+    */
+   list_inithead(&dri->bo_cache);
+   dri->bo_cache_size = env_var_as_unsigned("GBM_BO_CACHE_SIZE", 0);
+
    force_sw = env_var_as_boolean("GBM_ALWAYS_SOFTWARE", false);
    if (!force_sw) {
       ret = dri_screen_create(dri);
@@ -29,10 +29,12 @@
 #define _GBM_DRI_INTERNAL_H_
 
 #include <xf86drm.h>
+#include <stdbool.h>
 #include <string.h>
 #include <sys/mman.h>
 #include "gbmint.h"
 #include "c11/threads.h"
+#include "util/list.h"
 
 #include <GL/gl.h> /* dri_interface needs GL types */
 #include "GL/internal/dri_interface.h"
@@ -111,6 +113,10 @@ struct gbm_dri_device {
 
    const struct gbm_dri_visual *visual_table;
    int num_visuals;
+
+   /* Released BOs kept for reuse, the oldest first, see GBM_BO_CACHE_SIZE */
+   struct list_head bo_cache;
+   unsigned bo_cache_size, bo_cache_count;
 };
 
 struct gbm_dri_bo {
@@ -121,6 +127,14 @@ struct gbm_dri_bo {
    /* Used for cursors and the swrast front BO */
    uint32_t handle, size;
    void *map;
+
+   /* The allocation the BO cache matches, for the BOs it can take */
+   bool cacheable, exported;
+   uint32_t usage;
+   unsigned num_modifiers;
+   uint32_t modifiers_hash;
+   struct list_head cache_link;
+   int64_t cache_time;
 };
 
 struct gbm_dri_surface {
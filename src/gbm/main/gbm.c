@@ -695,3 +695,30 @@ gbm_surface_has_free_buffers(struct gbm_surface *surf)
 {
    return surf->gbm->surface_has_free_buffers(surf);
 }
+
+/**
+ * Get the damage of the swap which presented a locked buffer
+ *
+ * With eglSwapBuffersWithDamageEXT, only the damaged rectangles of the
+ * buffer changed from the previously presented one.  A KMS compositor can
+ * pass them on as the FB_DAMAGE_CLIPS of the plane it shows the buffer on.
+ *
+ * The rectangles are x, y, width, height quadruples with a top-left
+ * origin, unlike the EGL ones.
+ *
+ * \param surf The surface
+ * \param bo A buffer locked with gbm_surface_lock_front_buffer()
+ * \param rects Array receiving up to max_rects rectangles, 4 values each
+ * \param max_rects The size of rects in rectangles
+ * \return The number of damaged rectangles, which may be more than max_rects,
+ * or -1 if the whole buffer has to be considered damaged
+ */
+GBM_EXPORT int
+gbm_surface_get_buffer_damage(struct gbm_surface *surf, struct gbm_bo *bo,
+                              int32_t *rects, int max_rects)
+{
+   if (!surf->gbm->surface_get_buffer_damage)
+      return -1;
+
+   return surf->gbm->surface_get_buffer_damage(surf, bo, rects, max_rects);
+}
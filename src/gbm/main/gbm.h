@@ -396,6 +396,10 @@ gbm_surface_release_buffer(struct gbm_surface *surface, struct gbm_bo *bo);
 int
 gbm_surface_has_free_buffers(struct gbm_surface *surface);
 
+int
+gbm_surface_get_buffer_damage(struct gbm_surface *surface, struct gbm_bo *bo,
+                              int32_t *rects, int max_rects);
+
 void
 gbm_surface_destroy(struct gbm_surface *surface);
 
@@ -97,6 +97,9 @@ struct gbm_device {
    void (*surface_release_buffer)(struct gbm_surface *surface,
                                   struct gbm_bo *bo);
    int (*surface_has_free_buffers)(struct gbm_surface *surface);
+   int (*surface_get_buffer_damage)(struct gbm_surface *surface,
+                                    struct gbm_bo *bo,
+                                    int32_t *rects, int max_rects);
    void (*surface_destroy)(struct gbm_surface *surface);
 };
 
@@ -195,13 +195,58 @@ dri3_fence_await(xcb_connection_t *c, struct loader_dri3_drawable *draw,
    }
 }
 
+/* Swaps after which a back buffer which stayed idle is freed */
+#define DRI3_SHRINK_IDLE_SWAPS 120
+
+static void
+dri3_update_max_num_back(struct loader_dri3_drawable *draw)
+{
+   switch (draw->last_present_mode) {
+   case XCB_PRESENT_COMPLETE_MODE_FLIP:
+      /* One more buffer being scanned out, and without vsync one to render
+       * to while a flip is queued.
+       */
+      draw->max_num_back = draw->swap_interval == 0 ? 4 : 3;
+      break;
+   case XCB_PRESENT_COMPLETE_MODE_SKIP:
+      break;
+   default:
+      draw->max_num_back = 2;
+      break;
+   }
+
+   if (draw->num_back > draw->max_num_back)
+      draw->num_back = draw->max_num_back;
+}
+
+/* Gives up the last back buffer when at least two have stayed idle for
+ * DRI3_SHRINK_IDLE_SWAPS swaps. Called after a present, with the mutex held.
+ */
 static void
 dri3_update_num_back(struct loader_dri3_drawable *draw)
 {
-   if (draw->last_present_mode == XCB_PRESENT_COMPLETE_MODE_FLIP)
-      draw->num_back = 3;
-   else
-      draw->num_back = 2;
+   int last = LOADER_DRI3_BACK_ID(draw->num_back - 1);
+   int num_busy = 0;
+
+   for (int b = 0; b < draw->num_back; b++) {
+      struct loader_dri3_buffer *buffer = draw->buffers[LOADER_DRI3_BACK_ID(b)];
+
+      if (buffer && buffer->busy)
+         num_busy++;
+   }
+
+   if (draw->num_back <= 2 || num_busy > draw->num_back - 2) {
+      draw->num_idle_swaps = 0;
+      return;
+   }
+
+   if (++draw->num_idle_swaps < DRI3_SHRINK_IDLE_SWAPS ||
+       draw->cur_back == last || draw->cur_blit_source == last)
+      return;
+
+   /* it is freed with the next buffers request */
+   draw->num_back--;
+   draw->num_idle_swaps = 0;
 }
 
 void
@@ -305,7 +350,8 @@ loader_dri3_drawable_init(xcb_connection_t *conn,
    }
    draw->swap_interval = swap_interval;
 
-   dri3_update_num_back(draw);
+   draw->num_back = 2;
+   dri3_update_max_num_back(draw);
 
    /* Create a new drawable */
    draw->dri_drawable =
@@ -569,6 +615,17 @@ dri3_find_back(struct loader_dri3_drawable *draw)
             return id;
          }
       }
+
+      /* Rather than waiting for the server to release one, render to a new
+       * buffer while the presents are in flight.
+       */
+      if (num_to_consider == draw->num_back &&
+          draw->num_back < draw->max_num_back) {
+         num_to_consider = ++draw->num_back;
+         draw->num_idle_swaps = 0;
+         continue;
+      }
+
       if (!dri3_wait_for_event_locked(draw)) {
          mtx_unlock(&draw->mtx);
          return -1;
@@ -942,6 +999,8 @@ loader_dri3_swap_buffers_msc(struct loader_dri3_drawable *draw,
       xcb_flush(draw->conn);
       if (draw->stamp)
          ++(*draw->stamp);
+
+      dri3_update_num_back(draw);
    }
    mtx_unlock(&draw->mtx);
 
@@ -1817,7 +1876,7 @@ loader_dri3_get_buffers(__DRIdrawable *driDrawable,
    if (!dri3_update_drawable(driDrawable, draw))
       return false;
 
-   dri3_update_num_back(draw);
+   dri3_update_max_num_back(draw);
 
    /* Free no longer needed back buffers */
    for (buf_id = draw->num_back; buf_id < LOADER_DRI3_MAX_BACK; buf_id++) {
@@ -144,9 +144,15 @@ struct loader_dri3_drawable {
 
    struct loader_dri3_buffer *buffers[LOADER_DRI3_NUM_BUFFERS];
    int cur_back;
-   int num_back;
    int cur_blit_source;
 
+   /* Back buffers in use, grown up to max_num_back when none is idle and
+    * shrunk once one has stayed unused for a while.
+    */
+   int num_back;
+   int max_num_back;
+   unsigned num_idle_swaps;
+
    uint32_t *stamp;
 
    xcb_present_event_t eid;
@@ -96,7 +96,7 @@ class PrintCode(gl_XML.gl_print_base):
         out('{')
         with indent():
             out('GET_CURRENT_CONTEXT(ctx);')
-            out('_mesa_glthread_finish(ctx);')
+            out('_mesa_glthread_finish_before(ctx, "{0}");'.format(func.name))
             out('debug_print_sync("{0}");'.format(func.name))
             self.print_sync_call(func)
         out('}')
@@ -246,12 +246,24 @@ class PrintCode(gl_XML.gl_print_base):
             if func.marshal_fail:
                 out('if ({0}) {{'.format(func.marshal_fail))
                 with indent():
-                    out('_mesa_glthread_finish(ctx);')
+                    out('_mesa_glthread_finish_before(ctx, "{0}");'.format(
+                        func.name))
                     out('_mesa_glthread_restore_dispatch(ctx);')
                     self.print_sync_dispatch(func)
                     out('return;')
                 out('}')
 
+            if func.marshal == 'draw':
+                # The draws of user vertex arrays which aren't copied to
+                # the batch by a custom marshal function.
+                out('if (_mesa_glthread_has_user_arrays(ctx)) {')
+                with indent():
+                    out('_mesa_glthread_finish_before(ctx, "{0}");'.format(
+                        func.name))
+                    self.print_sync_dispatch(func)
+                    out('return;')
+                out('}')
+
             out('if (cmd_size <= MARSHAL_MAX_CMD_SIZE) {')
             with indent():
                 self.print_async_dispatch(func)
@@ -262,7 +274,7 @@ class PrintCode(gl_XML.gl_print_base):
         if need_fallback_sync:
             out('fallback_to_sync:')
         with indent():
-            out('_mesa_glthread_finish(ctx);')
+            out('_mesa_glthread_finish_before(ctx, "{0}");'.format(func.name))
             self.print_sync_dispatch(func)
 
         out('}')
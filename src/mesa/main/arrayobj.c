@@ -415,6 +415,7 @@ _mesa_initialize_vao(struct gl_context *ctx,
 
    vao->RefCount = 1;
    vao->SharedAndImmutable = false;
+   _mesa_update_vao_stamp(vao);
 
    /* Init the individual arrays */
    for (i = 0; i < ARRAY_SIZE(vao->VertexAttrib); i++) {
@@ -461,6 +462,8 @@ _mesa_update_vao_derived_arrays(struct gl_context *ctx,
    /* Make sure we do not run into problems with shared objects */
    assert(!vao->SharedAndImmutable || vao->NewArrays == 0);
 
+   _mesa_update_vao_stamp(vao);
+
    /*
     * Stay tuned, the next series scans for duplicate bindings in this
     * function. So that drivers can easily know the minimum unique set
@@ -469,6 +472,18 @@ _mesa_update_vao_derived_arrays(struct gl_context *ctx,
 }
 
 
+/* Shared by all the contexts, so that a VAO allocated in place of a deleted
+ * one doesn't get its stamp.
+ */
+static GLuint vao_stamp;
+
+void
+_mesa_update_vao_stamp(struct gl_vertex_array_object *vao)
+{
+   vao->Stamp = p_atomic_inc_return(&vao_stamp);
+}
+
+
 void
 _mesa_set_vao_immutable(struct gl_context *ctx,
                         struct gl_vertex_array_object *vao)
@@ -82,6 +82,13 @@ _mesa_update_vao_derived_arrays(struct gl_context *ctx,
                                 struct gl_vertex_array_object *vao);
 
 
+/**
+ * Give the vao a new Stamp.
+ */
+extern void
+_mesa_update_vao_stamp(struct gl_vertex_array_object *vao);
+
+
 /**
  * Mark the vao as shared and immutable, do remaining updates.
  */
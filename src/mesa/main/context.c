@@ -1252,9 +1252,9 @@ _mesa_initialize_context(struct gl_context *ctx,
 
    switch (ctx->API) {
    case API_OPENGL_COMPAT:
+      /* ctx->Save is only allocated by the first glNewList */
       ctx->BeginEnd = create_beginend_table(ctx);
-      ctx->Save = _mesa_alloc_dispatch_table();
-      if (!ctx->BeginEnd || !ctx->Save)
+      if (!ctx->BeginEnd)
          goto fail;
 
       /* fall-through */
@@ -62,6 +62,7 @@
 #include "texstorage.h"
 #include "mtypes.h"
 #include "varray.h"
+#include "vtxfmt.h"
 #include "arbprogram.h"
 #include "transformfeedback.h"
 
@@ -9280,6 +9281,27 @@ _mesa_GenLists(GLsizei range)
 }
 
 
+/**
+ * Set up the dispatch table for display list compilation. Most contexts
+ * never compile a list, it's done by the first glNewList rather than at
+ * context creation.
+ */
+static bool
+init_save_dispatch(struct gl_context *ctx)
+{
+   if (ctx->Save)
+      return true;
+
+   ctx->Save = _mesa_alloc_dispatch_table();
+   if (!ctx->Save)
+      return false;
+
+   _mesa_initialize_save_table(ctx);
+   _mesa_install_save_vtxfmt(ctx, &ctx->ListState.ListVtxfmt);
+   return true;
+}
+
+
 /**
  * Begin a new display list.
  */
@@ -9311,6 +9333,11 @@ _mesa_NewList(GLuint name, GLenum mode)
       return;
    }
 
+   if (!init_save_dispatch(ctx)) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glNewList");
+      return;
+   }
+
    ctx->CompileFlag = GL_TRUE;
    ctx->ExecuteFlag = (mode == GL_COMPILE_AND_EXECUTE);
 
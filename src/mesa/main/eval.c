@@ -85,6 +85,8 @@ GLuint _mesa_evaluator_components( GLenum target )
 static struct gl_1d_map *
 get_1d_map( struct gl_context *ctx, GLenum target )
 {
+   _mesa_init_eval_maps(ctx);
+
    switch (target) {
       case GL_MAP1_VERTEX_3:
          return &ctx->EvalMap.Map1Vertex3;
@@ -116,6 +118,8 @@ get_1d_map( struct gl_context *ctx, GLenum target )
 static struct gl_2d_map *
 get_2d_map( struct gl_context *ctx, GLenum target )
 {
+   _mesa_init_eval_maps(ctx);
+
    switch (target) {
       case GL_MAP2_VERTEX_3:
          return &ctx->EvalMap.Map2Vertex3;
@@ -908,6 +912,21 @@ void _mesa_init_eval( struct gl_context *ctx )
    ctx->Eval.MapGrid2v1 = 0.0;
    ctx->Eval.MapGrid2v2 = 1.0;
 
+   /* The evaluator data is set up on first use, few contexts need it */
+   ctx->EvalMap.Initialized = GL_FALSE;
+}
+
+
+/**
+ * Give the evaluator maps their initial control points, if not done yet.
+ * To be called before accessing ctx->EvalMap.
+ */
+void _mesa_init_eval_maps( struct gl_context *ctx )
+{
+   if (ctx->EvalMap.Initialized)
+      return;
+   ctx->EvalMap.Initialized = GL_TRUE;
+
    /* Evaluator data */
    {
       static GLfloat vertex[4] = { 0.0, 0.0, 0.0, 1.0 };
@@ -1143,22 +1143,26 @@ extern "C" {
 struct gl_shader_program *
 _mesa_get_fixed_func_fragment_program(struct gl_context *ctx)
 {
+   struct gl_shared_state *shared = ctx->Shared;
    struct gl_shader_program *shader_program;
    struct state_key key;
    GLuint keySize;
 
    keySize = make_state_key(ctx, &key);
 
+   /* The cache is shared by the contexts sharing objects. */
+   simple_mtx_lock(&shared->FixedFuncMutex);
    shader_program = (struct gl_shader_program *)
-      _mesa_search_program_cache(ctx->FragmentProgram.Cache,
+      _mesa_search_program_cache(shared->FixedFuncFragmentShaders,
                                  &key, keySize);
 
    if (!shader_program) {
       shader_program = create_new_program(ctx, &key);
 
-      _mesa_shader_cache_insert(ctx, ctx->FragmentProgram.Cache,
+      _mesa_shader_cache_insert(ctx, shared->FixedFuncFragmentShaders,
 				&key, keySize, shader_program);
    }
+   simple_mtx_unlock(&shared->FixedFuncMutex);
 
    return shader_program;
 }
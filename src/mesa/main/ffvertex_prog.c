@@ -1645,6 +1645,7 @@ create_new_program( const struct state_key *key,
 struct gl_program *
 _mesa_get_fixed_func_vertex_program(struct gl_context *ctx)
 {
+   struct gl_shared_state *shared = ctx->Shared;
    struct gl_program *prog;
    struct state_key key;
 
@@ -1652,9 +1653,11 @@ _mesa_get_fixed_func_vertex_program(struct gl_context *ctx)
     */
    make_state_key(ctx, &key);
 
-   /* Look for an already-prepared program for this state:
+   /* Look for an already-prepared program for this state, which any of the
+    * contexts sharing objects with this one may have built:
     */
-   prog = _mesa_search_program_cache(ctx->VertexProgram.Cache, &key,
+   simple_mtx_lock(&shared->FixedFuncMutex);
+   prog = _mesa_search_program_cache(shared->FixedFuncVertexPrograms, &key,
                                      sizeof(key));
 
    if (!prog) {
@@ -1663,8 +1666,10 @@ _mesa_get_fixed_func_vertex_program(struct gl_context *ctx)
          printf("Build new TNL program\n");
 
       prog = ctx->Driver.NewProgram(ctx, GL_VERTEX_PROGRAM_ARB, 0, true);
-      if (!prog)
+      if (!prog) {
+         simple_mtx_unlock(&shared->FixedFuncMutex);
          return NULL;
+      }
 
       create_new_program( &key, prog,
                           ctx->Const.ShaderCompilerOptions[MESA_SHADER_VERTEX].OptimizeForAOS,
@@ -1673,9 +1678,10 @@ _mesa_get_fixed_func_vertex_program(struct gl_context *ctx)
       if (ctx->Driver.ProgramStringNotify)
          ctx->Driver.ProgramStringNotify(ctx, GL_VERTEX_PROGRAM_ARB, prog);
 
-      _mesa_program_cache_insert(ctx, ctx->VertexProgram.Cache, &key,
+      _mesa_program_cache_insert(ctx, shared->FixedFuncVertexPrograms, &key,
                                  sizeof(key), prog);
    }
+   simple_mtx_unlock(&shared->FixedFuncMutex);
 
    return prog;
 }
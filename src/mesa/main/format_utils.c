@@ -27,6 +27,9 @@
 #include "glformats.h"
 #include "format_pack.h"
 #include "format_unpack.h"
+#include "neon_format_utils.h"
+#include "sse_format_utils.h"
+#include "x86/common_x86_asm.h"
 
 const mesa_array_format RGBA32_FLOAT =
    MESA_ARRAY_FORMAT(4, 1, 1, 1, 4, 0, 1, 2, 3);
@@ -181,6 +184,123 @@ _mesa_compute_rgba2base2rgba_component_mapping(GLenum baseFormat, uint8_t *map)
 }
 
 
+/**
+ * Swizzle-and-convert of ubyte pixels to 4 channels with the SIMD
+ * instructions of the CPU.  Returns the number of pixels done, the rest is
+ * left to the scalar code.
+ */
+static unsigned
+swizzle_ubyte_rgba_simd(uint8_t *dst, const uint8_t *src,
+                        int num_src_channels, const uint8_t swizzle[4],
+                        uint8_t one, unsigned count)
+{
+#if defined(USE_SSE41)
+   if (cpu_has_sse4_1) {
+      return _mesa_swizzle_ubyte_rgba_sse41(dst, src, num_src_channels,
+                                            swizzle, one, count);
+   }
+#endif
+#if defined(HAVE_NEON_FORMAT_UTILS)
+   return _mesa_swizzle_ubyte_rgba_neon(dst, src, num_src_channels,
+                                        swizzle, one, count);
+#endif
+   return 0;
+}
+
+/**
+ * Pack a row of RGBA8 pixels to the 16 bit formats of the SIMD kernels,
+ * as _mesa_pack_ubyte_rgba_row.  Returns the number of pixels done.
+ */
+static unsigned
+pack_ubyte_rgba_row_simd(mesa_format format, unsigned n,
+                         const uint8_t src[][4], void *dst)
+{
+#if defined(USE_SSE41)
+   if (cpu_has_sse4_1) {
+      switch (format) {
+      case MESA_FORMAT_B5G6R5_UNORM:
+         return _mesa_pack_ubyte_rgba_b5g6r5_sse41(dst, src[0], n);
+      case MESA_FORMAT_B4G4R4A4_UNORM:
+         return _mesa_pack_ubyte_rgba_b4g4r4a4_sse41(dst, src[0], n);
+      default:
+         return 0;
+      }
+   }
+#endif
+#if defined(HAVE_NEON_FORMAT_UTILS)
+   switch (format) {
+   case MESA_FORMAT_B5G6R5_UNORM:
+      return _mesa_pack_ubyte_rgba_b5g6r5_neon(dst, src[0], n);
+   case MESA_FORMAT_B4G4R4A4_UNORM:
+      return _mesa_pack_ubyte_rgba_b4g4r4a4_neon(dst, src[0], n);
+   default:
+      return 0;
+   }
+#endif
+   return 0;
+}
+
+/**
+ * Unpack a row of the 16 bit formats of the SIMD kernels to RGBA8 pixels,
+ * as _mesa_unpack_ubyte_rgba_row.  Returns the number of pixels done.
+ */
+static unsigned
+unpack_ubyte_rgba_row_simd(mesa_format format, unsigned n,
+                           const void *src, uint8_t dst[][4])
+{
+#if defined(USE_SSE41)
+   if (cpu_has_sse4_1) {
+      switch (format) {
+      case MESA_FORMAT_B5G6R5_UNORM:
+         return _mesa_unpack_ubyte_rgba_b5g6r5_sse41(dst[0], src, n);
+      case MESA_FORMAT_B4G4R4A4_UNORM:
+         return _mesa_unpack_ubyte_rgba_b4g4r4a4_sse41(dst[0], src, n);
+      default:
+         return 0;
+      }
+   }
+#endif
+#if defined(HAVE_NEON_FORMAT_UTILS)
+   switch (format) {
+   case MESA_FORMAT_B5G6R5_UNORM:
+      return _mesa_unpack_ubyte_rgba_b5g6r5_neon(dst[0], src, n);
+   case MESA_FORMAT_B4G4R4A4_UNORM:
+      return _mesa_unpack_ubyte_rgba_b4g4r4a4_neon(dst[0], src, n);
+   default:
+      return 0;
+   }
+#endif
+   return 0;
+}
+
+static void
+pack_ubyte_rgba_row(mesa_format format, unsigned n, const uint8_t src[][4],
+                    void *dst)
+{
+   unsigned done = pack_ubyte_rgba_row_simd(format, n, src, dst);
+
+   if (done < n) {
+      _mesa_pack_ubyte_rgba_row(format, n - done, src + done,
+                                (uint8_t *) dst +
+                                done * _mesa_get_format_bytes(format));
+   }
+}
+
+static void
+unpack_ubyte_rgba_row(mesa_format format, unsigned n, const void *src,
+                      uint8_t dst[][4])
+{
+   unsigned done = unpack_ubyte_rgba_row_simd(format, n, src, dst);
+
+   if (done < n) {
+      _mesa_unpack_ubyte_rgba_row(format, n - done,
+                                  (const uint8_t *) src +
+                                  done * _mesa_get_format_bytes(format),
+                                  dst + done);
+   }
+}
+
+
 /**
  * Special case conversion function to swap r/b channels from the source
  * image to the dest image.
@@ -340,8 +460,8 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
          } else if (dst_array_format == RGBA8_UBYTE) {
             assert(!_mesa_is_format_integer_color(src_format));
             for (row = 0; row < height; ++row) {
-               _mesa_unpack_ubyte_rgba_row(src_format, width,
-                                           src, (uint8_t (*)[4])dst);
+               unpack_ubyte_rgba_row(src_format, width,
+                                     src, (uint8_t (*)[4])dst);
                src += src_stride;
                dst += dst_stride;
             }
@@ -373,13 +493,24 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
             assert(!_mesa_is_format_integer_color(dst_format));
 
             if (dst_format == MESA_FORMAT_B8G8R8A8_UNORM) {
-               convert_ubyte_rgba_to_bgra(width, height, src, src_stride,
-                                          dst, dst_stride);
+               static const uint8_t map_bgra[4] = { 2, 1, 0, 3 };
+
+               for (row = 0; row < height; ++row) {
+                  unsigned done = swizzle_ubyte_rgba_simd(dst, src, 4,
+                                                          map_bgra,
+                                                          UINT8_MAX, width);
+
+                  convert_ubyte_rgba_to_bgra(width - done, 1,
+                                             src + done * 4, src_stride,
+                                             dst + done * 4, dst_stride);
+                  src += src_stride;
+                  dst += dst_stride;
+               }
             }
             else {
                for (row = 0; row < height; ++row) {
-                  _mesa_pack_ubyte_rgba_row(dst_format, width,
-                                            (const uint8_t (*)[4])src, dst);
+                  pack_ubyte_rgba_row(dst_format, width,
+                                      (const uint8_t (*)[4])src, dst);
                   src += src_stride;
                   dst += dst_stride;
                }
@@ -615,8 +746,8 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
          }
       } else {
          for (row = 0; row < height; ++row) {
-            _mesa_unpack_ubyte_rgba_row(src_format, width,
-                                        src, tmp_ubyte + row * width);
+            unpack_ubyte_rgba_row(src_format, width,
+                                  src, tmp_ubyte + row * width);
             if (rebase_swizzle)
                _mesa_swizzle_and_convert(tmp_ubyte + row * width,
                                          MESA_ARRAY_FORMAT_TYPE_UBYTE, 4,
@@ -637,8 +768,8 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
          }
       } else {
          for (row = 0; row < height; ++row) {
-            _mesa_pack_ubyte_rgba_row(dst_format, width,
-                                      (const uint8_t (*)[4])tmp_ubyte + row * width, dst);
+            pack_ubyte_rgba_row(dst_format, width,
+                                (const uint8_t (*)[4])tmp_ubyte + row * width, dst);
             dst += dst_stride;
          }
       }
@@ -1081,6 +1212,15 @@ convert_ubyte(void *void_dst, int num_dst_channels,
       }
       break;
    case MESA_ARRAY_FORMAT_TYPE_UBYTE:
+      if (num_dst_channels == 4) {
+         int done = swizzle_ubyte_rgba_simd(void_dst, void_src,
+                                            num_src_channels, swizzle,
+                                            one, count);
+
+         void_dst = (uint8_t *) void_dst + done * 4;
+         void_src = (const uint8_t *) void_src + done * num_src_channels;
+         count -= done;
+      }
       SWIZZLE_CONVERT(uint8_t, uint8_t, src);
       break;
    case MESA_ARRAY_FORMAT_TYPE_BYTE:
@@ -36,6 +36,8 @@
 #include "main/glthread.h"
 #include "main/marshal.h"
 #include "main/marshal_generated.h"
+#include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/u_atomic.h"
 #include "util/u_thread.h"
 
@@ -91,6 +93,11 @@ _mesa_glthread_init(struct gl_context *ctx)
       util_queue_fence_init(&glthread->batches[i].fence);
    }
 
+   if (env_var_as_boolean("MESA_GLTHREAD_STATS", false)) {
+      glthread->sync_stats = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                                     _mesa_key_pointer_equal);
+   }
+
    glthread->stats.queue = &glthread->queue;
    ctx->CurrentClientDispatch = ctx->MarshalExec;
    ctx->GLThread = glthread;
@@ -104,6 +111,44 @@ _mesa_glthread_init(struct gl_context *ctx)
    util_queue_fence_destroy(&fence);
 }
 
+static int
+compare_sync_stats(const void *a, const void *b)
+{
+   const struct hash_entry *entry_a = *(const struct hash_entry **) a;
+   const struct hash_entry *entry_b = *(const struct hash_entry **) b;
+   uintptr_t count_a = (uintptr_t) entry_a->data;
+   uintptr_t count_b = (uintptr_t) entry_b->data;
+
+   return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+static void
+print_sync_stats(struct glthread_state *glthread)
+{
+   struct hash_table *stats = glthread->sync_stats;
+   struct hash_entry **entries, *entry;
+   unsigned num = 0;
+
+   entries = malloc(stats->entries * sizeof(*entries));
+   if (!entries)
+      return;
+
+   hash_table_foreach(stats, entry)
+      entries[num++] = entry;
+   qsort(entries, num, sizeof(*entries), compare_sync_stats);
+
+   fprintf(stderr, "glthread: %u bytes of commands offloaded, %u executed "
+           "directly, %u syncs\n", glthread->stats.num_offloaded_items,
+           glthread->stats.num_direct_items, glthread->stats.num_syncs);
+   for (unsigned i = 0; i < num; i++) {
+      fprintf(stderr, "glthread: %8u gl%s\n",
+              (unsigned) (uintptr_t) entries[i]->data,
+              (const char *) entries[i]->key);
+   }
+
+   free(entries);
+}
+
 void
 _mesa_glthread_destroy(struct gl_context *ctx)
 {
@@ -115,6 +160,11 @@ _mesa_glthread_destroy(struct gl_context *ctx)
    _mesa_glthread_finish(ctx);
    util_queue_destroy(&glthread->queue);
 
+   if (glthread->sync_stats) {
+      print_sync_stats(glthread);
+      _mesa_hash_table_destroy(glthread->sync_stats, NULL);
+   }
+
    for (unsigned i = 0; i < MARSHAL_MAX_BATCHES; i++)
       util_queue_fence_destroy(&glthread->batches[i].fence);
 
@@ -218,3 +268,28 @@ _mesa_glthread_finish(struct gl_context *ctx)
    if (synced)
       p_atomic_inc(&glthread->stats.num_syncs);
 }
+
+/**
+ * Waits for the batches as _mesa_glthread_finish() before the call of func
+ * is executed on the main thread, and counts it in the sync statistics.
+ */
+void
+_mesa_glthread_finish_before(struct gl_context *ctx, const char *func)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   if (!glthread)
+      return;
+
+   if (glthread->sync_stats &&
+       !u_thread_is_self(glthread->queue.threads[0])) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(glthread->sync_stats, func);
+
+      if (entry)
+         entry->data = (void *) ((uintptr_t) entry->data + 1);
+      else
+         _mesa_hash_table_insert(glthread->sync_stats, func, (void *) 1);
+   }
+
+   _mesa_glthread_finish(ctx);
+}
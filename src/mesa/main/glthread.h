@@ -46,9 +46,26 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include "util/u_queue.h"
+#include "main/config.h"
 
 enum marshal_dispatch_cmd_id;
 struct gl_context;
+struct hash_table;
+
+/**
+ * A generic vertex array of the default vertex array object, as set by the
+ * last glVertexAttribPointer() on the main thread.
+ */
+struct glthread_attrib
+{
+   const void *pointer;
+
+   /** The stride between the vertices, in bytes, never 0. */
+   int stride;
+
+   /** The size of one vertex, 0 if the type or size isn't known. */
+   unsigned element_size;
+};
 
 /** A single batch of commands queued up for execution. */
 struct glthread_batch
@@ -94,6 +111,23 @@ struct glthread_state
     * buffer) binding is in a VBO.
     */
    bool element_array_is_vbo;
+
+   /**
+    * The generic vertex arrays tracked on the main thread, in the contexts
+    * where draws copy the vertices of user arrays to the batch, see
+    * _mesa_glthread_tracks_user_arrays().  Masks of the enabled arrays, of
+    * the ones with user pointers and of the ones with a divisor.
+    */
+   struct glthread_attrib attribs[MAX_VERTEX_GENERIC_ATTRIBS];
+   uint32_t enabled_attribs;
+   uint32_t user_attribs;
+   uint32_t instanced_attribs;
+
+   /**
+    * The number of syncs of each GL function, keyed by its name, NULL if
+    * MESA_GLTHREAD_STATS isn't set.  Printed when the context is destroyed.
+    */
+   struct hash_table *sync_stats;
 };
 
 void _mesa_glthread_init(struct gl_context *ctx);
@@ -102,5 +136,6 @@ void _mesa_glthread_destroy(struct gl_context *ctx);
 void _mesa_glthread_restore_dispatch(struct gl_context *ctx);
 void _mesa_glthread_flush_batch(struct gl_context *ctx);
 void _mesa_glthread_finish(struct gl_context *ctx);
+void _mesa_glthread_finish_before(struct gl_context *ctx, const char *func);
 
 #endif /* _GLTHREAD_H*/
@@ -38,6 +38,82 @@
 #include "glheader.h"
 #include "hash.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
+
+
+#define HASH_DIRECT_MIN_SIZE 64
+#define HASH_DIRECT_MAX_SIZE (16 * 1024)
+
+/**
+ * Array of the data of the keys below its size, indexed by the key.  GL
+ * names are mostly allocated sequentially from 1, so most of them land in
+ * it.  It is read without locking: the writers, which hold the mutex,
+ * replace it by a bigger copy to grow it and keep the previous arrays
+ * alive, for the readers which may still have them, until the table is
+ * deleted.
+ */
+struct _mesa_HashDirect {
+   GLuint Size;
+   struct _mesa_HashDirect *Prev;        /**< the array this one replaced */
+   void *Data[];
+};
+
+
+static struct _mesa_HashDirect *
+hash_direct_create(GLuint size, struct _mesa_HashDirect *prev)
+{
+   struct _mesa_HashDirect *direct =
+      calloc(1, sizeof(*direct) + size * sizeof(direct->Data[0]));
+
+   if (direct) {
+      direct->Size = size;
+      direct->Prev = prev;
+      if (prev)
+         memcpy(direct->Data, prev->Data, prev->Size * sizeof(prev->Data[0]));
+   }
+
+   return direct;
+}
+
+
+/**
+ * Grow the direct array so that it holds key, if the key doesn't make it
+ * much bigger than the keys it already holds.  The keys of the new range
+ * move from the hash table to it.
+ *
+ * \return true if the key is now in the direct array.
+ */
+static bool
+hash_direct_grow(struct _mesa_HashTable *table, GLuint key)
+{
+   struct _mesa_HashDirect *old = table->Direct;
+   struct _mesa_HashDirect *direct;
+
+   if (key >= 2 * old->Size || 2 * old->Size > HASH_DIRECT_MAX_SIZE)
+      return false;
+
+   direct = hash_direct_create(2 * old->Size, old);
+   if (!direct)
+      return false;
+
+   if (_mesa_hash_table_num_entries(table->ht)) {
+      for (GLuint i = old->Size; i < direct->Size; i++) {
+         struct hash_entry *entry =
+            _mesa_hash_table_search_pre_hashed(table->ht, uint_hash(i),
+                                               uint_key(i));
+         if (entry) {
+            direct->Data[i] = entry->data;
+            if (entry->data)
+               table->NumDirect++;
+            _mesa_hash_table_remove(table->ht, entry);
+         }
+      }
+   }
+
+   /* publish the filled array to the readers */
+   p_atomic_set(&table->Direct, direct);
+   return true;
+}
 
 
 /**
@@ -53,7 +129,10 @@ _mesa_NewHashTable(void)
    if (table) {
       table->ht = _mesa_hash_table_create(NULL, uint_key_hash,
                                           uint_key_compare);
-      if (table->ht == NULL) {
+      table->Direct = hash_direct_create(HASH_DIRECT_MIN_SIZE, NULL);
+      if (table->ht == NULL || table->Direct == NULL) {
+         _mesa_hash_table_destroy(table->ht, NULL);
+         free(table->Direct);
          free(table);
          _mesa_error_no_memory(__func__);
          return NULL;
@@ -86,14 +165,22 @@ _mesa_NewHashTable(void)
 void
 _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 {
+   struct _mesa_HashDirect *direct, *prev;
+
    assert(table);
 
-   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL) {
+   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL ||
+       table->NumDirect) {
       _mesa_problem(NULL, "In _mesa_DeleteHashTable, found non-freed data");
    }
 
    _mesa_hash_table_destroy(table->ht, NULL);
 
+   for (direct = table->Direct; direct; direct = prev) {
+      prev = direct->Prev;
+      free(direct);
+   }
+
    mtx_destroy(&table->Mutex);
    free(table);
 }
@@ -107,13 +194,14 @@ _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 static inline void *
 _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 {
+   const struct _mesa_HashDirect *direct = table->Direct;
    const struct hash_entry *entry;
 
    assert(table);
    assert(key);
 
-   if (key == DELETED_KEY_VALUE)
-      return table->deleted_key_data;
+   if (key < direct->Size)
+      return direct->Data[key];
 
    entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                               uint_hash(key),
@@ -127,6 +215,10 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 
 /**
  * Lookup an entry in the hash table.
+ *
+ * The keys in the direct array are looked up without locking.  The others
+ * are looked up again under the lock, since a concurrent insertion may move
+ * them to the direct array.
  * 
  * \param table the hash table.
  * \param key the key.
@@ -136,7 +228,14 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 void *
 _mesa_HashLookup(struct _mesa_HashTable *table, GLuint key)
 {
+   const struct _mesa_HashDirect *direct = p_atomic_read(&table->Direct);
    void *res;
+
+   assert(key);
+
+   if (key < direct->Size)
+      return p_atomic_read(&direct->Data[key]);
+
    _mesa_HashLockMutex(table);
    res = _mesa_HashLookup_unlocked(table, key);
    _mesa_HashUnlockMutex(table);
@@ -174,8 +273,14 @@ _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
    if (key > table->MaxKey)
       table->MaxKey = key;
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = data;
+   if (key < table->Direct->Size || hash_direct_grow(table, key)) {
+      struct _mesa_HashDirect *direct = table->Direct;
+
+      if (!direct->Data[key] && data)
+         table->NumDirect++;
+      else if (direct->Data[key] && !data)
+         table->NumDirect--;
+      p_atomic_set(&direct->Data[key], data);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht, hash, uint_key(key));
       if (entry) {
@@ -244,8 +349,12 @@ _mesa_HashRemove_unlocked(struct _mesa_HashTable *table, GLuint key)
     */
    assert(!table->InDeleteAll);
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = NULL;
+   if (key < table->Direct->Size) {
+      struct _mesa_HashDirect *direct = table->Direct;
+
+      if (direct->Data[key])
+         table->NumDirect--;
+      p_atomic_set(&direct->Data[key], NULL);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                                  uint_hash(key),
@@ -288,14 +397,19 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
    assert(callback);
    _mesa_HashLockMutex(table);
    table->InDeleteAll = GL_TRUE;
+   for (GLuint i = 0; i < table->Direct->Size; i++) {
+      void *data = table->Direct->Data[i];
+
+      if (data) {
+         callback(i, data, userData);
+         p_atomic_set(&table->Direct->Data[i], NULL);
+      }
+   }
+   table->NumDirect = 0;
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
       _mesa_hash_table_remove(table->ht, entry);
    }
-   if (table->deleted_key_data) {
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
-      table->deleted_key_data = NULL;
-   }
    table->InDeleteAll = GL_FALSE;
    _mesa_HashUnlockMutex(table);
 }
@@ -316,12 +430,18 @@ hash_walk_unlocked(const struct _mesa_HashTable *table,
    assert(table);
    assert(callback);
 
+   /* the callback may grow the direct array */
+   for (GLuint i = 0; i < table->Direct->Size; i++) {
+      void *data = table->Direct->Data[i];
+
+      if (data)
+         callback(i, data, userData);
+   }
+
    struct hash_entry *entry;
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
    }
-   if (table->deleted_key_data)
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
 }
 
 
@@ -360,8 +480,6 @@ debug_print_entry(GLuint key, void *data, void *userData)
 void
 _mesa_HashPrint(const struct _mesa_HashTable *table)
 {
-   if (table->deleted_key_data)
-      debug_print_entry(DELETED_KEY_VALUE, table->deleted_key_data, NULL);
    _mesa_HashWalk(table, debug_print_entry, NULL);
 }
 
@@ -418,12 +536,5 @@ _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
 GLuint
 _mesa_HashNumEntries(const struct _mesa_HashTable *table)
 {
-   GLuint count = 0;
-
-   if (table->deleted_key_data)
-      count++;
-
-   count += _mesa_hash_table_num_entries(table->ht);
-
-   return count;
+   return table->NumDirect + _mesa_hash_table_num_entries(table->ht);
 }
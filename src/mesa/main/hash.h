@@ -45,7 +45,7 @@
  * and we use a 1:1 mapping from GLuints to key pointers, so we need to be
  * able to track a GLuint that happens to match the deleted key outside of
  * struct hash_table.  We tell the hash table to use "1" as the deleted key
- * value, so that we test the deleted-key-in-the-table path as best we can.
+ * value, which is always in the direct array.
  */
 #define DELETED_KEY_VALUE 1
 
@@ -93,16 +93,21 @@ uint_key(GLuint id)
 }
 /** @} */
 
+struct _mesa_HashDirect;
+
 /**
  * The hash table data structure.
+ *
+ * The keys below the size of the direct array are stored in it rather than
+ * in the hash table.  _mesa_HashLookup() reads them without locking.
  */
 struct _mesa_HashTable {
    struct hash_table *ht;
+   struct _mesa_HashDirect *Direct;      /**< data of the small keys */
+   GLuint NumDirect;                     /**< non-NULL entries in Direct */
    GLuint MaxKey;                        /**< highest key inserted so far */
    mtx_t Mutex;                          /**< mutual exclusion lock */
    GLboolean InDeleteAll;                /**< Debug check */
-   /** Value that would be in the table for DELETED_KEY_VALUE. */
-   void *deleted_key_data;
 };
 
 extern struct _mesa_HashTable *_mesa_NewHashTable(void);
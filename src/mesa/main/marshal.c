@@ -27,8 +27,10 @@
  * thread when automatic code generation isn't appropriate.
  */
 
+#include "main/bufferobj.h"
 #include "main/enums.h"
 #include "main/macros.h"
+#include "util/bitscan.h"
 #include "marshal.h"
 #include "dispatch.h"
 #include "marshal_generated.h"
@@ -88,7 +90,7 @@ _mesa_marshal_Enable(GLenum cap)
    debug_print_marshal("Enable");
 
    if (cap == GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "Enable");
       _mesa_glthread_restore_dispatch(ctx);
    } else {
       cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_Enable,
@@ -98,7 +100,7 @@ _mesa_marshal_Enable(GLenum cap)
       return;
    }
 
-   _mesa_glthread_finish(ctx);
+   _mesa_glthread_finish_before(ctx, "Enable");
    debug_print_sync_fallback("Enable");
    CALL_Enable(ctx->CurrentServerDispatch, (cap));
 }
@@ -187,7 +189,7 @@ _mesa_marshal_ShaderSource(GLuint shader, GLsizei count,
       }
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ShaderSource");
       CALL_ShaderSource(ctx->CurrentServerDispatch,
                         (shader, count, string, length_tmp));
    }
@@ -283,7 +285,7 @@ _mesa_marshal_BindBuffer(GLenum target, GLuint buffer)
       cmd->buffer = buffer;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "BindBuffer");
       CALL_BindBuffer(ctx->CurrentServerDispatch, (target, buffer));
    }
 }
@@ -326,7 +328,7 @@ _mesa_marshal_BufferData(GLenum target, GLsizeiptr size, const GLvoid * data,
    debug_print_marshal("BufferData");
 
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "BufferData");
       _mesa_error(ctx, GL_INVALID_VALUE, "BufferData(size < 0)");
       return;
    }
@@ -347,7 +349,7 @@ _mesa_marshal_BufferData(GLenum target, GLsizeiptr size, const GLvoid * data,
       }
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "BufferData");
       CALL_BufferData(ctx->CurrentServerDispatch,
                       (target, size, data, usage));
    }
@@ -385,7 +387,7 @@ _mesa_marshal_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
 
    debug_print_marshal("BufferSubData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "BufferSubData");
       _mesa_error(ctx, GL_INVALID_VALUE, "BufferSubData(size < 0)");
       return;
    }
@@ -402,7 +404,7 @@ _mesa_marshal_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
       memcpy(variable_data, data, size);
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "BufferSubData");
       CALL_BufferSubData(ctx->CurrentServerDispatch,
                          (target, offset, size, data));
    }
@@ -446,7 +448,7 @@ _mesa_marshal_NamedBufferData(GLuint buffer, GLsizeiptr size,
 
    debug_print_marshal("NamedBufferData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "NamedBufferData");
       _mesa_error(ctx, GL_INVALID_VALUE, "NamedBufferData(size < 0)");
       return;
    }
@@ -465,7 +467,7 @@ _mesa_marshal_NamedBufferData(GLuint buffer, GLsizeiptr size,
       }
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "NamedBufferData");
       CALL_NamedBufferData(ctx->CurrentServerDispatch,
                            (buffer, size, data, usage));
    }
@@ -503,7 +505,7 @@ _mesa_marshal_NamedBufferSubData(GLuint buffer, GLintptr offset,
 
    debug_print_marshal("NamedBufferSubData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "NamedBufferSubData");
       _mesa_error(ctx, GL_INVALID_VALUE, "NamedBufferSubData(size < 0)");
       return;
    }
@@ -519,7 +521,7 @@ _mesa_marshal_NamedBufferSubData(GLuint buffer, GLintptr offset,
       memcpy(variable_data, data, size);
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "NamedBufferSubData");
       CALL_NamedBufferSubData(ctx->CurrentServerDispatch,
                               (buffer, offset, size, data));
    }
@@ -635,7 +637,7 @@ _mesa_marshal_ClearBufferfv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferfv");
 
    if (!(buffer == GL_DEPTH || buffer == GL_COLOR)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferfv");
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -651,7 +653,7 @@ _mesa_marshal_ClearBufferfv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferfv, buffer,
                                  drawbuffer, (GLuint *)value, size)) {
       debug_print_sync("ClearBufferfv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferfv");
       CALL_ClearBufferfv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -665,7 +667,7 @@ _mesa_marshal_ClearBufferiv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferiv");
 
    if (!(buffer == GL_STENCIL || buffer == GL_COLOR)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferiv");
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -681,7 +683,7 @@ _mesa_marshal_ClearBufferiv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferiv, buffer,
                                  drawbuffer, (GLuint *)value, size)) {
       debug_print_sync("ClearBufferiv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferiv");
       CALL_ClearBufferiv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -695,7 +697,7 @@ _mesa_marshal_ClearBufferuiv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferuiv");
 
    if (buffer != GL_COLOR) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferuiv");
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -710,7 +712,7 @@ _mesa_marshal_ClearBufferuiv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferuiv, buffer,
                                  drawbuffer, (GLuint *)value, 4)) {
       debug_print_sync("ClearBufferuiv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferuiv");
       CALL_ClearBufferuiv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -724,7 +726,7 @@ _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferfi");
 
    if (buffer != GL_DEPTH_STENCIL) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferfi");
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -742,8 +744,630 @@ _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferfi, buffer,
                                  drawbuffer, (GLuint *)value, 2)) {
       debug_print_sync("ClearBufferfi");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_before(ctx, "ClearBufferfi");
       CALL_ClearBufferfi(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, depth, stencil));
    }
 }
+
+
+/**
+ * The size of one vertex of a generic array, 0 for the sizes and types
+ * which generate an error or aren't known here.
+ */
+static unsigned
+vertex_element_size(GLint size, GLenum type)
+{
+   if (size == GL_BGRA)
+      size = 4;
+   if (size < 1 || size > 4)
+      return 0;
+
+   switch (type) {
+   case GL_BYTE:
+   case GL_UNSIGNED_BYTE:
+      return size;
+   case GL_SHORT:
+   case GL_UNSIGNED_SHORT:
+   case GL_HALF_FLOAT:
+   case GL_HALF_FLOAT_OES:
+      return size * 2;
+   case GL_INT:
+   case GL_UNSIGNED_INT:
+   case GL_FLOAT:
+   case GL_FIXED:
+      return size * 4;
+   case GL_DOUBLE:
+      return size * 8;
+   case GL_INT_2_10_10_10_REV:
+   case GL_UNSIGNED_INT_2_10_10_10_REV:
+   case GL_UNSIGNED_INT_10F_11F_11F_REV:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Tracks the generic vertex arrays set with user pointers.  An array the
+ * call may fail to set is tracked as a user array of an unknown size, so
+ * that its draws sync.
+ */
+static void
+track_vertex_attrib_pointer(struct gl_context *ctx, GLuint index, GLint size,
+                            GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (index >= MAX_VERTEX_GENERIC_ATTRIBS)
+      return;
+
+   struct glthread_attrib *attrib = &glthread->attribs[index];
+   const unsigned element_size = vertex_element_size(size, type);
+
+   if (element_size && stride >= 0 && glthread->vertex_array_is_vbo) {
+      glthread->user_attribs &= ~(1u << index);
+      return;
+   }
+
+   attrib->pointer = pointer;
+   attrib->stride = stride ? stride : element_size;
+   attrib->element_size = stride >= 0 ? element_size : 0;
+   glthread->user_attribs |= 1u << index;
+}
+
+/* VertexAttribPointer: marshalled asynchronously */
+struct marshal_cmd_VertexAttribPointer
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint index;
+   GLint size;
+   GLenum type;
+   GLboolean normalized;
+   GLsizei stride;
+   const GLvoid *pointer;
+};
+
+void
+_mesa_unmarshal_VertexAttribPointer(struct gl_context *ctx,
+                                    const struct marshal_cmd_VertexAttribPointer *cmd)
+{
+   CALL_VertexAttribPointer(ctx->CurrentServerDispatch,
+                            (cmd->index, cmd->size, cmd->type,
+                             cmd->normalized, cmd->stride, cmd->pointer));
+}
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribPointer(GLuint index, GLint size, GLenum type,
+                                  GLboolean normalized, GLsizei stride,
+                                  const GLvoid *pointer)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_VertexAttribPointer *cmd;
+   debug_print_marshal("VertexAttribPointer");
+
+   if (_mesa_glthread_tracks_user_arrays(ctx)) {
+      track_vertex_attrib_pointer(ctx, index, size, type, stride, pointer);
+   } else if (_mesa_glthread_is_non_vbo_vertex_attrib_pointer(ctx)) {
+      _mesa_glthread_finish_before(ctx, "VertexAttribPointer");
+      _mesa_glthread_restore_dispatch(ctx);
+      debug_print_sync_fallback("VertexAttribPointer");
+      CALL_VertexAttribPointer(ctx->CurrentServerDispatch,
+                               (index, size, type, normalized, stride,
+                                pointer));
+      return;
+   }
+
+   cmd = _mesa_glthread_allocate_command(ctx,
+                                         DISPATCH_CMD_VertexAttribPointer,
+                                         sizeof(*cmd));
+   cmd->index = index;
+   cmd->size = size;
+   cmd->type = type;
+   cmd->normalized = normalized;
+   cmd->stride = stride;
+   cmd->pointer = pointer;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* VertexAttribIPointer: marshalled asynchronously */
+struct marshal_cmd_VertexAttribIPointer
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint index;
+   GLint size;
+   GLenum type;
+   GLsizei stride;
+   const GLvoid *pointer;
+};
+
+void
+_mesa_unmarshal_VertexAttribIPointer(struct gl_context *ctx,
+                                     const struct marshal_cmd_VertexAttribIPointer *cmd)
+{
+   CALL_VertexAttribIPointer(ctx->CurrentServerDispatch,
+                             (cmd->index, cmd->size, cmd->type, cmd->stride,
+                              cmd->pointer));
+}
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribIPointer(GLuint index, GLint size, GLenum type,
+                                   GLsizei stride, const GLvoid *pointer)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_VertexAttribIPointer *cmd;
+   debug_print_marshal("VertexAttribIPointer");
+
+   if (_mesa_glthread_tracks_user_arrays(ctx)) {
+      track_vertex_attrib_pointer(ctx, index, size, type, stride, pointer);
+   } else if (_mesa_glthread_is_non_vbo_vertex_attrib_pointer(ctx)) {
+      _mesa_glthread_finish_before(ctx, "VertexAttribIPointer");
+      _mesa_glthread_restore_dispatch(ctx);
+      debug_print_sync_fallback("VertexAttribIPointer");
+      CALL_VertexAttribIPointer(ctx->CurrentServerDispatch,
+                                (index, size, type, stride, pointer));
+      return;
+   }
+
+   cmd = _mesa_glthread_allocate_command(ctx,
+                                         DISPATCH_CMD_VertexAttribIPointer,
+                                         sizeof(*cmd));
+   cmd->index = index;
+   cmd->size = size;
+   cmd->type = type;
+   cmd->stride = stride;
+   cmd->pointer = pointer;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* EnableVertexAttribArray, DisableVertexAttribArray: marshalled
+ * asynchronously
+ */
+struct marshal_cmd_VertexAttribArray
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint index;
+};
+
+void
+_mesa_unmarshal_EnableVertexAttribArray(struct gl_context *ctx,
+                                        const struct marshal_cmd_VertexAttribArray *cmd)
+{
+   CALL_EnableVertexAttribArray(ctx->CurrentServerDispatch, (cmd->index));
+}
+
+void GLAPIENTRY
+_mesa_marshal_EnableVertexAttribArray(GLuint index)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_VertexAttribArray *cmd;
+   debug_print_marshal("EnableVertexAttribArray");
+
+   if (index < MAX_VERTEX_GENERIC_ATTRIBS)
+      ctx->GLThread->enabled_attribs |= 1u << index;
+
+   cmd = _mesa_glthread_allocate_command(ctx,
+                                         DISPATCH_CMD_EnableVertexAttribArray,
+                                         sizeof(*cmd));
+   cmd->index = index;
+   _mesa_post_marshal_hook(ctx);
+}
+
+void
+_mesa_unmarshal_DisableVertexAttribArray(struct gl_context *ctx,
+                                         const struct marshal_cmd_VertexAttribArray *cmd)
+{
+   CALL_DisableVertexAttribArray(ctx->CurrentServerDispatch, (cmd->index));
+}
+
+void GLAPIENTRY
+_mesa_marshal_DisableVertexAttribArray(GLuint index)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_VertexAttribArray *cmd;
+   debug_print_marshal("DisableVertexAttribArray");
+
+   if (index < MAX_VERTEX_GENERIC_ATTRIBS)
+      ctx->GLThread->enabled_attribs &= ~(1u << index);
+
+   cmd = _mesa_glthread_allocate_command(ctx,
+                                         DISPATCH_CMD_DisableVertexAttribArray,
+                                         sizeof(*cmd));
+   cmd->index = index;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* VertexAttribDivisor: marshalled asynchronously */
+struct marshal_cmd_VertexAttribDivisor
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint index;
+   GLuint divisor;
+};
+
+void
+_mesa_unmarshal_VertexAttribDivisor(struct gl_context *ctx,
+                                    const struct marshal_cmd_VertexAttribDivisor *cmd)
+{
+   CALL_VertexAttribDivisor(ctx->CurrentServerDispatch,
+                            (cmd->index, cmd->divisor));
+}
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribDivisor(GLuint index, GLuint divisor)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct glthread_state *glthread = ctx->GLThread;
+   struct marshal_cmd_VertexAttribDivisor *cmd;
+   debug_print_marshal("VertexAttribDivisor");
+
+   if (index < MAX_VERTEX_GENERIC_ATTRIBS) {
+      if (divisor)
+         glthread->instanced_attribs |= 1u << index;
+      else
+         glthread->instanced_attribs &= ~(1u << index);
+   }
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_VertexAttribDivisor,
+                                         sizeof(*cmd));
+   cmd->index = index;
+   cmd->divisor = divisor;
+   _mesa_post_marshal_hook(ctx);
+}
+
+
+/**
+ * A user vertex array of a draw, the vertices of which are copied after the
+ * draw command.  The array points to the copy while the draw is executed.
+ */
+struct marshal_user_array
+{
+   GLuint index;
+   GLsizei stride;
+
+   /** The user pointer, restored after the draw. */
+   const GLvoid *pointer;
+
+   /** The offset of the copy from the command, in bytes. */
+   GLuint offset;
+};
+
+/**
+ * Whether the vertices of the enabled user arrays can be copied, which
+ * needs their sizes and no instancing.
+ */
+static bool
+can_copy_user_arrays(const struct glthread_state *glthread)
+{
+   uint32_t mask = glthread->enabled_attribs & glthread->user_attribs;
+
+   if (mask & glthread->instanced_attribs)
+      return false;
+
+   while (mask) {
+      const struct glthread_attrib *attrib =
+         &glthread->attribs[u_bit_scan(&mask)];
+
+      if (!attrib->element_size || !attrib->pointer)
+         return false;
+   }
+
+   return true;
+}
+
+static uint64_t
+user_array_copy_size(const struct glthread_attrib *attrib, unsigned count)
+{
+   return (uint64_t) (count - 1) * attrib->stride + attrib->element_size;
+}
+
+/**
+ * The size of the descriptions and the copies of the enabled user arrays
+ * for count vertices, which is more than MARSHAL_MAX_CMD_SIZE if they don't
+ * fit in a command.
+ */
+static size_t
+user_arrays_size(const struct glthread_state *glthread, unsigned count,
+                 unsigned *num_arrays)
+{
+   uint32_t mask = glthread->enabled_attribs & glthread->user_attribs;
+   uint64_t size = 0;
+
+   *num_arrays = 0;
+   while (mask) {
+      const struct glthread_attrib *attrib =
+         &glthread->attribs[u_bit_scan(&mask)];
+
+      size += sizeof(struct marshal_user_array) +
+              ALIGN(user_array_copy_size(attrib, count), 8);
+      (*num_arrays)++;
+   }
+
+   return MIN2(size, MARSHAL_MAX_CMD_SIZE + 1);
+}
+
+/**
+ * Writes the descriptions of the enabled user arrays at offset in the
+ * command, followed by their vertices [start, start + count).
+ */
+static void
+copy_user_arrays(const struct glthread_state *glthread, void *cmd,
+                 size_t offset, unsigned num_arrays, unsigned start,
+                 unsigned count)
+{
+   struct marshal_user_array *arrays =
+      (struct marshal_user_array *) ((uint8_t *) cmd + offset);
+   uint32_t mask = glthread->enabled_attribs & glthread->user_attribs;
+
+   offset += num_arrays * sizeof(struct marshal_user_array);
+   while (mask) {
+      const unsigned index = u_bit_scan(&mask);
+      const struct glthread_attrib *attrib = &glthread->attribs[index];
+      const size_t size = user_array_copy_size(attrib, count);
+
+      arrays->index = index;
+      arrays->stride = attrib->stride;
+      arrays->pointer = attrib->pointer;
+      arrays->offset = offset;
+      memcpy((uint8_t *) cmd + offset,
+             (const uint8_t *) attrib->pointer + (size_t) start * attrib->stride,
+             size);
+
+      offset += ALIGN(size, 8);
+      arrays++;
+   }
+}
+
+/**
+ * Points the user arrays of a draw to their copies in the command, or back
+ * to the user pointers.  An array which isn't the user array the main
+ * thread tracked is left alone.
+ */
+static void
+set_user_arrays(struct gl_context *ctx, const void *cmd,
+                const struct marshal_user_array *arrays, unsigned num_arrays,
+                unsigned start, bool copies)
+{
+   struct gl_vertex_array_object *vao = ctx->Array.VAO;
+
+   if (!num_arrays || vao != ctx->Array.DefaultVAO)
+      return;
+
+   FLUSH_VERTICES(ctx, _NEW_ARRAY);
+
+   for (unsigned i = 0; i < num_arrays; i++) {
+      const gl_vert_attrib attr = VERT_ATTRIB_GENERIC(arrays[i].index);
+      struct gl_array_attributes *array = &vao->VertexAttrib[attr];
+      const GLubyte *pointer = arrays[i].pointer;
+      const GLubyte *copy = (const GLubyte *) cmd + arrays[i].offset -
+                            (size_t) start * arrays[i].stride;
+
+      if (array->Ptr != (copies ? pointer : copy) ||
+          _mesa_is_bufferobj(vao->BufferBinding[array->BufferBindingIndex].BufferObj))
+         continue;
+
+      array->Ptr = copies ? copy : pointer;
+      vao->NewArrays |= vao->_Enabled & VERT_BIT(attr);
+   }
+}
+
+static unsigned
+draw_index_size(GLenum type)
+{
+   switch (type) {
+   case GL_UNSIGNED_BYTE:
+      return 1;
+   case GL_UNSIGNED_SHORT:
+      return 2;
+   case GL_UNSIGNED_INT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+static void
+get_index_range(const GLvoid *indices, unsigned index_size, unsigned count,
+                unsigned *min_index, unsigned *max_index)
+{
+   unsigned min = ~0u, max = 0;
+
+   for (unsigned i = 0; i < count; i++) {
+      unsigned index;
+
+      if (index_size == 1)
+         index = ((const GLubyte *) indices)[i];
+      else if (index_size == 2)
+         index = ((const GLushort *) indices)[i];
+      else
+         index = ((const GLuint *) indices)[i];
+
+      min = MIN2(min, index);
+      max = MAX2(max, index);
+   }
+
+   *min_index = min;
+   *max_index = max;
+}
+
+/* DrawArrays: marshalled asynchronously, with the vertices of the user
+ * arrays
+ */
+struct marshal_cmd_DrawArrays
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum mode;
+   GLint first;
+   GLsizei count;
+   GLuint num_user_arrays;
+   /* Next, aligned to 8 bytes, num_user_arrays struct marshal_user_array
+    * and the copies of their vertices
+    */
+};
+
+void
+_mesa_unmarshal_DrawArrays(struct gl_context *ctx,
+                           const struct marshal_cmd_DrawArrays *cmd)
+{
+   const struct marshal_user_array *arrays = (const struct marshal_user_array *)
+      ((const uint8_t *) cmd + ALIGN(sizeof(*cmd), 8));
+
+   set_user_arrays(ctx, cmd, arrays, cmd->num_user_arrays, cmd->first, true);
+   CALL_DrawArrays(ctx->CurrentServerDispatch,
+                   (cmd->mode, cmd->first, cmd->count));
+   set_user_arrays(ctx, cmd, arrays, cmd->num_user_arrays, cmd->first, false);
+}
+
+void GLAPIENTRY
+_mesa_marshal_DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct glthread_state *glthread = ctx->GLThread;
+   const size_t arrays_offset = ALIGN(sizeof(struct marshal_cmd_DrawArrays), 8);
+   size_t cmd_size = sizeof(struct marshal_cmd_DrawArrays);
+   unsigned num_user_arrays = 0;
+   struct marshal_cmd_DrawArrays *cmd;
+   debug_print_marshal("DrawArrays");
+
+   if (_mesa_glthread_has_user_arrays(ctx) && count > 0) {
+      /* the errors are generated by the sync call */
+      if (first < 0 || count > MARSHAL_MAX_CMD_SIZE ||
+          !can_copy_user_arrays(glthread))
+         goto fallback_to_sync;
+
+      cmd_size = arrays_offset +
+                 user_arrays_size(glthread, count, &num_user_arrays);
+      if (cmd_size > MARSHAL_MAX_CMD_SIZE)
+         goto fallback_to_sync;
+   }
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_DrawArrays,
+                                         cmd_size);
+   cmd->mode = mode;
+   cmd->first = first;
+   cmd->count = count;
+   cmd->num_user_arrays = num_user_arrays;
+   if (num_user_arrays) {
+      copy_user_arrays(glthread, cmd, arrays_offset, num_user_arrays, first,
+                       count);
+   }
+   _mesa_post_marshal_hook(ctx);
+   return;
+
+fallback_to_sync:
+   _mesa_glthread_finish_before(ctx, "DrawArrays");
+   debug_print_sync_fallback("DrawArrays");
+   CALL_DrawArrays(ctx->CurrentServerDispatch, (mode, first, count));
+}
+
+/* DrawElements: marshalled asynchronously, with the user indices and the
+ * vertices of the user arrays they use
+ */
+struct marshal_cmd_DrawElements
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum mode;
+   GLsizei count;
+   GLenum type;
+   GLuint min_index;
+   GLuint num_user_arrays;
+   bool user_indices; /* If set, the indices follow */
+   const GLvoid *indices;
+   /* Next, aligned to 8 bytes, the user indices, then num_user_arrays
+    * struct marshal_user_array and the copies of their vertices
+    */
+};
+
+void
+_mesa_unmarshal_DrawElements(struct gl_context *ctx,
+                             const struct marshal_cmd_DrawElements *cmd)
+{
+   const uint8_t *variable_data = (const uint8_t *) cmd +
+                                  ALIGN(sizeof(*cmd), 8);
+   const GLvoid *indices = cmd->indices;
+
+   if (cmd->user_indices) {
+      indices = variable_data;
+      variable_data += ALIGN(cmd->count * draw_index_size(cmd->type), 8);
+   }
+
+   const struct marshal_user_array *arrays =
+      (const struct marshal_user_array *) variable_data;
+
+   set_user_arrays(ctx, cmd, arrays, cmd->num_user_arrays, cmd->min_index,
+                   true);
+   CALL_DrawElements(ctx->CurrentServerDispatch,
+                     (cmd->mode, cmd->count, cmd->type, indices));
+   set_user_arrays(ctx, cmd, arrays, cmd->num_user_arrays, cmd->min_index,
+                   false);
+}
+
+void GLAPIENTRY
+_mesa_marshal_DrawElements(GLenum mode, GLsizei count, GLenum type,
+                           const GLvoid *indices)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct glthread_state *glthread = ctx->GLThread;
+   const bool user_indices = _mesa_glthread_is_non_vbo_draw_elements(ctx);
+   const bool user_arrays = _mesa_glthread_has_user_arrays(ctx);
+   const unsigned index_size = draw_index_size(type);
+   size_t cmd_size = ALIGN(sizeof(struct marshal_cmd_DrawElements), 8);
+   unsigned num_user_arrays = 0;
+   unsigned min_index = 0, max_index = 0;
+   struct marshal_cmd_DrawElements *cmd;
+   debug_print_marshal("DrawElements");
+
+   if (user_indices || user_arrays) {
+      /* the errors are generated by the sync call */
+      if (count < 0 || count > MARSHAL_MAX_CMD_SIZE || !index_size ||
+          (user_indices && count && !indices))
+         goto fallback_to_sync;
+   }
+
+   if (user_indices)
+      cmd_size += ALIGN(count * index_size, 8);
+
+   if (user_arrays && count > 0) {
+      /* the indices in a buffer can't be read to find the vertices */
+      if (!user_indices || !can_copy_user_arrays(glthread))
+         goto fallback_to_sync;
+
+      get_index_range(indices, index_size, count, &min_index, &max_index);
+      if (max_index - min_index >= MARSHAL_MAX_CMD_SIZE)
+         goto fallback_to_sync;
+
+      cmd_size += user_arrays_size(glthread, max_index - min_index + 1,
+                                   &num_user_arrays);
+   }
+
+   if (cmd_size > MARSHAL_MAX_CMD_SIZE)
+      goto fallback_to_sync;
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_DrawElements,
+                                         cmd_size);
+   cmd->mode = mode;
+   cmd->count = count;
+   cmd->type = type;
+   cmd->min_index = min_index;
+   cmd->num_user_arrays = num_user_arrays;
+   cmd->user_indices = user_indices;
+   cmd->indices = indices;
+
+   uint8_t *variable_data = (uint8_t *) cmd + ALIGN(sizeof(*cmd), 8);
+   if (user_indices) {
+      memcpy(variable_data, indices, count * index_size);
+      variable_data += ALIGN(count * index_size, 8);
+   }
+   if (num_user_arrays) {
+      copy_user_arrays(glthread, cmd, variable_data - (uint8_t *) cmd,
+                       num_user_arrays, min_index, max_index - min_index + 1);
+   }
+   _mesa_post_marshal_hook(ctx);
+   return;
+
+fallback_to_sync:
+   _mesa_glthread_finish_before(ctx, "DrawElements");
+   debug_print_sync_fallback("DrawElements");
+   CALL_DrawElements(ctx->CurrentServerDispatch,
+                     (mode, count, type, indices));
+}
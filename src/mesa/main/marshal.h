@@ -94,6 +94,44 @@ _mesa_glthread_is_non_vbo_draw_elements(const struct gl_context *ctx)
    return ctx->API != API_OPENGL_CORE && !glthread->element_array_is_vbo;
 }
 
+/**
+ * Whether the main thread tracks the generic vertex arrays, so that the
+ * draws of user arrays copy their vertices to the batch instead of
+ * disabling threading.
+ *
+ * Only in GLES 2 and 3 contexts, where the user arrays can't be pushed and
+ * popped as client attribs and are in the default vertex array object,
+ * since glBindVertexArray() disables threading.
+ */
+static inline bool
+_mesa_glthread_tracks_user_arrays(const struct gl_context *ctx)
+{
+   return ctx->API == API_OPENGLES2;
+}
+
+/**
+ * Whether an enabled generic vertex array is a user array, which the code
+ * generated draws can't marshal.
+ */
+static inline bool
+_mesa_glthread_has_user_arrays(const struct gl_context *ctx)
+{
+   const struct glthread_state *glthread = ctx->GLThread;
+
+   return (glthread->enabled_attribs & glthread->user_attribs) != 0;
+}
+
+/**
+ * The code generated ARB_vertex_attrib_binding calls can set the arrays in
+ * ways the tracking of the user arrays doesn't follow, so they disable
+ * threading once there are user arrays.
+ */
+static inline bool
+_mesa_glthread_is_user_array_attrib_binding(const struct gl_context *ctx)
+{
+   return ctx->GLThread->user_attribs != 0;
+}
+
 #define DEBUG_MARSHAL_PRINT_CALLS 0
 
 /**
@@ -183,6 +221,14 @@ struct marshal_cmd_BufferSubData;
 struct marshal_cmd_NamedBufferData;
 struct marshal_cmd_NamedBufferSubData;
 struct marshal_cmd_ClearBuffer;
+struct marshal_cmd_VertexAttribPointer;
+struct marshal_cmd_VertexAttribIPointer;
+struct marshal_cmd_VertexAttribArray;
+#define marshal_cmd_EnableVertexAttribArray   marshal_cmd_VertexAttribArray
+#define marshal_cmd_DisableVertexAttribArray  marshal_cmd_VertexAttribArray
+struct marshal_cmd_VertexAttribDivisor;
+struct marshal_cmd_DrawArrays;
+struct marshal_cmd_DrawElements;
 #define marshal_cmd_ClearBufferfv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferiv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferuiv  marshal_cmd_ClearBuffer
@@ -281,4 +327,57 @@ void GLAPIENTRY
 _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
                             const GLfloat depth, const GLint stencil);
 
+void
+_mesa_unmarshal_VertexAttribPointer(struct gl_context *ctx,
+                                    const struct marshal_cmd_VertexAttribPointer *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribPointer(GLuint index, GLint size, GLenum type,
+                                  GLboolean normalized, GLsizei stride,
+                                  const GLvoid *pointer);
+
+void
+_mesa_unmarshal_VertexAttribIPointer(struct gl_context *ctx,
+                                     const struct marshal_cmd_VertexAttribIPointer *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribIPointer(GLuint index, GLint size, GLenum type,
+                                   GLsizei stride, const GLvoid *pointer);
+
+void
+_mesa_unmarshal_EnableVertexAttribArray(struct gl_context *ctx,
+                                        const struct marshal_cmd_VertexAttribArray *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_EnableVertexAttribArray(GLuint index);
+
+void
+_mesa_unmarshal_DisableVertexAttribArray(struct gl_context *ctx,
+                                         const struct marshal_cmd_VertexAttribArray *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_DisableVertexAttribArray(GLuint index);
+
+void
+_mesa_unmarshal_VertexAttribDivisor(struct gl_context *ctx,
+                                    const struct marshal_cmd_VertexAttribDivisor *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_VertexAttribDivisor(GLuint index, GLuint divisor);
+
+void
+_mesa_unmarshal_DrawArrays(struct gl_context *ctx,
+                           const struct marshal_cmd_DrawArrays *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_DrawArrays(GLenum mode, GLint first, GLsizei count);
+
+void
+_mesa_unmarshal_DrawElements(struct gl_context *ctx,
+                             const struct marshal_cmd_DrawElements *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_DrawElements(GLenum mode, GLsizei count, GLenum type,
+                           const GLvoid *indices);
+
 #endif /* MARSHAL_H */
@@ -1501,6 +1501,12 @@ struct gl_vertex_array_object
    /** Mask of VERT_BIT_* values indicating changed/dirty arrays */
    GLbitfield NewArrays;
 
+   /**
+    * Changes each time the enabled arrays or their bindings are updated,
+    * unique among all the VAOs, for drivers caching state derived from them.
+    */
+   GLuint Stamp;
+
    /** The index buffer (also known as the element array buffer in OpenGL). */
    struct gl_buffer_object *IndexBufferObj;
 };
@@ -1665,6 +1671,9 @@ struct gl_evaluators
    struct gl_2d_map Map2Texture3;
    struct gl_2d_map Map2Texture4;
    /*@}*/
+
+   /** Whether the maps were given their initial points, done on first use */
+   GLboolean Initialized;
 };
 
 
@@ -2209,9 +2218,6 @@ struct gl_vertex_program_state
    /** Program to emulate fixed-function T&L (see above) */
    struct gl_program *_TnlProgram;
 
-   /** Cache of fixed-function programs */
-   struct gl_program_cache *Cache;
-
    GLboolean _Overriden;
 
    /**
@@ -2282,9 +2288,6 @@ struct gl_fragment_program_state
 
    /** Program to emulate fixed-function texture env/combine (see above) */
    struct gl_program *_TexEnvProgram;
-
-   /** Cache of fixed-function programs */
-   struct gl_program_cache *Cache;
 };
 
 
@@ -3203,6 +3206,16 @@ struct gl_shared_state
    struct gl_program *DefaultFragmentProgram;
    /*@}*/
 
+   /**
+    * \name Caches of the programs emulating fixed-function T&L and texture
+    * env/combine, shared so that the contexts don't each generate them.
+    */
+   /*@{*/
+   simple_mtx_t FixedFuncMutex;   /**< for the fixed-function caches */
+   struct gl_program_cache *FixedFuncVertexPrograms;
+   struct gl_program_cache *FixedFuncFragmentShaders;
+   /*@}*/
+
    /* GL_ATI_fragment_shader */
    struct _mesa_HashTable *ATIShaders;
    struct ati_fragment_shader *DefaultFragmentShader;
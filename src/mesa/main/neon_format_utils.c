@@ -0,0 +1,180 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "main/neon_format_utils.h"
+
+#ifdef HAVE_NEON_FORMAT_UTILS
+
+#include <arm_neon.h>
+#include "main/formats.h"
+
+/* A table lookup of 16 bytes, out of range indices read zero. */
+static inline uint8x16_t
+shuffle_u8(uint8x16_t v, uint8x16_t index)
+{
+#if defined(__aarch64__)
+   return vqtbl1q_u8(v, index);
+#else
+   uint8x8x2_t table = { { vget_low_u8(v), vget_high_u8(v) } };
+
+   return vcombine_u8(vtbl2_u8(table, vget_low_u8(index)),
+                      vtbl2_u8(table, vget_high_u8(index)));
+#endif
+}
+
+/* Rounds x * max / 255 as _mesa_unorm_to_unorm(x, 8, bits) does, see
+ * sse_format_utils.c.
+ */
+static inline uint16x8_t
+unorm8_to_unorm(uint8x8_t x, uint8_t max)
+{
+   uint16x8_t t = vmlal_u8(vdupq_n_u16(127), x, vdup_n_u8(max));
+
+   t = vaddq_u16(t, vaddq_u16(vshrq_n_u16(t, 8), vdupq_n_u16(1)));
+   return vshrq_n_u16(t, 8);
+}
+
+unsigned
+_mesa_swizzle_ubyte_rgba_neon(uint8_t *dst, const uint8_t *src,
+                              unsigned num_src_channels,
+                              const uint8_t swizzle[4], uint8_t one,
+                              unsigned count)
+{
+   const unsigned shuffles = num_src_channels == 3 ? 1 : 4 / num_src_channels;
+   const unsigned pixels = 4 * shuffles;
+   uint8_t index[4][16], ones[16];
+   uint8x16_t index4[4], ones4;
+   unsigned i;
+
+   for (unsigned s = 0; s < shuffles; s++) {
+      for (unsigned p = 0; p < 4; p++) {
+         for (unsigned c = 0; c < 4; c++) {
+            index[s][p * 4 + c] = swizzle[c] < 4 ?
+               (s * 4 + p) * num_src_channels + swizzle[c] : 0xff;
+            ones[p * 4 + c] = swizzle[c] == MESA_FORMAT_SWIZZLE_ONE ? one : 0;
+         }
+      }
+      index4[s] = vld1q_u8(index[s]);
+   }
+   ones4 = vld1q_u8(ones);
+
+   for (i = 0; i * num_src_channels + 16 <= count * num_src_channels;
+        i += pixels) {
+      uint8x16_t v = vld1q_u8(src + i * num_src_channels);
+
+      for (unsigned s = 0; s < shuffles; s++) {
+         vst1q_u8(dst + (i + s * 4) * 4,
+                  vorrq_u8(shuffle_u8(v, index4[s]), ones4));
+      }
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_pack_ubyte_rgba_b5g6r5_neon(uint16_t *dst, const uint8_t *src,
+                                  unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      uint8x8x4_t v = vld4_u8(src + i * 4);
+      uint16x8_t r = unorm8_to_unorm(v.val[0], 31);
+      uint16x8_t g = unorm8_to_unorm(v.val[1], 63);
+      uint16x8_t b = unorm8_to_unorm(v.val[2], 31);
+
+      vst1q_u16(dst + i, vorrq_u16(vorrq_u16(b, vshlq_n_u16(g, 5)),
+                                   vshlq_n_u16(r, 11)));
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_pack_ubyte_rgba_b4g4r4a4_neon(uint16_t *dst, const uint8_t *src,
+                                    unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      uint8x8x4_t v = vld4_u8(src + i * 4);
+      uint16x8_t r = unorm8_to_unorm(v.val[0], 15);
+      uint16x8_t g = unorm8_to_unorm(v.val[1], 15);
+      uint16x8_t b = unorm8_to_unorm(v.val[2], 15);
+      uint16x8_t a = unorm8_to_unorm(v.val[3], 15);
+
+      vst1q_u16(dst + i, vorrq_u16(vorrq_u16(b, vshlq_n_u16(g, 4)),
+                                   vorrq_u16(vshlq_n_u16(r, 8),
+                                             vshlq_n_u16(a, 12))));
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_unpack_ubyte_rgba_b5g6r5_neon(uint8_t *dst, const uint16_t *src,
+                                    unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      uint16x8_t v = vld1q_u16(src + i);
+      uint8x8_t r = vmovn_u16(vshrq_n_u16(v, 11));
+      uint8x8_t g = vmovn_u16(vandq_u16(vshrq_n_u16(v, 5), vdupq_n_u16(0x3f)));
+      uint8x8_t b = vmovn_u16(vandq_u16(v, vdupq_n_u16(0x1f)));
+      uint8x8x4_t rgba;
+
+      rgba.val[0] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+      rgba.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+      rgba.val[2] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+      rgba.val[3] = vdup_n_u8(0xff);
+      vst4_u8(dst + i * 4, rgba);
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_unpack_ubyte_rgba_b4g4r4a4_neon(uint8_t *dst, const uint16_t *src,
+                                      unsigned count)
+{
+   const uint8x8_t mask = vdup_n_u8(0xf);
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      uint16x8_t v = vld1q_u16(src + i);
+      uint8x8_t bg = vmovn_u16(v);
+      uint8x8_t ra = vshrn_n_u16(v, 8);
+      uint8x8x4_t rgba;
+
+      rgba.val[0] = vmul_u8(vand_u8(ra, mask), vdup_n_u8(17));
+      rgba.val[1] = vmul_u8(vshr_n_u8(bg, 4), vdup_n_u8(17));
+      rgba.val[2] = vmul_u8(vand_u8(bg, mask), vdup_n_u8(17));
+      rgba.val[3] = vmul_u8(vshr_n_u8(ra, 4), vdup_n_u8(17));
+      vst4_u8(dst + i * 4, rgba);
+   }
+
+   return i;
+}
+
+#endif /* HAVE_NEON_FORMAT_UTILS */
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef NEON_FORMAT_UTILS_H
+#define NEON_FORMAT_UTILS_H
+
+#include <stdint.h>
+#include "util/u_endian.h"
+
+/* Built when the compiler targets NEON, the packed pixels are read as native
+ * 16 bit words, which the kernels take as little endian.
+ */
+#if defined(__ARM_NEON) && defined(PIPE_ARCH_LITTLE_ENDIAN)
+#define HAVE_NEON_FORMAT_UTILS 1
+
+/*
+ * The same kernels as the SSE4.1 ones in sse_format_utils.h, which return
+ * the number of pixels converted.
+ */
+
+unsigned
+_mesa_swizzle_ubyte_rgba_neon(uint8_t *dst, const uint8_t *src,
+                              unsigned num_src_channels,
+                              const uint8_t swizzle[4], uint8_t one,
+                              unsigned count);
+
+unsigned
+_mesa_pack_ubyte_rgba_b5g6r5_neon(uint16_t *dst, const uint8_t *src,
+                                  unsigned count);
+unsigned
+_mesa_pack_ubyte_rgba_b4g4r4a4_neon(uint16_t *dst, const uint8_t *src,
+                                    unsigned count);
+
+unsigned
+_mesa_unpack_ubyte_rgba_b5g6r5_neon(uint8_t *dst, const uint16_t *src,
+                                    unsigned count);
+unsigned
+_mesa_unpack_ubyte_rgba_b4g4r4a4_neon(uint8_t *dst, const uint16_t *src,
+                                      unsigned count);
+#endif
+
+#endif /* NEON_FORMAT_UTILS_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "main/neon_minmax.h"
+
+#ifdef HAVE_NEON_MINMAX
+
+#include <arm_neon.h>
+#include <stdint.h>
+#include "util/macros.h"
+
+/* As the SSE4.1 scan, restart indices are or'ed to all ones for the min and
+ * cleared for the max.
+ */
+#define MINMAX_NEON(name, type, bits, lanes)                                \
+static void                                                                 \
+name(const type *indices, unsigned count, bool restart,                     \
+     unsigned restart_index, unsigned *min_index, unsigned *max_index)      \
+{                                                                           \
+   type min = (type) ~0u;                                                   \
+   type max = 0;                                                            \
+   unsigned i = 0;                                                          \
+                                                                            \
+   if (count >= 2 * lanes) {                                                \
+      type min_arr[lanes];                                                  \
+      type max_arr[lanes];                                                  \
+      uint##bits##x##lanes##_t min4 = vdupq_n_u##bits((type) ~0u);          \
+      uint##bits##x##lanes##_t max4 = vdupq_n_u##bits(0);                   \
+      const uint##bits##x##lanes##_t restart4 =                             \
+         vdupq_n_u##bits((type) restart_index);                             \
+                                                                            \
+      if (restart) {                                                        \
+         for (; i + lanes <= count; i += lanes) {                           \
+            uint##bits##x##lanes##_t v = vld1q_u##bits(indices + i);        \
+            uint##bits##x##lanes##_t r = vceqq_u##bits(v, restart4);        \
+            min4 = vminq_u##bits(min4, vorrq_u##bits(v, r));                \
+            max4 = vmaxq_u##bits(max4, vbicq_u##bits(v, r));                \
+         }                                                                  \
+      } else {                                                              \
+         for (; i + lanes <= count; i += lanes) {                           \
+            uint##bits##x##lanes##_t v = vld1q_u##bits(indices + i);        \
+            min4 = vminq_u##bits(min4, v);                                  \
+            max4 = vmaxq_u##bits(max4, v);                                  \
+         }                                                                  \
+      }                                                                     \
+                                                                            \
+      vst1q_u##bits(min_arr, min4);                                         \
+      vst1q_u##bits(max_arr, max4);                                         \
+      for (unsigned j = 0; j < lanes; j++) {                                \
+         min = MIN2(min, min_arr[j]);                                       \
+         max = MAX2(max, max_arr[j]);                                       \
+      }                                                                     \
+   }                                                                        \
+                                                                            \
+   for (; i < count; i++) {                                                 \
+      if (restart && indices[i] == restart_index)                           \
+         continue;                                                          \
+      min = MIN2(min, indices[i]);                                          \
+      max = MAX2(max, indices[i]);                                          \
+   }                                                                        \
+                                                                            \
+   /* no index but restarts, as the scalar scan */                          \
+   *min_index = min > max ? ~0u : min;                                      \
+   *max_index = max;                                                        \
+}
+
+MINMAX_NEON(ubyte_array_min_max, uint8_t, 8, 16)
+MINMAX_NEON(ushort_array_min_max, uint16_t, 16, 8)
+MINMAX_NEON(uint_array_min_max, uint32_t, 32, 4)
+
+void
+_mesa_index_array_min_max_neon(const void *indices, unsigned index_size,
+                               unsigned count, bool restart,
+                               unsigned restart_index,
+                               unsigned *min_index, unsigned *max_index)
+{
+   switch (index_size) {
+   case 1:
+      /* a restart index that doesn't fit is never met */
+      ubyte_array_min_max(indices, count, restart && restart_index <= 0xff,
+                          restart_index, min_index, max_index);
+      break;
+   case 2:
+      ushort_array_min_max(indices, count,
+                           restart && restart_index <= 0xffff,
+                           restart_index, min_index, max_index);
+      break;
+   default:
+      uint_array_min_max(indices, count, restart, restart_index,
+                         min_index, max_index);
+      break;
+   }
+}
+
+#endif /* HAVE_NEON_MINMAX */
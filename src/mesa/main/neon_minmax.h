@@ -0,0 +1,44 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef NEON_MINMAX_H
+#define NEON_MINMAX_H
+
+#include <stdbool.h>
+
+/* Built when the compiler targets NEON, as on all of aarch64. */
+#if defined(__ARM_NEON)
+#define HAVE_NEON_MINMAX 1
+
+/**
+ * Min and max of the indices of index_size bytes, which skip the
+ * restart_index if restart is set.
+ */
+void
+_mesa_index_array_min_max_neon(const void *indices, unsigned index_size,
+                               unsigned count, bool restart,
+                               unsigned restart_index,
+                               unsigned *min_index, unsigned *max_index);
+#endif
+
+#endif /* NEON_MINMAX_H */
@@ -34,6 +34,7 @@
 #include "bufferobj.h"
 #include "shared.h"
 #include "program/program.h"
+#include "program/prog_cache.h"
 #include "dlist.h"
 #include "samplerobj.h"
 #include "shaderapi.h"
@@ -78,6 +79,10 @@ _mesa_alloc_shared_state(struct gl_context *ctx)
    shared->DefaultFragmentProgram =
       ctx->Driver.NewProgram(ctx, GL_FRAGMENT_PROGRAM_ARB, 0, true);
 
+   simple_mtx_init(&shared->FixedFuncMutex, mtx_plain);
+   shared->FixedFuncVertexPrograms = _mesa_new_program_cache();
+   shared->FixedFuncFragmentShaders = _mesa_new_program_cache();
+
    shared->ATIShaders = _mesa_NewHashTable();
    shared->DefaultFragmentShader = _mesa_new_ati_fragment_shader(ctx, 0);
 
@@ -371,6 +376,12 @@ free_shared_state(struct gl_context *ctx, struct gl_shared_state *shared)
       _mesa_DeleteHashTable(shared->ShaderObjects);
    }
 
+   if (shared->FixedFuncVertexPrograms)
+      _mesa_delete_program_cache(ctx, shared->FixedFuncVertexPrograms);
+
+   if (shared->FixedFuncFragmentShaders)
+      _mesa_delete_shader_cache(ctx, shared->FixedFuncFragmentShaders);
+
    if (shared->Programs) {
       _mesa_HashDeleteAll(shared->Programs, delete_program_cb, ctx);
       _mesa_DeleteHashTable(shared->Programs);
@@ -453,6 +464,7 @@ free_shared_state(struct gl_context *ctx, struct gl_shared_state *shared)
    }
 
    simple_mtx_destroy(&shared->Mutex);
+   simple_mtx_destroy(&shared->FixedFuncMutex);
    mtx_destroy(&shared->TexMutex);
 
    free(shared);
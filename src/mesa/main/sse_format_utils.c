@@ -0,0 +1,199 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "main/sse_format_utils.h"
+#include "main/formats.h"
+#include <smmintrin.h>
+
+/* Rounds x * max / 255 as _mesa_unorm_to_unorm(x, 8, bits) does, the
+ * division by 255 of t < 65535 is (t + 1 + (t >> 8)) >> 8.
+ */
+static inline __m128i
+unorm8_to_unorm(__m128i x, int max)
+{
+   __m128i t = _mm_add_epi32(_mm_mullo_epi16(x, _mm_set1_epi32(max)),
+                             _mm_set1_epi32(127));
+   t = _mm_add_epi32(t, _mm_add_epi32(_mm_srli_epi32(t, 8),
+                                      _mm_set1_epi32(1)));
+   return _mm_srli_epi32(t, 8);
+}
+
+/* One shuffle writes 4 pixels, a load of 16 bytes has the source of 16, 8,
+ * 5 or 4 of them for 1 to 4 channels and is used for 16, 8, 4 and 4.
+ */
+unsigned
+_mesa_swizzle_ubyte_rgba_sse41(uint8_t *dst, const uint8_t *src,
+                               unsigned num_src_channels,
+                               const uint8_t swizzle[4], uint8_t one,
+                               unsigned count)
+{
+   const unsigned shuffles = num_src_channels == 3 ? 1 : 4 / num_src_channels;
+   const unsigned pixels = 4 * shuffles;
+   uint8_t index[4][16], ones[16];
+   __m128i index4[4], ones4;
+   unsigned i;
+
+   for (unsigned s = 0; s < shuffles; s++) {
+      for (unsigned p = 0; p < 4; p++) {
+         for (unsigned c = 0; c < 4; c++) {
+            /* the high bit makes the byte zero */
+            index[s][p * 4 + c] = swizzle[c] < 4 ?
+               (s * 4 + p) * num_src_channels + swizzle[c] : 0x80;
+            ones[p * 4 + c] = swizzle[c] == MESA_FORMAT_SWIZZLE_ONE ? one : 0;
+         }
+      }
+      index4[s] = _mm_loadu_si128((const __m128i *) index[s]);
+   }
+   ones4 = _mm_loadu_si128((const __m128i *) ones);
+
+   for (i = 0; i * num_src_channels + 16 <= count * num_src_channels;
+        i += pixels) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (src + i *
+                                                     num_src_channels));
+
+      for (unsigned s = 0; s < shuffles; s++) {
+         _mm_storeu_si128((__m128i *) (dst + (i + s * 4) * 4),
+                          _mm_or_si128(_mm_shuffle_epi8(v, index4[s]),
+                                       ones4));
+      }
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_pack_ubyte_rgba_b5g6r5_sse41(uint16_t *dst, const uint8_t *src,
+                                   unsigned count)
+{
+   const __m128i mask = _mm_set1_epi32(0xff);
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m128i packed[2];
+
+      for (unsigned j = 0; j < 2; j++) {
+         __m128i v = _mm_loadu_si128((const __m128i *) (src + (i + j * 4) * 4));
+         __m128i r = unorm8_to_unorm(_mm_and_si128(v, mask), 31);
+         __m128i g = unorm8_to_unorm(_mm_and_si128(_mm_srli_epi32(v, 8), mask),
+                                     63);
+         __m128i b = unorm8_to_unorm(_mm_and_si128(_mm_srli_epi32(v, 16),
+                                                   mask), 31);
+
+         packed[j] = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 5)),
+                                  _mm_slli_epi32(r, 11));
+      }
+
+      _mm_storeu_si128((__m128i *) (dst + i),
+                       _mm_packus_epi32(packed[0], packed[1]));
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_pack_ubyte_rgba_b4g4r4a4_sse41(uint16_t *dst, const uint8_t *src,
+                                     unsigned count)
+{
+   const __m128i mask = _mm_set1_epi32(0xff);
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m128i packed[2];
+
+      for (unsigned j = 0; j < 2; j++) {
+         __m128i v = _mm_loadu_si128((const __m128i *) (src + (i + j * 4) * 4));
+         __m128i r = unorm8_to_unorm(_mm_and_si128(v, mask), 15);
+         __m128i g = unorm8_to_unorm(_mm_and_si128(_mm_srli_epi32(v, 8), mask),
+                                     15);
+         __m128i b = unorm8_to_unorm(_mm_and_si128(_mm_srli_epi32(v, 16),
+                                                   mask), 15);
+         __m128i a = unorm8_to_unorm(_mm_srli_epi32(v, 24), 15);
+
+         packed[j] = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 4)),
+                                  _mm_or_si128(_mm_slli_epi32(r, 8),
+                                               _mm_slli_epi32(a, 12)));
+      }
+
+      _mm_storeu_si128((__m128i *) (dst + i),
+                       _mm_packus_epi32(packed[0], packed[1]));
+   }
+
+   return i;
+}
+
+/* The channels are extended as EXTEND_NORMALIZED_INT, 5 bits to x * 8 +
+ * (x >> 2), 6 to x * 4 + (x >> 4) and 4 to x * 17.
+ */
+unsigned
+_mesa_unpack_ubyte_rgba_b5g6r5_sse41(uint8_t *dst, const uint16_t *src,
+                                     unsigned count)
+{
+   const __m128i alpha = _mm_set1_epi32(0xff000000);
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)
+                                                     (src + i)));
+      __m128i b = _mm_and_si128(v, _mm_set1_epi32(0x1f));
+      __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3f));
+      __m128i r = _mm_srli_epi32(v, 11);
+
+      r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+      g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+      b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+      _mm_storeu_si128((__m128i *) (dst + i * 4),
+                       _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                    _mm_or_si128(_mm_slli_epi32(b, 16),
+                                                 alpha)));
+   }
+
+   return i;
+}
+
+unsigned
+_mesa_unpack_ubyte_rgba_b4g4r4a4_sse41(uint8_t *dst, const uint16_t *src,
+                                       unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)
+                                                     (src + i)));
+      /* the nibbles of BGRA to the low nibbles of the bytes of RGBA */
+      __m128i rgba = _mm_or_si128(
+         _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 8),
+                                    _mm_set1_epi32(0xf)),
+                      _mm_and_si128(_mm_slli_epi32(v, 4),
+                                    _mm_set1_epi32(0xf00))),
+         _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 16),
+                                    _mm_set1_epi32(0xf0000)),
+                      _mm_and_si128(_mm_slli_epi32(v, 12),
+                                    _mm_set1_epi32(0xf000000))));
+
+      _mm_storeu_si128((__m128i *) (dst + i * 4),
+                       _mm_or_si128(rgba, _mm_slli_epi32(rgba, 4)));
+   }
+
+   return i;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef SSE_FORMAT_UTILS_H
+#define SSE_FORMAT_UTILS_H
+
+#include <stdint.h>
+
+/*
+ * The kernels return the number of pixels they converted, which is count
+ * or a few less, the rest is left to the scalar code.
+ */
+
+/**
+ * Swizzle-and-convert of ubyte pixels of num_src_channels to 4 channels,
+ * as _mesa_swizzle_and_convert does it, one is the value of
+ * MESA_FORMAT_SWIZZLE_ONE.
+ */
+unsigned
+_mesa_swizzle_ubyte_rgba_sse41(uint8_t *dst, const uint8_t *src,
+                               unsigned num_src_channels,
+                               const uint8_t swizzle[4], uint8_t one,
+                               unsigned count);
+
+/** Packs of RGBA8 pixels, as _mesa_pack_ubyte_rgba_row. */
+unsigned
+_mesa_pack_ubyte_rgba_b5g6r5_sse41(uint16_t *dst, const uint8_t *src,
+                                   unsigned count);
+unsigned
+_mesa_pack_ubyte_rgba_b4g4r4a4_sse41(uint16_t *dst, const uint8_t *src,
+                                     unsigned count);
+
+/** Unpacks to RGBA8 pixels, as _mesa_unpack_ubyte_rgba_row. */
+unsigned
+_mesa_unpack_ubyte_rgba_b5g6r5_sse41(uint8_t *dst, const uint16_t *src,
+                                     unsigned count);
+unsigned
+_mesa_unpack_ubyte_rgba_b4g4r4a4_sse41(uint8_t *dst, const uint16_t *src,
+                                       unsigned count);
+
+#endif /* SSE_FORMAT_UTILS_H */
@@ -26,69 +26,97 @@
  */
 
 #include "main/sse_minmax.h"
+#include "util/macros.h"
 #include <smmintrin.h>
 #include <stdint.h>
 
-void
-_mesa_uint_array_min_max(const unsigned *ui_indices, unsigned *min_index,
-                         unsigned *max_index, const unsigned count)
-{
-   unsigned max_ui = 0;
-   unsigned min_ui = ~0U;
-   unsigned i = 0;
-   unsigned aligned_count = count;
-
-   /* handle the first few values without SSE until the pointer is aligned */
-   while (((uintptr_t)ui_indices & 15) && aligned_count) {
-      if (*ui_indices > max_ui)
-         max_ui = *ui_indices;
-      if (*ui_indices < min_ui)
-         min_ui = *ui_indices;
-
-      aligned_count--;
-      ui_indices++;
-   }
-
-   /* TODO: The actual threshold for SSE begin useful may be higher than 8.
-    * Some careful microbenchmarks and measurement are required to
-    * find the actual tipping point.
-    */
-   if (aligned_count >= 8) {
-      unsigned max_arr[4] __attribute__ ((aligned (16)));
-      unsigned min_arr[4] __attribute__ ((aligned (16)));
-      unsigned vec_count;
-      __m128i max_ui4 = _mm_setzero_si128();
-      __m128i min_ui4 = _mm_set1_epi32(~0U);
-      __m128i ui_indices4;
-      __m128i *ui_indices_ptr;
-
-      vec_count = aligned_count & ~0x3;
-      ui_indices_ptr = (__m128i *)ui_indices;
-      for (i = 0; i < vec_count / 4; i++) {
-         ui_indices4 = _mm_load_si128(&ui_indices_ptr[i]);
-         max_ui4 = _mm_max_epu32(ui_indices4, max_ui4);
-         min_ui4 = _mm_min_epu32(ui_indices4, min_ui4);
-      }
-
-      _mm_store_si128((__m128i *)max_arr, max_ui4);
-      _mm_store_si128((__m128i *)min_arr, min_ui4);
+/* Restart indices are or'ed to all ones for the min and masked to zero for
+ * the max, so that they don't count without a branch.
+ */
+#define MINMAX_SSE41(name, type, bits)                                      \
+static void                                                                 \
+name(const type *indices, unsigned count, bool restart,                     \
+     unsigned restart_index, unsigned *min_index, unsigned *max_index)      \
+{                                                                           \
+   const unsigned lanes = 16 / sizeof(type);                                \
+   type min = (type) ~0u;                                                   \
+   type max = 0;                                                            \
+   unsigned i = 0;                                                          \
+                                                                            \
+   /* until the pointer is aligned */                                       \
+   for (; i < count && ((uintptr_t) (indices + i) & 15); i++) {             \
+      if (restart && indices[i] == restart_index)                           \
+         continue;                                                          \
+      min = MIN2(min, indices[i]);                                          \
+      max = MAX2(max, indices[i]);                                          \
+   }                                                                        \
+                                                                            \
+   if (count - i >= 2 * lanes) {                                            \
+      type min_arr[16 / sizeof(type)] __attribute__ ((aligned (16)));       \
+      type max_arr[16 / sizeof(type)] __attribute__ ((aligned (16)));       \
+      __m128i min4 = _mm_set1_epi32(~0);                                    \
+      __m128i max4 = _mm_setzero_si128();                                   \
+      const __m128i restart4 = _mm_set1_epi##bits((type) restart_index);    \
+                                                                            \
+      if (restart) {                                                        \
+         for (; i + lanes <= count; i += lanes) {                           \
+            __m128i v = _mm_load_si128((const __m128i *) (indices + i));    \
+            __m128i r = _mm_cmpeq_epi##bits(v, restart4);                   \
+            min4 = _mm_min_epu##bits(min4, _mm_or_si128(v, r));             \
+            max4 = _mm_max_epu##bits(max4, _mm_andnot_si128(r, v));         \
+         }                                                                  \
+      } else {                                                              \
+         for (; i + lanes <= count; i += lanes) {                           \
+            __m128i v = _mm_load_si128((const __m128i *) (indices + i));    \
+            min4 = _mm_min_epu##bits(min4, v);                              \
+            max4 = _mm_max_epu##bits(max4, v);                              \
+         }                                                                  \
+      }                                                                     \
+                                                                            \
+      _mm_store_si128((__m128i *) min_arr, min4);                           \
+      _mm_store_si128((__m128i *) max_arr, max4);                           \
+      for (unsigned j = 0; j < lanes; j++) {                                \
+         min = MIN2(min, min_arr[j]);                                       \
+         max = MAX2(max, max_arr[j]);                                       \
+      }                                                                     \
+   }                                                                        \
+                                                                            \
+   for (; i < count; i++) {                                                 \
+      if (restart && indices[i] == restart_index)                           \
+         continue;                                                          \
+      min = MIN2(min, indices[i]);                                          \
+      max = MAX2(max, indices[i]);                                          \
+   }                                                                        \
+                                                                            \
+   /* no index but restarts, as the scalar scan */                          \
+   *min_index = min > max ? ~0u : min;                                      \
+   *max_index = max;                                                        \
+}
 
-      for (i = 0; i < 4; i++) {
-         if (max_arr[i] > max_ui)
-            max_ui = max_arr[i];
-         if (min_arr[i] < min_ui)
-            min_ui = min_arr[i];
-      }
-      i = vec_count;
-   }
+MINMAX_SSE41(ubyte_array_min_max, uint8_t, 8)
+MINMAX_SSE41(ushort_array_min_max, uint16_t, 16)
+MINMAX_SSE41(uint_array_min_max, uint32_t, 32)
 
-   for (; i < aligned_count; i++) {
-      if (ui_indices[i] > max_ui)
-         max_ui = ui_indices[i];
-      if (ui_indices[i] < min_ui)
-         min_ui = ui_indices[i];
+void
+_mesa_index_array_min_max_sse41(const void *indices, unsigned index_size,
+                                unsigned count, bool restart,
+                                unsigned restart_index,
+                                unsigned *min_index, unsigned *max_index)
+{
+   switch (index_size) {
+   case 1:
+      /* a restart index that doesn't fit is never met */
+      ubyte_array_min_max(indices, count, restart && restart_index <= 0xff,
+                          restart_index, min_index, max_index);
+      break;
+   case 2:
+      ushort_array_min_max(indices, count,
+                           restart && restart_index <= 0xffff,
+                           restart_index, min_index, max_index);
+      break;
+   default:
+      uint_array_min_max(indices, count, restart, restart_index,
+                         min_index, max_index);
+      break;
    }
-
-   *min_index = min_ui;
-   *max_index = max_ui;
 }
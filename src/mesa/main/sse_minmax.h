@@ -28,8 +28,16 @@
 #ifndef SSE_MINMAX_H
 #define SSE_MINMAX_H
 
+#include <stdbool.h>
+
+/**
+ * Min and max of the indices of index_size bytes, which skip the
+ * restart_index if restart is set.
+ */
 void
-_mesa_uint_array_min_max(const unsigned *ui_indices, unsigned *min_index,
-                         unsigned *max_index, const unsigned count);
+_mesa_index_array_min_max_sse41(const void *indices, unsigned index_size,
+                                unsigned count, bool restart,
+                                unsigned restart_index,
+                                unsigned *min_index, unsigned *max_index);
 
 #endif /* SSE_MINMAX_H */
@@ -38,6 +38,10 @@
  */
 
 #include <stdbool.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "c11/threads.h"
 #include "texcompress.h"
 #include "texcompress_etc.h"
 #include "texstore.h"
@@ -45,6 +49,7 @@
 #include "macros.h"
 #include "format_unpack.h"
 #include "util/format_srgb.h"
+#include "util/u_queue.h"
 
 
 struct etc2_block {
@@ -105,6 +110,113 @@ static const int etc2_modifier_tables_non_opaque[8][4] = {
 #undef TAG
 #undef UINT8_TYPE
 
+typedef void (*etc_unpack_func)(uint8_t *dst_row,
+                                unsigned dst_stride,
+                                const uint8_t *src_row,
+                                unsigned src_stride,
+                                unsigned width,
+                                unsigned height);
+
+/* Images of at least this many blocks are split in bands of block rows,
+ * decoded by the threads of a queue shared by all the contexts and by
+ * the calling thread.
+ */
+#define ETC_THREADED_MIN_BLOCKS (64 * 64)
+#define ETC_MAX_BANDS 4
+
+static struct util_queue etc_queue;
+static unsigned etc_queue_threads;
+static once_flag etc_queue_once = ONCE_FLAG_INIT;
+
+struct etc_unpack_job {
+   etc_unpack_func unpack;
+   uint8_t *dst_row;
+   unsigned dst_stride;
+   const uint8_t *src_row;
+   unsigned src_stride;
+   unsigned width;
+   unsigned height;
+   struct util_queue_fence fence;
+};
+
+static void
+etc_queue_init(void)
+{
+   long cpus = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+   cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   unsigned threads = CLAMP(cpus, 1, ETC_MAX_BANDS) - 1;
+   if (threads &&
+       util_queue_init(&etc_queue, "etc", ETC_MAX_BANDS * 4, threads,
+                       UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      etc_queue_threads = threads;
+}
+
+static void
+etc_unpack_job_execute(void *data, int thread_index)
+{
+   struct etc_unpack_job *job = data;
+
+   job->unpack(job->dst_row, job->dst_stride, job->src_row, job->src_stride,
+               job->width, job->height);
+}
+
+static void
+etc_unpack(etc_unpack_func unpack,
+           uint8_t *dst_row,
+           unsigned dst_stride,
+           const uint8_t *src_row,
+           unsigned src_stride,
+           unsigned width,
+           unsigned height)
+{
+   const unsigned block_rows = DIV_ROUND_UP(height, 4);
+   struct etc_unpack_job jobs[ETC_MAX_BANDS];
+   unsigned bands = 1, band_rows, i;
+
+   if (DIV_ROUND_UP(width, 4) * block_rows >= ETC_THREADED_MIN_BLOCKS) {
+      call_once(&etc_queue_once, etc_queue_init);
+      bands = etc_queue_threads + 1;
+   }
+
+   if (bands < 2) {
+      unpack(dst_row, dst_stride, src_row, src_stride, width, height);
+      return;
+   }
+
+   /* every band gets rows */
+   band_rows = DIV_ROUND_UP(block_rows, bands);
+   bands = DIV_ROUND_UP(block_rows, band_rows);
+   for (i = 0; i < bands; i++) {
+      struct etc_unpack_job *job = &jobs[i];
+      const unsigned row = i * band_rows;
+
+      job->unpack = unpack;
+      job->dst_row = dst_row + row * 4 * dst_stride;
+      job->dst_stride = dst_stride;
+      job->src_row = src_row + row * src_stride;
+      job->src_stride = src_stride;
+      job->width = width;
+      job->height = MIN2(band_rows * 4, height - row * 4);
+      util_queue_fence_init(&job->fence);
+
+      /* the last band is decoded here meanwhile */
+      if (i < bands - 1)
+         util_queue_add_job(&etc_queue, job, &job->fence,
+                            etc_unpack_job_execute, NULL);
+      else
+         etc_unpack_job_execute(job, 0);
+   }
+
+   for (i = 0; i < bands; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
 GLboolean
 _mesa_texstore_etc1_rgb8(UNUSED_TEXSTORE_PARAMS)
 {
@@ -142,9 +254,8 @@ _mesa_etc1_unpack_rgba8888(uint8_t *dst_row,
                            unsigned src_width,
                            unsigned src_height)
 {
-   etc1_unpack_rgba8888(dst_row, dst_stride,
-                        src_row, src_stride,
-                        src_width, src_height);
+   etc_unpack(etc1_unpack_rgba8888, dst_row, dst_stride,
+              src_row, src_stride, src_width, src_height);
 }
 
 static uint8_t
@@ -666,16 +777,96 @@ etc2_rgba8_fetch_texel(const struct etc2_block *block,
    etc2_alpha8_fetch_texel(block, x, y, dst);
 }
 
+/**
+ * Decode the colors of all the texels of a block. The texels of the
+ * individual, differential, T and H modes each pick one of four colors
+ * of their subblock, which are computed once per block here instead of
+ * once per texel. The texels are RGBA, or BGRA for the sRGB formats.
+ */
 static void
-etc2_unpack_rgb8(uint8_t *dst_row,
-                 unsigned dst_stride,
-                 const uint8_t *src_row,
-                 unsigned src_stride,
-                 unsigned width,
-                 unsigned height)
+etc2_rgb8_decode_block(const struct etc2_block *block,
+                       uint8_t texels[4][4][4],
+                       GLboolean punchthrough_alpha,
+                       bool bgra)
+{
+   const unsigned r = bgra ? 2 : 0, b = bgra ? 0 : 2;
+   const bool subblocks = block->is_ind_mode || block->is_diff_mode;
+   uint8_t colors[2][4][4];
+   unsigned x, y, i, s;
+
+   if (block->is_planar_mode) {
+      for (y = 0; y < 4; y++) {
+         for (x = 0; x < 4; x++) {
+            uint8_t *dst = texels[y][x];
+            uint8_t tmp;
+
+            etc2_rgb8_fetch_texel(block, x, y, dst, punchthrough_alpha);
+            tmp = dst[0];
+            dst[0] = dst[r];
+            dst[r] = tmp;
+            dst[3] = 255;
+         }
+      }
+      return;
+   }
+
+   for (s = 0; s < (subblocks ? 2 : 1); s++) {
+      for (i = 0; i < 4; i++) {
+         uint8_t *color = colors[s][i];
+
+         if (subblocks) {
+            const uint8_t *base_color = block->base_colors[s];
+            const int modifier = block->modifier_tables[s][i];
+
+            color[r] = etc2_clamp(base_color[0] + modifier);
+            color[1] = etc2_clamp(base_color[1] + modifier);
+            color[b] = etc2_clamp(base_color[2] + modifier);
+         }
+         else {
+            color[r] = block->paint_colors[i][0];
+            color[1] = block->paint_colors[i][1];
+            color[b] = block->paint_colors[i][2];
+         }
+         color[3] = 255;
+
+         /* index 2 is transparent black in a non opaque block */
+         if (punchthrough_alpha && !block->opaque && i == 2)
+            memset(color, 0, 4);
+      }
+   }
+
+   for (y = 0; y < 4; y++) {
+      for (x = 0; x < 4; x++) {
+         const unsigned bit = y + x * 4;
+         const unsigned idx =
+            ((block->pixel_indices[0] >> (15 + bit)) & 0x2) |
+            ((block->pixel_indices[0] >> bit) & 0x1);
+         const unsigned blk =
+            subblocks && (block->flipped ? y >= 2 : x >= 2);
+
+         memcpy(texels[y][x], colors[blk][idx], 4);
+      }
+   }
+}
+
+/**
+ * Decode the RGB8 based formats, with the EAC alpha of the RGBA8 ones in
+ * front of the color of each block.
+ */
+static void
+etc2_unpack_blocks(uint8_t *dst_row,
+                   unsigned dst_stride,
+                   const uint8_t *src_row,
+                   unsigned src_stride,
+                   unsigned width,
+                   unsigned height,
+                   bool eac_alpha,
+                   GLboolean punchthrough_alpha,
+                   bool bgra)
 {
-   const unsigned bw = 4, bh = 4, bs = 8, comps = 4;
+   const unsigned bw = 4, bh = 4, bs = eac_alpha ? 16 : 8, comps = 4;
    struct etc2_block block;
+   uint8_t texels[4][4][4];
    unsigned x, y, i, j;
 
    for (y = 0; y < height; y += bh) {
@@ -693,17 +884,21 @@ etc2_unpack_rgb8(uint8_t *dst_row,
           */
          const unsigned w = MIN2(bw, width - x);
 
-         etc2_rgb8_parse_block(&block, src,
-                               false /* punchthrough_alpha */);
+         if (eac_alpha)
+            etc2_rgba8_parse_block(&block, src);
+         else
+            etc2_rgb8_parse_block(&block, src, punchthrough_alpha);
+
+         etc2_rgb8_decode_block(&block, texels, punchthrough_alpha, bgra);
 
          for (j = 0; j < h; j++) {
             uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgb8_fetch_texel(&block, i, j, dst,
-                                     false /* punchthrough_alpha */);
-               dst[3] = 255;
-               dst += comps;
+
+            if (eac_alpha) {
+               for (i = 0; i < w; i++)
+                  etc2_alpha8_fetch_texel(&block, i, j, texels[j][i]);
             }
+            memcpy(dst, texels[j], w * comps);
          }
 
          src += bs;
@@ -713,6 +908,19 @@ etc2_unpack_rgb8(uint8_t *dst_row,
    }
 }
 
+static void
+etc2_unpack_rgb8(uint8_t *dst_row,
+                 unsigned dst_stride,
+                 const uint8_t *src_row,
+                 unsigned src_stride,
+                 unsigned width,
+                 unsigned height)
+{
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      false /* eac_alpha */, false /* punchthrough_alpha */,
+                      false /* bgra */);
+}
+
 static void
 etc2_unpack_srgb8(uint8_t *dst_row,
                   unsigned dst_stride,
@@ -721,40 +929,9 @@ etc2_unpack_srgb8(uint8_t *dst_row,
                   unsigned width,
                   unsigned height)
 {
-   const unsigned bw = 4, bh = 4, bs = 8, comps = 4;
-   struct etc2_block block;
-   unsigned x, y, i, j;
-   uint8_t tmp;
-
-   for (y = 0; y < height; y += bh) {
-      const uint8_t *src = src_row;
-      const unsigned h = MIN2(bh, height - y);
-
-      for (x = 0; x < width; x+= bw) {
-         const unsigned w = MIN2(bw, width - x);
-         etc2_rgb8_parse_block(&block, src,
-                               false /* punchthrough_alpha */);
-
-
-         for (j = 0; j < h; j++) {
-            uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgb8_fetch_texel(&block, i, j, dst,
-                                     false /* punchthrough_alpha */);
-               /* Convert to MESA_FORMAT_B8G8R8A8_SRGB */
-               tmp = dst[0];
-               dst[0] = dst[2];
-               dst[2] = tmp;
-               dst[3] = 255;
-
-               dst += comps;
-            }
-         }
-         src += bs;
-      }
-
-      src_row += src_stride;
-   }
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      false /* eac_alpha */, false /* punchthrough_alpha */,
+                      true /* bgra */);
 }
 
 static void
@@ -765,34 +942,9 @@ etc2_unpack_rgba8(uint8_t *dst_row,
                   unsigned width,
                   unsigned height)
 {
-   /* If internalformat is COMPRESSED_RGBA8_ETC2_EAC, each 4 × 4 block of
-    * RGBA8888 information is compressed to 128 bits. To decode a block, the
-    * two 64-bit integers int64bitAlpha and int64bitColor are calculated.
-   */
-   const unsigned bw = 4, bh = 4, bs = 16, comps = 4;
-   struct etc2_block block;
-   unsigned x, y, i, j;
-
-   for (y = 0; y < height; y += bh) {
-      const uint8_t *src = src_row;
-      const unsigned h = MIN2(bh, height - y);
-
-      for (x = 0; x < width; x+= bw) {
-         const unsigned w = MIN2(bw, width - x);
-         etc2_rgba8_parse_block(&block, src);
-
-         for (j = 0; j < h; j++) {
-            uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgba8_fetch_texel(&block, i, j, dst);
-               dst += comps;
-            }
-         }
-         src += bs;
-      }
-
-      src_row += src_stride;
-   }
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      true /* eac_alpha */, false /* punchthrough_alpha */,
+                      false /* bgra */);
 }
 
 static void
@@ -803,42 +955,9 @@ etc2_unpack_srgb8_alpha8(uint8_t *dst_row,
                          unsigned width,
                          unsigned height)
 {
-   /* If internalformat is COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, each 4 × 4 block
-    * of RGBA8888 information is compressed to 128 bits. To decode a block, the
-    * two 64-bit integers int64bitAlpha and int64bitColor are calculated.
-    */
-   const unsigned bw = 4, bh = 4, bs = 16, comps = 4;
-   struct etc2_block block;
-   unsigned x, y, i, j;
-   uint8_t tmp;
-
-   for (y = 0; y < height; y += bh) {
-      const unsigned h = MIN2(bh, height - y);
-      const uint8_t *src = src_row;
-
-      for (x = 0; x < width; x+= bw) {
-         const unsigned w = MIN2(bw, width - x);
-         etc2_rgba8_parse_block(&block, src);
-
-         for (j = 0; j < h; j++) {
-            uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgba8_fetch_texel(&block, i, j, dst);
-
-               /* Convert to MESA_FORMAT_B8G8R8A8_SRGB */
-               tmp = dst[0];
-               dst[0] = dst[2];
-               dst[2] = tmp;
-               dst[3] = dst[3];
-
-               dst += comps;
-            }
-         }
-         src += bs;
-      }
-
-      src_row += src_stride;
-   }
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      true /* eac_alpha */, false /* punchthrough_alpha */,
+                      true /* bgra */);
 }
 
 static void
@@ -1024,32 +1143,9 @@ etc2_unpack_rgb8_punchthrough_alpha1(uint8_t *dst_row,
                                      unsigned width,
                                      unsigned height)
 {
-   const unsigned bw = 4, bh = 4, bs = 8, comps = 4;
-   struct etc2_block block;
-   unsigned x, y, i, j;
-
-   for (y = 0; y < height; y += bh) {
-      const unsigned h = MIN2(bh, height - y);
-      const uint8_t *src = src_row;
-
-      for (x = 0; x < width; x+= bw) {
-         const unsigned w = MIN2(bw, width - x);
-         etc2_rgb8_parse_block(&block, src,
-                               true /* punchthrough_alpha */);
-         for (j = 0; j < h; j++) {
-            uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgb8_fetch_texel(&block, i, j, dst,
-                                     true /* punchthrough_alpha */);
-               dst += comps;
-            }
-         }
-
-         src += bs;
-      }
-
-      src_row += src_stride;
-   }
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      false /* eac_alpha */, true /* punchthrough_alpha */,
+                      false /* bgra */);
 }
 
 static void
@@ -1060,39 +1156,9 @@ etc2_unpack_srgb8_punchthrough_alpha1(uint8_t *dst_row,
                                      unsigned width,
                                      unsigned height)
 {
-   const unsigned bw = 4, bh = 4, bs = 8, comps = 4;
-   struct etc2_block block;
-   unsigned x, y, i, j;
-   uint8_t tmp;
-
-   for (y = 0; y < height; y += bh) {
-      const unsigned h = MIN2(bh, height - y);
-      const uint8_t *src = src_row;
-
-      for (x = 0; x < width; x+= bw) {
-         const unsigned w = MIN2(bw, width - x);
-         etc2_rgb8_parse_block(&block, src,
-                               true /* punchthrough_alpha */);
-         for (j = 0; j < h; j++) {
-            uint8_t *dst = dst_row + (y + j) * dst_stride + x * comps;
-            for (i = 0; i < w; i++) {
-               etc2_rgb8_fetch_texel(&block, i, j, dst,
-                                     true /* punchthrough_alpha */);
-               /* Convert to MESA_FORMAT_B8G8R8A8_SRGB */
-               tmp = dst[0];
-               dst[0] = dst[2];
-               dst[2] = tmp;
-               dst[3] = dst[3];
-
-               dst += comps;
-            }
-         }
-
-         src += bs;
-      }
-
-      src_row += src_stride;
-   }
+   etc2_unpack_blocks(dst_row, dst_stride, src_row, src_stride, width, height,
+                      false /* eac_alpha */, true /* punchthrough_alpha */,
+                      true /* bgra */);
 }
 
 /* ETC2 texture formats are valid in glCompressedTexImage2D and
@@ -1208,46 +1274,33 @@ _mesa_unpack_etc2_format(uint8_t *dst_row,
                          unsigned src_height,
                          mesa_format format)
 {
+   etc_unpack_func unpack;
+
    if (format == MESA_FORMAT_ETC2_RGB8)
-      etc2_unpack_rgb8(dst_row, dst_stride,
-                       src_row, src_stride,
-                       src_width, src_height);
+      unpack = etc2_unpack_rgb8;
    else if (format == MESA_FORMAT_ETC2_SRGB8)
-      etc2_unpack_srgb8(dst_row, dst_stride,
-                        src_row, src_stride,
-                        src_width, src_height);
+      unpack = etc2_unpack_srgb8;
    else if (format == MESA_FORMAT_ETC2_RGBA8_EAC)
-      etc2_unpack_rgba8(dst_row, dst_stride,
-                        src_row, src_stride,
-                        src_width, src_height);
+      unpack = etc2_unpack_rgba8;
    else if (format == MESA_FORMAT_ETC2_SRGB8_ALPHA8_EAC)
-      etc2_unpack_srgb8_alpha8(dst_row, dst_stride,
-                               src_row, src_stride,
-                               src_width, src_height);
+      unpack = etc2_unpack_srgb8_alpha8;
    else if (format == MESA_FORMAT_ETC2_R11_EAC)
-      etc2_unpack_r11(dst_row, dst_stride,
-                      src_row, src_stride,
-                      src_width, src_height);
+      unpack = etc2_unpack_r11;
    else if (format == MESA_FORMAT_ETC2_RG11_EAC)
-      etc2_unpack_rg11(dst_row, dst_stride,
-                       src_row, src_stride,
-                       src_width, src_height);
+      unpack = etc2_unpack_rg11;
    else if (format == MESA_FORMAT_ETC2_SIGNED_R11_EAC)
-      etc2_unpack_signed_r11(dst_row, dst_stride,
-                             src_row, src_stride,
-                             src_width, src_height);
+      unpack = etc2_unpack_signed_r11;
    else if (format == MESA_FORMAT_ETC2_SIGNED_RG11_EAC)
-      etc2_unpack_signed_rg11(dst_row, dst_stride,
-                              src_row, src_stride,
-                              src_width, src_height);
+      unpack = etc2_unpack_signed_rg11;
    else if (format == MESA_FORMAT_ETC2_RGB8_PUNCHTHROUGH_ALPHA1)
-      etc2_unpack_rgb8_punchthrough_alpha1(dst_row, dst_stride,
-                                           src_row, src_stride,
-                                           src_width, src_height);
+      unpack = etc2_unpack_rgb8_punchthrough_alpha1;
    else if (format == MESA_FORMAT_ETC2_SRGB8_PUNCHTHROUGH_ALPHA1)
-      etc2_unpack_srgb8_punchthrough_alpha1(dst_row, dst_stride,
-                                            src_row, src_stride,
-                                            src_width, src_height);
+      unpack = etc2_unpack_srgb8_punchthrough_alpha1;
+   else
+      return;
+
+   etc_unpack(unpack, dst_row, dst_stride, src_row, src_stride,
+              src_width, src_height);
 }
 
 
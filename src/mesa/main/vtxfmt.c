@@ -245,7 +245,7 @@ _mesa_install_exec_vtxfmt(struct gl_context *ctx, const GLvertexformat *vfmt)
 void
 _mesa_install_save_vtxfmt(struct gl_context *ctx, const GLvertexformat *vfmt)
 {
-   if (_mesa_is_desktop_gl(ctx))
+   if (_mesa_is_desktop_gl(ctx) && ctx->Save)
       install_vtxfmt(ctx, ctx->Save, vfmt);
 }
 
@@ -256,3 +256,23 @@ _mesa_shader_cache_insert(struct gl_context *ctx,
    c->next = cache->items[hash % cache->size];
    cache->items[hash % cache->size] = c;
 }
+
+
+/**
+ * Call the callback for each program of the cache, with the same signature
+ * as for _mesa_HashWalk() but a key of 0.
+ */
+void
+_mesa_program_cache_walk(struct gl_program_cache *cache,
+                         void (*callback)(GLuint key, void *data,
+                                          void *userData),
+                         void *userData)
+{
+   struct cache_item *c;
+   GLuint i;
+
+   for (i = 0; i < cache->size; i++) {
+      for (c = cache->items[i]; c; c = c->next)
+         callback(0, c->program, userData);
+   }
+}
@@ -70,6 +70,12 @@ _mesa_shader_cache_insert(struct gl_context *ctx,
 			  const void *key, GLuint keysize,
 			  struct gl_shader_program *program);
 
+extern void
+_mesa_program_cache_walk(struct gl_program_cache *cache,
+                         void (*callback)(GLuint key, void *data,
+                                          void *userData),
+                         void *userData);
+
 
 #ifdef __cplusplus
 }
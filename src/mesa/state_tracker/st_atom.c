@@ -26,13 +26,16 @@
  **************************************************************************/
 
 
+#include <inttypes.h>
 #include <stdio.h>
 #include "main/glheader.h"
 #include "main/context.h"
 
 #include "pipe/p_defines.h"
+#include "util/os_time.h"
 #include "st_context.h"
 #include "st_atom.h"
+#include "st_debug.h"
 #include "st_program.h"
 #include "st_manager.h"
 
@@ -46,16 +49,53 @@ static const update_func_t update_functions[] =
 #undef ST_STATE
 };
 
+static const char *const update_names[] =
+{
+#define ST_STATE(FLAG, st_update) #st_update,
+#include "st_atom_list.h"
+#undef ST_STATE
+};
+
 
 void st_init_atoms( struct st_context *st )
 {
    STATIC_ASSERT(ARRAY_SIZE(update_functions) <= 64);
+
+   if (ST_DEBUG & DEBUG_ATOMS)
+      st->atom_stats = calloc(ST_NUM_ATOMS, sizeof(*st->atom_stats));
 }
 
 
 void st_destroy_atoms( struct st_context *st )
 {
-   /* no-op */
+   if (!st->atom_stats)
+      return;
+
+   for (unsigned i = 0; i < ST_NUM_ATOMS; i++) {
+      if (st->atom_stats[i].calls) {
+         debug_printf("%s: %"PRIu64" calls, %.3f ms\n", update_names[i],
+                      st->atom_stats[i].calls,
+                      st->atom_stats[i].time / 1000000.0);
+      }
+   }
+
+   free(st->atom_stats);
+   st->atom_stats = NULL;
+}
+
+
+static void
+update_atoms_timed(struct st_context *st, uint64_t dirty)
+{
+   while (dirty) {
+      unsigned i = u_bit_scan64(&dirty);
+      int64_t start = os_time_get_nano();
+
+      update_functions[i](st);
+
+      st->atom_stats[i].time += os_time_get_nano() - start;
+      st->atom_stats[i].calls++;
+   }
 }
 
 
@@ -251,17 +291,21 @@ void st_validate_state( struct st_context *st, enum st_pipeline pipeline )
    if (!dirty)
       return;
 
-   dirty_lo = dirty;
-   dirty_hi = dirty >> 32;
+   if (unlikely(st->atom_stats)) {
+      update_atoms_timed(st, dirty);
+   } else {
+      dirty_lo = dirty;
+      dirty_hi = dirty >> 32;
 
-   /* Update states.
-    *
-    * Don't use u_bit_scan64, it may be slower on 32-bit.
-    */
-   while (dirty_lo)
-      update_functions[u_bit_scan(&dirty_lo)](st);
-   while (dirty_hi)
-      update_functions[32 + u_bit_scan(&dirty_hi)](st);
+      /* Update states.
+       *
+       * Don't use u_bit_scan64, it may be slower on 32-bit.
+       */
+      while (dirty_lo)
+         update_functions[u_bit_scan(&dirty_lo)](st);
+      while (dirty_hi)
+         update_functions[32 + u_bit_scan(&dirty_hi)](st);
+   }
 
    /* Clear the render or compute state bits. */
    st->dirty &= ~pipeline_mask;
@@ -63,6 +63,13 @@ enum {
 #define ST_STATE(FLAG, st_update) FLAG##_INDEX,
 #include "st_atom_list.h"
 #undef ST_STATE
+   ST_NUM_ATOMS
+};
+
+/** The updates of an atom, counted with ST_DEBUG=atoms */
+struct st_atom_stats {
+   uint64_t calls;
+   int64_t time;  /**< nanoseconds */
 };
 
 /* Define ST_NEW_xxx values as static const uint64_t values.
@@ -460,17 +460,17 @@ set_vertex_attribs(struct st_context *st,
 /**
  * Set up for drawing interleaved arrays that all live in one VBO
  * or all live in user space.
- * \param vbuffer  returns vertex buffer info
- * \param velements  returns vertex element info
+ * \param state  returns vertex buffer and element info
  */
 static void
 setup_interleaved_attribs(struct st_context *st,
                           const struct st_vertex_program *vp,
                           const struct gl_vertex_array *arrays,
-                          unsigned num_inputs)
+                          unsigned num_inputs,
+                          struct st_vertex_array_cache_entry *state)
 {
-   struct pipe_vertex_buffer vbuffer;
-   struct pipe_vertex_element velements[PIPE_MAX_ATTRIBS] = {{0}};
+   struct pipe_vertex_buffer *vbuffer = &state->vbuffers[0];
+   struct pipe_vertex_element *velements = state->velements;
    GLuint attr;
    const GLubyte *low_addr = NULL;
    GLboolean usingVBO;      /* all arrays in a VBO? */
@@ -548,12 +548,13 @@ setup_interleaved_attribs(struct st_context *st,
    /*
     * Return the vbuffer info and setup user-space attrib info, if needed.
     */
+   state->bufobjs[0] = NULL;
    if (num_inputs == 0) {
       /* just defensive coding here */
-      vbuffer.buffer.resource = NULL;
-      vbuffer.is_user_buffer = false;
-      vbuffer.buffer_offset = 0;
-      vbuffer.stride = 0;
+      vbuffer->buffer.resource = NULL;
+      vbuffer->is_user_buffer = false;
+      vbuffer->buffer_offset = 0;
+      vbuffer->stride = 0;
    }
    else if (usingVBO) {
       /* all interleaved arrays in a VBO */
@@ -564,41 +565,43 @@ setup_interleaved_attribs(struct st_context *st,
          return; /* out-of-memory error probably */
       }
 
-      vbuffer.buffer.resource = stobj->buffer;
-      vbuffer.is_user_buffer = false;
-      vbuffer.buffer_offset = pointer_to_offset(low_addr);
-      vbuffer.stride = stride;
+      vbuffer->buffer.resource = stobj->buffer;
+      vbuffer->is_user_buffer = false;
+      vbuffer->buffer_offset = pointer_to_offset(low_addr);
+      vbuffer->stride = stride;
+      state->bufobjs[0] = stobj;
    }
    else {
       /* all interleaved arrays in user memory */
-      vbuffer.buffer.user = low_addr;
-      vbuffer.is_user_buffer = !!low_addr; /* if NULL, then unbind */
-      vbuffer.buffer_offset = 0;
-      vbuffer.stride = stride;
+      vbuffer->buffer.user = low_addr;
+      vbuffer->is_user_buffer = !!low_addr; /* if NULL, then unbind */
+      vbuffer->buffer_offset = 0;
+      vbuffer->stride = stride;
 
       if (low_addr)
          st->draw_needs_minmax_index = true;
    }
 
-   set_vertex_attribs(st, &vbuffer, num_inputs ? 1 : 0,
+   state->num_vbuffers = num_inputs ? 1 : 0;
+   set_vertex_attribs(st, vbuffer, state->num_vbuffers,
                       velements, num_inputs);
 }
 
 /**
  * Set up a separate pipe_vertex_buffer and pipe_vertex_element for each
  * vertex attribute.
- * \param vbuffer  returns vertex buffer info
- * \param velements  returns vertex element info
+ * \param state  returns vertex buffer and element info
  */
 static void
 setup_non_interleaved_attribs(struct st_context *st,
                               const struct st_vertex_program *vp,
                               const struct gl_vertex_array *arrays,
-                              unsigned num_inputs)
+                              unsigned num_inputs,
+                              struct st_vertex_array_cache_entry *state)
 {
    struct gl_context *ctx = st->ctx;
-   struct pipe_vertex_buffer vbuffer[PIPE_MAX_ATTRIBS];
-   struct pipe_vertex_element velements[PIPE_MAX_ATTRIBS] = {{0}};
+   struct pipe_vertex_buffer *vbuffer = state->vbuffers;
+   struct pipe_vertex_element *velements = state->velements;
    unsigned num_vbuffers = 0;
    unsigned unref_buffers = 0;
    GLuint attr;
@@ -617,6 +620,7 @@ setup_non_interleaved_attribs(struct st_context *st,
       assert(array);
 
       bufidx = num_vbuffers++;
+      state->bufobjs[bufidx] = NULL;
 
       binding = array->BufferBinding;
       attrib = array->VertexAttrib;
@@ -639,6 +643,7 @@ setup_non_interleaved_attribs(struct st_context *st,
          vbuffer[bufidx].is_user_buffer = false;
          vbuffer[bufidx].buffer_offset =
             binding->Offset + attrib->RelativeOffset;
+         state->bufobjs[bufidx] = stobj;
       }
       else {
          if (stride == 0) {
@@ -696,6 +701,7 @@ setup_non_interleaved_attribs(struct st_context *st,
       u_upload_unmap(st->pipe->stream_uploader);
    }
 
+   state->num_vbuffers = num_vbuffers;
    set_vertex_attribs(st, vbuffer, num_vbuffers, velements, num_inputs);
 
    /* Unreference uploaded zero-stride vertex buffers. */
@@ -705,12 +711,75 @@ setup_non_interleaved_attribs(struct st_context *st,
    }
 }
 
+/**
+ * Whether all the inputs are arrays of the draw VAO in buffer objects, which
+ * only change with the VAO.  The current values and the user arrays can
+ * change without it.
+ */
+static bool
+arrays_cacheable(const struct st_vertex_program *vp,
+                 const struct gl_vertex_array *arrays,
+                 unsigned num_inputs, GLbitfield enabled)
+{
+   for (unsigned attr = 0; attr < num_inputs; attr++) {
+      const unsigned mesaAttr = vp->index_to_input[attr];
+
+      if (mesaAttr == ST_DOUBLE_ATTRIB_PLACEHOLDER)
+         continue;
+
+      if (!(enabled & VERT_BIT(mesaAttr)) ||
+          !_mesa_is_bufferobj(arrays[mesaAttr].BufferBinding->BufferObj))
+         return false;
+   }
+
+   return true;
+}
+
+static struct st_vertex_array_cache_entry *
+find_cached_arrays(struct st_context *st,
+                   const struct st_vertex_program *vp,
+                   unsigned num_inputs, GLuint vao_stamp, GLbitfield enabled)
+{
+   for (unsigned i = 0; i < NUM_VERTEX_ARRAY_CACHE_ENTRIES; i++) {
+      struct st_vertex_array_cache_entry *entry = &st->vertex_array_cache[i];
+
+      if (entry->vao_stamp == vao_stamp &&
+          entry->enabled == enabled &&
+          entry->num_inputs == num_inputs &&
+          !memcmp(entry->index_to_input, vp->index_to_input, num_inputs))
+         return entry;
+   }
+
+   return NULL;
+}
+
+/**
+ * The VAO holds references to the buffer objects, but their storage may have
+ * been reallocated since the entry was filled.
+ */
+static bool
+cached_buffers_valid(const struct st_vertex_array_cache_entry *entry)
+{
+   for (unsigned i = 0; i < entry->num_vbuffers; i++) {
+      if (!entry->bufobjs[i] ||
+          entry->bufobjs[i]->buffer != entry->vbuffers[i].buffer.resource)
+         return false;
+   }
+
+   return true;
+}
+
 void st_update_array(struct st_context *st)
 {
    struct gl_context *ctx = st->ctx;
    const struct gl_vertex_array *arrays = ctx->Array._DrawArrays;
+   const struct gl_vertex_array_object *vao = ctx->Array._DrawVAO;
+   const GLbitfield enabled = ctx->Array._DrawVAOEnabledAttribs;
    const struct st_vertex_program *vp;
+   struct st_vertex_array_cache_entry *entry = NULL;
+   struct st_vertex_array_cache_entry state;
    unsigned num_inputs;
+   bool cacheable;
 
    st->vertex_array_out_of_memory = FALSE;
    st->draw_needs_minmax_index = false;
@@ -723,8 +792,39 @@ void st_update_array(struct st_context *st)
    vp = st->vp;
    num_inputs = st->vp_variant->num_inputs;
 
+   /* Switching between a few VAOs reuses what was derived from them. */
+   cacheable = arrays_cacheable(vp, arrays, num_inputs, enabled);
+   if (cacheable) {
+      entry = find_cached_arrays(st, vp, num_inputs, vao->Stamp, enabled);
+      if (entry && cached_buffers_valid(entry)) {
+         set_vertex_attribs(st, entry->vbuffers, entry->num_vbuffers,
+                            entry->velements, num_inputs);
+         return;
+      }
+   }
+
+   memset(state.velements, 0, sizeof(state.velements));
+
    if (is_interleaved_arrays(vp, arrays, num_inputs))
-      setup_interleaved_attribs(st, vp, arrays, num_inputs);
+      setup_interleaved_attribs(st, vp, arrays, num_inputs, &state);
    else
-      setup_non_interleaved_attribs(st, vp, arrays, num_inputs);
+      setup_non_interleaved_attribs(st, vp, arrays, num_inputs, &state);
+
+   if (!cacheable || st->vertex_array_out_of_memory)
+      return;
+
+   /* replace the stale entry of the VAO, or the oldest one */
+   if (!entry) {
+      entry = &st->vertex_array_cache[st->next_vertex_array_cache_entry];
+      st->next_vertex_array_cache_entry =
+         (st->next_vertex_array_cache_entry + 1) %
+         NUM_VERTEX_ARRAY_CACHE_ENTRIES;
+   }
+
+   state.vao_stamp = vao->Stamp;
+   state.enabled = enabled;
+   state.num_inputs = num_inputs;
+   memcpy(state.index_to_input, vp->index_to_input,
+          sizeof(state.index_to_input));
+   *entry = state;
 }
@@ -48,6 +48,43 @@
 #include "st_program.h"
 #include "st_cb_bufferobjects.h"
 
+/**
+ * Whether the values of the parameters are the ones last bound.  Uniforms
+ * set to the values they already had, and the state parameters updated
+ * along with others, don't make drivers upload everything again.
+ */
+static bool
+constants_unchanged(struct st_context *st, enum pipe_shader_type shader_type,
+                    const struct gl_program_parameter_list *params,
+                    unsigned size)
+{
+   const void *shadow = st->state.constants[shader_type].shadow;
+
+   return st->state.constants[shader_type].ptr == params->ParameterValues &&
+          st->state.constants[shader_type].size == size &&
+          st->state.constants[shader_type].shadow_size >= size &&
+          !memcmp(shadow, params->ParameterValues, size);
+}
+
+static void
+update_constants_shadow(struct st_context *st,
+                        enum pipe_shader_type shader_type,
+                        const struct gl_program_parameter_list *params,
+                        unsigned size)
+{
+   if (st->state.constants[shader_type].shadow_size < size) {
+      free(st->state.constants[shader_type].shadow);
+      st->state.constants[shader_type].shadow = malloc(size);
+      st->state.constants[shader_type].shadow_size =
+         st->state.constants[shader_type].shadow ? size : 0;
+   }
+
+   if (st->state.constants[shader_type].shadow_size >= size) {
+      memcpy(st->state.constants[shader_type].shadow,
+             params->ParameterValues, size);
+   }
+}
+
 /**
  * Pass the given program parameters to the graphics pipe as a
  * constant buffer.
@@ -104,6 +141,9 @@ st_upload_constants(struct st_context *st, struct gl_program *prog)
 
       _mesa_shader_write_subroutine_indices(st->ctx, stage);
 
+      if (constants_unchanged(st, shader_type, params, paramBytes))
+         return;
+
       cb.buffer = NULL;
       cb.user_buffer = params->ParameterValues;
       cb.buffer_offset = 0;
@@ -121,6 +161,7 @@ st_upload_constants(struct st_context *st, struct gl_program *prog)
 
       st->state.constants[shader_type].ptr = params->ParameterValues;
       st->state.constants[shader_type].size = paramBytes;
+      update_constants_shadow(st, shader_type, params, paramBytes);
    }
    else if (st->state.constants[shader_type].ptr) {
       /* Unbind. */
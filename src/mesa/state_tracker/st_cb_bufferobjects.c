@@ -266,6 +266,165 @@ buffer_usage(GLenum target, GLboolean immutable,
 }
 
 
+/**
+ * The current buffer may be bound, so we have to revalidate all atoms that
+ * might be using it.
+ */
+static void
+buffer_storage_changed(struct gl_context *ctx, struct st_buffer_object *st_obj)
+{
+   /* TODO: Add arrays to usage history */
+   ctx->NewDriverState |= ST_NEW_VERTEX_ARRAYS;
+   if (st_obj->Base.UsageHistory & USAGE_UNIFORM_BUFFER)
+      ctx->NewDriverState |= ST_NEW_UNIFORM_BUFFER;
+   if (st_obj->Base.UsageHistory & USAGE_SHADER_STORAGE_BUFFER)
+      ctx->NewDriverState |= ST_NEW_STORAGE_BUFFER;
+   if (st_obj->Base.UsageHistory & USAGE_TEXTURE_BUFFER)
+      ctx->NewDriverState |= ST_NEW_SAMPLER_VIEWS | ST_NEW_IMAGE_UNITS;
+   if (st_obj->Base.UsageHistory & USAGE_ATOMIC_COUNTER_BUFFER)
+      ctx->NewDriverState |= ctx->DriverFlags.NewAtomicBuffer;
+}
+
+
+/**
+ * Return idle storage like templ, the storage of an orphaned buffer the GPU
+ * is done with if there is one.  Storage still referenced elsewhere, by a
+ * stream output target or a view for example, may still be written or read
+ * by work the fence doesn't cover, so it isn't reused.
+ */
+static struct pipe_resource *
+orphaned_buffer_get(struct st_context *st, const struct pipe_resource *templ)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+
+   for (unsigned i = 0; i < st->orphaned_buffers.num; i++) {
+      struct st_orphaned_buffer *entry = &st->orphaned_buffers.entries[i];
+      struct pipe_resource *buffer = entry->buffer;
+
+      if (!entry->fence ||
+          p_atomic_read(&buffer->reference.count) != 1 ||
+          buffer->width0 != templ->width0 ||
+          buffer->bind != templ->bind ||
+          buffer->usage != templ->usage ||
+          buffer->flags != templ->flags ||
+          !screen->fence_finish(screen, NULL, entry->fence, 0))
+         continue;
+
+      screen->fence_reference(screen, &entry->fence, NULL);
+      st->orphaned_buffers.num--;
+      memmove(entry, entry + 1,
+              (st->orphaned_buffers.num - i) * sizeof(*entry));
+      return buffer;
+   }
+
+   return screen->resource_create(screen, templ);
+}
+
+
+/**
+ * Keep the storage of an orphaned buffer until the next flush fences it,
+ * dropping the oldest one when the pool is full.  The entries are in the
+ * order they were orphaned, the unfenced ones last.
+ */
+static void
+orphaned_buffer_put(struct st_context *st, struct pipe_resource *buffer)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+   struct st_orphaned_buffer *entries = st->orphaned_buffers.entries;
+
+   if (st->orphaned_buffers.num == NUM_ORPHANED_BUFFERS) {
+      if (entries[0].fence)
+         screen->fence_reference(screen, &entries[0].fence, NULL);
+      else
+         st->orphaned_buffers.num_unfenced--;
+      pipe_resource_reference(&entries[0].buffer, NULL);
+
+      st->orphaned_buffers.num--;
+      memmove(entries, entries + 1,
+              st->orphaned_buffers.num * sizeof(*entries));
+   }
+
+   entries[st->orphaned_buffers.num].buffer = buffer;
+   entries[st->orphaned_buffers.num].fence = NULL;
+   st->orphaned_buffers.num++;
+   st->orphaned_buffers.num_unfenced++;
+}
+
+
+/**
+ * Called by st_flush() with the fence of the flush, which the storage
+ * orphaned since the previous flush is idle after.
+ */
+void
+st_fence_orphaned_buffers(struct st_context *st,
+                          struct pipe_fence_handle *fence)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+
+   for (unsigned i = st->orphaned_buffers.num -
+                     st->orphaned_buffers.num_unfenced;
+        i < st->orphaned_buffers.num; i++)
+      screen->fence_reference(screen, &st->orphaned_buffers.entries[i].fence,
+                              fence);
+
+   st->orphaned_buffers.num_unfenced = 0;
+}
+
+
+void
+st_destroy_orphaned_buffers(struct st_context *st)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+
+   for (unsigned i = 0; i < st->orphaned_buffers.num; i++) {
+      struct st_orphaned_buffer *entry = &st->orphaned_buffers.entries[i];
+
+      if (entry->fence)
+         screen->fence_reference(screen, &entry->fence, NULL);
+      pipe_resource_reference(&entry->buffer, NULL);
+   }
+
+   st->orphaned_buffers.num = 0;
+   st->orphaned_buffers.num_unfenced = 0;
+}
+
+
+/**
+ * Give a buffer whose whole contents are about to be replaced idle storage,
+ * so that the write doesn't wait for the GPU to be done with the old
+ * contents.  The old storage is reused once the GPU is done with it.  This
+ * is for the drivers which can't invalidate buffers themselves.
+ * \return true if the storage was replaced
+ */
+static bool
+bufferobj_orphan(struct gl_context *ctx, struct st_buffer_object *st_obj)
+{
+   struct st_context *st = st_context(ctx);
+   struct pipe_resource *old = st_obj->buffer;
+
+   if (st->has_invalidate_buffer || !old || st_obj->imported)
+      return false;
+
+   /* the fences of this context don't cover the work of the others */
+   if (ctx->Shared->RefCount > 1)
+      return false;
+
+   struct pipe_resource *buffer = orphaned_buffer_get(st, old);
+   if (!buffer)
+      return false;
+
+   if (ST_DEBUG & DEBUG_BUFFER) {
+      debug_printf("Orphan buffer size %u bind 0x%x\n",
+                   old->width0, old->bind);
+   }
+
+   orphaned_buffer_put(st, old);
+   st_obj->buffer = buffer;
+   buffer_storage_changed(ctx, st_obj);
+   return true;
+}
+
+
 static ALWAYS_INLINE GLboolean
 bufferobj_data(struct gl_context *ctx,
                GLenum target,
@@ -293,19 +452,29 @@ bufferobj_data(struct gl_context *ctx,
           * This should be the same as creating a new buffer, but we avoid
           * a lot of validation in Mesa.
           */
-         pipe->buffer_subdata(pipe, st_obj->buffer,
-                              PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE,
-                              0, size, data);
+         if (bufferobj_orphan(ctx, st_obj)) {
+            pipe->buffer_subdata(pipe, st_obj->buffer,
+                                 PIPE_TRANSFER_UNSYNCHRONIZED,
+                                 0, size, data);
+         } else {
+            pipe->buffer_subdata(pipe, st_obj->buffer,
+                                 PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE,
+                                 0, size, data);
+         }
          return GL_TRUE;
-      } else if (screen->get_param(screen, PIPE_CAP_INVALIDATE_BUFFER)) {
+      } else if (st->has_invalidate_buffer) {
          pipe->invalidate_resource(pipe, st_obj->buffer);
          return GL_TRUE;
+      } else if (bufferobj_orphan(ctx, st_obj)) {
+         return GL_TRUE;
       }
    }
 
    st_obj->Base.Size = size;
    st_obj->Base.Usage = usage;
    st_obj->Base.StorageFlags = storageFlags;
+   st_obj->imported = st_mem_obj ||
+                      target == GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD;
 
    pipe_resource_reference( &st_obj->buffer, NULL );
 
@@ -354,20 +523,7 @@ bufferobj_data(struct gl_context *ctx,
       }
    }
 
-   /* The current buffer may be bound, so we have to revalidate all atoms that
-    * might be using it.
-    */
-   /* TODO: Add arrays to usage history */
-   ctx->NewDriverState |= ST_NEW_VERTEX_ARRAYS;
-   if (st_obj->Base.UsageHistory & USAGE_UNIFORM_BUFFER)
-      ctx->NewDriverState |= ST_NEW_UNIFORM_BUFFER;
-   if (st_obj->Base.UsageHistory & USAGE_SHADER_STORAGE_BUFFER)
-      ctx->NewDriverState |= ST_NEW_STORAGE_BUFFER;
-   if (st_obj->Base.UsageHistory & USAGE_TEXTURE_BUFFER)
-      ctx->NewDriverState |= ST_NEW_SAMPLER_VIEWS | ST_NEW_IMAGE_UNITS;
-   if (st_obj->Base.UsageHistory & USAGE_ATOMIC_COUNTER_BUFFER)
-      ctx->NewDriverState |= ctx->DriverFlags.NewAtomicBuffer;
-
+   buffer_storage_changed(ctx, st_obj);
    return GL_TRUE;
 }
 
@@ -491,10 +647,21 @@ st_bufferobj_map_range(struct gl_context *ctx,
    assert(offset < obj->Size);
    assert(offset + length <= obj->Size);
 
-   const enum pipe_transfer_usage transfer_flags =
+   enum pipe_transfer_usage transfer_flags =
       st_access_flags_to_transfer_flags(access,
                                         offset == 0 && length == obj->Size);
 
+   /* The storage can't be replaced under the other mappings. */
+   if ((transfer_flags & PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE) &&
+       !(transfer_flags & (PIPE_TRANSFER_UNSYNCHRONIZED |
+                           PIPE_TRANSFER_PERSISTENT)) &&
+       !_mesa_bufferobj_mapped(obj, MAP_USER) &&
+       !_mesa_bufferobj_mapped(obj, MAP_INTERNAL) &&
+       bufferobj_orphan(ctx, st_obj)) {
+      transfer_flags &= ~PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE;
+      transfer_flags |= PIPE_TRANSFER_UNSYNCHRONIZED;
+   }
+
    obj->Mappings[index].Pointer = pipe_buffer_map_range(pipe,
                                                         st_obj->buffer,
                                                         offset, length,
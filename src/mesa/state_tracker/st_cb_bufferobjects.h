@@ -31,6 +31,7 @@
 #include "main/mtypes.h"
 
 struct dd_function_table;
+struct pipe_fence_handle;
 struct pipe_resource;
 struct pipe_screen;
 struct st_context;
@@ -44,6 +45,11 @@ struct st_buffer_object
    struct gl_buffer_object Base;
    struct pipe_resource *buffer;     /* GPU storage */
    struct pipe_transfer *transfer[MAP_COUNT];
+
+   /** The storage comes from a memory object or user memory and can't be
+    * replaced by fresh storage when the buffer is orphaned.
+    */
+   bool imported;
 };
 
 
@@ -59,6 +65,14 @@ enum pipe_transfer_usage
 st_access_flags_to_transfer_flags(GLbitfield access, bool wholeBuffer);
 
 
+extern void
+st_fence_orphaned_buffers(struct st_context *st,
+                          struct pipe_fence_handle *fence);
+
+extern void
+st_destroy_orphaned_buffers(struct st_context *st);
+
+
 extern void
 st_init_bufferobject_functions(struct pipe_screen *screen,
                                struct dd_function_table *functions);
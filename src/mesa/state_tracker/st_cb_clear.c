@@ -303,6 +303,55 @@ clear_with_quad(struct gl_context *ctx, unsigned clear_buffers)
 }
 
 
+/**
+ * Clear the scissor rectangle of the bound surfaces with
+ * pipe->clear_render_target and pipe->clear_depth_stencil, which don't
+ * need any of the draw state.
+ */
+static void
+clear_with_surfaces(struct gl_context *ctx, unsigned clear_buffers)
+{
+   struct st_context *st = st_context(ctx);
+   struct pipe_context *pipe = st->pipe;
+   struct gl_framebuffer *fb = ctx->DrawBuffer;
+   struct st_renderbuffer *strb;
+   unsigned i;
+
+   _mesa_update_draw_buffer_bounds(ctx, fb);
+
+   if (fb->_Xmin >= fb->_Xmax || fb->_Ymin >= fb->_Ymax)
+      return;
+
+   const unsigned x = fb->_Xmin;
+   const unsigned width = fb->_Xmax - fb->_Xmin;
+   const unsigned height = fb->_Ymax - fb->_Ymin;
+   const unsigned y = st_fb_orientation(fb) == Y_0_TOP ?
+      fb->Height - fb->_Ymax : fb->_Ymin;
+
+   /* the surfaces of the framebuffer state, see st_atom_framebuffer.c */
+   for (i = 0; i < fb->_NumColorDrawBuffers; i++) {
+      if (!(clear_buffers & (PIPE_CLEAR_COLOR0 << i)))
+         continue;
+
+      strb = st_renderbuffer(fb->_ColorDrawBuffers[i]);
+      pipe->clear_render_target(pipe, strb->surface,
+                                (union pipe_color_union*)&ctx->Color.ClearColor,
+                                x, y, width, height, true);
+   }
+
+   strb = st_renderbuffer(fb->Attachment[BUFFER_DEPTH].Renderbuffer);
+   if (!strb)
+      strb = st_renderbuffer(fb->Attachment[BUFFER_STENCIL].Renderbuffer);
+
+   if (clear_buffers & PIPE_CLEAR_DEPTHSTENCIL) {
+      pipe->clear_depth_stencil(pipe, strb->surface,
+                                clear_buffers & PIPE_CLEAR_DEPTHSTENCIL,
+                                ctx->Depth.Clear, ctx->Stencil.Clear,
+                                x, y, width, height, true);
+   }
+}
+
+
 /**
  * Return if the scissor must be enabled during the clear.
  */
@@ -369,6 +418,7 @@ st_Clear(struct gl_context *ctx, GLbitfield mask)
    struct gl_renderbuffer *stencilRb
       = ctx->DrawBuffer->Attachment[BUFFER_STENCIL].Renderbuffer;
    GLbitfield quad_buffers = 0x0;
+   GLbitfield scissor_buffers = 0x0;
    GLbitfield clear_buffers = 0x0;
    GLuint i;
 
@@ -394,10 +444,11 @@ st_Clear(struct gl_context *ctx, GLbitfield mask)
             if (!GET_COLORMASK(ctx->Color.ColorMask, colormask_index))
                continue;
 
-            if (is_scissor_enabled(ctx, rb) ||
-                is_window_rectangle_enabled(ctx) ||
+            if (is_window_rectangle_enabled(ctx) ||
                 GET_COLORMASK(ctx->Color.ColorMask, colormask_index) != 0xf)
                quad_buffers |= PIPE_CLEAR_COLOR0 << i;
+            else if (is_scissor_enabled(ctx, rb))
+               scissor_buffers |= PIPE_CLEAR_COLOR0 << i;
             else
                clear_buffers |= PIPE_CLEAR_COLOR0 << i;
          }
@@ -408,9 +459,10 @@ st_Clear(struct gl_context *ctx, GLbitfield mask)
       struct st_renderbuffer *strb = st_renderbuffer(depthRb);
 
       if (strb->surface && ctx->Depth.Mask) {
-         if (is_scissor_enabled(ctx, depthRb) ||
-             is_window_rectangle_enabled(ctx))
+         if (is_window_rectangle_enabled(ctx))
             quad_buffers |= PIPE_CLEAR_DEPTH;
+         else if (is_scissor_enabled(ctx, depthRb))
+            scissor_buffers |= PIPE_CLEAR_DEPTH;
          else
             clear_buffers |= PIPE_CLEAR_DEPTH;
       }
@@ -419,21 +471,37 @@ st_Clear(struct gl_context *ctx, GLbitfield mask)
       struct st_renderbuffer *strb = st_renderbuffer(stencilRb);
 
       if (strb->surface && !is_stencil_disabled(ctx, stencilRb)) {
-         if (is_scissor_enabled(ctx, stencilRb) ||
-             is_window_rectangle_enabled(ctx) ||
+         if (is_window_rectangle_enabled(ctx) ||
              is_stencil_masked(ctx, stencilRb))
             quad_buffers |= PIPE_CLEAR_STENCIL;
+         else if (is_scissor_enabled(ctx, stencilRb))
+            scissor_buffers |= PIPE_CLEAR_STENCIL;
          else
             clear_buffers |= PIPE_CLEAR_STENCIL;
       }
    }
 
+   /* Scissored clears of the layers of a layered framebuffer, or without
+    * a cheap way to clear a rect of the surfaces, draw a quad.
+    */
+   if (!st->has_clear_scissored || st->state.fb_num_layers > 1) {
+      quad_buffers |= scissor_buffers;
+      scissor_buffers = 0x0;
+   }
+
    /* Always clear depth and stencil together.
     * This can only happen when the stencil writemask is not a full mask.
     */
    if (quad_buffers & PIPE_CLEAR_DEPTHSTENCIL &&
+       (scissor_buffers | clear_buffers) & PIPE_CLEAR_DEPTHSTENCIL) {
+      quad_buffers |= (scissor_buffers | clear_buffers) &
+                      PIPE_CLEAR_DEPTHSTENCIL;
+      scissor_buffers &= ~PIPE_CLEAR_DEPTHSTENCIL;
+      clear_buffers &= ~PIPE_CLEAR_DEPTHSTENCIL;
+   }
+   if (scissor_buffers & PIPE_CLEAR_DEPTHSTENCIL &&
        clear_buffers & PIPE_CLEAR_DEPTHSTENCIL) {
-      quad_buffers |= clear_buffers & PIPE_CLEAR_DEPTHSTENCIL;
+      scissor_buffers |= clear_buffers & PIPE_CLEAR_DEPTHSTENCIL;
       clear_buffers &= ~PIPE_CLEAR_DEPTHSTENCIL;
    }
 
@@ -444,6 +512,9 @@ st_Clear(struct gl_context *ctx, GLbitfield mask)
    if (quad_buffers) {
       clear_with_quad(ctx, quad_buffers);
    }
+   if (scissor_buffers) {
+      clear_with_surfaces(ctx, scissor_buffers);
+   }
    if (clear_buffers) {
       /* We can't translate the clear color to the colorbuffer format,
        * because different colorbuffers may have different formats.
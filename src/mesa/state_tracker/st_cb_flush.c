@@ -36,6 +36,7 @@
 #include "main/context.h"
 #include "st_context.h"
 #include "st_cb_bitmap.h"
+#include "st_cb_bufferobjects.h"
 #include "st_cb_flush.h"
 #include "st_cb_clear.h"
 #include "st_cb_fbo.h"
@@ -50,9 +51,21 @@ void st_flush(struct st_context *st,
               struct pipe_fence_handle **fence,
               unsigned flags)
 {
+   struct pipe_fence_handle *orphan_fence = NULL;
+
    st_flush_bitmap_cache(st);
 
+   /* The orphaned buffers need a fence to know when they are idle. */
+   if (!fence && st->orphaned_buffers.num_unfenced)
+      fence = &orphan_fence;
+
    st->pipe->flush(st->pipe, fence, flags);
+
+   if (fence && *fence)
+      st_fence_orphaned_buffers(st, *fence);
+
+   if (orphan_fence)
+      st->pipe->screen->fence_reference(st->pipe->screen, &orphan_fence, NULL);
 }
 
 
@@ -61,11 +61,13 @@ st_new_program(struct gl_context *ctx, GLenum target, GLuint id,
    case GL_VERTEX_PROGRAM_ARB: {
       struct st_vertex_program *prog = rzalloc(NULL,
                                                struct st_vertex_program);
+      simple_mtx_init(&prog->variant_mutex, mtx_plain);
       return _mesa_init_gl_program(&prog->Base, target, id, is_arb_asm);
    }
    case GL_FRAGMENT_PROGRAM_ARB: {
       struct st_fragment_program *prog = rzalloc(NULL,
                                                  struct st_fragment_program);
+      simple_mtx_init(&prog->variant_mutex, mtx_plain);
       return _mesa_init_gl_program(&prog->Base, target, id, is_arb_asm);
    }
    case GL_TESS_CONTROL_PROGRAM_NV:
@@ -100,6 +102,7 @@ st_delete_program(struct gl_context *ctx, struct gl_program *prog)
       {
          struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
          st_release_vp_variants( st, stvp );
+         simple_mtx_destroy(&stvp->variant_mutex);
          
          if (stvp->glsl_to_tgsi)
             free_glsl_to_tgsi_visitor(stvp->glsl_to_tgsi);
@@ -124,6 +127,7 @@ st_delete_program(struct gl_context *ctx, struct gl_program *prog)
             (struct st_fragment_program *) prog;
 
          st_release_fp_variants(st, stfp);
+         simple_mtx_destroy(&stfp->variant_mutex);
          
          if (stfp->glsl_to_tgsi)
             free_glsl_to_tgsi_visitor(stfp->glsl_to_tgsi);
@@ -266,12 +266,16 @@ st_destroy_context_priv(struct st_context *st, bool destroy_pipe)
    st_destroy_pbo_helpers(st);
    st_destroy_bound_texture_handles(st);
    st_destroy_bound_image_handles(st);
+   st_destroy_orphaned_buffers(st);
 
    for (i = 0; i < ARRAY_SIZE(st->state.frag_sampler_views); i++) {
       pipe_sampler_view_release(st->pipe,
                                 &st->state.frag_sampler_views[i]);
    }
 
+   for (i = 0; i < ARRAY_SIZE(st->state.constants); i++)
+      free(st->state.constants[i].shadow);
+
    /* free glReadPixels cache data */
    st_invalidate_readpix_cache(st);
 
@@ -463,6 +467,10 @@ st_create_context_priv(struct gl_context *ctx, struct pipe_context *pipe,
       screen->get_param(screen, PIPE_CAP_TGSI_PACK_HALF_FLOAT);
    st->has_multi_draw_indirect =
       screen->get_param(screen, PIPE_CAP_MULTI_DRAW_INDIRECT);
+   st->has_invalidate_buffer =
+      screen->get_param(screen, PIPE_CAP_INVALIDATE_BUFFER);
+   st->has_clear_scissored =
+      screen->get_param(screen, PIPE_CAP_CLEAR_SCISSORED);
 
    st->has_hw_atomics =
       screen->get_shader_param(screen, PIPE_SHADER_FRAGMENT,
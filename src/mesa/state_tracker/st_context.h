@@ -46,6 +46,7 @@ struct dd_function_table;
 struct draw_context;
 struct draw_stage;
 struct gen_mipmap_state;
+struct st_buffer_object;
 struct st_context;
 struct st_fragment_program;
 struct st_perf_monitor_group;
@@ -89,6 +90,18 @@ struct st_bound_handles
 
 
 #define NUM_DRAWPIX_CACHE_ENTRIES 4
+#define NUM_ORPHANED_BUFFERS 16
+#define NUM_VERTEX_ARRAY_CACHE_ENTRIES 4
+
+/**
+ * Storage of an orphaned buffer object, reused for another buffer once the
+ * GPU is done with it.
+ */
+struct st_orphaned_buffer
+{
+   struct pipe_resource *buffer;
+   struct pipe_fence_handle *fence;  /**< NULL until the next flush */
+};
 
 struct drawpix_cache_entry
 {
@@ -100,6 +113,24 @@ struct drawpix_cache_entry
    unsigned age;
 };
 
+/**
+ * The vertex buffers and elements derived from the arrays of a VAO, see
+ * st_atom_array.c.  The resources of the buffers aren't referenced, they are
+ * checked against the storage of the buffer objects when reused.
+ */
+struct st_vertex_array_cache_entry
+{
+   GLuint vao_stamp;       /**< 0 for an unused entry */
+   GLbitfield enabled;
+   unsigned num_inputs;
+   ubyte index_to_input[PIPE_MAX_ATTRIBS];
+
+   unsigned num_vbuffers;
+   struct pipe_vertex_buffer vbuffers[PIPE_MAX_ATTRIBS];
+   const struct st_buffer_object *bufobjs[PIPE_MAX_ATTRIBS];
+   struct pipe_vertex_element velements[PIPE_MAX_ATTRIBS];
+};
+
 
 struct st_context
 {
@@ -144,6 +175,8 @@ struct st_context
    boolean draw_needs_minmax_index;
    boolean vertex_array_out_of_memory;
    boolean has_hw_atomics;
+   boolean has_invalidate_buffer;
+   boolean has_clear_scissored;
 
    /* Some state is contained in constant objects.
     * Other state is just parameter values.
@@ -160,6 +193,8 @@ struct st_context
       struct {
          void *ptr;
          unsigned size;
+         void *shadow;          /**< copy of the values last bound */
+         unsigned shadow_size;  /**< allocated size of shadow */
       } constants[PIPE_SHADER_TYPES];
       unsigned fb_width;
       unsigned fb_height;
@@ -182,6 +217,9 @@ struct st_context
 
    uint64_t dirty; /**< dirty states */
 
+   /** ST_NUM_ATOMS counters, NULL unless ST_DEBUG=atoms */
+   struct st_atom_stats *atom_stats;
+
    /** This masks out unused shader resources. Only valid in draw calls. */
    uint64_t active_states;
 
@@ -230,6 +268,13 @@ struct st_context
       unsigned age;
    } drawpix_cache;
 
+   /** Buffer storage orphaned by glBufferData and glMapBufferRange */
+   struct {
+      struct st_orphaned_buffer entries[NUM_ORPHANED_BUFFERS];
+      unsigned num;
+      unsigned num_unfenced;
+   } orphaned_buffers;
+
    /** for glReadPixels */
    struct {
       struct pipe_resource *src;
@@ -279,6 +324,11 @@ struct st_context
    /* The number of vertex buffers from the last call of validate_arrays. */
    unsigned last_num_vbuffers;
 
+   /* The vertex arrays state of the last VAOs drawn with. */
+   struct st_vertex_array_cache_entry
+      vertex_array_cache[NUM_VERTEX_ARRAY_CACHE_ENTRIES];
+   unsigned next_vertex_array_cache_entry;
+
    int32_t draw_stamp;
    int32_t read_stamp;
 
@@ -44,6 +44,7 @@
 #include "compiler/glsl_types.h"
 #include "compiler/glsl/glsl_to_nir.h"
 #include "compiler/glsl/ir.h"
+#include "compiler/glsl/program.h"
 #include "compiler/glsl/string_to_uint_map.h"
 
 
@@ -316,37 +317,37 @@ st_nir_assign_uniform_locations(struct gl_context *ctx,
 static void
 st_nir_opts(nir_shader *nir)
 {
-   bool progress;
-   do {
-      progress = false;
-
-      NIR_PASS_V(nir, nir_lower_vars_to_ssa);
-      NIR_PASS_V(nir, nir_lower_alu_to_scalar);
-      NIR_PASS_V(nir, nir_lower_phis_to_scalar);
-
-      NIR_PASS_V(nir, nir_lower_64bit_pack);
-      NIR_PASS(progress, nir, nir_copy_prop);
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
-      NIR_PASS(progress, nir, nir_opt_dce);
-      if (nir_opt_trivial_continues(nir)) {
-         progress = true;
-         NIR_PASS(progress, nir, nir_copy_prop);
-         NIR_PASS(progress, nir, nir_opt_dce);
-      }
-      NIR_PASS(progress, nir, nir_opt_if);
-      NIR_PASS(progress, nir, nir_opt_dead_cf);
-      NIR_PASS(progress, nir, nir_opt_cse);
-      NIR_PASS(progress, nir, nir_opt_peephole_select, 8);
-
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
-
-      NIR_PASS(progress, nir, nir_opt_undef);
-      NIR_PASS(progress, nir, nir_opt_conditional_discard);
+   nir_pass_loop loop;
+
+   nir_pass_loop_init(&loop);
+   while (nir_pass_loop_iterate(&loop)) {
+      NIR_LOOP_PASS_V(&loop, nir, nir_lower_vars_to_ssa);
+      NIR_LOOP_PASS_V(&loop, nir, nir_lower_alu_to_scalar);
+      NIR_LOOP_PASS_V(&loop, nir, nir_lower_phis_to_scalar);
+
+      NIR_LOOP_PASS_V(&loop, nir, nir_lower_64bit_pack);
+      NIR_LOOP_PASS(&loop, nir, nir_copy_prop);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_remove_phis);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_dce);
+      /* copy_prop and dce are skipped again unless this made progress */
+      NIR_LOOP_PASS(&loop, nir, nir_opt_trivial_continues);
+      NIR_LOOP_PASS(&loop, nir, nir_copy_prop);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_dce);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_if);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_dead_cf);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_cse);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_peephole_select, 8);
+
+      NIR_LOOP_PASS(&loop, nir, nir_opt_algebraic);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_constant_folding);
+
+      NIR_LOOP_PASS(&loop, nir, nir_opt_undef);
+      NIR_LOOP_PASS(&loop, nir, nir_opt_conditional_discard);
       if (nir->options->max_unroll_iterations) {
-         NIR_PASS(progress, nir, nir_opt_loop_unroll, (nir_variable_mode)0);
+         NIR_LOOP_PASS(&loop, nir, nir_opt_loop_unroll, (nir_variable_mode)0);
       }
-   } while (progress);
+   }
+   nir_pass_loop_finish(&loop, "st");
 }
 
 /* First third of converting glsl_to_nir.. this leaves things in a pre-
@@ -616,6 +617,32 @@ st_nir_link_shaders(nir_shader **producer, nir_shader **consumer)
    }
 }
 
+struct st_nir_stage_range {
+   unsigned first, last;
+};
+
+/* The optimisations of a stage before the stages are linked, run in
+ * parallel by link_run_stages().
+ */
+static void
+st_nir_opt_stage(struct gl_context *ctx, struct gl_linked_shader *shader,
+                 void *data)
+{
+   const struct st_nir_stage_range *range =
+      (const struct st_nir_stage_range *) data;
+
+   nir_variable_mode mask = (nir_variable_mode) 0;
+   if (shader->Stage != range->first)
+      mask = (nir_variable_mode)(mask | nir_var_shader_in);
+
+   if (shader->Stage != range->last)
+      mask = (nir_variable_mode)(mask | nir_var_shader_out);
+
+   nir_shader *nir = shader->Program->nir;
+   NIR_PASS_V(nir, nir_lower_io_to_scalar_early, mask);
+   st_nir_opts(nir);
+}
+
 extern "C" {
 
 bool
@@ -641,19 +668,11 @@ st_link_nir(struct gl_context *ctx,
          continue;
 
       st_nir_get_mesa_program(ctx, shader_program, shader);
-
-      nir_variable_mode mask = (nir_variable_mode) 0;
-      if (i != first)
-         mask = (nir_variable_mode)(mask | nir_var_shader_in);
-
-      if (i != last)
-         mask = (nir_variable_mode)(mask | nir_var_shader_out);
-
-      nir_shader *nir = shader->Program->nir;
-      NIR_PASS_V(nir, nir_lower_io_to_scalar_early, mask);
-      st_nir_opts(nir);
    }
 
+   struct st_nir_stage_range range = { first, last };
+   link_run_stages(ctx, shader_program, st_nir_opt_stage, &range);
+
    /* Linking the stages in the opposite order (from fragment to vertex)
     * ensures that inter-shader outputs written to in an earlier stage
     * are eliminated if they are (transitively) not used in a later
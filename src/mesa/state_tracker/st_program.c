@@ -35,9 +35,11 @@
 #include "main/imports.h"
 #include "main/hash.h"
 #include "main/mtypes.h"
+#include "program/prog_cache.h"
 #include "program/prog_parameter.h"
 #include "program/prog_print.h"
 #include "program/programopt.h"
+#include "util/hash_table.h"
 
 #include "compiler/nir/nir.h"
 
@@ -226,6 +228,74 @@ delete_vp_variant(struct st_context *st, struct st_vp_variant *vpv)
 
 
 
+/**
+ * From this many variants on, a program looks its variants up in a hash
+ * table of their keys instead of walking the list.
+ */
+#define VARIANT_TABLE_MIN_VARIANTS 8
+
+
+static uint32_t
+vp_variant_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct st_vp_variant_key));
+}
+
+
+static bool
+vp_variant_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct st_vp_variant_key)) == 0;
+}
+
+
+/**
+ * Count a new variant of the list, and add it to the table of the
+ * variants, which is created with all of them once there are enough.
+ */
+static void
+vp_variant_added(struct st_vertex_program *stvp, struct st_vp_variant *vpv)
+{
+   stvp->num_variants++;
+
+   if (!stvp->variant_table) {
+      if (stvp->num_variants < VARIANT_TABLE_MIN_VARIANTS)
+         return;
+
+      stvp->variant_table = _mesa_hash_table_create(NULL, vp_variant_key_hash,
+                                                    vp_variant_key_equal);
+      if (!stvp->variant_table)
+         return;
+
+      for (struct st_vp_variant *v = stvp->variants; v; v = v->next)
+         _mesa_hash_table_insert(stvp->variant_table, &v->key, v);
+      return;
+   }
+
+   _mesa_hash_table_insert(stvp->variant_table, &vpv->key, vpv);
+}
+
+
+/**
+ * Forget a variant unlinked from the list, before it is deleted.
+ */
+static void
+vp_variant_removed(struct st_vertex_program *stvp, struct st_vp_variant *vpv)
+{
+   stvp->num_variants--;
+
+   if (stvp->last_variant == vpv)
+      stvp->last_variant = NULL;
+
+   if (stvp->variant_table) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(stvp->variant_table, &vpv->key);
+      if (entry)
+         _mesa_hash_table_remove(stvp->variant_table, entry);
+   }
+}
+
+
 /**
  * Clean out any old compilations:
  */
@@ -235,6 +305,7 @@ st_release_vp_variants( struct st_context *st,
 {
    struct st_vp_variant *vpv;
 
+   simple_mtx_lock(&stvp->variant_mutex);
    for (vpv = stvp->variants; vpv; ) {
       struct st_vp_variant *next = vpv->next;
       delete_vp_variant(st, vpv);
@@ -242,6 +313,11 @@ st_release_vp_variants( struct st_context *st,
    }
 
    stvp->variants = NULL;
+   stvp->last_variant = NULL;
+   stvp->num_variants = 0;
+   _mesa_hash_table_destroy(stvp->variant_table, NULL);
+   stvp->variant_table = NULL;
+   simple_mtx_unlock(&stvp->variant_mutex);
 
    if ((stvp->tgsi.type == PIPE_SHADER_IR_TGSI) && stvp->tgsi.tokens) {
       tgsi_free_tokens(stvp->tgsi.tokens);
@@ -264,6 +340,62 @@ delete_fp_variant(struct st_context *st, struct st_fp_variant *fpv)
 }
 
 
+static uint32_t
+fp_variant_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct st_fp_variant_key));
+}
+
+
+static bool
+fp_variant_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct st_fp_variant_key)) == 0;
+}
+
+
+/** The fragment program version of vp_variant_added() */
+static void
+fp_variant_added(struct st_fragment_program *stfp, struct st_fp_variant *fpv)
+{
+   stfp->num_variants++;
+
+   if (!stfp->variant_table) {
+      if (stfp->num_variants < VARIANT_TABLE_MIN_VARIANTS)
+         return;
+
+      stfp->variant_table = _mesa_hash_table_create(NULL, fp_variant_key_hash,
+                                                    fp_variant_key_equal);
+      if (!stfp->variant_table)
+         return;
+
+      for (struct st_fp_variant *v = stfp->variants; v; v = v->next)
+         _mesa_hash_table_insert(stfp->variant_table, &v->key, v);
+      return;
+   }
+
+   _mesa_hash_table_insert(stfp->variant_table, &fpv->key, fpv);
+}
+
+
+/** The fragment program version of vp_variant_removed() */
+static void
+fp_variant_removed(struct st_fragment_program *stfp, struct st_fp_variant *fpv)
+{
+   stfp->num_variants--;
+
+   if (stfp->last_variant == fpv)
+      stfp->last_variant = NULL;
+
+   if (stfp->variant_table) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(stfp->variant_table, &fpv->key);
+      if (entry)
+         _mesa_hash_table_remove(stfp->variant_table, entry);
+   }
+}
+
+
 /**
  * Free all variants of a fragment program.
  */
@@ -272,6 +404,7 @@ st_release_fp_variants(struct st_context *st, struct st_fragment_program *stfp)
 {
    struct st_fp_variant *fpv;
 
+   simple_mtx_lock(&stfp->variant_mutex);
    for (fpv = stfp->variants; fpv; ) {
       struct st_fp_variant *next = fpv->next;
       delete_fp_variant(st, fpv);
@@ -279,6 +412,11 @@ st_release_fp_variants(struct st_context *st, struct st_fragment_program *stfp)
    }
 
    stfp->variants = NULL;
+   stfp->last_variant = NULL;
+   stfp->num_variants = 0;
+   _mesa_hash_table_destroy(stfp->variant_table, NULL);
+   stfp->variant_table = NULL;
+   simple_mtx_unlock(&stfp->variant_mutex);
 
    if ((stfp->tgsi.type == PIPE_SHADER_IR_TGSI) && stfp->tgsi.tokens) {
       ureg_free_tokens(stfp->tgsi.tokens);
@@ -546,6 +684,32 @@ st_translate_vertex_program(struct st_context *st,
    return stvp->tgsi.tokens != NULL;
 }
 
+/**
+ * Compute the key of a variant for pipe_context::create_cached_shader_state
+ * from the SHA-1 of the GLSL program, its stage and the bits of the variant
+ * key that change the shader.  Returns false when the driver doesn't take
+ * keys, without a disk cache or for programs which aren't GLSL.
+ */
+static bool
+st_get_variant_cache_key(struct st_context *st, struct gl_program *prog,
+                         struct gl_shader_program *shader_program,
+                         uint32_t variant_bits, cache_key key)
+{
+   static const unsigned char zero[sizeof(shader_program->data->sha1)] = {0};
+   uint32_t data[sizeof(zero) / sizeof(uint32_t) + 2];
+
+   if (!st->pipe->create_cached_shader_state || !st->ctx->Cache ||
+       !shader_program ||
+       memcmp(shader_program->data->sha1, zero, sizeof(zero)) == 0)
+      return false;
+
+   memcpy(data, shader_program->data->sha1, sizeof(zero));
+   data[ARRAY_SIZE(data) - 2] = prog->info.stage;
+   data[ARRAY_SIZE(data) - 1] = variant_bits;
+   disk_cache_compute_key(st->ctx->Cache, data, sizeof(data), key);
+   return true;
+}
+
 static struct st_vp_variant *
 st_create_vp_variant(struct st_context *st,
                      struct st_vertex_program *stvp,
@@ -559,19 +723,43 @@ st_create_vp_variant(struct st_context *st,
    vpv->num_inputs = stvp->num_inputs;
 
    if (stvp->tgsi.type == PIPE_SHADER_IR_NIR) {
+      cache_key shader_key;
+      bool cached =
+         st_get_variant_cache_key(st, &stvp->Base, stvp->shader_program,
+                                  key->clamp_color |
+                                  key->passthrough_edgeflags << 1,
+                                  shader_key);
+
       vpv->tgsi.type = PIPE_SHADER_IR_NIR;
+      if (key->passthrough_edgeflags)
+         vpv->num_inputs++;
+
+      /* the driver may have the binary without the NIR */
+      if (cached) {
+         vpv->driver_shader =
+            pipe->create_cached_shader_state(pipe, PIPE_SHADER_VERTEX, NULL,
+                                             shader_key);
+         if (vpv->driver_shader)
+            return vpv;
+      }
+
+      st_deserialise_deferred_nir(st->ctx, &stvp->Base);
+
       vpv->tgsi.ir.nir = nir_shader_clone(NULL, stvp->tgsi.ir.nir);
       if (key->clamp_color)
          NIR_PASS_V(vpv->tgsi.ir.nir, nir_lower_clamp_color_outputs);
-      if (key->passthrough_edgeflags) {
+      if (key->passthrough_edgeflags)
          NIR_PASS_V(vpv->tgsi.ir.nir, nir_lower_passthrough_edgeflags);
-         vpv->num_inputs++;
-      }
 
       st_finalize_nir(st, &stvp->Base, stvp->shader_program,
                       vpv->tgsi.ir.nir);
 
-      vpv->driver_shader = pipe->create_vs_state(pipe, &vpv->tgsi);
+      if (cached) {
+         vpv->driver_shader =
+            pipe->create_cached_shader_state(pipe, PIPE_SHADER_VERTEX,
+                                             &vpv->tgsi, shader_key);
+      } else
+         vpv->driver_shader = pipe->create_vs_state(pipe, &vpv->tgsi);
       /* driver takes ownership of IR: */
       vpv->tgsi.ir.nir = NULL;
       return vpv;
@@ -618,10 +806,26 @@ st_get_vp_variant(struct st_context *st,
 {
    struct st_vp_variant *vpv;
 
+   /* Contexts sharing the program look up and add variants concurrently. */
+   simple_mtx_lock(&stvp->variant_mutex);
+
+   /* The state rarely changes between validations. */
+   vpv = stvp->last_variant;
+   if (vpv && memcmp(&vpv->key, key, sizeof(*key)) == 0) {
+      simple_mtx_unlock(&stvp->variant_mutex);
+      return vpv;
+   }
+
    /* Search for existing variant */
-   for (vpv = stvp->variants; vpv; vpv = vpv->next) {
-      if (memcmp(&vpv->key, key, sizeof(*key)) == 0) {
-         break;
+   if (stvp->variant_table) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(stvp->variant_table, key);
+      vpv = entry ? entry->data : NULL;
+   } else {
+      for (vpv = stvp->variants; vpv; vpv = vpv->next) {
+         if (memcmp(&vpv->key, key, sizeof(*key)) == 0) {
+            break;
+         }
       }
    }
 
@@ -632,9 +836,14 @@ st_get_vp_variant(struct st_context *st,
          /* insert into list */
          vpv->next = stvp->variants;
          stvp->variants = vpv;
+         vp_variant_added(stvp, vpv);
       }
    }
 
+   if (vpv)
+      stvp->last_variant = vpv;
+   simple_mtx_unlock(&stvp->variant_mutex);
+
    return vpv;
 }
 
@@ -1025,6 +1234,27 @@ st_create_fp_variant(struct st_context *st,
       return NULL;
 
    if (stfp->tgsi.type == PIPE_SHADER_IR_NIR) {
+      cache_key shader_key;
+      bool cached = !key->bitmap && !key->drawpixels &&
+         !key->external.lower_nv12 && !key->external.lower_iyuv &&
+         st_get_variant_cache_key(st, &stfp->Base, stfp->shader_program,
+                                  key->clamp_color |
+                                  key->persample_shading << 1,
+                                  shader_key);
+
+      /* the driver may have the binary without the NIR */
+      if (cached) {
+         variant->driver_shader =
+            pipe->create_cached_shader_state(pipe, PIPE_SHADER_FRAGMENT,
+                                             NULL, shader_key);
+         if (variant->driver_shader) {
+            variant->key = *key;
+            return variant;
+         }
+      }
+
+      st_deserialise_deferred_nir(st->ctx, &stfp->Base);
+
       tgsi.type = PIPE_SHADER_IR_NIR;
       tgsi.ir.nir = nir_shader_clone(NULL, stfp->tgsi.ir.nir);
 
@@ -1100,7 +1330,12 @@ st_create_fp_variant(struct st_context *st,
                     key->external.lower_iyuv);
       }
 
-      variant->driver_shader = pipe->create_fs_state(pipe, &tgsi);
+      if (cached) {
+         variant->driver_shader =
+            pipe->create_cached_shader_state(pipe, PIPE_SHADER_FRAGMENT,
+                                             &tgsi, shader_key);
+      } else
+         variant->driver_shader = pipe->create_fs_state(pipe, &tgsi);
       variant->key = *key;
 
       return variant;
@@ -1239,10 +1474,26 @@ st_get_fp_variant(struct st_context *st,
 {
    struct st_fp_variant *fpv;
 
+   /* Contexts sharing the program look up and add variants concurrently. */
+   simple_mtx_lock(&stfp->variant_mutex);
+
+   /* The state rarely changes between validations. */
+   fpv = stfp->last_variant;
+   if (fpv && memcmp(&fpv->key, key, sizeof(*key)) == 0) {
+      simple_mtx_unlock(&stfp->variant_mutex);
+      return fpv;
+   }
+
    /* Search for existing variant */
-   for (fpv = stfp->variants; fpv; fpv = fpv->next) {
-      if (memcmp(&fpv->key, key, sizeof(*key)) == 0) {
-         break;
+   if (stfp->variant_table) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(stfp->variant_table, key);
+      fpv = entry ? entry->data : NULL;
+   } else {
+      for (fpv = stfp->variants; fpv; fpv = fpv->next) {
+         if (memcmp(&fpv->key, key, sizeof(*key)) == 0) {
+            break;
+         }
       }
    }
 
@@ -1269,9 +1520,14 @@ st_get_fp_variant(struct st_context *st,
             fpv->next = stfp->variants;
             stfp->variants = fpv;
          }
+         fp_variant_added(stfp, fpv);
       }
    }
 
+   if (fpv)
+      stfp->last_variant = fpv;
+   simple_mtx_unlock(&stfp->variant_mutex);
+
    return fpv;
 }
 
@@ -1748,11 +2004,13 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
          struct st_vertex_program *stvp = (struct st_vertex_program *) target;
          struct st_vp_variant *vpv, **prevPtr = &stvp->variants;
 
+         simple_mtx_lock(&stvp->variant_mutex);
          for (vpv = stvp->variants; vpv; ) {
             struct st_vp_variant *next = vpv->next;
             if (vpv->key.st == st) {
                /* unlink from list */
                *prevPtr = next;
+               vp_variant_removed(stvp, vpv);
                /* destroy this variant */
                delete_vp_variant(st, vpv);
             }
@@ -1761,6 +2019,7 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             }
             vpv = next;
          }
+         simple_mtx_unlock(&stvp->variant_mutex);
       }
       break;
    case GL_FRAGMENT_PROGRAM_ARB:
@@ -1769,11 +2028,13 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             (struct st_fragment_program *) target;
          struct st_fp_variant *fpv, **prevPtr = &stfp->variants;
 
+         simple_mtx_lock(&stfp->variant_mutex);
          for (fpv = stfp->variants; fpv; ) {
             struct st_fp_variant *next = fpv->next;
             if (fpv->key.st == st) {
                /* unlink from list */
                *prevPtr = next;
+               fp_variant_removed(stfp, fpv);
                /* destroy this variant */
                delete_fp_variant(st, fpv);
             }
@@ -1782,6 +2043,7 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             }
             fpv = next;
          }
+         simple_mtx_unlock(&stfp->variant_mutex);
       }
       break;
    case GL_GEOMETRY_PROGRAM_NV:
@@ -1887,6 +2149,14 @@ st_destroy_program_variants(struct st_context *st)
    /* GLSL vert/frag/geom shaders */
    _mesa_HashWalk(st->ctx->Shared->ShaderObjects,
                   destroy_shader_program_variants_cb, st);
+
+   /* fixed-function programs, which outlive the context */
+   simple_mtx_lock(&st->ctx->Shared->FixedFuncMutex);
+   _mesa_program_cache_walk(st->ctx->Shared->FixedFuncVertexPrograms,
+                            destroy_program_variants_cb, st);
+   _mesa_program_cache_walk(st->ctx->Shared->FixedFuncFragmentShaders,
+                            destroy_shader_program_variants_cb, st);
+   simple_mtx_unlock(&st->ctx->Shared->FixedFuncMutex);
 }
 
 
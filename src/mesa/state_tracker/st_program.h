@@ -43,6 +43,8 @@
 #include "st_texture.h"
 #include "st_glsl_to_tgsi.h"
 
+struct hash_table;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -151,8 +153,21 @@ struct st_fragment_program
 
    struct st_fp_variant *variants;
 
+   /** The variant st_get_fp_variant() returned last, and a table of the
+    * variants by key once there are many of them.
+    */
+   struct st_fp_variant *last_variant;
+   struct hash_table *variant_table;
+   unsigned num_variants;
+   /** Guards the variants and the above, as contexts share programs */
+   simple_mtx_t variant_mutex;
+
    /* Used by the shader cache and ARB_get_program_binary */
    unsigned num_tgsi_tokens;
+
+   /** Offset of the NIR in Base.driver_cache_blob while its deserialisation
+    * is deferred, see st_deserialise_deferred_nir() */
+   unsigned nir_offset;
 };
 
 
@@ -223,11 +238,24 @@ struct st_vertex_program
     */
    struct st_vp_variant *variants;
 
+   /** The variant st_get_vp_variant() returned last, and a table of the
+    * variants by key once there are many of them.
+    */
+   struct st_vp_variant *last_variant;
+   struct hash_table *variant_table;
+   unsigned num_variants;
+   /** Guards the variants and the above, as contexts share programs */
+   simple_mtx_t variant_mutex;
+
    /** SHA1 hash of linked tgsi shader program, used for on-disk cache */
    unsigned char sha1[20];
 
    /* Used by the shader cache and ARB_get_program_binary */
    unsigned num_tgsi_tokens;
+
+   /** Offset of the NIR in Base.driver_cache_blob while its deserialisation
+    * is deferred, see st_deserialise_deferred_nir() */
+   unsigned nir_offset;
 };
 
 
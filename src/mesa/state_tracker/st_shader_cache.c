@@ -181,10 +181,21 @@ read_tgsi_from_cache(struct blob_reader *blob_reader,
    blob_copy_bytes(blob_reader, (uint8_t *) *tokens, tokens_size);
 }
 
+/* The variants of the vertex and fragment programs are created from the
+ * binaries the driver keeps in its cache, the NIR is only needed for the
+ * ones it doesn't have.
+ */
+static bool
+st_can_defer_nir(struct st_context *st, gl_shader_stage stage)
+{
+   return st->pipe->create_cached_shader_state &&
+          (stage == MESA_SHADER_VERTEX || stage == MESA_SHADER_FRAGMENT);
+}
+
 static void
 st_deserialise_ir_program(struct gl_context *ctx,
                           struct gl_shader_program *shProg,
-                          struct gl_program *prog, bool nir)
+                          struct gl_program *prog, bool nir, bool defer_nir)
 {
    struct st_context *st = st_context(ctx);
    size_t size = prog->driver_cache_blob_size;
@@ -211,7 +222,13 @@ st_deserialise_ir_program(struct gl_context *ctx,
 
       read_stream_out_from_cache(&blob_reader, &stvp->tgsi);
 
-      if (nir) {
+      if (nir && defer_nir) {
+         stvp->tgsi.type = PIPE_SHADER_IR_NIR;
+         stvp->shader_program = shProg;
+         stvp->tgsi.ir.nir = NULL;
+         stvp->nir_offset = blob_reader.current - buffer;
+         blob_reader.current = blob_reader.end;
+      } else if (nir) {
          stvp->tgsi.type = PIPE_SHADER_IR_NIR;
          stvp->shader_program = shProg;
          stvp->tgsi.ir.nir = nir_deserialize(NULL, options, &blob_reader);
@@ -300,7 +317,13 @@ st_deserialise_ir_program(struct gl_context *ctx,
 
       st_release_fp_variants(st, stfp);
 
-      if (nir) {
+      if (nir && defer_nir) {
+         stfp->tgsi.type = PIPE_SHADER_IR_NIR;
+         stfp->shader_program = shProg;
+         stfp->tgsi.ir.nir = NULL;
+         stfp->nir_offset = blob_reader.current - buffer;
+         blob_reader.current = blob_reader.end;
+      } else if (nir) {
          stfp->tgsi.type = PIPE_SHADER_IR_NIR;
          stfp->shader_program = shProg;
          stfp->tgsi.ir.nir = nir_deserialize(NULL, options, &blob_reader);
@@ -366,6 +389,53 @@ st_deserialise_ir_program(struct gl_context *ctx,
       st_precompile_shader_variant(st, prog);
 }
 
+/**
+ * Deserialise the NIR that st_load_ir_from_disk_cache() left in the cached
+ * blob, for a variant the driver doesn't have in its cache.
+ */
+void
+st_deserialise_deferred_nir(struct gl_context *ctx, struct gl_program *prog)
+{
+   struct pipe_shader_state *state;
+   unsigned offset;
+
+   switch (prog->info.stage) {
+   case MESA_SHADER_VERTEX:
+      state = &((struct st_vertex_program *) prog)->tgsi;
+      offset = ((struct st_vertex_program *) prog)->nir_offset;
+      break;
+   case MESA_SHADER_FRAGMENT:
+      state = &((struct st_fragment_program *) prog)->tgsi;
+      offset = ((struct st_fragment_program *) prog)->nir_offset;
+      break;
+   default:
+      return;
+   }
+
+   if (state->type != PIPE_SHADER_IR_NIR || state->ir.nir ||
+       !prog->driver_cache_blob)
+      return;
+
+   const struct nir_shader_compiler_options *options =
+      ctx->Const.ShaderCompilerOptions[prog->info.stage].NirOptions;
+   struct blob_reader blob_reader;
+   blob_reader_init(&blob_reader,
+                    (uint8_t *) prog->driver_cache_blob + offset,
+                    prog->driver_cache_blob_size - offset);
+
+   state->ir.nir = nir_deserialize(NULL, options, &blob_reader);
+   prog->nir = state->ir.nir;
+
+   ralloc_free(prog->driver_cache_blob);
+   prog->driver_cache_blob = NULL;
+   prog->driver_cache_blob_size = 0;
+
+   if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
+      fprintf(stderr, "%s state tracker IR deserialised for a variant\n",
+              _mesa_shader_stage_to_string(prog->info.stage));
+   }
+}
+
 bool
 st_load_ir_from_disk_cache(struct gl_context *ctx,
                            struct gl_shader_program *prog,
@@ -385,12 +455,17 @@ st_load_ir_from_disk_cache(struct gl_context *ctx,
          continue;
 
       struct gl_program *glprog = prog->_LinkedShaders[i]->Program;
-      st_deserialise_ir_program(ctx, prog, glprog, nir);
-
-      /* We don't need the cached blob anymore so free it */
-      ralloc_free(glprog->driver_cache_blob);
-      glprog->driver_cache_blob = NULL;
-      glprog->driver_cache_blob_size = 0;
+      bool defer_nir = nir && st_can_defer_nir(st_context(ctx), i);
+      st_deserialise_ir_program(ctx, prog, glprog, nir, defer_nir);
+
+      /* We don't need the cached blob anymore so free it, unless it still
+       * has the NIR
+       */
+      if (!defer_nir) {
+         ralloc_free(glprog->driver_cache_blob);
+         glprog->driver_cache_blob = NULL;
+         glprog->driver_cache_blob_size = 0;
+      }
 
       if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
          fprintf(stderr, "%s state tracker IR retrieved from cache\n",
@@ -412,7 +487,7 @@ st_deserialise_tgsi_program(struct gl_context *ctx,
                             struct gl_shader_program *shProg,
                             struct gl_program *prog)
 {
-   st_deserialise_ir_program(ctx, shProg, prog, false);
+   st_deserialise_ir_program(ctx, shProg, prog, false, false);
 }
 
 void
@@ -426,5 +501,5 @@ st_deserialise_nir_program(struct gl_context *ctx,
                            struct gl_shader_program *shProg,
                            struct gl_program *prog)
 {
-   st_deserialise_ir_program(ctx, shProg, prog, true);
+   st_deserialise_ir_program(ctx, shProg, prog, true, false);
 }
@@ -51,6 +51,9 @@ st_deserialise_nir_program(struct gl_context *ctx,
                            struct gl_shader_program *shProg,
                            struct gl_program *prog);
 
+void
+st_deserialise_deferred_nir(struct gl_context *ctx, struct gl_program *prog);
+
 bool
 st_load_ir_from_disk_cache(struct gl_context *ctx,
                            struct gl_shader_program *prog,
@@ -49,7 +49,7 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 /**
  * Size (in bytes) of the VBO to use for glBegin/glVertex/glEnd-style rendering.
  */
-#define VBO_VERT_BUFFER_SIZE (1024 * 64)
+#define VBO_VERT_BUFFER_SIZE (1024 * 512)
 
 
 struct vbo_exec_eval1_map {
@@ -87,6 +87,7 @@ struct vbo_exec_context
       fi_type *buffer_map;
       fi_type *buffer_ptr;              /* cursor, points into buffer */
       GLuint   buffer_used;             /* in bytes */
+      GLuint   buffer_offset;           /* of buffer_map, in bytes */
       fi_type vertex[VBO_ATTRIB_MAX*4]; /* current vertex */
 
       GLuint vert_count;   /**< Number of vertices currently in buffer */
@@ -1252,7 +1252,9 @@ vbo_exec_FlushVertices(struct gl_context *ctx, GLuint flags)
       return;
    }
 
-   /* Flush (draw), and make sure VBO is left unmapped when done */
+   /* Flush (draw), and make sure VBO is left unmapped when done, unless
+    * it's persistently mapped.
+    */
    vbo_exec_FlushVertices_internal(exec, GL_TRUE);
 
    /* Need to do this to ensure vbo_exec_begin_vertices gets called again:
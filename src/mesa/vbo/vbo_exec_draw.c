@@ -168,6 +168,18 @@ vbo_copy_vertices(struct vbo_exec_context *exec)
 
 
 
+/**
+ * With persistent coherent mappings the VBO stays mapped across the draws,
+ * each of which sources the vertices written after the previous one.
+ */
+static bool
+vbo_exec_persistent_mapping(const struct vbo_exec_context *exec)
+{
+   return _mesa_is_bufferobj(exec->vtx.bufferobj) &&
+          exec->ctx->Extensions.ARB_buffer_storage;
+}
+
+
 /* TODO: populate these as the vertex is defined:
  */
 static void
@@ -180,7 +192,7 @@ vbo_exec_bind_arrays(struct gl_context *ctx)
    GLintptr buffer_offset;
    if (_mesa_is_bufferobj(exec->vtx.bufferobj)) {
       assert(exec->vtx.bufferobj->Mappings[MAP_INTERNAL].Pointer);
-      buffer_offset = exec->vtx.bufferobj->Mappings[MAP_INTERNAL].Offset;
+      buffer_offset = exec->vtx.buffer_offset;
    } else {
       /* Ptr into ordinary app memory */
       buffer_offset = (GLbyte *)exec->vtx.buffer_map - (GLbyte *)NULL;
@@ -247,7 +259,8 @@ vbo_exec_vtx_unmap(struct vbo_exec_context *exec)
    if (_mesa_is_bufferobj(exec->vtx.bufferobj)) {
       struct gl_context *ctx = exec->ctx;
 
-      if (ctx->Driver.FlushMappedBufferRange) {
+      if (ctx->Driver.FlushMappedBufferRange &&
+          !vbo_exec_persistent_mapping(exec)) {
          GLintptr offset = exec->vtx.buffer_used -
                            exec->vtx.bufferobj->Mappings[MAP_INTERNAL].Offset;
          GLsizeiptr length = (exec->vtx.buffer_ptr - exec->vtx.buffer_map) *
@@ -280,16 +293,38 @@ void
 vbo_exec_vtx_map(struct vbo_exec_context *exec)
 {
    struct gl_context *ctx = exec->ctx;
-   const GLenum accessRange = GL_MAP_WRITE_BIT |  /* for MapBufferRange */
-                              GL_MAP_INVALIDATE_RANGE_BIT |
-                              GL_MAP_UNSYNCHRONIZED_BIT |
-                              GL_MAP_FLUSH_EXPLICIT_BIT |
-                              MESA_MAP_NOWAIT_BIT;
+   GLbitfield accessRange = GL_MAP_WRITE_BIT |  /* for MapBufferRange */
+                            GL_MAP_UNSYNCHRONIZED_BIT;
+   GLbitfield storageFlags = GL_MAP_WRITE_BIT |
+                             GL_DYNAMIC_STORAGE_BIT |
+                             GL_CLIENT_STORAGE_BIT;
    const GLenum usage = GL_STREAM_DRAW_ARB;
 
    if (!_mesa_is_bufferobj(exec->vtx.bufferobj))
       return;
 
+   /* A persistent mapping stays across the flushes, the next vertices go
+    * after the ones drawn.
+    */
+   if (exec->vtx.buffer_map) {
+      assert(vbo_exec_persistent_mapping(exec));
+      return;
+   }
+
+   if (vbo_exec_persistent_mapping(exec)) {
+      /* The copied vertices are read back from the buffer, which only the
+       * persistent mapping allows along with unsynchronized writes.
+       */
+      accessRange |= GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT |
+                     GL_MAP_READ_BIT;
+      storageFlags |= GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT |
+                      GL_MAP_READ_BIT;
+   } else {
+      accessRange |= GL_MAP_INVALIDATE_RANGE_BIT |
+                     GL_MAP_FLUSH_EXPLICIT_BIT |
+                     MESA_MAP_NOWAIT_BIT;
+   }
+
    assert(!exec->vtx.buffer_map);
    assert(!exec->vtx.buffer_ptr);
 
@@ -317,10 +352,7 @@ vbo_exec_vtx_map(struct vbo_exec_context *exec)
 
       if (ctx->Driver.BufferData(ctx, GL_ARRAY_BUFFER_ARB,
                                  VBO_VERT_BUFFER_SIZE,
-                                 NULL, usage,
-                                 GL_MAP_WRITE_BIT |
-                                 GL_DYNAMIC_STORAGE_BIT |
-                                 GL_CLIENT_STORAGE_BIT,
+                                 NULL, usage, storageFlags,
                                  exec->vtx.bufferobj)) {
          /* buffer allocation worked, now map the buffer */
          exec->vtx.buffer_map =
@@ -337,6 +369,7 @@ vbo_exec_vtx_map(struct vbo_exec_context *exec)
    }
 
    exec->vtx.buffer_ptr = exec->vtx.buffer_map;
+   exec->vtx.buffer_offset = exec->vtx.buffer_used;
 
    if (!exec->vtx.buffer_map) {
       /* out of memory */
@@ -358,13 +391,40 @@ vbo_exec_vtx_map(struct vbo_exec_context *exec)
 
 
 
+/**
+ * Move the start of the persistently mapped buffer past the vertices of
+ * the last draw. When it's full we get new storage, the driver keeps the
+ * old one until the GPU is done with it.
+ */
+static void
+vbo_exec_vtx_advance(struct vbo_exec_context *exec)
+{
+   exec->vtx.buffer_used += (exec->vtx.buffer_ptr -
+                             exec->vtx.buffer_map) * sizeof(float);
+   exec->vtx.buffer_map = exec->vtx.buffer_ptr;
+   exec->vtx.buffer_offset = exec->vtx.buffer_used;
+
+   if (VBO_VERT_BUFFER_SIZE <= exec->vtx.buffer_used + 1024) {
+      vbo_exec_vtx_unmap(exec);
+      vbo_exec_vtx_map(exec);
+   }
+}
+
+
 /**
  * Execute the buffer and save copied verts.
- * \param keep_unmapped  if true, leave the VBO unmapped when we're done.
+ * \param keep_unmapped  if true, leave the VBO unmapped when we're done,
+ *                       unless it's persistently mapped.
  */
 void
 vbo_exec_vtx_flush(struct vbo_exec_context *exec, GLboolean keepUnmapped)
 {
+   const bool persistent = vbo_exec_persistent_mapping(exec);
+
+   /* the driver can draw from a persistent mapping, it stays */
+   if (persistent)
+      keepUnmapped = GL_FALSE;
+
    if (0)
       vbo_exec_debug_verts(exec);
 
@@ -384,7 +444,8 @@ vbo_exec_vtx_flush(struct vbo_exec_context *exec, GLboolean keepUnmapped)
          if (ctx->NewState)
             _mesa_update_state(ctx);
 
-         vbo_exec_vtx_unmap(exec);
+         if (!persistent)
+            vbo_exec_vtx_unmap(exec);
 
          assert(ctx->NewState == 0);
 
@@ -397,7 +458,9 @@ vbo_exec_vtx_flush(struct vbo_exec_context *exec, GLboolean keepUnmapped)
                           NULL, 0, NULL);
 
          /* Get new storage -- unless asked not to. */
-         if (!keepUnmapped)
+         if (persistent)
+            vbo_exec_vtx_advance(exec);
+         else if (!keepUnmapped)
             vbo_exec_vtx_map(exec);
       }
    }
@@ -27,6 +27,7 @@
 
 #include "main/glheader.h"
 #include "main/context.h"
+#include "main/eval.h"
 #include "main/macros.h"
 #include "math/m_eval.h"
 #include "main/dispatch.h"
@@ -70,6 +71,8 @@ void vbo_exec_eval_update( struct vbo_exec_context *exec )
    struct gl_context *ctx = exec->ctx;
    GLuint attr;
 
+   _mesa_init_eval_maps(ctx);
+
    /* Vertex program maps have priority over conventional attribs */
 
    for (attr = 0; attr < VBO_ATTRIB_FIRST_MATERIAL; attr++) {
@@ -30,6 +30,7 @@
 #include "main/context.h"
 #include "main/varray.h"
 #include "main/macros.h"
+#include "main/neon_minmax.h"
 #include "main/sse_minmax.h"
 #include "x86/common_x86_asm.h"
 #include "util/hash_table.h"
@@ -227,6 +228,31 @@ out:
 }
 
 
+/**
+ * Scan the indices with the SIMD instructions of the CPU, returns false if
+ * there are none.
+ */
+static bool
+vbo_minmax_index_simd(const void *indices, unsigned index_size,
+                      GLuint count, bool restart, GLuint restart_index,
+                      GLuint *min_index, GLuint *max_index)
+{
+#if defined(USE_SSE41)
+   if (cpu_has_sse4_1) {
+      _mesa_index_array_min_max_sse41(indices, index_size, count, restart,
+                                      restart_index, min_index, max_index);
+      return true;
+   }
+#endif
+#if defined(HAVE_NEON_MINMAX)
+   _mesa_index_array_min_max_neon(indices, index_size, count, restart,
+                                  restart_index, min_index, max_index);
+   return true;
+#endif
+   return false;
+}
+
+
 /**
  * Compute min and max elements by scanning the index buffer for
  * glDraw[Range]Elements() calls.
@@ -261,6 +287,10 @@ vbo_get_minmax_index(struct gl_context *ctx,
                                            MAP_INTERNAL);
    }
 
+   if (vbo_minmax_index_simd(indices, ib->index_size, count, restart,
+                             restartIndex, min_index, max_index))
+      goto done;
+
    switch (ib->index_size) {
    case 4: {
       const GLuint *ui_indices = (const GLuint *)indices;
@@ -275,16 +305,10 @@ vbo_get_minmax_index(struct gl_context *ctx,
          }
       }
       else {
-#if defined(USE_SSE41)
-         if (cpu_has_sse4_1) {
-            _mesa_uint_array_min_max(ui_indices, &min_ui, &max_ui, count);
+         for (i = 0; i < count; i++) {
+            if (ui_indices[i] > max_ui) max_ui = ui_indices[i];
+            if (ui_indices[i] < min_ui) min_ui = ui_indices[i];
          }
-         else
-#endif
-            for (i = 0; i < count; i++) {
-               if (ui_indices[i] > max_ui) max_ui = ui_indices[i];
-               if (ui_indices[i] < min_ui) min_ui = ui_indices[i];
-            }
       }
       *min_index = min_ui;
       *max_index = max_ui;
@@ -338,6 +362,7 @@ vbo_get_minmax_index(struct gl_context *ctx,
       unreachable("not reached");
    }
 
+done:
    if (_mesa_is_bufferobj(ib->obj)) {
       vbo_minmax_cache_store(ctx, ib->obj, ib->index_size, offset,
                              count, *min_index, *max_index);
@@ -75,6 +75,17 @@ struct vbo_save_vertex_list {
    GLuint prim_count;
 
    struct vbo_save_primitive_store *prim_store;
+
+   /* The prims as one indexed draw of points, lines or triangles, which
+    * reads each of the identical vertices once. ib.obj is NULL when the
+    * prims don't reduce to one draw.
+    */
+   struct {
+      struct _mesa_prim prim;
+      struct _mesa_index_buffer ib;
+      GLuint min_index;
+      GLuint max_index;
+   } merged;
 };
 
 
@@ -82,6 +82,7 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "main/state.h"
 #include "main/varray.h"
 #include "util/bitscan.h"
+#include "util/hash_table.h"
 
 #include "vbo_noop.h"
 #include "vbo_private.h"
@@ -412,6 +413,272 @@ convert_line_loop_to_strip(struct vbo_save_context *save,
 }
 
 
+/**
+ * The mode the prim is drawn as by compile_merged_prims, GL_NONE if it
+ * can't be.
+ */
+static GLenum
+merged_prim_mode(GLenum mode)
+{
+   switch (mode) {
+   case GL_POINTS:
+      return GL_POINTS;
+   case GL_LINES:
+   case GL_LINE_STRIP:
+      return GL_LINES;
+   case GL_TRIANGLES:
+   case GL_TRIANGLE_STRIP:
+   case GL_TRIANGLE_FAN:
+   case GL_QUADS:
+   case GL_QUAD_STRIP:
+   case GL_POLYGON:
+      return GL_TRIANGLES;
+   default:
+      return GL_NONE;
+   }
+}
+
+
+/**
+ * Number of merged indices of the prim.
+ */
+static GLuint
+merged_prim_count(const struct _mesa_prim *prim)
+{
+   const GLuint count = prim->count;
+
+   switch (prim->mode) {
+   case GL_POINTS:
+      return count;
+   case GL_LINES:
+      return count / 2 * 2;
+   case GL_LINE_STRIP:
+      return count >= 2 ? (count - 1) * 2 : 0;
+   case GL_TRIANGLES:
+      return count / 3 * 3;
+   case GL_TRIANGLE_STRIP:
+   case GL_TRIANGLE_FAN:
+   case GL_POLYGON:
+      return count >= 3 ? (count - 2) * 3 : 0;
+   case GL_QUADS:
+      return count / 4 * 6;
+   case GL_QUAD_STRIP:
+      return count >= 4 ? (count / 2 - 1) * 6 : 0;
+   default:
+      unreachable("Unexpected primitive type");
+   }
+}
+
+
+/**
+ * Write the indices of the prim, each the index of the first identical
+ * vertex. The triangles keep the winding and the last vertex of each one
+ * is the last vertex convention provoking vertex of the original
+ * primitive.
+ */
+static GLuint *
+merged_prim_indices(const struct _mesa_prim *prim, const GLuint *remap,
+                    GLuint *dst)
+{
+   const GLuint *v = remap + prim->start;
+   const GLuint count = prim->count;
+   GLuint i;
+
+#define TRI(a, b, c) \
+   do { *dst++ = v[a]; *dst++ = v[b]; *dst++ = v[c]; } while (0)
+
+   switch (prim->mode) {
+   case GL_POINTS:
+   case GL_LINES:
+   case GL_TRIANGLES:
+      for (i = 0; i < merged_prim_count(prim); i++)
+         *dst++ = v[i];
+      break;
+   case GL_LINE_STRIP:
+      for (i = 0; i + 1 < count; i++) {
+         *dst++ = v[i];
+         *dst++ = v[i + 1];
+      }
+      break;
+   case GL_TRIANGLE_STRIP:
+      for (i = 0; i + 2 < count; i++) {
+         if (i & 1)
+            TRI(i + 1, i, i + 2);
+         else
+            TRI(i, i + 1, i + 2);
+      }
+      break;
+   case GL_TRIANGLE_FAN:
+      for (i = 0; i + 2 < count; i++)
+         TRI(0, i + 1, i + 2);
+      break;
+   case GL_POLYGON:
+      /* the first vertex is the provoking one */
+      for (i = 0; i + 2 < count; i++)
+         TRI(i + 1, i + 2, 0);
+      break;
+   case GL_QUADS:
+      for (i = 0; i + 3 < count; i += 4) {
+         TRI(i, i + 1, i + 3);
+         TRI(i + 1, i + 2, i + 3);
+      }
+      break;
+   case GL_QUAD_STRIP:
+      for (i = 0; i + 3 < count; i += 2) {
+         TRI(i, i + 1, i + 3);
+         TRI(i + 2, i, i + 3);
+      }
+      break;
+   default:
+      unreachable("Unexpected primitive type");
+   }
+
+#undef TRI
+
+   return dst;
+}
+
+
+/**
+ * Map each vertex of the list to the first one with the same data.
+ * Returns the number of different vertices.
+ */
+static GLuint
+dedup_vertices(const fi_type *vertices, GLuint vertex_count,
+               GLuint vertex_size, GLuint *remap, GLuint *table,
+               GLuint table_size)
+{
+   const size_t size = vertex_size * sizeof(fi_type);
+   GLuint unique = 0;
+
+   memset(table, 0xff, table_size * sizeof(*table));
+
+   for (GLuint i = 0; i < vertex_count; i++) {
+      const fi_type *vertex = vertices + i * vertex_size;
+      GLuint slot = _mesa_hash_data(vertex, size) & (table_size - 1);
+
+      while (table[slot] != ~0u &&
+             memcmp(vertices + table[slot] * vertex_size, vertex, size))
+         slot = (slot + 1) & (table_size - 1);
+
+      if (table[slot] == ~0u) {
+         table[slot] = i;
+         unique++;
+      }
+      remap[i] = table[slot];
+   }
+
+   return unique;
+}
+
+
+/**
+ * Turn the prims of the node into one indexed draw of its base mode, for
+ * playback to draw the list at once and without the duplicate vertices.
+ * The prims are kept for loopback and the state the merged draw can't do.
+ * This is done before the starts are corrected.
+ */
+static void
+compile_merged_prims(struct gl_context *ctx,
+                     struct vbo_save_vertex_list *node,
+                     const fi_type *vertices, GLuint vertex_size,
+                     GLuint start_offset)
+{
+   GLenum mode = GL_NONE;
+   GLuint count = 0;
+
+   memset(&node->merged, 0, sizeof(node->merged));
+
+   if (!node->vertex_count || !vertex_size)
+      return;
+
+   for (unsigned i = 0; i < node->prim_count; i++) {
+      const GLenum prim_mode = merged_prim_mode(node->prims[i].mode);
+
+      if (prim_mode == GL_NONE || (i > 0 && prim_mode != mode))
+         return;
+
+      mode = prim_mode;
+      count += merged_prim_count(&node->prims[i]);
+   }
+
+   if (!count)
+      return;
+
+   GLuint table_size = util_next_power_of_two(node->vertex_count * 2);
+   GLuint *remap = malloc(node->vertex_count * sizeof(GLuint));
+   GLuint *table = malloc(table_size * sizeof(GLuint));
+   GLuint *indices = malloc(count * sizeof(GLuint));
+
+   if (!remap || !table || !indices)
+      goto out;
+
+   GLuint unique = dedup_vertices(vertices, node->vertex_count, vertex_size,
+                                  remap, table, table_size);
+
+   /* a single prim of the base mode only gains the vertex reuse */
+   if (node->prim_count == 1 && node->prims[0].mode == mode &&
+       unique == node->vertex_count)
+      goto out;
+
+   GLuint *dst = indices;
+   for (unsigned i = 0; i < node->prim_count; i++)
+      dst = merged_prim_indices(&node->prims[i], remap, dst);
+   assert(dst == indices + count);
+
+   GLuint min_index = ~0u, max_index = 0;
+   for (GLuint i = 0; i < count; i++) {
+      indices[i] += start_offset;
+      min_index = MIN2(min_index, indices[i]);
+      max_index = MAX2(max_index, indices[i]);
+   }
+
+   unsigned index_size = sizeof(GLuint);
+   if (max_index < 0xffff) {
+      GLushort *indices16 = (GLushort *) indices;
+
+      for (GLuint i = 0; i < count; i++)
+         indices16[i] = indices[i];
+      index_size = sizeof(GLushort);
+   }
+
+   struct gl_buffer_object *obj = ctx->Driver.NewBufferObject(ctx, VBO_BUF_ID);
+   if (!obj)
+      goto out;
+
+   if (!ctx->Driver.BufferData(ctx, GL_ELEMENT_ARRAY_BUFFER_ARB,
+                               count * index_size, indices,
+                               GL_STATIC_DRAW_ARB,
+                               GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT,
+                               obj)) {
+      _mesa_reference_buffer_object(ctx, &obj, NULL);
+      goto out;
+   }
+
+   node->merged.ib.count = count;
+   node->merged.ib.index_size = index_size;
+   node->merged.ib.obj = obj;
+   node->merged.ib.ptr = NULL;
+
+   node->merged.prim.mode = mode;
+   node->merged.prim.indexed = 1;
+   node->merged.prim.begin = 1;
+   node->merged.prim.end = 1;
+   node->merged.prim.no_current_update = node->prims[0].no_current_update;
+   node->merged.prim.start = 0;
+   node->merged.prim.count = count;
+   node->merged.prim.num_instances = 1;
+
+   node->merged.min_index = min_index;
+   node->merged.max_index = max_index;
+
+out:
+   free(remap);
+   free(table);
+   free(indices);
+}
+
+
 /* Compare the present vao if it has the same setup. */
 static bool
 compare_vao(gl_vertex_processing_mode mode,
@@ -645,6 +912,9 @@ compile_vertex_list(struct gl_context *ctx)
 
    merge_prims(node->prims, &node->prim_count);
 
+   compile_merged_prims(ctx, node, save->buffer_map, save->vertex_size,
+                        start_offset);
+
    /* Correct the primitive starts, we can only do this here as copy_vertices
     * and convert_line_loop_to_strip above consume the uncorrected starts.
     * On the other hand the _vbo_loopback_vertex_list call below needs the
@@ -1821,6 +2091,8 @@ vbo_destroy_vertex_list(struct gl_context *ctx, void *data)
    if (--node->prim_store->refcount == 0)
       free(node->prim_store);
 
+   _mesa_reference_buffer_object(ctx, &node->merged.ib.obj, NULL);
+
    free(node->current_data);
    node->current_data = NULL;
 }
@@ -35,6 +35,7 @@
 #include "main/macros.h"
 #include "main/light.h"
 #include "main/state.h"
+#include "main/transformfeedback.h"
 #include "main/varray.h"
 #include "util/bitscan.h"
 
@@ -142,6 +143,59 @@ loopback_vertex_list(struct gl_context *ctx,
 }
 
 
+/**
+ * Whether the merged draw of the node renders the same as its prims with
+ * the current state. It has other primitives and vertex numbers, and
+ * triangles which only have the last vertex convention provoking vertex
+ * and draw inner edges in line mode.
+ */
+static bool
+can_draw_merged(const struct gl_context *ctx,
+                const struct vbo_save_vertex_list *node)
+{
+   const struct gl_program *vp = ctx->VertexProgram._Current;
+   const struct gl_program *fp = ctx->FragmentProgram._Current;
+
+   if (!node->merged.ib.obj)
+      return false;
+
+   if (ctx->Light.ProvokingVertex != GL_LAST_VERTEX_CONVENTION_EXT ||
+       ctx->Array._PrimitiveRestart ||
+       _mesa_is_xfb_active_and_unpaused(ctx))
+      return false;
+
+   for (unsigned i = 0; i < MAX_VERTEX_STREAMS; i++) {
+      if (ctx->Query.PrimitivesGenerated[i])
+         return false;
+   }
+   for (unsigned i = 0; i < MAX_PIPELINE_STATISTICS; i++) {
+      if (ctx->Query.pipeline_stats[i])
+         return false;
+   }
+
+   if (ctx->GeometryProgram._Current || ctx->TessEvalProgram._Current)
+      return false;
+   if (vp && vp->info.system_values_read &
+             (BITFIELD64_BIT(SYSTEM_VALUE_VERTEX_ID) |
+              BITFIELD64_BIT(SYSTEM_VALUE_VERTEX_ID_ZERO_BASE)))
+      return false;
+   if (fp && (fp->info.inputs_read & VARYING_BIT_PRIMITIVE_ID ||
+              fp->info.system_values_read &
+              BITFIELD64_BIT(SYSTEM_VALUE_PRIMITIVE_ID)))
+      return false;
+
+   switch (node->merged.prim.mode) {
+   case GL_LINES:
+      return !ctx->Line.StippleFlag;
+   case GL_TRIANGLES:
+      return ctx->Polygon.FrontMode == GL_FILL &&
+             ctx->Polygon.BackMode == GL_FILL;
+   default:
+      return true;
+   }
+}
+
+
 /**
  * Execute the buffer and save copied verts.
  * This is called from the display list code when executing
@@ -207,7 +261,12 @@ vbo_save_playback_vertex_list(struct gl_context *ctx, void *data)
 
       assert(ctx->NewState == 0);
 
-      if (node->vertex_count > 0) {
+      if (node->vertex_count > 0 && can_draw_merged(ctx, node)) {
+         ctx->Driver.Draw(ctx, &node->merged.prim, 1, &node->merged.ib,
+                          GL_TRUE, node->merged.min_index,
+                          node->merged.max_index, NULL, 0, NULL);
+      }
+      else if (node->vertex_count > 0) {
          GLuint min_index = _vbo_save_get_min_index(node);
          GLuint max_index = _vbo_save_get_max_index(node);
          ctx->Driver.Draw(ctx, node->prims, node->prim_count, NULL, GL_TRUE,
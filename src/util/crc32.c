@@ -36,8 +36,22 @@
 #ifdef HAVE_ZLIB
 #include <zlib.h>
 #endif
+#include <stdbool.h>
+#include <string.h>
 #include "crc32.h"
 
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#elif defined(__GNUC__) && (__GNUC__ >= 6 || defined(__clang__)) && \
+    defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#define CRC32_ARMV8
+#endif
+
 
 static const uint32_t 
 util_crc32_table[256] = {
@@ -108,6 +122,153 @@ util_crc32_table[256] = {
 };
 
 
+#if defined(CRC32_PCLMUL)
+
+/* The kernel is built for PCLMULQDQ whatever the build flags are, and only
+ * called once cpuid says the CPU has it.
+ */
+static bool
+has_pclmul(void)
+{
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+   return true;
+#else
+   static int pclmul = -1;
+
+   if (pclmul < 0) {
+      unsigned eax, ebx, ecx, edx;
+
+      pclmul = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+               (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+   }
+
+   return pclmul;
+#endif
+}
+
+/**
+ * Folds 64 bytes at a time with carry-less multiplies, then reduces the
+ * 128 bits left with a Barrett reduction, as in "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" from Intel. Takes a
+ * multiple of 16 bytes, at least 64.
+ */
+__attribute__((target("pclmul,sse4.1"))) static uint32_t
+crc32_pclmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+   /* the constants of the paper for the reflected polynomial */
+   const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+   const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+   const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+   const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+   const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+   __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+   x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+   x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+   x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+   x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+   p += 64;
+   size -= 64;
+
+   /* fold 4 blocks in parallel */
+   while (size >= 64) {
+      x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                         _mm_loadu_si128((const __m128i *)(p + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                         _mm_loadu_si128((const __m128i *)(p + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                         _mm_loadu_si128((const __m128i *)(p + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                         _mm_loadu_si128((const __m128i *)(p + 0x30)));
+      p += 64;
+      size -= 64;
+   }
+
+   /* fold them into one */
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   /* and the blocks of 16 left */
+   while (size >= 16) {
+      x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                         _mm_loadu_si128((const __m128i *)p));
+      p += 16;
+      size -= 16;
+   }
+
+   /* 128 bits to 64 */
+   x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /* Barrett reduction to 32 */
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return _mm_extract_epi32(x1, 1);
+}
+
+#elif defined(CRC32_ARMV8)
+
+static bool
+has_armv8_crc32(void)
+{
+#ifdef __ARM_FEATURE_CRC32
+   return true;
+#else
+   static int crc32 = -1;
+
+   /* HWCAP_CRC32 */
+   if (crc32 < 0)
+      crc32 = (getauxval(AT_HWCAP) & (1 << 7)) != 0;
+
+   return crc32;
+#endif
+}
+
+#ifdef __clang__
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t
+crc32_armv8(uint32_t crc, const uint8_t *p, size_t size)
+{
+   for (; size >= 8; size -= 8, p += 8) {
+      uint64_t v;
+      memcpy(&v, p, sizeof(v));
+      crc = __crc32d(crc, v);
+   }
+
+   while (size--)
+      crc = __crc32b(crc, *p++);
+
+   return crc;
+}
+
+#endif
+
 /**
  * @sa http://www.w3.org/TR/PNG/#D-CRCAppendix
  */
@@ -116,6 +277,17 @@ util_hash_crc32(const void *data, size_t size)
 {
    const uint8_t *p = data;
    uint32_t crc = 0xffffffff;
+
+#if defined(CRC32_PCLMUL)
+   if (size >= 64 && has_pclmul()) {
+      crc = crc32_pclmul(crc, p, size & ~(size_t)15);
+      p += size & ~(size_t)15;
+      size &= 15;
+   }
+#elif defined(CRC32_ARMV8)
+   if (has_armv8_crc32())
+      return crc32_armv8(crc, p, size);
+#endif
  
 #ifdef HAVE_ZLIB
    /* Prefer zlib's implementation for better performance.
@@ -124,7 +296,7 @@ util_hash_crc32(const void *data, size_t size)
     * available function to avoid build system complications.
     */
    if ((uInt)size == size)
-      return ~crc32(0, data, size);
+      return ~crc32(~crc, p, size);
 #endif
 
    while (size--)
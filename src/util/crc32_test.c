@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "crc32.h"
+
+/* an odd size, with vector and tail parts at any offset */
+#define SIZE 4111
+
+/* The portable bit at a time CRC, to check the table, zlib and the CPU
+ * specific paths of util_hash_crc32() against.
+ */
+static uint32_t
+crc32_bitwise(const uint8_t *p, size_t size)
+{
+   uint32_t crc = 0xffffffff;
+
+   while (size--) {
+      crc ^= *p++;
+      for (unsigned i = 0; i < 8; i++)
+         crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+   }
+
+   return crc;
+}
+
+int main(int argc, char *argv[])
+{
+   static uint8_t data[SIZE];
+   uint32_t seed = 0x12345678;
+   bool failed = false;
+
+   /* the util_hash_crc32() result isn't inverted at the end */
+   if (util_hash_crc32("123456789", 9) != ~0xcbf43926u) {
+      printf("crc32 of \"123456789\" is 0x%08x\n",
+             ~util_hash_crc32("123456789", 9));
+      failed = true;
+   }
+
+   for (unsigned i = 0; i < SIZE; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 16;
+   }
+
+   for (unsigned offset = 0; offset < 16; offset++) {
+      for (unsigned size = 0; offset + size <= SIZE;
+           size += size < 300 ? 1 : 97) {
+         uint32_t expected = crc32_bitwise(data + offset, size);
+         uint32_t got = util_hash_crc32(data + offset, size);
+
+         if (got != expected) {
+            printf("offset %u, size %u: expected 0x%08x, got 0x%08x\n",
+                   offset, size, expected, got);
+            failed = true;
+         }
+      }
+   }
+
+   return failed;
+}
@@ -21,6 +21,8 @@
  * IN THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include "main/macros.h"
 #include "debug.h"
@@ -76,3 +78,25 @@ env_var_as_boolean(const char *var_name, bool default_value)
       return default_value;
    }
 }
+
+/**
+ * Reads an environment variable and interprets its value as an unsigned
+ * integer, in decimal, octal or hexadecimal notation.
+ *
+ * Values which aren't a number result in the default value.
+ */
+unsigned
+env_var_as_unsigned(const char *var_name, unsigned default_value)
+{
+   const char *str = getenv(var_name);
+   if (str == NULL)
+      return default_value;
+
+   char *end;
+   errno = 0;
+   unsigned long value = strtoul(str, &end, 0);
+   if (errno != 0 || end == str || *end != '\0')
+      return default_value;
+
+   return value;
+}
@@ -44,6 +44,7 @@
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
+#include "util/u_dynarray.h"
 #include "util/mesa-sha1.h"
 #include "util/ralloc.h"
 #include "main/compiler.h"
@@ -74,6 +75,57 @@
  */
 #define CACHE_VERSION 1
 
+/* The single file backend, enabled with MESA_GLSL_CACHE_SINGLE_FILE, keeps
+ * the entries as records appended to a pack file and finds them through a
+ * hash table in a mmapped index, so a lookup is a probe of the mapping and
+ * one pread, and puts are written in batches. Eviction is by generation:
+ * when the pack file reaches half the maximum cache size, or the two live
+ * pack files and the new entries would pass the maximum size, a new one is
+ * started and the one before the previous is deleted, entries hit in the
+ * previous one are copied to the new one. Index slots of deleted
+ * generations are simply dead.
+ */
+#define PACK_MAGIC 0x4b504d43 /* "CMPK" */
+#define PACK_VERSION 2
+#define PACK_INDEX_SLOTS (1 << 16)
+#define PACK_MAX_PROBES 16
+#define PACK_FLUSH_SIZE (1024 * 1024)
+
+struct pack_index_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t num_slots;
+   /* Generation puts append to, the one before it is still read. */
+   uint32_t gen;
+   /* Bytes written to the pack files of gen and of the one before it. */
+   uint64_t gen_size;
+   uint64_t prev_gen_size;
+};
+
+struct pack_index_slot {
+   uint8_t key[CACHE_KEY_SIZE];
+   /* 0 for an unused slot */
+   uint32_t gen;
+   uint32_t size;
+   uint32_t pad;
+   uint64_t offset;
+};
+
+/* followed by the driver keys blob and the compressed data */
+struct pack_record_header {
+   uint32_t magic;
+   uint32_t crc32;
+   uint32_t uncompressed_size;
+   uint32_t compressed_size;
+   uint8_t key[CACHE_KEY_SIZE];
+};
+
+struct pack_pending_entry {
+   cache_key key;
+   uint32_t offset;
+   uint32_t size;
+};
+
 struct disk_cache {
    /* The path to the cache directory. */
    char *path;
@@ -104,6 +156,25 @@ struct disk_cache {
 
    disk_cache_put_cb blob_put_cb;
    disk_cache_get_cb blob_get_cb;
+
+   /* Single file backend, only used when pack is set. */
+   bool pack;
+   mtx_t pack_lock; /* protects pack_fd and pack_gen */
+   int pack_index_fd;
+   struct pack_index_header *pack_header;
+   struct pack_index_slot *pack_slots;
+   /* Pack files of pack_gen and the generation before it. */
+   int pack_fd[2];
+   uint32_t pack_gen;
+
+   /* Records waiting to be written, only used by the put thread. */
+   struct util_dynarray pack_pending;
+   struct util_dynarray pack_pending_entries;
+   /* What the pending entries count against max_size, their uncompressed
+    * size like for the eviction of the file per entry backend.
+    */
+   uint64_t pack_pending_cost;
+   unsigned pack_queued;
 };
 
 struct disk_cache_put_job {
@@ -120,6 +191,9 @@ struct disk_cache_put_job {
    size_t size;
 
    struct cache_item_metadata cache_item_metadata;
+
+   /* The data is a pack record to copy as is. */
+   bool is_pack_record;
 };
 
 /* Create a directory named 'path' if it does not already exist.
@@ -188,6 +262,325 @@ do {                                       \
    _dst += _src_size;                      \
 } while (0);
 
+static char *
+pack_file_name(struct disk_cache *cache, uint32_t gen)
+{
+   char *filename;
+
+   if (asprintf(&filename, "%s/pack-%u", cache->path, gen) == -1)
+      return NULL;
+
+   return filename;
+}
+
+static int
+pack_open(struct disk_cache *cache, uint32_t gen, int flags)
+{
+   char *filename = pack_file_name(cache, gen);
+   if (filename == NULL)
+      return -1;
+
+   int fd = open(filename, flags | O_CLOEXEC, 0644);
+   free(filename);
+
+   return fd;
+}
+
+/* Reopens the pack files if another thread or process started a new
+ * generation. Must be called with pack_lock held.
+ */
+static void
+pack_refresh_locked(struct disk_cache *cache)
+{
+   uint32_t gen = p_atomic_read(&cache->pack_header->gen);
+
+   if (gen == cache->pack_gen)
+      return;
+
+   for (unsigned i = 0; i < 2; i++) {
+      if (cache->pack_fd[i] != -1)
+         close(cache->pack_fd[i]);
+   }
+
+   cache->pack_fd[0] = pack_open(cache, gen, O_RDWR | O_CREAT);
+   cache->pack_fd[1] = gen > 1 ? pack_open(cache, gen - 1, O_RDONLY) : -1;
+   cache->pack_gen = gen;
+}
+
+static bool
+pack_slot_is_live(struct disk_cache *cache, struct pack_index_slot *slot)
+{
+   return slot->gen && (slot->gen == cache->pack_gen ||
+                        slot->gen + 1 == cache->pack_gen);
+}
+
+static struct pack_index_slot *
+pack_find_slot(struct disk_cache *cache, const cache_key key)
+{
+   const uint32_t *key_chunk = (const uint32_t *) key;
+   uint32_t mask = cache->pack_header->num_slots - 1;
+   uint32_t i = CPU_TO_LE32(*key_chunk) & mask;
+
+   for (unsigned n = 0; n < PACK_MAX_PROBES; n++, i = (i + 1) & mask) {
+      struct pack_index_slot *slot = &cache->pack_slots[i];
+
+      if (pack_slot_is_live(cache, slot) &&
+          memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+   }
+
+   return NULL;
+}
+
+/* Picks the slot for a new entry: the entry's own slot if it's already
+ * there, else the first dead slot, else the oldest one.
+ */
+static struct pack_index_slot *
+pack_insert_slot(struct disk_cache *cache, const cache_key key)
+{
+   const uint32_t *key_chunk = (const uint32_t *) key;
+   uint32_t mask = cache->pack_header->num_slots - 1;
+   uint32_t i = CPU_TO_LE32(*key_chunk) & mask;
+   struct pack_index_slot *best = NULL;
+
+   for (unsigned n = 0; n < PACK_MAX_PROBES; n++, i = (i + 1) & mask) {
+      struct pack_index_slot *slot = &cache->pack_slots[i];
+
+      if (!pack_slot_is_live(cache, slot)) {
+         if (!best || pack_slot_is_live(cache, best))
+            best = slot;
+         continue;
+      }
+
+      if (memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+
+      if (!best || (pack_slot_is_live(cache, best) && slot->gen < best->gen))
+         best = slot;
+   }
+
+   return best;
+}
+
+static bool
+pack_pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   for (size_t done = 0; done < count;) {
+      ssize_t ret = pwrite(fd, (const char *) buf + done, count - done,
+                           offset + done);
+      if (ret == -1) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+      done += ret;
+   }
+
+   return true;
+}
+
+static bool
+pack_pread_all(int fd, void *buf, size_t count, off_t offset)
+{
+   for (size_t done = 0; done < count;) {
+      ssize_t ret = pread(fd, (char *) buf + done, count - done,
+                          offset + done);
+      if (ret == -1 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return false;
+      done += ret;
+   }
+
+   return true;
+}
+
+/* Starts a new generation, which deletes the one before the previous. Must
+ * be called with the index flock and pack_lock held.
+ */
+static void
+pack_new_gen_locked(struct disk_cache *cache)
+{
+   uint32_t gen = cache->pack_header->gen;
+
+   if (gen > 1) {
+      char *filename = pack_file_name(cache, gen - 1);
+      if (filename) {
+         unlink(filename);
+         free(filename);
+      }
+   }
+
+   int fd = pack_open(cache, gen + 1, O_RDWR | O_CREAT | O_TRUNC);
+   if (fd == -1)
+      return;
+   close(fd);
+
+   cache->pack_header->prev_gen_size = cache->pack_header->gen_size;
+   cache->pack_header->gen_size = 0;
+   p_atomic_set(&cache->pack_header->gen, gen + 1);
+
+   pack_refresh_locked(cache);
+}
+
+/* Writes the pending records with a single write at the end of the pack
+ * file and adds them to the index. Only called from the put thread, or
+ * once the queue is gone.
+ */
+static void
+pack_flush(struct disk_cache *cache)
+{
+   size_t size = cache->pack_pending.size;
+
+   if (!size)
+      return;
+
+   if (flock(cache->pack_index_fd, LOCK_EX) == -1)
+      goto done;
+
+   mtx_lock(&cache->pack_lock);
+   pack_refresh_locked(cache);
+
+   struct pack_index_header *header = cache->pack_header;
+   if (header->gen_size && header->gen_size + size > cache->max_size / 2)
+      pack_new_gen_locked(cache);
+
+   /* Drop the previous generation too if the entries don't fit next to
+    * it. A new generation failing to start leaves the header as it is.
+    */
+   uint32_t gen;
+   do {
+      gen = header->gen;
+      if (header->gen_size + header->prev_gen_size +
+          cache->pack_pending_cost <= cache->max_size)
+         break;
+      if (header->gen_size || header->prev_gen_size)
+         pack_new_gen_locked(cache);
+   } while (header->gen != gen);
+
+   uint64_t offset = cache->pack_header->gen_size;
+   if (cache->pack_fd[0] != -1 &&
+       pack_pwrite_all(cache->pack_fd[0], cache->pack_pending.data, size,
+                       offset)) {
+      util_dynarray_foreach(&cache->pack_pending_entries,
+                            struct pack_pending_entry, entry) {
+         struct pack_index_slot *slot = pack_insert_slot(cache, entry->key);
+         if (!slot)
+            continue;
+
+         /* Readers of other processes check the record, so it's enough
+          * that the slot doesn't look live while it's rewritten.
+          */
+         p_atomic_set(&slot->gen, 0);
+         memcpy(slot->key, entry->key, CACHE_KEY_SIZE);
+         slot->offset = offset + entry->offset;
+         slot->size = entry->size;
+         p_atomic_set(&slot->gen, cache->pack_gen);
+      }
+
+      cache->pack_header->gen_size = offset + size;
+   }
+
+   mtx_unlock(&cache->pack_lock);
+   flock(cache->pack_index_fd, LOCK_UN);
+
+ done:
+   util_dynarray_clear(&cache->pack_pending);
+   util_dynarray_clear(&cache->pack_pending_entries);
+   cache->pack_pending_cost = 0;
+}
+
+static void
+pack_fini(struct disk_cache *cache)
+{
+   for (unsigned i = 0; i < 2; i++) {
+      if (cache->pack_fd[i] != -1)
+         close(cache->pack_fd[i]);
+   }
+
+   munmap(cache->pack_header, sizeof(struct pack_index_header) +
+          PACK_INDEX_SLOTS * sizeof(struct pack_index_slot));
+   close(cache->pack_index_fd);
+
+   mtx_destroy(&cache->pack_lock);
+   util_dynarray_fini(&cache->pack_pending);
+   util_dynarray_fini(&cache->pack_pending_entries);
+}
+
+static bool
+pack_init(struct disk_cache *cache, void *local)
+{
+   struct stat sb;
+   size_t size = sizeof(struct pack_index_header) +
+      PACK_INDEX_SLOTS * sizeof(struct pack_index_slot);
+
+   cache->pack_fd[0] = cache->pack_fd[1] = -1;
+
+   char *path = ralloc_asprintf(local, "%s/pack_index", cache->path);
+   if (path == NULL)
+      return false;
+
+   int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (fd == -1)
+      return false;
+
+   /* Only one process sets up the index, and the flush holds the same
+    * lock, so nobody appends to a pack file we truncate here.
+    */
+   if (flock(fd, LOCK_EX) == -1 || fstat(fd, &sb) == -1)
+      goto fail;
+
+   bool reset = sb.st_size != size;
+   if (reset) {
+      if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1)
+         goto fail;
+   }
+
+   void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED)
+      goto fail;
+
+   cache->pack_header = map;
+   cache->pack_slots = (struct pack_index_slot *) (cache->pack_header + 1);
+
+   if (reset || cache->pack_header->magic != PACK_MAGIC ||
+       cache->pack_header->version != PACK_VERSION ||
+       cache->pack_header->num_slots != PACK_INDEX_SLOTS ||
+       cache->pack_header->gen == 0) {
+      memset(map, 0, size);
+      cache->pack_header->magic = PACK_MAGIC;
+      cache->pack_header->version = PACK_VERSION;
+      cache->pack_header->num_slots = PACK_INDEX_SLOTS;
+      cache->pack_header->gen = 1;
+
+      int pack_fd = pack_open(cache, 1, O_RDWR | O_CREAT | O_TRUNC);
+      if (pack_fd == -1) {
+         munmap(map, size);
+         goto fail;
+      }
+      close(pack_fd);
+   }
+
+   flock(fd, LOCK_UN);
+
+   cache->pack_index_fd = fd;
+   mtx_init(&cache->pack_lock, mtx_plain);
+   util_dynarray_init(&cache->pack_pending, NULL);
+   util_dynarray_init(&cache->pack_pending_entries, NULL);
+
+   pack_refresh_locked(cache);
+   if (cache->pack_fd[0] == -1) {
+      pack_fini(cache);
+      return false;
+   }
+
+   return true;
+
+ fail:
+   close(fd);
+   return false;
+}
+
 struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *timestamp,
                   uint64_t driver_flags)
@@ -380,6 +773,10 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
                    UTIL_QUEUE_INIT_RESIZE_IF_FULL |
                    UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY);
 
+   /* Falls back to a file per entry if the pack can't be set up. */
+   if (env_var_as_boolean("MESA_GLSL_CACHE_SINGLE_FILE", false))
+      cache->pack = pack_init(cache, local);
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -436,6 +833,10 @@ disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
       util_queue_destroy(&cache->cache_queue);
+      if (cache->pack) {
+         pack_flush(cache);
+         pack_fini(cache);
+      }
       munmap(cache->index_mmap, cache->index_mmap_size);
    }
 
@@ -671,6 +1072,16 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   if (cache->pack) {
+      mtx_lock(&cache->pack_lock);
+      pack_refresh_locked(cache);
+      struct pack_index_slot *slot = pack_find_slot(cache, key);
+      if (slot)
+         p_atomic_set(&slot->gen, 0);
+      mtx_unlock(&cache->pack_lock);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -801,6 +1212,7 @@ create_put_job(struct disk_cache *cache, const cache_key key,
       dc_job->data = dc_job + 1;
       memcpy(dc_job->data, data, size);
       dc_job->size = size;
+      dc_job->is_pack_record = false;
 
       /* Copy the cache item metadata */
       if (cache_item_metadata) {
@@ -1006,6 +1418,173 @@ cache_put(void *job, int thread_index)
    free(filename);
 }
 
+/* Put job of the single file backend, appends the entry to the pending
+ * records and writes them once the queue runs dry or they get large.
+ */
+static void
+pack_cache_put(void *job, int thread_index)
+{
+   struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
+   struct disk_cache *cache = dc_job->cache;
+   struct pack_index_slot *slot;
+   bool present;
+
+   mtx_lock(&cache->pack_lock);
+   pack_refresh_locked(cache);
+   slot = pack_find_slot(cache, dc_job->key);
+   present = slot && slot->gen == cache->pack_gen;
+   mtx_unlock(&cache->pack_lock);
+
+   if (!present) {
+      uint32_t offset = cache->pack_pending.size;
+      size_t record_size;
+
+      if (dc_job->is_pack_record) {
+         record_size = dc_job->size;
+         memcpy(util_dynarray_grow(&cache->pack_pending, record_size),
+                dc_job->data, record_size);
+         cache->pack_pending_cost += record_size;
+      } else {
+         size_t header_size = sizeof(struct pack_record_header) +
+            cache->driver_keys_blob_size;
+         uLongf compressed_size = compressBound(dc_job->size);
+         uint8_t *record = util_dynarray_grow(&cache->pack_pending,
+                                              header_size + compressed_size);
+
+         if (compress2(record + header_size, &compressed_size, dc_job->data,
+                       dc_job->size, Z_BEST_COMPRESSION) != Z_OK) {
+            cache->pack_pending.size = offset;
+            goto flush;
+         }
+
+         struct pack_record_header header = {
+            .magic = PACK_MAGIC,
+            .crc32 = util_hash_crc32(dc_job->data, dc_job->size),
+            .uncompressed_size = dc_job->size,
+            .compressed_size = compressed_size,
+         };
+         memcpy(header.key, dc_job->key, CACHE_KEY_SIZE);
+
+         /* records aren't aligned in the pending buffer */
+         memcpy(record, &header, sizeof(header));
+         memcpy(record + sizeof(header), cache->driver_keys_blob,
+                cache->driver_keys_blob_size);
+
+         record_size = header_size + compressed_size;
+         cache->pack_pending.size = offset + record_size;
+         cache->pack_pending_cost += dc_job->size;
+      }
+
+      struct pack_pending_entry entry = {
+         .offset = offset,
+         .size = record_size,
+      };
+      memcpy(entry.key, dc_job->key, CACHE_KEY_SIZE);
+      util_dynarray_append(&cache->pack_pending_entries,
+                           struct pack_pending_entry, entry);
+   }
+
+ flush:
+   if (p_atomic_dec_zero(&cache->pack_queued) ||
+       cache->pack_pending.size >=
+       MIN2(PACK_FLUSH_SIZE, cache->max_size / 4))
+      pack_flush(cache);
+}
+
+static void
+pack_queue_put_job(struct disk_cache *cache, struct disk_cache_put_job *dc_job)
+{
+   p_atomic_inc(&cache->pack_queued);
+   util_queue_fence_init(&dc_job->fence);
+   util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                      pack_cache_put, destroy_put_job);
+}
+
+static void *
+pack_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   size_t header_size = sizeof(struct pack_record_header) +
+      cache->driver_keys_blob_size;
+   struct pack_record_header header;
+   uint8_t *record = NULL, *data = NULL;
+   bool promote;
+
+   mtx_lock(&cache->pack_lock);
+   pack_refresh_locked(cache);
+
+   struct pack_index_slot *slot = pack_find_slot(cache, key);
+   if (!slot) {
+      mtx_unlock(&cache->pack_lock);
+      return NULL;
+   }
+
+   uint32_t record_size = slot->size;
+   uint64_t offset = slot->offset;
+   promote = slot->gen != cache->pack_gen;
+   int fd = cache->pack_fd[promote ? 1 : 0];
+
+   if (fd == -1 || record_size < header_size ||
+       !(record = malloc(record_size)) ||
+       !pack_pread_all(fd, record, record_size, offset)) {
+      mtx_unlock(&cache->pack_lock);
+      goto fail;
+   }
+   mtx_unlock(&cache->pack_lock);
+
+   /* The slot may have been rewritten by another process under us, so
+    * check that the record is the one we want.
+    */
+   memcpy(&header, record, sizeof(header));
+   if (header.magic != PACK_MAGIC ||
+       memcmp(header.key, key, CACHE_KEY_SIZE) != 0 ||
+       header.compressed_size != record_size - header_size)
+      goto fail;
+
+   /* Check for extremely unlikely hash collisions */
+   if (memcmp(cache->driver_keys_blob, record + sizeof(header),
+              cache->driver_keys_blob_size) != 0) {
+      assert(!"Mesa cache keys mismatch!");
+      goto fail;
+   }
+
+   data = malloc(header.uncompressed_size);
+   if (!data)
+      goto fail;
+
+   uLongf uncompressed_size = header.uncompressed_size;
+   if (uncompress(data, &uncompressed_size, record + header_size,
+                  header.compressed_size) != Z_OK ||
+       uncompressed_size != header.uncompressed_size)
+      goto fail;
+
+   /* Check the data for corruption */
+   if (header.crc32 != util_hash_crc32(data, header.uncompressed_size))
+      goto fail;
+
+   /* Keep the entry alive by copying it to the current generation. */
+   if (promote) {
+      struct disk_cache_put_job *dc_job =
+         create_put_job(cache, key, record, record_size, NULL);
+      if (dc_job) {
+         dc_job->is_pack_record = true;
+         pack_queue_put_job(cache, dc_job);
+      }
+   }
+
+   free(record);
+
+   if (size)
+      *size = header.uncompressed_size;
+
+   return data;
+
+ fail:
+   free(record);
+   free(data);
+
+   return NULL;
+}
+
 void
 disk_cache_put(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
@@ -1023,6 +1602,11 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
       create_put_job(cache, key, data, size, cache_item_metadata);
 
    if (dc_job) {
+      if (cache->pack) {
+         pack_queue_put_job(cache, dc_job);
+         return;
+      }
+
       util_queue_fence_init(&dc_job->fence);
       util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
                          cache_put, destroy_put_job);
@@ -1103,6 +1687,9 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
+   if (cache->pack)
+      return pack_get(cache, key, size);
+
    filename = get_cache_file(cache, key);
    if (filename == NULL)
       goto fail;
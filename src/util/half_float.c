@@ -26,6 +26,17 @@
 #include <assert.h>
 #include "half_float.h"
 #include "rounding.h"
+#include "bitscan.h"
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define HALF_FLOAT_F16C
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HALF_FLOAT_NEON
+#endif
 
 typedef union { float f; int32_t i; uint32_t u; } fi_type;
 
@@ -175,3 +186,169 @@ _mesa_half_to_float(uint16_t val)
    result = fi.f;
    return result;
 }
+
+
+/* Same result as _mesa_float_to_half() with integer ops only, the rounding
+ * is done by adding just under half an ulp on top of the odd bit, and the
+ * halfs below the smallest normal by letting the float adder round.
+ */
+static inline uint16_t
+float_to_half_bits(float val)
+{
+   fi_type fi = {val};
+   uint32_t sign = fi.u & 0x80000000;
+   uint16_t result;
+
+   fi.u ^= sign;
+
+   if (fi.u >= 0x47800000) {
+      /* too large for a half, infinity or NaN */
+      result = fi.u > 0x7f800000 ? 0x7c01 : 0x7c00;
+   } else if (fi.u < 0x38800000) {
+      /* zero or a subnormal half: adding 0.5 leaves the half mantissa in
+       * the low bits of the float one, rounded to nearest even
+       */
+      fi.f += 0.5f;
+      result = fi.u - 0x3f000000;
+   } else {
+      uint32_t mant_odd = (fi.u >> 13) & 1;
+
+      /* rebias the exponent, a mantissa carry raises it */
+      fi.u = fi.u - ((127 - 15) << 23) + 0xfff + mant_odd;
+      result = fi.u >> 13;
+   }
+
+   return result | (sign >> 16);
+}
+
+/* Same result as _mesa_half_to_float() with integer ops only. */
+static inline float
+half_to_float_bits(uint16_t val)
+{
+   uint32_t sign = (uint32_t) (val & 0x8000) << 16;
+   uint32_t e = (val >> 10) & 0x1f;
+   uint32_t m = val & 0x3ff;
+   fi_type fi;
+
+   if (e == 31) {
+      fi.u = sign | 0x7f800000 | (m ? 1 : 0);
+   } else if (e) {
+      fi.u = sign | ((e + 112) << 23) | (m << 13);
+   } else if (m) {
+      /* subnormal half, normal as a float */
+      unsigned bit = util_last_bit(m) - 1;
+      fi.u = sign | ((bit + 103) << 23) | ((m << (23 - bit)) & 0x7fffff);
+   } else {
+      fi.u = sign;
+   }
+
+   return fi.f;
+}
+
+#if defined(HALF_FLOAT_F16C)
+
+/* The kernels are built for F16C whatever the build flags are, and only
+ * called once cpuid says the CPU and the OS support it.
+ */
+static bool
+has_f16c(void)
+{
+#ifdef __F16C__
+   return true;
+#else
+   static int f16c = -1;
+
+   if (f16c < 0) {
+      unsigned eax, ebx, ecx, edx;
+      bool supported = false;
+
+      /* the VEX encoded instrs also need the OS to save the ymm state */
+      if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+          (ecx & bit_F16C) && (ecx & bit_OSXSAVE)) {
+         uint32_t xcr0, xcr0_hi;
+
+         __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+         supported = (xcr0 & 6) == 6;
+      }
+
+      f16c = supported;
+   }
+
+   return f16c;
+#endif
+}
+
+__attribute__((target("avx,f16c"))) static unsigned
+float_to_half_array_f16c(uint16_t *dst, const float *src, unsigned num)
+{
+   unsigned i = 0;
+
+   for (; i + 8 <= num; i += 8) {
+      __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                  _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128((__m128i *)(dst + i), h);
+   }
+
+   return i;
+}
+
+__attribute__((target("avx,f16c"))) static unsigned
+half_to_float_array_f16c(float *dst, const uint16_t *src, unsigned num)
+{
+   unsigned i = 0;
+
+   for (; i + 8 <= num; i += 8) {
+      __m128i h = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+   }
+
+   return i;
+}
+
+#endif
+
+/**
+ * Converts an array of floats to halfs, with the same rounding as
+ * _mesa_float_to_half(), using F16C or NEON when the CPU has it. Only the
+ * NaNs may differ, they stay NaNs but the payload isn't the same.
+ */
+void
+util_float_to_half_array(uint16_t *dst, const float *src, unsigned num)
+{
+   unsigned i = 0;
+
+#if defined(HALF_FLOAT_F16C)
+   if (has_f16c())
+      i = float_to_half_array_f16c(dst, src, num);
+#elif defined(HALF_FLOAT_NEON)
+   for (; i + 4 <= num; i += 4) {
+      float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+      vst1_u16(dst + i, vreinterpret_u16_f16(h));
+   }
+#endif
+
+   for (; i < num; i++)
+      dst[i] = float_to_half_bits(src[i]);
+}
+
+/**
+ * Converts an array of halfs to floats, see util_float_to_half_array().
+ */
+void
+util_half_to_float_array(float *dst, const uint16_t *src, unsigned num)
+{
+   unsigned i = 0;
+
+#if defined(HALF_FLOAT_F16C)
+   if (has_f16c())
+      i = half_to_float_array_f16c(dst, src, num);
+#elif defined(HALF_FLOAT_NEON)
+   for (; i + 4 <= num; i += 4) {
+      float16x4_t h = vreinterpret_f16_u16(vld1_u16(src + i));
+      vst1q_f32(dst + i, vcvt_f32_f16(h));
+   }
+#endif
+
+   for (; i < num; i++)
+      dst[i] = half_to_float_bits(src[i]);
+}
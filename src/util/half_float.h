@@ -35,6 +35,9 @@ extern "C" {
 uint16_t _mesa_float_to_half(float val);
 float _mesa_half_to_float(uint16_t val);
 
+void util_float_to_half_array(uint16_t *dst, const float *src, unsigned num);
+void util_half_to_float_array(float *dst, const uint16_t *src, unsigned num);
+
 static inline bool
 _mesa_half_is_negative(uint16_t h)
 {
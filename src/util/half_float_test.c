@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "half_float.h"
+#include "os_time.h"
+
+/* an odd size so the arrays end with a tail the SIMD paths don't do */
+#define NUM 4099
+
+static uint32_t
+float_bits(float f)
+{
+   uint32_t u;
+   memcpy(&u, &f, sizeof(u));
+   return u;
+}
+
+static bool
+test_float_to_half(void)
+{
+   static float f[NUM];
+   static uint16_t h[NUM];
+   bool ok = true;
+
+   /* a stride of a prime sweeps all exponents and lots of roundings */
+   for (uint64_t x = 0; x < (1ull << 32);) {
+      unsigned num = 0;
+
+      for (; num < NUM && x < (1ull << 32); num++, x += 251) {
+         uint32_t u = x;
+         memcpy(&f[num], &u, sizeof(u));
+      }
+
+      util_float_to_half_array(h, f, num);
+
+      for (unsigned i = 0; i < num; i++) {
+         uint16_t expected = _mesa_float_to_half(f[i]);
+         uint16_t tail;
+         bool match;
+
+         /* a single value is only done by the scalar tail */
+         util_float_to_half_array(&tail, &f[i], 1);
+
+         match = isnan(f[i]) ?
+            (h[i] & 0x7c00) == 0x7c00 && (h[i] & 0x3ff) &&
+            (tail & 0x7c00) == 0x7c00 && (tail & 0x3ff) :
+            h[i] == expected && tail == expected;
+
+         if (!match) {
+            fprintf(stderr, "float 0x%08x: got 0x%04x and 0x%04x alone, "
+                    "expected 0x%04x\n", float_bits(f[i]), h[i], tail,
+                    expected);
+            ok = false;
+         }
+      }
+   }
+
+   return ok;
+}
+
+static bool
+test_half_to_float(void)
+{
+   static uint16_t h[65536];
+   static float f[65536];
+   bool ok = true;
+
+   for (unsigned i = 0; i < 65536; i++)
+      h[i] = i;
+
+   /* all the halfs, starting at each offset of a vector */
+   for (unsigned start = 0; start < 8; start++) {
+      util_half_to_float_array(f, h + start, 65536 - start);
+
+      for (unsigned i = start; i < 65536; i++) {
+         float expected = _mesa_half_to_float(i);
+         float got = f[i - start];
+         bool match = isnan(expected) ?
+            isnan(got) : float_bits(got) == float_bits(expected);
+
+         if (!match) {
+            fprintf(stderr, "half 0x%04x: got 0x%08x, expected 0x%08x\n",
+                    i, float_bits(got), float_bits(expected));
+            ok = false;
+         }
+      }
+   }
+
+   return ok;
+}
+
+static void
+bench(void)
+{
+   enum { BENCH_NUM = 1024, BENCH_LOOPS = 10000 };
+   static float f[BENCH_NUM];
+   static uint16_t h[BENCH_NUM];
+   int64_t start;
+
+   for (unsigned i = 0; i < BENCH_NUM; i++)
+      f[i] = (i - BENCH_NUM / 2) * 0.37f;
+
+   start = os_time_get_nano();
+   for (unsigned loop = 0; loop < BENCH_LOOPS; loop++) {
+      for (unsigned i = 0; i < BENCH_NUM; i++)
+         h[i] = _mesa_float_to_half(f[i] + loop);
+   }
+   printf("_mesa_float_to_half:      %.2f ns/value\n",
+          (os_time_get_nano() - start) / (double) (BENCH_NUM * BENCH_LOOPS));
+
+   start = os_time_get_nano();
+   for (unsigned loop = 0; loop < BENCH_LOOPS; loop++) {
+      f[loop % BENCH_NUM] += 1.0f;
+      util_float_to_half_array(h, f, BENCH_NUM);
+   }
+   printf("util_float_to_half_array: %.2f ns/value\n",
+          (os_time_get_nano() - start) / (double) (BENCH_NUM * BENCH_LOOPS));
+
+   start = os_time_get_nano();
+   for (unsigned loop = 0; loop < BENCH_LOOPS; loop++) {
+      for (unsigned i = 0; i < BENCH_NUM; i++)
+         f[i] = _mesa_half_to_float(h[i] + loop);
+   }
+   printf("_mesa_half_to_float:      %.2f ns/value\n",
+          (os_time_get_nano() - start) / (double) (BENCH_NUM * BENCH_LOOPS));
+
+   start = os_time_get_nano();
+   for (unsigned loop = 0; loop < BENCH_LOOPS; loop++) {
+      h[loop % BENCH_NUM]++;
+      util_half_to_float_array(f, h, BENCH_NUM);
+   }
+   printf("util_half_to_float_array: %.2f ns/value\n",
+          (os_time_get_nano() - start) / (double) (BENCH_NUM * BENCH_LOOPS));
+}
+
+int main(int argc, char *argv[])
+{
+   bool ok = true;
+
+   ok &= test_float_to_half();
+   ok &= test_half_to_float();
+
+   /* with --bench, also time the conversions against the scalar ones */
+   if (argc > 1 && !strcmp(argv[1], "--bench"))
+      bench();
+
+   return ok ? 0 : 1;
+}
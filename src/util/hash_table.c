@@ -38,6 +38,20 @@
  * For more information, see:
  *
  * http://cgit.freedesktop.org/~anholt/hash_table/tree/README
+ *
+ * Next to the entries, a control array holds one byte per entry: 7 bits
+ * of the hash for present entries, or a free or deleted marker. Probing
+ * walks groups of CTRL_GROUP_SIZE consecutive entries, comparing all the
+ * control bytes of a group at once and only touching the entries whose
+ * byte matches, and ends at the first group with a free entry. The
+ * control array is followed by copies of its first bytes, so a group
+ * starting near the end can be loaded in one go.
+ *
+ * Most tables hold a handful of keys, so they start in the small_table of
+ * the struct, without a control array, and only get a table allocated once
+ * they outgrow it. There the keys are packed from the start, deleted ones
+ * leaving a deleted entry, and a search walks them up to the first free
+ * entry.
  */
 
 #include <stdlib.h>
@@ -47,10 +61,21 @@
 #include "hash_table.h"
 #include "ralloc.h"
 #include "macros.h"
+#include "bitscan.h"
 #include "main/hash.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 static const uint32_t deleted_key_value;
 
+#define CTRL_GROUP_SIZE 16
+#define CTRL_FREE       0x80
+#define CTRL_DELETED    0xfe
+
 /**
  * From Knuth -- a good choice for hash/rehash values is p, p-2 where
  * p and p-2 are both prime.  These tables are sized to have an extra 10%
@@ -92,10 +117,48 @@ static const struct {
    { 2147483648ul,	2362232233ul,	2362232231ul}
 };
 
-static int
-entry_is_free(const struct hash_entry *entry)
+/* the upper bits, the lower ones pick the first entry to probe */
+static uint8_t
+ctrl_tag(uint32_t hash)
+{
+   return (hash * 0x9e3779b1u) >> 25;
+}
+
+static uint32_t
+ctrl_size(uint32_t size)
 {
-   return entry->key == NULL;
+   return size + CTRL_GROUP_SIZE - 1;
+}
+
+/* bit i is set when byte i of the group equals value */
+static uint32_t
+ctrl_group_match(const uint8_t *group, uint8_t value)
+{
+#if defined(__SSE2__)
+   __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+   static const uint8_t bits[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+   uint8x16_t match = vandq_u8(vceqq_u8(vld1q_u8(group), vdupq_n_u8(value)),
+                               vld1q_u8(bits));
+   return vaddv_u8(vget_low_u8(match)) |
+          (vaddv_u8(vget_high_u8(match)) << 8);
+#else
+   uint32_t mask = 0;
+   for (int i = 0; i < CTRL_GROUP_SIZE; i++)
+      mask |= (uint32_t)(group[i] == value) << i;
+   return mask;
+#endif
+}
+
+/* sets the byte of an entry and its copies after the end */
+static void
+ctrl_set(struct hash_table *ht, uint32_t index, uint8_t value)
+{
+   for (uint32_t i = index; i < ctrl_size(ht->size); i += ht->size)
+      ht->ctrl[i] = value;
 }
 
 static int
@@ -110,6 +173,12 @@ entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
    return entry->key != NULL && entry->key != ht->deleted_key;
 }
 
+static bool
+hash_table_is_small(const struct hash_table *ht)
+{
+   return ht->table == ht->small_table;
+}
+
 struct hash_table *
 _mesa_hash_table_create(void *mem_ctx,
                         uint32_t (*key_hash_function)(const void *key),
@@ -123,20 +192,17 @@ _mesa_hash_table_create(void *mem_ctx,
       return NULL;
 
    ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->size = HASH_TABLE_SMALL_SIZE;
+   ht->rehash = 0;
+   ht->max_entries = HASH_TABLE_SMALL_SIZE;
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(ht, struct hash_entry, ht->size);
+   ht->table = ht->small_table;
+   ht->ctrl = NULL;
    ht->entries = 0;
    ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
-
-   if (ht->table == NULL) {
-      ralloc_free(ht);
-      return NULL;
-   }
+   memset(ht->small_table, 0, sizeof(ht->small_table));
 
    return ht;
 }
@@ -152,13 +218,20 @@ _mesa_hash_table_clone(struct hash_table *src, void *dst_mem_ctx)
 
    memcpy(ht, src, sizeof(struct hash_table));
 
+   if (hash_table_is_small(src)) {
+      ht->table = ht->small_table;
+      return ht;
+   }
+
    ht->table = ralloc_array(ht, struct hash_entry, ht->size);
-   if (ht->table == NULL) {
+   ht->ctrl = ralloc_array(ht, uint8_t, ctrl_size(ht->size));
+   if (ht->table == NULL || ht->ctrl == NULL) {
       ralloc_free(ht);
       return NULL;
    }
 
    memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry));
+   memcpy(ht->ctrl, src->ctrl, ctrl_size(ht->size));
 
    return ht;
 }
@@ -208,6 +281,8 @@ _mesa_hash_table_clear(struct hash_table *ht,
       entry->key = NULL;
    }
 
+   if (ht->ctrl)
+      memset(ht->ctrl, CTRL_FREE, ctrl_size(ht->size));
    ht->entries = 0;
    ht->deleted_entries = 0;
 }
@@ -228,33 +303,84 @@ _mesa_hash_table_set_deleted_key(struct hash_table *ht, const void *deleted_key)
    ht->deleted_key = deleted_key;
 }
 
+/**
+ * Walks the groups from the one of the hash until one has a free entry,
+ * returning the present entry with the key, or NULL and the first free
+ * or deleted entry on the way in available if asked.
+ */
 static struct hash_entry *
-hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
+hash_table_probe(struct hash_table *ht, uint32_t hash, const void *key,
+                 struct hash_entry **available)
 {
-   uint32_t start_hash_address = hash % ht->size;
-   uint32_t hash_address = start_hash_address;
+   uint8_t tag = ctrl_tag(hash);
+   uint32_t address = hash % ht->size;
 
-   do {
-      uint32_t double_hash;
+   for (uint32_t probed = 0; probed < ht->size;
+        probed += CTRL_GROUP_SIZE) {
+      const uint8_t *group = ht->ctrl + address;
 
-      struct hash_entry *entry = ht->table + hash_address;
+      unsigned match = ctrl_group_match(group, tag);
+      while (match) {
+         uint32_t index = address + u_bit_scan(&match);
+         struct hash_entry *entry =
+            ht->table + (index < ht->size ? index : index % ht->size);
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(ht, entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
             return entry;
+      }
+
+      uint32_t free_mask = ctrl_group_match(group, CTRL_FREE);
+      if (available && !*available) {
+         uint32_t mask = free_mask | ctrl_group_match(group, CTRL_DELETED);
+         if (mask) {
+            uint32_t index = (address + ffs(mask) - 1) % ht->size;
+            *available = ht->table + index;
          }
       }
 
-      double_hash = 1 + hash % ht->rehash;
+      if (free_mask)
+         return NULL;
+
+      address = (address + CTRL_GROUP_SIZE) % ht->size;
+   }
+
+   return NULL;
+}
+
+/**
+ * hash_table_probe() for the small table.
+ */
+static struct hash_entry *
+hash_table_small_probe(struct hash_table *ht, uint32_t hash, const void *key,
+                       struct hash_entry **available)
+{
+   struct hash_entry *entry;
+
+   for (entry = ht->table; entry != ht->table + HASH_TABLE_SMALL_SIZE;
+        entry++) {
+      if (!entry_is_present(ht, entry)) {
+         if (available && !*available)
+            *available = entry;
+         if (entry->key == NULL)
+            break;
+         continue;
+      }
 
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
+      if (entry->hash == hash && ht->key_equals_function(key, entry->key))
+         return entry;
+   }
 
    return NULL;
 }
 
+static struct hash_entry *
+hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   if (hash_table_is_small(ht))
+      return hash_table_small_probe(ht, hash, key, NULL);
+   return hash_table_probe(ht, hash, key, NULL);
+}
+
 /**
  * Finds a hash table entry with the given key and hash of that key.
  *
@@ -285,6 +411,7 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
 {
    struct hash_table old_ht;
    struct hash_entry *table, *entry;
+   uint8_t *ctrl;
 
    if (new_size_index >= ARRAY_SIZE(hash_sizes))
       return;
@@ -294,80 +421,116 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
    if (table == NULL)
       return;
 
+   ctrl = ralloc_array(ht, uint8_t,
+                       ctrl_size(hash_sizes[new_size_index].size));
+   if (ctrl == NULL) {
+      ralloc_free(table);
+      return;
+   }
+
    old_ht = *ht;
 
    ht->table = table;
+   ht->ctrl = ctrl;
    ht->size_index = new_size_index;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
    ht->max_entries = hash_sizes[ht->size_index].max_entries;
    ht->entries = 0;
    ht->deleted_entries = 0;
+   memset(ht->ctrl, CTRL_FREE, ctrl_size(ht->size));
 
    hash_table_foreach(&old_ht, entry) {
       hash_table_insert(ht, entry->hash, entry->key, entry->data);
    }
 
-   ralloc_free(old_ht.table);
+   /* old_ht.table is still ht->small_table when growing out of it */
+   if (old_ht.table != ht->small_table) {
+      ralloc_free(old_ht.table);
+      ralloc_free(old_ht.ctrl);
+   }
+}
+
+/* the first size class with room for more than the small table */
+static unsigned
+hash_table_small_grow_index(void)
+{
+   unsigned i = 0;
+
+   while (hash_sizes[i].max_entries <= HASH_TABLE_SMALL_SIZE)
+      i++;
+
+   return i;
+}
+
+static struct hash_entry *
+hash_table_small_insert(struct hash_table *ht, uint32_t hash,
+                        const void *key, void *data)
+{
+   struct hash_entry *entry, *available_entry = NULL;
+
+   entry = hash_table_small_probe(ht, hash, key, &available_entry);
+   if (entry) {
+      entry->key = key;
+      entry->data = data;
+      return entry;
+   }
+
+   if (available_entry == NULL) {
+      _mesa_hash_table_rehash(ht, hash_table_small_grow_index());
+      if (hash_table_is_small(ht))
+         return NULL;
+      return hash_table_insert(ht, hash, key, data);
+   }
+
+   if (entry_is_deleted(ht, available_entry))
+      ht->deleted_entries--;
+   available_entry->hash = hash;
+   available_entry->key = key;
+   available_entry->data = data;
+   ht->entries++;
+   return available_entry;
 }
 
 static struct hash_entry *
 hash_table_insert(struct hash_table *ht, uint32_t hash,
                   const void *key, void *data)
 {
-   uint32_t start_hash_address, hash_address;
-   struct hash_entry *available_entry = NULL;
+   struct hash_entry *entry, *available_entry = NULL;
 
    assert(key != NULL);
 
+   if (hash_table_is_small(ht))
+      return hash_table_small_insert(ht, hash, key, data);
+
    if (ht->entries >= ht->max_entries) {
       _mesa_hash_table_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
       _mesa_hash_table_rehash(ht, ht->size_index);
    }
 
-   start_hash_address = hash % ht->size;
-   hash_address = start_hash_address;
-   do {
-      struct hash_entry *entry = ht->table + hash_address;
-      uint32_t double_hash;
-
-      if (!entry_is_present(ht, entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
-      }
-
-      /* Implement replacement when another insert happens
-       * with a matching key.  This is a relatively common
-       * feature of hash tables, with the alternative
-       * generally being "insert the new value as well, and
-       * return it first when the key is searched for".
-       *
-       * Note that the hash table doesn't have a delete
-       * callback.  If freeing of old data pointers is
-       * required to avoid memory leaks, perform a search
-       * before inserting.
-       */
-      if (!entry_is_deleted(ht, entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         entry->key = key;
-         entry->data = data;
-         return entry;
-      }
-
-
-      double_hash = 1 + hash % ht->rehash;
-
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
+   /* Implement replacement when another insert happens
+    * with a matching key.  This is a relatively common
+    * feature of hash tables, with the alternative
+    * generally being "insert the new value as well, and
+    * return it first when the key is searched for".
+    *
+    * Note that the hash table doesn't have a delete
+    * callback.  If freeing of old data pointers is
+    * required to avoid memory leaks, perform a search
+    * before inserting.
+    */
+   entry = hash_table_probe(ht, hash, key, &available_entry);
+   if (entry) {
+      entry->key = key;
+      entry->data = data;
+      return entry;
+   }
 
    if (available_entry) {
       if (entry_is_deleted(ht, available_entry))
          ht->deleted_entries--;
+      ctrl_set(ht, available_entry - ht->table, ctrl_tag(hash));
       available_entry->hash = hash;
       available_entry->key = key;
       available_entry->data = data;
@@ -416,6 +579,8 @@ _mesa_hash_table_remove(struct hash_table *ht,
       return;
 
    entry->key = ht->deleted_key;
+   if (ht->ctrl)
+      ctrl_set(ht, entry - ht->table, CTRL_DELETED);
    ht->entries--;
    ht->deleted_entries++;
 }
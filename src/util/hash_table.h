@@ -44,8 +44,15 @@ struct hash_entry {
    void *data;
 };
 
+/* tables start with their entries in small_table, searched linearly, and
+ * move to an allocated table past HASH_TABLE_SMALL_SIZE keys
+ */
+#define HASH_TABLE_SMALL_SIZE 8
+
 struct hash_table {
    struct hash_entry *table;
+   /* one byte per entry, see hash_table.c */
+   uint8_t *ctrl;
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
@@ -55,6 +62,7 @@ struct hash_table {
    uint32_t size_index;
    uint32_t entries;
    uint32_t deleted_entries;
+   struct hash_entry small_table[HASH_TABLE_SMALL_SIZE];
 };
 
 struct hash_table *
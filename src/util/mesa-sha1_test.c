@@ -27,9 +27,51 @@
 
 #include "macros.h"
 #include "mesa-sha1.h"
+#include "sha1/sha1.h"
 
 #define SHA1_LENGTH 40
 
+/* Checks the SHA1TransformBlocks() runs, which use the CPU specific paths,
+ * against the portable SHA1Transform() on each block.
+ */
+static bool
+test_transform_blocks(void)
+{
+   static uint8_t data[SHA1_BLOCK_LENGTH * 37];
+   uint32_t seed = 0x12345678;
+   bool failed = false;
+
+   for (unsigned i = 0; i < sizeof(data); i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 16;
+   }
+
+   for (unsigned offset = 0; offset < 8; offset++) {
+      for (unsigned blocks = 0;
+           offset + (blocks + 1) * SHA1_BLOCK_LENGTH <= sizeof(data);
+           blocks++) {
+         uint32_t got[5] = {
+            0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+         };
+         uint32_t expected[5];
+         const uint8_t *p = data + offset;
+
+         memcpy(expected, got, sizeof(expected));
+         SHA1TransformBlocks(got, p, blocks);
+         for (unsigned i = 0; i < blocks; i++)
+            SHA1Transform(expected, p + i * SHA1_BLOCK_LENGTH);
+
+         if (memcmp(got, expected, sizeof(got)) != 0) {
+            printf("SHA1TransformBlocks of %u blocks at offset %u differs\n",
+                   blocks, offset);
+            failed = true;
+         }
+      }
+   }
+
+   return failed;
+}
+
 int main(int argc, char *argv[])
 {
    static const struct {
@@ -61,5 +103,7 @@ int main(int argc, char *argv[])
       }
    }
 
+   failed |= test_transform_blocks();
+
    return failed;
 }
@@ -46,6 +46,8 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 
 #define CANARY 0x5A1106
 
+#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
+
 /* Align the header's size so that ralloc() allocations will return with the
  * same alignment as a libc malloc would have (8 on 32-bit GLIBC, 16 on
  * 64-bit), avoiding performance penalities on x86 and alignment faults on
@@ -76,12 +78,16 @@ struct
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* The pool chunk of the block, NULL when it was malloc'd. */
+   struct ralloc_pool_chunk *chunk;
 };
 
 typedef struct ralloc_header ralloc_header;
 
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
+static void pool_free(ralloc_header *info);
 
 static ralloc_header *
 get_header(const void *ptr)
@@ -109,6 +115,201 @@ add_child(ralloc_header *parent, ralloc_header *info)
    }
 }
 
+/*
+ * Pools: the blocks of up to RALLOC_POOL_MAX_SIZE bytes, header included,
+ * are carved out of chunks holding blocks of one size.  A freed block goes
+ * on the free list of its size, and the chunks are only given back to
+ * malloc by ralloc_pool_trim or ralloc_pool_destroy.
+ */
+#define RALLOC_POOL_GRANULARITY 32
+#define RALLOC_POOL_MAX_SIZE 1024
+#define RALLOC_POOL_NUM_BUCKETS (RALLOC_POOL_MAX_SIZE / RALLOC_POOL_GRANULARITY)
+#define RALLOC_POOL_CHUNK_SIZE 16384
+
+struct ralloc_pool_bucket;
+
+struct ralloc_pool_chunk {
+   struct ralloc_pool_bucket *bucket;
+   struct ralloc_pool_chunk *next;
+   /* blocks not on the free list */
+   unsigned live;
+};
+
+/* the blocks of a chunk keep the alignment of malloc */
+#define RALLOC_POOL_CHUNK_HEADER_SIZE \
+   ALIGN_POT(sizeof(struct ralloc_pool_chunk), RALLOC_POOL_GRANULARITY)
+
+struct ralloc_pool_bucket {
+   struct ralloc_pool_chunk *chunks;
+   /* linked through the next pointers of the blocks */
+   ralloc_header *free;
+   size_t block_size;
+};
+
+struct ralloc_pool {
+   struct ralloc_pool_bucket buckets[RALLOC_POOL_NUM_BUCKETS];
+};
+
+static size_t
+pool_block_size(const ralloc_header *info)
+{
+   return info->chunk->bucket->block_size;
+}
+
+static bool
+pool_grow(struct ralloc_pool_bucket *bucket)
+{
+   struct ralloc_pool_chunk *chunk = malloc(RALLOC_POOL_CHUNK_SIZE);
+   if (unlikely(chunk == NULL))
+      return false;
+
+   chunk->bucket = bucket;
+   chunk->next = bucket->chunks;
+   chunk->live = 0;
+   bucket->chunks = chunk;
+
+   char *block = (char *) chunk + RALLOC_POOL_CHUNK_HEADER_SIZE;
+   char *end = (char *) chunk + RALLOC_POOL_CHUNK_SIZE;
+   for (; block + bucket->block_size <= end; block += bucket->block_size) {
+      ralloc_header *info = (ralloc_header *) block;
+
+      info->chunk = chunk;
+      info->next = bucket->free;
+#ifdef DEBUG
+      info->canary = 0;
+#endif
+      bucket->free = info;
+   }
+
+   return true;
+}
+
+static void
+pool_free(ralloc_header *info)
+{
+   struct ralloc_pool_chunk *chunk = info->chunk;
+   struct ralloc_pool_bucket *bucket = chunk->bucket;
+
+   assert(chunk->live > 0);
+   chunk->live--;
+
+#ifdef DEBUG
+   info->canary = 0;
+#endif
+   info->next = bucket->free;
+   bucket->free = info;
+}
+
+ralloc_pool *
+ralloc_pool_create(void)
+{
+   ralloc_pool *pool = calloc(1, sizeof(*pool));
+
+   if (unlikely(pool == NULL))
+      return NULL;
+
+   for (unsigned i = 0; i < RALLOC_POOL_NUM_BUCKETS; i++)
+      pool->buckets[i].block_size = (i + 1) * RALLOC_POOL_GRANULARITY;
+
+   return pool;
+}
+
+void
+ralloc_pool_destroy(ralloc_pool *pool)
+{
+   if (pool == NULL)
+      return;
+
+   for (unsigned i = 0; i < RALLOC_POOL_NUM_BUCKETS; i++) {
+      struct ralloc_pool_chunk *chunk = pool->buckets[i].chunks;
+
+      while (chunk != NULL) {
+         struct ralloc_pool_chunk *next = chunk->next;
+         free(chunk);
+         chunk = next;
+      }
+   }
+
+   free(pool);
+}
+
+void
+ralloc_pool_trim(ralloc_pool *pool)
+{
+   if (pool == NULL)
+      return;
+
+   for (unsigned i = 0; i < RALLOC_POOL_NUM_BUCKETS; i++) {
+      struct ralloc_pool_bucket *bucket = &pool->buckets[i];
+      ralloc_header **free_link = &bucket->free;
+
+      /* drop the blocks of the empty chunks from the free list */
+      while (*free_link != NULL) {
+         if ((*free_link)->chunk->live == 0)
+            *free_link = (*free_link)->next;
+         else
+            free_link = &(*free_link)->next;
+      }
+
+      struct ralloc_pool_chunk **chunk_link = &bucket->chunks;
+      while (*chunk_link != NULL) {
+         struct ralloc_pool_chunk *chunk = *chunk_link;
+
+         if (chunk->live == 0) {
+            *chunk_link = chunk->next;
+            free(chunk);
+         } else {
+            chunk_link = &chunk->next;
+         }
+      }
+   }
+}
+
+void *
+ralloc_pool_size(ralloc_pool *pool, const void *ctx, size_t size)
+{
+   size_t block_size = ALIGN_POT(size + sizeof(ralloc_header),
+                                 RALLOC_POOL_GRANULARITY);
+
+   if (pool == NULL || block_size > RALLOC_POOL_MAX_SIZE)
+      return ralloc_size(ctx, size);
+
+   struct ralloc_pool_bucket *bucket =
+      &pool->buckets[block_size / RALLOC_POOL_GRANULARITY - 1];
+
+   if (bucket->free == NULL && !pool_grow(bucket))
+      return NULL;
+
+   ralloc_header *info = bucket->free;
+   bucket->free = info->next;
+   info->chunk->live++;
+
+   info->parent = NULL;
+   info->child = NULL;
+   info->prev = NULL;
+   info->next = NULL;
+   info->destructor = NULL;
+
+   add_child(ctx != NULL ? get_header(ctx) : NULL, info);
+
+#ifdef DEBUG
+   info->canary = CANARY;
+#endif
+
+   return PTR_FROM_HEADER(info);
+}
+
+void *
+rzalloc_pool_size(ralloc_pool *pool, const void *ctx, size_t size)
+{
+   void *ptr = ralloc_pool_size(pool, ctx, size);
+
+   if (likely(ptr))
+      memset(ptr, 0, size);
+
+   return ptr;
+}
+
 void *
 ralloc_context(const void *ctx)
 {
@@ -135,6 +336,7 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
+   info->chunk = NULL;
 
    parent = ctx != NULL ? get_header(ctx) : NULL;
 
@@ -165,7 +367,21 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
+
+   /* pooled blocks move to a malloc'd one, which can grow */
+   if (old->chunk) {
+      size_t old_size = pool_block_size(old) - sizeof(ralloc_header);
+
+      info = malloc(size + sizeof(ralloc_header));
+      if (info == NULL)
+         return NULL;
+
+      memcpy(info, old, sizeof(ralloc_header) + MIN2(old_size, size));
+      info->chunk = NULL;
+      pool_free(old);
+   } else {
+      info = realloc(old, size + sizeof(ralloc_header));
+   }
 
    if (info == NULL)
       return NULL;
@@ -273,7 +489,10 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (info->chunk)
+      pool_free(info);
+   else
+      free(info);
 }
 
 void
@@ -553,8 +772,6 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
  * other buffers.
  */
 
-#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
-
 #define MIN_LINEAR_BUFSIZE 2048
 #define SUBALLOC_ALIGNMENT sizeof(uintptr_t)
 #define LMAGIC 0x87b9c7d3
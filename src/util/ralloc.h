@@ -251,6 +251,50 @@ void *ralloc_parent(const void *ptr);
  */
 void ralloc_set_destructor(const void *ptr, void(*destructor)(void *));
 
+/// \defgroup pool Pooled Allocation @{
+/**
+ * A pool of ralloc blocks, for the users allocating and freeing lots of
+ * small objects.
+ *
+ * The blocks allocated from a pool are regular ralloc blocks: they have a
+ * context, children, and can be stolen, resized or freed.  When freed,
+ * their memory goes to a free list of the pool for the next blocks of the
+ * same size instead of back to malloc.
+ *
+ * The pool must outlive all of its blocks.  It isn't thread safe, the
+ * blocks of a pool must be allocated and freed by one thread at a time.
+ */
+typedef struct ralloc_pool ralloc_pool;
+
+ralloc_pool *ralloc_pool_create(void);
+
+/**
+ * Free the memory of the pool.  Its blocks must already be freed.
+ */
+void ralloc_pool_destroy(ralloc_pool *pool);
+
+/**
+ * Give the memory not used by any block back to malloc.
+ */
+void ralloc_pool_trim(ralloc_pool *pool);
+
+/**
+ * Allocate memory chained off of the given context out of \p pool.
+ *
+ * Large blocks, and all of them when \p pool is NULL, are allocated as by
+ * ralloc_size.
+ */
+void *ralloc_pool_size(ralloc_pool *pool, const void *ctx, size_t size)
+   MALLOCLIKE;
+
+/**
+ * Allocate zero-initialized memory chained off of the given context out of
+ * \p pool.
+ */
+void *rzalloc_pool_size(ralloc_pool *pool, const void *ctx, size_t size)
+   MALLOCLIKE;
+/// @}
+
 /// \defgroup array String Functions @{
 /**
  * Duplicate a string, allocating the memory from the given context.
@@ -0,0 +1,196 @@
+/*
+ * Copyright © 2019 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ralloc.h"
+#include "os_time.h"
+
+#define NUM 4096
+
+static unsigned destroyed;
+
+static void
+count_destructor(void *ptr)
+{
+   destroyed++;
+}
+
+static bool
+check_fill(const uint8_t *p, size_t size, uint8_t value)
+{
+   for (size_t i = 0; i < size; i++) {
+      if (p[i] != value)
+         return false;
+   }
+   return true;
+}
+
+/* blocks of all sizes, with children, stolen, resized and freed */
+static bool
+test_blocks(void)
+{
+   static uint8_t *blocks[NUM];
+   static size_t sizes[NUM];
+   static bool stolen[NUM];
+   ralloc_pool *pool = ralloc_pool_create();
+   void *ctx = ralloc_context(NULL);
+   void *other = ralloc_context(NULL);
+   bool ok = true;
+
+   srand(1);
+   for (unsigned round = 0; round < 8; round++) {
+      for (unsigned i = 0; i < NUM; i++) {
+         if (blocks[i])
+            continue;
+
+         sizes[i] = rand() % 1200;
+         blocks[i] = (i & 1) ? rzalloc_pool_size(pool, ctx, sizes[i]) :
+                               ralloc_pool_size(pool, ctx, sizes[i]);
+         if (!blocks[i] || ralloc_parent(blocks[i]) != ctx ||
+             ((uintptr_t)blocks[i] & (sizeof(void *) * 2 - 1)) ||
+             ((i & 1) && !check_fill(blocks[i], sizes[i], 0))) {
+            fprintf(stderr, "bad block %u of size %zu\n", i, sizes[i]);
+            ok = false;
+         }
+         memset(blocks[i], i & 0xff, sizes[i]);
+
+         /* a child, freed with its parent */
+         if (i % 3 == 0) {
+            void *child = ralloc_pool_size(pool, blocks[i], 40);
+            ralloc_set_destructor(child, count_destructor);
+         }
+      }
+
+      for (unsigned i = 0; i < NUM; i++) {
+         if (!check_fill(blocks[i], sizes[i], i & 0xff)) {
+            fprintf(stderr, "block %u overwritten\n", i);
+            ok = false;
+         }
+
+         switch (rand() % 4) {
+         case 0:
+            ralloc_free(blocks[i]);
+            blocks[i] = NULL;
+            break;
+         case 1:
+            ralloc_steal(other, blocks[i]);
+            stolen[i] = true;
+            break;
+         case 2: {
+            size_t size = rand() % 2000;
+            blocks[i] = reralloc_size(ralloc_parent(blocks[i]), blocks[i],
+                                      size);
+            if (!check_fill(blocks[i], MIN2(size, sizes[i]), i & 0xff)) {
+               fprintf(stderr, "block %u lost its data on resize\n", i);
+               ok = false;
+            }
+            memset(blocks[i], i & 0xff, size);
+            sizes[i] = size;
+            break;
+         }
+         default:
+            break;
+         }
+      }
+
+      /* drop the stolen ones and the empty chunks now and then */
+      if (round % 3 == 2) {
+         ralloc_free(other);
+         other = ralloc_context(NULL);
+         for (unsigned i = 0; i < NUM; i++) {
+            if (stolen[i])
+               blocks[i] = NULL;
+            stolen[i] = false;
+         }
+         ralloc_pool_trim(pool);
+      }
+   }
+
+   unsigned children = 0;
+   for (unsigned i = 0; i < NUM; i++)
+      children += blocks[i] && i % 3 == 0;
+
+   destroyed = 0;
+   ralloc_free(ctx);
+   ralloc_free(other);
+   ralloc_pool_destroy(pool);
+
+   /* the children of the live blocks in both contexts */
+   if (destroyed < children) {
+      fprintf(stderr, "%u children destroyed, expected at least %u\n",
+              destroyed, children);
+      ok = false;
+   }
+
+   return ok;
+}
+
+/* allocating and freeing a mix of small blocks, as compilers do */
+static void
+bench(bool pooled)
+{
+   static void *blocks[NUM];
+   ralloc_pool *pool = pooled ? ralloc_pool_create() : NULL;
+   void *ctx = ralloc_context(NULL);
+   int64_t start = os_time_get_nano();
+
+   srand(2);
+   for (unsigned round = 0; round < 200; round++) {
+      for (unsigned i = 0; i < NUM; i++) {
+         if (!blocks[i])
+            blocks[i] = ralloc_pool_size(pool, ctx, 64 + rand() % 256);
+      }
+      for (unsigned i = 0; i < NUM; i++) {
+         if (rand() & 1) {
+            ralloc_free(blocks[i]);
+            blocks[i] = NULL;
+         }
+      }
+   }
+
+   ralloc_free(ctx);
+   ralloc_pool_destroy(pool);
+   memset(blocks, 0, sizeof(blocks));
+
+   printf("%s: %.2f ms\n", pooled ? "pooled" : "malloc",
+          (os_time_get_nano() - start) / 1000000.0);
+}
+
+int
+main(int argc, char **argv)
+{
+   bool ok = test_blocks();
+
+   if (argc > 1 && !strcmp(argv[1], "-bench")) {
+      bench(false);
+      bench(true);
+   }
+
+   printf("%s\n", ok ? "pass" : "fail");
+   return ok ? 0 : 1;
+}
@@ -326,15 +326,6 @@ ra_class_add_reg(struct ra_regs *regs, unsigned int c, unsigned int r)
    class->p++;
 }
 
-/**
- * Returns true if the register belongs to the given class.
- */
-static bool
-reg_belongs_to_class(unsigned int r, struct ra_class *c)
-{
-   return BITSET_TEST(c->regs, r);
-}
-
 /**
  * Must be called after all conflicts and register classes have been
  * set up and before the register set is used for allocation.
@@ -358,28 +349,28 @@ ra_set_finalize(struct ra_regs *regs, unsigned int **q_values)
       }
    } else {
       /* Compute, for each class B and C, how many regs of B an
-       * allocation to C could conflict with.
+       * allocation to C could conflict with. The conflicts bitset holds
+       * the same regs as the conflict list, so count them a word at a
+       * time.
        */
       for (b = 0; b < regs->class_count; b++) {
          for (c = 0; c < regs->class_count; c++) {
+            struct ra_class *class_b = regs->classes[b];
             unsigned int rc;
+            BITSET_WORD tmp;
             int max_conflicts = 0;
 
-            for (rc = 0; rc < regs->count; rc++) {
+            BITSET_FOREACH_SET(rc, tmp, regs->classes[c]->regs, regs->count) {
                int conflicts = 0;
                unsigned int i;
 
-               if (!reg_belongs_to_class(rc, regs->classes[c]))
-                  continue;
-
-               for (i = 0; i < regs->regs[rc].num_conflicts; i++) {
-                  unsigned int rb = regs->regs[rc].conflict_list[i];
-                  if (reg_belongs_to_class(rb, regs->classes[b]))
-                     conflicts++;
+               for (i = 0; i < BITSET_WORDS(regs->count); i++) {
+                  conflicts += _mesa_bitcount(regs->regs[rc].conflicts[i] &
+                                              class_b->regs[i]);
                }
                max_conflicts = MAX2(max_conflicts, conflicts);
             }
-            regs->classes[b]->q[c] = max_conflicts;
+            class_b->q[c] = max_conflicts;
          }
       }
    }
@@ -477,8 +468,12 @@ pq_test(struct ra_graph *g, unsigned int n)
    return g->nodes[n].q_total < g->regs->classes[n_class]->p;
 }
 
+/* Removes the node from the graph, and marks the neighbors that became
+ * trivially colorable as ready. q only goes down, so a node is marked at
+ * most once.
+ */
 static void
-decrement_q(struct ra_graph *g, unsigned int n)
+decrement_q(struct ra_graph *g, unsigned int n, BITSET_WORD *ready)
 {
    unsigned int i;
    int n_class = g->nodes[n].class;
@@ -488,12 +483,27 @@ decrement_q(struct ra_graph *g, unsigned int n)
       unsigned int n2_class = g->nodes[n2].class;
 
       if (!g->nodes[n2].in_stack) {
+         bool was_colorable = pq_test(g, n2);
+
          assert(g->nodes[n2].q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].q_total -= g->regs->classes[n2_class]->q[n_class];
+
+         if (!was_colorable && pq_test(g, n2) && g->nodes[n2].reg == NO_REG)
+            BITSET_SET(ready, n2);
       }
    }
 }
 
+static void
+ra_push_node(struct ra_graph *g, unsigned int n, BITSET_WORD *ready)
+{
+   BITSET_CLEAR(ready, n);
+   decrement_q(g, n, ready);
+   g->stack[g->stack_count] = n;
+   g->stack_count++;
+   g->nodes[n].in_stack = true;
+}
+
 /**
  * Simplifies the interference graph by pushing all
  * trivially-colorable nodes into a stack of nodes to be colored,
@@ -503,69 +513,89 @@ decrement_q(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * Instead of testing every node in each pass, the trivially colorable nodes
+ * are tracked in a bitset, which is walked from the top node down like the
+ * passes over the nodes, so the nodes are pushed in the same order. Only
+ * the search for an optimistic node walks the nodes left in the graph.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
+   unsigned int num_words = BITSET_WORDS(g->count);
+   BITSET_WORD *ready = calloc(num_words, sizeof(BITSET_WORD));
+   unsigned int *remaining = malloc(g->count * sizeof(unsigned int));
+   unsigned int remaining_count = 0;
    int i;
 
-   while (progress) {
-      unsigned int best_optimistic_node = ~0;
-      unsigned int lowest_q_total = ~0;
+   for (i = g->count - 1; i >= 0; i--) {
+      if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
+         continue;
 
-      progress = false;
-
-      for (i = g->count - 1; i >= 0; i--) {
-	 if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
-	    continue;
-
-	 if (pq_test(g, i)) {
-	    decrement_q(g, i);
-	    g->stack[g->stack_count] = i;
-	    g->stack_count++;
-	    g->nodes[i].in_stack = true;
-	    progress = true;
-	 } else {
-	    unsigned int new_q_total = g->nodes[i].q_total;
-	    if (new_q_total < lowest_q_total) {
-	       best_optimistic_node = i;
-	       lowest_q_total = new_q_total;
-	    }
-	 }
-      }
+      remaining[remaining_count++] = i;
+      if (pq_test(g, i))
+         BITSET_SET(ready, i);
+   }
+
+   while (true) {
+      bool progress = true;
+
+      /* Each pass pushes the ready nodes below the last one pushed,
+       * including the ones made ready during the pass.
+       */
+      while (progress) {
+         progress = false;
+
+         for (int w = num_words - 1; w >= 0; w--) {
+            BITSET_WORD mask = ~0u, word;
 
-      if (!progress && best_optimistic_node != ~0U) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->stack_count;
+            while ((word = ready[w] & mask)) {
+               unsigned int bit = util_last_bit(word) - 1;
 
-	 decrement_q(g, best_optimistic_node);
-	 g->stack[g->stack_count] = best_optimistic_node;
-	 g->stack_count++;
-	 g->nodes[best_optimistic_node].in_stack = true;
-	 progress = true;
+               ra_push_node(g, w * BITSET_WORDBITS + bit, ready);
+               progress = true;
+
+               /* only the nodes below this one are left for the pass */
+               mask = (1u << bit) - 1;
+            }
+         }
       }
-   }
 
-   g->stack_optimistic_start = stack_optimistic_start;
-}
+      /* Drop the nodes pushed since the last time while looking for the
+       * best optimistic node.
+       */
+      unsigned int best_optimistic_node = ~0;
+      unsigned int lowest_q_total = ~0;
+      unsigned int count = 0;
 
-static bool
-ra_any_neighbors_conflict(struct ra_graph *g, unsigned int n, unsigned int r)
-{
-   unsigned int i;
+      for (unsigned int j = 0; j < remaining_count; j++) {
+         unsigned int n = remaining[j];
 
-   for (i = 0; i < g->nodes[n].adjacency_count; i++) {
-      unsigned int n2 = g->nodes[n].adjacency_list[i];
+         if (g->nodes[n].in_stack)
+            continue;
 
-      if (!g->nodes[n2].in_stack &&
-          BITSET_TEST(g->regs->regs[r].conflicts, g->nodes[n2].reg)) {
-         return true;
+         remaining[count++] = n;
+         if (g->nodes[n].q_total < lowest_q_total) {
+            best_optimistic_node = n;
+            lowest_q_total = g->nodes[n].q_total;
+         }
       }
+      remaining_count = count;
+
+      if (best_optimistic_node == ~0U)
+         break;
+
+      if (stack_optimistic_start == UINT_MAX)
+         stack_optimistic_start = g->stack_count;
+
+      ra_push_node(g, best_optimistic_node, ready);
    }
 
-   return false;
+   free(ready);
+   free(remaining);
+
+   g->stack_optimistic_start = stack_optimistic_start;
 }
 
 /* Computes a bitfield of what regs are available for a given register
@@ -603,6 +633,34 @@ ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
    return false;
 }
 
+/* Returns the first reg set in regs at or after start, wrapping around. */
+static unsigned int
+ra_find_first_reg(const BITSET_WORD *regs, unsigned int count,
+                  unsigned int start)
+{
+   unsigned int num_words = BITSET_WORDS(count);
+   unsigned int start_word = start / BITSET_WORDBITS;
+   BITSET_WORD start_mask = ~0u << (start % BITSET_WORDBITS);
+
+   for (unsigned int i = 0; i <= num_words; i++) {
+      unsigned int w = (start_word + i) % num_words;
+      BITSET_WORD word = regs[w];
+
+      /* the start word is looked at twice, first the bits from start, and
+       * once wrapped around the ones below it
+       */
+      if (i == 0)
+         word &= start_mask;
+      else if (i == num_words)
+         word &= ~start_mask;
+
+      if (word)
+         return w * BITSET_WORDBITS + ffs(word) - 1;
+   }
+
+   return NO_REG;
+}
+
 /**
  * Pops nodes from the stack back into the graph, coloring them with
  * registers as they go.
@@ -614,44 +672,33 @@ static bool
 ra_select(struct ra_graph *g)
 {
    int start_search_reg = 0;
-   BITSET_WORD *select_regs = NULL;
-
-   if (g->select_reg_callback)
-      select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
+   BITSET_WORD *select_regs =
+      malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
 
    while (g->stack_count != 0) {
-      unsigned int ri;
-      unsigned int r = -1;
+      unsigned int r;
       int n = g->stack[g->stack_count - 1];
-      struct ra_class *c = g->regs->classes[g->nodes[n].class];
 
       /* set this to false even if we return here so that
        * ra_get_best_spill_node() considers this node later.
        */
       g->nodes[n].in_stack = false;
 
-      if (g->select_reg_callback) {
-         if (!ra_compute_available_regs(g, n, select_regs)) {
-            free(select_regs);
-            return false;
-         }
+      /* One pass over the neighbors gives the regs left for the node. */
+      if (!ra_compute_available_regs(g, n, select_regs)) {
+         free(select_regs);
+         return false;
+      }
 
+      if (g->select_reg_callback) {
          r = g->select_reg_callback(g, select_regs, g->select_reg_callback_data);
       } else {
          /* Find the lowest-numbered reg which is not used by a member
           * of the graph adjacent to us.
           */
-         for (ri = 0; ri < g->regs->count; ri++) {
-            r = (start_search_reg + ri) % g->regs->count;
-            if (!reg_belongs_to_class(r, c))
-               continue;
-
-            if (!ra_any_neighbors_conflict(g, n, r))
-               break;
-         }
-
-         if (ri >= g->regs->count)
-            return false;
+         r = ra_find_first_reg(select_regs, g->regs->count,
+                               start_search_reg % g->regs->count);
+         assert(r != NO_REG);
       }
 
       g->nodes[n].reg = r;
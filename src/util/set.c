@@ -33,6 +33,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "macros.h"
@@ -102,6 +103,18 @@ entry_is_present(struct set_entry *entry)
    return entry->key != NULL && entry->key != deleted_key;
 }
 
+/*
+ * Most sets hold a handful of keys, so they start in the small_table of the
+ * struct and only get a table allocated once they outgrow it. There the
+ * keys are packed from the start, deleted ones leaving a deleted entry, and
+ * a search walks them up to the first free entry.
+ */
+static bool
+set_is_small(const struct set *ht)
+{
+   return ht->table == ht->small_table;
+}
+
 struct set *
 _mesa_set_create(void *mem_ctx,
                  uint32_t (*key_hash_function)(const void *key),
@@ -115,19 +128,15 @@ _mesa_set_create(void *mem_ctx,
       return NULL;
 
    ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->size = SET_SMALL_SIZE;
+   ht->rehash = 0;
+   ht->max_entries = SET_SMALL_SIZE;
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(ht, struct set_entry, ht->size);
+   ht->table = ht->small_table;
    ht->entries = 0;
    ht->deleted_entries = 0;
-
-   if (ht->table == NULL) {
-      ralloc_free(ht);
-      return NULL;
-   }
+   memset(ht->small_table, 0, sizeof(ht->small_table));
 
    return ht;
 }
@@ -151,7 +160,8 @@ _mesa_set_destroy(struct set *ht, void (*delete_function)(struct set_entry *entr
          delete_function(entry);
       }
    }
-   ralloc_free(ht->table);
+   if (!set_is_small(ht))
+      ralloc_free(ht->table);
    ralloc_free(ht);
 }
 
@@ -165,6 +175,17 @@ set_search(const struct set *ht, uint32_t hash, const void *key)
 {
    uint32_t hash_address;
 
+   if (set_is_small(ht)) {
+      for (struct set_entry *entry = ht->table;
+           entry != ht->table + SET_SMALL_SIZE && !entry_is_free(entry);
+           entry++) {
+         if (entry_is_present(entry) && entry->hash == hash &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+      return NULL;
+   }
+
    hash_address = hash % ht->size;
    do {
       uint32_t double_hash;
@@ -234,7 +255,56 @@ set_rehash(struct set *ht, unsigned new_size_index)
       set_add(ht, entry->hash, entry->key);
    }
 
-   ralloc_free(old_ht.table);
+   /* old_ht.table is still ht->small_table when growing out of it */
+   if (old_ht.table != ht->small_table)
+      ralloc_free(old_ht.table);
+}
+
+/* the first size class with room for more than the small table */
+static unsigned
+set_small_grow_index(void)
+{
+   unsigned i = 0;
+
+   while (hash_sizes[i].max_entries <= SET_SMALL_SIZE)
+      i++;
+
+   return i;
+}
+
+static struct set_entry *
+set_small_add(struct set *ht, uint32_t hash, const void *key)
+{
+   struct set_entry *entry, *available_entry = NULL;
+
+   for (entry = ht->table; entry != ht->table + SET_SMALL_SIZE; entry++) {
+      if (!entry_is_present(entry)) {
+         if (available_entry == NULL)
+            available_entry = entry;
+         if (entry_is_free(entry))
+            break;
+         continue;
+      }
+
+      if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+         entry->key = key;
+         return entry;
+      }
+   }
+
+   if (available_entry == NULL) {
+      set_rehash(ht, set_small_grow_index());
+      if (set_is_small(ht))
+         return NULL;
+      return set_add(ht, hash, key);
+   }
+
+   if (entry_is_deleted(available_entry))
+      ht->deleted_entries--;
+   available_entry->hash = hash;
+   available_entry->key = key;
+   ht->entries++;
+   return available_entry;
 }
 
 /**
@@ -249,6 +319,9 @@ set_add(struct set *ht, uint32_t hash, const void *key)
    uint32_t hash_address;
    struct set_entry *available_entry = NULL;
 
+   if (set_is_small(ht))
+      return set_small_add(ht, hash, key);
+
    if (ht->entries >= ht->max_entries) {
       set_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
@@ -40,6 +40,11 @@ struct set_entry {
    const void *key;
 };
 
+/* sets start with their entries in small_table, searched linearly, and
+ * move to an allocated table past SET_SMALL_SIZE keys
+ */
+#define SET_SMALL_SIZE 8
+
 struct set {
    void *mem_ctx;
    struct set_entry *table;
@@ -51,6 +56,7 @@ struct set {
    uint32_t size_index;
    uint32_t entries;
    uint32_t deleted_entries;
+   struct set_entry small_table[SET_SMALL_SIZE];
 };
 
 struct set *
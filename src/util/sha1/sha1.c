@@ -19,6 +19,18 @@
 #include "u_endian.h"
 #include "sha1.h"
 
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA1_SHANI
+#elif defined(__GNUC__) && (__GNUC__ >= 6 || defined(__clang__)) && \
+    defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <arm_neon.h>
+#define SHA1_ARMV8
+#endif
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 /*
@@ -100,6 +112,305 @@ SHA1Transform(uint32_t state[5], const uint8_t buffer[SHA1_BLOCK_LENGTH])
 	a = b = c = d = e = 0;
 }
 
+#if defined(SHA1_SHANI)
+
+/*
+ * The SHA extensions, built for them whatever the build flags are and only
+ * used once cpuid says the CPU has them.
+ */
+static int
+sha1_has_shani(void)
+{
+#if defined(__SHA__) && defined(__SSE4_1__)
+	return 1;
+#else
+	static int shani = -1;
+
+	if (shani < 0) {
+		unsigned eax, ebx, ecx, edx;
+		int supported = 0;
+
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+		    (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) &&
+		    __get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			supported = (ebx & bit_SHA) != 0;
+		}
+
+		shani = supported;
+	}
+
+	return shani;
+#endif
+}
+
+__attribute__((target("sha,sse4.1"))) static void
+sha1_transform_shani(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+	    0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; blocks; blocks--, data += SHA1_BLOCK_LENGTH) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		/* rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 16-19 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 20-23 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 24-27 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 28-31 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 32-35 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 36-39 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 40-43 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 44-47 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 48-51 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 52-55 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 56-59 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 60-63 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* rounds 64-67 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* rounds 68-71 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 72-75 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		/* rounds 76-79 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#elif defined(SHA1_ARMV8)
+
+static int
+sha1_has_armv8(void)
+{
+#ifdef __ARM_FEATURE_CRYPTO
+	return 1;
+#else
+	static int armv8 = -1;
+
+	/* HWCAP_SHA1 */
+	if (armv8 < 0)
+		armv8 = (getauxval(AT_HWCAP) & (1 << 5)) != 0;
+
+	return armv8;
+#endif
+}
+
+#ifdef __clang__
+__attribute__((target("crypto")))
+#else
+__attribute__((target("+crypto")))
+#endif
+static void
+sha1_transform_armv8(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+	static const uint32_t k[4] = {
+		0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6
+	};
+	uint32x4_t abcd = vld1q_u32(state);
+	uint32_t e = state[4];
+
+	for (; blocks; blocks--, data += SHA1_BLOCK_LENGTH) {
+		uint32x4_t abcd_save = abcd, msg[4], tmp;
+		uint32_t e_save = e, e_next;
+		int i;
+
+		for (i = 0; i < 4; i++)
+			msg[i] = vreinterpretq_u32_u8(vrev32q_u8(
+			    vld1q_u8(data + i * 16)));
+
+		/* 4 rounds each, the schedule is done in place */
+		for (i = 0; i < 20; i++) {
+			if (i >= 4)
+				msg[i & 3] = vsha1su1q_u32(vsha1su0q_u32(
+				    msg[i & 3], msg[(i + 1) & 3],
+				    msg[(i + 2) & 3]), msg[(i + 3) & 3]);
+
+			tmp = vaddq_u32(msg[i & 3], vdupq_n_u32(k[i / 5]));
+			e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			if (i < 5)
+				abcd = vsha1cq_u32(abcd, e, tmp);
+			else if (i >= 10 && i < 15)
+				abcd = vsha1mq_u32(abcd, e, tmp);
+			else
+				abcd = vsha1pq_u32(abcd, e, tmp);
+			e = e_next;
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		e += e_save;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e;
+}
+
+#endif
+
+/*
+ * Hash a run of 512-bit blocks, with the SHA instructions if the CPU has
+ * them.
+ */
+void
+SHA1TransformBlocks(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+#if defined(SHA1_SHANI)
+	if (sha1_has_shani()) {
+		sha1_transform_shani(state, data, blocks);
+		return;
+	}
+#elif defined(SHA1_ARMV8)
+	if (sha1_has_armv8()) {
+		sha1_transform_armv8(state, data, blocks);
+		return;
+	}
+#endif
+
+	for (; blocks; blocks--, data += SHA1_BLOCK_LENGTH)
+		SHA1Transform(state, data);
+}
+
 
 /*
  * SHA1Init - Initialize new context
@@ -130,9 +441,9 @@ SHA1Update(SHA1_CTX *context, const uint8_t *data, size_t len)
 	context->count += (len << 3);
 	if ((j + len) > 63) {
 		(void)memcpy(&context->buffer[j], data, (i = 64-j));
-		SHA1Transform(context->state, context->buffer);
-		for ( ; i + 63 < len; i += 64)
-			SHA1Transform(context->state, (uint8_t *)&data[i]);
+		SHA1TransformBlocks(context->state, context->buffer, 1);
+		SHA1TransformBlocks(context->state, &data[i], (len - i) / 64);
+		i += (len - i) & ~(size_t)63;
 		j = 0;
 	} else {
 		i = 0;
@@ -130,6 +130,36 @@ void slab_create_child(struct slab_child_pool *pool,
    pool->pages = NULL;
    pool->free = NULL;
    pool->migrated = NULL;
+   pool->foreign = NULL;
+   pool->num_foreign = 0;
+}
+
+/* Hand the batched foreign elements back to their owners. Called with the
+ * parent mutex held, which keeps the owners from being destroyed while the
+ * elements are pushed.
+ */
+static void
+slab_return_foreign_locked(struct slab_child_pool *pool)
+{
+   while (pool->foreign) {
+      struct slab_element_header *elt = pool->foreign;
+      pool->foreign = elt->next;
+
+      /* Note: we _must_ re-read elt->owner here because the owning child
+       * pool may have been destroyed since the element was batched.
+       */
+      intptr_t owner_int = p_atomic_read(&elt->owner);
+
+      if (!(owner_int & 1)) {
+         struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
+         elt->next = owner->migrated;
+         owner->migrated = elt;
+      } else {
+         slab_free_orphaned(elt);
+      }
+   }
+
+   pool->num_foreign = 0;
 }
 
 /**
@@ -145,6 +175,8 @@ void slab_destroy_child(struct slab_child_pool *pool)
 
    mtx_lock(&pool->parent->mutex);
 
+   slab_return_foreign_locked(pool);
+
    while (pool->pages) {
       struct slab_page_header *page = pool->pages;
       pool->pages = page->u.next;
@@ -216,6 +248,8 @@ slab_alloc(struct slab_child_pool *pool)
       mtx_lock(&pool->parent->mutex);
       pool->free = pool->migrated;
       pool->migrated = NULL;
+      if (pool->foreign)
+         slab_return_foreign_locked(pool);
       mtx_unlock(&pool->parent->mutex);
 
       /* Now allocate a new page. */
@@ -249,7 +283,8 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
    CHECK_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
    SET_MAGIC(elt, SLAB_MAGIC_FREE);
 
-   if (p_atomic_read(&elt->owner) == (intptr_t)pool) {
+   owner_int = p_atomic_read(&elt->owner);
+   if (owner_int == (intptr_t)pool) {
       /* This is the simple case: The caller guarantees that we can safely
        * access the free list.
        */
@@ -258,24 +293,17 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
       return;
    }
 
-   /* The slow case: migration or an orphaned page. */
-   mtx_lock(&pool->parent->mutex);
-
-   /* Note: we _must_ re-read elt->owner here because the owning child pool
-    * may have been destroyed by another thread in the meantime.
+   /* The slow case: migration or an orphaned page. Batch the element and
+    * take the parent mutex once for a full magazine.
     */
-   owner_int = p_atomic_read(&elt->owner);
-
-   if (!(owner_int & 1)) {
-      struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
-      elt->next = owner->migrated;
-      owner->migrated = elt;
-      mtx_unlock(&pool->parent->mutex);
-   } else {
-      mtx_unlock(&pool->parent->mutex);
+   elt->next = pool->foreign;
+   pool->foreign = elt;
+   if (++pool->num_foreign < SLAB_MAGAZINE_SIZE)
+      return;
 
-      slab_free_orphaned(elt);
-   }
+   mtx_lock(&pool->parent->mutex);
+   slab_return_foreign_locked(pool);
+   mtx_unlock(&pool->parent->mutex);
 }
 
 /**
@@ -33,7 +33,9 @@
  * Allocations obtained from one child pool should usually be freed in the
  * same child pool. Freeing an allocation in a different child pool associated
  * to the same parent is allowed (and requires no locking by the caller), but
- * it is discouraged because it implies a performance penalty.
+ * it is discouraged because it implies a performance penalty. Such frees are
+ * batched in the freeing pool and handed back to their owners under a single
+ * parent lock, SLAB_MAGAZINE_SIZE at a time.
  *
  * For convenience and to ease the transition, there is also a set of wrapper
  * functions around a single parent-child pair.
@@ -67,8 +69,16 @@ struct slab_child_pool {
     * This list is protected by the parent mutex.
     */
    struct slab_element_header *migrated;
+
+   /* Elements owned by other pools which were freed with this pool as the
+    * argument to slab_free, not yet returned to their owners.
+    */
+   struct slab_element_header *foreign;
+   unsigned num_foreign;
 };
 
+#define SLAB_MAGAZINE_SIZE 32
+
 void slab_create_parent(struct slab_parent_pool *parent,
                         unsigned item_size,
                         unsigned num_items);
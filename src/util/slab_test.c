@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2019 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Cross child pool frees from several threads, which go through the
+ * magazines of foreign elements, and frees into the pages orphaned by a
+ * destroyed child pool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "c11/threads.h"
+#include "slab.h"
+
+#define NUM_THREADS 4
+#define NUM_ITEMS 1000
+#define NUM_ROUNDS 50
+
+struct item {
+   unsigned thread;
+   unsigned index;
+   unsigned round;
+};
+
+struct thread_data {
+   unsigned id;
+   struct slab_child_pool pool;
+   /* the items allocated by the previous thread, this one frees them */
+   struct item *mailbox[NUM_ITEMS];
+};
+
+static struct slab_parent_pool parent;
+/* allocated, so that the leak checkers don't see the pages as still used
+ * through the lists of destroyed pools
+ */
+static struct thread_data *threads[NUM_THREADS];
+static unsigned round;
+static bool failed;
+
+static int
+alloc_thread(void *arg)
+{
+   struct thread_data *t = arg;
+   struct thread_data *next = threads[(t->id + 1) % NUM_THREADS];
+
+   for (unsigned i = 0; i < NUM_ITEMS; i++) {
+      struct item *item = slab_alloc(&t->pool);
+
+      item->thread = t->id;
+      item->index = i;
+      item->round = round;
+      next->mailbox[i] = item;
+   }
+
+   return 0;
+}
+
+static int
+free_thread(void *arg)
+{
+   struct thread_data *t = arg;
+   unsigned prev = (t->id + NUM_THREADS - 1) % NUM_THREADS;
+
+   for (unsigned i = 0; i < NUM_ITEMS; i++) {
+      struct item *item = t->mailbox[i];
+
+      /* an item handed out twice has been overwritten */
+      if (item->thread != prev || item->index != i || item->round != round) {
+         fprintf(stderr, "round %u: item %u of thread %u was overwritten\n",
+                 round, i, prev);
+         failed = true;
+      }
+
+      slab_free(&t->pool, item);
+      t->mailbox[i] = NULL;
+   }
+
+   return 0;
+}
+
+static void
+run_threads(thrd_start_t func, bool odd_only)
+{
+   thrd_t thrd[NUM_THREADS];
+
+   for (unsigned i = 0; i < NUM_THREADS; i++) {
+      if (!odd_only || (i & 1))
+         thrd_create(&thrd[i], func, threads[i]);
+   }
+
+   for (unsigned i = 0; i < NUM_THREADS; i++) {
+      if (!odd_only || (i & 1))
+         thrd_join(thrd[i], NULL);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   slab_create_parent(&parent, sizeof(struct item), 64);
+
+   for (unsigned i = 0; i < NUM_THREADS; i++) {
+      threads[i] = calloc(1, sizeof(*threads[i]));
+      threads[i]->id = i;
+      slab_create_child(&threads[i]->pool, &parent);
+   }
+
+   for (round = 0; round < NUM_ROUNDS; round++) {
+      run_threads(alloc_thread, false);
+      run_threads(free_thread, false);
+   }
+
+   /* The even threads go away with their items still allocated, so the odd
+    * threads free them into orphaned pages.
+    */
+   run_threads(alloc_thread, false);
+   for (unsigned i = 0; i < NUM_THREADS; i += 2) {
+      free_thread(threads[i]);
+      slab_destroy_child(&threads[i]->pool);
+   }
+   run_threads(free_thread, true);
+
+   for (unsigned i = 1; i < NUM_THREADS; i += 2)
+      slab_destroy_child(&threads[i]->pool);
+   slab_destroy_parent(&parent);
+
+   for (unsigned i = 0; i < NUM_THREADS; i++)
+      free(threads[i]);
+
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2018 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Fills, empties and refills tables and sets around the size of their
+ * small table, checking the contents against the keys put in. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "hash_table.h"
+#include "set.h"
+
+#define NUM_KEYS (HASH_TABLE_SMALL_SIZE * 3)
+
+static uint32_t
+key_value(const void *key)
+{
+   return *(const uint32_t *)key;
+}
+
+static bool
+uint32_t_key_equals(const void *a, const void *b)
+{
+   return key_value(a) == key_value(b);
+}
+
+static void
+check_table(struct hash_table *ht, uint32_t *keys, const bool *present)
+{
+   struct hash_entry *entry;
+   uint32_t i, count = 0;
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      entry = _mesa_hash_table_search(ht, keys + i);
+      assert(!entry == !present[i]);
+      if (entry) {
+         assert(key_value(entry->key) == i);
+         assert(entry->data == keys + i);
+         count++;
+      }
+   }
+
+   hash_table_foreach(ht, entry) {
+      assert(present[key_value(entry->key)]);
+      count--;
+   }
+   assert(count == 0);
+}
+
+static void
+check_set(struct set *set, uint32_t *keys, const bool *present)
+{
+   struct set_entry *entry;
+   uint32_t i, count = 0;
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      entry = _mesa_set_search(set, keys + i);
+      assert(!entry == !present[i]);
+      if (entry) {
+         assert(key_value(entry->key) == i);
+         count++;
+      }
+   }
+   assert(count == set->entries);
+
+   set_foreach(set, entry) {
+      assert(present[key_value(entry->key)]);
+      count--;
+   }
+   assert(count == 0);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct hash_table *ht, *clone;
+   struct set *set;
+   uint32_t keys[NUM_KEYS];
+   bool present[NUM_KEYS];
+   uint32_t i, round;
+
+   (void) argc;
+   (void) argv;
+
+   for (i = 0; i < NUM_KEYS; i++)
+      keys[i] = i;
+
+   ht = _mesa_hash_table_create(NULL, key_value, uint32_t_key_equals);
+   set = _mesa_set_create(NULL, key_value, uint32_t_key_equals);
+   memset(present, 0, sizeof(present));
+
+   /* churn in the small table with removals in the middle */
+   for (round = 0; round < 4; round++) {
+      for (i = 0; i < HASH_TABLE_SMALL_SIZE; i++) {
+         uint32_t k = (i * 5 + round) % NUM_KEYS;
+         _mesa_hash_table_insert(ht, keys + k, keys + k);
+         _mesa_set_add(set, keys + k);
+         present[k] = true;
+      }
+      check_table(ht, keys, present);
+      check_set(set, keys, present);
+
+      for (i = 0; i < NUM_KEYS; i += 2) {
+         _mesa_hash_table_remove(ht, _mesa_hash_table_search(ht, keys + i));
+         _mesa_set_remove(set, _mesa_set_search(set, keys + i));
+         present[i] = false;
+      }
+      check_table(ht, keys, present);
+      check_set(set, keys, present);
+   }
+
+   clone = _mesa_hash_table_clone(ht, NULL);
+   check_table(clone, keys, present);
+   _mesa_hash_table_destroy(clone, NULL);
+
+   /* grow out of it */
+   for (i = 0; i < NUM_KEYS; i++) {
+      _mesa_hash_table_insert(ht, keys + i, keys + i);
+      _mesa_set_add(set, keys + i);
+      present[i] = true;
+      check_table(ht, keys, present);
+      check_set(set, keys, present);
+   }
+
+   clone = _mesa_hash_table_clone(ht, NULL);
+   check_table(clone, keys, present);
+   _mesa_hash_table_destroy(clone, NULL);
+
+   _mesa_hash_table_clear(ht, NULL);
+   memset(present, 0, sizeof(present));
+   check_table(ht, keys, present);
+
+   _mesa_hash_table_destroy(ht, NULL);
+   _mesa_set_destroy(set, NULL);
+
+   return 0;
+}
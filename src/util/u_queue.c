@@ -405,26 +405,10 @@ util_queue_destroy(struct util_queue *queue)
    free(queue->threads);
 }
 
-void
-util_queue_add_job(struct util_queue *queue,
-                   void *job,
-                   struct util_queue_fence *fence,
-                   util_queue_execute_func execute,
-                   util_queue_execute_func cleanup)
+/* called with the queue lock held */
+static void
+util_queue_wait_for_space_locked(struct util_queue *queue)
 {
-   struct util_queue_job *ptr;
-
-   mtx_lock(&queue->lock);
-   if (queue->kill_threads) {
-      mtx_unlock(&queue->lock);
-      /* well no good option here, but any leaks will be
-       * short-lived as things are shutting down..
-       */
-      return;
-   }
-
-   util_queue_fence_reset(fence);
-
    assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
 
    if (queue->num_queued == queue->max_jobs) {
@@ -455,25 +439,81 @@ util_queue_add_job(struct util_queue *queue,
          queue->write_idx = num_jobs;
          queue->max_jobs = new_max_jobs;
       } else {
-         /* Wait until there is a free slot. */
+         /* Wait until there is a free slot, the jobs of a batch added so
+          * far may not have woken the threads yet.
+          */
+         cnd_broadcast(&queue->has_queued_cond);
          while (queue->num_queued == queue->max_jobs)
             cnd_wait(&queue->has_space_cond, &queue->lock);
       }
    }
+}
+
+void
+util_queue_add_jobs(struct util_queue *queue,
+                    const struct util_queue_job *jobs,
+                    unsigned num,
+                    bool high_priority)
+{
+   mtx_lock(&queue->lock);
+   if (queue->kill_threads) {
+      mtx_unlock(&queue->lock);
+      /* well no good option here, but any leaks will be
+       * short-lived as things are shutting down..
+       */
+      return;
+   }
+
+   for (unsigned i = 0; i < num; i++) {
+      /* the ring is read from read_idx, high priority jobs are put before
+       * it in reverse order so the first of them runs first
+       */
+      const struct util_queue_job *job =
+         high_priority ? &jobs[num - 1 - i] : &jobs[i];
+      struct util_queue_job *ptr;
 
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+      util_queue_fence_reset(job->fence);
+      util_queue_wait_for_space_locked(queue);
 
-   queue->num_queued++;
-   cnd_signal(&queue->has_queued_cond);
+      if (high_priority) {
+         queue->read_idx = (queue->read_idx + queue->max_jobs - 1) %
+                           queue->max_jobs;
+         ptr = &queue->jobs[queue->read_idx];
+      } else {
+         ptr = &queue->jobs[queue->write_idx];
+         queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+      }
+
+      assert(ptr->job == NULL);
+      *ptr = *job;
+
+      queue->num_queued++;
+   }
+
+   if (num > 1)
+      cnd_broadcast(&queue->has_queued_cond);
+   else
+      cnd_signal(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 }
 
+void
+util_queue_add_job(struct util_queue *queue,
+                   void *job,
+                   struct util_queue_fence *fence,
+                   util_queue_execute_func execute,
+                   util_queue_execute_func cleanup)
+{
+   struct util_queue_job entry = {
+      .job = job,
+      .fence = fence,
+      .execute = execute,
+      .cleanup = cleanup,
+   };
+
+   util_queue_add_jobs(queue, &entry, 1, false);
+}
+
 /**
  * Remove a queued job. If the job hasn't started execution, it's removed from
  * the queue. If the job has started execution, the function waits for it to
@@ -513,6 +553,31 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
       util_queue_fence_wait(fence);
 }
 
+void
+util_queue_promote_job(struct util_queue *queue, struct util_queue_fence *fence)
+{
+   if (util_queue_fence_is_signalled(fence))
+      return;
+
+   mtx_lock(&queue->lock);
+   for (unsigned i = queue->read_idx; i != queue->write_idx;
+        i = (i + 1) % queue->max_jobs) {
+      if (queue->jobs[i].fence == fence) {
+         struct util_queue_job job = queue->jobs[i];
+
+         /* shift the jobs before it back by one */
+         while (i != queue->read_idx) {
+            unsigned prev = (i + queue->max_jobs - 1) % queue->max_jobs;
+            queue->jobs[i] = queue->jobs[prev];
+            i = prev;
+         }
+         queue->jobs[i] = job;
+         break;
+      }
+   }
+   mtx_unlock(&queue->lock);
+}
+
 static void
 util_queue_finish_execute(void *data, int num_thread)
 {
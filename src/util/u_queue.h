@@ -230,8 +230,20 @@ void util_queue_add_job(struct util_queue *queue,
                         struct util_queue_fence *fence,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
+/* Adds num jobs taking the queue lock and waking the threads once. High
+ * priority jobs go in front of the ones already queued, for work someone
+ * waits for, the fences of the jobs must be set.
+ */
+void util_queue_add_jobs(struct util_queue *queue,
+                         const struct util_queue_job *jobs,
+                         unsigned num,
+                         bool high_priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
+/* moves the job of fence to the front if it hasn't started yet, to run it
+ * next when the caller is about to wait for it */
+void util_queue_promote_job(struct util_queue *queue,
+                            struct util_queue_fence *fence);
 
 void util_queue_finish(struct util_queue *queue);
 
@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2019 Lima Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* The order the jobs of a single thread queue run in, with batches, high
+ * priority jobs and promoted jobs, on fixed size and resizing queues.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "u_queue.h"
+
+#define MAX_JOBS 64
+
+struct test_job {
+   unsigned id;
+   struct util_queue_fence fence;
+};
+
+static struct test_job jobs[MAX_JOBS];
+static unsigned order[MAX_JOBS];
+static unsigned num_run;
+
+/* holds the thread of the queue until the jobs are queued */
+static struct util_queue_fence gate, gate_started;
+
+static void
+execute_job(void *data, int thread_index)
+{
+   struct test_job *job = data;
+
+   order[num_run++] = job->id;
+}
+
+static void
+execute_gate(void *data, int thread_index)
+{
+   util_queue_fence_signal(&gate_started);
+   util_queue_fence_wait(&gate);
+}
+
+static struct util_queue_job
+job_entry(unsigned id)
+{
+   struct util_queue_job entry = {
+      .job = &jobs[id],
+      .fence = &jobs[id].fence,
+      .execute = execute_job,
+   };
+
+   jobs[id].id = id;
+   return entry;
+}
+
+static void
+close_gate(struct util_queue *queue)
+{
+   static struct util_queue_fence fence;
+
+   util_queue_fence_init(&fence);
+   util_queue_fence_reset(&gate);
+   util_queue_fence_reset(&gate_started);
+   util_queue_add_job(queue, &gate, &fence, execute_gate, NULL);
+   util_queue_fence_wait(&gate_started);
+}
+
+static bool
+check_order(const char *name, const unsigned *expected, unsigned num)
+{
+   bool ok = num_run == num && !memcmp(order, expected, num * sizeof(*order));
+
+   if (!ok) {
+      printf("%s: ran", name);
+      for (unsigned i = 0; i < num_run; i++)
+         printf(" %u", order[i]);
+      printf(", expected");
+      for (unsigned i = 0; i < num; i++)
+         printf(" %u", expected[i]);
+      printf("\n");
+   }
+
+   num_run = 0;
+   return ok;
+}
+
+static void
+wait_jobs(unsigned num)
+{
+   for (unsigned i = 0; i < num; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+}
+
+/* normal batches run in order, high priority ones before them and a
+ * promoted job before everything
+ */
+static bool
+test_priorities(unsigned flags, unsigned max_jobs)
+{
+   static const unsigned expected[] = { 4, 5, 6, 0, 1, 2, 3, 7 };
+   struct util_queue_job batch[3];
+   struct util_queue queue;
+   bool ok;
+
+   if (!util_queue_init(&queue, "test", max_jobs, 1, flags))
+      return false;
+
+   close_gate(&queue);
+
+   batch[0] = job_entry(0);
+   batch[1] = job_entry(1);
+   util_queue_add_jobs(&queue, batch, 2, false);
+   batch[0] = job_entry(2);
+   util_queue_add_jobs(&queue, batch, 1, false);
+   util_queue_add_job(&queue, &jobs[3], &jobs[3].fence, execute_job, NULL);
+   jobs[3].id = 3;
+
+   batch[0] = job_entry(5);
+   batch[1] = job_entry(6);
+   util_queue_add_jobs(&queue, batch, 2, true);
+   batch[0] = job_entry(7);
+   util_queue_add_jobs(&queue, batch, 1, false);
+   batch[0] = job_entry(4);
+   util_queue_add_jobs(&queue, batch, 1, false);
+   util_queue_promote_job(&queue, &jobs[4].fence);
+
+   util_queue_fence_signal(&gate);
+   wait_jobs(8);
+   ok = check_order("priorities", expected, 8);
+
+   util_queue_destroy(&queue);
+   return ok;
+}
+
+/* a batch larger than a fixed size queue mustn't wait for the threads it
+ * hasn't woken up yet
+ */
+static bool
+test_large_batch(void)
+{
+   struct util_queue_job batch[MAX_JOBS];
+   unsigned expected[MAX_JOBS];
+   struct util_queue queue;
+   bool ok;
+
+   if (!util_queue_init(&queue, "test", 4, 1, 0))
+      return false;
+
+   for (unsigned i = 0; i < MAX_JOBS; i++) {
+      batch[i] = job_entry(i);
+      expected[i] = i;
+   }
+
+   util_queue_add_jobs(&queue, batch, MAX_JOBS, false);
+   wait_jobs(MAX_JOBS);
+   ok = check_order("large batch", expected, MAX_JOBS);
+
+   util_queue_destroy(&queue);
+   return ok;
+}
+
+/* a resizing queue grown while it only holds high priority jobs, and
+ * dropping a job
+ */
+static bool
+test_resize(void)
+{
+   struct util_queue_job batch[MAX_JOBS];
+   unsigned expected[MAX_JOBS];
+   struct util_queue queue;
+   unsigned num = 0;
+   bool ok;
+
+   if (!util_queue_init(&queue, "test", 2, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      return false;
+
+   close_gate(&queue);
+
+   for (unsigned i = 0; i < 20; i++)
+      batch[i] = job_entry(i);
+   util_queue_add_jobs(&queue, batch, 20, true);
+   for (unsigned i = 20; i < 40; i++)
+      batch[i - 20] = job_entry(i);
+   util_queue_add_jobs(&queue, batch, 20, false);
+   util_queue_drop_job(&queue, &jobs[30].fence);
+   util_queue_promote_job(&queue, &jobs[39].fence);
+
+   expected[num++] = 39;
+   for (unsigned i = 0; i < 39; i++) {
+      if (i != 30)
+         expected[num++] = i;
+   }
+
+   util_queue_fence_signal(&gate);
+   wait_jobs(40);
+   ok = check_order("resize", expected, num);
+
+   util_queue_destroy(&queue);
+   return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+   bool ok = true;
+
+   util_queue_fence_init(&gate);
+   util_queue_fence_init(&gate_started);
+   for (unsigned i = 0; i < MAX_JOBS; i++)
+      util_queue_fence_init(&jobs[i].fence);
+
+   ok &= test_priorities(0, 16);
+   ok &= test_priorities(UTIL_QUEUE_INIT_RESIZE_IF_FULL, 2);
+   ok &= test_large_batch();
+   ok &= test_resize();
+
+   return ok ? 0 : 1;
+}
@@ -36,7 +36,9 @@
 #include <math.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include "xmlconfig.h"
+#include "simple_mtx.h"
 
 #undef GET_PROGRAM_NAME
 
@@ -714,6 +716,125 @@ optInfoEndElem(void *userData, const XML_Char *name)
     }
 }
 
+/** \brief Protects the option info and configuration file caches */
+static simple_mtx_t cacheMutex = _SIMPLE_MTX_INITIALIZER_NP;
+
+/** \brief Option info parsed from a configOptions document
+ *
+ * Screens of the same driver parse the same document over and over. The
+ * info is kept for the life time of the process and copied for each screen.
+ * The environment overrides the defaults when the document is parsed, the
+ * variables seen then are kept to tell when the copy would be different. */
+struct OptInfoCacheEntry {
+    struct OptInfoCacheEntry *next;
+    char *configOptions;
+    driOptionCache info;
+    char **envValues;
+};
+
+static struct OptInfoCacheEntry *optInfoCache = NULL;
+
+/** \brief Check that the environment still overrides the same defaults */
+static bool
+optInfoEnvironMatches(const struct OptInfoCacheEntry *entry)
+{
+    uint32_t i, size = 1 << entry->info.tableSize;
+    for (i = 0; i < size; ++i) {
+        const char *env;
+        if (!entry->info.info[i].name)
+            continue;
+        env = getenv (entry->info.info[i].name);
+        if (env == NULL && entry->envValues[i] == NULL)
+            continue;
+        if (env == NULL || entry->envValues[i] == NULL ||
+            strcmp (env, entry->envValues[i]))
+            return false;
+    }
+    return true;
+}
+
+/** \brief Copy option info, the copy is freed with driDestroyOptionInfo */
+static void
+copyOptionInfo(driOptionCache *dst, const driOptionCache *src)
+{
+    uint32_t i, size = 1 << src->tableSize;
+
+    dst->tableSize = src->tableSize;
+    dst->info = calloc(size, sizeof (driOptionInfo));
+    dst->values = malloc(size * sizeof (driOptionValue));
+    if (dst->info == NULL || dst->values == NULL) {
+        fprintf (stderr, "%s: %d: out of memory.\n", __FILE__, __LINE__);
+        abort();
+    }
+    memcpy (dst->values, src->values, size * sizeof (driOptionValue));
+
+    for (i = 0; i < size; ++i) {
+        const driOptionInfo *info = &src->info[i];
+        if (!info->name)
+            continue;
+        XSTRDUP (dst->info[i].name, info->name);
+        dst->info[i].type = info->type;
+        dst->info[i].nRanges = info->nRanges;
+        if (info->ranges) {
+            dst->info[i].ranges = malloc(info->nRanges * sizeof (driOptionRange));
+            if (dst->info[i].ranges == NULL) {
+                fprintf (stderr, "%s: %d: out of memory.\n", __FILE__, __LINE__);
+                abort();
+            }
+            memcpy (dst->info[i].ranges, info->ranges,
+                    info->nRanges * sizeof (driOptionRange));
+        }
+        if (info->type == DRI_STRING)
+            XSTRDUP (dst->values[i]._string, src->values[i]._string);
+    }
+}
+
+/** \brief Remember the option info parsed from configOptions
+ *
+ * Replaces an entry of the same document parsed with other environment
+ * variables. Called with cacheMutex locked. */
+static void
+cacheOptionInfo(const char *configOptions, const driOptionCache *info)
+{
+    struct OptInfoCacheEntry **prev, *entry;
+    uint32_t i, size = 1 << info->tableSize;
+
+    for (prev = &optInfoCache; *prev; prev = &(*prev)->next) {
+        if (!strcmp ((*prev)->configOptions, configOptions)) {
+            entry = *prev;
+            *prev = entry->next;
+            for (i = 0; i < size; ++i)
+                free(entry->envValues[i]);
+            free(entry->envValues);
+            driDestroyOptionInfo(&entry->info);
+            free(entry->configOptions);
+            free(entry);
+            break;
+        }
+    }
+
+    entry = calloc(1, sizeof (*entry));
+    if (entry == NULL)
+        return;
+    entry->configOptions = strdup(configOptions);
+    entry->envValues = calloc(size, sizeof (char *));
+    if (entry->configOptions == NULL || entry->envValues == NULL) {
+        free(entry->configOptions);
+        free(entry->envValues);
+        free(entry);
+        return;
+    }
+    copyOptionInfo(&entry->info, info);
+    for (i = 0; i < size; ++i) {
+        const char *env;
+        if (info->info[i].name && (env = getenv (info->info[i].name)))
+            XSTRDUP (entry->envValues[i], env);
+    }
+
+    entry->next = optInfoCache;
+    optInfoCache = entry;
+}
+
 void
 driParseOptionInfo(driOptionCache *info, const char *configOptions)
 {
@@ -721,6 +842,24 @@ driParseOptionInfo(driOptionCache *info, const char *configOptions)
     int status;
     struct OptInfoData userData;
     struct OptInfoData *data = &userData;
+    struct OptInfoCacheEntry *entry;
+
+    simple_mtx_lock(&cacheMutex);
+    for (entry = optInfoCache; entry; entry = entry->next) {
+        if (!strcmp (entry->configOptions, configOptions) &&
+            optInfoEnvironMatches(entry)) {
+            uint32_t i, size = 1 << entry->info.tableSize;
+            copyOptionInfo(info, &entry->info);
+            for (i = 0; i < size; ++i) {
+                if (entry->envValues[i])
+                    fprintf (stderr,
+                             "ATTENTION: default value of option %s overridden by environment.\n",
+                             info->info[i].name);
+            }
+            simple_mtx_unlock(&cacheMutex);
+            return;
+        }
+    }
 
     /* Make the hash table big enough to fit more than the maximum number of
      * config options we've ever seen in a driver.
@@ -752,13 +891,43 @@ driParseOptionInfo(driOptionCache *info, const char *configOptions)
         XML_FATAL ("%s.", XML_ErrorString(XML_GetErrorCode(p)));
 
     XML_ParserFree (p);
+
+    cacheOptionInfo(configOptions, info);
+    simple_mtx_unlock(&cacheMutex);
 }
 
+/** \brief State of a configuration file, to tell when it changed */
+struct ConfFileStamp {
+    char *name;
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+};
+
+/** \brief Options set by the configuration files for a device
+ *
+ * The matches only depend on the driver, the screen and the executable,
+ * which is the same for the whole process. They are kept as long as the
+ * files don't change, for the next contexts to skip parsing the files. */
+struct ConfCacheEntry {
+    struct ConfCacheEntry *next;
+    char *driverName;
+    int screenNum;
+    struct ConfFileStamp files[2];
+    uint32_t numStrings, maxStrings;
+    char **options; /**< \brief name and value of each option, in file order */
+};
+
+static struct ConfCacheEntry *confCache = NULL;
+
 /** \brief Parser context for configuration files. */
 struct OptConfData {
     const char *name;
     XML_Parser parser;
     driOptionCache *cache;
+    struct ConfCacheEntry *entry;
     int screenNum;
     const char *driverName, *execName;
     uint32_t ignoringDevice;
@@ -817,6 +986,59 @@ parseAppAttr(struct OptConfData *data, const XML_Char **attr)
         data->ignoringApp = data->inApp;
 }
 
+/** \brief Set an option to a value from a configuration file
+ *
+ * Returns false if the value is illegal. */
+static bool
+setConfOption(driOptionCache *cache, const char *name, const char *value)
+{
+    uint32_t opt = findOption (cache, name);
+    if (cache->info[opt].name == NULL)
+        /* don't use XML_WARNING, drirc defines options for all drivers,
+         * but not all drivers support them */
+        return true;
+    else if (getenv (cache->info[opt].name)) {
+      /* don't use XML_WARNING, we want the user to see this! */
+        fprintf (stderr, "ATTENTION: option value of option %s ignored.\n",
+                 cache->info[opt].name);
+        return true;
+    } else
+        return parseValue (&cache->values[opt], cache->info[opt].type, value);
+}
+
+/** \brief Remember an option set by a configuration file
+ *
+ * If memory runs out, the entry isn't complete and is dropped after
+ * parsing. */
+static void
+recordConfOption(struct ConfCacheEntry *entry, const char *name,
+                 const char *value)
+{
+    if (!entry || !entry->options)
+        return;
+    if (entry->numStrings + 2 > entry->maxStrings) {
+        uint32_t maxStrings = entry->maxStrings * 2;
+        char **options = realloc(entry->options, maxStrings * sizeof (char *));
+        if (options == NULL)
+            goto fail;
+        entry->options = options;
+        entry->maxStrings = maxStrings;
+    }
+    entry->options[entry->numStrings] = strdup(name);
+    entry->options[entry->numStrings + 1] = strdup(value);
+    entry->numStrings += 2;
+    if (!entry->options[entry->numStrings - 2] ||
+        !entry->options[entry->numStrings - 1])
+        goto fail;
+    return;
+
+fail:
+    while (entry->numStrings)
+        free(entry->options[--entry->numStrings]);
+    free(entry->options);
+    entry->options = NULL;
+}
+
 /** \brief Parse attributes of an option element. */
 static void
 parseOptConfAttr(struct OptConfData *data, const XML_Char **attr)
@@ -831,17 +1053,8 @@ parseOptConfAttr(struct OptConfData *data, const XML_Char **attr)
     if (!name) XML_WARNING1 ("name attribute missing in option.");
     if (!value) XML_WARNING1 ("value attribute missing in option.");
     if (name && value) {
-        driOptionCache *cache = data->cache;
-        uint32_t opt = findOption (cache, name);
-        if (cache->info[opt].name == NULL)
-            /* don't use XML_WARNING, drirc defines options for all drivers,
-             * but not all drivers support them */
-            return;
-        else if (getenv (cache->info[opt].name))
-          /* don't use XML_WARNING, we want the user to see this! */
-            fprintf (stderr, "ATTENTION: option value of option %s ignored.\n",
-                     cache->info[opt].name);
-        else if (!parseValue (&cache->values[opt], cache->info[opt].type, value))
+        recordConfOption (data->entry, name, value);
+        if (!setConfOption (data->cache, name, value))
             XML_WARNING ("illegal option value: %s.", value);
     }
 }
@@ -984,6 +1197,102 @@ parseOneConfigFile(XML_Parser p)
 #define SYSCONFDIR "/etc"
 #endif
 
+/** \brief Get the state of a configuration file */
+static void
+getConfFileStamp(struct ConfFileStamp *stamp, const char *name)
+{
+    struct stat st;
+
+    memset (stamp, 0, sizeof (*stamp));
+    /* the name points to the caller's string until it's cached */
+    stamp->name = (char *)name;
+    if (name && stat (name, &st) == 0) {
+        stamp->exists = true;
+        stamp->dev = st.st_dev;
+        stamp->ino = st.st_ino;
+        stamp->size = st.st_size;
+        stamp->mtime = st.st_mtime;
+    }
+}
+
+static bool
+confFileStampsEqual(const struct ConfFileStamp *a,
+                    const struct ConfFileStamp *b)
+{
+    if (!a->name || !b->name)
+        return a->name == b->name;
+    return !strcmp (a->name, b->name) && a->exists == b->exists &&
+        a->dev == b->dev && a->ino == b->ino &&
+        a->size == b->size && a->mtime == b->mtime;
+}
+
+static void
+freeConfCacheEntry(struct ConfCacheEntry *entry)
+{
+    uint32_t i;
+    for (i = 0; i < entry->numStrings; ++i)
+        free(entry->options[i]);
+    free(entry->options);
+    for (i = 0; i < 2; ++i)
+        free(entry->files[i].name);
+    free(entry->driverName);
+    free(entry);
+}
+
+/** \brief Find the options set for a device by unchanged files
+ *
+ * Drops the entry of the device if the files changed. Called with
+ * cacheMutex locked. */
+static struct ConfCacheEntry *
+findConfCacheEntry(const struct ConfFileStamp files[2], int screenNum,
+                   const char *driverName)
+{
+    struct ConfCacheEntry **prev, *entry;
+
+    for (prev = &confCache; *prev; prev = &(*prev)->next) {
+        entry = *prev;
+        if (entry->screenNum != screenNum ||
+            strcmp (entry->driverName, driverName))
+            continue;
+        if (confFileStampsEqual(&entry->files[0], &files[0]) &&
+            confFileStampsEqual(&entry->files[1], &files[1]))
+            return entry;
+        *prev = entry->next;
+        freeConfCacheEntry(entry);
+        return NULL;
+    }
+    return NULL;
+}
+
+/** \brief Start recording the options set for a device */
+static struct ConfCacheEntry *
+createConfCacheEntry(const struct ConfFileStamp files[2], int screenNum,
+                     const char *driverName)
+{
+    struct ConfCacheEntry *entry = calloc(1, sizeof (*entry));
+    uint32_t i;
+
+    if (entry == NULL)
+        return NULL;
+    entry->screenNum = screenNum;
+    entry->driverName = strdup(driverName);
+    entry->maxStrings = 32;
+    entry->options = malloc(entry->maxStrings * sizeof (char *));
+    for (i = 0; i < 2; ++i) {
+        entry->files[i] = files[i];
+        entry->files[i].name = files[i].name ? strdup(files[i].name) : NULL;
+        if (files[i].name && !entry->files[i].name) {
+            free(entry->options);
+            entry->options = NULL;
+        }
+    }
+    if (entry->driverName == NULL || entry->options == NULL) {
+        freeConfCacheEntry(entry);
+        return NULL;
+    }
+    return entry;
+}
+
 void
 driParseConfigFiles(driOptionCache *cache, const driOptionCache *info,
                     int screenNum, const char *driverName)
@@ -992,6 +1301,8 @@ driParseConfigFiles(driOptionCache *cache, const driOptionCache *info,
     char *home;
     uint32_t i;
     struct OptConfData userData;
+    struct ConfFileStamp files[2];
+    struct ConfCacheEntry *entry;
 
     initOptionCache (cache, info);
 
@@ -1011,6 +1322,25 @@ driParseConfigFiles(driOptionCache *cache, const driOptionCache *info,
         }
     }
 
+    for (i = 0; i < 2; ++i)
+        getConfFileStamp (&files[i], filenames[i]);
+
+    simple_mtx_lock(&cacheMutex);
+    entry = findConfCacheEntry (files, screenNum, driverName);
+    if (entry) {
+        for (i = 0; i < entry->numStrings; i += 2) {
+            if (!setConfOption (cache, entry->options[i], entry->options[i+1]))
+                __driUtilMessage ("Illegal value of option %s in configuration "
+                                  "files: %s.", entry->options[i],
+                                  entry->options[i+1]);
+        }
+        simple_mtx_unlock(&cacheMutex);
+        free(filenames[1]);
+        return;
+    }
+
+    userData.entry = createConfCacheEntry (files, screenNum, driverName);
+
     for (i = 0; i < 2; ++i) {
         XML_Parser p;
         if (filenames[i] == NULL)
@@ -1032,6 +1362,14 @@ driParseConfigFiles(driOptionCache *cache, const driOptionCache *info,
         XML_ParserFree (p);
     }
 
+    entry = userData.entry;
+    if (entry && entry->options) {
+        entry->next = confCache;
+        confCache = entry;
+    } else if (entry)
+        freeConfCacheEntry (entry);
+    simple_mtx_unlock(&cacheMutex);
+
     free(filenames[1]);
 }
 
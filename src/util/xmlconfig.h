@@ -97,13 +97,16 @@ typedef struct driOptionCache {
  * For the option information to be available to external configuration tools
  * it must be a public symbol __driConfigOptions. It is also passed as a
  * parameter to driParseOptionInfo in order to avoid driver-independent code
- * depending on symbols in driver-specific code. */
+ * depending on symbols in driver-specific code.
+ *
+ * The parsed info is cached for the next screens of the process. */
 void driParseOptionInfo (driOptionCache *info,
 			 const char *configOptions);
 /** \brief Initialize option cache from info and parse configuration files
  *
  * To be called in <driver>CreateContext. screenNum and driverName select
- * device sections. */
+ * device sections. The options set by the files are cached for each device
+ * until the files change. */
 void driParseConfigFiles (driOptionCache *cache, const driOptionCache *info,
 			  int screenNum, const char *driverName);
 /** \brief Destroy option info
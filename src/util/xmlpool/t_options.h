@@ -351,6 +351,11 @@ DRI_CONF_OPT_BEGIN_B(glx_disable_sgi_video_sync, def) \
    DRI_CONF_DESC(en, gettext("Disable the GLX_SGI_video_sync extension")) \
 DRI_CONF_OPT_END
 
+#define DRI_CONF_MAX_FRAMES_IN_FLIGHT(def) \
+DRI_CONF_OPT_BEGIN_V(max_frames_in_flight, int, def, "-1:4") \
+        DRI_CONF_DESC(en,gettext("Frames a buffer swap leaves in flight before waiting for the oldest, 0 for no limit, -1 for the driver default")) \
+DRI_CONF_OPT_END
+
 
 /**
  * \brief Software-fallback options.  To allow using features (like